@@ -0,0 +1,143 @@
+//! Criterion benchmarks for the crypto FFI
+//! 
+//! Run with `cargo bench`; add `--features profiling` to also print where
+//! the time of the whole run went, phase by phase.
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use rust_crypto::*;
+
+const SIZES: [usize; 5] = [64, 1024, 16 * 1024, 64 * 1024, 1024 * 1024];
+const PASSWORD: &[u8] = b"benchmark password";
+const SALT: [u8; 16] = [0x5a; 16];
+
+fn frame_len(data_len: usize) -> usize {
+    16 + data_len + 16
+}
+
+fn new_handle() -> *mut CrustyKey {
+    let key = [0x42u8; 32];
+    let mut handle: *mut CrustyKey = std::ptr::null_mut();
+    let result = unsafe { create_key_handle(key.as_ptr(), key.len(), &mut handle) };
+    assert_eq!(result, CryptoErrorCode::Success as i32);
+    handle
+}
+
+/// Argon2id at the floor, the library default and the interactive costs
+fn bench_kdf(c: &mut Criterion) {
+    let mut group = c.benchmark_group("kdf");
+    group.sample_size(10);
+    
+    for (memory_kib, iterations) in [(8u32, 1u32), (19 * 1024, 2), (64 * 1024, 3)] {
+        let id = BenchmarkId::from_parameter(format!("m{}_t{}", memory_kib, iterations));
+        group.bench_function(id, |b| {
+            let mut key = [0u8; 32];
+            b.iter(|| unsafe {
+                derive_key_with_params(PASSWORD.as_ptr(), PASSWORD.len(), SALT.as_ptr(), SALT.len(),
+                                       memory_kib, iterations, 1, key.as_mut_ptr(), key.len())
+            });
+        });
+    }
+    group.finish();
+}
+
+/// AES-256-GCM per message size, with and without a key schedule per call
+fn bench_aead(c: &mut Criterion) {
+    let handle = new_handle();
+    let key = [0x42u8; 32];
+    let mut group = c.benchmark_group("aead");
+    
+    for size in SIZES {
+        let data = vec![0xa5u8; size];
+        let mut frame = vec![0u8; frame_len(size)];
+        let mut plaintext = vec![0u8; size];
+        let mut len = 0;
+        group.throughput(Throughput::Bytes(size as u64));
+        
+        group.bench_with_input(BenchmarkId::new("encrypt_with_handle", size), &size, |b, _| {
+            b.iter(|| unsafe {
+                encrypt_with_handle(handle, data.as_ptr(), data.len(), frame.as_mut_ptr(), frame.len(), &mut len)
+            });
+        });
+        
+        group.bench_with_input(BenchmarkId::new("encrypt_with_key", size), &size, |b, _| {
+            b.iter(|| unsafe {
+                encrypt_with_key(data.as_ptr(), data.len(), key.as_ptr(), key.len(),
+                                 frame.as_mut_ptr(), frame.len(), &mut len)
+            });
+        });
+        
+        let result = unsafe {
+            encrypt_with_handle(handle, data.as_ptr(), data.len(), frame.as_mut_ptr(), frame.len(), &mut len)
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        group.bench_with_input(BenchmarkId::new("decrypt_with_handle", size), &size, |b, _| {
+            b.iter(|| unsafe {
+                decrypt_with_handle(handle, frame.as_ptr(), frame.len(),
+                                    plaintext.as_mut_ptr(), plaintext.len(), &mut len)
+            });
+        });
+    }
+    group.finish();
+    
+    unsafe { destroy_key_handle(handle) };
+}
+
+/// Cost of getting a nonce: OS RNG, handle counter or caller-supplied
+fn bench_nonce(c: &mut Criterion) {
+    let handle = new_handle();
+    let key = [0x42u8; 32];
+    let mut group = c.benchmark_group("nonce");
+    
+    group.bench_function("fill_random_bytes", |b| {
+        let mut nonce = [0u8; 12];
+        b.iter(|| unsafe { fill_random_bytes(nonce.as_mut_ptr(), nonce.len()) });
+    });
+    
+    // Empty messages leave only the nonce, framing and tag of each call
+    let mut frame = vec![0u8; frame_len(0)];
+    let mut len = 0;
+    group.bench_function("empty_with_key", |b| {
+        b.iter(|| unsafe {
+            encrypt_with_key(frame.as_ptr(), 0, key.as_ptr(), key.len(), frame.as_mut_ptr(), frame.len(), &mut len)
+        });
+    });
+    group.bench_function("empty_with_handle", |b| {
+        b.iter(|| unsafe {
+            encrypt_with_handle(handle, frame.as_ptr(), 0, frame.as_mut_ptr(), frame.len(), &mut len)
+        });
+    });
+    group.bench_function("empty_with_nonce", |b| {
+        let nonce = [7u8; 12];
+        b.iter(|| unsafe {
+            encrypt_with_nonce(handle, frame.as_ptr(), 0, black_box(nonce.as_ptr()),
+                               frame.as_mut_ptr(), frame.len(), &mut len)
+        });
+    });
+    group.finish();
+    
+    unsafe { destroy_key_handle(handle) };
+}
+
+/// Prints the phase totals of the run when built with `profiling`
+fn report_profile(_c: &mut Criterion) {
+    let mut profile = CryptoProfile::default();
+    if unsafe { get_crypto_profile(&mut profile) } != CryptoErrorCode::Success as i32 {
+        return;
+    }
+    
+    let phases = [
+        ("kdf", profile.kdf),
+        ("cipher_init", profile.cipher_init),
+        ("aead", profile.aead),
+        ("copy_out", profile.copy_out),
+    ];
+    let total: u64 = phases.iter().map(|(_, stats)| stats.nanos).sum::<u64>().max(1);
+    println!("\nphase          calls        total ms   share");
+    for (name, stats) in phases {
+        println!("{:<12} {:>9} {:>15.1} {:>6.1}%", name, stats.calls,
+                 stats.nanos as f64 / 1e6, stats.nanos as f64 * 100.0 / total as f64);
+    }
+}
+
+criterion_group!(benches, bench_kdf, bench_aead, bench_nonce, report_profile);
+criterion_main!(benches);
@@ -125,101 +125,21 @@ fn main() {
         Ok(bindings) => {
             println!("cargo:warning=Successfully generated bindings with cbindgen");
             
-            // Add the namespaces manually since they're not being added properly by cbindgen
-            let mut header_content = String::from("/* This file was generated by cbindgen */\n#pragma once\n\n");
-            header_content.push_str("#include <stdint.h>\n#include <stddef.h>\n\n");
-            header_content.push_str("namespace crusty {\nnamespace crypto {\n\n");
-            
-            // For the enum
-            header_content.push_str("enum class CryptoErrorCode {\n");
-            header_content.push_str("    Success = 0,\n");
-            header_content.push_str("    InvalidParams = -1,\n");
-            header_content.push_str("    AuthenticationFailed = -2,\n");
-            header_content.push_str("    EncryptionError = -3,\n");
-            header_content.push_str("    DecryptionError = -4,\n");
-            header_content.push_str("    KeyDerivationError = -5,\n");
-            header_content.push_str("    BufferTooSmall = -6,\n");
-            header_content.push_str("    InternalError = -7,\n");
-            header_content.push_str("    HardwareNotAvailable = -8\n");
-            header_content.push_str("};\n\n");
-            
-            // We can't directly get bindings as a string, so we'll just use our predefined function declarations
-            // No need to extract from bindings
-            
-            // Add extern "C" block
-            header_content.push_str("#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n");
-            
-            // Function declarations
-            header_content.push_str("/**\n * Encrypts data using AES-256-GCM with the provided password\n");
-            header_content.push_str(" * \n * # Safety\n");
-            header_content.push_str(" * \n * This function is unsafe because it dereferences raw pointers.\n");
-            header_content.push_str(" * The caller must ensure that:\n");
-            header_content.push_str(" * - `data_ptr` points to a valid buffer of at least `data_len` bytes\n");
-            header_content.push_str(" * - `password_ptr` points to a valid buffer of at least `password_len` bytes\n");
-            header_content.push_str(" * - `output_ptr` points to a buffer of at least `output_max_len` bytes\n");
-            header_content.push_str(" * - `output_len` points to a valid `size_t`\n");
-            header_content.push_str(" */\n");
-            header_content.push_str("int32_t encrypt_data(\n");
-            header_content.push_str("    const uint8_t* data_ptr, size_t data_len,\n");
-            header_content.push_str("    const uint8_t* password_ptr, size_t password_len,\n");
-            header_content.push_str("    uint8_t* output_ptr, size_t output_max_len,\n");
-            header_content.push_str("    size_t* output_len\n");
-            header_content.push_str(");\n\n");
-            
-            header_content.push_str("/**\n * Decrypts data using AES-256-GCM with the provided password\n");
-            header_content.push_str(" * \n * # Safety\n");
-            header_content.push_str(" * \n * This function is unsafe because it dereferences raw pointers.\n");
-            header_content.push_str(" * The caller must ensure that:\n");
-            header_content.push_str(" * - `data_ptr` points to a valid buffer of at least `data_len` bytes\n");
-            header_content.push_str(" * - `password_ptr` points to a valid buffer of at least `password_len` bytes\n");
-            header_content.push_str(" * - `output_ptr` points to a buffer of at least `output_max_len` bytes\n");
-            header_content.push_str(" * - `output_len` points to a valid `size_t`\n");
-            header_content.push_str(" */\n");
-            header_content.push_str("int32_t decrypt_data(\n");
-            header_content.push_str("    const uint8_t* data_ptr, size_t data_len,\n");
-            header_content.push_str("    const uint8_t* password_ptr, size_t password_len,\n");
-            header_content.push_str("    uint8_t* output_ptr, size_t output_max_len,\n");
-            header_content.push_str("    size_t* output_len\n");
-            header_content.push_str(");\n\n");
-            
-            header_content.push_str("/**\n * Hashes a password using Argon2id for verification\n");
-            header_content.push_str(" * \n * # Safety\n");
-            header_content.push_str(" * \n * This function is unsafe because it dereferences raw pointers.\n");
-            header_content.push_str(" * The caller must ensure that:\n");
-            header_content.push_str(" * - `password_ptr` points to a valid buffer of at least `password_len` bytes\n");
-            header_content.push_str(" * - `output_ptr` points to a buffer of at least `output_len` bytes\n");
-            header_content.push_str(" */\n");
-            header_content.push_str("int32_t hash_password(\n");
-            header_content.push_str("    const uint8_t* password_ptr, size_t password_len,\n");
-            header_content.push_str("    uint8_t* output_ptr, size_t output_len\n");
-            header_content.push_str(");\n\n");
-            
-            header_content.push_str("/**\n * Derives an encryption key from a password and salt\n");
-            header_content.push_str(" * \n * # Safety\n");
-            header_content.push_str(" * \n * This function is unsafe because it dereferences raw pointers.\n");
-            header_content.push_str(" * The caller must ensure that:\n");
-            header_content.push_str(" * - `password_ptr` points to a valid buffer of at least `password_len` bytes\n");
-            header_content.push_str(" * - `salt_ptr` points to a valid buffer of at least `salt_len` bytes\n");
-            header_content.push_str(" * - `key_ptr` points to a buffer of at least `key_len` bytes\n");
-            header_content.push_str(" */\n");
-            header_content.push_str("int32_t derive_key_from_password(\n");
-            header_content.push_str("    const uint8_t* password_ptr, size_t password_len,\n");
-            header_content.push_str("    const uint8_t* salt_ptr, size_t salt_len,\n");
-            header_content.push_str("    uint8_t* key_ptr, size_t key_len\n");
-            header_content.push_str(");\n\n");
-            
-            // Close extern "C" block
-            header_content.push_str("#ifdef __cplusplus\n}\n#endif\n\n");
-            
-            // Close namespaces
-            header_content.push_str("} // namespace crypto\n");
-            header_content.push_str("} // namespace crusty\n");
-            
-            // Write the modified header to file
-            std::fs::write(out_dir.join("crypto_interface.h"), header_content)
-                .expect("Unable to write header file");
-            
-            println!("cargo:warning=Header file written with corrected namespace and types to {}", out_dir.join("crypto_interface.h").display());
+            // crypto_interface.h is maintained by hand next to lib.rs because cbindgen
+            // does not emit the namespaces and C++ types the C++ layer expects. The raw
+            // cbindgen output is kept in OUT_DIR so the exported FFI surface can be
+            // diffed against the checked-in header, which is only written here when it
+            // is missing entirely.
+            let generated_path = PathBuf::from(env::var("OUT_DIR").unwrap()).join("crypto_interface.generated.h");
+            bindings.write_to_file(&generated_path);
+            println!("cargo:warning=Raw cbindgen output written to {}", generated_path.display());
+            
+            let header_path = out_dir.join("crypto_interface.h");
+            if !header_path.exists() {
+                std::fs::copy(&generated_path, &header_path)
+                    .expect("Unable to write header file");
+                println!("cargo:warning=Header file written to {}", header_path.display());
+            }
         },
         Err(err) => {
             println!("cargo:warning=Error generating bindings with cbindgen: {}", err);
@@ -30,8 +30,8 @@ use stm32h5;
 
 // Common imports for both std and no_std
 use aes_gcm::{
-    aead::{Aead, KeyInit},
-    Key, Nonce
+    aead::{Aead, AeadInPlace, KeyInit},
+    Key, Nonce, Tag
 };
 
 // AES implementation - requires 'aes' feature
@@ -44,6 +44,15 @@ use generic_array::typenum::{U12, U16};
 // Type alias for AES-256 in GCM mode with 12-byte nonce
 type Aes256Gcm = AesGcm<Aes256, U12, U16>;
 
+// Sizes shared by the framed `nonce(12) | len(4) | ciphertext` output format
+const KEY_LEN: usize = 32;
+const NONCE_LEN: usize = 12;
+const FRAME_HEADER_LEN: usize = NONCE_LEN + 4;
+const TAG_LEN: usize = 16;
+
+/// Size of a keyed fingerprint from `fingerprint_with_handle`
+pub const FINGERPRINT_LEN: usize = 32;
+
 // Conditional imports based on features
 #[cfg(feature = "std")]
 use rand::rngs::OsRng;
@@ -66,9 +75,6 @@ use std::slice;
 #[cfg(all(not(feature = "std"), feature = "embedded"))]
 use rand_core::RngCore;
 
-#[cfg(all(not(feature = "std"), feature = "embedded"))]
-use heapless::Vec;
-
 // For embedded targets, we need to provide a panic handler
 #[cfg(all(not(feature = "std"), feature = "embedded"))]
 use core::panic::PanicInfo;
@@ -106,6 +112,22 @@ pub enum CryptoErrorCode {
     HardwareNotAvailable = -8,
 }
 
+/// One message of an `encrypt_batch_with_key` or `decrypt_batch_with_key` call
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct CryptoBatchItem {
+    /// Plaintext to encrypt, or a frame to decrypt
+    pub input_ptr: *const u8,
+    pub input_len: usize,
+    /// Destination buffer for this message
+    pub output_ptr: *mut u8,
+    pub output_max_len: usize,
+    /// Set to the bytes written, or to the size needed on `BufferTooSmall`
+    pub output_len: usize,
+    /// Set to the `CryptoErrorCode` of this message
+    pub status: i32,
+}
+
 /// Encrypts data using AES-256-GCM with the provided password
 /// 
 /// # Safety
@@ -156,10 +178,10 @@ pub unsafe extern "C" fn encrypt_data(
         let nonce = Nonce::from_slice(&nonce_bytes);
         
         // Create the cipher
-        let cipher = Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(&key));
+        let cipher = timed(Phase::CipherInit, || Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(&key)));
         
         // Encrypt the data
-        let ciphertext = match cipher.encrypt(nonce, data) {
+        let ciphertext = match timed(Phase::Aead, || cipher.encrypt(nonce, data)) {
             Ok(c) => c,
             Err(_) => return CryptoErrorCode::EncryptionError as i32,
         };
@@ -182,7 +204,7 @@ pub unsafe extern "C" fn encrypt_data(
         output_slice[12..16].copy_from_slice(&ciphertext_len_bytes);
         
         // Write ciphertext to output
-        output_slice[16..16 + ciphertext.len()].copy_from_slice(&ciphertext);
+        timed(Phase::CopyOut, || output_slice[16..16 + ciphertext.len()].copy_from_slice(&ciphertext));
         
         // Set output length
         *output_len = required_size;
@@ -193,56 +215,7 @@ pub unsafe extern "C" fn encrypt_data(
     // For embedded targets without std, if hardware acceleration failed
     #[cfg(all(not(feature = "std"), feature = "embedded"))]
     {
-        // Simple key derivation for embedded targets
-        let key = match simple_key_derivation(password) {
-            Ok(k) => k,
-            Err(_) => return CryptoErrorCode::KeyDerivationError as i32,
-        };
-        
-        // Generate a random nonce using hardware RNG if available
-        let mut nonce_bytes = [0u8; 12];
-        if let Err(_) = get_random_bytes(&mut nonce_bytes) {
-            return CryptoErrorCode::InternalError as i32;
-        }
-        let nonce = Nonce::from_slice(&nonce_bytes);
-        
-        // Create the cipher
-        let cipher = Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(&key));
-        
-        // Encrypt the data
-        // For embedded targets, we use heapless::Vec to avoid dynamic allocation
-        let mut ciphertext: Vec<u8, 2048> = Vec::new();
-        match cipher.encrypt_in_place_detached(nonce, data, &mut ciphertext) {
-            Ok(_tag) => {},
-            Err(_) => return CryptoErrorCode::EncryptionError as i32,
-        }
-        
-        // Calculate required output size
-        let required_size = 12 + 4 + ciphertext.len(); // nonce + ciphertext length + ciphertext
-        
-        // Check if output buffer is large enough
-        if output_max_len < required_size {
-            *output_len = required_size;
-            return CryptoErrorCode::BufferTooSmall as i32;
-        }
-        
-        // Write nonce to output
-        let output_slice = core::slice::from_raw_parts_mut(output_ptr, output_max_len);
-        output_slice[0..12].copy_from_slice(&nonce_bytes);
-        
-        // Write ciphertext length to output
-        let ciphertext_len_bytes = (ciphertext.len() as u32).to_be_bytes();
-        output_slice[12..16].copy_from_slice(&ciphertext_len_bytes);
-        
-        // Write ciphertext to output
-        for (i, &byte) in ciphertext.iter().enumerate() {
-            output_slice[16 + i] = byte;
-        }
-        
-        // Set output length
-        *output_len = required_size;
-        
-        return CryptoErrorCode::Success as i32;
+        return encrypt_with_software(data, password, output_ptr, output_max_len, output_len);
     }
     
     // If we get here, neither std nor embedded features are enabled
@@ -292,9 +265,6 @@ pub unsafe extern "C" fn decrypt_data(
         // Fall back to software implementation if hardware acceleration fails
     }
     
-    // Extract the nonce
-    let nonce = Nonce::from_slice(&data[0..12]);
-    
     // Extract the ciphertext length
     let ciphertext_len = u32::from_be_bytes([data[12], data[13], data[14], data[15]]) as usize;
     
@@ -303,12 +273,18 @@ pub unsafe extern "C" fn decrypt_data(
         return CryptoErrorCode::InvalidParams as i32;
     }
     
-    // Extract the ciphertext
-    let ciphertext = &data[16..16 + ciphertext_len];
-    
     // Software implementation
     #[cfg(feature = "std")]
     {
+        // Report the needed size before paying for key derivation
+        if ciphertext_len < TAG_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        if output_max_len < ciphertext_len - TAG_LEN {
+            *output_len = ciphertext_len - TAG_LEN;
+            return CryptoErrorCode::BufferTooSmall as i32;
+        }
+        
         // Derive key from password
         let key = match derive_key_from_password_internal(password) {
             Ok(k) => k,
@@ -316,72 +292,346 @@ pub unsafe extern "C" fn decrypt_data(
         };
         
         // Create the cipher
-        let cipher = Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(&key));
-        
-        // Decrypt the data
-        let plaintext = match cipher.decrypt(nonce, ciphertext) {
-            Ok(p) => p,
-            Err(_) => return CryptoErrorCode::AuthenticationFailed as i32,
-        };
-        
-        // Check if output buffer is large enough
-        if output_max_len < plaintext.len() {
-            *output_len = plaintext.len();
-            return CryptoErrorCode::BufferTooSmall as i32;
-        }
-        
-        // Write plaintext to output
-        let output_slice = core::slice::from_raw_parts_mut(output_ptr, output_max_len);
-        output_slice[0..plaintext.len()].copy_from_slice(&plaintext);
-        
-        // Set output length
-        *output_len = plaintext.len();
+        let cipher = timed(Phase::CipherInit, || Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(&key)));
         
-        return CryptoErrorCode::Success as i32;
+        // Decrypt straight into the caller's buffer, with no intermediate Vec
+        return open_frame(&cipher, &data[..16 + ciphertext_len], output_ptr, output_max_len, &mut *output_len);
     }
     
     // For embedded targets without std, if hardware acceleration failed
     #[cfg(all(not(feature = "std"), feature = "embedded"))]
     {
-        // Simple key derivation for embedded targets
-        let key = match simple_key_derivation(password) {
-            Ok(k) => k,
-            Err(_) => return CryptoErrorCode::KeyDerivationError as i32,
-        };
-        
-        // Create the cipher
-        let cipher = Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(&key));
+        return decrypt_with_software(&data[..16 + ciphertext_len], password, output_ptr, output_max_len, output_len);
+    }
+    
+    // If we get here, neither std nor embedded features are enabled
+    #[cfg(not(any(feature = "std", feature = "embedded")))]
+    {
+        return CryptoErrorCode::InternalError as i32;
+    }
+}
+
+/// AES-GCM implementation used on this CPU
+#[repr(C)]
+#[derive(Debug, Copy, Clone, PartialEq)]
+pub enum AesBackend {
+    /// Portable constant-time software implementation
+    Software = 0,
+    /// AES-NI rounds with PCLMULQDQ for GHASH (x86/x86_64)
+    AesNiClmul = 1,
+    /// ARMv8 Cryptography Extensions: AES rounds with PMULL for GHASH (aarch64)
+    Armv8Crypto = 2,
+}
+
+/// AES round instructions (AES-NI or ARMv8 AES)
+pub const CPU_FEATURE_AES: u32 = 1 << 0;
+/// Carry-less multiplication for GHASH (PCLMULQDQ or PMULL)
+pub const CPU_FEATURE_CLMUL: u32 = 1 << 1;
+/// AVX2
+pub const CPU_FEATURE_AVX2: u32 = 1 << 2;
+/// Vector AES (VAES)
+pub const CPU_FEATURE_VAES: u32 = 1 << 3;
+/// Vector carry-less multiplication (VPCLMULQDQ)
+pub const CPU_FEATURE_VPCLMULQDQ: u32 = 1 << 4;
+/// AVX-512 Foundation
+pub const CPU_FEATURE_AVX512F: u32 = 1 << 5;
+
+#[cfg(all(feature = "std", any(target_arch = "x86", target_arch = "x86_64")))]
+fn detect_cpu_features() -> u32 {
+    let mut features = 0;
+    if is_x86_feature_detected!("aes") && is_x86_feature_detected!("sse2") {
+        features |= CPU_FEATURE_AES;
+    }
+    if is_x86_feature_detected!("pclmulqdq") {
+        features |= CPU_FEATURE_CLMUL;
+    }
+    if is_x86_feature_detected!("avx2") {
+        features |= CPU_FEATURE_AVX2;
+    }
+    if is_x86_feature_detected!("vaes") {
+        features |= CPU_FEATURE_VAES;
+    }
+    if is_x86_feature_detected!("vpclmulqdq") {
+        features |= CPU_FEATURE_VPCLMULQDQ;
+    }
+    if is_x86_feature_detected!("avx512f") {
+        features |= CPU_FEATURE_AVX512F;
+    }
+    features
+}
+
+#[cfg(all(feature = "std", target_arch = "aarch64"))]
+fn detect_cpu_features() -> u32 {
+    // Rust's "aes" feature on aarch64 covers both AESE/AESD and PMULL
+    if std::arch::is_aarch64_feature_detected!("aes") {
+        CPU_FEATURE_AES | CPU_FEATURE_CLMUL
+    } else {
+        0
+    }
+}
+
+#[cfg(all(feature = "std", not(any(target_arch = "x86", target_arch = "x86_64", target_arch = "aarch64"))))]
+fn detect_cpu_features() -> u32 {
+    0
+}
+
+/// CPU features relevant to AES-GCM, detected on first use and cached
+fn cpu_features() -> u32 {
+    #[cfg(feature = "std")]
+    {
+        static FEATURES: std::sync::OnceLock<u32> = std::sync::OnceLock::new();
+        *FEATURES.get_or_init(detect_cpu_features)
+    }
+    
+    // Embedded targets are handled by the hardware crypto path instead
+    #[cfg(not(feature = "std"))]
+    {
+        0
+    }
+}
+
+/// Backend the `aes` and `polyval` crates dispatch to on this CPU
+/// 
+/// Both crates pick their implementation at run time from the same CPUID
+/// (x86) or HWCAP (aarch64) bits. On aarch64 the ARMv8 code is only compiled
+/// in with `--cfg aes_armv8 --cfg polyval_armv8`, which `.cargo/config.toml`
+/// sets for this crate.
+fn aes_backend() -> AesBackend {
+    let required = CPU_FEATURE_AES | CPU_FEATURE_CLMUL;
+    let hardware = cpu_features() & required == required;
+
+    #[cfg(all(any(target_arch = "x86", target_arch = "x86_64"), not(aes_force_soft)))]
+    if hardware {
+        return AesBackend::AesNiClmul;
+    }
+
+    #[cfg(all(target_arch = "aarch64", aes_armv8, polyval_armv8, not(aes_force_soft)))]
+    if hardware {
+        return AesBackend::Armv8Crypto;
+    }
+    
+    let _ = hardware;
+    AesBackend::Software
+}
+
+/// Returns the AES-GCM backend used on this CPU as an `AesBackend` value
+#[no_mangle]
+pub extern "C" fn get_aes_backend() -> i32 {
+    aes_backend() as i32
+}
+
+/// Returns the detected `CPU_FEATURE_*` bits
+#[no_mangle]
+pub extern "C" fn get_cpu_features() -> u32 {
+    cpu_features()
+}
+
+/// Checks that AES-GCM runs on hardware instructions
+/// 
+/// Returns `HardwareNotAvailable` when only the software implementation can be used.
+#[no_mangle]
+pub extern "C" fn require_hardware_aes() -> i32 {
+    if aes_backend() == AesBackend::Software {
+        CryptoErrorCode::HardwareNotAvailable as i32
+    } else {
+        CryptoErrorCode::Success as i32
+    }
+}
+
+/// Time and call count of one phase, as reported by `get_crypto_profile`
+#[repr(C)]
+#[derive(Debug, Copy, Clone, Default, PartialEq)]
+pub struct CryptoPhaseStats {
+    /// Number of times the phase ran
+    pub calls: u64,
+    /// Total wall-clock time spent in the phase, in nanoseconds
+    pub nanos: u64,
+}
+
+/// Per-phase timings collected by the `profiling` feature
+#[repr(C)]
+#[derive(Debug, Copy, Clone, Default, PartialEq)]
+pub struct CryptoProfile {
+    /// Argon2id key derivation and password hashing
+    pub kdf: CryptoPhaseStats,
+    /// AES-256 key schedule and GHASH key setup
+    pub cipher_init: CryptoPhaseStats,
+    /// AES-GCM encryption or decryption including the tag
+    pub aead: CryptoPhaseStats,
+    /// Moving data between caller buffers and frames
+    pub copy_out: CryptoPhaseStats,
+}
+
+/// Per-phase timers behind the `profiling` feature
+/// 
+/// Without the feature `timed` just runs its closure, so the
+/// instrumentation compiles away.
+mod profiling {
+    use super::CryptoProfile;
+    
+    #[derive(Debug, Copy, Clone)]
+    pub(crate) enum Phase {
+        Kdf,
+        CipherInit,
+        Aead,
+        CopyOut,
+    }
+    
+    #[cfg(feature = "profiling")]
+    mod counters {
+        use super::{CryptoProfile, Phase};
+        use crate::CryptoPhaseStats;
+        use std::sync::atomic::{AtomicU64, Ordering};
+        use std::time::Instant;
+        
+        const PHASES: usize = 4;
+        
+        static CALLS: [AtomicU64; PHASES] = [AtomicU64::new(0), AtomicU64::new(0), AtomicU64::new(0), AtomicU64::new(0)];
+        static NANOS: [AtomicU64; PHASES] = [AtomicU64::new(0), AtomicU64::new(0), AtomicU64::new(0), AtomicU64::new(0)];
+        
+        pub(crate) fn counted<T>(phase: Phase, f: impl FnOnce() -> T) -> T {
+            let start = Instant::now();
+            let result = f();
+            let elapsed = start.elapsed().as_nanos().min(u64::MAX as u128) as u64;
+            CALLS[phase as usize].fetch_add(1, Ordering::Relaxed);
+            NANOS[phase as usize].fetch_add(elapsed, Ordering::Relaxed);
+            result
+        }
         
-        // Decrypt the data
-        // For embedded targets, we use heapless::Vec to avoid dynamic allocation
-        let mut plaintext: Vec<u8, 2048> = Vec::new();
-        match cipher.decrypt_in_place_detached(nonce, ciphertext, &mut plaintext) {
-            Ok(_) => {},
-            Err(_) => return CryptoErrorCode::AuthenticationFailed as i32,
+        pub(crate) fn snapshot() -> CryptoProfile {
+            let phase = |p: Phase| CryptoPhaseStats {
+                calls: CALLS[p as usize].load(Ordering::Relaxed),
+                nanos: NANOS[p as usize].load(Ordering::Relaxed),
+            };
+            CryptoProfile {
+                kdf: phase(Phase::Kdf),
+                cipher_init: phase(Phase::CipherInit),
+                aead: phase(Phase::Aead),
+                copy_out: phase(Phase::CopyOut),
+            }
         }
         
-        // Check if output buffer is large enough
-        if output_max_len < plaintext.len() {
-            *output_len = plaintext.len();
-            return CryptoErrorCode::BufferTooSmall as i32;
+        pub(crate) fn reset() {
+            for counter in CALLS.iter().chain(NANOS.iter()) {
+                counter.store(0, Ordering::Relaxed);
+            }
         }
+    }
+    
+    #[cfg(feature = "profiling")]
+    use counters::counted;
+    #[cfg(feature = "profiling")]
+    pub(crate) use counters::{reset, snapshot};
+    
+    #[cfg(not(feature = "profiling"))]
+    #[inline(always)]
+    fn counted<T>(_phase: Phase, f: impl FnOnce() -> T) -> T {
+        f()
+    }
+    
+    /// Reports phase boundaries to the callback the host installed with
+    /// `set_trace_callback`, so its own tracer can lay the phases out on
+    /// its timeline
+    #[cfg(feature = "tracing")]
+    pub(crate) mod spans {
+        use super::Phase;
+        use std::sync::atomic::{AtomicUsize, Ordering};
         
-        // Write plaintext to output
-        let output_slice = core::slice::from_raw_parts_mut(output_ptr, output_max_len);
-        for (i, &byte) in plaintext.iter().enumerate() {
-            output_slice[i] = byte;
+        pub(crate) type Callback = extern "C" fn(phase: u32, begin: u8);
+        
+        static CALLBACK: AtomicUsize = AtomicUsize::new(0);
+        
+        pub(crate) fn install(callback: Option<Callback>) {
+            CALLBACK.store(callback.map_or(0, |f| f as usize), Ordering::Release);
         }
         
-        // Set output length
-        *output_len = plaintext.len();
+        #[inline(always)]
+        pub(crate) fn traced<T>(phase: Phase, f: impl FnOnce() -> T) -> T {
+            let raw = CALLBACK.load(Ordering::Acquire);
+            if raw == 0 {
+                return f();
+            }
+            // SAFETY: only `install` stores non-zero values, all of them `Callback`s
+            let callback: Callback = unsafe { core::mem::transmute::<usize, Callback>(raw) };
+            callback(phase as u32, 1);
+            let result = f();
+            callback(phase as u32, 0);
+            result
+        }
+    }
+    
+    #[cfg(not(feature = "tracing"))]
+    mod spans {
+        use super::Phase;
         
-        return CryptoErrorCode::Success as i32;
+        #[inline(always)]
+        pub(crate) fn traced<T>(_phase: Phase, f: impl FnOnce() -> T) -> T {
+            f()
+        }
     }
     
-    // If we get here, neither std nor embedded features are enabled
-    #[cfg(not(any(feature = "std", feature = "embedded")))]
+    /// Runs `f`; timing is only recorded with the `profiling` feature, and
+    /// only reported to the host with the `tracing` feature
+    #[inline(always)]
+    pub(crate) fn timed<T>(phase: Phase, f: impl FnOnce() -> T) -> T {
+        spans::traced(phase, || counted(phase, f))
+    }
+    
+    #[cfg(not(feature = "profiling"))]
+    pub(crate) fn snapshot() -> CryptoProfile {
+        CryptoProfile::default()
+    }
+    
+    #[cfg(not(feature = "profiling"))]
+    pub(crate) fn reset() {}
+}
+
+use profiling::{timed, Phase};
+
+/// Copies the per-phase timings collected since start-up or the last reset
+/// 
+/// Returns `InternalError`, with the profile zeroed, when the library was
+/// built without the `profiling` feature.
+/// 
+/// # Safety
+/// 
+/// `profile_out` must point to a writable `CryptoProfile`.
+#[no_mangle]
+pub unsafe extern "C" fn get_crypto_profile(profile_out: *mut CryptoProfile) -> i32 {
+    if profile_out.is_null() {
+        return CryptoErrorCode::InvalidParams as i32;
+    }
+    
+    *profile_out = profiling::snapshot();
+    if cfg!(feature = "profiling") {
+        CryptoErrorCode::Success as i32
+    } else {
+        CryptoErrorCode::InternalError as i32
+    }
+}
+
+/// Sets every phase timer back to zero
+#[no_mangle]
+pub extern "C" fn reset_crypto_profile() {
+    profiling::reset();
+}
+
+/// Installs the callback each phase reports to, or removes it when null
+/// 
+/// The callback runs on the thread doing the work and must not call back
+/// into the library. Returns `InternalError` when the library was built
+/// without the `tracing` feature.
+#[no_mangle]
+pub extern "C" fn set_trace_callback(callback: Option<extern "C" fn(phase: u32, begin: u8)>) -> i32 {
+    #[cfg(feature = "tracing")]
     {
-        return CryptoErrorCode::InternalError as i32;
+        profiling::spans::install(callback);
+        CryptoErrorCode::Success as i32
+    }
+    #[cfg(not(feature = "tracing"))]
+    {
+        let _ = callback;
+        CryptoErrorCode::InternalError as i32
     }
 }
 
@@ -389,6 +639,75 @@ pub unsafe extern "C" fn decrypt_data(
 #[cfg(feature = "std")]
 mod std_features {
     use super::*;
+    use argon2::{Algorithm, Params, Version};
+    use hmac::{Hmac, Mac};
+    use sha2::Sha256;
+    use std::sync::atomic::{AtomicU64, Ordering};
+    use zeroize::Zeroizing;
+    
+    type HmacSha256 = Hmac<Sha256>;
+    
+    // Far beyond any real message count; only keeps the counter from wrapping
+    const NONCE_COUNTER_LIMIT: u64 = u64::MAX / 2;
+    
+    // Label the fingerprint key is derived under, so it never equals the cipher key
+    const FINGERPRINT_KEY_LABEL: &[u8] = b"CRUSTy fingerprint key v1";
+    
+    /// Expanded AES-256-GCM key with its own nonce sequence
+    /// 
+    /// Sits in Rust-owned memory behind the opaque `crusty_key_t` handle of
+    /// the C interface, and its key schedule is zeroized when the handle is
+    /// destroyed. Nonces continue from a random 96-bit starting value, so
+    /// encryptions through one handle never repeat a nonce and need no RNG
+    /// call of their own. A handle may be used from several threads at once.
+    /// 
+    /// The handle also keeps an HMAC key derived from the key, used only by
+    /// `fingerprint_with_handle` and zeroized with the rest.
+    pub struct CrustyKey {
+        cipher: Aes256Gcm,
+        nonce_base: [u8; NONCE_LEN],
+        nonce_counter: AtomicU64,
+        fingerprint_key: Zeroizing<[u8; FINGERPRINT_LEN]>,
+    }
+    
+    impl CrustyKey {
+        fn new(key: &[u8]) -> Self {
+            let mut nonce_base = [0u8; NONCE_LEN];
+            OsRng.fill_bytes(&mut nonce_base);
+            CrustyKey {
+                cipher: timed(Phase::CipherInit, || Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(key))),
+                nonce_base,
+                nonce_counter: AtomicU64::new(0),
+                fingerprint_key: derive_fingerprint_key(key),
+            }
+        }
+        
+        /// Next nonce of this handle's sequence, or `None` once it is used up
+        fn next_nonce(&self) -> Option<[u8; NONCE_LEN]> {
+            let count = self.nonce_counter.fetch_add(1, Ordering::Relaxed);
+            if count >= NONCE_COUNTER_LIMIT {
+                return None;
+            }
+            
+            // Count in the low 64 bits of the random starting value
+            let mut nonce = self.nonce_base;
+            let mut low = [0u8; 8];
+            low.copy_from_slice(&nonce[NONCE_LEN - 8..]);
+            let low = u64::from_be_bytes(low).wrapping_add(count);
+            nonce[NONCE_LEN - 8..].copy_from_slice(&low.to_be_bytes());
+            Some(nonce)
+        }
+    }
+    
+    /// HMAC-SHA256 of a fixed label under the key, the key's fingerprint subkey
+    fn derive_fingerprint_key(key: &[u8]) -> Zeroizing<[u8; FINGERPRINT_LEN]> {
+        let mut subkey = Zeroizing::new([0u8; FINGERPRINT_LEN]);
+        // HMAC takes keys of any length, so this cannot fail
+        let mut mac = <HmacSha256 as Mac>::new_from_slice(key).expect("HMAC accepts any key length");
+        mac.update(FINGERPRINT_KEY_LABEL);
+        subkey.copy_from_slice(&mac.finalize().into_bytes());
+        subkey
+    }
     
     /// Hashes a password using Argon2id for verification
     /// 
@@ -418,7 +737,7 @@ mod std_features {
         let argon2 = Argon2::default();
         
         // Hash the password
-        let password_hash = match argon2.hash_password(password, &salt) {
+        let password_hash = match timed(Phase::Kdf, || argon2.hash_password(password, &salt)) {
             Ok(hash) => hash.to_string(),
             Err(_) => return CryptoErrorCode::KeyDerivationError as i32,
         };
@@ -474,7 +793,7 @@ mod std_features {
         
         // Derive key
         let mut key = [0u8; 32];
-        if let Err(_) = argon2.hash_password_into(password, salt, &mut key) {
+        if let Err(_) = timed(Phase::Kdf, || argon2.hash_password_into(password, salt, &mut key)) {
             return CryptoErrorCode::KeyDerivationError as i32;
         }
         
@@ -485,106 +804,1459 @@ mod std_features {
         CryptoErrorCode::Success as i32
     }
 
-    // Internal function to derive a key from a password
-    pub(crate) fn derive_key_from_password_internal(password: &[u8]) -> Result<[u8; 32], ()> {
-        // Generate a salt
-        let salt = SaltString::generate(&mut Argon2OsRng);
+    /// Derives an encryption key from a password and salt with explicit Argon2id costs
+    /// 
+    /// Used by the file engine so the costs recorded in a file header are the ones
+    /// applied when the file is decrypted, independent of `Argon2::default()`.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `password_ptr` points to a valid buffer of at least `password_len` bytes
+    /// - `salt_ptr` points to a valid buffer of at least `salt_len` bytes
+    /// - `key_ptr` points to a buffer of at least `key_len` bytes
+    #[no_mangle]
+    pub unsafe extern "C" fn derive_key_with_params(
+        password_ptr: *const u8, password_len: usize,
+        salt_ptr: *const u8, salt_len: usize,
+        memory_kib: u32, iterations: u32, parallelism: u32,
+        key_ptr: *mut u8, key_len: usize
+    ) -> i32 {
+        // Validate parameters
+        if password_ptr.is_null() || salt_ptr.is_null() || key_ptr.is_null() || key_len != KEY_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
         
-        // Create Argon2id instance
-        let argon2 = Argon2::default();
+        let params = match Params::new(memory_kib, iterations, parallelism, Some(KEY_LEN)) {
+            Ok(p) => p,
+            Err(_) => return CryptoErrorCode::InvalidParams as i32,
+        };
         
-        // Derive key
-        let mut key = [0u8; 32];
-        argon2.hash_password_into(password, salt.as_str().as_bytes(), &mut key)
-            .map_err(|_| ())?;
+        // Convert raw pointers to slices
+        let password = std::slice::from_raw_parts(password_ptr, password_len);
+        let salt = std::slice::from_raw_parts(salt_ptr, salt_len);
+        let key_slice = std::slice::from_raw_parts_mut(key_ptr, key_len);
         
-        Ok(key)
+        // Derive straight into the caller's buffer so no stack copy of the key remains
+        let argon2 = Argon2::new(Algorithm::Argon2id, Version::V0x13, params);
+        if timed(Phase::Kdf, || argon2.hash_password_into(password, salt, key_slice)).is_err() {
+            key_slice.fill(0);
+            return CryptoErrorCode::KeyDerivationError as i32;
+        }
+        
+        CryptoErrorCode::Success as i32
     }
-}
-
-// The following functions are only available with the embedded feature
-#[cfg(feature = "embedded")]
-mod embedded_features {
-    use super::*;
     
-    // Simple key derivation for embedded targets
-    // This is a placeholder and should be replaced with a more secure implementation
-    pub(crate) fn simple_key_derivation(password: &[u8]) -> Result<[u8; 32], ()> {
-        let mut key = [0u8; 32];
-        
-        // Simple key derivation: repeat the password to fill the key
-        for (i, &byte) in password.iter().cycle().take(32).enumerate() {
-            key[i] = byte;
+    /// Fills a buffer with bytes from the operating system CSPRNG
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that `buffer_ptr` points to a buffer of at least `buffer_len` bytes
+    #[no_mangle]
+    pub unsafe extern "C" fn fill_random_bytes(buffer_ptr: *mut u8, buffer_len: usize) -> i32 {
+        if buffer_ptr.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
         }
         
-        Ok(key)
+        let buffer = std::slice::from_raw_parts_mut(buffer_ptr, buffer_len);
+        match OsRng.try_fill_bytes(buffer) {
+            Ok(_) => CryptoErrorCode::Success as i32,
+            Err(_) => CryptoErrorCode::InternalError as i32,
+        }
     }
     
-    // Get random bytes using hardware RNG if available
+    /// Encrypts data using AES-256-GCM with an already derived 32-byte key
+    /// 
+    /// The output uses the same `nonce(12) | len(4) | ciphertext` framing as
+    /// `encrypt_data`, but skips key derivation so a file can derive its key once
+    /// and encrypt every chunk with it. Encryption happens directly in the
+    /// output buffer, which may overlap the input.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `data_ptr` points to a valid buffer of at least `data_len` bytes
+    /// - `key_ptr` points to a valid buffer of at least `key_len` bytes
+    /// - `output_ptr` points to a buffer of at least `output_max_len` bytes
+    /// - `output_len` points to a valid `usize`
+    #[no_mangle]
+    pub unsafe extern "C" fn encrypt_with_key(
+        data_ptr: *const u8, data_len: usize,
+        key_ptr: *const u8, key_len: usize,
+        output_ptr: *mut u8, output_max_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        // Validate parameters
+        if data_ptr.is_null() || key_ptr.is_null() || output_ptr.is_null() || output_len.is_null() || key_len != KEY_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        // Check if output buffer is large enough before doing any work
+        let required_size = FRAME_HEADER_LEN + data_len + TAG_LEN;
+        if output_max_len < required_size {
+            *output_len = required_size;
+            return CryptoErrorCode::BufferTooSmall as i32;
+        }
+        
+        // Move the plaintext into place; `copy` tolerates overlapping buffers
+        timed(Phase::CopyOut, || core::ptr::copy(data_ptr, output_ptr.add(FRAME_HEADER_LEN), data_len));
+        
+        let key = std::slice::from_raw_parts(key_ptr, key_len);
+        let frame = std::slice::from_raw_parts_mut(output_ptr, required_size);
+        let result = seal_frame_in_place(key, frame, data_len);
+        if result == CryptoErrorCode::Success as i32 {
+            *output_len = required_size;
+        }
+        result
+    }
+    
+    /// Encrypts a chunk in place using an already derived 32-byte key
+    /// 
+    /// The plaintext must already sit at offset 16 of the buffer. The nonce and
+    /// length prefix are written in front of it and the tag after it, giving the
+    /// same frame as `encrypt_with_key` without copying the data.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `buffer_ptr` points to a valid buffer of at least `buffer_len` bytes
+    /// - `key_ptr` points to a valid buffer of at least `key_len` bytes
+    /// - `output_len` points to a valid `usize`
+    #[no_mangle]
+    pub unsafe extern "C" fn encrypt_in_place_with_key(
+        buffer_ptr: *mut u8, buffer_len: usize,
+        plaintext_len: usize,
+        key_ptr: *const u8, key_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        // Validate parameters
+        if buffer_ptr.is_null() || key_ptr.is_null() || output_len.is_null() || key_len != KEY_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        // Check if the buffer has room for the frame around the plaintext
+        let required_size = FRAME_HEADER_LEN + plaintext_len + TAG_LEN;
+        if buffer_len < required_size {
+            *output_len = required_size;
+            return CryptoErrorCode::BufferTooSmall as i32;
+        }
+        
+        let key = std::slice::from_raw_parts(key_ptr, key_len);
+        let frame = std::slice::from_raw_parts_mut(buffer_ptr, required_size);
+        let result = seal_frame_in_place(key, frame, plaintext_len);
+        if result == CryptoErrorCode::Success as i32 {
+            *output_len = required_size;
+        }
+        result
+    }
+    
+    /// Decrypts a frame produced by `encrypt_with_key` using an already derived key
+    /// 
+    /// The plaintext is decrypted directly into the output buffer and wiped
+    /// again if the tag does not verify.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `data_ptr` points to a valid buffer of at least `data_len` bytes
+    /// - `key_ptr` points to a valid buffer of at least `key_len` bytes
+    /// - `output_ptr` points to a buffer of at least `output_max_len` bytes
+    ///   that does not overlap the input
+    /// - `output_len` points to a valid `usize`
+    #[no_mangle]
+    pub unsafe extern "C" fn decrypt_with_key(
+        data_ptr: *const u8, data_len: usize,
+        key_ptr: *const u8, key_len: usize,
+        output_ptr: *mut u8, output_max_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        // Validate parameters
+        if data_ptr.is_null() || key_ptr.is_null() || output_ptr.is_null() || output_len.is_null() || key_len != KEY_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        // Convert raw pointers to slices
+        let data = std::slice::from_raw_parts(data_ptr, data_len);
+        let key = std::slice::from_raw_parts(key_ptr, key_len);
+        
+        let cipher = timed(Phase::CipherInit, || Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(key)));
+        open_frame(&cipher, data, output_ptr, output_max_len, &mut *output_len)
+    }
+    
+    /// Encrypts many messages under one key in a single call
+    /// 
+    /// Each message becomes a frame in the same format as `encrypt_with_key`.
+    /// The cipher and its key schedule are set up once per call and the
+    /// nonces come from one RNG call plus a counter, so the fixed cost of a
+    /// call is shared by the whole batch. Every item gets its own `status`; a
+    /// failing message does not stop the others.
+    /// 
+    /// Returns `Success` if every message was encrypted, otherwise the status
+    /// of the first item that failed.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `items_ptr` points to `item_count` valid `CryptoBatchItem`s
+    /// - each item's input and output pointers are valid for their lengths
+    /// - an item's output overlaps no other item's input or output
+    /// - `key_ptr` points to a valid buffer of at least `key_len` bytes
+    #[no_mangle]
+    pub unsafe extern "C" fn encrypt_batch_with_key(
+        items_ptr: *mut CryptoBatchItem, item_count: usize,
+        key_ptr: *const u8, key_len: usize
+    ) -> i32 {
+        // Validate parameters
+        if items_ptr.is_null() || key_ptr.is_null() || key_len != KEY_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let key = CrustyKey::new(std::slice::from_raw_parts(key_ptr, key_len));
+        seal_batch(&key, std::slice::from_raw_parts_mut(items_ptr, item_count))
+    }
+    
+    /// Decrypts many frames under one key in a single call
+    /// 
+    /// The counterpart of `encrypt_batch_with_key`. A message whose tag does
+    /// not verify gets `AuthenticationFailed` and its output is wiped; the
+    /// other messages are still decrypted.
+    /// 
+    /// Returns `Success` if every message was decrypted, otherwise the status
+    /// of the first item that failed.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `items_ptr` points to `item_count` valid `CryptoBatchItem`s
+    /// - each item's input and output pointers are valid for their lengths
+    /// - no output overlaps any input or other output
+    /// - `key_ptr` points to a valid buffer of at least `key_len` bytes
+    #[no_mangle]
+    pub unsafe extern "C" fn decrypt_batch_with_key(
+        items_ptr: *mut CryptoBatchItem, item_count: usize,
+        key_ptr: *const u8, key_len: usize
+    ) -> i32 {
+        // Validate parameters
+        if items_ptr.is_null() || key_ptr.is_null() || key_len != KEY_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let key = std::slice::from_raw_parts(key_ptr, key_len);
+        let cipher = timed(Phase::CipherInit, || Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(key)));
+        open_batch(&cipher, std::slice::from_raw_parts_mut(items_ptr, item_count))
+    }
+    
+    /// Creates a key handle from an already derived 32-byte key
+    /// 
+    /// The handle must be released with `destroy_key_handle`.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `key_ptr` points to a valid buffer of at least `key_len` bytes
+    /// - `handle_out` points to a valid handle pointer
+    #[no_mangle]
+    pub unsafe extern "C" fn create_key_handle(
+        key_ptr: *const u8, key_len: usize,
+        handle_out: *mut *mut CrustyKey
+    ) -> i32 {
+        // Validate parameters
+        if key_ptr.is_null() || handle_out.is_null() || key_len != KEY_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let key = std::slice::from_raw_parts(key_ptr, key_len);
+        *handle_out = Box::into_raw(Box::new(CrustyKey::new(key)));
+        CryptoErrorCode::Success as i32
+    }
+    
+    /// Derives a key from a password and salt with Argon2id straight into a handle
+    /// 
+    /// The derived key bytes only exist inside this call and are wiped before
+    /// it returns. The handle must be released with `destroy_key_handle`.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `password_ptr` points to a valid buffer of at least `password_len` bytes
+    /// - `salt_ptr` points to a valid buffer of at least `salt_len` bytes
+    /// - `handle_out` points to a valid handle pointer
+    #[no_mangle]
+    pub unsafe extern "C" fn derive_key_handle(
+        password_ptr: *const u8, password_len: usize,
+        salt_ptr: *const u8, salt_len: usize,
+        memory_kib: u32, iterations: u32, parallelism: u32,
+        handle_out: *mut *mut CrustyKey
+    ) -> i32 {
+        if handle_out.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let mut key = Zeroizing::new([0u8; KEY_LEN]);
+        let result = derive_key_with_params(
+            password_ptr, password_len,
+            salt_ptr, salt_len,
+            memory_kib, iterations, parallelism,
+            key.as_mut_ptr(), KEY_LEN
+        );
+        if result != CryptoErrorCode::Success as i32 {
+            return result;
+        }
+        
+        *handle_out = Box::into_raw(Box::new(CrustyKey::new(&key[..])));
+        CryptoErrorCode::Success as i32
+    }
+    
+    /// Destroys a key handle, zeroizing its key schedule
+    /// 
+    /// # Safety
+    /// 
+    /// `handle` must be null or a handle from `create_key_handle` or
+    /// `derive_key_handle` that is not used again and no longer in use on
+    /// another thread.
+    #[no_mangle]
+    pub unsafe extern "C" fn destroy_key_handle(handle: *mut CrustyKey) {
+        if !handle.is_null() {
+            drop(Box::from_raw(handle));
+        }
+    }
+    
+    /// Encrypts data with a key handle into a new frame
+    /// 
+    /// Produces the same frame as `encrypt_with_key`, with the nonce taken
+    /// from the handle's sequence. The output buffer may overlap the input.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `handle` is a live key handle
+    /// - `data_ptr` points to a valid buffer of at least `data_len` bytes
+    /// - `output_ptr` points to a buffer of at least `output_max_len` bytes
+    /// - `output_len` points to a valid `usize`
+    #[no_mangle]
+    pub unsafe extern "C" fn encrypt_with_handle(
+        handle: *const CrustyKey,
+        data_ptr: *const u8, data_len: usize,
+        output_ptr: *mut u8, output_max_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        // Validate parameters
+        if handle.is_null() || output_len.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        seal_message(&*handle, data_ptr, data_len, output_ptr, output_max_len, &mut *output_len)
+    }
+    
+    /// Encrypts a chunk in place with a key handle
+    /// 
+    /// The plaintext must already sit at offset 16 of the buffer, as for
+    /// `encrypt_in_place_with_key`.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `handle` is a live key handle
+    /// - `buffer_ptr` points to a valid buffer of at least `buffer_len` bytes
+    /// - `output_len` points to a valid `usize`
+    #[no_mangle]
+    pub unsafe extern "C" fn encrypt_in_place_with_handle(
+        handle: *const CrustyKey,
+        buffer_ptr: *mut u8, buffer_len: usize,
+        plaintext_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        // Validate parameters
+        if handle.is_null() || buffer_ptr.is_null() || output_len.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        // Check if the buffer has room for the frame around the plaintext
+        let required_size = FRAME_HEADER_LEN + plaintext_len + TAG_LEN;
+        if buffer_len < required_size {
+            *output_len = required_size;
+            return CryptoErrorCode::BufferTooSmall as i32;
+        }
+        
+        let frame = std::slice::from_raw_parts_mut(buffer_ptr, required_size);
+        let result = seal_frame_with_handle(&*handle, frame, plaintext_len);
+        if result == CryptoErrorCode::Success as i32 {
+            *output_len = required_size;
+        }
+        result
+    }
+    
+    /// Decrypts a frame with a key handle
+    /// 
+    /// The plaintext is wiped again if the tag does not verify.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `handle` is a live key handle
+    /// - `data_ptr` points to a valid buffer of at least `data_len` bytes
+    /// - `output_ptr` points to a buffer of at least `output_max_len` bytes
+    ///   that does not overlap the input
+    /// - `output_len` points to a valid `usize`
+    #[no_mangle]
+    pub unsafe extern "C" fn decrypt_with_handle(
+        handle: *const CrustyKey,
+        data_ptr: *const u8, data_len: usize,
+        output_ptr: *mut u8, output_max_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        // Validate parameters
+        if handle.is_null() || data_ptr.is_null() || output_ptr.is_null() || output_len.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let data = std::slice::from_raw_parts(data_ptr, data_len);
+        open_frame(&(*handle).cipher, data, output_ptr, output_max_len, &mut *output_len)
+    }
+    
+    /// Decrypts a frame in place with a key handle
+    /// 
+    /// The counterpart of `encrypt_in_place_with_handle`: the ciphertext is
+    /// decrypted where it is, checked against the detached tag, and the
+    /// plaintext is left at offset 16 of the buffer. Nothing is allocated
+    /// or copied. The plaintext is wiped again if the tag does not verify.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `handle` is a live key handle
+    /// - `buffer_ptr` points to a valid buffer of at least `buffer_len` bytes
+    /// - `output_len` points to a valid `usize`
+    #[no_mangle]
+    pub unsafe extern "C" fn decrypt_in_place_with_handle(
+        handle: *const CrustyKey,
+        buffer_ptr: *mut u8, buffer_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        // Validate parameters
+        if handle.is_null() || buffer_ptr.is_null() || output_len.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let frame = std::slice::from_raw_parts_mut(buffer_ptr, buffer_len);
+        open_frame_in_place(&(*handle).cipher, frame, &mut *output_len)
+    }
+    
+    /// Encrypts data with a key handle under a nonce chosen by the caller
+    /// 
+    /// Used for container chunks, whose nonces follow from the file's nonce
+    /// prefix, the chunk index and the final-chunk flag, so workers need
+    /// neither the RNG nor each other. The caller must never use a nonce
+    /// twice under one key. If the plaintext already sits at offset 16 of
+    /// the output it is encrypted in place; otherwise the buffers may overlap.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `handle` is a live key handle
+    /// - `data_ptr` points to a valid buffer of at least `data_len` bytes
+    /// - `nonce_ptr` points to 12 readable bytes that do not overlap the output
+    /// - `output_ptr` points to a buffer of at least `output_max_len` bytes
+    /// - `output_len` points to a valid `usize`
+    #[no_mangle]
+    pub unsafe extern "C" fn encrypt_with_nonce(
+        handle: *const CrustyKey,
+        data_ptr: *const u8, data_len: usize,
+        nonce_ptr: *const u8,
+        output_ptr: *mut u8, output_max_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        // Validate parameters
+        if handle.is_null() || data_ptr.is_null() || nonce_ptr.is_null() ||
+            output_ptr.is_null() || output_len.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let required_size = FRAME_HEADER_LEN + data_len + TAG_LEN;
+        if output_max_len < required_size {
+            *output_len = required_size;
+            return CryptoErrorCode::BufferTooSmall as i32;
+        }
+        
+        // Move the plaintext into place unless it is already there
+        let body_ptr = output_ptr.add(FRAME_HEADER_LEN);
+        if data_ptr != body_ptr as *const u8 {
+            timed(Phase::CopyOut, || core::ptr::copy(data_ptr, body_ptr, data_len));
+        }
+        
+        let nonce = std::slice::from_raw_parts(nonce_ptr, NONCE_LEN);
+        let frame = std::slice::from_raw_parts_mut(output_ptr, required_size);
+        let result = seal_frame(&(*handle).cipher, nonce, frame, data_len);
+        if result == CryptoErrorCode::Success as i32 {
+            *output_len = required_size;
+        }
+        result
+    }
+    
+    /// Decrypts a frame with a key handle, requiring the nonce it must carry
+    /// 
+    /// A frame stored under any other nonce was moved, cut from another file
+    /// or had its final-chunk marking changed, and is rejected with
+    /// `DecryptionError` before anything is decrypted.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `handle` is a live key handle
+    /// - `data_ptr` points to a valid buffer of at least `data_len` bytes
+    /// - `nonce_ptr` points to 12 readable bytes
+    /// - `output_ptr` points to a buffer of at least `output_max_len` bytes
+    ///   that does not overlap the input
+    /// - `output_len` points to a valid `usize`
+    #[no_mangle]
+    pub unsafe extern "C" fn decrypt_with_nonce(
+        handle: *const CrustyKey,
+        data_ptr: *const u8, data_len: usize,
+        nonce_ptr: *const u8,
+        output_ptr: *mut u8, output_max_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        // Validate parameters
+        if handle.is_null() || data_ptr.is_null() || nonce_ptr.is_null() ||
+            output_ptr.is_null() || output_len.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let data = std::slice::from_raw_parts(data_ptr, data_len);
+        let expected = std::slice::from_raw_parts(nonce_ptr, NONCE_LEN);
+        if data.len() >= NONCE_LEN && data[..NONCE_LEN] != *expected {
+            return CryptoErrorCode::DecryptionError as i32;
+        }
+        
+        open_frame(&(*handle).cipher, data, output_ptr, output_max_len, &mut *output_len)
+    }
+    
+    /// Decrypts a frame in place with a key handle, requiring its nonce
+    /// 
+    /// Checks the nonce as `decrypt_with_nonce` does and decrypts as
+    /// `decrypt_in_place_with_handle` does, leaving the plaintext at offset
+    /// 16 of the buffer.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `handle` is a live key handle
+    /// - `buffer_ptr` points to a valid buffer of at least `buffer_len` bytes
+    /// - `nonce_ptr` points to 12 readable bytes that do not overlap the buffer
+    /// - `output_len` points to a valid `usize`
+    #[no_mangle]
+    pub unsafe extern "C" fn decrypt_in_place_with_nonce(
+        handle: *const CrustyKey,
+        buffer_ptr: *mut u8, buffer_len: usize,
+        nonce_ptr: *const u8,
+        output_len: *mut usize
+    ) -> i32 {
+        // Validate parameters
+        if handle.is_null() || buffer_ptr.is_null() || nonce_ptr.is_null() || output_len.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let frame = std::slice::from_raw_parts_mut(buffer_ptr, buffer_len);
+        let expected = std::slice::from_raw_parts(nonce_ptr, NONCE_LEN);
+        if frame.len() >= NONCE_LEN && frame[..NONCE_LEN] != *expected {
+            return CryptoErrorCode::DecryptionError as i32;
+        }
+        
+        open_frame_in_place(&(*handle).cipher, frame, &mut *output_len)
+    }
+    
+    /// Computes a keyed fingerprint of data with a key handle
+    /// 
+    /// HMAC-SHA256 of `context` as a 64-bit big-endian value followed by
+    /// the data, under the handle's fingerprint subkey. Without the key a
+    /// fingerprint reveals nothing about the data, so it can be stored next
+    /// to the ciphertext; equal fingerprints under one context mean equal
+    /// data. Callers give each purpose, or each position, its own context.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `handle` is a live key handle
+    /// - `data_ptr` points to a valid buffer of at least `data_len` bytes,
+    ///   or `data_len` is 0
+    /// - `output_ptr` points to a buffer of at least `output_len` bytes
+    #[no_mangle]
+    pub unsafe extern "C" fn fingerprint_with_handle(
+        handle: *const CrustyKey,
+        context: u64,
+        data_ptr: *const u8, data_len: usize,
+        output_ptr: *mut u8, output_len: usize
+    ) -> i32 {
+        // Validate parameters
+        if handle.is_null() || output_ptr.is_null() || (data_ptr.is_null() && data_len > 0) {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        if output_len < FINGERPRINT_LEN {
+            return CryptoErrorCode::BufferTooSmall as i32;
+        }
+        
+        let data: &[u8] = if data_len == 0 { &[] } else { std::slice::from_raw_parts(data_ptr, data_len) };
+        let mut mac = match <HmacSha256 as Mac>::new_from_slice(&(*handle).fingerprint_key[..]) {
+            Ok(mac) => mac,
+            Err(_) => return CryptoErrorCode::InternalError as i32,
+        };
+        mac.update(&context.to_be_bytes());
+        mac.update(data);
+        let output = std::slice::from_raw_parts_mut(output_ptr, FINGERPRINT_LEN);
+        output.copy_from_slice(&mac.finalize().into_bytes());
+        CryptoErrorCode::Success as i32
+    }
+    
+    /// Encrypts many messages with a key handle in a single call
+    /// 
+    /// Behaves like `encrypt_batch_with_key` without setting up a cipher.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `handle` is a live key handle
+    /// - `items_ptr` points to `item_count` valid `CryptoBatchItem`s
+    /// - each item's input and output pointers are valid for their lengths
+    /// - an item's output overlaps no other item's input or output
+    #[no_mangle]
+    pub unsafe extern "C" fn encrypt_batch_with_handle(
+        handle: *const CrustyKey,
+        items_ptr: *mut CryptoBatchItem, item_count: usize
+    ) -> i32 {
+        if handle.is_null() || items_ptr.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        seal_batch(&*handle, std::slice::from_raw_parts_mut(items_ptr, item_count))
+    }
+    
+    /// Decrypts many frames with a key handle in a single call
+    /// 
+    /// Behaves like `decrypt_batch_with_key` without setting up a cipher.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `handle` is a live key handle
+    /// - `items_ptr` points to `item_count` valid `CryptoBatchItem`s
+    /// - each item's input and output pointers are valid for their lengths
+    /// - no output overlaps any input or other output
+    #[no_mangle]
+    pub unsafe extern "C" fn decrypt_batch_with_handle(
+        handle: *const CrustyKey,
+        items_ptr: *mut CryptoBatchItem, item_count: usize
+    ) -> i32 {
+        if handle.is_null() || items_ptr.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        open_batch(&(*handle).cipher, std::slice::from_raw_parts_mut(items_ptr, item_count))
+    }
+    
+    /// Encrypts every item of a batch, returning the first failure
+    unsafe fn seal_batch(key: &CrustyKey, items: &mut [CryptoBatchItem]) -> i32 {
+        let mut overall = CryptoErrorCode::Success as i32;
+        for item in items.iter_mut() {
+            item.status = seal_message(key, item.input_ptr, item.input_len,
+                                       item.output_ptr, item.output_max_len, &mut item.output_len);
+            if item.status != CryptoErrorCode::Success as i32 && overall == CryptoErrorCode::Success as i32 {
+                overall = item.status;
+            }
+        }
+        overall
+    }
+    
+    /// Decrypts every item of a batch, returning the first failure
+    unsafe fn open_batch(cipher: &Aes256Gcm, items: &mut [CryptoBatchItem]) -> i32 {
+        let mut overall = CryptoErrorCode::Success as i32;
+        for item in items.iter_mut() {
+            item.status = if item.input_ptr.is_null() || item.output_ptr.is_null() {
+                CryptoErrorCode::InvalidParams as i32
+            } else {
+                let data = std::slice::from_raw_parts(item.input_ptr, item.input_len);
+                open_frame(cipher, data, item.output_ptr, item.output_max_len, &mut item.output_len)
+            };
+            if item.status != CryptoErrorCode::Success as i32 && overall == CryptoErrorCode::Success as i32 {
+                overall = item.status;
+            }
+        }
+        overall
+    }
+    
+    /// Copies a message into its frame and seals it with the handle's next nonce
+    unsafe fn seal_message(
+        key: &CrustyKey,
+        data_ptr: *const u8, data_len: usize,
+        output_ptr: *mut u8, output_max_len: usize,
+        output_len: &mut usize
+    ) -> i32 {
+        if data_ptr.is_null() || output_ptr.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let required_size = FRAME_HEADER_LEN + data_len + TAG_LEN;
+        if output_max_len < required_size {
+            *output_len = required_size;
+            return CryptoErrorCode::BufferTooSmall as i32;
+        }
+        
+        // Move the plaintext into place; `copy` tolerates overlapping buffers
+        timed(Phase::CopyOut, || core::ptr::copy(data_ptr, output_ptr.add(FRAME_HEADER_LEN), data_len));
+        
+        let frame = std::slice::from_raw_parts_mut(output_ptr, required_size);
+        let result = seal_frame_with_handle(key, frame, data_len);
+        if result == CryptoErrorCode::Success as i32 {
+            *output_len = required_size;
+        }
+        result
+    }
+    
+    /// Seals a frame in place with the next nonce of a handle
+    fn seal_frame_with_handle(key: &CrustyKey, frame: &mut [u8], plaintext_len: usize) -> i32 {
+        match key.next_nonce() {
+            Some(nonce) => seal_frame(&key.cipher, &nonce, frame, plaintext_len),
+            None => CryptoErrorCode::EncryptionError as i32,
+        }
+    }
+    
+    /// Decrypts one frame into the output buffer
+    pub(crate) unsafe fn open_frame(
+        cipher: &Aes256Gcm,
+        data: &[u8],
+        output_ptr: *mut u8, output_max_len: usize,
+        output_len: &mut usize
+    ) -> i32 {
+        // Check if data is long enough to contain nonce and length
+        if data.len() < FRAME_HEADER_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        // Extract the nonce, ciphertext and tag
+        let nonce = Nonce::from_slice(&data[0..NONCE_LEN]);
+        let ciphertext_len = u32::from_be_bytes([data[12], data[13], data[14], data[15]]) as usize;
+        if ciphertext_len < TAG_LEN || data.len() < FRAME_HEADER_LEN + ciphertext_len {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        let plaintext_len = ciphertext_len - TAG_LEN;
+        let ciphertext = &data[FRAME_HEADER_LEN..FRAME_HEADER_LEN + plaintext_len];
+        let tag = Tag::from_slice(&data[FRAME_HEADER_LEN + plaintext_len..FRAME_HEADER_LEN + ciphertext_len]);
+        
+        // Check if output buffer is large enough
+        if output_max_len < plaintext_len {
+            *output_len = plaintext_len;
+            return CryptoErrorCode::BufferTooSmall as i32;
+        }
+        
+        // Decrypt straight into the caller's buffer
+        let output_slice = std::slice::from_raw_parts_mut(output_ptr, plaintext_len);
+        timed(Phase::CopyOut, || output_slice.copy_from_slice(ciphertext));
+        if timed(Phase::Aead, || cipher.decrypt_in_place_detached(nonce, b"", output_slice, tag)).is_err() {
+            // Never leave unauthenticated plaintext behind
+            output_slice.fill(0);
+            return CryptoErrorCode::AuthenticationFailed as i32;
+        }
+        
+        *output_len = plaintext_len;
+        CryptoErrorCode::Success as i32
+    }
+    
+    /// Decrypts one frame where it is, leaving the plaintext after the frame header
+    fn open_frame_in_place(cipher: &Aes256Gcm, frame: &mut [u8], output_len: &mut usize) -> i32 {
+        // Check if data is long enough to contain nonce and length
+        if frame.len() < FRAME_HEADER_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        
+        let ciphertext_len = u32::from_be_bytes([frame[12], frame[13], frame[14], frame[15]]) as usize;
+        if ciphertext_len < TAG_LEN || frame.len() < FRAME_HEADER_LEN + ciphertext_len {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        let plaintext_len = ciphertext_len - TAG_LEN;
+        
+        // The tag is verified detached, so the body can be decrypted in place
+        let (header, rest) = frame.split_at_mut(FRAME_HEADER_LEN);
+        let (body, tail) = rest.split_at_mut(plaintext_len);
+        let nonce = Nonce::from_slice(&header[0..NONCE_LEN]);
+        let tag = Tag::clone_from_slice(&tail[..TAG_LEN]);
+        if timed(Phase::Aead, || cipher.decrypt_in_place_detached(nonce, b"", body, &tag)).is_err() {
+            // Never leave unauthenticated plaintext behind
+            body.fill(0);
+            return CryptoErrorCode::AuthenticationFailed as i32;
+        }
+        
+        *output_len = plaintext_len;
+        CryptoErrorCode::Success as i32
+    }
+    
+    /// Fills in a frame whose plaintext already sits after the frame header
+    fn seal_frame_in_place(key: &[u8], frame: &mut [u8], plaintext_len: usize) -> i32 {
+        // Generate a random nonce
+        let mut nonce_bytes = [0u8; NONCE_LEN];
+        OsRng.fill_bytes(&mut nonce_bytes);
+        
+        let cipher = timed(Phase::CipherInit, || Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(key)));
+        seal_frame(&cipher, &nonce_bytes, frame, plaintext_len)
+    }
+    
+    /// Encrypts the plaintext after the frame header under `nonce_bytes`
+    fn seal_frame(cipher: &Aes256Gcm, nonce_bytes: &[u8], frame: &mut [u8], plaintext_len: usize) -> i32 {
+        // The length prefix is 32 bits wide
+        let ciphertext_len = plaintext_len + TAG_LEN;
+        if ciphertext_len > u32::MAX as usize {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        let nonce = Nonce::from_slice(nonce_bytes);
+        
+        // Encrypt the plaintext where it is
+        let body_end = FRAME_HEADER_LEN + plaintext_len;
+        let body = &mut frame[FRAME_HEADER_LEN..body_end];
+        let tag = match timed(Phase::Aead, || cipher.encrypt_in_place_detached(nonce, b"", body)) {
+            Ok(t) => t,
+            Err(_) => return CryptoErrorCode::EncryptionError as i32,
+        };
+        
+        // Write nonce, ciphertext length and tag around it
+        frame[0..NONCE_LEN].copy_from_slice(nonce_bytes);
+        frame[NONCE_LEN..FRAME_HEADER_LEN].copy_from_slice(&(ciphertext_len as u32).to_be_bytes());
+        frame[body_end..body_end + TAG_LEN].copy_from_slice(&tag);
+        
+        CryptoErrorCode::Success as i32
+    }
+
+    // Internal function to derive a key from a password
+    pub(crate) fn derive_key_from_password_internal(password: &[u8]) -> Result<[u8; 32], ()> {
+        // Generate a salt
+        let salt = SaltString::generate(&mut Argon2OsRng);
+        
+        // Create Argon2id instance
+        let argon2 = Argon2::default();
+        
+        // Derive key
+        let mut key = [0u8; 32];
+        timed(Phase::Kdf, || argon2.hash_password_into(password, salt.as_str().as_bytes(), &mut key))
+            .map_err(|_| ())?;
+        
+        Ok(key)
+    }
+}
+
+// The following functions are only available with the embedded feature
+#[cfg(feature = "embedded")]
+mod embedded_features {
+    use super::*;
+    #[cfg(feature = "stm32h573i_dk")]
+    use hmac::{Hmac, Mac};
+    use sha2::Sha256;
+    use zeroize::Zeroize;
+    
+    // Password stretching sized for the Cortex-M33: about 0.2 s of software
+    // SHA-256 at 250 MHz, paid once per password per session thanks to the cache
+    const KDF_ITERATIONS: u32 = 10_000;
+    
+    // The nonce | length | ciphertext frame has no room for a salt, so one
+    // fixed salt keeps the same password decrypting on every device
+    const KDF_SALT: &[u8] = b"CRUSTy-Core embedded KDF v1";
+    
+    // HKDF info of the AES-256-GCM key, leaving room for other subkeys
+    const KDF_AES_KEY_INFO: &[u8] = b"CRUSTy-Core AES-256-GCM key v1";
+    
+    #[cfg(feature = "stm32h573i_dk")]
+    const KEY_CACHE_SLOTS: usize = 4;
+    
+    // Slots are found by an HMAC of the password under a per-session secret,
+    // so the tags alone give no way to test password guesses
+    #[cfg(feature = "stm32h573i_dk")]
+    #[derive(Clone, Copy)]
+    struct KeyCacheSlot {
+        tag: [u8; 32],
+        key: [u8; 32],
+        last_used: u32,
+        occupied: bool,
+    }
+    
+    #[cfg(feature = "stm32h573i_dk")]
+    struct KeyCache {
+        secret: [u8; 32],
+        ready: bool,
+        clock: u32,
+        slots: [KeyCacheSlot; KEY_CACHE_SLOTS],
+    }
+    
+    #[cfg(feature = "stm32h573i_dk")]
+    impl KeyCache {
+        fn wipe(&mut self) {
+            self.secret.zeroize();
+            self.ready = false;
+            self.clock = 0;
+            for slot in self.slots.iter_mut() {
+                slot.tag.zeroize();
+                slot.key.zeroize();
+                slot.last_used = 0;
+                slot.occupied = false;
+            }
+        }
+        
+        // Every slot is compared in full, hit or miss
+        fn lookup(&mut self, tag: &[u8; 32]) -> Option<[u8; 32]> {
+            let mut found = None;
+            for (i, slot) in self.slots.iter().enumerate() {
+                let diff = slot.tag.iter().zip(tag.iter()).fold(0u8, |acc, (a, b)| acc | (a ^ b));
+                if slot.occupied && diff == 0 {
+                    found = Some(i);
+                }
+            }
+            
+            let i = found?;
+            self.clock = self.clock.wrapping_add(1);
+            self.slots[i].last_used = self.clock;
+            Some(self.slots[i].key)
+        }
+        
+        // Takes a free slot, or evicts the least recently used one
+        fn store(&mut self, tag: &[u8; 32], key: &[u8; 32]) {
+            let clock = self.clock;
+            let victim = match self.slots.iter().position(|slot| !slot.occupied) {
+                Some(i) => i,
+                None => (0..KEY_CACHE_SLOTS)
+                    .max_by_key(|&i| clock.wrapping_sub(self.slots[i].last_used))
+                    .unwrap_or(0),
+            };
+            
+            self.clock = clock.wrapping_add(1);
+            let slot = &mut self.slots[victim];
+            slot.tag = *tag;
+            slot.key = *key;
+            slot.last_used = self.clock;
+            slot.occupied = true;
+        }
+    }
+    
+    // Allocator of the firmware's MPU-protected region (mem_protect.h)
+    #[cfg(feature = "stm32h573i_dk")]
+    extern "C" {
+        fn mem_protect_alloc_secure(size: usize, align: usize) -> *mut u8;
+    }
+    
+    #[cfg(feature = "stm32h573i_dk")]
+    static mut KEY_CACHE: *mut KeyCache = core::ptr::null_mut();
+    
+    // Runs f on the cache with interrupts masked; None if the secure region
+    // has no room for it. The region hands out zeroed memory.
+    #[cfg(feature = "stm32h573i_dk")]
+    fn with_key_cache<R>(f: impl FnOnce(&mut KeyCache) -> R) -> Option<R> {
+        cortex_m::interrupt::free(|_| unsafe {
+            if KEY_CACHE.is_null() {
+                KEY_CACHE = mem_protect_alloc_secure(core::mem::size_of::<KeyCache>(),
+                                                     core::mem::align_of::<KeyCache>()) as *mut KeyCache;
+            }
+            KEY_CACHE.as_mut().map(f)
+        })
+    }
+    
+    // PBKDF2-HMAC-SHA256 stretches the password, HKDF-SHA256 expands it to the key
+    fn derive_key_uncached(password: &[u8]) -> Result<[u8; 32], ()> {
+        let mut stretched = [0u8; 32];
+        pbkdf2::pbkdf2_hmac::<Sha256>(password, KDF_SALT, KDF_ITERATIONS, &mut stretched);
+        
+        let mut key = [0u8; 32];
+        let result = hkdf::Hkdf::<Sha256>::from_prk(&stretched)
+            .map_err(|_| ())
+            .and_then(|hkdf| hkdf.expand(KDF_AES_KEY_INFO, &mut key).map_err(|_| ()));
+        stretched.zeroize();
+        result.map(|_| key)
+    }
+    
+    // Derive the AES-256-GCM key of a password, from the cache when this
+    // session has seen the password before
+    #[cfg(feature = "stm32h573i_dk")]
+    pub(crate) fn derive_embedded_key(password: &[u8]) -> Result<[u8; 32], ()> {
+        // The session secret needs the RNG, which may block, so it is drawn
+        // before interrupts are masked
+        if with_key_cache(|cache| cache.ready) == Some(false) {
+            let mut secret = [0u8; 32];
+            if get_random_bytes(&mut secret).is_ok() {
+                with_key_cache(|cache| {
+                    if !cache.ready {
+                        cache.secret = secret;
+                        cache.ready = true;
+                    }
+                });
+            }
+            secret.zeroize();
+        }
+        
+        let mut secret = match with_key_cache(|cache| if cache.ready { Some(cache.secret) } else { None }) {
+            Some(Some(secret)) => secret,
+            // No cache or no RNG: derive every time
+            _ => return derive_key_uncached(password),
+        };
+        let mut mac = <Hmac<Sha256> as Mac>::new_from_slice(&secret).expect("HMAC accepts any key length");
+        secret.zeroize();
+        mac.update(password);
+        let mut tag = [0u8; 32];
+        tag.copy_from_slice(&mac.finalize().into_bytes());
+        
+        if let Some(Some(key)) = with_key_cache(|cache| cache.lookup(&tag)) {
+            tag.zeroize();
+            return Ok(key);
+        }
+        
+        let result = derive_key_uncached(password);
+        if let Ok(key) = &result {
+            with_key_cache(|cache| {
+                // Another thread may have derived it meanwhile
+                if cache.ready && cache.lookup(&tag).is_none() {
+                    cache.store(&tag, key);
+                }
+            });
+        }
+        tag.zeroize();
+        result
+    }
+    
+    // Without the firmware there is no protected memory to cache keys in
+    #[cfg(not(feature = "stm32h573i_dk"))]
+    pub(crate) fn derive_embedded_key(password: &[u8]) -> Result<[u8; 32], ()> {
+        derive_key_uncached(password)
+    }
+    
+    /// Wipes every key derived this session, and the secret the cache is indexed by
+    /// 
+    /// Call when a session ends; the next `encrypt_data` or `decrypt_data`
+    /// pays for a full key derivation again.
+    #[no_mangle]
+    pub extern "C" fn clear_derived_key_cache() {
+        #[cfg(feature = "stm32h573i_dk")]
+        with_key_cache(|cache| cache.wipe());
+    }
+    
+    // Firmware crypto services (tools/Zephyr/stm32h573i_dk_app/src/crypto_ops.h),
+    // which drive the AES peripheral and TRNG and fall back to mbedTLS
+    #[cfg(feature = "stm32h573i_dk")]
+    extern "C" {
+        fn crypto_ops_random_bytes(buffer: *mut u8, len: usize) -> i32;
+        fn crypto_ops_aes_gcm_encrypt(
+            key: *const u8, key_len: usize,
+            nonce: *const u8, nonce_len: usize,
+            aad: *const u8, aad_len: usize,
+            plaintext: *const u8, plaintext_len: usize,
+            ciphertext: *mut u8, ciphertext_len: *mut usize,
+            tag: *mut u8, tag_len: usize,
+        ) -> i32;
+        fn crypto_ops_aes_gcm_decrypt(
+            key: *const u8, key_len: usize,
+            nonce: *const u8, nonce_len: usize,
+            aad: *const u8, aad_len: usize,
+            ciphertext: *const u8, ciphertext_len: usize,
+            tag: *const u8, tag_len: usize,
+            plaintext: *mut u8, plaintext_len: *mut usize,
+        ) -> i32;
+    }
+    
+    #[cfg(feature = "stm32h573i_dk")]
+    const CRYPTO_OPS_ERR_AUTH: i32 = -5;
+    
+    // Get random bytes using hardware RNG if available
     pub(crate) fn get_random_bytes(buffer: &mut [u8]) -> Result<(), ()> {
         #[cfg(feature = "stm32h573i_dk")]
         {
-            // Use STM32H5 hardware RNG
-            // This is a placeholder and should be replaced with actual hardware RNG implementation
-            for byte in buffer.iter_mut() {
-                *byte = 0x42; // Placeholder, replace with actual RNG
+            // STM32H5 TRNG through the firmware entropy driver; never fall
+            // back to a PRNG, nonces must not repeat
+            let ret = unsafe { crypto_ops_random_bytes(buffer.as_mut_ptr(), buffer.len()) };
+            return if ret == 0 { Ok(()) } else { Err(()) };
+        }
+        
+        // Without the firmware there is no entropy source; a fixed-seed PRNG
+        // would repeat nonces, so refuse instead
+        #[cfg(not(feature = "stm32h573i_dk"))]
+        {
+            let _ = buffer;
+            Err(())
+        }
+    }
+    
+    // Encrypt data using hardware acceleration if available
+    //
+    // Writes the same nonce | length | ciphertext+tag layout as the software path.
+    pub(crate) unsafe fn encrypt_with_hardware(
+        data: &[u8],
+        password: &[u8],
+        output_ptr: *mut u8,
+        output_max_len: usize,
+        output_len: *mut usize
+    ) -> Result<i32, ()> {
+        #[cfg(feature = "stm32h573i_dk")]
+        {
+            let sealed_len = data.len() + TAG_LEN;
+            if sealed_len > u32::MAX as usize {
+                return Ok(CryptoErrorCode::InvalidParams as i32);
+            }
+            let required_size = FRAME_HEADER_LEN + sealed_len;
+            if output_max_len < required_size {
+                *output_len = required_size;
+                return Ok(CryptoErrorCode::BufferTooSmall as i32);
+            }
+            
+            let mut key = derive_embedded_key(password)?;
+            let output = core::slice::from_raw_parts_mut(output_ptr, required_size);
+            let (header, sealed) = output.split_at_mut(FRAME_HEADER_LEN);
+            let (ciphertext, tag) = sealed.split_at_mut(data.len());
+            
+            if get_random_bytes(&mut header[..NONCE_LEN]).is_err() {
+                key.zeroize();
+                return Ok(CryptoErrorCode::InternalError as i32);
+            }
+            header[NONCE_LEN..].copy_from_slice(&(sealed_len as u32).to_be_bytes());
+            
+            let mut ciphertext_len = ciphertext.len();
+            let ret = crypto_ops_aes_gcm_encrypt(
+                key.as_ptr(), key.len(),
+                header.as_ptr(), NONCE_LEN,
+                core::ptr::null(), 0,
+                data.as_ptr(), data.len(),
+                ciphertext.as_mut_ptr(), &mut ciphertext_len,
+                tag.as_mut_ptr(), TAG_LEN,
+            );
+            key.zeroize();
+            if ret != 0 || ciphertext_len != data.len() {
+                // Let the software implementation have a go
+                return Err(());
+            }
+            
+            *output_len = required_size;
+            return Ok(CryptoErrorCode::Success as i32);
+        }
+        
+        // Hardware acceleration not available
+        #[cfg(not(feature = "stm32h573i_dk"))]
+        Err(())
+    }
+    
+    // Decrypt data using hardware acceleration if available
+    pub(crate) unsafe fn decrypt_with_hardware(
+        data: &[u8],
+        password: &[u8],
+        output_ptr: *mut u8,
+        output_max_len: usize,
+        output_len: *mut usize
+    ) -> Result<i32, ()> {
+        #[cfg(feature = "stm32h573i_dk")]
+        {
+            if data.len() < FRAME_HEADER_LEN + TAG_LEN {
+                return Ok(CryptoErrorCode::InvalidParams as i32);
+            }
+            let mut sealed_len_bytes = [0u8; 4];
+            sealed_len_bytes.copy_from_slice(&data[NONCE_LEN..FRAME_HEADER_LEN]);
+            let sealed_len = u32::from_be_bytes(sealed_len_bytes) as usize;
+            if sealed_len < TAG_LEN || sealed_len > data.len() - FRAME_HEADER_LEN {
+                return Ok(CryptoErrorCode::InvalidParams as i32);
+            }
+            let text_len = sealed_len - TAG_LEN;
+            if output_max_len < text_len {
+                *output_len = text_len;
+                return Ok(CryptoErrorCode::BufferTooSmall as i32);
+            }
+            
+            let mut key = derive_embedded_key(password)?;
+            let nonce = &data[..NONCE_LEN];
+            let (ciphertext, tag) = data[FRAME_HEADER_LEN..FRAME_HEADER_LEN + sealed_len].split_at(text_len);
+            
+            let mut plaintext_len = output_max_len;
+            let ret = crypto_ops_aes_gcm_decrypt(
+                key.as_ptr(), key.len(),
+                nonce.as_ptr(), NONCE_LEN,
+                core::ptr::null(), 0,
+                ciphertext.as_ptr(), text_len,
+                tag.as_ptr(), TAG_LEN,
+                output_ptr, &mut plaintext_len,
+            );
+            key.zeroize();
+            if ret == CRYPTO_OPS_ERR_AUTH {
+                // The firmware has already wiped the output
+                return Ok(CryptoErrorCode::AuthenticationFailed as i32);
+            }
+            if ret != 0 || plaintext_len != text_len {
+                return Err(());
+            }
+            
+            *output_len = text_len;
+            return Ok(CryptoErrorCode::Success as i32);
+        }
+        
+        // Hardware acceleration not available
+        #[cfg(not(feature = "stm32h573i_dk"))]
+        Err(())
+    }
+    
+    // Largest message `encrypt_in_place_detached` and `decrypt_in_place_detached`
+    // take, chosen per board with the max_message_* features; the largest
+    // enabled wins. It bounds how long one call keeps the cipher busy.
+    #[cfg(feature = "max_message_16k")]
+    pub const EMBEDDED_MAX_MESSAGE_LEN: usize = 16 * 1024;
+    #[cfg(all(feature = "max_message_4k", not(feature = "max_message_16k")))]
+    pub const EMBEDDED_MAX_MESSAGE_LEN: usize = 4 * 1024;
+    #[cfg(not(any(feature = "max_message_4k", feature = "max_message_16k")))]
+    pub const EMBEDDED_MAX_MESSAGE_LEN: usize = 1024;
+    
+    // AES-256-GCM over the buffer where it is, with the portable implementation
+    fn seal_in_place_software(key: &[u8; 32], nonce: &[u8], buffer: &mut [u8], tag_out: &mut [u8]) -> i32 {
+        let cipher = Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(key));
+        match cipher.encrypt_in_place_detached(Nonce::from_slice(nonce), b"", buffer) {
+            Ok(tag) => {
+                tag_out.copy_from_slice(&tag);
+                CryptoErrorCode::Success as i32
+            }
+            Err(_) => CryptoErrorCode::EncryptionError as i32,
+        }
+    }
+    
+    fn open_in_place_software(key: &[u8; 32], nonce: &[u8], buffer: &mut [u8], tag: &[u8]) -> i32 {
+        let cipher = Aes256Gcm::new(Key::<Aes256Gcm>::from_slice(key));
+        if cipher.decrypt_in_place_detached(Nonce::from_slice(nonce), b"", buffer, Tag::from_slice(tag)).is_err() {
+            // Never leave unauthenticated plaintext behind
+            buffer.fill(0);
+            return CryptoErrorCode::AuthenticationFailed as i32;
+        }
+        CryptoErrorCode::Success as i32
+    }
+    
+    // On the board the firmware encrypts in place, on the AES peripheral or
+    // with mbedTLS. A failure may leave the buffer half processed, so there
+    // is no second attempt.
+    fn seal_in_place(key: &[u8; 32], nonce: &[u8], buffer: &mut [u8], tag_out: &mut [u8]) -> i32 {
+        #[cfg(feature = "stm32h573i_dk")]
+        {
+            let mut len = buffer.len();
+            let ret = unsafe {
+                crypto_ops_aes_gcm_encrypt(
+                    key.as_ptr(), key.len(),
+                    nonce.as_ptr(), NONCE_LEN,
+                    core::ptr::null(), 0,
+                    buffer.as_ptr(), buffer.len(),
+                    buffer.as_mut_ptr(), &mut len,
+                    tag_out.as_mut_ptr(), TAG_LEN,
+                )
+            };
+            return if ret == 0 { CryptoErrorCode::Success as i32 } else { CryptoErrorCode::EncryptionError as i32 };
+        }
+        
+        #[cfg(not(feature = "stm32h573i_dk"))]
+        seal_in_place_software(key, nonce, buffer, tag_out)
+    }
+    
+    fn open_in_place(key: &[u8; 32], nonce: &[u8], buffer: &mut [u8], tag: &[u8]) -> i32 {
+        #[cfg(feature = "stm32h573i_dk")]
+        {
+            let mut len = buffer.len();
+            let ret = unsafe {
+                crypto_ops_aes_gcm_decrypt(
+                    key.as_ptr(), key.len(),
+                    nonce.as_ptr(), NONCE_LEN,
+                    core::ptr::null(), 0,
+                    buffer.as_ptr(), buffer.len(),
+                    tag.as_ptr(), TAG_LEN,
+                    buffer.as_mut_ptr(), &mut len,
+                )
+            };
+            if ret == 0 {
+                return CryptoErrorCode::Success as i32;
             }
-            return Ok(());
+            // The firmware wipes the output on a bad tag; wipe it on other failures too
+            buffer.fill(0);
+            return if ret == CRYPTO_OPS_ERR_AUTH {
+                CryptoErrorCode::AuthenticationFailed as i32
+            } else {
+                CryptoErrorCode::DecryptionError as i32
+            };
+        }
+        
+        #[cfg(not(feature = "stm32h573i_dk"))]
+        open_in_place_software(key, nonce, buffer, tag)
+    }
+    
+    // Software fallback of `encrypt_data`: the frame is built in the output
+    // buffer and encrypted there, with no copy of the message on the stack
+    pub(crate) unsafe fn encrypt_with_software(
+        data: &[u8],
+        password: &[u8],
+        output_ptr: *mut u8,
+        output_max_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        let sealed_len = data.len() + TAG_LEN;
+        if sealed_len > u32::MAX as usize {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        let required_size = FRAME_HEADER_LEN + sealed_len;
+        if output_max_len < required_size {
+            *output_len = required_size;
+            return CryptoErrorCode::BufferTooSmall as i32;
+        }
+        
+        // PBKDF2 and HKDF, cached per session
+        let mut key = match derive_embedded_key(password) {
+            Ok(k) => k,
+            Err(_) => return CryptoErrorCode::KeyDerivationError as i32,
+        };
+        
+        let output = core::slice::from_raw_parts_mut(output_ptr, required_size);
+        let (header, sealed) = output.split_at_mut(FRAME_HEADER_LEN);
+        let (body, tag) = sealed.split_at_mut(data.len());
+        if get_random_bytes(&mut header[..NONCE_LEN]).is_err() {
+            key.zeroize();
+            return CryptoErrorCode::InternalError as i32;
+        }
+        header[NONCE_LEN..].copy_from_slice(&(sealed_len as u32).to_be_bytes());
+        body.copy_from_slice(data);
+        
+        let result = seal_in_place_software(&key, &header[..NONCE_LEN], body, tag);
+        key.zeroize();
+        if result == CryptoErrorCode::Success as i32 {
+            *output_len = required_size;
+        }
+        result
+    }
+    
+    // Software fallback of `decrypt_data`; `frame` is exactly one checked frame
+    pub(crate) unsafe fn decrypt_with_software(
+        frame: &[u8],
+        password: &[u8],
+        output_ptr: *mut u8,
+        output_max_len: usize,
+        output_len: *mut usize
+    ) -> i32 {
+        let sealed_len = frame.len() - FRAME_HEADER_LEN;
+        if sealed_len < TAG_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        let text_len = sealed_len - TAG_LEN;
+        if output_max_len < text_len {
+            *output_len = text_len;
+            return CryptoErrorCode::BufferTooSmall as i32;
         }
         
-        // Fallback to a simple PRNG if hardware RNG is not available
-        // This is not secure and should be replaced with a better solution
-        let seed = 0x12345678;
-        let mut state = seed;
+        let mut key = match derive_embedded_key(password) {
+            Ok(k) => k,
+            Err(_) => return CryptoErrorCode::KeyDerivationError as i32,
+        };
         
-        for byte in buffer.iter_mut() {
-            state = state.wrapping_mul(1103515245).wrapping_add(12345);
-            *byte = ((state >> 16) & 0xFF) as u8;
+        // Decrypt where the plaintext ends up
+        let (ciphertext, tag) = frame[FRAME_HEADER_LEN..].split_at(text_len);
+        let output = core::slice::from_raw_parts_mut(output_ptr, text_len);
+        output.copy_from_slice(ciphertext);
+        let result = open_in_place_software(&key, &frame[..NONCE_LEN], output, tag);
+        key.zeroize();
+        if result == CryptoErrorCode::Success as i32 {
+            *output_len = text_len;
         }
-        
-        Ok(())
+        result
     }
     
-    // Encrypt data using hardware acceleration if available
-    pub(crate) unsafe fn encrypt_with_hardware(
-        data: &[u8],
-        password: &[u8],
-        output_ptr: *mut u8,
-        output_max_len: usize,
-        output_len: *mut usize
-    ) -> Result<i32, ()> {
-        #[cfg(feature = "stm32h573i_dk")]
-        {
-            // Use STM32H5 hardware crypto accelerator
-            // This is a placeholder and should be replaced with actual hardware implementation
-            
-            // For now, just return an error to fall back to software implementation
-            return Err(());
+    /// Encrypts a message in place, handing back its nonce and tag separately
+    /// 
+    /// The zero-copy form of `encrypt_data` for embedded targets: the
+    /// ciphertext replaces the plaintext in the caller's buffer, ideally one
+    /// from the firmware's secure region, and no copy of the message is made
+    /// anywhere. Messages are limited to `EMBEDDED_MAX_MESSAGE_LEN` bytes.
+    /// If encryption fails after it started, the buffer holds neither
+    /// plaintext nor ciphertext.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `buffer_ptr` points to a valid buffer of at least `buffer_len` bytes
+    /// - `password_ptr` points to a valid buffer of at least `password_len` bytes
+    /// - `nonce_out` points to 12 writable bytes and `tag_out` to 16
+    #[no_mangle]
+    pub unsafe extern "C" fn encrypt_in_place_detached(
+        buffer_ptr: *mut u8, buffer_len: usize,
+        password_ptr: *const u8, password_len: usize,
+        nonce_out: *mut u8, tag_out: *mut u8
+    ) -> i32 {
+        // Validate parameters
+        if buffer_ptr.is_null() || password_ptr.is_null() || nonce_out.is_null() || tag_out.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        if buffer_len > EMBEDDED_MAX_MESSAGE_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
         }
         
-        // Hardware acceleration not available
-        Err(())
+        let password = core::slice::from_raw_parts(password_ptr, password_len);
+        let mut key = match derive_embedded_key(password) {
+            Ok(k) => k,
+            Err(_) => return CryptoErrorCode::KeyDerivationError as i32,
+        };
+        
+        let nonce = core::slice::from_raw_parts_mut(nonce_out, NONCE_LEN);
+        if get_random_bytes(nonce).is_err() {
+            key.zeroize();
+            return CryptoErrorCode::InternalError as i32;
+        }
+        
+        let buffer = core::slice::from_raw_parts_mut(buffer_ptr, buffer_len);
+        let tag = core::slice::from_raw_parts_mut(tag_out, TAG_LEN);
+        let result = seal_in_place(&key, nonce, buffer, tag);
+        key.zeroize();
+        result
     }
     
-    // Decrypt data using hardware acceleration if available
-    pub(crate) unsafe fn decrypt_with_hardware(
-        data: &[u8],
-        password: &[u8],
-        output_ptr: *mut u8,
-        output_max_len: usize,
-        output_len: *mut usize
-    ) -> Result<i32, ()> {
-        #[cfg(feature = "stm32h573i_dk")]
-        {
-            // Use STM32H5 hardware crypto accelerator
-            // This is a placeholder and should be replaced with actual hardware implementation
-            
-            // For now, just return an error to fall back to software implementation
-            return Err(());
+    /// Decrypts a message from `encrypt_in_place_detached` in place
+    /// 
+    /// The plaintext replaces the ciphertext in the caller's buffer, and is
+    /// wiped again if the tag does not verify. Messages are limited to
+    /// `EMBEDDED_MAX_MESSAGE_LEN` bytes.
+    /// 
+    /// # Safety
+    /// 
+    /// This function is unsafe because it dereferences raw pointers.
+    /// The caller must ensure that:
+    /// - `buffer_ptr` points to a valid buffer of at least `buffer_len` bytes
+    /// - `password_ptr` points to a valid buffer of at least `password_len` bytes
+    /// - `nonce_ptr` points to 12 readable bytes and `tag_ptr` to 16
+    #[no_mangle]
+    pub unsafe extern "C" fn decrypt_in_place_detached(
+        buffer_ptr: *mut u8, buffer_len: usize,
+        password_ptr: *const u8, password_len: usize,
+        nonce_ptr: *const u8, tag_ptr: *const u8
+    ) -> i32 {
+        // Validate parameters
+        if buffer_ptr.is_null() || password_ptr.is_null() || nonce_ptr.is_null() || tag_ptr.is_null() {
+            return CryptoErrorCode::InvalidParams as i32;
+        }
+        if buffer_len > EMBEDDED_MAX_MESSAGE_LEN {
+            return CryptoErrorCode::InvalidParams as i32;
         }
         
-        // Hardware acceleration not available
-        Err(())
+        let password = core::slice::from_raw_parts(password_ptr, password_len);
+        let mut key = match derive_embedded_key(password) {
+            Ok(k) => k,
+            Err(_) => return CryptoErrorCode::KeyDerivationError as i32,
+        };
+        
+        let buffer = core::slice::from_raw_parts_mut(buffer_ptr, buffer_len);
+        let nonce = core::slice::from_raw_parts(nonce_ptr, NONCE_LEN);
+        let tag = core::slice::from_raw_parts(tag_ptr, TAG_LEN);
+        let result = open_in_place(&key, nonce, buffer, tag);
+        key.zeroize();
+        result
     }
 }
 
@@ -689,4 +2361,494 @@ mod tests {
         // Should fail with authentication error
         assert_eq!(result, CryptoErrorCode::AuthenticationFailed as i32);
     }
+    
+    #[test]
+    fn test_key_based_roundtrip_with_stored_salt() {
+        let data = b"Hello, CRUSTy-Core!";
+        let password = b"secure_password";
+        let salt = [7u8; 16];
+        
+        // Deriving twice from the same salt and costs must yield the same key
+        let mut key = [0u8; 32];
+        let mut key_again = [0u8; 32];
+        let result = unsafe {
+            derive_key_with_params(
+                password.as_ptr(), password.len(),
+                salt.as_ptr(), salt.len(),
+                19456, 2, 1,
+                key.as_mut_ptr(), key.len()
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        let result = unsafe {
+            derive_key_with_params(
+                password.as_ptr(), password.len(),
+                salt.as_ptr(), salt.len(),
+                19456, 2, 1,
+                key_again.as_mut_ptr(), key_again.len()
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(key, key_again);
+        
+        // Encrypt with the derived key
+        let mut encrypted = vec![0u8; 1024];
+        let mut encrypted_len = 0;
+        let result = unsafe {
+            encrypt_with_key(
+                data.as_ptr(), data.len(),
+                key.as_ptr(), key.len(),
+                encrypted.as_mut_ptr(), encrypted.len(),
+                &mut encrypted_len
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(encrypted_len, 16 + data.len() + 16);
+        encrypted.truncate(encrypted_len);
+        
+        // Decrypt with the same key
+        let mut decrypted = vec![0u8; 1024];
+        let mut decrypted_len = 0;
+        let result = unsafe {
+            decrypt_with_key(
+                encrypted.as_ptr(), encrypted.len(),
+                key.as_ptr(), key.len(),
+                decrypted.as_mut_ptr(), decrypted.len(),
+                &mut decrypted_len
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        decrypted.truncate(decrypted_len);
+        assert_eq!(decrypted, data);
+        
+        // A different key must fail authentication
+        let wrong_key = [1u8; 32];
+        let result = unsafe {
+            decrypt_with_key(
+                encrypted.as_ptr(), encrypted.len(),
+                wrong_key.as_ptr(), wrong_key.len(),
+                decrypted.as_mut_ptr(), decrypted.len(),
+                &mut decrypted_len
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::AuthenticationFailed as i32);
+    }
+    
+    #[test]
+    fn test_in_place_encryption_matches_framing() {
+        let data = b"Hello, CRUSTy-Core!";
+        let key = [3u8; 32];
+        
+        // Plaintext goes after the 16-byte frame header
+        let mut frame = vec![0u8; 16 + data.len() + 16];
+        frame[16..16 + data.len()].copy_from_slice(data);
+        let mut frame_len = 0;
+        let result = unsafe {
+            encrypt_in_place_with_key(
+                frame.as_mut_ptr(), frame.len(),
+                data.len(),
+                key.as_ptr(), key.len(),
+                &mut frame_len
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(frame_len, frame.len());
+        assert_ne!(&frame[16..16 + data.len()], &data[..]);
+        
+        // A buffer without room for the tag is rejected up front
+        let mut small = vec![0u8; 16 + data.len()];
+        let mut required = 0;
+        let result = unsafe {
+            encrypt_in_place_with_key(
+                small.as_mut_ptr(), small.len(),
+                data.len(),
+                key.as_ptr(), key.len(),
+                &mut required
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::BufferTooSmall as i32);
+        assert_eq!(required, frame.len());
+        
+        // The frame decrypts like one from encrypt_with_key
+        let mut decrypted = vec![0u8; data.len()];
+        let mut decrypted_len = 0;
+        let result = unsafe {
+            decrypt_with_key(
+                frame.as_ptr(), frame.len(),
+                key.as_ptr(), key.len(),
+                decrypted.as_mut_ptr(), decrypted.len(),
+                &mut decrypted_len
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(&decrypted[..decrypted_len], &data[..]);
+        
+        // Tampering fails authentication and leaves no plaintext behind
+        frame[20] ^= 1;
+        let result = unsafe {
+            decrypt_with_key(
+                frame.as_ptr(), frame.len(),
+                key.as_ptr(), key.len(),
+                decrypted.as_mut_ptr(), decrypted.len(),
+                &mut decrypted_len
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::AuthenticationFailed as i32);
+        assert!(decrypted.iter().all(|&b| b == 0));
+    }
+
+    #[test]
+    fn test_batch_roundtrip_reports_per_item_status() {
+        let key = [5u8; 32];
+        let messages: Vec<Vec<u8>> = (0..100).map(|i| vec![i as u8; 64 + i]).collect();
+        
+        // The last message gets an output buffer without room for the tag
+        let mut frames: Vec<Vec<u8>> = messages.iter().map(|m| vec![0u8; 16 + m.len() + 16]).collect();
+        frames[99].truncate(16 + messages[99].len());
+        let mut items: Vec<CryptoBatchItem> = messages.iter().zip(frames.iter_mut()).map(|(m, f)| CryptoBatchItem {
+            input_ptr: m.as_ptr(),
+            input_len: m.len(),
+            output_ptr: f.as_mut_ptr(),
+            output_max_len: f.len(),
+            output_len: 0,
+            status: 0,
+        }).collect();
+        
+        let result = unsafe { encrypt_batch_with_key(items.as_mut_ptr(), items.len(), key.as_ptr(), key.len()) };
+        assert_eq!(result, CryptoErrorCode::BufferTooSmall as i32);
+        assert!(items[..99].iter().all(|item| item.status == CryptoErrorCode::Success as i32));
+        assert_eq!(items[99].status, CryptoErrorCode::BufferTooSmall as i32);
+        assert_eq!(items[99].output_len, 16 + messages[99].len() + 16);
+        
+        // Nonces are unique across the batch, including across RNG blocks
+        let mut nonces: Vec<&[u8]> = frames[..99].iter().map(|f| &f[..12]).collect();
+        nonces.sort();
+        nonces.dedup();
+        assert_eq!(nonces.len(), 99);
+        
+        // Tamper with one frame; only that message fails to decrypt
+        frames[3][20] ^= 1;
+        let mut plaintexts: Vec<Vec<u8>> = messages[..99].iter().map(|m| vec![0u8; m.len()]).collect();
+        let mut items: Vec<CryptoBatchItem> = frames[..99].iter().zip(plaintexts.iter_mut()).map(|(f, p)| CryptoBatchItem {
+            input_ptr: f.as_ptr(),
+            input_len: f.len(),
+            output_ptr: p.as_mut_ptr(),
+            output_max_len: p.len(),
+            output_len: 0,
+            status: 0,
+        }).collect();
+        
+        let result = unsafe { decrypt_batch_with_key(items.as_mut_ptr(), items.len(), key.as_ptr(), key.len()) };
+        assert_eq!(result, CryptoErrorCode::AuthenticationFailed as i32);
+        for (i, item) in items.iter().enumerate() {
+            if i == 3 {
+                assert_eq!(item.status, CryptoErrorCode::AuthenticationFailed as i32);
+                assert!(plaintexts[i].iter().all(|&b| b == 0));
+            } else {
+                assert_eq!(item.status, CryptoErrorCode::Success as i32);
+                assert_eq!(plaintexts[i], messages[i]);
+            }
+        }
+    }
+
+    #[test]
+    fn test_key_handle_roundtrip() {
+        let data = b"Hello, CRUSTy-Core!";
+        let password = b"secure_password";
+        let salt = [9u8; 16];
+        
+        // A derived handle encrypts like the key from derive_key_with_params
+        let mut handle: *mut CrustyKey = std::ptr::null_mut();
+        let result = unsafe {
+            derive_key_handle(
+                password.as_ptr(), password.len(),
+                salt.as_ptr(), salt.len(),
+                19456, 2, 1,
+                &mut handle
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert!(!handle.is_null());
+        
+        let mut key = [0u8; 32];
+        let result = unsafe {
+            derive_key_with_params(
+                password.as_ptr(), password.len(),
+                salt.as_ptr(), salt.len(),
+                19456, 2, 1,
+                key.as_mut_ptr(), key.len()
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        
+        // Consecutive encryptions use consecutive nonces
+        let mut first = vec![0u8; 16 + data.len() + 16];
+        let mut second = first.clone();
+        let mut len = 0;
+        for frame in [&mut first, &mut second] {
+            let result = unsafe {
+                encrypt_with_handle(handle, data.as_ptr(), data.len(), frame.as_mut_ptr(), frame.len(), &mut len)
+            };
+            assert_eq!(result, CryptoErrorCode::Success as i32);
+            assert_eq!(len, frame.len());
+        }
+        assert_eq!(&first[..4], &second[..4]);
+        let counter = |frame: &[u8]| u64::from_be_bytes(frame[4..12].try_into().unwrap());
+        assert_eq!(counter(&second), counter(&first).wrapping_add(1));
+        
+        // Frames from a handle open with the raw key and the other way round
+        let mut decrypted = vec![0u8; data.len()];
+        let result = unsafe {
+            decrypt_with_key(
+                second.as_ptr(), second.len(),
+                key.as_ptr(), key.len(),
+                decrypted.as_mut_ptr(), decrypted.len(),
+                &mut len
+            )
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(&decrypted[..len], &data[..]);
+        
+        let mut raw = vec![0u8; 16 + data.len() + 16];
+        let result = unsafe {
+            encrypt_with_key(data.as_ptr(), data.len(), key.as_ptr(), key.len(), raw.as_mut_ptr(), raw.len(), &mut len)
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        decrypted.fill(0);
+        let result = unsafe {
+            decrypt_with_handle(handle, raw.as_ptr(), raw.len(), decrypted.as_mut_ptr(), decrypted.len(), &mut len)
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(&decrypted[..len], &data[..]);
+        
+        // A handle from the raw bytes decrypts the same frames
+        let mut copy: *mut CrustyKey = std::ptr::null_mut();
+        let result = unsafe { create_key_handle(key.as_ptr(), key.len(), &mut copy) };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        let result = unsafe {
+            decrypt_with_handle(copy, first.as_ptr(), first.len(), decrypted.as_mut_ptr(), decrypted.len(), &mut len)
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        
+        unsafe {
+            destroy_key_handle(handle);
+            destroy_key_handle(copy);
+            destroy_key_handle(std::ptr::null_mut());
+        }
+    }
+
+    #[test]
+    fn test_explicit_nonce_roundtrip_rejects_other_nonces() {
+        let data = b"Hello, CRUSTy-Core!";
+        let key = [3u8; 32];
+        let mut handle: *mut CrustyKey = std::ptr::null_mut();
+        let result = unsafe { create_key_handle(key.as_ptr(), key.len(), &mut handle) };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        
+        // The frame carries exactly the nonce it was sealed under
+        let nonce = [1u8, 2, 3, 4, 5, 6, 7, 0, 0, 0, 5, 1];
+        let mut frame = vec![0u8; 16 + data.len() + 16];
+        let mut len = 0;
+        let result = unsafe {
+            encrypt_with_nonce(handle, data.as_ptr(), data.len(), nonce.as_ptr(),
+                               frame.as_mut_ptr(), frame.len(), &mut len)
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(&frame[..12], &nonce[..]);
+        
+        // Already in place gives the same frame
+        let mut in_place = vec![0u8; frame.len()];
+        in_place[16..16 + data.len()].copy_from_slice(data);
+        let result = unsafe {
+            encrypt_with_nonce(handle, in_place.as_ptr().add(16), data.len(), nonce.as_ptr(),
+                               in_place.as_mut_ptr(), in_place.len(), &mut len)
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(in_place, frame);
+        
+        let mut decrypted = vec![0u8; data.len()];
+        let result = unsafe {
+            decrypt_with_nonce(handle, frame.as_ptr(), frame.len(), nonce.as_ptr(),
+                               decrypted.as_mut_ptr(), decrypted.len(), &mut len)
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(&decrypted[..len], &data[..]);
+        
+        // Expecting another chunk index or the final flag flipped fails
+        let mut moved = nonce;
+        moved[10] = 6;
+        let mut not_final = nonce;
+        not_final[11] = 0;
+        for expected in [moved, not_final] {
+            let result = unsafe {
+                decrypt_with_nonce(handle, frame.as_ptr(), frame.len(), expected.as_ptr(),
+                                   decrypted.as_mut_ptr(), decrypted.len(), &mut len)
+            };
+            assert_eq!(result, CryptoErrorCode::DecryptionError as i32);
+        }
+        
+        // Rewriting the stored nonce to match is caught by the tag
+        frame[..12].copy_from_slice(&moved);
+        let result = unsafe {
+            decrypt_with_nonce(handle, frame.as_ptr(), frame.len(), moved.as_ptr(),
+                               decrypted.as_mut_ptr(), decrypted.len(), &mut len)
+        };
+        assert_eq!(result, CryptoErrorCode::AuthenticationFailed as i32);
+        
+        unsafe { destroy_key_handle(handle) };
+    }
+
+    #[test]
+    fn test_in_place_decryption_leaves_plaintext_after_header() {
+        let data = b"Hello, CRUSTy-Core!";
+        let key = [4u8; 32];
+        let mut handle: *mut CrustyKey = std::ptr::null_mut();
+        let result = unsafe { create_key_handle(key.as_ptr(), key.len(), &mut handle) };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        
+        let nonce = [9u8, 8, 7, 6, 5, 4, 3, 0, 0, 0, 1, 0];
+        let mut frame = vec![0u8; 16 + data.len() + 16];
+        let mut len = 0;
+        let result = unsafe {
+            encrypt_with_nonce(handle, data.as_ptr(), data.len(), nonce.as_ptr(),
+                               frame.as_mut_ptr(), frame.len(), &mut len)
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        let sealed = frame.clone();
+        
+        // The plaintext replaces the ciphertext after the frame header
+        let result = unsafe { decrypt_in_place_with_nonce(handle, frame.as_mut_ptr(), frame.len(), nonce.as_ptr(), &mut len) };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(len, data.len());
+        assert_eq!(&frame[16..16 + len], &data[..]);
+        
+        // Without the nonce check the result is the same
+        let mut unchecked = sealed.clone();
+        let result = unsafe { decrypt_in_place_with_handle(handle, unchecked.as_mut_ptr(), unchecked.len(), &mut len) };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_eq!(&unchecked[16..16 + len], &data[..]);
+        
+        // Another position is rejected before the buffer is touched
+        let mut moved = nonce;
+        moved[10] = 2;
+        let mut untouched = sealed.clone();
+        let result = unsafe { decrypt_in_place_with_nonce(handle, untouched.as_mut_ptr(), untouched.len(), moved.as_ptr(), &mut len) };
+        assert_eq!(result, CryptoErrorCode::DecryptionError as i32);
+        assert_eq!(untouched, sealed);
+        
+        // A bad tag leaves zeros instead of unauthenticated plaintext
+        let mut tampered = sealed.clone();
+        let last = tampered.len() - 1;
+        tampered[last] ^= 1;
+        let result = unsafe { decrypt_in_place_with_handle(handle, tampered.as_mut_ptr(), tampered.len(), &mut len) };
+        assert_eq!(result, CryptoErrorCode::AuthenticationFailed as i32);
+        assert!(tampered[16..16 + data.len()].iter().all(|&b| b == 0));
+        
+        // A truncated frame is refused
+        let result = unsafe { decrypt_in_place_with_handle(handle, frame.as_mut_ptr(), frame.len() - 1, &mut len) };
+        assert_eq!(result, CryptoErrorCode::InvalidParams as i32);
+        
+        unsafe { destroy_key_handle(handle) };
+    }
+
+    #[test]
+    fn test_fingerprint_is_keyed_and_separates_contexts() {
+        let data = b"Hello, CRUSTy-Core!";
+        let key = [5u8; 32];
+        let mut handle: *mut CrustyKey = std::ptr::null_mut();
+        let result = unsafe { create_key_handle(key.as_ptr(), key.len(), &mut handle) };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        
+        let fingerprint = |handle: *const CrustyKey, context: u64, data: &[u8]| {
+            let mut out = [0u8; FINGERPRINT_LEN];
+            let result = unsafe {
+                fingerprint_with_handle(handle, context, data.as_ptr(), data.len(), out.as_mut_ptr(), out.len())
+            };
+            assert_eq!(result, CryptoErrorCode::Success as i32);
+            out
+        };
+        
+        // HMAC-SHA256(HMAC-SHA256(key, label), context || data)
+        let expected: [u8; FINGERPRINT_LEN] = [
+            0x35, 0x43, 0xa3, 0xd2, 0xa8, 0x44, 0x09, 0xdf, 0x27, 0xe0, 0xc9, 0x7f, 0x02, 0x6e, 0xc1, 0x6e,
+            0x5e, 0xd4, 0xf2, 0x26, 0x17, 0x2e, 0x0a, 0x05, 0xc3, 0x64, 0x74, 0xa3, 0x05, 0xb9, 0x62, 0x3d,
+        ];
+        assert_eq!(fingerprint(handle, 7, data), expected);
+        assert_ne!(fingerprint(handle, 8, data), expected);
+        assert_ne!(fingerprint(handle, 7, &data[1..]), expected);
+        
+        // Another key gives unrelated fingerprints
+        let other_key = [6u8; 32];
+        let mut other: *mut CrustyKey = std::ptr::null_mut();
+        let result = unsafe { create_key_handle(other_key.as_ptr(), other_key.len(), &mut other) };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        assert_ne!(fingerprint(other, 7, data), expected);
+        
+        // Empty input needs no buffer; short output is refused
+        let empty = unsafe {
+            let mut out = [0u8; FINGERPRINT_LEN];
+            fingerprint_with_handle(handle, 0, std::ptr::null(), 0, out.as_mut_ptr(), out.len())
+        };
+        assert_eq!(empty, CryptoErrorCode::Success as i32);
+        let mut short = [0u8; FINGERPRINT_LEN - 1];
+        let result = unsafe {
+            fingerprint_with_handle(handle, 0, data.as_ptr(), data.len(), short.as_mut_ptr(), short.len())
+        };
+        assert_eq!(result, CryptoErrorCode::BufferTooSmall as i32);
+        
+        unsafe {
+            destroy_key_handle(handle);
+            destroy_key_handle(other);
+        }
+    }
+
+    #[test]
+    fn test_backend_matches_cpu_features() {
+        let features = get_cpu_features();
+        let backend = get_aes_backend();
+        
+        // Detection is cached, so repeated queries agree
+        assert_eq!(get_cpu_features(), features);
+        assert_eq!(get_aes_backend(), backend);
+        
+        // A hardware backend needs both AES rounds and carry-less multiplication
+        if backend != AesBackend::Software as i32 {
+            assert_eq!(features & CPU_FEATURE_AES, CPU_FEATURE_AES);
+            assert_eq!(features & CPU_FEATURE_CLMUL, CPU_FEATURE_CLMUL);
+            assert_eq!(require_hardware_aes(), CryptoErrorCode::Success as i32);
+        } else {
+            assert_eq!(require_hardware_aes(), CryptoErrorCode::HardwareNotAvailable as i32);
+        }
+    }
+    
+    #[test]
+    fn test_profile_counts_phases_when_enabled() {
+        let key = [5u8; 32];
+        let data = [7u8; 100];
+        let mut frame = vec![0u8; 16 + data.len() + 16];
+        let mut len = 0;
+        
+        let mut before = CryptoProfile::default();
+        let status = unsafe { get_crypto_profile(&mut before) };
+        let result = unsafe {
+            encrypt_with_key(data.as_ptr(), data.len(), key.as_ptr(), key.len(),
+                             frame.as_mut_ptr(), frame.len(), &mut len)
+        };
+        assert_eq!(result, CryptoErrorCode::Success as i32);
+        
+        let mut after = CryptoProfile::default();
+        assert_eq!(unsafe { get_crypto_profile(&mut after) }, status);
+        assert_eq!(unsafe { get_crypto_profile(std::ptr::null_mut()) }, CryptoErrorCode::InvalidParams as i32);
+        
+        if cfg!(feature = "profiling") {
+            // Other tests run concurrently, so counters only ever grow here
+            assert_eq!(status, CryptoErrorCode::Success as i32);
+            assert!(after.cipher_init.calls > before.cipher_init.calls);
+            assert!(after.aead.calls > before.aead.calls);
+            assert!(after.copy_out.calls > before.copy_out.calls);
+        } else {
+            assert_eq!(status, CryptoErrorCode::InternalError as i32);
+            assert_eq!(after, CryptoProfile::default());
+        }
+    }
 }
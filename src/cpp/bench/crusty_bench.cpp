@@ -0,0 +1,370 @@
+// Throughput benchmarks for the crypto FFI, the Crypto wrapper and the file
+// engine. Run with --benchmark_format=json or --benchmark_out=<file> for
+// machine-readable results. File benchmarks use CRUSTY_BENCH_DIR (default:
+// the system temp directory), so point it at the storage being sized.
+
+#include "core/audit_log.h"
+#include "core/crypto_interface.h"
+#include "core/encryptor.h"
+#include "core/secure_utils.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using namespace crusty;
+
+const std::string PASSWORD = "benchmark password";
+
+// Cheapest costs Argon2id accepts, so file benchmarks measure the pipeline
+const KdfParams MINIMAL_KDF{8, 1, 1};
+
+std::vector<uint8_t> pattern(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<uint8_t>(i * 131 + 7);
+    }
+    return data;
+}
+
+std::filesystem::path benchDirectory() {
+    const char* configured = std::getenv("CRUSTY_BENCH_DIR");
+    std::filesystem::path base = configured ? std::filesystem::path(configured)
+                                            : std::filesystem::temp_directory_path();
+    std::filesystem::path dir = base / "crusty_bench";
+    std::filesystem::create_directories(dir);
+    return dir;
+}
+
+// Raw key handle shared by the handle benchmarks
+class HandleKey {
+public:
+    HandleKey() {
+        std::vector<uint8_t> key(32, 0x42);
+        if (crypto::create_key_handle(key.data(), key.size(), &handle_) != 0) {
+            throw std::runtime_error("Failed to create key handle");
+        }
+    }
+    ~HandleKey() { crypto::destroy_key_handle(handle_); }
+    
+    crypto::crusty_key_t* get() const { return handle_; }
+
+private:
+    crypto::crusty_key_t* handle_ = nullptr;
+};
+
+//
+// Raw FFI
+//
+
+// Includes one default-cost Argon2id derivation per call
+void BM_FfiEncryptData(benchmark::State& state) {
+    std::vector<uint8_t> data = pattern(static_cast<size_t>(state.range(0)));
+    std::vector<uint8_t> output(data.size() + 64);
+    size_t written = 0;
+    
+    for (auto _ : state) {
+        int32_t result = crypto::encrypt_data(
+            data.data(), data.size(),
+            reinterpret_cast<const uint8_t*>(PASSWORD.data()), PASSWORD.size(),
+            output.data(), output.size(), &written);
+        if (result != 0) {
+            state.SkipWithError("encrypt_data failed");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+void BM_FfiDecryptData(benchmark::State& state) {
+    std::vector<uint8_t> data = pattern(static_cast<size_t>(state.range(0)));
+    std::vector<uint8_t> ciphertext(data.size() + 64);
+    size_t ciphertextSize = 0;
+    crypto::encrypt_data(data.data(), data.size(),
+                         reinterpret_cast<const uint8_t*>(PASSWORD.data()), PASSWORD.size(),
+                         ciphertext.data(), ciphertext.size(), &ciphertextSize);
+    std::vector<uint8_t> output(data.size() + 64);
+    size_t written = 0;
+    
+    for (auto _ : state) {
+        int32_t result = crypto::decrypt_data(
+            ciphertext.data(), ciphertextSize,
+            reinterpret_cast<const uint8_t*>(PASSWORD.data()), PASSWORD.size(),
+            output.data(), output.size(), &written);
+        if (result != 0) {
+            state.SkipWithError("decrypt_data failed");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+// AES-GCM alone: the key schedule is expanded once
+void BM_FfiEncryptWithHandle(benchmark::State& state) {
+    HandleKey key;
+    std::vector<uint8_t> data = pattern(static_cast<size_t>(state.range(0)));
+    std::vector<uint8_t> output(data.size() + 32);
+    size_t written = 0;
+    
+    for (auto _ : state) {
+        if (crypto::encrypt_with_handle(key.get(), data.data(), data.size(),
+                                        output.data(), output.size(), &written) != 0) {
+            state.SkipWithError("encrypt_with_handle failed");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+void BM_FfiDecryptWithHandle(benchmark::State& state) {
+    HandleKey key;
+    std::vector<uint8_t> data = pattern(static_cast<size_t>(state.range(0)));
+    std::vector<uint8_t> frame(data.size() + 32);
+    size_t frameSize = 0;
+    crypto::encrypt_with_handle(key.get(), data.data(), data.size(), frame.data(), frame.size(), &frameSize);
+    std::vector<uint8_t> output(std::max<size_t>(1, data.size()));
+    size_t written = 0;
+    
+    for (auto _ : state) {
+        if (crypto::decrypt_with_handle(key.get(), frame.data(), frameSize,
+                                        output.data(), output.size(), &written) != 0) {
+            state.SkipWithError("decrypt_with_handle failed");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+// No output buffer and no copy: the frame is decrypted where it lies
+void BM_FfiDecryptInPlace(benchmark::State& state) {
+    HandleKey key;
+    std::vector<uint8_t> data = pattern(static_cast<size_t>(state.range(0)));
+    std::vector<uint8_t> sealed(data.size() + 32);
+    size_t frameSize = 0;
+    crypto::encrypt_with_handle(key.get(), data.data(), data.size(), sealed.data(), sealed.size(), &frameSize);
+    std::vector<uint8_t> frame = sealed;
+    size_t written = 0;
+    
+    for (auto _ : state) {
+        if (crypto::decrypt_in_place_with_handle(key.get(), frame.data(), frameSize, &written) != 0) {
+            state.SkipWithError("decrypt_in_place_with_handle failed");
+            break;
+        }
+        benchmark::DoNotOptimize(frame.data());
+        
+        state.PauseTiming();
+        std::copy(sealed.begin(), sealed.end(), frame.begin());
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+//
+// Crypto wrapper, to compare with the raw calls above
+//
+
+void BM_CryptoEncrypt(benchmark::State& state) {
+    Crypto crypto;
+    std::vector<uint8_t> data = pattern(static_cast<size_t>(state.range(0)));
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(crypto.encrypt(data, PASSWORD));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+void BM_CryptoEncryptWithKey(benchmark::State& state) {
+    Crypto crypto;
+    SecureKey key = crypto.deriveKey(PASSWORD, std::vector<uint8_t>(16, 1), MINIMAL_KDF);
+    std::vector<uint8_t> data = pattern(static_cast<size_t>(state.range(0)));
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(crypto.encryptWithKey(data, key));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+void BM_CryptoEncryptInto(benchmark::State& state) {
+    Crypto crypto;
+    SecureKey key = crypto.deriveKey(PASSWORD, std::vector<uint8_t>(16, 1), MINIMAL_KDF);
+    std::vector<uint8_t> data = pattern(static_cast<size_t>(state.range(0)));
+    std::vector<uint8_t> output(data.size() + 32);
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(crypto.encryptInto(data.data(), data.size(), key, output.data(), output.size()));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+void BM_DeriveKey(benchmark::State& state) {
+    Crypto crypto;
+    std::vector<uint8_t> salt(16, 1);
+    KdfParams params;
+    params.memoryKib = static_cast<uint32_t>(state.range(0));
+    params.iterations = static_cast<uint32_t>(state.range(1));
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(crypto.deriveKey(PASSWORD, salt, params));
+    }
+}
+
+//
+// Secure memory
+//
+
+// Below and above STREAMING_WIPE_THRESHOLD, where the wipe switches to
+// non-temporal stores
+void BM_WipeMemory(benchmark::State& state) {
+    std::vector<uint8_t> buffer = pattern(static_cast<size_t>(state.range(0)));
+    
+    for (auto _ : state) {
+        secure::wipeMemory(buffer.data(), buffer.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+//
+// File engine
+//
+
+// Arguments: file size, chunk size, I/O (0 stream, 1 memory-mapped, 2 I/O threads, 3 io_uring)
+void configure(Encryptor& encryptor, const benchmark::State& state) {
+    encryptor.setChunkSize(static_cast<size_t>(state.range(1)));
+    encryptor.setIoMode(state.range(2) == 1 ? IoMode::MemoryMapped : IoMode::Stream);
+    encryptor.setIoEngine(state.range(2) == 2 ? IoEngine::ThreadPool
+                          : state.range(2) == 3 ? IoEngine::IoUring
+                          : IoEngine::Blocking);
+    encryptor.setKdfParams(MINIMAL_KDF);
+}
+
+std::string writeSource(const std::filesystem::path& dir, int64_t size) {
+    std::string path = (dir / ("source_" + std::to_string(size))).string();
+    if (!std::filesystem::exists(path) || std::filesystem::file_size(path) != static_cast<uint64_t>(size)) {
+        std::vector<uint8_t> data = pattern(static_cast<size_t>(size));
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+    return path;
+}
+
+void BM_EncryptFile(benchmark::State& state) {
+    std::filesystem::path dir = benchDirectory();
+    std::string source = writeSource(dir, state.range(0));
+    std::string dest = (dir / "encrypted").string();
+    Encryptor encryptor;
+    configure(encryptor, state);
+    
+    for (auto _ : state) {
+        std::filesystem::remove(dest);
+        encryptor.encryptFile(source, dest, PASSWORD);
+    }
+    std::filesystem::remove(dest);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+void BM_DecryptFile(benchmark::State& state) {
+    std::filesystem::path dir = benchDirectory();
+    std::string source = writeSource(dir, state.range(0));
+    std::string encrypted = (dir / "encrypted").string();
+    std::string dest = (dir / "decrypted").string();
+    Encryptor encryptor;
+    configure(encryptor, state);
+    std::filesystem::remove(encrypted);
+    encryptor.encryptFile(source, encrypted, PASSWORD);
+    
+    for (auto _ : state) {
+        std::filesystem::remove(dest);
+        encryptor.decryptFile(encrypted, dest, PASSWORD);
+    }
+    std::filesystem::remove(dest);
+    std::filesystem::remove(encrypted);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+
+void fileArguments(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgNames({"file", "chunk", "io"});
+    for (int64_t fileSize : {1ll << 20, 64ll << 20, 256ll << 20}) {
+        for (int64_t chunkSize : {64ll << 10, 1ll << 20, 8ll << 20}) {
+            for (int64_t io : {0, 1, 2, 3}) {
+                benchmark->Args({fileSize, chunkSize, io});
+            }
+        }
+    }
+    benchmark->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+constexpr int64_t MIN_BUFFER = 64;
+constexpr int64_t MAX_BUFFER = 16 << 20;
+
+BENCHMARK(BM_FfiEncryptData)->RangeMultiplier(16)->Range(MIN_BUFFER, MAX_BUFFER)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FfiDecryptData)->RangeMultiplier(16)->Range(MIN_BUFFER, MAX_BUFFER)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FfiEncryptWithHandle)->RangeMultiplier(16)->Range(MIN_BUFFER, MAX_BUFFER);
+BENCHMARK(BM_FfiDecryptWithHandle)->RangeMultiplier(16)->Range(MIN_BUFFER, MAX_BUFFER);
+BENCHMARK(BM_FfiDecryptInPlace)->RangeMultiplier(16)->Range(MIN_BUFFER, MAX_BUFFER);
+BENCHMARK(BM_CryptoEncrypt)->RangeMultiplier(16)->Range(MIN_BUFFER, MAX_BUFFER)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CryptoEncryptWithKey)->RangeMultiplier(16)->Range(MIN_BUFFER, MAX_BUFFER);
+BENCHMARK(BM_CryptoEncryptInto)->RangeMultiplier(16)->Range(MIN_BUFFER, MAX_BUFFER);
+BENCHMARK(BM_DeriveKey)->ArgNames({"memory_kib", "iterations"})
+    ->Args({19456, 2})->Args({65536, 3})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_WipeMemory)->RangeMultiplier(4)->Range(64 << 10, 16 << 20);
+BENCHMARK(BM_EncryptFile)->Apply(fileArguments);
+BENCHMARK(BM_DecryptFile)->Apply(fileArguments);
+
+// Where the run's time went inside Rust; stderr keeps JSON output on stdout intact
+void reportProfile() {
+    crypto::CryptoProfile profile{};
+    if (crypto::get_crypto_profile(&profile) != 0) {
+        return;
+    }
+    
+    const std::pair<const char*, crypto::CryptoPhaseStats> phases[] = {
+        {"kdf", profile.kdf},
+        {"cipher_init", profile.cipher_init},
+        {"aead", profile.aead},
+        {"copy_out", profile.copy_out},
+    };
+    uint64_t total = 0;
+    for (const auto& phase : phases) {
+        total += phase.second.nanos;
+    }
+    
+    std::fprintf(stderr, "\n%-12s %12s %14s %7s\n", "phase", "calls", "total ms", "share");
+    for (const auto& phase : phases) {
+        std::fprintf(stderr, "%-12s %12llu %14.1f %6.1f%%\n", phase.first,
+                     static_cast<unsigned long long>(phase.second.calls),
+                     phase.second.nanos / 1e6,
+                     total ? phase.second.nanos * 100.0 / total : 0.0);
+    }
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    // Keep audit logging off the measured path
+    AuditLog::getInstance().setMinimumLevel(AuditLog::EventType::Error);
+    AuditLog::getInstance().enableAsync();
+    
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    reportProfile();
+    return 0;
+}
@@ -0,0 +1,1205 @@
+#include "cli.h"
+#include "daemon.h"
+#include "../core/encryptor.h"
+#include "../core/batch_encryptor.h"
+#include "../core/audit_log.h"
+#include "../core/container_format.h"
+#include "../core/encryptor_stats.h"
+#include "../core/job_queue.h"
+#include "../core/key_cache.h"
+#include "../core/memory_budget.h"
+#include "../core/secure_utils.h"
+#include "../core/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace crusty {
+namespace cli {
+
+namespace {
+
+constexpr const char* VERSION = "CRUSTy-CLI v1.0.0";
+
+constexpr const char* USAGE =
+    "Usage: crusty_cli <command> [options] [arguments]\n"
+    "\n"
+    "Commands:\n"
+    "  encrypt <input> <output>          Encrypt a file (\"-\" for stdin/stdout)\n"
+    "  decrypt <input> <output>          Decrypt a file (\"-\" for stdin/stdout)\n"
+    "  batch encrypt|decrypt <path>...   Process files and directories\n"
+    "  update <input> <output>           Encrypt a file, rewriting only chunks changed since\n"
+    "                                    the last update of <output>\n"
+    "  verify <file>...                  Check encrypted files\n"
+    "  pack <archive> <path>...          Encrypt files and directories into one archive,\n"
+    "                                    storing repeated chunks once\n"
+    "  unpack <archive> <directory> [name]...\n"
+    "                                    Extract an archive created by pack, or only the\n"
+    "                                    named files\n"
+    "  list <archive>                    List the files in an archive\n"
+    "  key add|change <file>             Add a password to a file encrypted with --key-slots,\n"
+    "                                    or change the password of its slot\n"
+    "  key remove <file> <slot>          Take a password's slot away from a file\n"
+    "  calibrate [milliseconds]          Suggest key derivation costs (default 500 ms)\n"
+    "  daemon                            Serve encrypt and decrypt jobs from clients started\n"
+    "                                    with --socket, keeping keys and threads warm\n"
+    "  help                              Show this message\n"
+    "  version                           Show the version\n"
+    "\n"
+    "Options:\n"
+    "      --password-file <path>   Read the password from the first line of a file\n"
+    "      --password-env <name>    Read the password from an environment variable\n"
+    "  -j, --jobs <n>               Worker threads (default: one per hardware thread)\n"
+    "  -c, --chunk-size <size>      Chunk size when encrypting, e.g. 64K or 8M (default 8M)\n"
+    "      --mmap                   Use memory-mapped I/O for regular files\n"
+    "      --io-engine <name>       blocking, threads or io_uring (default blocking)\n"
+    "      --io-depth <n>           Reads and writes kept in flight by the I/O engine\n"
+    "      --memory <size>          Keep chunk buffers within a budget, e.g. 512M, choosing the\n"
+    "                               chunk size and worker count to fit unless -c or -j are\n"
+    "                               given; auto uses half the cgroup or physical memory limit\n"
+    "      --no-cache               Keep file data out of the page cache (bulk jobs)\n"
+    "      --sync <mode>            Make output durable: none, file or group (batch; default none)\n"
+    "  -f, --force                  Overwrite existing output files\n"
+    "      --rename                 batch: number output files that already exist\n"
+    "      --no-recursive           batch, pack: do not descend into subdirectories\n"
+    "  -a, --authenticate           verify: also authenticate every chunk, writing nothing\n"
+    "      --sample <n>             verify: authenticate only n chunks per file (first, last\n"
+    "                               and a random pick of the rest)\n"
+    "  -q, --quiet                  No progress output\n"
+    "      --require-hardware       Fail unless AES-GCM is hardware accelerated\n"
+    "      --kdf-memory <size>      Argon2id memory cost when encrypting, e.g. 64M\n"
+    "      --kdf-iterations <n>     Argon2id passes when encrypting\n"
+    "      --kdf-parallelism <n>    Argon2id lanes when encrypting\n"
+    "      --compress <name>        Compress before encrypting: none, lz4, zstd or auto\n"
+    "                               (zstd, skipping data that does not compress)\n"
+    "      --compress-level <n>     Codec level when compressing (default: codec default)\n"
+    "      --key-slots              When encrypting, seal the file key in a key slot so\n"
+    "                               passwords can be added and changed without re-encrypting\n"
+    "      --metrics-file <path>    Write Prometheus metrics to a file when done\n"
+    "      --trace <path>           Write a Chrome trace of where the time went when done\n"
+    "                               (builds configured with CRUSTY_TRACING)\n"
+    "      --socket <path>          daemon: socket to listen on; encrypt, decrypt: run the\n"
+    "                               job in the daemon listening there\n"
+    "\n"
+    "Without a password option the password is read from the terminal.\n"
+    "When decrypting to stdout, output written before an error is detected\n"
+    "must be discarded; the exit status is non-zero in that case.\n";
+
+class UsageError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct Options {
+    std::string command;
+    std::vector<std::string> arguments;
+    std::string passwordFile;
+    std::string passwordEnv;
+    size_t jobs = 0;
+    size_t chunkSize = 0;
+    bool mmap = false;
+    IoEngine ioEngine = IoEngine::Blocking;
+    size_t ioDepth = 0;
+    size_t memoryBudget = 0;
+    bool noCache = false;
+    OutputSync outputSync = OutputSync::None;
+    bool force = false;
+    bool rename = false;
+    bool recursive = true;
+    bool authenticate = false;
+    uint64_t sampleChunks = 0;
+    bool quiet = false;
+    bool requireHardware = false;
+    KdfParams kdf;
+    bool kdfSet = false;
+    CompressionSettings compression;
+    bool keySlots = false;
+    std::string metricsFile;
+    std::string traceFile;
+    std::string socket;
+};
+
+bool isStdio(const std::string& path) {
+    return path == "-";
+}
+
+size_t parseSize(const std::string& text, const std::string& option) {
+    size_t end = 0;
+    unsigned long long value = 0;
+    try {
+        value = std::stoull(text, &end);
+    } catch (const std::exception&) {
+        throw UsageError("Invalid value for " + option + ": " + text);
+    }
+    
+    std::string suffix = text.substr(end);
+    if (suffix == "K" || suffix == "k") {
+        value *= 1024;
+    } else if (suffix == "M" || suffix == "m") {
+        value *= 1024 * 1024;
+    } else if (suffix == "G" || suffix == "g") {
+        value *= 1024 * 1024 * 1024;
+    } else if (!suffix.empty()) {
+        throw UsageError("Invalid value for " + option + ": " + text);
+    }
+    return static_cast<size_t>(value);
+}
+
+Options parseArguments(int argc, char* argv[]) {
+    Options options;
+    if (argc < 2) {
+        throw UsageError("No command given");
+    }
+    options.command = argv[1];
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw UsageError("Missing value for " + arg);
+            }
+            return argv[++i];
+        };
+        
+        if (arg == "--password-file") {
+            options.passwordFile = value();
+        } else if (arg == "--password-env") {
+            options.passwordEnv = value();
+        } else if (arg == "-j" || arg == "--jobs") {
+            options.jobs = parseSize(value(), arg);
+        } else if (arg == "-c" || arg == "--chunk-size") {
+            options.chunkSize = parseSize(value(), arg);
+            if (options.chunkSize == 0 || options.chunkSize > container::MAX_CHUNK_SIZE) {
+                throw UsageError("Chunk size must be between 1 byte and 1G");
+            }
+        } else if (arg == "--mmap") {
+            options.mmap = true;
+        } else if (arg == "--io-engine") {
+            std::string name = value();
+            if (name == ioEngineName(IoEngine::Blocking)) {
+                options.ioEngine = IoEngine::Blocking;
+            } else if (name == ioEngineName(IoEngine::ThreadPool)) {
+                options.ioEngine = IoEngine::ThreadPool;
+            } else if (name == ioEngineName(IoEngine::IoUring)) {
+                options.ioEngine = IoEngine::IoUring;
+            } else {
+                throw UsageError("Unknown I/O engine: " + name);
+            }
+        } else if (arg == "--no-cache") {
+            options.noCache = true;
+        } else if (arg == "--sync") {
+            std::string mode = value();
+            if (mode == "none") {
+                options.outputSync = OutputSync::None;
+            } else if (mode == "file") {
+                options.outputSync = OutputSync::PerFile;
+            } else if (mode == "group") {
+                options.outputSync = OutputSync::Grouped;
+            } else {
+                throw UsageError("Unknown sync mode: " + mode);
+            }
+        } else if (arg == "--io-depth") {
+            options.ioDepth = parseSize(value(), arg);
+            if (options.ioDepth == 0) {
+                throw UsageError("I/O depth must be at least 1");
+            }
+        } else if (arg == "--memory") {
+            std::string text = value();
+            if (text == "auto") {
+                options.memoryBudget = MemoryBudget::detectMemoryLimit() / 2;
+                if (options.memoryBudget == 0) {
+                    throw UsageError("Cannot determine the memory limit; give --memory a size");
+                }
+            } else {
+                options.memoryBudget = parseSize(text, arg);
+            }
+            if (options.memoryBudget < MemoryBudget::MIN_BYTES) {
+                throw UsageError("The memory budget must be at least 4M");
+            }
+        } else if (arg == "-f" || arg == "--force") {
+            options.force = true;
+        } else if (arg == "--rename") {
+            options.rename = true;
+        } else if (arg == "--no-recursive") {
+            options.recursive = false;
+        } else if (arg == "-a" || arg == "--authenticate") {
+            options.authenticate = true;
+        } else if (arg == "--sample") {
+            options.sampleChunks = parseSize(value(), arg);
+            if (options.sampleChunks < 2) {
+                throw UsageError("The sample must be at least 2 chunks");
+            }
+            options.authenticate = true;
+        } else if (arg == "-q" || arg == "--quiet") {
+            options.quiet = true;
+        } else if (arg == "--require-hardware") {
+            options.requireHardware = true;
+        } else if (arg == "--kdf-memory") {
+            options.kdf.memoryKib = static_cast<uint32_t>(std::min<size_t>(parseSize(value(), arg) / 1024, UINT32_MAX));
+            options.kdfSet = true;
+        } else if (arg == "--kdf-iterations") {
+            options.kdf.iterations = static_cast<uint32_t>(std::min<size_t>(parseSize(value(), arg), UINT32_MAX));
+            options.kdfSet = true;
+        } else if (arg == "--kdf-parallelism") {
+            options.kdf.parallelism = static_cast<uint32_t>(std::min<size_t>(parseSize(value(), arg), UINT32_MAX));
+            options.kdfSet = true;
+        } else if (arg == "--compress") {
+            std::string name = value();
+            options.compression.skipIncompressible = name == "auto";
+            if (name == compression::name(Compression::None)) {
+                options.compression.algorithm = Compression::None;
+            } else if (name == compression::name(Compression::Lz4)) {
+                options.compression.algorithm = Compression::Lz4;
+            } else if (name == compression::name(Compression::Zstd) || name == "auto") {
+                options.compression.algorithm = Compression::Zstd;
+            } else {
+                throw UsageError("Unknown compression: " + name);
+            }
+            if (!compression::available(options.compression.algorithm)) {
+                throw UsageError("This build does not support " + name + " compression");
+            }
+        } else if (arg == "--compress-level") {
+            std::string text = value();
+            size_t end = 0;
+            try {
+                options.compression.level = std::stoi(text, &end);
+            } catch (const std::exception&) {
+                end = 0;
+            }
+            if (end == 0 || end != text.size()) {
+                throw UsageError("Invalid value for " + arg + ": " + text);
+            }
+        } else if (arg == "--metrics-file") {
+            options.metricsFile = value();
+        } else if (arg == "--trace") {
+            options.traceFile = value();
+            if (!trace::compiledIn()) {
+                throw UsageError("This build does not record traces; configure it with -DCRUSTY_TRACING=ON");
+            }
+        } else if (arg == "--key-slots") {
+            options.keySlots = true;
+        } else if (arg == "--socket") {
+            options.socket = value();
+        } else if (arg == "--") {
+            options.arguments.insert(options.arguments.end(), argv + i + 1, argv + argc);
+            break;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            throw UsageError("Unknown option: " + arg);
+        } else {
+            options.arguments.push_back(arg);
+        }
+    }
+    
+    if (!options.passwordFile.empty() && !options.passwordEnv.empty()) {
+        throw UsageError("Use only one of --password-file and --password-env");
+    }
+    if (options.kdfSet && !container::validKdfParams(options.kdf)) {
+        throw UsageError("Invalid key derivation costs");
+    }
+    if (!options.socket.empty() && options.command != "encrypt" && options.command != "decrypt" &&
+        options.command != "daemon") {
+        throw UsageError("--socket works only with encrypt, decrypt and daemon");
+    }
+    return options;
+}
+
+void stripLineEnding(std::string& line) {
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+        line.pop_back();
+    }
+}
+
+// Read a line from the terminal with echo turned off
+std::string promptPassword(const std::string& prompt) {
+    std::string password;
+#ifdef _WIN32
+    HANDLE console = CreateFileW(L"CONIN$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                 nullptr, OPEN_EXISTING, 0, nullptr);
+    if (console == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("No terminal to read the password from; use --password-file or --password-env");
+    }
+    
+    DWORD mode = 0;
+    GetConsoleMode(console, &mode);
+    SetConsoleMode(console, mode & ~static_cast<DWORD>(ENABLE_ECHO_INPUT));
+    std::cerr << prompt << std::flush;
+    
+    char buffer[512];
+    DWORD read = 0;
+    if (ReadConsoleA(console, buffer, sizeof(buffer), &read, nullptr)) {
+        password.assign(buffer, read);
+    }
+    secure::wipeMemory(buffer, sizeof(buffer));
+    
+    SetConsoleMode(console, mode);
+    CloseHandle(console);
+#else
+    int tty = ::open("/dev/tty", O_RDWR | O_CLOEXEC);
+    if (tty < 0) {
+        throw std::runtime_error("No terminal to read the password from; use --password-file or --password-env");
+    }
+    
+    termios original{};
+    bool restore = tcgetattr(tty, &original) == 0;
+    if (restore) {
+        termios silent = original;
+        silent.c_lflag &= ~static_cast<tcflag_t>(ECHO);
+        tcsetattr(tty, TCSAFLUSH, &silent);
+    }
+    ssize_t ignored = ::write(tty, prompt.data(), prompt.size());
+    (void)ignored;
+    
+    char c = 0;
+    while (::read(tty, &c, 1) == 1 && c != '\n') {
+        password.push_back(c);
+    }
+    
+    if (restore) {
+        tcsetattr(tty, TCSAFLUSH, &original);
+    }
+    ignored = ::write(tty, "\n", 1);
+    ::close(tty);
+#endif
+    stripLineEnding(password);
+    return password;
+}
+
+secure::SecureData<std::string> readPassword(const Options& options, bool confirm) {
+    secure::SecureData<std::string> password;
+    
+    if (!options.passwordFile.empty()) {
+        std::ifstream file(options.passwordFile, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open password file: " + options.passwordFile);
+        }
+        std::getline(file, password.get());
+        stripLineEnding(password.get());
+    } else if (!options.passwordEnv.empty()) {
+        const char* value = std::getenv(options.passwordEnv.c_str());
+        if (value == nullptr) {
+            throw std::runtime_error("Environment variable is not set: " + options.passwordEnv);
+        }
+        password.get() = value;
+    } else {
+        password = secure::SecureData<std::string>(promptPassword("Password: "));
+        if (confirm) {
+            secure::SecureData<std::string> again(promptPassword("Confirm password: "));
+            if (!secure::SecureView(again).equals(password)) {
+                throw std::runtime_error("Passwords do not match");
+            }
+        }
+    }
+    
+    if (password.get().empty()) {
+        throw std::runtime_error("The password must not be empty");
+    }
+    return password;
+}
+
+// Percentage on stderr, only when it goes to a terminal
+class ProgressPrinter {
+public:
+    explicit ProgressPrinter(bool quiet) {
+#ifdef _WIN32
+        enabled_ = !quiet && _isatty(_fileno(stderr));
+#else
+        enabled_ = !quiet && isatty(fileno(stderr));
+#endif
+    }
+    
+    ~ProgressPrinter() {
+        if (printed_) {
+            std::cerr << "\n";
+        }
+    }
+    
+    void update(float progress, const std::string& suffix = std::string()) {
+        int percent = static_cast<int>(progress * 100);
+        if (!enabled_ || percent == last_percent_) {
+            return;
+        }
+        last_percent_ = percent;
+        printed_ = true;
+        
+        // Pad over the rest of a longer previous line
+        std::string line = std::to_string(percent) + "%" + suffix;
+        size_t length = line.size();
+        line.resize(std::max(length, last_length_), ' ');
+        last_length_ = length;
+        std::cerr << "\r" << line << std::flush;
+    }
+
+private:
+    bool enabled_ = false;
+    bool printed_ = false;
+    int last_percent_ = -1;
+    size_t last_length_ = 0;
+};
+
+// " 45.2 MB/s, 12 s left" once the engine has a rate estimate
+std::string rateSuffix(const ProgressInfo& progress) {
+    if (progress.finished || progress.bytesPerSecond <= 0.0) {
+        return std::string();
+    }
+    
+    char rate[32];
+    std::snprintf(rate, sizeof(rate), " %.1f MB/s", progress.bytesPerSecond / (1024.0 * 1024.0));
+    std::string suffix = rate;
+    if (progress.hasEta()) {
+        suffix += ", " + std::to_string((progress.eta.count() + 999) / 1000) + " s left";
+    }
+    return suffix;
+}
+
+// Budget for --memory, or null without it
+std::shared_ptr<MemoryBudget> memoryBudget(const Options& options) {
+    return options.memoryBudget > 0 ? std::make_shared<MemoryBudget>(options.memoryBudget) : nullptr;
+}
+
+void configureEncryptor(Encryptor& encryptor, const Options& options) {
+    if (std::shared_ptr<MemoryBudget> budget = memoryBudget(options)) {
+        // Workers first, so the budget picks the chunk size for them
+        encryptor.setWorkerCount(options.jobs > 0 ? options.jobs : budget->plan().workers);
+        encryptor.setMemoryBudget(std::move(budget));
+    } else {
+        encryptor.setWorkerCount(options.jobs);
+    }
+    if (options.chunkSize > 0) {
+        encryptor.setChunkSize(options.chunkSize);
+    }
+    if (options.mmap) {
+        encryptor.setIoMode(IoMode::MemoryMapped);
+    }
+    encryptor.setIoEngine(options.ioEngine);
+    if (options.noCache) {
+        encryptor.setFileCaching(FileCaching::DropBehind);
+    }
+    encryptor.setOutputSync(options.outputSync);
+    if (options.ioDepth > 0) {
+        encryptor.setIoQueueDepth(options.ioDepth);
+    }
+    if (options.kdfSet) {
+        encryptor.setKdfParams(options.kdf);
+    }
+    encryptor.setCompression(options.compression);
+    encryptor.setKeySlots(options.keySlots);
+}
+
+// Writes the engine's metrics when the command ends, whether it succeeded or not
+class MetricsWriter {
+public:
+    MetricsWriter(const std::string& path, std::shared_ptr<EncryptorStats> stats)
+        : path_(path), stats_(std::move(stats)) {}
+    
+    ~MetricsWriter() {
+        if (path_.empty() || !stats_) {
+            return;
+        }
+        
+        // Write beside the target and rename, so collectors never see half a file
+        try {
+            std::string temporary = path_ + ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::trunc);
+                file << stats_->snapshot().toPrometheus();
+                if (!file) {
+                    throw std::runtime_error("write failed");
+                }
+            }
+            std::filesystem::rename(temporary, path_);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to write metrics to " << path_ << ": " << e.what() << std::endl;
+        }
+    }
+    
+    // Prevent copying
+    MetricsWriter(const MetricsWriter&) = delete;
+    MetricsWriter& operator=(const MetricsWriter&) = delete;
+
+private:
+    std::string path_;
+    std::shared_ptr<EncryptorStats> stats_;
+};
+
+// Captures trace spans while it lives, written as a Chrome trace at the end
+class TraceWriter {
+public:
+    explicit TraceWriter(const std::string& path) : path_(path) {
+        if (!path_.empty()) {
+            trace::start();
+        }
+    }
+    
+    ~TraceWriter() {
+        if (path_.empty()) {
+            return;
+        }
+        
+        trace::stop();
+        // Failed runs are written too; they are often the ones worth a look
+        try {
+            std::ofstream file(path_, std::ios::trunc);
+            trace::writeChromeTrace(file);
+            if (!file) {
+                throw std::runtime_error("write failed");
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to write trace to " << path_ << ": " << e.what() << std::endl;
+        }
+    }
+    
+    // Prevent copying
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+private:
+    std::string path_;
+};
+
+// Remove an existing output file when --force is given
+void prepareOutput(const std::string& path, const Options& options) {
+    if (!std::filesystem::exists(path)) {
+        return;
+    }
+    if (!options.force) {
+        throw std::runtime_error("Output file already exists (use --force to overwrite): " + path);
+    }
+    std::filesystem::remove(path);
+}
+
+// Hand the job to a daemon, which reads and writes our descriptors itself;
+// the engine settings are the daemon's
+int runRemote(const Options& options, bool encrypting) {
+#ifdef _WIN32
+    (void)encrypting;
+    throw std::runtime_error("--socket is not supported on Windows yet");
+#else
+    const std::string& input = options.arguments[0];
+    const std::string& output = options.arguments[1];
+    secure::SecureData<std::string> password = readPassword(options, encrypting);
+    
+    int inputFd = isStdio(input) ? STDIN_FILENO : ::open(input.c_str(), O_RDONLY | O_CLOEXEC);
+    if (inputFd < 0) {
+        throw std::runtime_error("Failed to open input file: " + input);
+    }
+    auto closeFiles = [&](int outputFd) {
+        if (!isStdio(input)) {
+            ::close(inputFd);
+        }
+        if (!isStdio(output) && outputFd >= 0) {
+            ::close(outputFd);
+        }
+    };
+    
+    uint64_t inputSize = 0;
+    struct stat info{};
+    if (fstat(inputFd, &info) == 0 && S_ISREG(info.st_mode)) {
+        inputSize = static_cast<uint64_t>(info.st_size);
+    }
+    
+    int outputFd = STDOUT_FILENO;
+    if (!isStdio(output)) {
+        try {
+            prepareOutput(output, options);
+        } catch (...) {
+            closeFiles(-1);
+            throw;
+        }
+        outputFd = ::open(output.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (outputFd < 0) {
+            closeFiles(-1);
+            throw std::runtime_error("Failed to create output file: " + output);
+        }
+    }
+    
+    try {
+        submitJob(options.socket, encrypting, inputFd, outputFd, inputSize, password);
+    } catch (...) {
+        closeFiles(outputFd);
+        if (!isStdio(output)) {
+            std::error_code ec;
+            std::filesystem::remove(output, ec);
+        }
+        throw;
+    }
+    closeFiles(outputFd);
+    return EXIT_OK;
+#endif
+}
+
+int runSingle(const Options& options, bool encrypting) {
+    if (options.arguments.size() != 2) {
+        throw UsageError(options.command + " takes an input and an output");
+    }
+    
+    const std::string& input = options.arguments[0];
+    const std::string& output = options.arguments[1];
+    if (isStdio(input) && options.passwordFile.empty() && options.passwordEnv.empty()) {
+#ifdef _WIN32
+        bool terminal = _isatty(_fileno(stdin));
+#else
+        bool terminal = isatty(fileno(stdin));
+#endif
+        if (terminal) {
+            throw UsageError("Refusing to read data from a terminal; redirect stdin or pass a file");
+        }
+    }
+    if (!options.socket.empty()) {
+        return runRemote(options, encrypting);
+    }
+    
+    Encryptor encryptor;
+    configureEncryptor(encryptor, options);
+    MetricsWriter metrics(options.metricsFile, encryptor.stats());
+    secure::SecureData<std::string> password = readPassword(options, encrypting);
+    
+    ProgressPrinter printer(options.quiet);
+    auto progress = [&printer](const ProgressInfo& value) { printer.update(value.fraction, rateSuffix(value)); };
+    
+    // Plain files take the regular path, which can use memory mapping
+    if (!isStdio(input) && !isStdio(output)) {
+        prepareOutput(output, options);
+        try {
+            if (encrypting) {
+                encryptor.encryptFile(input, output, password, progress);
+            } else {
+                encryptor.decryptFile(input, output, password, progress);
+            }
+        } catch (...) {
+            std::error_code ec;
+            std::filesystem::remove(output, ec);
+            throw;
+        }
+        return EXIT_OK;
+    }
+    
+    std::ifstream inputFile;
+    uint64_t inputSize = 0;
+    if (!isStdio(input)) {
+        inputFile.open(input, std::ios::binary);
+        if (!inputFile.is_open()) {
+            throw std::runtime_error("Failed to open input file: " + input);
+        }
+        std::error_code ec;
+        inputSize = std::filesystem::file_size(input, ec);
+    }
+    
+    std::ofstream outputFile;
+    if (!isStdio(output)) {
+        prepareOutput(output, options);
+        outputFile.open(output, std::ios::binary);
+        if (!outputFile.is_open()) {
+            throw std::runtime_error("Failed to create output file: " + output);
+        }
+    }
+    
+    std::istream& source = isStdio(input) ? std::cin : inputFile;
+    std::ostream& dest = isStdio(output) ? std::cout : outputFile;
+    try {
+        if (encrypting) {
+            encryptor.encryptStream(source, dest, password, progress, inputSize);
+        } else {
+            encryptor.decryptStream(source, dest, password, progress, inputSize);
+        }
+    } catch (...) {
+        if (!isStdio(output)) {
+            outputFile.close();
+            std::error_code ec;
+            std::filesystem::remove(output, ec);
+        }
+        throw;
+    }
+    return EXIT_OK;
+}
+
+int runBatch(const Options& options) {
+    if (options.arguments.size() < 2) {
+        throw UsageError("batch takes encrypt or decrypt and at least one path");
+    }
+    
+    BatchEncryptor::Operation operation;
+    if (options.arguments[0] == "encrypt") {
+        operation = BatchEncryptor::Operation::Encrypt;
+    } else if (options.arguments[0] == "decrypt") {
+        operation = BatchEncryptor::Operation::Decrypt;
+    } else {
+        throw UsageError("batch takes encrypt or decrypt, not " + options.arguments[0]);
+    }
+    
+    // A lone directory is processed while it is listed, so its outputs
+    // cannot be checked up front; the engine fails those that exist
+    // unless --force replaces them
+    bool streaming = options.arguments.size() == 2 && std::filesystem::is_directory(options.arguments[1]);
+    
+    std::vector<BatchEncryptor::Item> items;
+    for (size_t i = 1; i < options.arguments.size() && !streaming; ++i) {
+        const std::string& path = options.arguments[i];
+        if (std::filesystem::is_directory(path)) {
+            auto found = BatchEncryptor::collectDirectory(path, operation, options.recursive);
+            items.insert(items.end(), found.begin(), found.end());
+        } else {
+            items.push_back({path, BatchEncryptor::defaultDestPath(path, operation)});
+        }
+    }
+    
+    if (items.empty() && !streaming) {
+        std::cerr << "No files to process" << std::endl;
+        return EXIT_OK;
+    }
+    
+    // --rename numbers taken outputs instead of overwriting or refusing them
+    if (!options.rename && !streaming) {
+        for (const auto& item : items) {
+            prepareOutput(item.destPath, options);
+        }
+    }
+    
+    std::shared_ptr<MemoryBudget> budget = memoryBudget(options);
+    BatchEncryptor batch(options.jobs > 0 || !budget ? options.jobs : budget->plan().workers);
+    batch.setMemoryBudget(budget);
+    if (options.chunkSize > 0) {
+        batch.setChunkSize(options.chunkSize);
+    }
+    if (options.mmap) {
+        batch.setIoMode(IoMode::MemoryMapped);
+    }
+    batch.setIoEngine(options.ioEngine);
+    if (options.noCache) {
+        batch.setFileCaching(FileCaching::DropBehind);
+    }
+    batch.setOutputSync(options.outputSync);
+    batch.setRenameConflicts(options.rename);
+    batch.setReplaceExisting(options.force);
+    if (options.ioDepth > 0) {
+        batch.setIoQueueDepth(options.ioDepth);
+    }
+    if (options.kdfSet) {
+        batch.setKdfParams(options.kdf);
+    }
+    batch.setCompression(options.compression);
+    batch.setKeySlots(options.keySlots);
+    MetricsWriter metrics(options.metricsFile, batch.stats());
+    
+    secure::SecureData<std::string> password = readPassword(options, operation == BatchEncryptor::Operation::Encrypt);
+    
+    std::vector<BatchEncryptor::Result> results;
+    {
+        ProgressPrinter printer(options.quiet);
+        auto onProgress = [&printer](const BatchEncryptor::Progress& progress) {
+            printer.update(progress.overallProgress,
+                           " (" + std::to_string(progress.completedItems) + "/" +
+                           std::to_string(progress.totalItems) + (progress.listing ? "+" : "") + " files)");
+        };
+        if (streaming) {
+            results = batch.runDirectory(options.arguments[1], operation, password, options.recursive, onProgress);
+        } else {
+            results = batch.run(items, operation, password, onProgress);
+        }
+    }
+    
+    if (results.empty()) {
+        std::cerr << "No files to process" << std::endl;
+        return EXIT_OK;
+    }
+    
+    size_t failed = 0;
+    size_t cancelled = 0;
+    for (const auto& result : results) {
+        if (result.status == BatchEncryptor::Status::Failed) {
+            ++failed;
+            std::cerr << "FAILED " << result.sourcePath << ": " << result.error << std::endl;
+        } else if (result.status == BatchEncryptor::Status::Cancelled) {
+            ++cancelled;
+        }
+    }
+    
+    // A wrong password stops a decrypt batch, leaving the rest cancelled
+    if (!options.quiet) {
+        std::cerr << (results.size() - failed - cancelled) << " of " << results.size() << " files processed";
+        if (failed > 0) {
+            std::cerr << ", " << failed << " failed";
+        }
+        if (cancelled > 0) {
+            std::cerr << ", " << cancelled << " cancelled";
+        }
+        std::cerr << std::endl;
+    }
+    return failed == 0 && cancelled == 0 ? EXIT_OK : EXIT_FAILED;
+}
+
+int runVerify(const Options& options) {
+    if (options.arguments.empty()) {
+        throw UsageError("verify takes at least one file");
+    }
+    
+    Encryptor encryptor;
+    configureEncryptor(encryptor, options);
+    MetricsWriter metrics(options.metricsFile, encryptor.stats());
+    
+    secure::SecureData<std::string> password;
+    if (options.authenticate) {
+        password = readPassword(options, false);
+    }
+    
+    size_t failed = 0;
+    for (const auto& path : options.arguments) {
+        try {
+            if (!options.authenticate) {
+                container::ContainerInfo info = encryptor.inspectFile(path);
+                std::cout << "OK     " << path << " (" << info.chunkOffsets.size() << " chunks, "
+                          << info.plaintextSize << " bytes)" << std::endl;
+                continue;
+            }
+            
+            VerifyResult result = encryptor.verifyFile(path, password, ProgressCallback{}, options.sampleChunks);
+            std::cout << "OK     " << path << " (" << result.chunkCount << " chunks, "
+                      << result.plaintextSize << " bytes, ";
+            if (result.complete()) {
+                std::cout << "authenticated)" << std::endl;
+            } else {
+                std::cout << result.chunksVerified << " chunks authenticated)" << std::endl;
+            }
+        } catch (const std::exception& e) {
+            ++failed;
+            std::cout << "FAILED " << path << ": " << e.what() << std::endl;
+        }
+    }
+    return failed == 0 ? EXIT_OK : EXIT_FAILED;
+}
+
+int runUpdate(const Options& options) {
+    if (options.arguments.size() != 2) {
+        throw UsageError("update takes an input and an output");
+    }
+    
+    const std::string& input = options.arguments[0];
+    const std::string& output = options.arguments[1];
+    if (isStdio(input) || isStdio(output)) {
+        throw UsageError("update works on files, not stdin or stdout");
+    }
+    
+    Encryptor encryptor;
+    configureEncryptor(encryptor, options);
+    MetricsWriter metrics(options.metricsFile, encryptor.stats());
+    
+    // A new file gets its password confirmed; an existing one checks it
+    secure::SecureData<std::string> password = readPassword(options, !std::filesystem::exists(output));
+    
+    UpdateResult result;
+    {
+        ProgressPrinter printer(options.quiet);
+        result = encryptor.updateFile(input, output, password,
+            [&printer](const ProgressInfo& value) { printer.update(value.fraction, rateSuffix(value)); });
+    }
+    if (!options.quiet) {
+        std::cerr << "Rewrote " << result.chunksRewritten << " of " << result.chunkCount << " chunks"
+                  << (result.incremental ? "" : " (new encryption)") << std::endl;
+    }
+    return EXIT_OK;
+}
+
+// Files keep their path below the directory given, including its own name
+std::vector<ArchiveItem> collectPackItems(const std::vector<std::string>& paths, bool recursive) {
+    std::vector<ArchiveItem> items;
+    for (const auto& path : paths) {
+        if (!std::filesystem::is_directory(path)) {
+            items.push_back({path, std::filesystem::path(path).filename().generic_string()});
+            continue;
+        }
+        
+        std::filesystem::path root = std::filesystem::absolute(path).lexically_normal();
+        if (root.filename().empty()) {
+            root = root.parent_path();
+        }
+        std::filesystem::path parent = root.parent_path();
+        std::vector<ArchiveItem> found;
+        auto add = [&](const std::filesystem::directory_entry& entry) {
+            if (entry.is_regular_file()) {
+                found.push_back({entry.path().string(), entry.path().lexically_relative(parent).generic_string()});
+            }
+        };
+        if (recursive) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(root)) {
+                add(entry);
+            }
+        } else {
+            for (const auto& entry : std::filesystem::directory_iterator(root)) {
+                add(entry);
+            }
+        }
+        std::sort(found.begin(), found.end(),
+                  [](const ArchiveItem& a, const ArchiveItem& b) { return a.name < b.name; });
+        items.insert(items.end(), found.begin(), found.end());
+    }
+    return items;
+}
+
+int runPack(const Options& options) {
+    if (options.arguments.size() < 2) {
+        throw UsageError("pack takes an archive and at least one file or directory");
+    }
+    
+    const std::string& archive = options.arguments[0];
+    std::vector<std::string> paths(options.arguments.begin() + 1, options.arguments.end());
+    std::vector<ArchiveItem> items = collectPackItems(paths, options.recursive);
+    prepareOutput(archive, options);
+    
+    Encryptor encryptor;
+    configureEncryptor(encryptor, options);
+    MetricsWriter metrics(options.metricsFile, encryptor.stats());
+    secure::SecureData<std::string> password = readPassword(options, true);
+    
+    PackResult result;
+    {
+        ProgressPrinter printer(options.quiet);
+        result = encryptor.packFiles(items, archive, password,
+            [&printer](const ProgressInfo& value) { printer.update(value.fraction, rateSuffix(value)); });
+    }
+    if (!options.quiet) {
+        std::cerr << "Packed " << result.files << " files: " << result.chunksStored << " of "
+                  << result.chunkCount << " chunks stored (" << result.bytesStored << " of "
+                  << result.bytesRead << " bytes)" << std::endl;
+    }
+    return EXIT_OK;
+}
+
+int runUnpack(const Options& options) {
+    if (options.arguments.size() < 2) {
+        throw UsageError("unpack takes an archive, a directory and optionally file names");
+    }
+    
+    const std::string& archive = options.arguments[0];
+    const std::string& directory = options.arguments[1];
+    std::vector<std::string> names(options.arguments.begin() + 2, options.arguments.end());
+    
+    // Named files only replace what has their names
+    std::error_code ec;
+    if (!options.force && names.empty() && std::filesystem::is_directory(directory, ec) &&
+        !std::filesystem::is_empty(directory, ec)) {
+        throw std::runtime_error("Output directory is not empty (use --force to overwrite files in it): " + directory);
+    }
+    if (!options.force) {
+        for (const std::string& name : names) {
+            std::string path = (std::filesystem::path(directory) / name).string();
+            if (std::filesystem::exists(path, ec)) {
+                throw std::runtime_error("Output file already exists (use --force to overwrite): " + path);
+            }
+        }
+    }
+    
+    Encryptor encryptor;
+    configureEncryptor(encryptor, options);
+    MetricsWriter metrics(options.metricsFile, encryptor.stats());
+    secure::SecureData<std::string> password = readPassword(options, false);
+    
+    ProgressPrinter printer(options.quiet);
+    auto onProgress = [&printer](const ProgressInfo& value) { printer.update(value.fraction, rateSuffix(value)); };
+    if (names.empty()) {
+        encryptor.unpackArchive(archive, directory, password, onProgress);
+    } else {
+        encryptor.extractFiles(archive, names, directory, password, onProgress);
+    }
+    return EXIT_OK;
+}
+
+int runList(const Options& options) {
+    if (options.arguments.size() != 1) {
+        throw UsageError("list takes an archive");
+    }
+    
+    Encryptor encryptor;
+    configureEncryptor(encryptor, options);
+    secure::SecureData<std::string> password = readPassword(options, false);
+    container::ArchiveCatalog catalog = encryptor.listArchive(options.arguments[0], password);
+    
+    uint64_t totalSize = 0;
+    for (const container::ArchiveEntry& entry : catalog.entries) {
+        std::cout << std::setw(14) << entry.size << "  " << entry.name << "\n";
+        totalSize += entry.size;
+    }
+    uint64_t storedSize = 0;
+    for (const container::StoredChunk& chunk : catalog.chunks) {
+        storedSize += chunk.size;
+    }
+    std::cout.flush();
+    if (!options.quiet) {
+        std::cerr << catalog.entries.size() << " files, " << totalSize << " bytes in "
+                  << catalog.chunks.size() << " stored chunks of " << storedSize << " bytes" << std::endl;
+    }
+    return EXIT_OK;
+}
+
+int runCalibrate(const Options& options) {
+    if (options.arguments.size() > 1) {
+        throw UsageError("calibrate takes at most a target time in milliseconds");
+    }
+    
+    std::chrono::milliseconds target(500);
+    if (!options.arguments.empty()) {
+        target = std::chrono::milliseconds(parseSize(options.arguments[0], "calibrate"));
+        if (target.count() == 0) {
+            throw UsageError("The target time must be at least 1 ms");
+        }
+    }
+    
+    uint32_t memoryKib = options.kdfSet ? options.kdf.memoryKib : Crypto::DEFAULT_CALIBRATION_MEMORY_KIB;
+    KdfParams params = Crypto().calibrateKdf(target, memoryKib, options.kdf.parallelism);
+    
+    std::cout << "--kdf-memory " << params.memoryKib << "K"
+              << " --kdf-iterations " << params.iterations
+              << " --kdf-parallelism " << params.parallelism << std::endl;
+    return EXIT_OK;
+}
+
+// Edit the key slots of a file; only its header is rewritten
+int runKey(const Options& options) {
+    const std::vector<std::string>& args = options.arguments;
+    bool removing = !args.empty() && args[0] == "remove";
+    if (args.size() != (removing ? 3u : 2u) || (!removing && args[0] != "add" && args[0] != "change")) {
+        throw UsageError("key takes add <file>, change <file> or remove <file> <slot>");
+    }
+    
+    Encryptor encryptor;
+    configureEncryptor(encryptor, options);
+    secure::SecureData<std::string> password = readPassword(options, false);
+    if (removing) {
+        size_t slot = parseSize(args[2], "key remove");
+        encryptor.removeKeySlot(args[1], password, slot);
+        if (!options.quiet) {
+            std::cerr << "Removed key slot " << slot << std::endl;
+        }
+        return EXIT_OK;
+    }
+    
+    // The new password always comes from the terminal, confirmed
+    secure::SecureData<std::string> newPassword(promptPassword("New password: "));
+    secure::SecureData<std::string> again(promptPassword("Confirm new password: "));
+    if (!secure::SecureView(again).equals(newPassword)) {
+        throw std::runtime_error("Passwords do not match");
+    }
+    if (newPassword.get().empty()) {
+        throw std::runtime_error("The password must not be empty");
+    }
+    
+    size_t slot = args[0] == "add" ? encryptor.addKeySlot(args[1], password, newPassword)
+                                   : encryptor.changeKeySlotPassword(args[1], password, newPassword);
+    if (!options.quiet) {
+        std::cerr << (args[0] == "add" ? "Added key slot " : "Changed key slot ") << slot << std::endl;
+    }
+    return EXIT_OK;
+}
+
+// Serve jobs until stopped, reusing derived keys across them
+int runDaemonCommand(const Options& options) {
+    if (!options.arguments.empty()) {
+        throw UsageError("daemon takes no arguments");
+    }
+    
+    Encryptor encryptor;
+    configureEncryptor(encryptor, options);
+    encryptor.setKeyCache(std::make_shared<KeyCache>());
+    MetricsWriter metrics(options.metricsFile, encryptor.stats());
+    runDaemon(encryptor, options.socket.empty() ? defaultSocketPath() : options.socket, JobQueue::DEFAULT_WORKERS,
+              options.quiet);
+    return EXIT_OK;
+}
+
+} // anonymous namespace
+
+int run(int argc, char* argv[]) {
+    // Standard streams carry binary data and are read in whole chunks
+    std::ios::sync_with_stdio(false);
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    // Keep audit logging off the data path
+    AuditLog::getInstance().enableAsync();
+    
+    // Probe the CPU while the arguments are parsed
+    Crypto::warmUp();
+    
+    try {
+        Options options = parseArguments(argc, argv);
+        TraceWriter tracer(options.traceFile);
+        
+        if (options.command == "help" || options.command == "-h" || options.command == "--help") {
+            std::cout << USAGE;
+            return EXIT_OK;
+        }
+        if (options.command == "version" || options.command == "--version") {
+            std::cout << VERSION << std::endl;
+            std::cout << "AES-GCM backend: " << Crypto::aesBackendName(Crypto::aesBackend()) << std::endl;
+            return EXIT_OK;
+        }
+        if (options.requireHardware) {
+            Crypto::requireHardwareAcceleration();
+        }
+        if (options.command == "encrypt" || options.command == "decrypt") {
+            return runSingle(options, options.command == "encrypt");
+        }
+        if (options.command == "batch") {
+            return runBatch(options);
+        }
+        if (options.command == "update") {
+            return runUpdate(options);
+        }
+        if (options.command == "verify") {
+            return runVerify(options);
+        }
+        if (options.command == "pack") {
+            return runPack(options);
+        }
+        if (options.command == "unpack") {
+            return runUnpack(options);
+        }
+        if (options.command == "list") {
+            return runList(options);
+        }
+        if (options.command == "key") {
+            return runKey(options);
+        }
+        if (options.command == "calibrate") {
+            return runCalibrate(options);
+        }
+        if (options.command == "daemon") {
+            return runDaemonCommand(options);
+        }
+        throw UsageError("Unknown command: " + options.command);
+    } catch (const UsageError& e) {
+        std::cerr << "Error: " << e.what() << "\n\n" << USAGE;
+        return EXIT_USAGE;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILED;
+    }
+}
+
+} // namespace cli
+} // namespace crusty
@@ -0,0 +1,40 @@
+#pragma once
+
+namespace crusty {
+namespace cli {
+
+/**
+ * Process exit codes used by the command-line interface
+ */
+constexpr int EXIT_OK = 0;
+constexpr int EXIT_FAILED = 1;
+constexpr int EXIT_USAGE = 2;
+
+/**
+ * @brief Run the headless command-line interface
+ * 
+ * Commands:
+ *   encrypt <input> <output>          Encrypt one file; "-" is stdin/stdout
+ *   decrypt <input> <output>          Decrypt one file; "-" is stdin/stdout
+ *   batch encrypt|decrypt <path>...   Process files and whole directories
+ *   verify <file>...                  Check container structure, and with
+ *                                     --authenticate every chunk's tag
+ *   calibrate [milliseconds]          Suggest Argon2id costs for this host
+ *   daemon                            Serve encrypt and decrypt jobs over a
+ *                                     Unix socket; with --socket, encrypt
+ *                                     and decrypt run in the daemon
+ * 
+ * Streams are processed chunk by chunk, so memory use is bounded by the
+ * chunk size and no temporary files are written. The password is read from
+ * --password-file, --password-env or the terminal, never from standard
+ * input, which stays free for data.
+ * 
+ * @param argc Argument count from main
+ * @param argv Arguments from main
+ * @return EXIT_OK, EXIT_FAILED if any operation failed, or EXIT_USAGE for
+ *         invalid arguments
+ */
+int run(int argc, char* argv[]);
+
+} // namespace cli
+} // namespace crusty
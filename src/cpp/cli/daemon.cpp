@@ -0,0 +1,741 @@
+#include "daemon.h"
+#include "../core/encryptor.h"
+#include "../core/audit_log.h"
+#include "../core/job_queue.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace crusty {
+namespace cli {
+
+#ifdef _WIN32
+
+std::string defaultSocketPath() {
+    return std::string();
+}
+
+void runDaemon(Encryptor&, const std::string&, size_t, bool) {
+    throw std::runtime_error("The daemon is not supported on Windows yet");
+}
+
+void submitJob(const std::string&, bool, int, int, uint64_t, secure::SecureView) {
+    throw std::runtime_error("The daemon is not supported on Windows yet");
+}
+
+#else
+
+namespace {
+
+// Request: magic | version | operation | reserved (2) | input size (8) |
+// password length (4) | password, with the input and output descriptors
+// attached to its first byte. Response: status | error code | reserved (2) |
+// message length (4) | message. Integers are big-endian.
+constexpr uint8_t MAGIC[4] = {'C', 'R', 'S', 'D'};
+constexpr uint8_t PROTOCOL_VERSION = 1;
+constexpr size_t REQUEST_HEADER_SIZE = 20;
+constexpr size_t RESPONSE_HEADER_SIZE = 8;
+constexpr uint32_t MAX_PASSWORD_SIZE = 64 * 1024;
+constexpr uint32_t MAX_MESSAGE_SIZE = 64 * 1024;
+
+constexpr uint8_t OPERATION_ENCRYPT = 1;
+constexpr uint8_t OPERATION_DECRYPT = 2;
+
+constexpr uint8_t STATUS_OK = 0;
+constexpr uint8_t STATUS_FAILED = 1;
+
+// A client has this long to send its request once connected
+constexpr int REQUEST_TIMEOUT_MS = 10000;
+
+constexpr size_t DESCRIPTOR_BUFFER_SIZE = 64 * 1024;
+
+void putU32(uint8_t* out, uint32_t value) {
+    for (int i = 3; i >= 0; --i) {
+        out[i] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+}
+
+void putU64(uint8_t* out, uint64_t value) {
+    for (int i = 7; i >= 0; --i) {
+        out[i] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+}
+
+uint32_t getU32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+uint64_t getU64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+[[noreturn]] void systemError(const std::string& message) {
+    throw std::runtime_error(message + " (" + std::strerror(errno) + ")");
+}
+
+// Owns a descriptor, closing it when dropped
+class Descriptor {
+public:
+    explicit Descriptor(int fd = -1) : fd_(fd) {}
+    Descriptor(Descriptor&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+    
+    Descriptor& operator=(Descriptor&& other) noexcept {
+        if (this != &other) {
+            reset();
+            fd_ = std::exchange(other.fd_, -1);
+        }
+        return *this;
+    }
+    
+    ~Descriptor() { reset(); }
+    
+    int get() const { return fd_; }
+    bool valid() const { return fd_ >= 0; }
+    
+    void reset() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+    
+    // Prevent copying
+    Descriptor(const Descriptor&) = delete;
+    Descriptor& operator=(const Descriptor&) = delete;
+
+private:
+    int fd_;
+};
+
+// Stream buffer over a descriptor a client passed. Blocks of a buffer or
+// more bypass the buffer, so chunk-sized reads and writes are one system
+// call each. Read errors throw so the stream goes bad instead of looking
+// like the end of the input.
+class DescriptorStreamBuf : public std::streambuf {
+public:
+    explicit DescriptorStreamBuf(int fd) : fd_(fd) {}
+    
+    ~DescriptorStreamBuf() override {
+        sync();
+    }
+    
+    // Prevent copying
+    DescriptorStreamBuf(const DescriptorStreamBuf&) = delete;
+    DescriptorStreamBuf& operator=(const DescriptorStreamBuf&) = delete;
+
+protected:
+    int_type underflow() override {
+        if (input_.empty()) {
+            input_.resize(DESCRIPTOR_BUFFER_SIZE);
+        }
+        size_t count = readSome(input_.data(), input_.size());
+        if (count == 0) {
+            return traits_type::eof();
+        }
+        setg(input_.data(), input_.data(), input_.data() + count);
+        return traits_type::to_int_type(*gptr());
+    }
+    
+    std::streamsize xsgetn(char* s, std::streamsize count) override {
+        std::streamsize copied = 0;
+        while (copied < count) {
+            std::streamsize buffered = egptr() - gptr();
+            if (buffered > 0) {
+                std::streamsize take = std::min(buffered, count - copied);
+                std::memcpy(s + copied, gptr(), static_cast<size_t>(take));
+                gbump(static_cast<int>(take));
+                copied += take;
+                continue;
+            }
+            
+            size_t remaining = static_cast<size_t>(count - copied);
+            if (remaining < DESCRIPTOR_BUFFER_SIZE) {
+                if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+                    break;
+                }
+                continue;
+            }
+            size_t read = readSome(s + copied, remaining);
+            if (read == 0) {
+                break;
+            }
+            copied += static_cast<std::streamsize>(read);
+        }
+        return copied;
+    }
+    
+    int_type overflow(int_type c) override {
+        if (!flushOutput()) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+    
+    std::streamsize xsputn(const char* s, std::streamsize count) override {
+        if (static_cast<size_t>(count) < DESCRIPTOR_BUFFER_SIZE) {
+            return std::streambuf::xsputn(s, count);
+        }
+        if (!flushOutput() || !writeAll(s, static_cast<size_t>(count))) {
+            return 0;
+        }
+        return count;
+    }
+    
+    int sync() override {
+        return pbase() == nullptr || flushOutput() ? 0 : -1;
+    }
+
+private:
+    size_t readSome(char* buffer, size_t size) {
+        while (true) {
+            ssize_t count = ::read(fd_, buffer, size);
+            if (count >= 0) {
+                return static_cast<size_t>(count);
+            }
+            if (errno != EINTR) {
+                systemError("Failed to read input");
+            }
+        }
+    }
+    
+    bool writeAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(fd_, data, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+    
+    // Write out what is buffered and make room for more
+    bool flushOutput() {
+        if (pbase() != nullptr && pptr() > pbase() &&
+            !writeAll(pbase(), static_cast<size_t>(pptr() - pbase()))) {
+            return false;
+        }
+        if (output_.empty()) {
+            output_.resize(DESCRIPTOR_BUFFER_SIZE);
+        }
+        setp(output_.data(), output_.data() + output_.size());
+        return true;
+    }
+    
+    int fd_;
+    std::vector<char> input_;
+    std::vector<char> output_;
+};
+
+struct Request {
+    bool encrypting = false;
+    uint64_t inputSize = 0;
+    Descriptor input;
+    Descriptor output;
+    secure::SecureData<std::string> password;
+};
+
+void setCloseOnExec(int fd) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags >= 0) {
+        fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+    }
+}
+
+Descriptor openSocket() {
+    Descriptor socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (!socket.valid()) {
+        systemError("Failed to create socket");
+    }
+    setCloseOnExec(socket.get());
+    return socket;
+}
+
+sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Invalid socket path: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+bool connectTo(int socket, const sockaddr_un& address) {
+    while (::connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Wait for data from a client, giving up after the request timeout
+void waitReadable(int socket) {
+    pollfd request{socket, POLLIN, 0};
+    while (true) {
+        int ready = poll(&request, 1, REQUEST_TIMEOUT_MS);
+        if (ready > 0) {
+            return;
+        }
+        if (ready == 0) {
+            throw std::runtime_error("Timed out waiting for the request");
+        }
+        if (errno != EINTR) {
+            systemError("Failed to wait for the request");
+        }
+    }
+}
+
+void receiveAll(int socket, uint8_t* buffer, size_t size) {
+    while (size > 0) {
+        waitReadable(socket);
+        ssize_t count = ::recv(socket, buffer, size, 0);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            systemError("Failed to receive the request");
+        }
+        if (count == 0) {
+            throw std::runtime_error("Connection closed before the request was complete");
+        }
+        buffer += count;
+        size -= static_cast<size_t>(count);
+    }
+}
+
+void sendAll(int socket, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = ::send(socket, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            systemError("Failed to send to the daemon socket");
+        }
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+}
+
+// Only processes running as the daemon's user may hand it jobs
+bool sameUser(int socket) {
+#if defined(SO_PEERCRED)
+    struct ucred credentials{};
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+        return false;
+    }
+    return credentials.uid == geteuid();
+#else
+    uid_t uid = 0;
+    gid_t gid = 0;
+    if (getpeereid(socket, &uid, &gid) != 0) {
+        return false;
+    }
+    return uid == geteuid();
+#endif
+}
+
+Request receiveRequest(int socket) {
+    Request request;
+    uint8_t header[REQUEST_HEADER_SIZE];
+    
+    // The descriptors arrive with the first bytes
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+    iovec vector{header, sizeof(header)};
+    msghdr message{};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    
+    ssize_t count = -1;
+    do {
+        waitReadable(socket);
+        count = ::recvmsg(socket, &message, 0);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0) {
+        systemError("Failed to receive the request");
+    }
+    
+    for (cmsghdr* part = CMSG_FIRSTHDR(&message); part != nullptr; part = CMSG_NXTHDR(&message, part)) {
+        if (part->cmsg_level != SOL_SOCKET || part->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t descriptors = (part->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        std::vector<int> fds(descriptors);
+        std::memcpy(fds.data(), CMSG_DATA(part), descriptors * sizeof(int));
+        for (size_t i = 0; i < descriptors; ++i) {
+            setCloseOnExec(fds[i]);
+            Descriptor fd(fds[i]);
+            if (i == 0 && !request.input.valid()) {
+                request.input = std::move(fd);
+            } else if (i == 1 && !request.output.valid()) {
+                request.output = std::move(fd);
+            }
+        }
+    }
+    if ((message.msg_flags & MSG_CTRUNC) != 0 || !request.input.valid() || !request.output.valid()) {
+        throw std::runtime_error("Request did not carry an input and an output descriptor");
+    }
+    if (count == 0) {
+        throw std::runtime_error("Connection closed before the request was complete");
+    }
+    receiveAll(socket, header + count, sizeof(header) - static_cast<size_t>(count));
+    
+    if (std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || header[4] != PROTOCOL_VERSION) {
+        throw std::runtime_error("Unsupported request from client");
+    }
+    if (header[5] != OPERATION_ENCRYPT && header[5] != OPERATION_DECRYPT) {
+        throw std::runtime_error("Unknown operation requested");
+    }
+    request.encrypting = header[5] == OPERATION_ENCRYPT;
+    request.inputSize = getU64(header + 8);
+    
+    uint32_t passwordSize = getU32(header + 16);
+    if (passwordSize > MAX_PASSWORD_SIZE) {
+        throw std::runtime_error("Password in the request is too long");
+    }
+    request.password.get().resize(passwordSize);
+    receiveAll(socket, reinterpret_cast<uint8_t*>(&request.password.get()[0]), passwordSize);
+    return request;
+}
+
+// The error code is only read for a failure
+void sendResponse(int socket, uint8_t status, CryptoErrorCode code, const std::string& text) {
+    std::string message = text.substr(0, MAX_MESSAGE_SIZE);
+    std::vector<uint8_t> response(RESPONSE_HEADER_SIZE + message.size());
+    response[0] = status;
+    response[1] = static_cast<uint8_t>(code);
+    putU32(response.data() + 4, static_cast<uint32_t>(message.size()));
+    std::memcpy(response.data() + RESPONSE_HEADER_SIZE, message.data(), message.size());
+    sendAll(socket, response.data(), response.size());
+}
+
+// Run one client's job and tell it how it went. Rethrows the job's error
+// so the queue records it.
+void serveConnection(Encryptor& engine, int socket) {
+    try {
+        Request request = receiveRequest(socket);
+        {
+            DescriptorStreamBuf input(request.input.get());
+            DescriptorStreamBuf output(request.output.get());
+            std::istream source(&input);
+            std::ostream dest(&output);
+            if (request.encrypting) {
+                engine.encryptStream(source, dest, request.password, ProgressCallback(), request.inputSize);
+            } else {
+                engine.decryptStream(source, dest, request.password, ProgressCallback(), request.inputSize);
+            }
+            if (!dest.flush()) {
+                throw EncryptionException("Failed to write output", CryptoErrorCode::IoError);
+            }
+        }
+        sendResponse(socket, STATUS_OK, CryptoErrorCode::InternalError, std::string());
+    } catch (const EncryptionException& e) {
+        try {
+            sendResponse(socket, STATUS_FAILED, e.getErrorCode(), e.what());
+        } catch (const std::exception&) {
+            // The client is gone; the job's error is what gets recorded
+        }
+        throw;
+    } catch (const std::exception& e) {
+        try {
+            sendResponse(socket, STATUS_FAILED, CryptoErrorCode::InternalError, e.what());
+        } catch (const std::exception&) {
+        }
+        throw;
+    }
+}
+
+// Self-pipe the signal handler writes to, waking the accept loop
+int signal_pipe[2] = {-1, -1};
+
+extern "C" void onStopSignal(int) {
+    int saved = errno;
+    char byte = 1;
+    ssize_t ignored = ::write(signal_pipe[1], &byte, 1);
+    (void)ignored;
+    errno = saved;
+}
+
+// Installs the stop handlers for the daemon's lifetime
+class StopSignals {
+public:
+    StopSignals() {
+        if (pipe(signal_pipe) != 0) {
+            systemError("Failed to create signal pipe");
+        }
+        for (int fd : signal_pipe) {
+            setCloseOnExec(fd);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+        
+        struct sigaction action{};
+        action.sa_handler = onStopSignal;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, &previous_int_);
+        sigaction(SIGTERM, &action, &previous_term_);
+        
+        // A client that goes away mid-job must fail the job, not the daemon
+        struct sigaction ignore{};
+        ignore.sa_handler = SIG_IGN;
+        sigemptyset(&ignore.sa_mask);
+        sigaction(SIGPIPE, &ignore, &previous_pipe_);
+    }
+    
+    ~StopSignals() {
+        sigaction(SIGINT, &previous_int_, nullptr);
+        sigaction(SIGTERM, &previous_term_, nullptr);
+        sigaction(SIGPIPE, &previous_pipe_, nullptr);
+        for (int& fd : signal_pipe) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    
+    int fd() const { return signal_pipe[0]; }
+    
+    // Prevent copying
+    StopSignals(const StopSignals&) = delete;
+    StopSignals& operator=(const StopSignals&) = delete;
+
+private:
+    struct sigaction previous_int_{};
+    struct sigaction previous_term_{};
+    struct sigaction previous_pipe_{};
+};
+
+// Directory for the socket that only this user can enter. /tmp is shared,
+// so a directory someone else made, or one open to others, is refused
+void privateDirectory(const std::string& path) {
+    if (::mkdir(path.c_str(), 0700) != 0 && errno != EEXIST) {
+        systemError("Failed to create directory " + path);
+    }
+    struct stat status{};
+    if (::lstat(path.c_str(), &status) != 0) {
+        systemError("Failed to check directory " + path);
+    }
+    if (!S_ISDIR(status.st_mode) || status.st_uid != geteuid() || (status.st_mode & 077) != 0) {
+        throw std::runtime_error("Refusing to use " + path + ": it must be a directory of this user with mode 0700");
+    }
+}
+
+} // anonymous namespace
+
+std::string defaultSocketPath() {
+    const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir != nullptr && runtimeDir[0] != '\0') {
+        return std::string(runtimeDir) + "/crusty.sock";
+    }
+    std::string directory = "/tmp/crusty-" + std::to_string(geteuid());
+    privateDirectory(directory);
+    return directory + "/crusty.sock";
+}
+
+void runDaemon(Encryptor& engine, const std::string& socketPath, size_t jobSlots, bool quiet) {
+    sockaddr_un address = socketAddress(socketPath);
+    
+    // A socket left behind by a daemon that died is replaced, a live one is not
+    {
+        Descriptor probe = openSocket();
+        if (connectTo(probe.get(), address)) {
+            throw std::runtime_error("A daemon is already listening on " + socketPath);
+        }
+        if (errno == ECONNREFUSED) {
+            ::unlink(socketPath.c_str());
+        }
+    }
+    
+    Descriptor listener = openSocket();
+    
+    // Owner-only from the moment it exists
+    mode_t mask = umask(0177);
+    int bound = ::bind(listener.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    umask(mask);
+    if (bound != 0) {
+        systemError("Failed to create socket " + socketPath);
+    }
+    if (::listen(listener.get(), SOMAXCONN) != 0) {
+        ::unlink(socketPath.c_str());
+        systemError("Failed to listen on " + socketPath);
+    }
+    
+    StopSignals signals;
+    auto jobs = std::make_unique<JobQueue>(jobSlots);
+    LOG_EVENT(SecurityEvent, "Daemon listening", {"socket", socketPath}, {"slots", jobSlots});
+    if (!quiet) {
+        std::cerr << "Listening on " << socketPath << std::endl;
+    }
+    
+    while (true) {
+        pollfd waiting[2] = {{listener.get(), POLLIN, 0}, {signals.fd(), POLLIN, 0}};
+        if (poll(waiting, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ::unlink(socketPath.c_str());
+            systemError("Failed to wait for connections");
+        }
+        if (waiting[1].revents != 0) {
+            break;
+        }
+        if ((waiting[0].revents & POLLIN) == 0) {
+            continue;
+        }
+        
+        // Fails when the client gave up before it was accepted
+        Descriptor client(::accept(listener.get(), nullptr, nullptr));
+        if (!client.valid()) {
+            continue;
+        }
+        setCloseOnExec(client.get());
+        if (!sameUser(client.get())) {
+            LOG_SECURITY("Daemon rejected a connection from another user");
+            continue;
+        }
+        
+        // Shared so a job dropped at shutdown still closes its connection
+        auto connection = std::make_shared<Descriptor>(std::move(client));
+        jobs->submit("daemon job", [&engine, connection](uint64_t, const std::shared_ptr<const CancellationToken>&) {
+            serveConnection(engine, connection->get());
+        });
+    }
+    
+    // Stop taking connections, drop waiting jobs and let running ones finish
+    ::unlink(socketPath.c_str());
+    listener.reset();
+    if (!quiet) {
+        std::cerr << "Stopping; waiting for running jobs" << std::endl;
+    }
+    jobs.reset();
+    LOG_SECURITY("Daemon stopped");
+}
+
+void submitJob(const std::string& socketPath, bool encrypting, int input, int output, uint64_t inputSize,
+               secure::SecureView password) {
+    if (password.size() > MAX_PASSWORD_SIZE) {
+        throw std::runtime_error("Password is too long for the daemon");
+    }
+    sockaddr_un address = socketAddress(socketPath);
+    Descriptor socket = openSocket();
+    if (!connectTo(socket.get(), address)) {
+        systemError("No daemon listening on " + socketPath);
+    }
+    
+    // The password and descriptors go only to a daemon of the same user
+    if (!sameUser(socket.get())) {
+        throw std::runtime_error("The daemon on " + socketPath + " runs as another user");
+    }
+    
+    secure::SecureData<std::vector<uint8_t>> request(std::vector<uint8_t>(REQUEST_HEADER_SIZE + password.size()));
+    uint8_t* header = request.get().data();
+    std::memcpy(header, MAGIC, sizeof(MAGIC));
+    header[4] = PROTOCOL_VERSION;
+    header[5] = encrypting ? OPERATION_ENCRYPT : OPERATION_DECRYPT;
+    putU64(header + 8, inputSize);
+    putU32(header + 16, static_cast<uint32_t>(password.size()));
+    std::memcpy(header + REQUEST_HEADER_SIZE, password.data(), password.size());
+    
+    // Send the first byte with the descriptors, the rest as a plain stream
+    int fds[2] = {input, output};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    iovec vector{header, 1};
+    msghdr message{};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* part = CMSG_FIRSTHDR(&message);
+    part->cmsg_level = SOL_SOCKET;
+    part->cmsg_type = SCM_RIGHTS;
+    part->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(part), fds, sizeof(fds));
+    
+    ssize_t sent = -1;
+    do {
+        sent = ::sendmsg(socket.get(), &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent != 1) {
+        systemError("Failed to send the job to the daemon");
+    }
+    sendAll(socket.get(), header + 1, request.get().size() - 1);
+    
+    // The daemon answers once the job has ended
+    uint8_t response[RESPONSE_HEADER_SIZE];
+    size_t received = 0;
+    while (received < sizeof(response)) {
+        ssize_t count = ::recv(socket.get(), response + received, sizeof(response) - received, 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            throw std::runtime_error("The daemon closed the connection before the job ended");
+        }
+        received += static_cast<size_t>(count);
+    }
+    
+    std::string text(std::min(getU32(response + 4), MAX_MESSAGE_SIZE), '\0');
+    received = 0;
+    while (received < text.size()) {
+        ssize_t count = ::recv(socket.get(), &text[received], text.size() - received, 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        received += static_cast<size_t>(count);
+    }
+    text.resize(received);
+    
+    if (response[0] != STATUS_OK) {
+        throw EncryptionException(text.empty() ? "The daemon could not run the job" : text,
+                                  static_cast<CryptoErrorCode>(response[1]));
+    }
+}
+
+#endif
+
+} // namespace cli
+} // namespace crusty
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "../core/secure_utils.h"
+
+namespace crusty {
+
+class Encryptor;
+
+namespace cli {
+
+/**
+ * @brief Socket the daemon listens on unless --socket names another
+ * 
+ * Without $XDG_RUNTIME_DIR the socket goes in /tmp/crusty-<uid>, which is
+ * created with mode 0700 if missing.
+ * 
+ * @return $XDG_RUNTIME_DIR/crusty.sock, or /tmp/crusty-<uid>/crusty.sock without it
+ * @throws std::runtime_error if /tmp/crusty-<uid> cannot be created, or is
+ *         not a directory owned by this user that only it can access
+ */
+std::string defaultSocketPath();
+
+/**
+ * @brief Serve encryption jobs until SIGINT or SIGTERM
+ * 
+ * Listens on a Unix domain socket that only the owner can connect to, and
+ * accepts jobs only from processes of the same user. Every job runs on the
+ * one engine, so its thread pool, buffer pool and key cache stay warm
+ * between jobs; clients pass their input and output as file descriptors,
+ * so no data goes through the socket. At most jobSlots jobs run at once,
+ * the rest wait in order. On a signal, jobs still waiting are dropped and
+ * running ones finish.
+ * 
+ * @param engine Configured engine the jobs run on
+ * @param socketPath Path of the socket; a stale socket there is replaced
+ * @param jobSlots Jobs run at the same time
+ * @param quiet No messages on stderr
+ * @throws std::runtime_error if the socket cannot be created, or another
+ *         daemon already listens on it
+ */
+void runDaemon(Encryptor& engine, const std::string& socketPath, size_t jobSlots, bool quiet);
+
+/**
+ * @brief Have a daemon encrypt or decrypt between two descriptors
+ * 
+ * Blocks until the job has ended. The daemon reads and writes the
+ * descriptors directly; pipes, terminals and sockets work as well as
+ * regular files.
+ * 
+ * @param socketPath Socket runDaemon() listens on
+ * @param encrypting True to encrypt, false to decrypt
+ * @param input Descriptor to read from
+ * @param output Descriptor to write to
+ * @param inputSize Bytes expected from input, or 0 if unknown
+ * @param password Password for the job
+ * @throws std::runtime_error if no daemon listens on the socket, the one
+ *         listening runs as another user, it drops the connection, or the
+ *         job fails; the message is the daemon's
+ */
+void submitJob(const std::string& socketPath, bool encrypting, int input, int output, uint64_t inputSize,
+               secure::SecureView password);
+
+} // namespace cli
+} // namespace crusty
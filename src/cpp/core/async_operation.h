@@ -0,0 +1,103 @@
+#pragma once
+
+#include "cancellation.h"
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace crusty {
+
+/**
+ * Called once when an asynchronous operation ends, on the thread that ran
+ * it: with null after success, otherwise with the EncryptionException or
+ * OperationCancelled the operation ended with. It runs before the
+ * operation's future becomes ready, so get() returning means it is done.
+ */
+using CompletionCallback = std::function<void(std::exception_ptr error)>;
+
+/**
+ * @brief Handle to a file operation running on an Encryptor's executor
+ * 
+ * Returned by Encryptor::encryptFileAsync() and decryptFileAsync(). Copies
+ * refer to the same operation, and dropping every handle neither waits for
+ * nor cancels it. Safe to use from several threads.
+ */
+class AsyncOperation {
+public:
+    AsyncOperation() = default;
+    
+    /**
+     * @return Id of the operation on its engine's executor; 0 for a default-constructed handle
+     */
+    uint64_t id() const { return id_; }
+    
+    /**
+     * @return False for a default-constructed handle
+     */
+    bool valid() const { return future_.valid(); }
+    
+    /**
+     * @brief Ask the operation to stop
+     * 
+     * A queued operation ends as soon as a worker reaches it; a running one
+     * stops before its next chunk and leaves nothing at its destination.
+     * Either way it completes with OperationCancelled.
+     */
+    void cancel() const {
+        if (token_) {
+            token_->cancel();
+        }
+    }
+    
+    /**
+     * @return True once the operation has ended, however it ended
+     */
+    bool done() const {
+        return future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+    
+    /**
+     * @brief Wait for the operation to end
+     */
+    void wait() const { future_.wait(); }
+    
+    /**
+     * @brief Wait for the operation to end, at most for a while
+     * 
+     * @param timeout Longest wait
+     * @return True if the operation has ended
+     */
+    template<typename Rep, typename Period>
+    bool waitFor(const std::chrono::duration<Rep, Period>& timeout) const {
+        return future_.wait_for(timeout) == std::future_status::ready;
+    }
+    
+    /**
+     * @brief Wait for the operation and rethrow what it failed with
+     * 
+     * @throws EncryptionException if the operation failed
+     * @throws OperationCancelled if it was cancelled
+     */
+    void get() const { future_.get(); }
+    
+    /**
+     * @return Future of the operation, e.g. to wait on several at once
+     */
+    const std::shared_future<void>& future() const { return future_; }
+
+private:
+    friend class Encryptor;
+    
+    AsyncOperation(uint64_t id, std::shared_future<void> future, std::shared_ptr<CancellationToken> token)
+        : id_(id), future_(std::move(future)), token_(std::move(token)) {}
+    
+    uint64_t id_ = 0;
+    std::shared_future<void> future_;
+    std::shared_ptr<CancellationToken> token_;
+};
+
+} // namespace crusty
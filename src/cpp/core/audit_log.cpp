@@ -0,0 +1,483 @@
+#include "audit_log.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace crusty {
+
+namespace {
+
+std::tm localTime(std::time_t time) {
+    std::tm result{};
+#ifdef _WIN32
+    localtime_s(&result, &time);
+#else
+    localtime_r(&time, &result);
+#endif
+    return result;
+}
+
+std::tm utcTime(std::time_t time) {
+    std::tm result{};
+#ifdef _WIN32
+    gmtime_s(&result, &time);
+#else
+    gmtime_r(&time, &result);
+#endif
+    return result;
+}
+
+void appendJsonString(std::string& out, const std::string& value) {
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+// Plain text values are quoted only when they would be ambiguous
+void appendTextString(std::string& out, const std::string& value) {
+    if (!value.empty() && value.find_first_of(" \"=\t\r\n") == std::string::npos) {
+        out += value;
+    } else {
+        appendJsonString(out, value);
+    }
+}
+
+void appendFieldValue(std::string& out, const LogField& field, bool json) {
+    char number[32];
+    switch (field.kind()) {
+        case LogField::Kind::String:
+            if (json) {
+                appendJsonString(out, field.stringValue());
+            } else {
+                appendTextString(out, field.stringValue());
+            }
+            return;
+        case LogField::Kind::Signed:
+            out += std::to_string(field.signedValue());
+            return;
+        case LogField::Kind::Unsigned:
+            out += std::to_string(field.unsignedValue());
+            return;
+        case LogField::Kind::Double:
+            // JSON has no NaN or infinity
+            if (json && !std::isfinite(field.doubleValue())) {
+                out += "null";
+                return;
+            }
+            std::snprintf(number, sizeof(number), "%.15g", field.doubleValue());
+            out += number;
+            return;
+        case LogField::Kind::Bool:
+            out += field.boolValue() ? "true" : "false";
+            return;
+    }
+}
+
+void syncToDisk(std::FILE* file) {
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+}
+
+} // anonymous namespace
+
+AuditLog& AuditLog::getInstance() {
+    static AuditLog instance;
+    return instance;
+}
+
+AuditLog::AuditLog()
+    : head_(&stub_), tail_(&stub_) {
+    // The log file is found and opened by the first write
+}
+
+AuditLog::~AuditLog() {
+    // Queued records are written before the file is closed
+    disableAsync();
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (logFile_ != nullptr) {
+        std::fclose(logFile_);
+        logFile_ = nullptr;
+    }
+}
+
+void AuditLog::log(EventType type, const std::string& message) {
+    if (!isEnabled(type)) {
+        return;
+    }
+    
+    Record record;
+    record.type = type;
+    record.time = std::chrono::system_clock::now();
+    record.message = message;
+    submit(std::move(record));
+}
+
+void AuditLog::log(EventType type, const std::string& message, std::initializer_list<LogField> fields) {
+    if (!isEnabled(type)) {
+        return;
+    }
+    
+    Record record;
+    record.type = type;
+    record.time = std::chrono::system_clock::now();
+    record.message = message;
+    record.fields.assign(fields.begin(), fields.end());
+    submit(std::move(record));
+}
+
+void AuditLog::setMinimumLevel(EventType level) {
+    minimum_level_.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+void AuditLog::setFormat(Format format) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    format_ = format;
+}
+
+void AuditLog::submit(Record&& record) {
+    if (async_.load()) {
+        producers_.fetch_add(1);
+        // disableAsync() may have started after the first check
+        if (async_.load()) {
+            Node* node = new Node;
+            node->record = std::move(record);
+            
+            uint64_t pending = enqueued_.fetch_add(1) + 1 - written_.load();
+            push(node);
+            bool batchReady = pending >= options_.maxBatchSize;
+            producers_.fetch_sub(1);
+            
+            // A full batch is ready; don't wait for the flush interval
+            if (batchReady) {
+                std::lock_guard<std::mutex> lock(wake_mutex_);
+                wake_requested_ = true;
+                wake_.notify_one();
+            }
+            return;
+        }
+        producers_.fetch_sub(1);
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    writeRecord(record);
+    if (logFile_ != nullptr) {
+        std::fflush(logFile_);
+    }
+}
+
+void AuditLog::setLogFile(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (logFile_ != nullptr) {
+        std::fclose(logFile_);
+        logFile_ = nullptr;
+    }
+    
+    logPath_ = path;
+    default_path_ = false;
+}
+
+void AuditLog::enableAsync(const AsyncOptions& options) {
+    std::lock_guard<std::mutex> control(control_mutex_);
+    
+    // Restart the writer so it picks up the new options
+    if (writer_.joinable()) {
+        async_.store(false);
+        while (producers_.load() != 0) {
+            std::this_thread::yield();
+        }
+        stopWriter();
+    }
+    
+    options_ = options;
+    if (options_.maxBatchSize == 0) {
+        options_.maxBatchSize = 1;
+    }
+    
+    stopping_ = false;
+    wake_requested_ = false;
+    writer_ = std::thread(&AuditLog::writerLoop, this);
+    async_.store(true);
+}
+
+void AuditLog::enableAsync() {
+    enableAsync(AsyncOptions());
+}
+
+void AuditLog::disableAsync() {
+    std::lock_guard<std::mutex> control(control_mutex_);
+    if (!writer_.joinable()) {
+        return;
+    }
+    
+    // New records take the synchronous path; wait out pushes in progress
+    async_.store(false);
+    while (producers_.load() != 0) {
+        std::this_thread::yield();
+    }
+    stopWriter();
+}
+
+void AuditLog::flush() {
+    uint64_t target = enqueued_.load();
+    if (written_.load() >= target) {
+        return;
+    }
+    
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    wake_requested_ = true;
+    wake_.notify_one();
+    written_cv_.wait(lock, [&] { return written_.load() >= target; });
+}
+
+void AuditLog::openLogFile() {
+    try {
+        // Create parent directories if they don't exist
+        std::filesystem::path logFilePath(logPath_);
+        if (logFilePath.has_parent_path()) {
+            std::filesystem::create_directories(logFilePath.parent_path());
+        }
+        
+        // Open log file in append mode
+        logFile_ = std::fopen(logPath_.c_str(), "a");
+        
+        if (logFile_ == nullptr) {
+            // Failed to open log file
+            std::cerr << "Failed to open audit log file: " << logPath_ << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error opening audit log file: " << e.what() << std::endl;
+    }
+}
+
+std::string AuditLog::defaultLogPath() {
+    auto homeDir = std::filesystem::path(std::getenv("USERPROFILE") ? std::getenv("USERPROFILE") :
+                                       (std::getenv("HOME") ? std::getenv("HOME") : "."));
+    return (homeDir / "crusty_audit.log").string();
+}
+
+void AuditLog::writeRecord(const Record& record) {
+    if (default_path_) {
+        logPath_ = defaultLogPath();
+        default_path_ = false;
+    }
+    if (logFile_ == nullptr && !logPath_.empty()) {
+        openLogFile();
+    }
+    if (logFile_ == nullptr) {
+        return;
+    }
+    
+    std::time_t seconds = std::chrono::system_clock::to_time_t(record.time);
+    char timestamp[40];
+    std::string line;
+    line.reserve(64 + record.message.size() + 24 * record.fields.size());
+    
+    if (format_ == Format::JsonLines) {
+        // UTC with milliseconds, so shippers need no time zone information
+        std::tm time = utcTime(seconds);
+        auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+            record.time.time_since_epoch()).count() % 1000;
+        size_t length = std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &time);
+        std::snprintf(timestamp + length, sizeof(timestamp) - length, ".%03dZ", static_cast<int>(millis));
+        
+        line += "{\"time\":\"";
+        line += timestamp;
+        line += "\",\"type\":\"";
+        line += eventTypeToString(record.type);
+        line += "\",\"message\":";
+        appendJsonString(line, record.message);
+        for (const LogField& field : record.fields) {
+            line += ',';
+            appendJsonString(line, field.key());
+            line += ':';
+            appendFieldValue(line, field, true);
+        }
+        line += "}\n";
+    } else {
+        std::tm time = localTime(seconds);
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &time);
+        
+        line += '[';
+        line += timestamp;
+        line += "] [";
+        line += eventTypeToString(record.type);
+        line += "] ";
+        line += record.message;
+        for (const LogField& field : record.fields) {
+            line += ' ';
+            line += field.key();
+            line += '=';
+            appendFieldValue(line, field, false);
+        }
+        line += '\n';
+    }
+    
+    std::fwrite(line.data(), 1, line.size(), logFile_);
+}
+
+const char* AuditLog::eventTypeToString(EventType type) {
+    switch (type) {
+        case EventType::Info:
+            return "INFO";
+        case EventType::Warning:
+            return "WARNING";
+        case EventType::Error:
+            return "ERROR";
+        case EventType::SecurityEvent:
+            return "SECURITY";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+void AuditLog::push(Node* node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+}
+
+AuditLog::Node* AuditLog::pop() {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    
+    if (tail == &stub_) {
+        if (next == nullptr) {
+            return nullptr;
+        }
+        tail_ = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    
+    if (next != nullptr) {
+        tail_ = next;
+        return tail;
+    }
+    
+    // A producer has swapped head_ but not linked its node yet
+    if (tail != head_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    
+    // tail is the last node; put the stub behind it so it can be unlinked
+    push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+        tail_ = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+void AuditLog::writerLoop() {
+    const size_t maxBatchSize = options_.maxBatchSize;
+    const FsyncPolicy policy = options_.fsyncPolicy;
+    
+    while (true) {
+        // Collect a batch without holding the file lock
+        std::vector<Node*> batch;
+        batch.reserve(maxBatchSize);
+        while (batch.size() < maxBatchSize) {
+            Node* node = pop();
+            if (node == nullptr) {
+                break;
+            }
+            batch.push_back(node);
+        }
+        
+        if (!batch.empty()) {
+            bool securityEvent = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (Node* node : batch) {
+                    securityEvent |= node->record.type == EventType::SecurityEvent;
+                    writeRecord(node->record);
+                }
+                if (logFile_ != nullptr) {
+                    std::fflush(logFile_);
+                    if (policy == FsyncPolicy::EveryBatch ||
+                        (policy == FsyncPolicy::SecurityEvents && securityEvent)) {
+                        syncToDisk(logFile_);
+                    }
+                }
+            }
+            
+            for (Node* node : batch) {
+                delete node;
+            }
+            
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            written_.fetch_add(batch.size());
+            written_cv_.notify_all();
+            if (batch.size() == maxBatchSize) {
+                continue;
+            }
+        }
+        
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        if (stopping_ && written_.load() == enqueued_.load()) {
+            break;
+        }
+        if (written_.load() != enqueued_.load() && (stopping_ || wake_requested_)) {
+            // A push is still being linked in; retry shortly
+            lock.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+        wake_.wait_for(lock, options_.flushInterval, [this] { return wake_requested_ || stopping_; });
+        wake_requested_ = false;
+    }
+}
+
+void AuditLog::stopWriter() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+        wake_.notify_one();
+    }
+    writer_.join();
+    writer_ = std::thread();
+}
+
+} // namespace crusty
@@ -1,20 +1,95 @@
 #pragma once
 
-#include <string>
-#include <fstream>
-#include <mutex>
+#include <atomic>
 #include <chrono>
-#include <filesystem>
-#include <sstream>
-#include <iomanip>
-#include <iostream>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace crusty {
 
+/**
+ * @brief Typed key/value pair attached to a structured log record
+ * 
+ * Values are stored as they are and only formatted when the record is
+ * written, which in async mode happens on the writer thread. Keys are not
+ * copied and must outlive the record; use string literals.
+ */
+class LogField {
+public:
+    enum class Kind {
+        String,
+        Signed,
+        Unsigned,
+        Double,
+        Bool
+    };
+    
+    LogField(const char* key, std::string value)
+        : key_(key), kind_(Kind::String), string_(std::move(value)) {}
+    
+    LogField(const char* key, const char* value)
+        : LogField(key, std::string(value)) {}
+    
+    LogField(const char* key, bool value)
+        : key_(key), kind_(Kind::Bool) {
+        value_.boolean = value;
+    }
+    
+    LogField(const char* key, double value)
+        : key_(key), kind_(Kind::Double) {
+        value_.real = value;
+    }
+    
+    template <typename T,
+              typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+    LogField(const char* key, T value)
+        : key_(key), kind_(std::is_signed<T>::value ? Kind::Signed : Kind::Unsigned) {
+        if (std::is_signed<T>::value) {
+            value_.signedValue = static_cast<int64_t>(value);
+        } else {
+            value_.unsignedValue = static_cast<uint64_t>(value);
+        }
+    }
+    
+    const char* key() const { return key_; }
+    Kind kind() const { return kind_; }
+    const std::string& stringValue() const { return string_; }
+    int64_t signedValue() const { return value_.signedValue; }
+    uint64_t unsignedValue() const { return value_.unsignedValue; }
+    double doubleValue() const { return value_.real; }
+    bool boolValue() const { return value_.boolean; }
+
+private:
+    const char* key_;
+    Kind kind_;
+    union {
+        int64_t signedValue;
+        uint64_t unsignedValue;
+        double real;
+        bool boolean;
+    } value_{};
+    std::string string_;
+};
+
 /**
  * @brief Secure audit logging system for security-critical operations
  * 
- * Thread-safe singleton that logs security events to a file
+ * Thread-safe singleton that logs security events to a file. By default
+ * every call writes and flushes synchronously. In async mode callers only
+ * push the record onto a lock-free queue and a background thread writes
+ * records in batches; anything still queued is written on shutdown.
+ * 
+ * The log file is opened by the first write, not when the log is created,
+ * so a process that logs nothing never touches it; in async mode that
+ * write happens on the background thread.
  */
 class AuditLog {
 public:
@@ -28,15 +103,42 @@ public:
         SecurityEvent
     };
     
+    /**
+     * @brief When the async writer forces written batches to stable storage
+     */
+    enum class FsyncPolicy {
+        Never,          // Leave it to the operating system
+        EveryBatch,     // fsync after every batch
+        SecurityEvents  // fsync batches that contain a security event
+    };
+    
+    /**
+     * @brief Output format of the log file
+     */
+    enum class Format {
+        Text,       // "[time] [TYPE] message key=value ..."
+        JsonLines   // One JSON object per line
+    };
+    
+    /**
+     * @brief Settings for async mode
+     */
+    struct AsyncOptions {
+        // Most records written per batch
+        size_t maxBatchSize = 256;
+        
+        // Longest time a record waits in the queue
+        std::chrono::milliseconds flushInterval{100};
+        
+        FsyncPolicy fsyncPolicy = FsyncPolicy::SecurityEvents;
+    };
+    
     /**
      * @brief Get the singleton instance
      * 
      * @return Reference to the singleton instance
      */
-    static AuditLog& getInstance() {
-        static AuditLog instance;
-        return instance;
-    }
+    static AuditLog& getInstance();
     
     /**
      * @brief Log an event
@@ -44,84 +146,122 @@ public:
      * @param type Type of event
      * @param message Message to log
      */
-    void log(EventType type, const std::string& message) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        
-        if (!logFile_.is_open() && !logPath_.empty()) {
-            openLogFile();
-        }
-        
-        if (logFile_.is_open()) {
-            auto now = std::chrono::system_clock::now();
-            auto time = std::chrono::system_clock::to_time_t(now);
-            
-            std::stringstream ss;
-            ss << std::put_time(std::localtime(&time), "%Y-%m-%d %H:%M:%S");
-            
-            logFile_ << "[" << ss.str() << "] [" << eventTypeToString(type) << "] " 
-                     << message << std::endl;
-            logFile_.flush();
-        }
+    void log(EventType type, const std::string& message);
+    
+    /**
+     * @brief Log an event with typed fields
+     * 
+     * Prefer the LOG_EVENT macro, which skips building the fields when the
+     * level is filtered out.
+     * 
+     * @param type Type of event
+     * @param message Fixed description of the event
+     * @param fields Values attached to the event, formatted when written
+     */
+    void log(EventType type, const std::string& message, std::initializer_list<LogField> fields);
+    
+    /**
+     * @brief Drop events below a level
+     * 
+     * Levels are ordered Info < Warning < Error < SecurityEvent. Security
+     * events are always logged.
+     * 
+     * @param level Lowest level to log
+     */
+    void setMinimumLevel(EventType level);
+    
+    /**
+     * @brief Check whether events of a type would be logged
+     * 
+     * @param type Type of event
+     * @return True if the event passes the level filter
+     */
+    bool isEnabled(EventType type) const {
+        return type == EventType::SecurityEvent ||
+               static_cast<int>(type) >= minimum_level_.load(std::memory_order_relaxed);
     }
     
+    /**
+     * @brief Set the output format for records written from now on
+     * 
+     * @param format Text or JSON lines
+     */
+    void setFormat(Format format);
+    
     /**
      * @brief Set the log file path
      * 
+     * Closes the current file; the new one is opened by the next write.
+     * 
      * @param path Path to the log file
      */
-    void setLogFile(const std::string& path) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        
-        if (logFile_.is_open()) {
-            logFile_.close();
-        }
-        
-        logPath_ = path;
-        openLogFile();
-    }
+    void setLogFile(const std::string& path);
     
+    /**
+     * @brief Switch to async mode, or update its settings
+     * 
+     * @param options Batching and fsync settings
+     */
+    void enableAsync(const AsyncOptions& options);
+    
+    /**
+     * @brief Switch to async mode with the default settings
+     */
+    void enableAsync();
+    
+    /**
+     * @brief Write everything queued and go back to synchronous logging
+     */
+    void disableAsync();
+    
+    /**
+     * @brief Block until every record logged so far has been written
+     */
+    void flush();
+
 private:
+    struct Record {
+        EventType type = EventType::Info;
+        std::chrono::system_clock::time_point time;
+        std::string message;
+        std::vector<LogField> fields;
+    };
+    
+    // Intrusive node for the multi-producer, single-consumer queue
+    struct Node {
+        Record record;
+        std::atomic<Node*> next{nullptr};
+    };
+    
     /**
      * @brief Private constructor for singleton
      */
-    AuditLog() {
-        // Default log file in user's home directory
-        auto homeDir = std::filesystem::path(std::getenv("USERPROFILE") ? std::getenv("USERPROFILE") : 
-                                           (std::getenv("HOME") ? std::getenv("HOME") : "."));
-        logPath_ = (homeDir / "crusty_audit.log").string();
-        openLogFile();
-    }
+    AuditLog();
     
     /**
-     * @brief Private destructor for singleton
+     * @brief Private destructor for singleton; drains the async queue
      */
-    ~AuditLog() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (logFile_.is_open()) {
-            logFile_.close();
-        }
-    }
+    ~AuditLog();
     
     /**
-     * @brief Open the log file
-     */
-    void openLogFile() {
-        try {
-            // Create parent directories if they don't exist
-            std::filesystem::path logFilePath(logPath_);
-            std::filesystem::create_directories(logFilePath.parent_path());
-            
-            // Open log file in append mode
-            logFile_.open(logPath_, std::ios::app);
-            
-            if (!logFile_.is_open()) {
-                // Failed to open log file
-                std::cerr << "Failed to open audit log file: " << logPath_ << std::endl;
-            }
-        } catch (const std::exception& e) {
-            std::cerr << "Error opening audit log file: " << e.what() << std::endl;
-        }
-    }
+     * @brief Open the log file (called with mutex_ held)
+     */
+    void openLogFile();
+    
+    /**
+     * @brief crusty_audit.log in the user's home directory
+     */
+    static std::string defaultLogPath();
+    
+    /**
+     * @brief Queue a record in async mode, or write it now
+     */
+    void submit(Record&& record);
+    
+    /**
+     * @brief Format and write one record (called with mutex_ held)
+     */
+    void writeRecord(const Record& record);
     
     /**
      * @brief Convert event type to string
@@ -129,34 +269,70 @@ private:
      * @param type Event type
      * @return String representation of event type
      */
-    std::string eventTypeToString(EventType type) {
-        switch (type) {
-            case EventType::Info:
-                return "INFO";
-            case EventType::Warning:
-                return "WARNING";
-            case EventType::Error:
-                return "ERROR";
-            case EventType::SecurityEvent:
-                return "SECURITY";
-            default:
-                return "UNKNOWN";
-        }
-    }
+    static const char* eventTypeToString(EventType type);
+    
+    // Queue operations; push is lock-free, pop is only called by the writer
+    void push(Node* node);
+    Node* pop();
+    void writerLoop();
+    void stopWriter();
     
+    // Log file, guarded by mutex_
     std::mutex mutex_;
-    std::ofstream logFile_;
+    std::FILE* logFile_ = nullptr;
     std::string logPath_;
+    bool default_path_ = true;  // logPath_ is still to be resolved
+    Format format_ = Format::Text;
+    
+    std::atomic<int> minimum_level_{static_cast<int>(EventType::Info)};
+    
+    // Async state
+    std::mutex control_mutex_;
+    std::atomic<bool> async_{false};
+    std::atomic<int> producers_{0};
+    AsyncOptions options_;
+    std::thread writer_;
+    
+    std::atomic<Node*> head_;
+    Node* tail_;
+    Node stub_;
+    std::atomic<uint64_t> enqueued_{0};
+    std::atomic<uint64_t> written_{0};
+    
+    // Writer wake-ups and flush() waits
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::condition_variable written_cv_;
+    bool wake_requested_ = false;
+    bool stopping_ = false;
     
     // Prevent copying and assignment
     AuditLog(const AuditLog&) = delete;
     AuditLog& operator=(const AuditLog&) = delete;
 };
 
-// Helper macros for logging
-#define LOG_INFO(msg) crusty::AuditLog::getInstance().log(crusty::AuditLog::EventType::Info, msg)
-#define LOG_WARNING(msg) crusty::AuditLog::getInstance().log(crusty::AuditLog::EventType::Warning, msg)
-#define LOG_ERROR(msg) crusty::AuditLog::getInstance().log(crusty::AuditLog::EventType::Error, msg)
-#define LOG_SECURITY(msg) crusty::AuditLog::getInstance().log(crusty::AuditLog::EventType::SecurityEvent, msg)
+// Helper macros for logging; the message is only built if the level is enabled
+#define CRUSTY_LOG_AT_LEVEL(type, msg) \
+    do { \
+        crusty::AuditLog& auditLog_ = crusty::AuditLog::getInstance(); \
+        if (auditLog_.isEnabled(type)) { \
+            auditLog_.log(type, msg); \
+        } \
+    } while (0)
+
+#define LOG_INFO(msg) CRUSTY_LOG_AT_LEVEL(crusty::AuditLog::EventType::Info, msg)
+#define LOG_WARNING(msg) CRUSTY_LOG_AT_LEVEL(crusty::AuditLog::EventType::Warning, msg)
+#define LOG_ERROR(msg) CRUSTY_LOG_AT_LEVEL(crusty::AuditLog::EventType::Error, msg)
+#define LOG_SECURITY(msg) CRUSTY_LOG_AT_LEVEL(crusty::AuditLog::EventType::SecurityEvent, msg)
+
+// Structured logging, e.g. LOG_EVENT(Info, "Chunk size set", {"bytes", size});
+// fields are only evaluated if the level is enabled
+#define LOG_EVENT(type, msg, ...) \
+    do { \
+        crusty::AuditLog& auditLog_ = crusty::AuditLog::getInstance(); \
+        if (auditLog_.isEnabled(crusty::AuditLog::EventType::type)) { \
+            auditLog_.log(crusty::AuditLog::EventType::type, msg, {__VA_ARGS__}); \
+        } \
+    } while (0)
 
 } // namespace crusty
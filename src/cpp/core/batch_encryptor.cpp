@@ -0,0 +1,627 @@
+#include "batch_encryptor.h"
+#include "audit_log.h"
+#include "directory_walker.h"
+#include "encryptor_stats.h"
+#include "key_cache.h"
+#include "memory_budget.h"
+#include "output_file.h"
+#include "path_utils.h"
+#include "secure_buffer_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+namespace crusty {
+
+namespace {
+
+constexpr const char* ENCRYPTED_EXTENSION = ".encrypted";
+constexpr const char* DECRYPTED_EXTENSION = ".decrypted";
+
+bool hasEncryptedExtension(const std::string& path) {
+    std::string filename = std::filesystem::path(path).filename().string();
+    size_t extensionLength = std::char_traits<char>::length(ENCRYPTED_EXTENSION);
+    return filename.size() > extensionLength &&
+           filename.compare(filename.size() - extensionLength, extensionLength, ENCRYPTED_EXTENSION) == 0;
+}
+
+// Whether a file found in a directory is picked up for an operation
+bool wantedFor(const std::string& path, BatchEncryptor::Operation operation) {
+    // Outputs of a directory being processed appear while it is listed
+    if (AtomicOutput::isTemporaryPath(path)) {
+        return false;
+    }
+    return hasEncryptedExtension(path) == (operation == BatchEncryptor::Operation::Decrypt);
+}
+
+// Gives every destination a name that neither an existing file nor another item has
+class DestinationNamer {
+public:
+    void assign(BatchEncryptor::Item& item) {
+        std::filesystem::path dest = std::filesystem::path(item.destPath).lexically_normal();
+        std::unique_ptr<UniqueNameAllocator>& allocator = allocators_[dest.parent_path().string()];
+        try {
+            if (!allocator) {
+                allocator = std::make_unique<UniqueNameAllocator>(dest.parent_path().string());
+            }
+            std::string unique = allocator->claim(dest.filename().string());
+            if (unique != dest.string()) {
+                item.destPath = unique;
+                ++changed_;
+            }
+        } catch (const std::exception&) {
+            // An unreadable directory fails the item when it is processed
+        }
+    }
+    
+    size_t changed() const { return changed_; }
+
+private:
+    std::map<std::string, std::unique_ptr<UniqueNameAllocator>> allocators_;
+    size_t changed_ = 0;
+};
+
+// One item of a run; slots never move, so tasks keep a pointer to theirs
+struct Slot {
+    size_t index = 0;
+    BatchEncryptor::Item item;
+    BatchEncryptor::Result result;
+    uint64_t weight = 1;        // Progress is weighted by size; empty files count as one byte
+    uint64_t credited = 0;
+};
+
+// Orders a queue so the largest file comes out first, then the earliest added
+struct LargestFirst {
+    bool operator()(const Slot* a, const Slot* b) const {
+        return a->weight != b->weight ? a->weight < b->weight : a->index > b->index;
+    }
+};
+
+using SlotQueue = std::priority_queue<Slot*, std::vector<Slot*>, LargestFirst>;
+
+} // anonymous namespace
+
+// Shared by the calling thread, the pool tasks and the directory walker of one run
+struct BatchEncryptor::RunState {
+    RunState(Operation operation, secure::SecureView password, const BatchProgressCallback& callback)
+        : operation(operation), password(password), callback(callback) {}
+    
+    Operation operation;
+    secure::SecureView password;
+    const BatchProgressCallback& callback;
+    
+    // Items in the order they were added, and those not started yet
+    std::mutex mutex;
+    std::condition_variable items_changed;
+    std::vector<std::unique_ptr<Slot>> slots;
+    SlotQueue small;
+    SlotQueue large;
+    uint64_t smallQueuedWeight = 0;
+    size_t smallRunning = 0;    // Small-file tasks queued or running
+    bool closed = false;        // No more items will be added
+    std::unique_ptr<DestinationNamer> namer;
+    
+    std::atomic<size_t> totalItems{0};
+    std::atomic<uint64_t> totalWeight{0};
+    std::atomic<uint64_t> processedWeight{0};
+    std::atomic<size_t> completed{0};
+    std::atomic<size_t> failed{0};
+    std::atomic<bool> listing{false};
+    
+    std::mutex callback_mutex;
+    
+    void add(Item item, uint64_t size, bool isLarge) {
+        auto slot = std::make_unique<Slot>();
+        slot->item = std::move(item);
+        slot->weight = std::max<uint64_t>(1, size);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (namer) {
+                namer->assign(slot->item);
+            }
+            slot->index = slots.size();
+            slot->result.sourcePath = slot->item.sourcePath;
+            slot->result.destPath = slot->item.destPath;
+            if (isLarge) {
+                large.push(slot.get());
+            } else {
+                small.push(slot.get());
+                smallQueuedWeight += slot->weight;
+            }
+            totalWeight.fetch_add(slot->weight);
+            totalItems.fetch_add(1);
+            slots.push_back(std::move(slot));
+        }
+        items_changed.notify_all();
+    }
+    
+    /**
+     * Takes the next unit of small files, largest first: one file, plus
+     * more while the unit stays within its share of what is queued. Many
+     * tiny files then share one pool task, while the last units stay small
+     * enough for every worker to finish at about the same time. Called
+     * with mutex held.
+     */
+    std::vector<Slot*> takeSmallUnit(size_t workers) {
+        uint64_t budget = std::min<uint64_t>(smallQueuedWeight / (2 * workers), SMALL_UNIT_BYTES);
+        std::vector<Slot*> unit;
+        uint64_t weight = 0;
+        while (!small.empty() && unit.size() < SMALL_UNIT_FILES) {
+            Slot* slot = small.top();
+            if (!unit.empty() && weight + slot->weight > budget) {
+                break;
+            }
+            small.pop();
+            weight += slot->weight;
+            smallQueuedWeight -= slot->weight;
+            unit.push_back(slot);
+        }
+        return unit;
+    }
+    
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        items_changed.notify_all();
+    }
+    
+    void credit(Slot& slot, float progress) {
+        uint64_t target = static_cast<uint64_t>(static_cast<double>(slot.weight) * progress);
+        target = std::min(target, slot.weight);
+        if (target > slot.credited) {
+            processedWeight.fetch_add(target - slot.credited);
+            slot.credited = target;
+        }
+    }
+    
+    void report(const Slot& slot, float progress, Status status) {
+        if (!callback) {
+            return;
+        }
+        
+        Progress snapshot;
+        snapshot.itemIndex = slot.index;
+        snapshot.itemProgress = progress;
+        snapshot.itemStatus = status;
+        snapshot.completedItems = completed.load();
+        snapshot.failedItems = failed.load();
+        snapshot.totalItems = totalItems.load();
+        snapshot.listing = listing.load();
+        uint64_t total = totalWeight.load();
+        snapshot.overallProgress = total == 0
+            ? 1.0f
+            : static_cast<float>(static_cast<double>(processedWeight.load()) / static_cast<double>(total));
+        
+        std::lock_guard<std::mutex> lock(callback_mutex);
+        callback(snapshot);
+    }
+};
+
+BatchEncryptor::BatchEncryptor(size_t workerCount)
+    : thread_pool_(std::make_shared<ThreadPool>(workerCount > 0 ? workerCount : MemoryBudget::detectCpuLimit())),
+      buffer_pool_(std::make_shared<secure::SecureBufferPool>()),
+      key_cache_(std::make_shared<KeyCache>()),
+      stats_(std::make_shared<EncryptorStats>()) {
+    small_files_.setBufferPool(buffer_pool_);
+    large_files_.setBufferPool(buffer_pool_);
+    small_files_.setKeyCache(key_cache_);
+    large_files_.setKeyCache(key_cache_);
+    small_files_.setStats(stats_);
+    large_files_.setStats(stats_);
+    large_files_.setThreadPool(thread_pool_);
+}
+
+std::vector<BatchEncryptor::Item> BatchEncryptor::collectDirectory(
+    const std::string& directory,
+    Operation operation,
+    bool recursive
+) {
+    std::vector<Item> items;
+    std::mutex itemsMutex;
+    
+    DirectoryWalker walker;
+    walker.walk(directory, [&](const DirectoryWalker::Entry& entry) {
+        if (!wantedFor(entry.path, operation)) {
+            return;
+        }
+        Item item{entry.path, defaultDestPath(entry.path, operation)};
+        std::lock_guard<std::mutex> lock(itemsMutex);
+        items.push_back(std::move(item));
+    }, recursive);
+    
+    std::sort(items.begin(), items.end(),
+              [](const Item& a, const Item& b) { return a.sourcePath < b.sourcePath; });
+    
+    LOG_EVENT(Info, "Collected batch directory", {"path", directory}, {"files", items.size()});
+    return items;
+}
+
+std::string BatchEncryptor::defaultDestPath(const std::string& sourcePath, Operation operation) {
+    if (operation == Operation::Encrypt) {
+        return sourcePath + ENCRYPTED_EXTENSION;
+    }
+    
+    if (hasEncryptedExtension(sourcePath)) {
+        return sourcePath.substr(0, sourcePath.size() - std::char_traits<char>::length(ENCRYPTED_EXTENSION));
+    }
+    return sourcePath + DECRYPTED_EXTENSION;
+}
+
+std::vector<BatchEncryptor::Result> BatchEncryptor::run(
+    const std::vector<Item>& items,
+    Operation operation,
+    secure::SecureView password,
+    BatchProgressCallback progressCallback
+) {
+    RunState state(operation, password, progressCallback);
+    return execute(state, [this, &items](RunState& feed, const std::shared_ptr<CancellationToken>&) {
+        // Unreadable files are reported by the engine when they are processed
+        for (const Item& item : items) {
+            std::error_code ec;
+            uint64_t size = std::filesystem::file_size(item.sourcePath, ec);
+            if (ec) {
+                size = 0;
+            }
+            feed.add(item, size, size >= large_file_threshold_);
+        }
+    
+    }, false);
+}
+
+std::vector<BatchEncryptor::Result> BatchEncryptor::runDirectory(
+    const std::string& directory,
+    Operation operation,
+    secure::SecureView password,
+    bool recursive,
+    BatchProgressCallback progressCallback
+) {
+    RunState state(operation, password, progressCallback);
+    return execute(state, [this, &directory, operation, recursive](RunState& feed,
+                                                                   const std::shared_ptr<CancellationToken>& cancellation) {
+        DirectoryWalker walker;
+        walker.setCancellationToken(cancellation);
+        DirectoryWalker::Summary summary = walker.walk(directory, [&](const DirectoryWalker::Entry& entry) {
+            if (wantedFor(entry.path, operation)) {
+                feed.add(Item{entry.path, defaultDestPath(entry.path, operation)}, entry.size,
+                         entry.size >= large_file_threshold_);
+            }
+        }, recursive);
+        
+        LOG_EVENT(Info, "Listed batch directory", {"path", directory},
+                  {"files", feed.totalItems.load()}, {"directories", summary.directories});
+    }, true);
+}
+
+std::vector<BatchEncryptor::Result> BatchEncryptor::execute(
+    RunState& state,
+    const std::function<void(RunState&, const std::shared_ptr<CancellationToken>&)>& addItems,
+    bool listing
+) {
+    // A fresh token per run, so cancel() never reaches a later run
+    auto cancellation = std::make_shared<CancellationToken>(cancellation_);
+    {
+        std::lock_guard<std::mutex> lock(run_mutex_);
+        run_cancellation_ = cancellation;
+    }
+    small_files_.setCancellationToken(cancellation);
+    large_files_.setCancellationToken(cancellation);
+    uint64_t keysDerivedBefore = key_cache_->misses();
+    
+    // Taken destinations get a numbered name; each directory is listed once
+    if (rename_conflicts_) {
+        state.namer = std::make_unique<DestinationNamer>();
+    }
+    
+    // Files of the whole run are synced together, in groups
+    std::shared_ptr<SyncGroup> syncGroup;
+    if (output_sync_ == OutputSync::Grouped) {
+        syncGroup = std::make_shared<SyncGroup>(std::make_shared<FileSystem>());
+    }
+    small_files_.setSyncGroup(syncGroup);
+    large_files_.setSyncGroup(syncGroup);
+    
+    // Batches share a few directories, so each is resolved once per run
+    auto resolver = std::make_shared<PathResolver>();
+    small_files_.setPathResolver(resolver);
+    large_files_.setPathResolver(resolver);
+    
+    // A listing runs alongside the work; a list is added before it starts
+    std::exception_ptr listingError;
+    std::thread lister;
+    if (listing) {
+        state.listing.store(true);
+        lister = std::thread([&state, &addItems, &cancellation, &listingError]() {
+            try {
+                addItems(state, cancellation);
+            } catch (...) {
+                listingError = std::current_exception();
+            }
+            state.listing.store(false);
+            state.close();
+        });
+    } else {
+        addItems(state, cancellation);
+        state.close();
+    }
+    
+    LOG_EVENT(SecurityEvent, "Batch started",
+              {"operation", state.operation == Operation::Encrypt ? "encrypt" : "decrypt"},
+              {"files", state.totalItems.load()},
+              {"listing", listing},
+              {"workers", thread_pool_->size()});
+    
+    auto processItem = [this, &state, &cancellation](Slot& slot, Encryptor& engine) {
+        Result& result = slot.result;
+        const Item& item = slot.item;
+        
+        if (cancellation->cancelled()) {
+            result.status = Status::Cancelled;
+        } else {
+            state.report(slot, 0.0f, Status::Running);
+            
+            // Progress inside a small file is not worth a timer thread per file
+            ProgressCallback onProgress;
+            if (&engine == &large_files_) {
+                onProgress = [&state, &slot](float progress) {
+                    state.credit(slot, progress);
+                    state.report(slot, progress, Status::Running);
+                };
+            }
+            
+            try {
+                if (replace_existing_ && !rename_conflicts_) {
+                    std::filesystem::remove(item.destPath);
+                }
+                if (state.operation == Operation::Encrypt) {
+                    engine.encryptFile(item.sourcePath, item.destPath, state.password, onProgress);
+                } else {
+                    engine.decryptFile(item.sourcePath, item.destPath, state.password, onProgress);
+                }
+                result.status = Status::Succeeded;
+                result.bytes = slot.weight;
+            } catch (const OperationCancelled&) {
+                result.status = Status::Cancelled;
+            } catch (const EncryptionException& e) {
+                result.status = Status::Failed;
+                result.error = e.what();
+                
+                // The header rejected the password before any record was
+                // read; every other file of the batch would fail the same way
+                if (state.operation == Operation::Decrypt && e.getErrorCode() == CryptoErrorCode::InvalidPassword &&
+                    !cancellation->cancelled()) {
+                    LOG_EVENT(SecurityEvent, "Batch stopped on a wrong password", {"path", item.sourcePath});
+                    cancellation->cancel();
+                }
+            } catch (const std::exception& e) {
+                result.status = Status::Failed;
+                result.error = e.what();
+            } catch (...) {
+                result.status = Status::Failed;
+                result.error = "Unknown error";
+            }
+        }
+        
+        state.credit(slot, 1.0f);
+        if (result.status == Status::Failed) {
+            state.failed.fetch_add(1);
+        }
+        state.completed.fetch_add(1);
+        state.report(slot, 1.0f, result.status);
+    };
+    
+    // Each small-file task queues the next unit when it finishes, so at most
+    // one per worker is waiting and a large file's chunks are not stuck
+    // behind the whole list. Called with state.mutex held.
+    size_t workers = thread_pool_->size();
+    std::function<void(std::vector<Slot*>)> startSmall =
+        [this, &state, &processItem, &startSmall, workers](std::vector<Slot*> unit) {
+        thread_pool_->submit([this, &state, &processItem, &startSmall, workers, unit = std::move(unit)]() {
+            for (Slot* slot : unit) {
+                processItem(*slot, small_files_);
+            }
+            
+            // Last touch of the shared state; run() may return right after
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (!state.small.empty()) {
+                startSmall(state.takeSmallUnit(workers));
+                return;
+            }
+            --state.smallRunning;
+            state.items_changed.notify_all();
+        });
+    };
+    
+    // Keeps the pool fed with small files and runs large ones here, largest
+    // first and one at a time with their chunks split across the pool, until
+    // every item of a closed list is done
+    while (true) {
+        Slot* large = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            while (state.smallRunning < workers && !state.small.empty()) {
+                ++state.smallRunning;
+                startSmall(state.takeSmallUnit(workers));
+            }
+            if (!state.large.empty()) {
+                large = state.large.top();
+                state.large.pop();
+            } else if (state.closed && state.small.empty() && state.smallRunning == 0) {
+                break;
+            }
+        }
+        
+        if (large) {
+            processItem(*large, large_files_);
+            continue;
+        }
+        
+        // Help with the queued small files instead of sleeping
+        if (!thread_pool_->runPendingTask()) {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.items_changed.wait_for(lock, std::chrono::milliseconds(10), [&state, workers]() {
+                return !state.large.empty() ||
+                       (!state.small.empty() && state.smallRunning < workers) ||
+                       (state.closed && state.small.empty() && state.smallRunning == 0);
+            });
+        }
+    }
+    if (lister.joinable()) {
+        lister.join();
+    }
+    
+    if (syncGroup) {
+        small_files_.setSyncGroup(nullptr);
+        large_files_.setSyncGroup(nullptr);
+        
+        // The engines report destinations by their sanitized path
+        std::map<std::string, Slot*> byDestination;
+        for (const auto& slot : state.slots) {
+            try {
+                byDestination.emplace(resolver->resolve(slot->item.destPath), slot.get());
+            } catch (const std::exception&) {
+                // Its engine rejected the path as well
+            }
+        }
+        for (const SyncGroup::Failure& failure : syncGroup->commit()) {
+            auto it = byDestination.find(failure.path);
+            if (it == byDestination.end() || it->second->result.status != Status::Succeeded) {
+                continue;
+            }
+            Result& result = it->second->result;
+            result.status = Status::Failed;
+            result.error = failure.error;
+            result.bytes = 0;
+            state.failed.fetch_add(1);
+        }
+    }
+    
+    small_files_.setPathResolver(nullptr);
+    large_files_.setPathResolver(nullptr);
+    small_files_.setCancellationToken(nullptr);
+    large_files_.setCancellationToken(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(run_mutex_);
+        run_cancellation_.reset();
+    }
+    
+    // Derived keys do not outlive the batch
+    uint64_t keysDerived = key_cache_->misses();
+    key_cache_->clear();
+    
+    if (state.namer && state.namer->changed() > 0) {
+        LOG_EVENT(Info, "Renamed batch destinations that were taken", {"files", state.namer->changed()});
+    }
+    LOG_EVENT(SecurityEvent, "Batch finished",
+              {"files", state.slots.size()},
+              {"failed", state.failed.load()},
+              {"cancelled", cancellation->cancelled()},
+              {"keys_derived", keysDerived - keysDerivedBefore});
+    
+    // Files found before the listing failed have been processed all the same
+    if (listingError) {
+        std::rethrow_exception(listingError);
+    }
+    
+    std::vector<Result> results;
+    results.reserve(state.slots.size());
+    for (auto& slot : state.slots) {
+        results.push_back(std::move(slot->result));
+    }
+    return results;
+}
+
+void BatchEncryptor::cancel() {
+    std::lock_guard<std::mutex> lock(run_mutex_);
+    if (run_cancellation_) {
+        run_cancellation_->cancel();
+    }
+    LOG_INFO("Batch cancellation requested");
+}
+
+void BatchEncryptor::setCancellationToken(std::shared_ptr<const CancellationToken> token) {
+    cancellation_ = std::move(token);
+}
+
+void BatchEncryptor::setChunkSize(size_t bytes) {
+    small_files_.setChunkSize(bytes);
+    large_files_.setChunkSize(bytes);
+}
+
+void BatchEncryptor::setMemoryBudget(std::shared_ptr<MemoryBudget> budget) {
+    small_files_.setMemoryBudget(budget);
+    large_files_.setMemoryBudget(budget);
+    if (budget) {
+        // Small files also run on the pool, so plan for all of its workers
+        setChunkSize(budget->plan(thread_pool_->size()).chunkSize);
+    }
+}
+
+void BatchEncryptor::setLargeFileThreshold(uint64_t bytes) {
+    large_file_threshold_ = bytes;
+    LOG_EVENT(Info, "Large file threshold set", {"bytes", bytes});
+}
+
+void BatchEncryptor::setIoMode(IoMode mode) {
+    small_files_.setIoMode(mode);
+    large_files_.setIoMode(mode);
+}
+
+void BatchEncryptor::setIoEngine(IoEngine engine) {
+    small_files_.setIoEngine(engine);
+    large_files_.setIoEngine(engine);
+}
+
+void BatchEncryptor::setIoQueueDepth(size_t depth) {
+    small_files_.setIoQueueDepth(depth);
+    large_files_.setIoQueueDepth(depth);
+}
+
+void BatchEncryptor::setFileCaching(FileCaching caching) {
+    small_files_.setFileCaching(caching);
+    large_files_.setFileCaching(caching);
+}
+
+void BatchEncryptor::setRenameConflicts(bool rename) {
+    rename_conflicts_ = rename;
+}
+
+void BatchEncryptor::setReplaceExisting(bool replace) {
+    replace_existing_ = replace;
+}
+
+void BatchEncryptor::setOutputSync(OutputSync sync) {
+    output_sync_ = sync;
+    small_files_.setOutputSync(sync);
+    large_files_.setOutputSync(sync);
+}
+
+void BatchEncryptor::setKdfParams(const KdfParams& params) {
+    small_files_.setKdfParams(params);
+    large_files_.setKdfParams(params);
+}
+
+void BatchEncryptor::setCompression(const CompressionSettings& settings) {
+    small_files_.setCompression(settings);
+    large_files_.setCompression(settings);
+}
+
+void BatchEncryptor::setKeySlots(bool enabled) {
+    small_files_.setKeySlots(enabled);
+    large_files_.setKeySlots(enabled);
+}
+
+void BatchEncryptor::setProgressSettings(const ProgressSettings& settings) {
+    large_files_.setProgressSettings(settings);
+}
+
+} // namespace crusty
@@ -0,0 +1,363 @@
+#pragma once
+
+#include "encryptor.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace crusty {
+
+/**
+ * @brief Encrypts or decrypts many files on one shared thread pool
+ * 
+ * Files below the large-file threshold are processed whole by pool tasks,
+ * with one task per worker queued at a time so they interleave with other
+ * work. Tiny files share a task: each takes the largest file queued plus
+ * more while it holds no more than its share of the queued bytes, so tasks
+ * over thousands of small files cost little more than the files, and the
+ * last tasks are short enough that the workers finish together. Larger
+ * files are processed one after another on the calling thread, largest
+ * first, with their chunks spread across the same pool, so neither kind
+ * waits for the other to finish. A failing file does not stop the batch;
+ * its error is reported in its result. The exception is a decryption
+ * whose password a file's header rejects (InvalidPassword): that is known
+ * before any of the file's records are read, and the rest of the batch is
+ * cancelled rather than each file failing on its own.
+ * 
+ * Both engines share a key cache for the length of a run, so the password
+ * goes through Argon2id once for all files encrypted in the batch, and once
+ * per distinct salt when decrypting.
+ */
+class BatchEncryptor {
+public:
+    enum class Operation {
+        Encrypt,
+        Decrypt
+    };
+    
+    enum class Status {
+        Pending,
+        Running,
+        Succeeded,
+        Failed,
+        Cancelled
+    };
+    
+    /**
+     * @brief One file to process
+     */
+    struct Item {
+        std::string sourcePath;
+        std::string destPath;
+    };
+    
+    /**
+     * @brief Outcome for one item, in the same order as the input
+     */
+    struct Result {
+        std::string sourcePath;
+        std::string destPath;
+        Status status = Status::Pending;
+        std::string error;
+        uint64_t bytes = 0;
+    };
+    
+    /**
+     * @brief Progress snapshot passed to the callback
+     */
+    struct Progress {
+        size_t itemIndex = 0;        // Item that changed
+        float itemProgress = 0.0f;   // Its progress, 0..1
+        Status itemStatus = Status::Pending;
+        size_t completedItems = 0;   // Items finished, failed or cancelled
+        size_t failedItems = 0;
+        size_t totalItems = 0;
+        float overallProgress = 0.0f; // Weighted by file size, 0..1
+        bool listing = false;        // runDirectory() is still finding files; totals may grow
+    };
+    
+    /**
+     * Called from worker threads, one call at a time
+     */
+    using BatchProgressCallback = std::function<void(const Progress&)>;
+    
+    /**
+     * @brief Create an engine with its own thread pool
+     * 
+     * @param workerCount Number of worker threads, or 0 for one per CPU the
+     *                    process may use (MemoryBudget::detectCpuLimit)
+     */
+    explicit BatchEncryptor(size_t workerCount = 0);
+    
+    /**
+     * @brief Collect the files in a directory
+     * 
+     * Destinations follow the application's naming: ".encrypted" is added
+     * when encrypting, and removed (or ".decrypted" added) when decrypting.
+     * Encrypting picks up every regular file not already ending in
+     * ".encrypted"; decrypting picks up only those that do. Temporary
+     * files of unfinished outputs are left out of both. The directory is
+     * listed with a DirectoryWalker.
+     * 
+     * @param directory Directory to scan
+     * @param operation Operation the items are for
+     * @param recursive True to include subdirectories
+     * @return Items sorted by source path
+     * @throws EncryptionException if the directory cannot be read
+     */
+    static std::vector<Item> collectDirectory(
+        const std::string& directory,
+        Operation operation,
+        bool recursive = true
+    );
+    
+    /**
+     * @brief Default destination for a source file
+     * 
+     * @param sourcePath Source file path
+     * @param operation Operation to perform
+     * @return Destination path
+     */
+    static std::string defaultDestPath(const std::string& sourcePath, Operation operation);
+    
+    /**
+     * @brief Process a batch of files
+     * 
+     * Blocks until every item has finished. Only one batch may run at a time
+     * on an engine.
+     * 
+     * @param items Files to process
+     * @param operation Encrypt or decrypt
+     * @param password Password used for every file; read until run() returns
+     * @param progressCallback Optional callback for per-item and overall progress
+     * @return One result per item
+     */
+    std::vector<Result> run(
+        const std::vector<Item>& items,
+        Operation operation,
+        secure::SecureView password,
+        BatchProgressCallback progressCallback = nullptr
+    );
+    
+    /**
+     * @brief Process the files in a directory while it is still being listed
+     * 
+     * Picks up the same files as collectDirectory(), but hands each one to
+     * the workers as soon as its directory has been read, so the first
+     * files are done before a large tree is fully listed. Progress reports
+     * set Progress::listing until the listing is complete; the totals grow
+     * until then. Only one batch may run at a time on an engine.
+     * 
+     * @param directory Directory to process
+     * @param operation Encrypt or decrypt
+     * @param password Password used for every file; read until runDirectory() returns
+     * @param recursive True to include subdirectories
+     * @param progressCallback Optional callback for per-item and overall progress
+     * @return One result per file, in the order the files were found
+     * @throws EncryptionException if the directory cannot be read
+     */
+    std::vector<Result> runDirectory(
+        const std::string& directory,
+        Operation operation,
+        secure::SecureView password,
+        bool recursive = true,
+        BatchProgressCallback progressCallback = nullptr
+    );
+    
+    /**
+     * @brief Stop the current run
+     * 
+     * Safe to call from any thread. Items that never started and items
+     * stopped between two chunks are reported as Status::Cancelled; the
+     * latter leave nothing at their destination. Has no effect on later runs.
+     */
+    void cancel();
+    
+    /**
+     * @brief Stop every run whenever a token is cancelled
+     * 
+     * For callers that cancel a whole job, of which the batch is one part.
+     * A run that starts with the token already cancelled processes nothing.
+     * 
+     * @param token Token shared with whoever cancels, or null
+     */
+    void setCancellationToken(std::shared_ptr<const CancellationToken> token);
+    
+    /**
+     * @brief Set the chunk size used when encrypting
+     * 
+     * @param bytes Chunk size in bytes
+     */
+    void setChunkSize(size_t bytes);
+    
+    /**
+     * @brief Keep the chunk buffers of all files in flight within a budget
+     * 
+     * Both engines and every file processed at the same time draw on the
+     * one budget; a file whose next chunk does not fit waits for chunks of
+     * the others to be written. Also limits the shared buffer pool to the
+     * budget's pool share and sets the chunk size MemoryBudget::plan()
+     * picks for the pool's workers. For a worker count that fits as well,
+     * construct with the plan's workers.
+     * 
+     * @param budget Budget, or null for none
+     */
+    void setMemoryBudget(std::shared_ptr<MemoryBudget> budget);
+    
+    /**
+     * @brief Set the size from which a file is split across workers
+     * 
+     * @param bytes Threshold in bytes (default 64 MB)
+     */
+    void setLargeFileThreshold(uint64_t bytes);
+    
+    /**
+     * @brief Choose how file data is read and written
+     * 
+     * @param mode I/O mode (IoMode::Stream by default)
+     */
+    void setIoMode(IoMode mode);
+    
+    /**
+     * @brief Choose how streamed file data is read and written
+     * 
+     * @param engine I/O engine (IoEngine::Blocking by default)
+     */
+    void setIoEngine(IoEngine engine);
+    
+    /**
+     * @brief Set how many reads and writes the I/O engine keeps in flight per file
+     * 
+     * @param depth Operations in flight; zero is ignored
+     */
+    void setIoQueueDepth(size_t depth);
+    
+    /**
+     * @brief Keep file data out of the page cache, for jobs never read back
+     * 
+     * @param caching Cache use (FileCaching::Normal by default)
+     */
+    void setFileCaching(FileCaching caching);
+    
+    /**
+     * @brief Choose when finished files are made durable
+     * 
+     * With OutputSync::Grouped, every run syncs and renames its files in
+     * groups, so a batch of many small files does not wait for the disk
+     * once per file. Files only appear at their destination as their group
+     * commits, at the latest when run() returns; one that fails then is
+     * reported as failed.
+     * 
+     * @param sync Durability (OutputSync::None by default)
+     */
+    void setOutputSync(OutputSync sync);
+    
+    /**
+     * @brief Give taken destinations a numbered name instead of failing them
+     * 
+     * A destination that exists, or that an earlier item of the same run
+     * uses, becomes "name_1.ext", "name_2.ext" and so on, as in
+     * PathUtils::ensureUniqueFilePath(). Each destination directory is
+     * listed once per run; results carry the names actually used.
+     * 
+     * @param rename True to rename (false by default)
+     */
+    void setRenameConflicts(bool rename);
+    
+    /**
+     * @brief Remove a file at an item's destination just before the item runs
+     * 
+     * The engines refuse destinations that exist. For runDirectory(), whose
+     * destinations are not known before the run, this is the way to
+     * overwrite them. Has no effect while setRenameConflicts() is on.
+     * 
+     * @param replace True to replace existing files (false by default)
+     */
+    void setReplaceExisting(bool replace);
+    
+    /**
+     * @brief Set the Argon2id costs used when encrypting
+     * 
+     * @param params Costs, for example from Crypto::calibrateKdf
+     */
+    void setKdfParams(const KdfParams& params);
+    
+    /**
+     * @brief Compress files before encrypting them
+     * 
+     * @param settings Algorithm, level and probing (see Encryptor::setCompression)
+     */
+    void setCompression(const CompressionSettings& settings);
+    
+    /**
+     * @brief Encrypt files with key slots, so passwords can be added later
+     * 
+     * @param enabled True to use key slots (see Encryptor::setKeySlots)
+     */
+    void setKeySlots(bool enabled);
+    
+    /**
+     * @brief Set how often progress within a large file is reported
+     * 
+     * Small files only report when they start and finish, which needs no
+     * timer per file.
+     * 
+     * @param settings Minimum interval and delta between updates
+     */
+    void setProgressSettings(const ProgressSettings& settings);
+    
+    /**
+     * @return Metrics registry shared by every file of every run
+     */
+    std::shared_ptr<EncryptorStats> stats() const { return stats_; }
+    
+    // Default large-file threshold (64 MB, eight default chunks)
+    static constexpr uint64_t DEFAULT_LARGE_FILE_THRESHOLD = 64ull * 1024 * 1024;
+    
+    // Most a pool task gathers when it shares small files: half a default
+    // chunk, and few enough files that progress still moves smoothly
+    static constexpr uint64_t SMALL_UNIT_BYTES = 4ull * 1024 * 1024;
+    static constexpr size_t SMALL_UNIT_FILES = 64;
+    
+    // Prevent copying
+    BatchEncryptor(const BatchEncryptor&) = delete;
+    BatchEncryptor& operator=(const BatchEncryptor&) = delete;
+
+private:
+    struct RunState;
+    
+    // Runs the items addItems() adds, on a thread of its own when listing
+    std::vector<Result> execute(
+        RunState& state,
+        const std::function<void(RunState&, const std::shared_ptr<CancellationToken>&)>& addItems,
+        bool listing
+    );
+    
+    std::shared_ptr<ThreadPool> thread_pool_;
+    std::shared_ptr<secure::SecureBufferPool> buffer_pool_;
+    
+    // Emptied at the end of every run
+    std::shared_ptr<KeyCache> key_cache_;
+    std::shared_ptr<EncryptorStats> stats_;
+    
+    // Whole-file processing for small files; chunk-parallel for large ones
+    Encryptor small_files_;
+    Encryptor large_files_;
+    
+    uint64_t large_file_threshold_ = DEFAULT_LARGE_FILE_THRESHOLD;
+    OutputSync output_sync_ = OutputSync::None;
+    bool rename_conflicts_ = false;
+    bool replace_existing_ = false;
+    std::shared_ptr<const CancellationToken> cancellation_;
+    
+    // Child of cancellation_ for the current run, cancelled by cancel()
+    std::mutex run_mutex_;
+    std::shared_ptr<CancellationToken> run_cancellation_;
+};
+
+} // namespace crusty
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+namespace crusty {
+
+/**
+ * @brief Thrown when an operation stops because its token was cancelled
+ */
+class OperationCancelled : public std::runtime_error {
+public:
+    OperationCancelled() : std::runtime_error("Operation cancelled") {}
+};
+
+/**
+ * @brief Flag an operation checks between steps to stop early
+ * 
+ * Cancellation is cooperative: cancel() only sets the flag, and the work
+ * notices it the next time it checks, for an Encryptor before the next
+ * chunk. A token may have a parent, in which case cancelling the parent
+ * cancels it too. Safe to use from several threads.
+ */
+class CancellationToken {
+public:
+    CancellationToken() = default;
+    
+    /**
+     * @param parent Token whose cancellation also cancels this one, or null
+     */
+    explicit CancellationToken(std::shared_ptr<const CancellationToken> parent)
+        : parent_(std::move(parent)) {}
+    
+    /**
+     * @brief Ask the work to stop; cannot be undone
+     */
+    void cancel() noexcept {
+        cancelled_.store(true, std::memory_order_relaxed);
+    }
+    
+    /**
+     * @return True once this token or one of its parents is cancelled
+     */
+    bool cancelled() const noexcept {
+        return cancelled_.load(std::memory_order_relaxed) || (parent_ && parent_->cancelled());
+    }
+    
+    /**
+     * @throws OperationCancelled if cancelled()
+     */
+    void throwIfCancelled() const {
+        if (cancelled()) {
+            throw OperationCancelled();
+        }
+    }
+    
+    // Prevent copying
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+private:
+    std::shared_ptr<const CancellationToken> parent_;
+    std::atomic<bool> cancelled_{false};
+};
+
+} // namespace crusty
@@ -0,0 +1,228 @@
+#include "chunk_pipeline.h"
+#include "cancellation.h"
+#include "memory_budget.h"
+#include "thread_pool.h"
+#include "secure_buffer_pool.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace crusty {
+
+ChunkPipeline::ChunkPipeline(ThreadPool* pool, size_t maxInFlight, Stage transform, Stage sink,
+                             secure::SecureBufferPool* buffers)
+    : pool_(pool),
+      max_in_flight_(std::max<size_t>(1, maxInFlight)),
+      transform_(std::move(transform)),
+      sink_(std::move(sink)),
+      buffers_(buffers) {
+    if (pool_) {
+        writer_ = std::thread([this]() { writerLoop(); });
+    }
+}
+
+ChunkPipeline::~ChunkPipeline() {
+    drain();
+}
+
+void ChunkPipeline::push(PipelineChunk chunk) {
+    if (cancellation_ && cancellation_->cancelled()) {
+        recycle(chunk);
+        throw OperationCancelled();
+    }
+    
+    if (!pool_) {
+        try {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                waitForMemory(lock, chunk);
+            }
+            transform_(chunk);
+            sink_(chunk);
+        } catch (...) {
+            recycle(chunk);
+            throw;
+        }
+        recycle(chunk);
+        return;
+    }
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    waitForSpace(lock, max_in_flight_ - 1, true);
+    try {
+        waitForMemory(lock, chunk);
+    } catch (...) {
+        lock.unlock();
+        recycle(chunk);
+        throw;
+    }
+    if (error_) {
+        recycle(chunk);
+        std::rethrow_exception(error_);
+    }
+    ++in_flight_;
+    lock.unlock();
+    
+    // Shared with the task, so the chunk can still be recycled if it never
+    // gets queued
+    std::shared_ptr<PipelineChunk> queued;
+    std::future<PipelineChunk> result;
+    try {
+        queued = std::make_shared<PipelineChunk>(std::move(chunk));
+        result = pool_->submit(
+            [this, queued]() {
+                try {
+                    TRACE_SPAN("pipeline.transform");
+                    transform_(*queued);
+                } catch (...) {
+                    recycle(*queued);
+                    throw;
+                }
+                return std::move(*queued);
+            });
+    } catch (...) {
+        lock.lock();
+        --in_flight_;
+        lock.unlock();
+        space_.notify_all();
+        recycle(queued ? *queued : chunk);
+        throw;
+    }
+    
+    lock.lock();
+    pending_.push_back(std::move(result));
+    ready_.notify_one();
+}
+
+void ChunkPipeline::finish() {
+    if (!pool_) {
+        return;
+    }
+    
+    drain();
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void ChunkPipeline::waitForSpace(std::unique_lock<std::mutex>& lock, size_t limit, bool stopOnError) {
+    auto done = [this, limit, stopOnError]() {
+        return in_flight_ <= limit || (stopOnError && error_);
+    };
+    if (done()) {
+        return;
+    }
+    
+    // Time the producer is held back by a full pipeline, or drain() waits
+    TRACE_SPAN("pipeline.wait");
+    while (!done()) {
+        // Help with queued work instead of idling; this also keeps nested
+        // use from pool threads (e.g. batch jobs) from starving the pool
+        lock.unlock();
+        bool ranTask = pool_->runPendingTask();
+        lock.lock();
+        
+        if (!ranTask) {
+            space_.wait_for(lock, std::chrono::milliseconds(1), done);
+        }
+    }
+}
+
+void ChunkPipeline::waitForMemory(std::unique_lock<std::mutex>& lock, PipelineChunk& chunk) {
+    size_t bytes = chunk.data.capacity();
+    if (!budget_ || bytes == 0 || budget_->tryReserve(bytes)) {
+        chunk.reservedBytes = budget_ ? bytes : 0;
+        return;
+    }
+    
+    // Chunks of every pipeline on the budget free it as they are written;
+    // a failed pipeline stops waiting and push() reports the error
+    TRACE_SPAN("pipeline.memory_wait");
+    while (!budget_->tryReserve(bytes)) {
+        if (error_) {
+            return;
+        }
+        if (cancellation_ && cancellation_->cancelled()) {
+            throw OperationCancelled();
+        }
+        
+        lock.unlock();
+        bool ranTask = pool_ && pool_->runPendingTask();
+        lock.lock();
+        
+        if (!ranTask) {
+            space_.wait_for(lock, std::chrono::milliseconds(1));
+        }
+    }
+    chunk.reservedBytes = bytes;
+}
+
+void ChunkPipeline::drain() {
+    if (!writer_.joinable()) {
+        return;
+    }
+    
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // Keep helping even after a failure so queued tasks can't strand the writer
+        waitForSpace(lock, 0, false);
+        closed_ = true;
+    }
+    ready_.notify_one();
+    writer_.join();
+}
+
+void ChunkPipeline::recycle(PipelineChunk& chunk) {
+    if (chunk.reservedBytes > 0) {
+        budget_->release(chunk.reservedBytes);
+        chunk.reservedBytes = 0;
+    }
+    if (buffers_) {
+        buffers_->release(std::move(chunk.data));
+    } else {
+        secure::wipe(chunk.data);
+    }
+}
+
+void ChunkPipeline::writerLoop() {
+    while (true) {
+        std::future<PipelineChunk> result;
+        bool failed = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this]() { return closed_ || !pending_.empty(); });
+            if (pending_.empty()) {
+                return;
+            }
+            result = std::move(pending_.front());
+            pending_.pop_front();
+            failed = static_cast<bool>(error_);
+        }
+        
+        std::exception_ptr error;
+        PipelineChunk chunk;
+        try {
+            chunk = result.get();
+            if (!failed) {
+                TRACE_SPAN("pipeline.sink");
+                sink_(chunk);
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        recycle(chunk);
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (error && !error_) {
+                error_ = error;
+            }
+            --in_flight_;
+        }
+        space_.notify_all();
+    }
+}
+
+} // namespace crusty
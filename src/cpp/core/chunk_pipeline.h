@@ -0,0 +1,140 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace crusty {
+
+class CancellationToken;
+class MemoryBudget;
+class ThreadPool;
+
+namespace secure {
+class SecureBufferPool;
+}
+
+/**
+ * @brief One chunk travelling through a ChunkPipeline
+ */
+struct PipelineChunk {
+    uint64_t index = 0;
+    bool isFinal = false;
+    std::vector<uint8_t> data;
+    size_t offset = 0;  // Start of the payload in data, for chunks transformed in place
+    size_t inputSize = 0;  // Source bytes the chunk was made from, for transforms that change its size
+    size_t reservedBytes = 0;  // Memory budget held for the chunk; set by the pipeline
+};
+
+/**
+ * @brief Ordered read -> transform -> write pipeline for file chunks
+ * 
+ * The caller pushes chunks in file order (the reader stage). Each chunk is
+ * transformed independently on the thread pool, and a dedicated writer
+ * thread hands results to the sink strictly in push order. At most
+ * maxInFlight chunks are queued or being transformed at any time, which
+ * bounds memory use to roughly maxInFlight chunk buffers.
+ * 
+ * Without a pool both stages run inline in push(), matching the old
+ * serial loop exactly. Chunk buffers are wiped after the sink and handed
+ * back to the buffer pool, if one is given.
+ */
+class ChunkPipeline {
+public:
+    /**
+     * Stage callback; receives the chunk and may replace its data
+     */
+    using Stage = std::function<void(PipelineChunk& chunk)>;
+    
+    /**
+     * @brief Create a pipeline
+     * 
+     * @param pool Pool running the transform stage, or nullptr for inline processing
+     * @param maxInFlight Maximum number of chunks between push() and the sink
+     * @param transform Called on a pool thread for every chunk
+     * @param sink Called on the writer thread for every chunk, in order
+     * @param buffers Pool receiving finished chunk buffers, or nullptr
+     */
+    ChunkPipeline(ThreadPool* pool, size_t maxInFlight, Stage transform, Stage sink,
+                  secure::SecureBufferPool* buffers = nullptr);
+    
+    /**
+     * @brief Wait for outstanding chunks; errors are discarded
+     * 
+     * Stage callbacks usually reference locals of the caller, so the
+     * pipeline never lets tasks outlive it, even when unwinding.
+     */
+    ~ChunkPipeline();
+    
+    /**
+     * @brief Stop accepting chunks once a token is cancelled
+     * 
+     * @param token Token checked by every push(), or null; must outlive the pipeline
+     */
+    void setCancellationToken(const CancellationToken* token) { cancellation_ = token; }
+    
+    /**
+     * @brief Count chunk buffers against a memory budget
+     * 
+     * push() reserves each chunk's buffer before queueing it and blocks
+     * while the budget is used up, helping with queued work meanwhile; the
+     * reservation ends when the buffer is recycled after the sink. Chunks
+     * whose buffers are not in their data, such as those of mapped files,
+     * take nothing.
+     * 
+     * @param budget Budget shared with other pipelines, or null; must outlive the pipeline
+     */
+    void setMemoryBudget(MemoryBudget* budget) { budget_ = budget; }
+    
+    /**
+     * @brief Queue the next chunk, blocking while the pipeline is full
+     * 
+     * @param chunk Chunk to process
+     * @throws OperationCancelled if the token is cancelled; the chunk is wiped
+     * @throws The first exception raised by either stage
+     */
+    void push(PipelineChunk chunk);
+    
+    /**
+     * @brief Wait until every pushed chunk has reached the sink
+     * 
+     * @throws The first exception raised by either stage
+     */
+    void finish();
+    
+    // Prevent copying
+    ChunkPipeline(const ChunkPipeline&) = delete;
+    ChunkPipeline& operator=(const ChunkPipeline&) = delete;
+
+private:
+    void writerLoop();
+    void waitForSpace(std::unique_lock<std::mutex>& lock, size_t limit, bool stopOnError);
+    void waitForMemory(std::unique_lock<std::mutex>& lock, PipelineChunk& chunk);
+    void drain();
+    void recycle(PipelineChunk& chunk);
+    
+    ThreadPool* pool_;
+    size_t max_in_flight_;
+    Stage transform_;
+    Stage sink_;
+    secure::SecureBufferPool* buffers_;
+    const CancellationToken* cancellation_ = nullptr;
+    MemoryBudget* budget_ = nullptr;
+    
+    std::deque<std::future<PipelineChunk>> pending_;
+    size_t in_flight_ = 0;
+    bool closed_ = false;
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable space_;
+    std::thread writer_;
+};
+
+} // namespace crusty
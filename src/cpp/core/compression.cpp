@@ -0,0 +1,189 @@
+#include "compression.h"
+#include "encryptor.h"
+#include "secure_utils.h"
+
+#include <algorithm>
+#include <climits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef CRUSTY_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef CRUSTY_HAVE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+namespace crusty {
+namespace compression {
+
+namespace {
+
+[[noreturn]] void unavailable(Compression algorithm) {
+    throw EncryptionException(std::string("This build cannot handle ") + name(algorithm) + " compression",
+                              CryptoErrorCode::InternalError);
+}
+
+[[noreturn]] void corrupted() {
+    throw EncryptionException("Compressed chunk is corrupted", CryptoErrorCode::DataCorrupted);
+}
+
+#ifdef CRUSTY_HAVE_ZSTD
+// Contexts hold sizeable tables, so each worker thread keeps one of each
+struct ZstdContextDeleter {
+    void operator()(ZSTD_CCtx* context) const { ZSTD_freeCCtx(context); }
+    void operator()(ZSTD_DCtx* context) const { ZSTD_freeDCtx(context); }
+};
+
+ZSTD_CCtx* zstdCompressor() {
+    thread_local std::unique_ptr<ZSTD_CCtx, ZstdContextDeleter> context(ZSTD_createCCtx());
+    if (!context) {
+        throw std::bad_alloc();
+    }
+    return context.get();
+}
+
+ZSTD_DCtx* zstdDecompressor() {
+    thread_local std::unique_ptr<ZSTD_DCtx, ZstdContextDeleter> context(ZSTD_createDCtx());
+    if (!context) {
+        throw std::bad_alloc();
+    }
+    return context.get();
+}
+#endif
+
+} // anonymous namespace
+
+bool available(Compression algorithm) {
+    switch (algorithm) {
+        case Compression::None:
+            return true;
+        case Compression::Lz4:
+#ifdef CRUSTY_HAVE_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case Compression::Zstd:
+#ifdef CRUSTY_HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+const char* name(Compression algorithm) {
+    switch (algorithm) {
+        case Compression::None:
+            return "none";
+        case Compression::Lz4:
+            return "lz4";
+        case Compression::Zstd:
+            return "zstd";
+    }
+    return "unknown";
+}
+
+size_t compress(Compression algorithm, int level, const uint8_t* data, size_t size, uint8_t* out, size_t capacity) {
+#if !defined(CRUSTY_HAVE_LZ4) && !defined(CRUSTY_HAVE_ZSTD)
+    // Only read by the codecs
+    (void)level;
+    (void)data;
+    (void)size;
+    (void)out;
+    (void)capacity;
+#endif
+    switch (algorithm) {
+        case Compression::Lz4: {
+#ifdef CRUSTY_HAVE_LZ4
+            // LZ4 counts in int; chunks are at most container::MAX_CHUNK_SIZE
+            int limit = static_cast<int>(std::min<size_t>(capacity, INT_MAX));
+            int written = level <= 1
+                ? LZ4_compress_default(reinterpret_cast<const char*>(data), reinterpret_cast<char*>(out),
+                                       static_cast<int>(size), limit)
+                : LZ4_compress_HC(reinterpret_cast<const char*>(data), reinterpret_cast<char*>(out),
+                                  static_cast<int>(size), limit, level);
+            return written > 0 ? static_cast<size_t>(written) : 0;
+#else
+            break;
+#endif
+        }
+        case Compression::Zstd: {
+#ifdef CRUSTY_HAVE_ZSTD
+            int zstdLevel = level == 0 ? ZSTD_CLEVEL_DEFAULT : std::clamp(level, ZSTD_minCLevel(), ZSTD_maxCLevel());
+            size_t written = ZSTD_compressCCtx(zstdCompressor(), out, capacity, data, size, zstdLevel);
+            // An error here means the output did not fit
+            return ZSTD_isError(written) ? 0 : written;
+#else
+            break;
+#endif
+        }
+        case Compression::None:
+            break;
+    }
+    unavailable(algorithm);
+}
+
+void decompress(Compression algorithm, const uint8_t* data, size_t size, uint8_t* out, size_t originalSize) {
+#if !defined(CRUSTY_HAVE_LZ4) && !defined(CRUSTY_HAVE_ZSTD)
+    // Only read by the codecs
+    (void)data;
+    (void)size;
+    (void)out;
+    (void)originalSize;
+#endif
+    switch (algorithm) {
+        case Compression::Lz4: {
+#ifdef CRUSTY_HAVE_LZ4
+            if (size > INT_MAX || originalSize > INT_MAX) {
+                corrupted();
+            }
+            int written = LZ4_decompress_safe(reinterpret_cast<const char*>(data), reinterpret_cast<char*>(out),
+                                              static_cast<int>(size), static_cast<int>(originalSize));
+            if (written < 0 || static_cast<size_t>(written) != originalSize) {
+                corrupted();
+            }
+            return;
+#else
+            break;
+#endif
+        }
+        case Compression::Zstd: {
+#ifdef CRUSTY_HAVE_ZSTD
+            size_t written = ZSTD_decompressDCtx(zstdDecompressor(), out, originalSize, data, size);
+            if (ZSTD_isError(written) || written != originalSize) {
+                corrupted();
+            }
+            return;
+#else
+            break;
+#endif
+        }
+        case Compression::None:
+            break;
+    }
+    unavailable(algorithm);
+}
+
+bool worthCompressing(Compression algorithm, const uint8_t* data, size_t size) {
+    // The start of a file is often a header that compresses better than the rest
+    size_t sampleSize = std::min(size, PROBE_SIZE);
+    const uint8_t* sample = data + (size - sampleSize) / 2;
+    size_t limit = sampleSize - sampleSize / PROBE_MIN_SAVING;
+    if (limit == 0) {
+        return false;
+    }
+    
+    // Fastest setting: this only has to tell text from already compressed data
+    std::vector<uint8_t> scratch(limit);
+    bool shrank = compress(algorithm, 1, sample, sampleSize, scratch.data(), limit) != 0;
+    secure::wipe(scratch);
+    return shrank;
+}
+
+} // namespace compression
+} // namespace crusty
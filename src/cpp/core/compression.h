@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace crusty {
+
+/**
+ * Compression applied to chunks before they are encrypted
+ * 
+ * The values are stored in the container header.
+ */
+enum class Compression : uint8_t {
+    None = 0,
+    Lz4 = 1,    // Fastest; levels above 1 use LZ4 HC
+    Zstd = 2    // Better ratio at moderate cost
+};
+
+/**
+ * @brief How newly encrypted files are compressed
+ * 
+ * Encrypted data can't be compressed afterwards, so logs, dumps and other
+ * text are worth compressing first. A chunk that does not get smaller is
+ * always stored as is; with skipIncompressible, a sample of each chunk is
+ * tried first, so media and archives cost little more than without
+ * compression.
+ */
+struct CompressionSettings {
+    Compression algorithm = Compression::None;
+    int level = 0;                      // 0 for the algorithm's default
+    bool skipIncompressible = false;    // Probe each chunk before compressing it
+};
+
+namespace compression {
+
+/**
+ * @brief Whether this build can compress and decompress an algorithm
+ * 
+ * @param algorithm Algorithm to check
+ * @return True for Compression::None and for codecs found at build time
+ */
+bool available(Compression algorithm);
+
+/**
+ * @brief Name of an algorithm, as used on the command line
+ * 
+ * @param algorithm Algorithm to name
+ * @return "none", "lz4" or "zstd"
+ */
+const char* name(Compression algorithm);
+
+/**
+ * @brief Compress data if that makes it smaller
+ * 
+ * @param algorithm Codec to use, other than None
+ * @param level Codec level, or 0 for its default
+ * @param data Data to compress
+ * @param size Bytes in data
+ * @param out Receives the compressed data
+ * @param capacity Space in out; the result is kept only if it fits
+ * @return Compressed size, or 0 if the data did not fit in capacity
+ * @throws EncryptionException if the codec is not available
+ */
+size_t compress(Compression algorithm, int level, const uint8_t* data, size_t size, uint8_t* out, size_t capacity);
+
+/**
+ * @brief Decompress data whose original size is known
+ * 
+ * @param algorithm Codec the data was compressed with
+ * @param data Compressed data
+ * @param size Bytes in data
+ * @param out Receives exactly originalSize bytes
+ * @param originalSize Size before compression
+ * @throws EncryptionException with DataCorrupted if the data does not
+ *         decompress to exactly originalSize bytes, or if the codec is not
+ *         available
+ */
+void decompress(Compression algorithm, const uint8_t* data, size_t size, uint8_t* out, size_t originalSize);
+
+/**
+ * @brief Guess from a sample whether a chunk is worth compressing
+ * 
+ * Compresses up to PROBE_SIZE bytes from the middle of the chunk at the
+ * codec's fastest setting.
+ * 
+ * @param algorithm Codec that would compress the chunk
+ * @param data Chunk data
+ * @param size Bytes in data
+ * @return True if the sample shrank by at least 1/PROBE_MIN_SAVING
+ */
+bool worthCompressing(Compression algorithm, const uint8_t* data, size_t size);
+
+// Sample tried by worthCompressing()
+constexpr size_t PROBE_SIZE = 64 * 1024;
+
+// A sample must shrink by at least 1/16 of its size
+constexpr size_t PROBE_MIN_SAVING = 16;
+
+} // namespace compression
+} // namespace crusty
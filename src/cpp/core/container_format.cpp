@@ -0,0 +1,939 @@
+#include "container_format.h"
+
+#include <algorithm>
+
+namespace crusty {
+namespace container {
+
+namespace {
+
+// Upper bound on the stored header length, so a corrupt field can't make
+// readers skip arbitrary amounts of data
+constexpr uint32_t MAX_HEADER_SIZE = 64 * 1024;
+
+// All multi-byte fields are big-endian, matching the chunk length prefix
+// written by the Rust library
+void putU16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value);
+}
+
+void putU32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+void putU64(uint8_t* out, uint64_t value) {
+    putU32(out, static_cast<uint32_t>(value >> 32));
+    putU32(out + 4, static_cast<uint32_t>(value));
+}
+
+uint16_t getU16(const uint8_t* in) {
+    return static_cast<uint16_t>((in[0] << 8) | in[1]);
+}
+
+uint32_t getU32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) |
+           (static_cast<uint32_t>(in[1]) << 16) |
+           (static_cast<uint32_t>(in[2]) << 8) |
+           static_cast<uint32_t>(in[3]);
+}
+
+uint64_t getU64(const uint8_t* in) {
+    return (static_cast<uint64_t>(getU32(in)) << 32) | getU32(in + 4);
+}
+
+[[noreturn]] void corrupted(const std::string& message) {
+    throw EncryptionException(message, CryptoErrorCode::DataCorrupted);
+}
+
+// Every record but the last of an uncompressed container holds a whole
+// chunk; compressed records only have to fit their prefix and a chunk
+bool validRecordLength(const FileHeader& header, uint32_t ciphertextLen, bool isFinal) {
+    uint64_t maxLen = maxRecordPlaintext(header) + TAG_SIZE;
+    if (header.compression == Compression::None) {
+        return ciphertextLen >= TAG_SIZE && ciphertextLen <= maxLen && (isFinal || ciphertextLen == maxLen);
+    }
+    return ciphertextLen >= CHUNK_PREFIX_SIZE + TAG_SIZE && ciphertextLen <= maxLen;
+}
+
+void writeBytes(std::ostream& out, const uint8_t* data, size_t size) {
+    if (!out.write(reinterpret_cast<const char*>(data), size)) {
+        throw EncryptionException("Failed to write encrypted file", CryptoErrorCode::IoError);
+    }
+}
+
+bool readBytes(std::istream& in, uint8_t* data, size_t size) {
+    in.read(reinterpret_cast<char*>(data), size);
+    return static_cast<size_t>(in.gcount()) == size;
+}
+
+// The header as stored: with the length read from the file rather than
+// the one encodeHeader() computes, which differs if a newer writer
+// appended fields
+std::vector<uint8_t> storedHeaderBytes(const FileHeader& header) {
+    std::vector<uint8_t> bytes(encodedHeaderSize(header));
+    encodeHeader(header, bytes.data());
+    putU32(bytes.data() + MAGIC.size() + 2, header.headerSize);
+    return bytes;
+}
+
+} // anonymous namespace
+
+bool validKdfParams(const KdfParams& params) {
+    // Argon2 needs at least eight 1 KiB blocks per lane
+    return params.parallelism >= 1 && params.parallelism <= MAX_KDF_PARALLELISM &&
+           params.iterations >= 1 && params.iterations <= MAX_KDF_ITERATIONS &&
+           params.memoryKib >= 8 * params.parallelism && params.memoryKib <= MAX_KDF_MEMORY_KIB;
+}
+
+ChunkNonce chunkNonce(const FileHeader& header, uint64_t chunkIndex, bool isFinal) {
+    return chunkNonce(header.noncePrefix, chunkIndex, isFinal);
+}
+
+ChunkNonce chunkNonce(const NoncePrefix& prefix, uint64_t chunkIndex, bool isFinal) {
+    if (chunkIndex >= MAX_CHUNK_COUNT) {
+        throw EncryptionException("File has too many chunks for its nonce counter; use a larger chunk size",
+                                  CryptoErrorCode::InternalError);
+    }
+    
+    // prefix | 32-bit chunk counter | last-chunk byte
+    ChunkNonce nonce{};
+    std::copy(prefix.begin(), prefix.end(), nonce.begin());
+    putU32(nonce.data() + NONCE_PREFIX_SIZE, static_cast<uint32_t>(chunkIndex));
+    nonce[nonce.size() - 1] = isFinal ? 1 : 0;
+    return nonce;
+}
+
+ChunkNonce chunkNonce(const ContainerInfo& info, uint64_t chunkIndex, bool isFinal) {
+    if (!isIncremental(info.header)) {
+        return chunkNonce(info.header, chunkIndex, isFinal);
+    }
+    if (chunkIndex >= info.noncePrefixes.size()) {
+        throw EncryptionException("Chunk index out of range", CryptoErrorCode::InternalError);
+    }
+    return chunkNonce(info.noncePrefixes[chunkIndex], chunkIndex, isFinal);
+}
+
+NoncePrefix framePrefix(const uint8_t* frame) {
+    NoncePrefix prefix{};
+    std::copy(frame, frame + NONCE_PREFIX_SIZE, prefix.begin());
+    return prefix;
+}
+
+std::vector<uint8_t> recordMacInput(const std::vector<NoncePrefix>& prefixes) {
+    std::vector<uint8_t> input(8 + prefixes.size() * NONCE_PREFIX_SIZE);
+    putU64(input.data(), prefixes.size());
+    uint8_t* p = input.data() + 8;
+    for (const NoncePrefix& prefix : prefixes) {
+        std::copy(prefix.begin(), prefix.end(), p);
+        p += NONCE_PREFIX_SIZE;
+    }
+    return input;
+}
+
+Fingerprint recordMac(const Crypto& crypto, const SecureKey& key, const std::vector<NoncePrefix>& prefixes) {
+    std::vector<uint8_t> input = recordMacInput(prefixes);
+    return crypto.fingerprint(RECORD_MAC_CONTEXT, input.data(), input.size(), key);
+}
+
+void checkRecordPrefixes(const Crypto& crypto, const SecureKey& key, const FileHeader& header,
+                         const std::vector<NoncePrefix>& prefixes) {
+    if (!isIncremental(header)) {
+        return;
+    }
+    Fingerprint mac = recordMac(crypto, key, prefixes);
+    if (!secure::SecureView(mac.data(), mac.size()).equals(
+            secure::SecureView(header.recordMac.data(), header.recordMac.size()))) {
+        throw EncryptionException("Chunk records do not match the file header (wrong password or replaced records)",
+                                  CryptoErrorCode::AuthenticationFailed);
+    }
+}
+
+std::shared_ptr<const SecureKey> recordKey(const Crypto& crypto, std::shared_ptr<const SecureKey> key,
+                                           const FileHeader& header) {
+    if (!isHeaderBound(header)) {
+        return key;
+    }
+    std::vector<uint8_t> bytes = storedHeaderBytes(header);
+    Fingerprint bound = crypto.fingerprint(HEADER_KEY_CONTEXT, bytes.data(), HEADER_SIZE, *key);
+    auto result = std::make_shared<const SecureKey>(SecureKey::fromBytes(bound.data(), bound.size()));
+    secure::wipe(bound);
+    return result;
+}
+
+Fingerprint keyCheck(const Crypto& crypto, const SecureKey& key, const FileHeader& header) {
+    if (!isHeaderBound(header)) {
+        return crypto.fingerprint(KEY_CHECK_CONTEXT, header.salt.data(), header.salt.size(), key);
+    }
+    FileHeader unchecked = header;
+    unchecked.keyCheck = {};
+    std::vector<uint8_t> bytes = storedHeaderBytes(unchecked);
+    return crypto.fingerprint(KEY_CHECK_CONTEXT, bytes.data(), bytes.size(), key);
+}
+
+void checkKey(const Crypto& crypto, const SecureKey& key, const FileHeader& header) {
+    if (!hasKeyCheck(header)) {
+        return;
+    }
+    Fingerprint check = keyCheck(crypto, key, header);
+    if (!secure::SecureView(check.data(), check.size()).equals(
+            secure::SecureView(header.keyCheck.data(), header.keyCheck.size()))) {
+        throw EncryptionException("Password does not match the file's key check (wrong password)",
+                                  CryptoErrorCode::InvalidPassword);
+    }
+}
+
+uint32_t frameCiphertextLength(const uint8_t* frame, bool& isFinal) {
+    uint32_t value = getU32(frame + 12);
+    isFinal = (value & FINAL_CHUNK_FLAG) != 0;
+    return value & ~FINAL_CHUNK_FLAG;
+}
+
+void encodeChunkPrefix(uint8_t* out, uint8_t encoding, uint32_t plaintextSize) {
+    out[0] = encoding;
+    putU32(out + 1, plaintextSize);
+}
+
+uint32_t decodeChunkPrefix(const uint8_t* in, uint8_t& encoding) {
+    encoding = in[0];
+    return getU32(in + 1);
+}
+
+uint32_t checkChunkPrefix(const FileHeader& header, const uint8_t* payload, size_t payloadSize, bool isFinal,
+                          uint8_t& encoding) {
+    if (payloadSize < CHUNK_PREFIX_SIZE) {
+        corrupted("Compressed chunk is malformed");
+    }
+    uint32_t plaintextSize = decodeChunkPrefix(payload, encoding);
+    size_t bodySize = payloadSize - CHUNK_PREFIX_SIZE;
+    
+    // Every chunk but the last holds exactly chunkSize bytes, which also
+    // bounds what a record can expand to
+    if (plaintextSize > header.chunkSize || (!isFinal && plaintextSize != header.chunkSize) ||
+        (encoding != CHUNK_STORED && encoding != CHUNK_COMPRESSED) ||
+        (encoding == CHUNK_STORED && bodySize != plaintextSize)) {
+        corrupted("Compressed chunk is malformed");
+    }
+    return plaintextSize;
+}
+
+uint32_t recordCiphertextLength(const FileHeader& header, uint8_t* frame, bool& isFinal) {
+    uint32_t ciphertextLen = frameCiphertextLength(frame, isFinal);
+    if (!validRecordLength(header, ciphertextLen, isFinal)) {
+        corrupted("Encrypted chunk length is invalid");
+    }
+    
+    // Hand the record on with the flag cleared, as produced by encryptChunk
+    clearFinalFlag(frame);
+    return ciphertextLen;
+}
+
+void setFinalFlag(uint8_t* frame) {
+    frame[12] |= static_cast<uint8_t>(FINAL_CHUNK_FLAG >> 24);
+}
+
+void clearFinalFlag(uint8_t* frame) {
+    frame[12] &= static_cast<uint8_t>(~(FINAL_CHUNK_FLAG >> 24));
+}
+
+ContainerLayout layoutFor(uint64_t plaintextSize, uint32_t chunkSize, uint64_t headerSize) {
+    ContainerLayout layout;
+    layout.headerSize = headerSize;
+    
+    // An empty file still gets one (empty) final record
+    layout.chunkCount = plaintextSize == 0 ? 1 : (plaintextSize + chunkSize - 1) / chunkSize;
+    layout.lastChunkSize = plaintextSize - (layout.chunkCount - 1) * chunkSize;
+    layout.footerOffset = layout.chunkOffset(layout.chunkCount - 1, chunkSize) + recordSize(layout.lastChunkSize);
+    layout.totalSize = layout.footerOffset + footerSize(layout.chunkCount);
+    return layout;
+}
+
+//
+// Header serialization
+//
+
+void encodeHeader(const FileHeader& header, uint8_t* out) {
+    uint8_t* p = out;
+    
+    std::copy(MAGIC.begin(), MAGIC.end(), p);
+    p += MAGIC.size();
+    putU16(p, header.version);
+    p += 2;
+    putU32(p, static_cast<uint32_t>(encodedHeaderSize(header)));
+    p += 4;
+    putU32(p, header.flags);
+    p += 4;
+    putU32(p, header.chunkSize);
+    p += 4;
+    putU32(p, header.kdf.memoryKib);
+    p += 4;
+    putU32(p, header.kdf.iterations);
+    p += 4;
+    putU32(p, header.kdf.parallelism);
+    p += 4;
+    std::copy(header.salt.begin(), header.salt.end(), p);
+    p += SALT_SIZE;
+    std::copy(header.noncePrefix.begin(), header.noncePrefix.end(), p);
+    p += NONCE_PREFIX_SIZE;
+    *p = static_cast<uint8_t>(header.compression); // Zero, reserved, in version 2
+    p += 1;
+    if (isIncremental(header)) {
+        std::copy(header.recordMac.begin(), header.recordMac.end(), p);
+        p += RECORD_MAC_SIZE;
+    }
+    if (hasKeyCheck(header)) {
+        std::copy(header.keyCheck.begin(), header.keyCheck.end(), p);
+        p += KEY_CHECK_SIZE;
+    }
+    if (hasKeySlots(header)) {
+        std::fill(p, p + KEY_SLOT_TABLE_SIZE, 0);
+        for (const KeySlot& slot : header.keySlots) {
+            if (slot.used) {
+                p[0] = 1;
+                putU32(p + 1, slot.kdf.memoryKib);
+                putU32(p + 5, slot.kdf.iterations);
+                putU32(p + 9, slot.kdf.parallelism);
+                std::copy(slot.salt.begin(), slot.salt.end(), p + 13);
+                std::copy(slot.wrappedKey.begin(), slot.wrappedKey.end(), p + 13 + SALT_SIZE);
+            }
+            p += KEY_SLOT_SIZE;
+        }
+    }
+}
+
+void writeHeader(std::ostream& out, const FileHeader& header) {
+    std::vector<uint8_t> buffer(encodedHeaderSize(header));
+    encodeHeader(header, buffer.data());
+    writeBytes(out, buffer.data(), buffer.size());
+}
+
+void encodeFooter(const std::vector<uint64_t>& chunkOffsets, uint64_t plaintextSize, uint8_t* out) {
+    uint8_t* p = out;
+    for (uint64_t offset : chunkOffsets) {
+        putU64(p, offset);
+        p += 8;
+    }
+    putU64(p, chunkOffsets.size());
+    p += 8;
+    putU64(p, plaintextSize);
+    p += 8;
+    std::copy(INDEX_MAGIC.begin(), INDEX_MAGIC.end(), p);
+}
+
+size_t storedHeaderSize(const uint8_t* data) {
+    if (!std::equal(MAGIC.begin(), MAGIC.end(), data)) {
+        corrupted("File is not a CRUSTy encrypted file");
+    }
+    uint16_t version = getU16(data + MAGIC.size());
+    if (version != FORMAT_VERSION && version != COMPRESSED_FORMAT_VERSION) {
+        corrupted("Unsupported file format version: " + std::to_string(version));
+    }
+    uint32_t headerSize = getU32(data + MAGIC.size() + 2);
+    if (headerSize < HEADER_SIZE || headerSize > MAX_HEADER_SIZE) {
+        corrupted("Invalid header size");
+    }
+    return headerSize;
+}
+
+FileHeader decodeHeader(const uint8_t* data, size_t size) {
+    if (size < HEADER_SIZE || size < storedHeaderSize(data)) {
+        corrupted("File header is truncated");
+    }
+    
+    FileHeader header;
+    const uint8_t* p = data + MAGIC.size();
+    header.version = getU16(p);
+    p += 2;
+    header.headerSize = getU32(p);
+    p += 4;
+    header.flags = getU32(p);
+    p += 4;
+    header.chunkSize = getU32(p);
+    p += 4;
+    header.kdf.memoryKib = getU32(p);
+    p += 4;
+    header.kdf.iterations = getU32(p);
+    p += 4;
+    header.kdf.parallelism = getU32(p);
+    p += 4;
+    std::copy(p, p + SALT_SIZE, header.salt.begin());
+    p += SALT_SIZE;
+    std::copy(p, p + NONCE_PREFIX_SIZE, header.noncePrefix.begin());
+    p += NONCE_PREFIX_SIZE;
+    
+    // Whether the codec is built in is checked when decrypting, so any
+    // build can still inspect the file
+    if (header.version == COMPRESSED_FORMAT_VERSION) {
+        header.compression = static_cast<Compression>(*p);
+        if (header.compression != Compression::Lz4 && header.compression != Compression::Zstd) {
+            corrupted("Unknown compression in header: " + std::to_string(*p));
+        }
+    }
+    p += 1;
+    
+    if (header.chunkSize == 0 || header.chunkSize > MAX_CHUNK_SIZE) {
+        corrupted("Invalid chunk size in header");
+    }
+    if (!validKdfParams(header.kdf)) {
+        corrupted("Invalid key derivation parameters in header");
+    }
+    if ((header.flags & ~KNOWN_FLAGS) != 0) {
+        corrupted("Unsupported header flags: " + std::to_string(header.flags));
+    }
+    if (header.headerSize < encodedHeaderSize(header)) {
+        corrupted("File header is too short for its flags");
+    }
+    
+    // Updating in place relies on every record having the same size.
+    // Fields appended by newer writers are skipped
+    if (isIncremental(header)) {
+        if (header.compression != Compression::None) {
+            corrupted("Invalid incremental container header");
+        }
+        std::copy(p, p + RECORD_MAC_SIZE, header.recordMac.begin());
+        p += RECORD_MAC_SIZE;
+    }
+    if (hasKeyCheck(header)) {
+        std::copy(p, p + KEY_CHECK_SIZE, header.keyCheck.begin());
+        p += KEY_CHECK_SIZE;
+    }
+    if (hasKeySlots(header)) {
+        bool anyUsed = false;
+        for (KeySlot& slot : header.keySlots) {
+            if (p[0] > 1) {
+                corrupted("Invalid key slot in header");
+            }
+            slot.used = p[0] == 1;
+            if (slot.used) {
+                slot.kdf.memoryKib = getU32(p + 1);
+                slot.kdf.iterations = getU32(p + 5);
+                slot.kdf.parallelism = getU32(p + 9);
+                if (!validKdfParams(slot.kdf)) {
+                    corrupted("Invalid key derivation parameters in key slot");
+                }
+                std::copy(p + 13, p + 13 + SALT_SIZE, slot.salt.begin());
+                std::copy(p + 13 + SALT_SIZE, p + KEY_SLOT_SIZE, slot.wrappedKey.begin());
+                anyUsed = true;
+            }
+            p += KEY_SLOT_SIZE;
+        }
+        if (!anyUsed) {
+            corrupted("File header has no key slot in use");
+        }
+    }
+    
+    return header;
+}
+
+FileHeader readHeader(std::istream& in) {
+    std::vector<uint8_t> buffer(HEADER_SIZE);
+    if (!readBytes(in, buffer.data(), buffer.size())) {
+        corrupted("File is too short to contain a header");
+    }
+    buffer.resize(storedHeaderSize(buffer.data()));
+    if (!readBytes(in, buffer.data() + HEADER_SIZE, buffer.size() - HEADER_SIZE)) {
+        corrupted("File header is truncated");
+    }
+    return decodeHeader(buffer.data(), buffer.size());
+}
+
+//
+// Chunk manifest serialization
+//
+
+std::vector<uint8_t> encodeManifest(const ChunkManifest& manifest) {
+    std::vector<uint8_t> out(MANIFEST_HEADER_SIZE + manifest.entries.size() * MANIFEST_ENTRY_SIZE);
+    uint8_t* p = out.data();
+    
+    std::copy(MANIFEST_MAGIC.begin(), MANIFEST_MAGIC.end(), p);
+    p += MANIFEST_MAGIC.size();
+    putU16(p, MANIFEST_VERSION);
+    p += 2;
+    putU32(p, manifest.chunkSize);
+    p += 4;
+    putU64(p, manifest.entries.size());
+    p += 8;
+    putU64(p, manifest.plaintextSize);
+    p += 8;
+    std::copy(manifest.salt.begin(), manifest.salt.end(), p);
+    p += SALT_SIZE;
+    
+    for (const ManifestEntry& entry : manifest.entries) {
+        std::copy(entry.noncePrefix.begin(), entry.noncePrefix.end(), p);
+        p += NONCE_PREFIX_SIZE;
+        std::copy(entry.fingerprint.begin(), entry.fingerprint.end(), p);
+        p += entry.fingerprint.size();
+    }
+    return out;
+}
+
+ChunkManifest decodeManifest(const uint8_t* data, size_t size) {
+    if (size < MANIFEST_HEADER_SIZE || !std::equal(MANIFEST_MAGIC.begin(), MANIFEST_MAGIC.end(), data)) {
+        corrupted("File is not a chunk manifest");
+    }
+    const uint8_t* p = data + MANIFEST_MAGIC.size();
+    if (getU16(p) != MANIFEST_VERSION) {
+        corrupted("Unsupported chunk manifest version: " + std::to_string(getU16(p)));
+    }
+    p += 2;
+    
+    ChunkManifest manifest;
+    manifest.chunkSize = getU32(p);
+    p += 4;
+    uint64_t chunkCount = getU64(p);
+    p += 8;
+    manifest.plaintextSize = getU64(p);
+    p += 8;
+    std::copy(p, p + SALT_SIZE, manifest.salt.begin());
+    p += SALT_SIZE;
+    
+    if (chunkCount != (size - MANIFEST_HEADER_SIZE) / MANIFEST_ENTRY_SIZE ||
+        (size - MANIFEST_HEADER_SIZE) % MANIFEST_ENTRY_SIZE != 0) {
+        corrupted("Chunk manifest is truncated");
+    }
+    manifest.entries.resize(static_cast<size_t>(chunkCount));
+    for (ManifestEntry& entry : manifest.entries) {
+        std::copy(p, p + NONCE_PREFIX_SIZE, entry.noncePrefix.begin());
+        p += NONCE_PREFIX_SIZE;
+        std::copy(p, p + entry.fingerprint.size(), entry.fingerprint.begin());
+        p += entry.fingerprint.size();
+    }
+    return manifest;
+}
+
+//
+// Deduplicated archive serialization
+//
+
+void encodeArchiveHeader(const ArchiveHeader& header, uint8_t* out) {
+    uint8_t* p = out;
+    std::copy(ARCHIVE_MAGIC.begin(), ARCHIVE_MAGIC.end(), p);
+    p += ARCHIVE_MAGIC.size();
+    putU16(p, ARCHIVE_VERSION);
+    p += 2;
+    putU32(p, header.kdf.memoryKib);
+    p += 4;
+    putU32(p, header.kdf.iterations);
+    p += 4;
+    putU32(p, header.kdf.parallelism);
+    p += 4;
+    std::copy(header.salt.begin(), header.salt.end(), p);
+    p += SALT_SIZE;
+    std::copy(header.noncePrefix.begin(), header.noncePrefix.end(), p);
+    p += NONCE_PREFIX_SIZE;
+    putU32(p, header.maxChunkSize);
+}
+
+ArchiveHeader decodeArchiveHeader(const uint8_t* data, size_t size) {
+    if (size < ARCHIVE_HEADER_SIZE || !std::equal(ARCHIVE_MAGIC.begin(), ARCHIVE_MAGIC.end(), data)) {
+        corrupted("File is not a deduplicated archive");
+    }
+    const uint8_t* p = data + ARCHIVE_MAGIC.size();
+    if (getU16(p) != ARCHIVE_VERSION) {
+        corrupted("Unsupported archive version: " + std::to_string(getU16(p)));
+    }
+    p += 2;
+    
+    ArchiveHeader header;
+    header.kdf.memoryKib = getU32(p);
+    p += 4;
+    header.kdf.iterations = getU32(p);
+    p += 4;
+    header.kdf.parallelism = getU32(p);
+    p += 4;
+    std::copy(p, p + SALT_SIZE, header.salt.begin());
+    p += SALT_SIZE;
+    std::copy(p, p + NONCE_PREFIX_SIZE, header.noncePrefix.begin());
+    p += NONCE_PREFIX_SIZE;
+    header.maxChunkSize = getU32(p);
+    
+    if (!validKdfParams(header.kdf)) {
+        corrupted("Invalid key derivation parameters in archive header");
+    }
+    if (header.maxChunkSize == 0 || header.maxChunkSize > MAX_CHUNK_SIZE) {
+        corrupted("Invalid chunk size in archive header");
+    }
+    return header;
+}
+
+void encodeArchiveTrailer(uint64_t catalogOffset, uint8_t* out) {
+    putU64(out, catalogOffset);
+    std::copy(ARCHIVE_END_MAGIC.begin(), ARCHIVE_END_MAGIC.end(), out + 8);
+}
+
+uint64_t decodeArchiveTrailer(const uint8_t* data, uint64_t fileSize) {
+    if (!std::equal(ARCHIVE_END_MAGIC.begin(), ARCHIVE_END_MAGIC.end(), data + 8)) {
+        corrupted("Archive is truncated (trailer missing)");
+    }
+    
+    // The catalog record needs at least its frame between the records and the trailer
+    uint64_t catalogOffset = getU64(data);
+    if (catalogOffset < ARCHIVE_HEADER_SIZE || fileSize < ARCHIVE_TRAILER_SIZE + recordSize(0) ||
+        catalogOffset > fileSize - ARCHIVE_TRAILER_SIZE - recordSize(0)) {
+        corrupted("Invalid catalog offset in archive trailer");
+    }
+    return catalogOffset;
+}
+
+std::vector<uint8_t> encodeCatalog(const ArchiveCatalog& catalog) {
+    constexpr size_t chunkSize = 8 + 4 + std::tuple_size<Fingerprint>::value;
+    size_t total = 8 + catalog.chunks.size() * chunkSize + 8;
+    for (const ArchiveEntry& entry : catalog.entries) {
+        total += 4 + entry.name.size() + 8 + 8 + entry.chunks.size() * 8;
+    }
+    
+    std::vector<uint8_t> out(total);
+    uint8_t* p = out.data();
+    putU64(p, catalog.chunks.size());
+    p += 8;
+    for (const StoredChunk& chunk : catalog.chunks) {
+        putU64(p, chunk.offset);
+        p += 8;
+        putU32(p, chunk.size);
+        p += 4;
+        std::copy(chunk.id.begin(), chunk.id.end(), p);
+        p += chunk.id.size();
+    }
+    
+    putU64(p, catalog.entries.size());
+    p += 8;
+    for (const ArchiveEntry& entry : catalog.entries) {
+        putU32(p, static_cast<uint32_t>(entry.name.size()));
+        p += 4;
+        std::copy(entry.name.begin(), entry.name.end(), p);
+        p += entry.name.size();
+        putU64(p, entry.size);
+        p += 8;
+        putU64(p, entry.chunks.size());
+        p += 8;
+        for (uint64_t index : entry.chunks) {
+            putU64(p, index);
+            p += 8;
+        }
+    }
+    return out;
+}
+
+ArchiveCatalog decodeCatalog(const uint8_t* data, size_t size, uint64_t recordsEnd) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    // Counts are checked against the bytes left before anything is allocated
+    auto need = [&](uint64_t count, uint64_t unit) {
+        if (count > static_cast<uint64_t>(end - p) / unit) {
+            corrupted("Archive catalog is truncated");
+        }
+    };
+    
+    ArchiveCatalog catalog;
+    need(1, 8);
+    uint64_t chunkCount = getU64(p);
+    p += 8;
+    constexpr size_t chunkSize = 8 + 4 + std::tuple_size<Fingerprint>::value;
+    need(chunkCount, chunkSize);
+    catalog.chunks.resize(static_cast<size_t>(chunkCount));
+    for (StoredChunk& chunk : catalog.chunks) {
+        chunk.offset = getU64(p);
+        p += 8;
+        chunk.size = getU32(p);
+        p += 4;
+        std::copy(p, p + chunk.id.size(), chunk.id.begin());
+        p += chunk.id.size();
+        if (chunk.size == 0 || chunk.size > MAX_CHUNK_SIZE || chunk.offset < ARCHIVE_HEADER_SIZE ||
+            chunk.offset > recordsEnd || recordsEnd - chunk.offset < recordSize(chunk.size)) {
+            corrupted("Archive catalog names a chunk outside the archive");
+        }
+    }
+    
+    need(1, 8);
+    uint64_t entryCount = getU64(p);
+    p += 8;
+    need(entryCount, 4 + 8 + 8);
+    catalog.entries.resize(static_cast<size_t>(entryCount));
+    for (ArchiveEntry& entry : catalog.entries) {
+        need(1, 4);
+        uint32_t nameSize = getU32(p);
+        p += 4;
+        need(uint64_t{nameSize} + 8 + 8, 1);
+        entry.name.assign(reinterpret_cast<const char*>(p), nameSize);
+        p += nameSize;
+        entry.size = getU64(p);
+        p += 8;
+        uint64_t refCount = getU64(p);
+        p += 8;
+        if (!validArchiveName(entry.name)) {
+            corrupted("Archive catalog holds an unsafe file name");
+        }
+        
+        need(refCount, 8);
+        entry.chunks.resize(static_cast<size_t>(refCount));
+        uint64_t total = 0;
+        for (uint64_t& index : entry.chunks) {
+            index = getU64(p);
+            p += 8;
+            if (index >= chunkCount) {
+                corrupted("Archive catalog names a chunk that is not stored");
+            }
+            total += catalog.chunks[index].size;
+        }
+        if (total != entry.size) {
+            corrupted("Chunks of " + entry.name + " do not add up to its size");
+        }
+    }
+    if (p != end) {
+        corrupted("Archive catalog has trailing data");
+    }
+    return catalog;
+}
+
+bool validArchiveName(std::string_view name) {
+    if (name.empty() || name.size() > MAX_ARCHIVE_NAME || name.front() == '/') {
+        return false;
+    }
+    if (name.find_first_of(std::string_view("\\:\0", 3)) != std::string_view::npos) {
+        return false;
+    }
+    
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t slash = name.find('/', start);
+        std::string_view part = name.substr(start, slash == std::string_view::npos ? std::string_view::npos : slash - start);
+        if (part.empty() || part == "." || part == "..") {
+            return false;
+        }
+        if (slash == std::string_view::npos) {
+            break;
+        }
+        start = slash + 1;
+    }
+    return true;
+}
+
+ChunkNonce chunkNonce(const Fingerprint& id) {
+    ChunkNonce nonce{};
+    std::copy(id.begin(), id.begin() + nonce.size(), nonce.begin());
+    return nonce;
+}
+
+ChunkNonce catalogNonce(const ArchiveHeader& header) {
+    ChunkNonce nonce{};
+    std::copy(header.noncePrefix.begin(), header.noncePrefix.end(), nonce.begin());
+    putU32(nonce.data() + NONCE_PREFIX_SIZE, 0xFFFFFFFFu);
+    nonce[nonce.size() - 1] = 1;
+    return nonce;
+}
+
+//
+// ContainerWriter implementation
+//
+
+ContainerWriter::ContainerWriter(std::ostream& out, const FileHeader& header)
+    : out_(out), offset_(encodedHeaderSize(header)) {
+    writeHeader(out_, header);
+}
+
+void ContainerWriter::writeChunk(std::vector<uint8_t>& frame, bool isFinal) {
+    if (final_written_) {
+        throw EncryptionException("Chunk written after the final chunk", CryptoErrorCode::InternalError);
+    }
+    if (frame.size() < FRAME_HEADER_SIZE + TAG_SIZE) {
+        throw EncryptionException("Encrypted chunk is malformed", CryptoErrorCode::InternalError);
+    }
+    
+    if (isFinal) {
+        setFinalFlag(frame.data());
+        final_written_ = true;
+    }
+    
+    chunk_offsets_.push_back(offset_);
+    writeBytes(out_, frame.data(), frame.size());
+    offset_ += frame.size();
+}
+
+void ContainerWriter::finish(uint64_t plaintextSize) {
+    if (!final_written_) {
+        throw EncryptionException("Container finished without a final chunk", CryptoErrorCode::InternalError);
+    }
+    
+    std::vector<uint8_t> footer(footerSize(chunk_offsets_.size()));
+    encodeFooter(chunk_offsets_, plaintextSize, footer.data());
+    writeBytes(out_, footer.data(), footer.size());
+}
+
+//
+// ContainerReader implementation
+//
+
+ContainerReader::ContainerReader(std::istream& in)
+    : in_(in), header_(readHeader(in)) {
+}
+
+void ContainerReader::readRecord(std::vector<uint8_t>& frame, bool& isFinal) {
+    // Read the prefix separately so a reused buffer is resized only once
+    uint8_t prefix[FRAME_HEADER_SIZE];
+    if (!readBytes(in_, prefix, FRAME_HEADER_SIZE)) {
+        corrupted("Encrypted chunk header is truncated");
+    }
+    uint32_t ciphertextLen = recordCiphertextLength(header_, prefix, isFinal);
+    frame.resize(FRAME_HEADER_SIZE + ciphertextLen);
+    std::copy(prefix, prefix + FRAME_HEADER_SIZE, frame.begin());
+    if (!readBytes(in_, frame.data() + FRAME_HEADER_SIZE, ciphertextLen)) {
+        corrupted("Encrypted chunk is truncated");
+    }
+}
+
+bool ContainerReader::readNextChunk(std::vector<uint8_t>& frame, bool& isFinal) {
+    if (final_read_) {
+        isFinal = true;
+        return false;
+    }
+    
+    if (in_.peek() == std::char_traits<char>::eof()) {
+        corrupted("Encrypted file is truncated (final chunk missing)");
+    }
+    
+    readRecord(frame, isFinal);
+    final_read_ = isFinal;
+    return true;
+}
+
+ContainerSummary ContainerReader::readSummary() {
+    ContainerSummary summary;
+    summary.header = header_;
+    
+    in_.clear();
+    in_.seekg(0, std::ios::end);
+    std::streamoff end = in_.tellg();
+    if (end < 0) {
+        throw EncryptionException("Encrypted file is not seekable", CryptoErrorCode::IoError);
+    }
+    summary.fileSize = static_cast<uint64_t>(end);
+    if (summary.fileSize < header_.headerSize + recordSize(0) + TRAILER_SIZE) {
+        corrupted("Encrypted file is too short");
+    }
+    
+    // Trailer: chunk count | plaintext size | index magic
+    uint8_t trailer[TRAILER_SIZE];
+    in_.seekg(static_cast<std::streamoff>(summary.fileSize - TRAILER_SIZE));
+    if (!readBytes(in_, trailer, TRAILER_SIZE) ||
+        !std::equal(INDEX_MAGIC.begin(), INDEX_MAGIC.end(), trailer + 16)) {
+        corrupted("Chunk index is missing");
+    }
+    
+    summary.chunkCount = getU64(trailer);
+    summary.plaintextSize = getU64(trailer + 8);
+    uint64_t available = summary.fileSize - header_.headerSize - TRAILER_SIZE;
+    if (summary.chunkCount == 0 || summary.chunkCount > available / (8 + recordSize(0))) {
+        corrupted("Chunk index has an invalid chunk count");
+    }
+    
+    // Every record but the last holds a whole chunk, so the counts fix the
+    // size; a plaintext larger than the file would overflow the layout
+    if (header_.compression == Compression::None) {
+        if (summary.plaintextSize < summary.fileSize) {
+            ContainerLayout layout = layoutFor(summary.plaintextSize, header_.chunkSize);
+            summary.layoutMatches = layout.chunkCount == summary.chunkCount &&
+                layout.totalSize - HEADER_SIZE + header_.headerSize == summary.fileSize;
+        }
+        return summary;
+    }
+    
+    // Compressed records still stand for one chunk each, but only bounds
+    // on their sizes are known
+    uint64_t expectedChunks = summary.plaintextSize == 0
+        ? 1 : (summary.plaintextSize - 1) / header_.chunkSize + 1;
+    uint64_t records = summary.fileSize - header_.headerSize - footerSize(summary.chunkCount);
+    uint64_t perRecord = records / summary.chunkCount;
+    uint64_t largest = recordSize(maxRecordPlaintext(header_));
+    summary.layoutMatches = expectedChunks == summary.chunkCount &&
+        perRecord >= recordSize(CHUNK_PREFIX_SIZE) &&
+        (perRecord < largest || (perRecord == largest && records % summary.chunkCount == 0));
+    return summary;
+}
+
+ContainerInfo ContainerReader::readIndex(bool checkRecords) {
+    ContainerSummary summary = readSummary();
+    ContainerInfo info;
+    info.header = header_;
+    info.fileSize = summary.fileSize;
+    info.plaintextSize = summary.plaintextSize;
+    uint64_t chunkCount = summary.chunkCount;
+    uint64_t indexOffset = info.fileSize - TRAILER_SIZE - chunkCount * 8;
+    
+    std::vector<uint8_t> index(static_cast<size_t>(chunkCount * 8));
+    in_.seekg(static_cast<std::streamoff>(indexOffset));
+    if (!readBytes(in_, index.data(), index.size())) {
+        corrupted("Chunk index is truncated");
+    }
+    
+    // Walk the record headers and check they tile the file exactly
+    bool incremental = isIncremental(header_);
+    checkRecords = checkRecords || incremental;
+    info.chunkOffsets.reserve(static_cast<size_t>(chunkCount));
+    if (incremental) {
+        info.noncePrefixes.reserve(static_cast<size_t>(chunkCount));
+    }
+    uint64_t expectedOffset = header_.headerSize;
+    uint64_t plaintextTotal = 0;
+    for (uint64_t i = 0; i < chunkCount; ++i) {
+        uint64_t offset = getU64(index.data() + i * 8);
+        if (offset != expectedOffset) {
+            corrupted("Chunk index does not match file layout");
+        }
+        
+        bool isLast = (i + 1 == chunkCount);
+        bool isFinal = isLast;
+        uint32_t ciphertextLen = 0;
+        if (checkRecords) {
+            uint8_t frame[FRAME_HEADER_SIZE];
+            in_.seekg(static_cast<std::streamoff>(offset));
+            if (!readBytes(in_, frame, FRAME_HEADER_SIZE)) {
+                corrupted("Encrypted chunk header is truncated");
+            }
+            ciphertextLen = frameCiphertextLength(frame, isFinal);
+            if (incremental) {
+                info.noncePrefixes.push_back(framePrefix(frame));
+            }
+        } else {
+            // Lengths follow from where the next record, or the index, starts
+            uint64_t end = isLast ? indexOffset : getU64(index.data() + (i + 1) * 8);
+            if (end < offset + FRAME_HEADER_SIZE || end - offset - FRAME_HEADER_SIZE > UINT32_MAX) {
+                corrupted("Encrypted chunk " + std::to_string(i) + " is malformed");
+            }
+            ciphertextLen = static_cast<uint32_t>(end - offset - FRAME_HEADER_SIZE);
+        }
+        if (isFinal != isLast || !validRecordLength(header_, ciphertextLen, isLast)) {
+            corrupted("Encrypted chunk " + std::to_string(i) + " is malformed");
+        }
+        
+        info.chunkOffsets.push_back(offset);
+        plaintextTotal += ciphertextLen - TAG_SIZE;
+        expectedOffset = offset + FRAME_HEADER_SIZE + ciphertextLen;
+    }
+    
+    if (expectedOffset != indexOffset) {
+        corrupted("Chunk records do not end at the index");
+    }
+    // Compressed records don't reveal their plaintext size until decrypted
+    if (header_.compression == Compression::None && plaintextTotal != info.plaintextSize) {
+        corrupted("Chunk index plaintext size does not match records");
+    }
+    
+    return info;
+}
+
+void ContainerReader::readChunkAt(const ContainerInfo& info, size_t chunkIndex, std::vector<uint8_t>& frame) {
+    if (chunkIndex >= info.chunkOffsets.size()) {
+        throw EncryptionException("Chunk index out of range", CryptoErrorCode::InternalError);
+    }
+    
+    in_.clear();
+    in_.seekg(static_cast<std::streamoff>(info.chunkOffsets[chunkIndex]));
+    bool isFinal = false;
+    readRecord(frame, isFinal);
+}
+
+} // namespace container
+} // namespace crusty
@@ -0,0 +1,1002 @@
+#pragma once
+
+#include "compression.h"
+#include "encryptor.h"
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace crusty {
+namespace container {
+
+/**
+ * Magic bytes at the start of every encrypted file
+ */
+constexpr std::array<uint8_t, 6> MAGIC = {'C', 'R', 'U', 'S', 'T', 'Y'};
+
+/**
+ * Magic bytes closing the footer index
+ */
+constexpr std::array<uint8_t, 8> INDEX_MAGIC = {'C', 'R', 'S', 'T', 'Y', 'I', 'D', 'X'};
+
+/**
+ * Current on-disk format version
+ */
+constexpr uint16_t FORMAT_VERSION = 2;
+
+/**
+ * Version written for compressed containers
+ * 
+ * Same layout as version 2, but the last header byte names the
+ * compression algorithm and every record starts with a chunk prefix.
+ * Kept apart so readers that predate compression reject these files
+ * instead of returning compressed data.
+ */
+constexpr uint16_t COMPRESSED_FORMAT_VERSION = 3;
+
+/**
+ * Size of the prefix inside every record of a compressed container
+ * 
+ * One encoding byte (CHUNK_STORED or CHUNK_COMPRESSED) and the chunk's
+ * plaintext size as a 32-bit big-endian value. The prefix is encrypted
+ * and authenticated with the chunk.
+ */
+constexpr size_t CHUNK_PREFIX_SIZE = 1 + 4;
+constexpr uint8_t CHUNK_STORED = 0;
+constexpr uint8_t CHUNK_COMPRESSED = 1;
+
+/**
+ * Size of the per-file Argon2id salt in bytes
+ */
+constexpr size_t SALT_SIZE = 16;
+
+/**
+ * Size of the random per-file nonce prefix
+ */
+constexpr size_t NONCE_PREFIX_SIZE = 7;
+using NoncePrefix = std::array<uint8_t, NONCE_PREFIX_SIZE>;
+
+/**
+ * Serialized size of the version 2 header fields
+ * 
+ * magic, version, header length, flags, chunk size, KDF costs, salt, nonce
+ * prefix and one byte that is reserved in version 2 and names the
+ * compression in version 3. Readers honour the stored header length, so
+ * later versions can append fields without moving the first record.
+ */
+constexpr size_t HEADER_SIZE = MAGIC.size() + 2 + 4 + 4 + 4 + 3 * 4 + SALT_SIZE + NONCE_PREFIX_SIZE + 1;
+
+/**
+ * Header flag of containers that can be updated in place
+ * 
+ * Encryptor::updateFile() rewrites only the chunks that changed, each
+ * under a fresh nonce prefix, so every record's nonce carries its own
+ * prefix instead of the header's. The header grows by RECORD_MAC_SIZE
+ * bytes holding a keyed MAC over all record prefixes in order, which
+ * stops records of older versions of the file from being spliced back in.
+ * Only uncompressed containers carry it. Readers that predate the flag
+ * still reject any rewritten record, as its nonce is not the one they expect.
+ */
+constexpr uint32_t FLAG_INCREMENTAL = 1u << 0;
+constexpr size_t RECORD_MAC_SIZE = 32;
+constexpr size_t INCREMENTAL_HEADER_SIZE = HEADER_SIZE + RECORD_MAC_SIZE;
+
+/**
+ * Crypto::fingerprint() context of the record MAC
+ * 
+ * Chunk fingerprints use the chunk index as their context, which is
+ * always below MAX_CHUNK_COUNT, so contexts from here up are free for
+ * other MACs under the file key.
+ */
+constexpr uint64_t RECORD_MAC_CONTEXT = 1ull << 63;
+
+/**
+ * Size of the nonce and length prefix in front of every encrypted chunk
+ */
+constexpr size_t FRAME_HEADER_SIZE = 12 + 4;
+
+/**
+ * AES-GCM authentication tag appended to every chunk ciphertext
+ */
+constexpr size_t TAG_SIZE = 16;
+
+/**
+ * Largest chunk size the 31-bit record length prefix can describe
+ */
+constexpr uint32_t MAX_CHUNK_SIZE = 1u << 30;
+
+/**
+ * Bit set in a record's length prefix to mark the final chunk
+ */
+constexpr uint32_t FINAL_CHUNK_FLAG = 0x80000000u;
+
+/**
+ * Most records one file can hold, limited by the 32-bit nonce counter
+ */
+constexpr uint64_t MAX_CHUNK_COUNT = 1ull << 32;
+
+/**
+ * Bounds on the Argon2id costs accepted from a header, so a crafted file
+ * cannot make a reader allocate or spin without limit
+ */
+constexpr uint32_t MAX_KDF_MEMORY_KIB = 4 * 1024 * 1024;
+constexpr uint32_t MAX_KDF_ITERATIONS = 1024;
+constexpr uint32_t MAX_KDF_PARALLELISM = 255;
+
+/**
+ * Size of the fixed trailer at the very end of the file
+ * 
+ * chunk count, plaintext size and index magic. The chunk offsets are
+ * stored directly in front of it.
+ */
+constexpr size_t TRAILER_SIZE = 8 + 8 + INDEX_MAGIC.size();
+
+/**
+ * Header flag of containers encrypted under a random data key
+ * 
+ * The chunks are encrypted under a data key drawn for the file, and the
+ * header carries a table of MAX_KEY_SLOTS key slots. Each used slot holds
+ * the data key sealed, as a Crypto::encryptInto frame, under a key derived
+ * from one password with the slot's own salt and costs. Any of the
+ * passwords opens the file, and adding, removing or changing one rewrites
+ * only the slot table, which has the same size however many slots are
+ * used. The header's own salt and costs are not used for the key; readers
+ * that predate the flag derive a key from them that fails to authenticate.
+ */
+constexpr uint32_t FLAG_KEY_SLOTS = 1u << 1;
+constexpr size_t MAX_KEY_SLOTS = 8;
+constexpr size_t DATA_KEY_SIZE = 32;
+constexpr size_t WRAPPED_KEY_SIZE = FRAME_HEADER_SIZE + DATA_KEY_SIZE + TAG_SIZE;
+
+/**
+ * Serialized size of one key slot and of the whole table
+ * 
+ * A byte that is 1 for a used slot, the Argon2id costs, the salt and the
+ * sealed data key. Unused slots are all zero.
+ */
+constexpr size_t KEY_SLOT_SIZE = 1 + 3 * 4 + SALT_SIZE + WRAPPED_KEY_SIZE;
+constexpr size_t KEY_SLOT_TABLE_SIZE = MAX_KEY_SLOTS * KEY_SLOT_SIZE;
+
+/**
+ * Header flag of containers whose header can tell a wrong password
+ * 
+ * The header grows by KEY_CHECK_SIZE bytes holding a MAC of the whole
+ * encoded header, with this field zeroed, under the key of its records
+ * and KEY_CHECK_CONTEXT. A reader thus rejects a wrong password or an
+ * edited header right after deriving the key, before reading any record.
+ * Headers without FLAG_HEADER_BOUND hold a MAC of the salt only. Files
+ * with key slots do without it, as opening a slot checks the password
+ * already.
+ */
+constexpr uint32_t FLAG_KEY_CHECK = 1u << 2;
+constexpr size_t KEY_CHECK_SIZE = 32;
+
+/**
+ * Crypto::fingerprint() context of the key check, after CHUNKER_SEED_CONTEXT
+ */
+constexpr uint64_t KEY_CHECK_CONTEXT = RECORD_MAC_CONTEXT + 4;
+
+/**
+ * Header flag of containers whose records are bound to the header
+ * 
+ * Records are encrypted under a key derived from the file key, or from
+ * the data key with key slots, and the fixed header fields: everything
+ * from the magic to the compression byte. Changing any of them, such as
+ * turning a compressed version 3 file into version 2, or clearing the
+ * flag itself gives another key, so the key check and every record fail
+ * to authenticate instead of the file being read the wrong way. The
+ * fields after them change in place and are authenticated separately:
+ * the record MAC covers the records and each key slot is sealed.
+ */
+constexpr uint32_t FLAG_HEADER_BOUND = 1u << 3;
+
+/**
+ * Crypto::fingerprint() context of the key bound to the header
+ */
+constexpr uint64_t HEADER_KEY_CONTEXT = RECORD_MAC_CONTEXT + 5;
+
+/**
+ * Header flags this version understands; containers with others are rejected
+ */
+constexpr uint32_t KNOWN_FLAGS = FLAG_INCREMENTAL | FLAG_KEY_SLOTS | FLAG_KEY_CHECK | FLAG_HEADER_BOUND;
+
+/**
+ * @brief One password's copy of a container's data key
+ */
+struct KeySlot {
+    bool used = false;
+    KdfParams kdf;
+    std::array<uint8_t, SALT_SIZE> salt{};
+    std::array<uint8_t, WRAPPED_KEY_SIZE> wrappedKey{};
+};
+
+/**
+ * @brief Per-file header written before the first encrypted chunk
+ * 
+ * Stores everything needed to re-derive the file key and to locate chunks,
+ * so the password is run through Argon2id once per file.
+ */
+struct FileHeader {
+    uint16_t version = FORMAT_VERSION;
+    uint32_t headerSize = HEADER_SIZE;
+    uint32_t flags = 0;
+    uint32_t chunkSize = 0;
+    KdfParams kdf;
+    std::array<uint8_t, SALT_SIZE> salt{};
+    NoncePrefix noncePrefix{};
+    Compression compression = Compression::None;   // Only set in version 3
+    std::array<uint8_t, RECORD_MAC_SIZE> recordMac{};   // Only with FLAG_INCREMENTAL
+    std::array<uint8_t, KEY_CHECK_SIZE> keyCheck{};     // Only with FLAG_KEY_CHECK
+    std::array<KeySlot, MAX_KEY_SLOTS> keySlots{};      // Only with FLAG_KEY_SLOTS
+};
+
+/**
+ * @param header Header to check
+ * @return True if the container's records carry their own nonce prefixes
+ */
+inline bool isIncremental(const FileHeader& header) {
+    return (header.flags & FLAG_INCREMENTAL) != 0;
+}
+
+/**
+ * @param header Header to check
+ * @return True if the container's key is held in key slots
+ */
+inline bool hasKeySlots(const FileHeader& header) {
+    return (header.flags & FLAG_KEY_SLOTS) != 0;
+}
+
+/**
+ * @param header Header to check
+ * @return True if the header can check a password before any record is read
+ */
+inline bool hasKeyCheck(const FileHeader& header) {
+    return (header.flags & FLAG_KEY_CHECK) != 0;
+}
+
+/**
+ * @param header Header to check
+ * @return True if the container's records are encrypted under a key bound to the header
+ */
+inline bool isHeaderBound(const FileHeader& header) {
+    return (header.flags & FLAG_HEADER_BOUND) != 0;
+}
+
+/**
+ * @param header Header to serialize
+ * @return Bytes encodeHeader() writes for it
+ */
+inline size_t encodedHeaderSize(const FileHeader& header) {
+    return (isIncremental(header) ? INCREMENTAL_HEADER_SIZE : HEADER_SIZE) +
+        (hasKeyCheck(header) ? KEY_CHECK_SIZE : 0) +
+        (hasKeySlots(header) ? KEY_SLOT_TABLE_SIZE : 0);
+}
+
+/**
+ * @brief Largest plaintext one record of a container can hold
+ * 
+ * @param header Header of the container
+ * @return Chunk size, plus the chunk prefix if the container is compressed
+ */
+inline uint64_t maxRecordPlaintext(const FileHeader& header) {
+    return static_cast<uint64_t>(header.chunkSize) +
+        (header.compression != Compression::None ? CHUNK_PREFIX_SIZE : 0);
+}
+
+/**
+ * @brief Structure of an encrypted file, read without decrypting it
+ */
+struct ContainerInfo {
+    FileHeader header;
+    uint64_t fileSize = 0;
+    uint64_t plaintextSize = 0;
+    std::vector<uint64_t> chunkOffsets;
+    std::vector<NoncePrefix> noncePrefixes;   // Every record's, only with FLAG_INCREMENTAL
+};
+
+/**
+ * @brief What the header and trailer of an encrypted file say about it
+ * 
+ * Cheap to read, two small reads however large the file, for showing a
+ * file rather than decrypting it.
+ */
+struct ContainerSummary {
+    FileHeader header;
+    uint64_t fileSize = 0;
+    uint64_t chunkCount = 0;
+    uint64_t plaintextSize = 0;
+    
+    // The file is exactly as long as the trailer's counts imply, or for a
+    // compressed container within the sizes they allow. Records themselves
+    // are only checked by readIndex() and decryption
+    bool layoutMatches = false;
+};
+
+/**
+ * @brief Size of a complete record for a chunk of plaintext
+ * 
+ * @param plaintextSize Plaintext bytes in the chunk
+ * @return Record size including nonce, length prefix and tag
+ */
+constexpr uint64_t recordSize(uint64_t plaintextSize) {
+    return FRAME_HEADER_SIZE + plaintextSize + TAG_SIZE;
+}
+
+/**
+ * @brief Size of the footer index for a number of chunks
+ * 
+ * @param chunkCount Number of records in the container
+ * @return Offsets plus trailer, in bytes
+ */
+constexpr uint64_t footerSize(uint64_t chunkCount) {
+    return chunkCount * 8 + TRAILER_SIZE;
+}
+
+/**
+ * @brief Position of every part of a container, known before encrypting
+ * 
+ * Every record except the last holds exactly one chunk, so the layout
+ * follows from the plaintext size and chunk size alone. Not valid for
+ * compressed containers, whose records vary in size.
+ */
+struct ContainerLayout {
+    uint64_t headerSize = HEADER_SIZE;
+    uint64_t chunkCount = 0;
+    uint64_t lastChunkSize = 0;
+    uint64_t footerOffset = 0;
+    uint64_t totalSize = 0;
+    
+    /**
+     * @return File offset of a record
+     */
+    uint64_t chunkOffset(uint64_t chunkIndex, uint32_t chunkSize) const {
+        return headerSize + chunkIndex * recordSize(chunkSize);
+    }
+};
+
+/**
+ * @brief Compute the layout of a container
+ * 
+ * @param plaintextSize Total plaintext bytes
+ * @param chunkSize Chunk size stored in the header
+ * @param headerSize Bytes in the header, from encodedHeaderSize()
+ * @return Container layout
+ */
+ContainerLayout layoutFor(uint64_t plaintextSize, uint32_t chunkSize, uint64_t headerSize = HEADER_SIZE);
+
+/**
+ * @brief Check Argon2id costs against the format's bounds
+ * 
+ * @param params Costs to check
+ * @return True if Argon2id accepts them and they are within the MAX_KDF_* limits
+ */
+bool validKdfParams(const KdfParams& params);
+
+/**
+ * @brief Nonce a chunk must be encrypted under
+ * 
+ * STREAM construction: the file's random prefix, the chunk index as a
+ * 32-bit big-endian counter and a last-chunk byte. Any worker can compute
+ * it without coordination, and a record that is moved, copied from another
+ * file or turned into the last one no longer matches its expected nonce.
+ * 
+ * @param header Header holding the nonce prefix
+ * @param chunkIndex Zero-based chunk number
+ * @param isFinal True for the last chunk of the file
+ * @return Nonce for the chunk
+ * @throws EncryptionException if chunkIndex is not below MAX_CHUNK_COUNT
+ */
+ChunkNonce chunkNonce(const FileHeader& header, uint64_t chunkIndex, bool isFinal);
+
+/**
+ * @brief Nonce a chunk was encrypted under, given the prefix to use
+ * 
+ * For records of incremental containers, which carry their own prefix.
+ * 
+ * @param prefix Nonce prefix of the record
+ * @param chunkIndex Zero-based chunk number
+ * @param isFinal True for the last chunk of the file
+ * @return Nonce for the chunk
+ * @throws EncryptionException if chunkIndex is not below MAX_CHUNK_COUNT
+ */
+ChunkNonce chunkNonce(const NoncePrefix& prefix, uint64_t chunkIndex, bool isFinal);
+
+/**
+ * @brief Nonce a chunk of an indexed container must carry
+ * 
+ * The header's prefix, or for incremental containers the record's own
+ * prefix as listed by readIndex(). Those prefixes are only trustworthy
+ * once checked against the header's record MAC.
+ * 
+ * @param info Structure from ContainerReader::readIndex()
+ * @param chunkIndex Zero-based chunk number
+ * @param isFinal True for the last chunk of the file
+ * @return Nonce for the chunk
+ * @throws EncryptionException if chunkIndex is not below MAX_CHUNK_COUNT
+ */
+ChunkNonce chunkNonce(const ContainerInfo& info, uint64_t chunkIndex, bool isFinal);
+
+/**
+ * @brief Read the nonce prefix a record was encrypted under
+ * 
+ * @param frame At least FRAME_HEADER_SIZE bytes of a record
+ * @return The record's nonce prefix
+ */
+NoncePrefix framePrefix(const uint8_t* frame);
+
+/**
+ * @brief Bytes the record MAC of an incremental header covers
+ * 
+ * The record count as a 64-bit big-endian value, then every record's
+ * nonce prefix in file order.
+ * 
+ * @param prefixes Nonce prefix of every record
+ * @return Input for Crypto::fingerprint() under RECORD_MAC_CONTEXT
+ */
+std::vector<uint8_t> recordMacInput(const std::vector<NoncePrefix>& prefixes);
+
+/**
+ * @brief MAC over the nonce prefix of every record, kept in incremental headers
+ * 
+ * @param crypto Cipher implementation
+ * @param key File key
+ * @param prefixes Nonce prefix of every record, in file order
+ * @return Value for FileHeader::recordMac
+ */
+Fingerprint recordMac(const Crypto& crypto, const SecureKey& key, const std::vector<NoncePrefix>& prefixes);
+
+/**
+ * @brief Check the record prefixes of an incremental container against its header
+ * 
+ * Records of incremental containers carry their own nonce prefix; only the
+ * header's MAC over all of them shows none was swapped for an older record.
+ * Does nothing for other containers.
+ * 
+ * @param crypto Cipher implementation
+ * @param key File key
+ * @param header Header of the container
+ * @param prefixes Nonce prefix of every record, in file order
+ * @throws EncryptionException with AuthenticationFailed if they do not match
+ */
+void checkRecordPrefixes(const Crypto& crypto, const SecureKey& key, const FileHeader& header,
+                         const std::vector<NoncePrefix>& prefixes);
+
+/**
+ * @brief Key a container's records are encrypted under
+ * 
+ * With FLAG_HEADER_BOUND, a key derived from the given one and the fixed
+ * header fields; otherwise the given key itself. The key check, record
+ * MAC and fingerprints of the container are all made under this key.
+ * 
+ * @param crypto Cipher implementation
+ * @param key File key, or the data key of a container with key slots
+ * @param header Complete header of the container
+ * @return Key for the container's records
+ * @throws EncryptionException if the crypto library fails
+ */
+std::shared_ptr<const SecureKey> recordKey(const Crypto& crypto, std::shared_ptr<const SecureKey> key,
+                                           const FileHeader& header);
+
+/**
+ * @brief MAC that lets a header check the key derived for it
+ * 
+ * Covers the whole header, key check aside, or just the salt of a header
+ * without FLAG_HEADER_BOUND. Changing any field after this, such as the
+ * record MAC, needs a new key check.
+ * 
+ * @param crypto Cipher implementation
+ * @param key Key of the container's records, from recordKey()
+ * @param header Header the MAC covers
+ * @return Value for FileHeader::keyCheck
+ */
+Fingerprint keyCheck(const Crypto& crypto, const SecureKey& key, const FileHeader& header);
+
+/**
+ * @brief Check a derived key against a header's key check
+ * 
+ * Does nothing for headers without FLAG_KEY_CHECK; their key is only
+ * known to be wrong once the first record fails to authenticate.
+ * 
+ * @param crypto Cipher implementation
+ * @param key Key derived from the password
+ * @param header Header of the container
+ * @throws EncryptionException with InvalidPassword if the key does not match
+ */
+void checkKey(const Crypto& crypto, const SecureKey& key, const FileHeader& header);
+
+/**
+ * @brief Read the ciphertext length from a record's length prefix
+ * 
+ * @param frame At least FRAME_HEADER_SIZE bytes of a record
+ * @param isFinal Set to true if the record is flagged as the final chunk
+ * @return Ciphertext length in bytes
+ */
+uint32_t frameCiphertextLength(const uint8_t* frame, bool& isFinal);
+
+/**
+ * @brief Write the chunk prefix of a compressed container's record
+ * 
+ * @param out Receives CHUNK_PREFIX_SIZE bytes
+ * @param encoding CHUNK_STORED or CHUNK_COMPRESSED
+ * @param plaintextSize Size of the chunk before compression
+ */
+void encodeChunkPrefix(uint8_t* out, uint8_t encoding, uint32_t plaintextSize);
+
+/**
+ * @brief Read the chunk prefix of a decrypted record
+ * 
+ * @param in CHUNK_PREFIX_SIZE bytes
+ * @param encoding Set to the stored encoding byte
+ * @return Size of the chunk before compression
+ */
+uint32_t decodeChunkPrefix(const uint8_t* in, uint8_t& encoding);
+
+/**
+ * @brief Read and validate the chunk prefix of a decrypted record
+ * 
+ * @param header Header of the compressed container
+ * @param payload Decrypted record: chunk prefix, then the stored or compressed chunk
+ * @param payloadSize Bytes in payload
+ * @param isFinal True for the file's last chunk, the only one that may be short
+ * @param encoding Set to CHUNK_STORED or CHUNK_COMPRESSED
+ * @return Size of the chunk before compression
+ * @throws EncryptionException with DataCorrupted if the prefix is impossible
+ */
+uint32_t checkChunkPrefix(const FileHeader& header, const uint8_t* payload, size_t payloadSize, bool isFinal,
+                          uint8_t& encoding);
+
+/**
+ * @brief Read and validate the length prefix of a record read from a container
+ * 
+ * @param header Header of the container
+ * @param frame FRAME_HEADER_SIZE bytes of a record; the final-chunk flag is
+ *              cleared, giving the frame Crypto::decryptChunk expects
+ * @param isFinal Set to whether the record is the last one
+ * @return Ciphertext length, tag included
+ * @throws EncryptionException if the length does not fit the container
+ */
+uint32_t recordCiphertextLength(const FileHeader& header, uint8_t* frame, bool& isFinal);
+
+/**
+ * @brief Set the final-chunk flag in a record's length prefix
+ * 
+ * @param frame At least FRAME_HEADER_SIZE bytes of a record
+ */
+void setFinalFlag(uint8_t* frame);
+
+/**
+ * @brief Clear the final-chunk flag, giving the frame Crypto::decryptChunk expects
+ * 
+ * @param frame At least FRAME_HEADER_SIZE bytes of a record
+ */
+void clearFinalFlag(uint8_t* frame);
+
+/**
+ * @brief Serialize a file header
+ * 
+ * @param header Header to serialize
+ * @param out Receives encodedHeaderSize(header) bytes
+ */
+void encodeHeader(const FileHeader& header, uint8_t* out);
+
+/**
+ * @brief Serialize the footer index
+ * 
+ * @param chunkOffsets File offset of every record
+ * @param plaintextSize Total plaintext bytes
+ * @param out Receives footerSize(chunkOffsets.size()) bytes
+ */
+void encodeFooter(const std::vector<uint64_t>& chunkOffsets, uint64_t plaintextSize, uint8_t* out);
+
+/**
+ * @brief Streams encrypted chunks into a container
+ * 
+ * Writes the header on construction, records in order, and the footer
+ * index on finish(). Only the chunk offsets are kept in memory.
+ */
+class ContainerWriter {
+public:
+    /**
+     * @brief Start a container and write its header
+     * 
+     * @param out Destination stream
+     * @param header Header to write
+     * @throws EncryptionException if the stream cannot be written
+     */
+    ContainerWriter(std::ostream& out, const FileHeader& header);
+    
+    /**
+     * @brief Append one framed chunk from Crypto::encryptChunk
+     * 
+     * @param frame Record as nonce | length | ciphertext (modified in place)
+     * @param isFinal True for the last chunk of the file
+     * @throws EncryptionException on write errors or records after the final one
+     */
+    void writeChunk(std::vector<uint8_t>& frame, bool isFinal);
+    
+    /**
+     * @brief Write the footer index
+     * 
+     * @param plaintextSize Total plaintext bytes written
+     * @throws EncryptionException if no final chunk was written or on write errors
+     */
+    void finish(uint64_t plaintextSize);
+
+private:
+    std::ostream& out_;
+    uint64_t offset_;
+    std::vector<uint64_t> chunk_offsets_;
+    bool final_written_ = false;
+};
+
+/**
+ * @brief Reads chunks back out of a container
+ * 
+ * Sequential reads only need the header, so non-seekable streams work.
+ * Random access and structural checks use the footer index.
+ */
+class ContainerReader {
+public:
+    /**
+     * @brief Read and validate the header
+     * 
+     * @param in Source stream positioned at the start of the file
+     * @throws EncryptionException if the header is missing, truncated or unsupported
+     */
+    explicit ContainerReader(std::istream& in);
+    
+    /**
+     * @return The parsed file header
+     */
+    const FileHeader& header() const { return header_; }
+    
+    /**
+     * @brief Read the next record in file order
+     * 
+     * @param frame Receives the record as nonce | length | ciphertext, with the
+     *              final-chunk flag cleared so it can go straight to decryptChunk
+     * @param isFinal Set to true when the final chunk has been read
+     * @return False once the final chunk has already been returned
+     * @throws EncryptionException if the record is truncated or malformed
+     */
+    bool readNextChunk(std::vector<uint8_t>& frame, bool& isFinal);
+    
+    /**
+     * @brief Read the trailer only (requires a seekable stream)
+     * 
+     * Leaves the stream position undefined, like readIndex().
+     * 
+     * @return Header, counts from the trailer and whether the file size fits them
+     * @throws EncryptionException if the trailer is missing or its counts are impossible
+     */
+    ContainerSummary readSummary();
+    
+    /**
+     * @brief Load and validate the footer index (requires a seekable stream)
+     * 
+     * Checks that the indexed records tile the file with plausible lengths.
+     * With checkRecords, every record header is also read to confirm its
+     * length and that only the last one is flagged final; random access
+     * skips that walk and checks each record when it reads it. Incremental
+     * containers are always walked, as that is where the record prefixes
+     * come from. Leaves the stream position undefined; use readChunkAt()
+     * afterwards.
+     * 
+     * @param checkRecords Read every record header as well as the index
+     * @return Container structure
+     * @throws EncryptionException if the structure is invalid
+     */
+    ContainerInfo readIndex(bool checkRecords = true);
+    
+    /**
+     * @brief Read a record by index (requires readIndex() first)
+     * 
+     * @param info Structure returned by readIndex()
+     * @param chunkIndex Zero-based chunk number
+     * @param frame Receives the record
+     * @throws EncryptionException if the record cannot be read
+     */
+    void readChunkAt(const ContainerInfo& info, size_t chunkIndex, std::vector<uint8_t>& frame);
+
+private:
+    std::istream& in_;
+    FileHeader header_;
+    bool final_read_ = false;
+    
+    void readRecord(std::vector<uint8_t>& frame, bool& isFinal);
+};
+
+/**
+ * Magic bytes at the start of a chunk manifest
+ */
+constexpr std::array<uint8_t, 8> MANIFEST_MAGIC = {'C', 'R', 'S', 'T', 'Y', 'M', 'A', 'N'};
+
+/**
+ * Current chunk manifest version
+ */
+constexpr uint16_t MANIFEST_VERSION = 1;
+
+/**
+ * Appended to an incremental container's path to name its manifest
+ */
+constexpr const char* MANIFEST_SUFFIX = ".manifest";
+
+/**
+ * Crypto::fingerprint() context of the MAC that closes a manifest
+ */
+constexpr uint64_t MANIFEST_MAC_CONTEXT = RECORD_MAC_CONTEXT + 1;
+
+/**
+ * Serialized sizes of a manifest's fixed fields, of one entry and of its MAC
+ * 
+ * magic, version, chunk size, chunk count, plaintext size and the
+ * container's salt; then a nonce prefix and a fingerprint per chunk.
+ */
+constexpr size_t MANIFEST_HEADER_SIZE = MANIFEST_MAGIC.size() + 2 + 4 + 8 + 8 + SALT_SIZE;
+constexpr size_t MANIFEST_ENTRY_SIZE = NONCE_PREFIX_SIZE + std::tuple_size<Fingerprint>::value;
+constexpr size_t MANIFEST_MAC_SIZE = std::tuple_size<Fingerprint>::value;
+
+/**
+ * @brief One chunk as last written by Encryptor::updateFile()
+ */
+struct ManifestEntry {
+    NoncePrefix noncePrefix{};   // Prefix the record was encrypted under
+    Fingerprint fingerprint{};   // Keyed fingerprint of the chunk's plaintext
+};
+
+/**
+ * @brief Per-chunk fingerprints kept next to an incremental container
+ * 
+ * Lets the next update tell which chunks changed from the new plaintext
+ * alone, without decrypting the container. Fingerprints are keyed with
+ * the file key and use the chunk index as context, so the manifest
+ * reveals neither the content nor which chunks are equal. A MAC under the
+ * same key closes the file, so a manifest that was tampered with or
+ * belongs to another container is not used. An entry only stands for the
+ * record whose nonce prefix it names; a record rewritten since counts as
+ * changed.
+ */
+struct ChunkManifest {
+    uint32_t chunkSize = 0;
+    uint64_t plaintextSize = 0;
+    std::array<uint8_t, SALT_SIZE> salt{};   // The container's, so manifests of other files stand out
+    std::vector<ManifestEntry> entries;
+};
+
+/**
+ * @brief Serialize a manifest, without its MAC
+ * 
+ * @param manifest Manifest to serialize
+ * @return MANIFEST_HEADER_SIZE plus MANIFEST_ENTRY_SIZE per entry bytes
+ */
+std::vector<uint8_t> encodeManifest(const ChunkManifest& manifest);
+
+/**
+ * @brief Parse a serialized manifest, without its MAC
+ * 
+ * @param data Manifest bytes, the MAC already checked and removed
+ * @param size Bytes in data
+ * @return Parsed manifest
+ * @throws EncryptionException with DataCorrupted if the manifest is malformed
+ */
+ChunkManifest decodeManifest(const uint8_t* data, size_t size);
+
+/**
+ * Magic bytes at the start of a deduplicated archive
+ * 
+ * An archive holds the files of a batch, cut at content-defined
+ * boundaries (content_chunker.h). Each distinct chunk is stored once, as
+ * a record framed like a container's, under a nonce taken from its keyed
+ * chunk ID; equal chunks therefore encrypt alike, which is what lets
+ * them be shared. An encrypted catalog after the records lists every
+ * file and its chunks, and an 8-byte offset to it plus ARCHIVE_END_MAGIC
+ * close the file.
+ */
+constexpr std::array<uint8_t, 8> ARCHIVE_MAGIC = {'C', 'R', 'S', 'T', 'Y', 'D', 'D', 'P'};
+constexpr std::array<uint8_t, 8> ARCHIVE_END_MAGIC = {'C', 'R', 'S', 'T', 'Y', 'D', 'D', 'E'};
+
+/**
+ * Current archive version
+ */
+constexpr uint16_t ARCHIVE_VERSION = 1;
+
+/**
+ * Conventional extension of deduplicated archives
+ */
+constexpr const char* ARCHIVE_EXTENSION = ".crustypack";
+
+/**
+ * Crypto::fingerprint() contexts of chunk IDs and of the seed that keys
+ * the chunk boundaries
+ */
+constexpr uint64_t CHUNK_ID_CONTEXT = RECORD_MAC_CONTEXT + 2;
+constexpr uint64_t CHUNKER_SEED_CONTEXT = RECORD_MAC_CONTEXT + 3;
+
+/**
+ * Serialized sizes of the archive header and trailer
+ * 
+ * Header: magic, version, Argon2id memory, iterations and lanes, salt,
+ * catalog nonce prefix and the largest chunk size. Trailer: catalog
+ * offset and end magic.
+ */
+constexpr size_t ARCHIVE_HEADER_SIZE = ARCHIVE_MAGIC.size() + 2 + 4 + 4 + 4 + SALT_SIZE + NONCE_PREFIX_SIZE + 4;
+constexpr size_t ARCHIVE_TRAILER_SIZE = 8 + ARCHIVE_END_MAGIC.size();
+
+/**
+ * Longest file name stored in an archive, in bytes
+ */
+constexpr size_t MAX_ARCHIVE_NAME = 4096;
+
+/**
+ * @brief Fixed fields at the start of an archive
+ */
+struct ArchiveHeader {
+    KdfParams kdf;
+    std::array<uint8_t, SALT_SIZE> salt{};
+    NoncePrefix noncePrefix{};   // For the catalog record
+    uint32_t maxChunkSize = 0;   // Chunker setting the archive was written with
+};
+
+/**
+ * @brief One distinct chunk stored in an archive
+ */
+struct StoredChunk {
+    uint64_t offset = 0;   // File offset of its record
+    uint32_t size = 0;     // Plaintext bytes
+    Fingerprint id{};      // Keyed fingerprint of the plaintext
+};
+
+/**
+ * @brief One file in an archive
+ */
+struct ArchiveEntry {
+    std::string name;              // Relative path, '/'-separated
+    uint64_t size = 0;
+    std::vector<uint64_t> chunks;  // Indices into ArchiveCatalog::chunks, in file order
+};
+
+/**
+ * @brief Decrypted table of contents of an archive
+ */
+struct ArchiveCatalog {
+    std::vector<StoredChunk> chunks;
+    std::vector<ArchiveEntry> entries;
+};
+
+/**
+ * @brief Serialize an archive header
+ * 
+ * @param header Header to serialize
+ * @param out Receives ARCHIVE_HEADER_SIZE bytes
+ */
+void encodeArchiveHeader(const ArchiveHeader& header, uint8_t* out);
+
+/**
+ * @brief Parse an archive header
+ * 
+ * @param data First bytes of the file
+ * @param size Bytes in data
+ * @return Parsed header
+ * @throws EncryptionException with DataCorrupted if the file is not an
+ *         archive, its version is unknown or its parameters are invalid
+ */
+ArchiveHeader decodeArchiveHeader(const uint8_t* data, size_t size);
+
+/**
+ * @brief Serialize the archive trailer
+ * 
+ * @param catalogOffset File offset of the catalog record
+ * @param out Receives ARCHIVE_TRAILER_SIZE bytes
+ */
+void encodeArchiveTrailer(uint64_t catalogOffset, uint8_t* out);
+
+/**
+ * @brief Parse the archive trailer
+ * 
+ * @param data Last ARCHIVE_TRAILER_SIZE bytes of the file
+ * @param fileSize Total size of the archive
+ * @return File offset of the catalog record
+ * @throws EncryptionException with DataCorrupted if the archive is
+ *         truncated or the offset does not fit the file
+ */
+uint64_t decodeArchiveTrailer(const uint8_t* data, uint64_t fileSize);
+
+/**
+ * @brief Serialize a catalog
+ * 
+ * @param catalog Catalog to serialize
+ * @return Plaintext of the catalog record
+ */
+std::vector<uint8_t> encodeCatalog(const ArchiveCatalog& catalog);
+
+/**
+ * @brief Parse and check a decrypted catalog
+ * 
+ * Every stored chunk must lie between the header and recordsEnd, every
+ * file's chunks must add up to its size, and every name must pass
+ * validArchiveName().
+ * 
+ * @param data Plaintext of the catalog record
+ * @param size Bytes in data
+ * @param recordsEnd File offset of the catalog record
+ * @return Parsed catalog
+ * @throws EncryptionException with DataCorrupted if the catalog is malformed
+ */
+ArchiveCatalog decodeCatalog(const uint8_t* data, size_t size, uint64_t recordsEnd);
+
+/**
+ * @brief Whether a name can be stored and extracted safely
+ * 
+ * Accepts relative '/'-separated paths whose components are neither empty,
+ * "." nor "..", with no backslashes, colons or NUL bytes, so extraction
+ * cannot leave the destination directory on any platform.
+ * 
+ * @param name Name to check
+ * @return True if the name is acceptable
+ */
+bool validArchiveName(std::string_view name);
+
+/**
+ * @brief Nonce of a stored chunk
+ * 
+ * The first 12 bytes of its ID; the ID is a keyed MAC, so nonces
+ * of different chunks collide no more often than random ones would.
+ * 
+ * @param id Chunk ID
+ * @return Nonce for the chunk's record
+ */
+ChunkNonce chunkNonce(const Fingerprint& id);
+
+/**
+ * @brief Nonce of the catalog record
+ * 
+ * @param header Archive header
+ * @return The header's prefix followed by an all-ones index, flagged final
+ */
+ChunkNonce catalogNonce(const ArchiveHeader& header);
+
+/**
+ * @brief Write a file header
+ * 
+ * @param out Destination stream
+ * @param header Header to serialize
+ * @throws EncryptionException if the stream cannot be written
+ */
+void writeHeader(std::ostream& out, const FileHeader& header);
+
+/**
+ * @brief Read the length of a file header from its start
+ * 
+ * @param data First HEADER_SIZE bytes of the file
+ * @return Stored header length, between HEADER_SIZE and the largest readers accept
+ * @throws EncryptionException if the bytes do not start a supported container
+ */
+size_t storedHeaderSize(const uint8_t* data);
+
+/**
+ * @brief Parse and validate a file header held in memory
+ * 
+ * @param data Start of the file
+ * @param size Bytes available, at least the stored header length
+ * @return Parsed header
+ * @throws EncryptionException if the header is truncated or unsupported
+ */
+FileHeader decodeHeader(const uint8_t* data, size_t size);
+
+/**
+ * @brief Read and validate a file header
+ * 
+ * @param in Source stream positioned at the start of the file
+ * @return Parsed header
+ * @throws EncryptionException if the header is missing, truncated or unsupported
+ */
+FileHeader readHeader(std::istream& in);
+
+} // namespace container
+} // namespace crusty
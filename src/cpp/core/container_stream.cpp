@@ -0,0 +1,371 @@
+#include "container_stream.h"
+#include "chunk_pipeline.h"
+#include "encryptor.h"
+#include "secure_buffer_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace crusty {
+
+namespace {
+
+[[noreturn]] void corrupted(const std::string& message) {
+    throw EncryptionException(message, CryptoErrorCode::DataCorrupted);
+}
+
+[[noreturn]] void unusable() {
+    throw EncryptionException("Stream cannot be used after an error", CryptoErrorCode::InternalError);
+}
+
+void throwIfCancelled(const CancellationToken* token) {
+    if (token) {
+        token->throwIfCancelled();
+    }
+}
+
+} // anonymous namespace
+
+//
+// EncryptStream implementation
+//
+
+EncryptStream::EncryptStream(Encryptor& engine, container::FileHeader header, std::shared_ptr<const SecureKey> key,
+                             CompressionSettings settings, std::shared_ptr<secure::SecureBufferPool> pool)
+    : engine_(engine),
+      header_(std::move(header)),
+      key_(std::move(key)),
+      settings_(settings),
+      pool_(std::move(pool)),
+      recorder_(engine.stats_.get(), EncryptorStats::Operation::Encrypt),
+      prefix_size_(header_.compression != Compression::None ? container::CHUNK_PREFIX_SIZE : 0) {
+    // The header is the first thing read out
+    output_.resize(container::encodedHeaderSize(header_));
+    container::encodeHeader(header_, output_.data());
+    offset_ = output_.size();
+    recorder_.addBytes(0, offset_);
+    
+    chunk_ = pool_->acquire(container::recordSize(prefix_size_ + header_.chunkSize));
+}
+
+EncryptStream::~EncryptStream() {
+    pool_->release(std::move(chunk_));
+    pool_->release(std::move(output_));
+}
+
+size_t EncryptStream::write(const uint8_t* data, size_t size) {
+    if (failed_) {
+        unusable();
+    }
+    if (finishing_) {
+        throw EncryptionException("Stream written after finish()", CryptoErrorCode::InternalError);
+    }
+    
+    size_t taken = 0;
+    try {
+        while (taken < size) {
+            // A full chunk is sealed once more plaintext shows it is not the
+            // last, and only when its record has somewhere to go
+            if (chunk_filled_ == header_.chunkSize) {
+                if (pending() > 0) {
+                    break;
+                }
+                seal(false);
+            }
+            
+            size_t count = std::min<size_t>(size - taken, header_.chunkSize - chunk_filled_);
+            std::memcpy(chunk_.data() + container::FRAME_HEADER_SIZE + prefix_size_ + chunk_filled_, data + taken, count);
+            chunk_filled_ += count;
+            taken += count;
+        }
+    } catch (...) {
+        failed_ = true;
+        throw;
+    }
+    plaintext_size_ += taken;
+    return taken;
+}
+
+size_t EncryptStream::read(uint8_t* buffer, size_t size) {
+    if (failed_) {
+        unusable();
+    }
+    
+    size_t copied = 0;
+    try {
+        while (copied < size) {
+            if (pending() == 0) {
+                if (!finishing_ || footer_written_) {
+                    break;
+                }
+                if (!final_sealed_) {
+                    seal(true);
+                } else {
+                    writeFooter();
+                }
+                continue;
+            }
+            
+            size_t count = std::min(pending(), size - copied);
+            std::memcpy(buffer + copied, output_.data() + output_offset_, count);
+            output_offset_ += count;
+            copied += count;
+        }
+    } catch (...) {
+        failed_ = true;
+        throw;
+    }
+    return copied;
+}
+
+void EncryptStream::finish() {
+    finishing_ = true;
+}
+
+bool EncryptStream::done() const {
+    return footer_written_ && pending() == 0;
+}
+
+void EncryptStream::seal(bool isFinal) {
+    throwIfCancelled(engine_.cancellationToken());
+    
+    chunk_.resize(container::recordSize(prefix_size_ + chunk_filled_));
+    PipelineChunk chunk{chunk_offsets_.size(), isFinal, std::move(chunk_), 0, chunk_filled_};
+    try {
+        engine_.sealRecord(chunk, *key_, header_, settings_, recorder_);
+    } catch (...) {
+        // Still the plaintext if sealing failed
+        pool_->release(std::move(chunk.data));
+        throw;
+    }
+    if (isFinal) {
+        container::setFinalFlag(chunk.data.data());
+        final_sealed_ = true;
+    } else {
+        chunk_ = pool_->acquire(container::recordSize(prefix_size_ + header_.chunkSize));
+    }
+    chunk_filled_ = 0;
+    
+    chunk_offsets_.push_back(offset_);
+    offset_ += chunk.data.size();
+    recorder_.addChunk(chunk.inputSize, chunk.data.size());
+    
+    pool_->release(std::move(output_));
+    output_ = std::move(chunk.data);
+    output_offset_ = 0;
+}
+
+void EncryptStream::writeFooter() {
+    std::vector<uint8_t> footer(container::footerSize(chunk_offsets_.size()));
+    container::encodeFooter(chunk_offsets_, plaintext_size_, footer.data());
+    recorder_.addBytes(0, footer.size());
+    
+    pool_->release(std::move(output_));
+    output_ = std::move(footer);
+    output_offset_ = 0;
+    footer_written_ = true;
+    recorder_.succeed();
+}
+
+//
+// DecryptStream implementation
+//
+
+DecryptStream::DecryptStream(Encryptor& engine, secure::SecureView password,
+                             std::shared_ptr<secure::SecureBufferPool> pool)
+    : engine_(engine),
+      password_(std::make_unique<secure::SecureData<std::string>>(
+          std::string(reinterpret_cast<const char*>(password.data()), password.size()))),
+      pool_(std::move(pool)),
+      recorder_(engine.stats_.get(), EncryptorStats::Operation::Decrypt) {
+}
+
+DecryptStream::~DecryptStream() {
+    pool_->release(std::move(record_));
+    pool_->release(std::move(output_));
+}
+
+size_t DecryptStream::write(const uint8_t* data, size_t size) {
+    if (failed_) {
+        unusable();
+    }
+    
+    size_t taken = 0;
+    try {
+        while (taken < size) {
+            size_t count = 0;
+            switch (part_) {
+                case Part::Header:
+                    count = takeHeader(data + taken, size - taken);
+                    break;
+                case Part::Record:
+                    // A whole record is opened once its plaintext has somewhere to go
+                    if (recordComplete()) {
+                        if (pending() > 0) {
+                            return taken;
+                        }
+                        open();
+                        continue;
+                    }
+                    count = takeRecord(data + taken, size - taken);
+                    break;
+                case Part::Footer:
+                    count = takeFooter(data + taken, size - taken);
+                    break;
+                case Part::End:
+                    corrupted("Data follows the end of the encrypted file");
+            }
+            offset_ += count;
+            taken += count;
+        }
+    } catch (...) {
+        failed_ = true;
+        throw;
+    }
+    return taken;
+}
+
+size_t DecryptStream::read(uint8_t* buffer, size_t size) {
+    if (failed_) {
+        unusable();
+    }
+    
+    size_t copied = 0;
+    try {
+        while (copied < size) {
+            if (pending() == 0) {
+                if (part_ != Part::Record || !recordComplete()) {
+                    break;
+                }
+                open();
+                continue;
+            }
+            
+            size_t count = std::min(pending(), size - copied);
+            std::memcpy(buffer + copied, output_.data() + output_offset_, count);
+            output_offset_ += count;
+            copied += count;
+        }
+    } catch (...) {
+        failed_ = true;
+        throw;
+    }
+    return copied;
+}
+
+void DecryptStream::finish() {
+    switch (part_) {
+        case Part::Header:
+            corrupted(header_bytes_.size() < container::HEADER_SIZE ? "File is too short to contain a header"
+                                                                    : "File header is truncated");
+        case Part::Record:
+            corrupted(recordComplete() && record_final_ ? "Chunk index is missing"
+                                                        : "Encrypted file is truncated (final chunk missing)");
+        case Part::Footer:
+            corrupted("Chunk index is truncated");
+        case Part::End:
+            recorder_.succeed();
+            break;
+    }
+}
+
+bool DecryptStream::done() const {
+    return part_ == Part::End && pending() == 0;
+}
+
+size_t DecryptStream::takeHeader(const uint8_t* data, size_t size) {
+    // The fixed fields say how long the whole header is
+    size_t wanted = header_bytes_.size() < container::HEADER_SIZE ? container::HEADER_SIZE
+                  : container::storedHeaderSize(header_bytes_.data());
+    size_t count = std::min(size, wanted - header_bytes_.size());
+    header_bytes_.insert(header_bytes_.end(), data, data + count);
+    if (header_bytes_.size() < container::HEADER_SIZE ||
+        header_bytes_.size() < container::storedHeaderSize(header_bytes_.data())) {
+        return count;
+    }
+    
+    header_ = container::decodeHeader(header_bytes_.data(), header_bytes_.size());
+    key_ = recorder_.time(EncryptorStats::Phase::Kdf, [&] { return engine_.containerKey(*password_, header_); });
+    password_.reset();
+    recorder_.addBytes(header_bytes_.size(), 0);
+    
+    frame_size_ = container::recordSize(container::maxRecordPlaintext(header_));
+    record_ = pool_->acquire(frame_size_);
+    part_ = Part::Record;
+    return count;
+}
+
+size_t DecryptStream::takeRecord(const uint8_t* data, size_t size) {
+    if (record_filled_ == 0) {
+        chunk_offsets_.push_back(offset_);
+    }
+    
+    // Records are self-delimiting: the frame header gives the length of the rest
+    size_t wanted = record_size_ != 0 ? record_size_ : container::FRAME_HEADER_SIZE;
+    size_t count = std::min(size, wanted - record_filled_);
+    std::memcpy(record_.data() + record_filled_, data, count);
+    record_filled_ += count;
+    if (record_size_ == 0 && record_filled_ == container::FRAME_HEADER_SIZE) {
+        record_size_ = container::FRAME_HEADER_SIZE +
+                       container::recordCiphertextLength(header_, record_.data(), record_final_);
+    }
+    return count;
+}
+
+size_t DecryptStream::takeFooter(const uint8_t* data, size_t size) {
+    size_t wanted = container::footerSize(chunk_offsets_.size());
+    size_t count = std::min(size, wanted - footer_.size());
+    footer_.insert(footer_.end(), data, data + count);
+    if (footer_.size() < wanted) {
+        return count;
+    }
+    
+    // Nothing reads the index here, but a container whose index does not
+    // match its records was damaged or put together from pieces
+    std::vector<uint8_t> expected(wanted);
+    container::encodeFooter(chunk_offsets_, plaintext_size_, expected.data());
+    if (footer_ != expected) {
+        corrupted("Chunk index does not match the encrypted chunks");
+    }
+    recorder_.addBytes(wanted, 0);
+    part_ = Part::End;
+    return count;
+}
+
+void DecryptStream::open() {
+    throwIfCancelled(engine_.cancellationToken());
+    
+    if (container::isIncremental(header_)) {
+        prefixes_.push_back(container::framePrefix(record_.data()));
+    }
+    record_.resize(record_size_);
+    PipelineChunk chunk{chunk_offsets_.size() - 1, record_final_, std::move(record_), 0, record_size_};
+    try {
+        engine_.openRecord(chunk, *key_, header_, recorder_);
+        
+        // The last plaintext is held back until no record can have been swapped
+        if (record_final_) {
+            container::checkRecordPrefixes(*engine_.crypto_, *key_, header_, prefixes_);
+        }
+    } catch (...) {
+        pool_->release(std::move(chunk.data));
+        throw;
+    }
+    
+    size_t plaintextSize = chunk.data.size() - chunk.offset;
+    recorder_.addChunk(chunk.inputSize, plaintextSize);
+    plaintext_size_ += plaintextSize;
+    record_filled_ = 0;
+    record_size_ = 0;
+    if (record_final_) {
+        part_ = Part::Footer;
+    } else {
+        record_ = pool_->acquire(frame_size_);
+    }
+    
+    pool_->release(std::move(output_));
+    output_ = std::move(chunk.data);
+    output_offset_ = chunk.offset;
+}
+
+} // namespace crusty
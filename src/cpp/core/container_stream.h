@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "container_format.h"
+#include "encryptor_stats.h"
+
+namespace crusty {
+
+class Encryptor;
+class SecureKey;
+
+namespace secure {
+class SecureBufferPool;
+}
+
+/**
+ * @brief Encrypts data pushed in memory into the container format
+ * 
+ * Opened by Encryptor::openEncryptStream(), for data that never touches
+ * the filesystem, such as a socket or an HTTP body. Plaintext goes in with
+ * write(), the container comes out with read(), and finish() ends the
+ * plaintext. The bytes read are exactly what encryptFile() would write
+ * for the same plaintext and settings.
+ * 
+ * At most one chunk of plaintext and one record of output are buffered:
+ * write() takes no more once a full chunk is waiting for its record to be
+ * read, so callers alternate the two, like partial writes to a socket.
+ * Chunks are sealed on the calling thread. Buffers are pooled and wiped
+ * when they are reused or the stream is destroyed.
+ * 
+ * Not thread-safe. The Encryptor that opened the stream must outlive it.
+ */
+class EncryptStream {
+public:
+    /**
+     * @brief Start a container
+     * 
+     * @param engine Engine sealing the chunks
+     * @param header Header with the key derivation recorded in it
+     * @param key File key
+     * @param settings Compression of the chunks
+     * @param pool Pool for chunk buffers
+     */
+    EncryptStream(Encryptor& engine, container::FileHeader header, std::shared_ptr<const SecureKey> key,
+                  CompressionSettings settings, std::shared_ptr<secure::SecureBufferPool> pool);
+    
+    /**
+     * @brief Wipe the buffered plaintext and output
+     */
+    ~EncryptStream();
+    
+    /**
+     * @brief Append plaintext
+     * 
+     * @param data Plaintext
+     * @param size Bytes in data
+     * @return Bytes taken; less than size when the pending output has to
+     *         be read first
+     * @throws EncryptionException if the stream was finished or a chunk
+     *         cannot be sealed
+     * @throws OperationCancelled if the engine's cancellation token is cancelled
+     */
+    size_t write(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Take container bytes that are ready
+     * 
+     * @param buffer Destination
+     * @param size Space in buffer
+     * @return Bytes copied; 0 when more plaintext, finish(), or nothing
+     *         (see done()) is needed
+     * @throws EncryptionException if the final chunk cannot be sealed
+     * @throws OperationCancelled if the engine's cancellation token is cancelled
+     */
+    size_t read(uint8_t* buffer, size_t size);
+    
+    /**
+     * @brief End the plaintext
+     * 
+     * The final record and the footer index follow with read().
+     */
+    void finish();
+    
+    /**
+     * @return True once finish() was called and the whole container read
+     */
+    bool done() const;
+    
+    /**
+     * @return Plaintext bytes taken so far
+     */
+    uint64_t plaintextSize() const { return plaintext_size_; }
+    
+    // Prevent copying
+    EncryptStream(const EncryptStream&) = delete;
+    EncryptStream& operator=(const EncryptStream&) = delete;
+
+private:
+    size_t pending() const { return output_.size() - output_offset_; }
+    void seal(bool isFinal);
+    void writeFooter();
+    
+    Encryptor& engine_;
+    container::FileHeader header_;
+    std::shared_ptr<const SecureKey> key_;
+    CompressionSettings settings_;
+    std::shared_ptr<secure::SecureBufferPool> pool_;
+    OperationRecorder recorder_;
+    size_t prefix_size_ = 0;   // Chunk prefix of compressed containers
+    
+    // Plaintext of the next chunk, laid out for sealing in place
+    std::vector<uint8_t> chunk_;
+    size_t chunk_filled_ = 0;
+    
+    // Header, record or footer being read out
+    std::vector<uint8_t> output_;
+    size_t output_offset_ = 0;
+    
+    uint64_t plaintext_size_ = 0;
+    uint64_t offset_ = 0;   // Container bytes produced so far
+    std::vector<uint64_t> chunk_offsets_;
+    bool finishing_ = false;
+    bool final_sealed_ = false;
+    bool footer_written_ = false;
+    bool failed_ = false;
+};
+
+/**
+ * @brief Decrypts a container pushed in memory
+ * 
+ * Opened by Encryptor::openDecryptStream(). Container bytes go in with
+ * write(), in pieces of any size; the plaintext comes out with read(),
+ * and finish() confirms the container ended. The key is derived from the
+ * header as soon as it has arrived, inside that write().
+ * 
+ * Buffers one record of input and one chunk of plaintext, with the same
+ * alternation of write() and read() as EncryptStream. Every chunk is
+ * authenticated before read() returns any of it, but the container is
+ * only known to be complete, and nothing to have been cut off its end,
+ * once finish() returns; callers must discard the plaintext if it throws.
+ * 
+ * Not thread-safe. The Encryptor that opened the stream must outlive it.
+ */
+class DecryptStream {
+public:
+    /**
+     * @brief Wait for a container's header
+     * 
+     * @param engine Engine deriving the key and opening the chunks
+     * @param password Password the container was encrypted with; kept
+     *                 until the header has arrived
+     * @param pool Pool for chunk buffers
+     */
+    DecryptStream(Encryptor& engine, secure::SecureView password, std::shared_ptr<secure::SecureBufferPool> pool);
+    
+    /**
+     * @brief Wipe the buffered records, plaintext and password
+     */
+    ~DecryptStream();
+    
+    /**
+     * @brief Append container bytes
+     * 
+     * @param data Container bytes
+     * @param size Bytes in data
+     * @return Bytes taken; less than size when the pending plaintext has
+     *         to be read first
+     * @throws EncryptionException if the container is malformed, the
+     *         password is wrong, a chunk fails authentication, this build
+     *         cannot decompress it, or data follows its end
+     * @throws OperationCancelled if the engine's cancellation token is cancelled
+     */
+    size_t write(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Take plaintext that is ready
+     * 
+     * @param buffer Destination
+     * @param size Space in buffer
+     * @return Bytes copied; 0 when more container bytes are needed or the
+     *         plaintext has all been read
+     * @throws EncryptionException as for write()
+     * @throws OperationCancelled if the engine's cancellation token is cancelled
+     */
+    size_t read(uint8_t* buffer, size_t size);
+    
+    /**
+     * @brief Confirm that the whole container was written
+     * 
+     * @throws EncryptionException with DataCorrupted if the container is
+     *         incomplete or its footer index does not match its records
+     */
+    void finish();
+    
+    /**
+     * @return True once the whole container was written and its plaintext read
+     */
+    bool done() const;
+    
+    /**
+     * @return Plaintext bytes produced so far
+     */
+    uint64_t plaintextSize() const { return plaintext_size_; }
+    
+    // Prevent copying
+    DecryptStream(const DecryptStream&) = delete;
+    DecryptStream& operator=(const DecryptStream&) = delete;
+
+private:
+    enum class Part { Header, Record, Footer, End };
+    
+    size_t pending() const { return output_.size() - output_offset_; }
+    size_t takeHeader(const uint8_t* data, size_t size);
+    size_t takeRecord(const uint8_t* data, size_t size);
+    size_t takeFooter(const uint8_t* data, size_t size);
+    bool recordComplete() const { return record_size_ != 0 && record_filled_ == record_size_; }
+    void open();
+    
+    Encryptor& engine_;
+    std::unique_ptr<secure::SecureData<std::string>> password_;   // Until the key is derived
+    std::shared_ptr<secure::SecureBufferPool> pool_;
+    OperationRecorder recorder_;
+    Part part_ = Part::Header;
+    
+    std::vector<uint8_t> header_bytes_;
+    container::FileHeader header_;
+    std::shared_ptr<const SecureKey> key_;
+    size_t frame_size_ = 0;   // Largest record of the container
+    
+    // Record being written in; its size is known once its frame header is
+    std::vector<uint8_t> record_;
+    size_t record_filled_ = 0;
+    size_t record_size_ = 0;
+    bool record_final_ = false;
+    
+    // Plaintext of the record opened last
+    std::vector<uint8_t> output_;
+    size_t output_offset_ = 0;
+    
+    std::vector<uint8_t> footer_;
+    uint64_t plaintext_size_ = 0;
+    uint64_t offset_ = 0;   // Container bytes taken so far
+    std::vector<uint64_t> chunk_offsets_;
+    std::vector<container::NoncePrefix> prefixes_;
+    bool failed_ = false;
+};
+
+} // namespace crusty
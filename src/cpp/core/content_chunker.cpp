@@ -0,0 +1,69 @@
+#include "content_chunker.h"
+
+#include <algorithm>
+
+namespace crusty {
+
+namespace {
+
+// Mask over the top bits, which carry the most recent bytes of the window
+uint64_t topBits(unsigned bits) {
+    return bits == 0 ? 0 : ~uint64_t{0} << (64 - std::min(bits, 63u));
+}
+
+// SplitMix64: a full-period generator whose outputs are well mixed
+uint64_t nextGear(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+} // anonymous namespace
+
+ContentChunker::ContentChunker(uint64_t seed, size_t maxSize)
+    : max_size_(std::max<size_t>(maxSize, 1)) {
+    for (uint64_t& value : gear_) {
+        value = nextGear(seed);
+    }
+    
+    unsigned bits = 0;
+    while ((size_t{2} << bits) <= max_size_ / 4) {
+        ++bits;
+    }
+    average_size_ = size_t{1} << bits;
+    min_size_ = average_size_ / 4;
+    
+    // Normalization level 2: two bits harder before the average, two easier after
+    mask_small_ = topBits(bits + 2);
+    mask_large_ = topBits(bits > 2 ? bits - 2 : 0);
+}
+
+size_t ContentChunker::cut(const uint8_t* data, size_t size) const {
+    if (size <= min_size_) {
+        return size;
+    }
+    
+    // Cut points below the minimum are skipped without hashing. The loop
+    // stays scalar: AVX2 and AVX-512 versions need a gather per step for the
+    // gear lookups and measured no faster, slower where gathers are microcoded
+    size_t end = std::min(size, max_size_);
+    size_t normal = std::min(end, average_size_);
+    uint64_t hash = 0;
+    size_t i = min_size_;
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + gear_[data[i]];
+        if ((hash & mask_small_) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < end; ++i) {
+        hash = (hash << 1) + gear_[data[i]];
+        if ((hash & mask_large_) == 0) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+} // namespace crusty
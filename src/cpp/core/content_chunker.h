@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace crusty {
+
+/**
+ * @brief Content-defined chunk boundaries (FastCDC)
+ * 
+ * Cuts data where a rolling gear hash over the last 64 bytes hits a mask,
+ * so boundaries follow the content: inserting or removing bytes moves the
+ * cut points of the chunks around the edit only, and equal runs of data
+ * in different files are cut alike. Normalized chunking uses a stricter
+ * mask before the average size and a looser one after it, which keeps
+ * most chunks close to the average.
+ * 
+ * The gear table is generated from a seed; deduplicated archives derive
+ * it from the key, so chunk sizes do not reveal known content.
+ */
+class ContentChunker {
+public:
+    /**
+     * @brief Set up the chunker
+     * 
+     * Chunks average a quarter of maxSize, rounded down to a power of two,
+     * and are at least a quarter of that average.
+     * 
+     * @param seed Seed of the gear table
+     * @param maxSize Largest chunk
+     */
+    ContentChunker(uint64_t seed, size_t maxSize);
+    
+    /**
+     * @brief Find the end of the next chunk
+     * 
+     * @param data Unchunked data; at least maxSize() bytes unless it runs
+     *        to the end of the input
+     * @param size Bytes in data
+     * @return Length of the chunk starting at data, at most maxSize()
+     */
+    size_t cut(const uint8_t* data, size_t size) const;
+    
+    size_t minSize() const { return min_size_; }
+    size_t averageSize() const { return average_size_; }
+    size_t maxSize() const { return max_size_; }
+
+private:
+    std::array<uint64_t, 256> gear_{};
+    size_t min_size_ = 0;
+    size_t average_size_ = 0;
+    size_t max_size_ = 0;
+    uint64_t mask_small_ = 0;   // Before the average size
+    uint64_t mask_large_ = 0;   // After it
+};
+
+} // namespace crusty
@@ -19,6 +19,66 @@ enum class CryptoErrorCode {
     HardwareNotAvailable = -8
 };
 
+enum class AesBackend {
+    Software = 0,
+    AesNiClmul = 1,
+    Armv8Crypto = 2
+};
+
+constexpr uint32_t CPU_FEATURE_AES = 1u << 0;
+constexpr uint32_t CPU_FEATURE_CLMUL = 1u << 1;
+constexpr uint32_t CPU_FEATURE_AVX2 = 1u << 2;
+constexpr uint32_t CPU_FEATURE_VAES = 1u << 3;
+constexpr uint32_t CPU_FEATURE_VPCLMULQDQ = 1u << 4;
+constexpr uint32_t CPU_FEATURE_AVX512F = 1u << 5;
+
+constexpr size_t FINGERPRINT_LEN = 32;
+
+/**
+ * Expanded AES-256-GCM key with its own nonce sequence, owned by Rust
+ * 
+ * Opaque; created by `create_key_handle` or `derive_key_handle` and released
+ * with `destroy_key_handle`, which zeroizes the key schedule.
+ */
+struct crusty_key;
+typedef crusty_key crusty_key_t;
+
+/**
+ * One message of an `encrypt_batch_with_key` or `decrypt_batch_with_key` call
+ */
+struct CryptoBatchItem {
+    const uint8_t* input_ptr;
+    size_t input_len;
+    uint8_t* output_ptr;
+    size_t output_max_len;
+    size_t output_len;
+    int32_t status;
+};
+
+/**
+ * Time and call count of one phase, as reported by `get_crypto_profile`
+ */
+struct CryptoPhaseStats {
+    uint64_t calls;
+    uint64_t nanos;
+};
+
+/**
+ * Per-phase timings collected when Rust is built with the `profiling` feature
+ */
+struct CryptoProfile {
+    CryptoPhaseStats kdf;
+    CryptoPhaseStats cipher_init;
+    CryptoPhaseStats aead;
+    CryptoPhaseStats copy_out;
+};
+
+/**
+ * Called at the start (`begin` = 1) and end (`begin` = 0) of a phase, with
+ * the phase's index in `CryptoProfile`
+ */
+typedef void (*CryptoTraceCallback)(uint32_t phase, uint8_t begin);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -93,6 +153,345 @@ int32_t derive_key_from_password(
     uint8_t* key_ptr, size_t key_len
 );
 
+/**
+ * Derives an encryption key from a password and salt with explicit Argon2id costs
+ * 
+ * # Safety
+ * 
+ * This function is unsafe because it dereferences raw pointers.
+ * The caller must ensure that:
+ * - `password_ptr` points to a valid buffer of at least `password_len` bytes
+ * - `salt_ptr` points to a valid buffer of at least `salt_len` bytes
+ * - `key_ptr` points to a buffer of at least `key_len` bytes
+ */
+int32_t derive_key_with_params(
+    const uint8_t* password_ptr, size_t password_len,
+    const uint8_t* salt_ptr, size_t salt_len,
+    uint32_t memory_kib, uint32_t iterations, uint32_t parallelism,
+    uint8_t* key_ptr, size_t key_len
+);
+
+/**
+ * Fills a buffer with bytes from the operating system CSPRNG
+ * 
+ * # Safety
+ * 
+ * The caller must ensure that `buffer_ptr` points to a buffer of at least `buffer_len` bytes
+ */
+int32_t fill_random_bytes(uint8_t* buffer_ptr, size_t buffer_len);
+
+/**
+ * Encrypts data using AES-256-GCM with an already derived 32-byte key
+ * 
+ * Encryption happens directly in the output buffer, which may overlap the input.
+ * 
+ * # Safety
+ * 
+ * This function is unsafe because it dereferences raw pointers.
+ * The caller must ensure that:
+ * - `data_ptr` points to a valid buffer of at least `data_len` bytes
+ * - `key_ptr` points to a valid buffer of at least `key_len` bytes
+ * - `output_ptr` points to a buffer of at least `output_max_len` bytes
+ * - `output_len` points to a valid `size_t`
+ */
+int32_t encrypt_with_key(
+    const uint8_t* data_ptr, size_t data_len,
+    const uint8_t* key_ptr, size_t key_len,
+    uint8_t* output_ptr, size_t output_max_len,
+    size_t* output_len
+);
+
+/**
+ * Encrypts a chunk in place using an already derived 32-byte key
+ * 
+ * The plaintext must already sit at offset 16 of the buffer; the nonce, length
+ * prefix and tag are written around it.
+ * 
+ * # Safety
+ * 
+ * This function is unsafe because it dereferences raw pointers.
+ * The caller must ensure that:
+ * - `buffer_ptr` points to a valid buffer of at least `buffer_len` bytes
+ * - `key_ptr` points to a valid buffer of at least `key_len` bytes
+ * - `output_len` points to a valid `size_t`
+ */
+int32_t encrypt_in_place_with_key(
+    uint8_t* buffer_ptr, size_t buffer_len,
+    size_t plaintext_len,
+    const uint8_t* key_ptr, size_t key_len,
+    size_t* output_len
+);
+
+/**
+ * Decrypts a frame produced by `encrypt_with_key` using an already derived key
+ * 
+ * The plaintext is wiped again if the tag does not verify.
+ * 
+ * # Safety
+ * 
+ * This function is unsafe because it dereferences raw pointers.
+ * The caller must ensure that:
+ * - `data_ptr` points to a valid buffer of at least `data_len` bytes
+ * - `key_ptr` points to a valid buffer of at least `key_len` bytes
+ * - `output_ptr` points to a buffer of at least `output_max_len` bytes
+ *   that does not overlap the input
+ * - `output_len` points to a valid `size_t`
+ */
+int32_t decrypt_with_key(
+    const uint8_t* data_ptr, size_t data_len,
+    const uint8_t* key_ptr, size_t key_len,
+    uint8_t* output_ptr, size_t output_max_len,
+    size_t* output_len
+);
+
+/**
+ * Encrypts many messages under one key in a single call
+ * 
+ * Each message becomes a frame in the same format as `encrypt_with_key`. The
+ * cipher is set up once per call and nonces are drawn from the OS RNG a block
+ * at a time. Every item gets its own `status`; returns `Success` if every
+ * message was encrypted, otherwise the status of the first item that failed.
+ * 
+ * # Safety
+ * 
+ * This function is unsafe because it dereferences raw pointers.
+ * The caller must ensure that:
+ * - `items_ptr` points to `item_count` valid `CryptoBatchItem`s
+ * - each item's input and output pointers are valid for their lengths
+ * - an item's output overlaps no other item's input or output
+ * - `key_ptr` points to a valid buffer of at least `key_len` bytes
+ */
+int32_t encrypt_batch_with_key(
+    CryptoBatchItem* items_ptr, size_t item_count,
+    const uint8_t* key_ptr, size_t key_len
+);
+
+/**
+ * Decrypts many frames under one key in a single call
+ * 
+ * A message whose tag does not verify gets `AuthenticationFailed` and its
+ * output is wiped; the other messages are still decrypted.
+ * 
+ * # Safety
+ * 
+ * This function is unsafe because it dereferences raw pointers.
+ * The caller must ensure that:
+ * - `items_ptr` points to `item_count` valid `CryptoBatchItem`s
+ * - each item's input and output pointers are valid for their lengths
+ * - no output overlaps any input or other output
+ * - `key_ptr` points to a valid buffer of at least `key_len` bytes
+ */
+int32_t decrypt_batch_with_key(
+    CryptoBatchItem* items_ptr, size_t item_count,
+    const uint8_t* key_ptr, size_t key_len
+);
+
+/**
+ * Creates a key handle from an already derived 32-byte key
+ * 
+ * # Safety
+ * 
+ * This function is unsafe because it dereferences raw pointers.
+ * The caller must ensure that:
+ * - `key_ptr` points to a valid buffer of at least `key_len` bytes
+ * - `handle_out` points to a valid handle pointer
+ */
+int32_t create_key_handle(
+    const uint8_t* key_ptr, size_t key_len,
+    crusty_key_t** handle_out
+);
+
+/**
+ * Derives a key from a password and salt with Argon2id straight into a handle
+ * 
+ * The derived key bytes only exist inside this call and are wiped before it
+ * returns.
+ * 
+ * # Safety
+ * 
+ * This function is unsafe because it dereferences raw pointers.
+ * The caller must ensure that:
+ * - `password_ptr` points to a valid buffer of at least `password_len` bytes
+ * - `salt_ptr` points to a valid buffer of at least `salt_len` bytes
+ * - `handle_out` points to a valid handle pointer
+ */
+int32_t derive_key_handle(
+    const uint8_t* password_ptr, size_t password_len,
+    const uint8_t* salt_ptr, size_t salt_len,
+    uint32_t memory_kib, uint32_t iterations, uint32_t parallelism,
+    crusty_key_t** handle_out
+);
+
+/**
+ * Destroys a key handle, zeroizing its key schedule
+ * 
+ * # Safety
+ * 
+ * `handle` must be null or a live handle that is not used again.
+ */
+void destroy_key_handle(crusty_key_t* handle);
+
+/**
+ * Encrypts data with a key handle into a new frame
+ * 
+ * Produces the same frame as `encrypt_with_key`, with the nonce taken from the
+ * handle's sequence. The output buffer may overlap the input.
+ */
+int32_t encrypt_with_handle(
+    const crusty_key_t* handle,
+    const uint8_t* data_ptr, size_t data_len,
+    uint8_t* output_ptr, size_t output_max_len,
+    size_t* output_len
+);
+
+/**
+ * Encrypts a chunk in place with a key handle
+ * 
+ * The plaintext must already sit at offset 16 of the buffer.
+ */
+int32_t encrypt_in_place_with_handle(
+    const crusty_key_t* handle,
+    uint8_t* buffer_ptr, size_t buffer_len,
+    size_t plaintext_len,
+    size_t* output_len
+);
+
+/**
+ * Decrypts a frame with a key handle
+ * 
+ * The plaintext is wiped again if the tag does not verify. The output must not
+ * overlap the input.
+ */
+int32_t decrypt_with_handle(
+    const crusty_key_t* handle,
+    const uint8_t* data_ptr, size_t data_len,
+    uint8_t* output_ptr, size_t output_max_len,
+    size_t* output_len
+);
+
+/**
+ * Decrypts a frame in place with a key handle
+ * 
+ * The tag is verified detached and the plaintext is left at offset 16 of the
+ * buffer, wiped again if the tag does not verify. Nothing is copied.
+ */
+int32_t decrypt_in_place_with_handle(
+    const crusty_key_t* handle,
+    uint8_t* buffer_ptr, size_t buffer_len,
+    size_t* output_len
+);
+
+/**
+ * Encrypts data with a key handle under a caller-chosen 12-byte nonce
+ * 
+ * Used for container chunks. The caller must never use a nonce twice under
+ * one key. Plaintext already at offset 16 of the output is encrypted in place.
+ */
+int32_t encrypt_with_nonce(
+    const crusty_key_t* handle,
+    const uint8_t* data_ptr, size_t data_len,
+    const uint8_t* nonce_ptr,
+    uint8_t* output_ptr, size_t output_max_len,
+    size_t* output_len
+);
+
+/**
+ * Decrypts a frame with a key handle, requiring the 12-byte nonce it must carry
+ * 
+ * A frame stored under any other nonce is rejected with DecryptionError.
+ */
+int32_t decrypt_with_nonce(
+    const crusty_key_t* handle,
+    const uint8_t* data_ptr, size_t data_len,
+    const uint8_t* nonce_ptr,
+    uint8_t* output_ptr, size_t output_max_len,
+    size_t* output_len
+);
+
+/**
+ * Decrypts a frame in place with a key handle, requiring its 12-byte nonce
+ * 
+ * Combines the checks of decrypt_with_nonce with decrypt_in_place_with_handle.
+ */
+int32_t decrypt_in_place_with_nonce(
+    const crusty_key_t* handle,
+    uint8_t* buffer_ptr, size_t buffer_len,
+    const uint8_t* nonce_ptr,
+    size_t* output_len
+);
+
+/**
+ * Computes a keyed fingerprint of data with a key handle
+ * 
+ * HMAC-SHA256 of `context` (64-bit big-endian) and the data under a subkey
+ * of the handle's key. Writes FINGERPRINT_LEN bytes.
+ */
+int32_t fingerprint_with_handle(
+    const crusty_key_t* handle,
+    uint64_t context,
+    const uint8_t* data_ptr, size_t data_len,
+    uint8_t* output_ptr, size_t output_len
+);
+
+/**
+ * Encrypts many messages with a key handle in a single call
+ */
+int32_t encrypt_batch_with_handle(
+    const crusty_key_t* handle,
+    CryptoBatchItem* items_ptr, size_t item_count
+);
+
+/**
+ * Decrypts many frames with a key handle in a single call
+ */
+int32_t decrypt_batch_with_handle(
+    const crusty_key_t* handle,
+    CryptoBatchItem* items_ptr, size_t item_count
+);
+
+/**
+ * Returns the AES-GCM backend used on this CPU as an `AesBackend` value
+ */
+int32_t get_aes_backend();
+
+/**
+ * Returns the detected `CPU_FEATURE_*` bits
+ */
+uint32_t get_cpu_features();
+
+/**
+ * Checks that AES-GCM runs on hardware instructions
+ * 
+ * Returns `HardwareNotAvailable` when only the software implementation can be used.
+ */
+int32_t require_hardware_aes();
+
+/**
+ * Copies the per-phase timings collected since start-up or the last reset
+ * 
+ * Returns `InternalError`, with the profile zeroed, when the library was
+ * built without the `profiling` feature.
+ * 
+ * # Safety
+ * 
+ * `profile_out` must point to a writable `CryptoProfile`.
+ */
+int32_t get_crypto_profile(CryptoProfile* profile_out);
+
+/**
+ * Sets every phase timer back to zero
+ */
+void reset_crypto_profile();
+
+/**
+ * Installs the callback each phase reports to, or removes it when null
+ * 
+ * The callback runs on the thread doing the work and must not call back
+ * into the library. Returns `InternalError` when the library was built
+ * without the `tracing` feature.
+ */
+int32_t set_trace_callback(CryptoTraceCallback callback);
+
 #ifdef __cplusplus
 }
 #endif
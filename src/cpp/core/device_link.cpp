@@ -0,0 +1,386 @@
+#include "device_link.h"
+#include "audit_log.h"
+#include "secure_utils.h"
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <string>
+
+namespace crusty {
+
+using device::Frame;
+using device::FrameType;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Makes the firmware's text console hand the UART to the binary link; the
+// leading line break ends whatever was typed before
+constexpr char LINK_COMMAND[] = "\r\nLINK\r\n";
+
+constexpr size_t READ_SIZE = 4096;
+
+void putU32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+std::chrono::milliseconds remaining(Clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+    return std::max(left, std::chrono::milliseconds(0));
+}
+
+[[noreturn]] void deviceError(const Frame& reply) {
+    auto code = reply.payload.empty() ? device::ErrorCode{} : static_cast<device::ErrorCode>(reply.payload[0]);
+    switch (code) {
+        case device::ErrorCode::AuthenticationFailed:
+            throw EncryptionException("Device could not authenticate the data", CryptoErrorCode::AuthenticationFailed);
+        case device::ErrorCode::NoKey:
+            throw EncryptionException("No key is loaded on the device", CryptoErrorCode::InternalError);
+        case device::ErrorCode::BadRequest:
+            throw EncryptionException("Device rejected the request", CryptoErrorCode::InternalError);
+        case device::ErrorCode::CryptoFailed:
+            break;
+    }
+    throw EncryptionException("Device failed to run the cipher", CryptoErrorCode::HardwareNotAvailable);
+}
+
+[[noreturn]] void unexpectedReply() {
+    throw EncryptionException("Unexpected reply from device", CryptoErrorCode::IoError);
+}
+
+} // anonymous namespace
+
+DeviceLink::DeviceLink(std::unique_ptr<DeviceTransport> transport)
+    : transport_(std::move(transport)) {
+    if (!transport_) {
+        throw EncryptionException("Device link needs a transport", CryptoErrorCode::InternalError);
+    }
+}
+
+DeviceLink::~DeviceLink() {
+    discardUnacked();
+    secure::wipe(scratch_);
+}
+
+const DeviceLink::DeviceInfo& DeviceLink::connect() {
+    connected_ = false;
+    discardUnacked();
+    parser_.reset();
+    next_seq_ = 0;
+    expected_seq_ = 0;
+    window_ = 1;
+    
+    transport_->write(reinterpret_cast<const uint8_t*>(LINK_COMMAND), sizeof(LINK_COMMAND) - 1);
+    
+    // Replies to an earlier session may still arrive; only RESET_DONE counts
+    bool reset = false;
+    std::vector<Frame> frames;
+    for (int attempt = 0; attempt < RESET_ATTEMPTS && !reset; ++attempt) {
+        sendFrame(FrameType::Reset, 0, nullptr, 0);
+        Clock::time_point deadline = Clock::now() + RESET_TIMEOUT;
+        while (!reset && Clock::now() < deadline) {
+            receive(remaining(deadline), frames);
+            reset = std::any_of(frames.begin(), frames.end(),
+                                [](const Frame& frame) { return frame.type == FrameType::ResetDone; });
+            frames.clear();
+        }
+    }
+    if (!reset) {
+        std::string errorMsg = "Device did not answer; is the CRUSTy firmware running on this port?";
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
+    }
+    
+    Frame reply;
+    request(FrameType::Hello, nullptr, 0, FrameType::Info, &reply);
+    const std::vector<uint8_t>& payload = reply.payload;
+    if (payload.size() < 6) {
+        throw EncryptionException("Device sent a malformed INFO reply", CryptoErrorCode::IoError);
+    }
+    
+    DeviceInfo info;
+    info.protocolVersion = static_cast<uint16_t>(payload[0] | (payload[1] << 8));
+    info.maxChunkSize = static_cast<size_t>(payload[2] | (payload[3] << 8));
+    info.window = payload[4];
+    info.hardwareAes = (payload[5] & device::CAPABILITY_HW_AES) != 0;
+    info.hardwareRng = (payload[5] & device::CAPABILITY_HW_RNG) != 0;
+    info.hardwareSha = (payload[5] & device::CAPABILITY_HW_SHA) != 0;
+    info.hardwarePka = (payload[5] & device::CAPABILITY_HW_PKA) != 0;
+    if (info.protocolVersion != device::PROTOCOL_VERSION) {
+        std::string errorMsg = "Device speaks link protocol version " + std::to_string(info.protocolVersion) +
+                               ", expected " + std::to_string(device::PROTOCOL_VERSION);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::HardwareNotAvailable);
+    }
+    if (info.maxChunkSize == 0 || info.maxChunkSize > device::MAX_CHUNK_SIZE || info.window == 0) {
+        throw EncryptionException("Device sent a malformed INFO reply", CryptoErrorCode::IoError);
+    }
+    
+    info_ = info;
+    window_ = std::min(info.window, device::WINDOW);
+    connected_ = true;
+    LOG_EVENT(Info, "Device link connected",
+              {"chunk_size", static_cast<uint64_t>(info_.maxChunkSize)},
+              {"window", static_cast<uint64_t>(window_)},
+              {"hardware_aes", info_.hardwareAes ? "yes" : "no"});
+    return info_;
+}
+
+void DeviceLink::setKey(const uint8_t* key, size_t size) {
+    requireConnected();
+    if (size != 16 && size != 24 && size != 32) {
+        throw EncryptionException("AES keys are 16, 24 or 32 bytes", CryptoErrorCode::InternalError);
+    }
+    request(FrameType::SetKey, key, size, FrameType::Ok);
+}
+
+void DeviceLink::clearKey() {
+    requireConnected();
+    request(FrameType::ClearKey, nullptr, 0, FrameType::Ok);
+}
+
+std::vector<uint8_t> DeviceLink::encrypt(const uint8_t* data, size_t size, const NoncePrefix& prefix,
+                                         ProgressCallback progressCallback) {
+    return transform(FrameType::Encrypt, data, size, prefix, progressCallback);
+}
+
+std::vector<uint8_t> DeviceLink::decrypt(const uint8_t* data, size_t size, const NoncePrefix& prefix,
+                                         ProgressCallback progressCallback) {
+    return transform(FrameType::Decrypt, data, size, prefix, progressCallback);
+}
+
+void DeviceLink::setCancellationToken(std::shared_ptr<const CancellationToken> token) {
+    cancellation_ = std::move(token);
+}
+
+size_t DeviceLink::encryptedSize(size_t plaintextSize) const {
+    requireConnected();
+    size_t chunks = (plaintextSize + info_.maxChunkSize - 1) / info_.maxChunkSize;
+    return plaintextSize + chunks * device::TAG_SIZE;
+}
+
+DeviceLink::Statistics DeviceLink::statistics() const {
+    Statistics stats = stats_;
+    stats.corruptFrames = parser_.corruptFrames();
+    return stats;
+}
+
+std::vector<uint8_t> DeviceLink::transform(FrameType type, const uint8_t* data, size_t size,
+                                           const NoncePrefix& prefix, const ProgressCallback& progressCallback) {
+    requireConnected();
+    bool encrypting = type == FrameType::Encrypt;
+    size_t inputChunk = encrypting ? info_.maxChunkSize : info_.maxChunkSize + device::TAG_SIZE;
+    size_t chunks = (size + inputChunk - 1) / inputChunk;
+    
+    // encrypt() never produces an empty last chunk, so it holds more than a tag
+    if (!encrypting && size % inputChunk != 0 && size % inputChunk <= device::TAG_SIZE) {
+        throw EncryptionException("Encrypted payload ends in a truncated chunk", CryptoErrorCode::DataCorrupted);
+    }
+    if (chunks > std::numeric_limits<uint32_t>::max()) {
+        throw EncryptionException("Payload has too many chunks for its nonce counter", CryptoErrorCode::InternalError);
+    }
+    
+    std::vector<uint8_t> output;
+    output.reserve(encrypting ? size + chunks * device::TAG_SIZE : size - chunks * device::TAG_SIZE);
+    
+    auto build = [&](size_t index, std::vector<uint8_t>& payload) {
+        size_t offset = index * inputChunk;
+        size_t length = std::min(inputChunk, size - offset);
+        payload.resize(device::NONCE_SIZE + length);
+        std::copy(prefix.begin(), prefix.end(), payload.begin());
+        putU32(payload.data() + NONCE_PREFIX_SIZE, static_cast<uint32_t>(index));
+        std::copy(data + offset, data + offset + length, payload.begin() + device::NONCE_SIZE);
+        return type;
+    };
+    
+    auto handle = [&](size_t index, const Frame& reply) {
+        if (reply.type == FrameType::Error) {
+            deviceError(reply);
+        }
+        size_t length = std::min(inputChunk, size - index * inputChunk);
+        size_t expected = encrypting ? length + device::TAG_SIZE : length - device::TAG_SIZE;
+        if (reply.type != FrameType::Result || reply.payload.size() != expected) {
+            unexpectedReply();
+        }
+        output.insert(output.end(), reply.payload.begin(), reply.payload.end());
+        if (progressCallback) {
+            progressCallback(static_cast<float>(index + 1) / static_cast<float>(chunks));
+        }
+    };
+    
+    try {
+        exchange(chunks, build, handle, true);
+    } catch (...) {
+        secure::wipe(output);
+        throw;
+    }
+    return output;
+}
+
+void DeviceLink::request(FrameType type, const uint8_t* payload, size_t size, FrameType expected, Frame* reply) {
+    auto build = [&](size_t, std::vector<uint8_t>& out) {
+        out.assign(payload, payload + size);
+        return type;
+    };
+    auto handle = [&](size_t, const Frame& frame) {
+        if (frame.type == FrameType::Error) {
+            deviceError(frame);
+        }
+        if (frame.type != expected) {
+            unexpectedReply();
+        }
+        if (reply) {
+            *reply = frame;
+        }
+    };
+    exchange(1, build, handle, false);
+}
+
+void DeviceLink::exchange(size_t count, const RequestBuilder& build, const ReplyHandler& handle, bool cancellable) {
+    size_t sent = 0;
+    size_t replied = 0;
+    bool cancelled = false;
+    std::exception_ptr failure;
+    int timeouts = 0;
+    Clock::time_point deadline = Clock::now() + RETRANSMIT_TIMEOUT;
+    std::vector<Frame> frames;
+    std::vector<uint8_t> payload;
+    
+    try {
+        while (replied < sent || (sent < count && !cancelled && !failure)) {
+            if (cancellable && cancellation_ && cancellation_->cancelled()) {
+                cancelled = true;
+            }
+            
+            // The device keeps its replies until acknowledged, so the window
+            // counts requests not yet answered rather than not yet acknowledged
+            while (sent < count && !cancelled && !failure && sent - replied < window_) {
+                FrameType type = build(sent, payload);
+                if (unacked_.empty()) {
+                    deadline = Clock::now() + RETRANSMIT_TIMEOUT;
+                }
+                sendFrame(type, next_seq_, payload.data(), payload.size());
+                unacked_.push_back(Unacked{type, next_seq_, payload});
+                ++next_seq_;
+                ++sent;
+            }
+            secure::wipe(payload);
+            
+            receive(remaining(deadline), frames);
+            bool ackDue = false;
+            for (const Frame& frame : frames) {
+                if (acknowledge(frame.ack)) {
+                    timeouts = 0;
+                    deadline = Clock::now() + RETRANSMIT_TIMEOUT;
+                }
+                if (!device::isMessage(frame.type)) {
+                    continue;
+                }
+                
+                // A repeat means our acknowledgement was lost
+                ackDue = true;
+                if (frame.seq != expected_seq_ || replied == sent) {
+                    continue;
+                }
+                ++expected_seq_;
+                timeouts = 0;
+                deadline = Clock::now() + RETRANSMIT_TIMEOUT;
+                try {
+                    handle(replied, frame);
+                } catch (...) {
+                    // Answers to what is already in flight are still collected
+                    if (!failure) {
+                        failure = std::current_exception();
+                    }
+                }
+                ++replied;
+            }
+            frames.clear();
+            
+            // The next request carries the acknowledgement if one goes out now
+            bool sending = sent < count && !cancelled && !failure && sent - replied < window_;
+            if (ackDue && !sending) {
+                sendFrame(FrameType::Ack, 0, nullptr, 0);
+            }
+            
+            if (Clock::now() >= deadline && replied < sent) {
+                if (++timeouts > MAX_RETRANSMITS) {
+                    throw EncryptionException("Device stopped responding", CryptoErrorCode::IoError);
+                }
+                for (const Unacked& frame : unacked_) {
+                    sendFrame(frame.type, frame.seq, frame.payload.data(), frame.payload.size());
+                    ++stats_.framesResent;
+                }
+                deadline = Clock::now() + RETRANSMIT_TIMEOUT;
+            }
+        }
+    } catch (const EncryptionException& e) {
+        // Sequence numbers are out of step now; only a reset recovers
+        connected_ = false;
+        discardUnacked();
+        secure::wipe(payload);
+        LOG_ERROR("Device link failed: " + std::string(e.what()));
+        throw;
+    }
+    
+    secure::wipe(scratch_);
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    if (cancelled) {
+        throw OperationCancelled();
+    }
+}
+
+void DeviceLink::sendFrame(FrameType type, uint16_t seq, const uint8_t* payload, size_t size) {
+    scratch_.clear();
+    device::encodeFrame(scratch_, type, seq, expected_seq_, payload, size);
+    transport_->write(scratch_.data(), scratch_.size());
+    ++stats_.framesSent;
+}
+
+void DeviceLink::receive(std::chrono::milliseconds timeout, std::vector<Frame>& frames) {
+    uint8_t buffer[READ_SIZE];
+    size_t read = transport_->read(buffer, sizeof(buffer), timeout);
+    if (read > 0) {
+        size_t before = frames.size();
+        parser_.feed(buffer, read, frames);
+        stats_.framesReceived += frames.size() - before;
+    }
+}
+
+bool DeviceLink::acknowledge(uint16_t ack) {
+    if (unacked_.empty()) {
+        return false;
+    }
+    
+    // ack is the next frame the device expects; anything outside the window is stale
+    size_t count = static_cast<uint16_t>(ack - unacked_.front().seq);
+    if (count == 0 || count > unacked_.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        secure::wipe(unacked_[i].payload);
+    }
+    unacked_.erase(unacked_.begin(), unacked_.begin() + static_cast<std::ptrdiff_t>(count));
+    return true;
+}
+
+void DeviceLink::discardUnacked() {
+    for (Unacked& frame : unacked_) {
+        secure::wipe(frame.payload);
+    }
+    unacked_.clear();
+}
+
+void DeviceLink::requireConnected() const {
+    if (!connected_) {
+        throw EncryptionException("Device is not connected", CryptoErrorCode::IoError);
+    }
+}
+
+} // namespace crusty
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "cancellation.h"
+#include "device_protocol.h"
+#include "encryptor.h"
+
+namespace crusty {
+
+/**
+ * @brief Byte stream to the device, such as a serial port
+ */
+class DeviceTransport {
+public:
+    virtual ~DeviceTransport() = default;
+    
+    /**
+     * @brief Send all bytes
+     * 
+     * @throws EncryptionException with IoError if the link fails
+     */
+    virtual void write(const uint8_t* data, size_t size) = 0;
+    
+    /**
+     * @brief Receive what has arrived, waiting up to a timeout for the first byte
+     * 
+     * @return Bytes read; 0 if nothing arrived in time
+     * @throws EncryptionException with IoError if the link fails
+     */
+    virtual size_t read(uint8_t* buffer, size_t size, std::chrono::milliseconds timeout) = 0;
+};
+
+/**
+ * @brief Offloads AES-GCM to an embedded device over device::Frame messages
+ * 
+ * Requests are pipelined: up to the device's window of chunks is in
+ * flight while earlier replies come back, so a large payload streams at
+ * close to line rate instead of waiting a round trip per chunk. Lost or
+ * damaged frames are resent (see device_protocol.h).
+ * 
+ * Payloads are split into chunks of chunkSize() bytes, each sealed under
+ * its own nonce: the 8-byte prefix given by the caller followed by the
+ * chunk index as a 32-bit little-endian counter. The output holds every
+ * chunk's ciphertext followed by its tag, so it is encryptedSize() bytes
+ * long. A prefix must not be used twice with the same key.
+ * 
+ * Not thread-safe; use one link from one thread at a time.
+ */
+class DeviceLink {
+public:
+    /**
+     * @brief What the device reported in its INFO reply
+     */
+    struct DeviceInfo {
+        uint16_t protocolVersion = 0;
+        size_t maxChunkSize = 0;
+        size_t window = 0;
+        bool hardwareAes = false;
+        bool hardwareRng = false;
+        bool hardwareSha = false;
+        bool hardwarePka = false;
+    };
+    
+    /**
+     * @brief Link counters, for diagnostics
+     */
+    struct Statistics {
+        uint64_t framesSent = 0;
+        uint64_t framesResent = 0;
+        uint64_t framesReceived = 0;
+        uint64_t corruptFrames = 0;
+    };
+    
+    static constexpr size_t NONCE_PREFIX_SIZE = device::NONCE_SIZE - 4;
+    using NoncePrefix = std::array<uint8_t, NONCE_PREFIX_SIZE>;
+    
+    /**
+     * @param transport Open byte stream to the device
+     */
+    explicit DeviceLink(std::unique_ptr<DeviceTransport> transport);
+    ~DeviceLink();
+    
+    /**
+     * @brief Bring the device into link mode and fetch its INFO
+     * 
+     * Asks the firmware's text console to switch to the binary link,
+     * then resets the link, which also clears any key on the device.
+     * Call again to recover after an IoError.
+     * 
+     * @return What the device supports
+     * @throws EncryptionException with IoError if the device does not answer,
+     *         or HardwareNotAvailable if it speaks another protocol version
+     */
+    const DeviceInfo& connect();
+    
+    /**
+     * @brief Load the key the device encrypts and decrypts with
+     * 
+     * @param key AES key
+     * @param size 16, 24 or 32
+     * @throws EncryptionException
+     */
+    void setKey(const uint8_t* key, size_t size);
+    
+    /**
+     * @brief Wipe the key on the device
+     * 
+     * @throws EncryptionException
+     */
+    void clearKey();
+    
+    /**
+     * @brief Encrypt a payload on the device
+     * 
+     * @param data Plaintext
+     * @param size Plaintext size
+     * @param prefix Nonce prefix, fresh for every payload under one key
+     * @param progressCallback Optional progress callback
+     * @return Chunk ciphertexts, each followed by its tag
+     * @throws EncryptionException, or OperationCancelled
+     */
+    std::vector<uint8_t> encrypt(const uint8_t* data, size_t size, const NoncePrefix& prefix,
+                                 ProgressCallback progressCallback = nullptr);
+    
+    /**
+     * @brief Decrypt what encrypt() produced, on a device with the same chunk size
+     * 
+     * @param data Chunk ciphertexts with their tags
+     * @param size Size of data
+     * @param prefix Nonce prefix the payload was encrypted with
+     * @param progressCallback Optional progress callback
+     * @return Plaintext
+     * @throws EncryptionException with AuthenticationFailed if a chunk does
+     *         not verify, or OperationCancelled
+     */
+    std::vector<uint8_t> decrypt(const uint8_t* data, size_t size, const NoncePrefix& prefix,
+                                 ProgressCallback progressCallback = nullptr);
+    
+    /**
+     * @brief Stop encrypt() and decrypt() early whenever a token is cancelled
+     * 
+     * Chunks already sent are still answered before OperationCancelled is
+     * thrown, so the link stays usable.
+     * 
+     * @param token Token shared with whoever cancels, or null
+     */
+    void setCancellationToken(std::shared_ptr<const CancellationToken> token);
+    
+    /**
+     * @brief Output size of encrypt() for a plaintext size
+     */
+    size_t encryptedSize(size_t plaintextSize) const;
+    
+    /**
+     * @return Chunk size payloads are split into; 0 before connect()
+     */
+    size_t chunkSize() const { return info_.maxChunkSize; }
+    
+    /**
+     * @return Device info from the last connect()
+     */
+    const DeviceInfo& info() const { return info_; }
+    
+    /**
+     * @return True after a successful connect() and no link failure since
+     */
+    bool connected() const { return connected_; }
+    
+    /**
+     * @return Link counters since construction
+     */
+    Statistics statistics() const;
+    
+    // A whole window of full frames takes about 0.4 s each way at 115200 baud
+    static constexpr std::chrono::milliseconds RETRANSMIT_TIMEOUT{1000};
+    static constexpr int MAX_RETRANSMITS = 5;
+    static constexpr std::chrono::milliseconds RESET_TIMEOUT{300};
+    static constexpr int RESET_ATTEMPTS = 5;
+    
+    // Prevent copying
+    DeviceLink(const DeviceLink&) = delete;
+    DeviceLink& operator=(const DeviceLink&) = delete;
+
+private:
+    struct Unacked {
+        device::FrameType type;
+        uint16_t seq;
+        std::vector<uint8_t> payload;
+    };
+    
+    // Builds the payload of request i
+    using RequestBuilder = std::function<device::FrameType(size_t index, std::vector<uint8_t>& payload)>;
+    // Takes the reply to request i, in order
+    using ReplyHandler = std::function<void(size_t index, const device::Frame& reply)>;
+    
+    void exchange(size_t count, const RequestBuilder& build, const ReplyHandler& handle, bool cancellable);
+    void request(device::FrameType type, const uint8_t* payload, size_t size, device::FrameType expected,
+                 device::Frame* reply = nullptr);
+    std::vector<uint8_t> transform(device::FrameType type, const uint8_t* data, size_t size,
+                                   const NoncePrefix& prefix, const ProgressCallback& progressCallback);
+    void sendFrame(device::FrameType type, uint16_t seq, const uint8_t* payload, size_t size);
+    void receive(std::chrono::milliseconds timeout, std::vector<device::Frame>& frames);
+    bool acknowledge(uint16_t ack);
+    void discardUnacked();
+    void requireConnected() const;
+    
+    std::unique_ptr<DeviceTransport> transport_;
+    device::FrameParser parser_;
+    std::shared_ptr<const CancellationToken> cancellation_;
+    DeviceInfo info_;
+    bool connected_ = false;
+    size_t window_ = 1;
+    
+    uint16_t next_seq_ = 0;         // Of our next message frame
+    uint16_t expected_seq_ = 0;     // Of the device's next message frame
+    std::vector<Unacked> unacked_;  // Oldest first
+    
+    std::vector<uint8_t> scratch_;
+    Statistics stats_;
+};
+
+} // namespace crusty
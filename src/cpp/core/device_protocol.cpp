@@ -0,0 +1,133 @@
+#include "device_protocol.h"
+#include "encryptor.h"
+
+#include <algorithm>
+
+namespace crusty {
+namespace device {
+
+namespace {
+
+void putU16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+uint16_t getU16(const uint8_t* data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+uint32_t getU32(const uint8_t* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+const std::array<uint32_t, 256>& crcTable() {
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t i = 0; i < entries.size(); ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    return table;
+}
+
+// Offsets within the header
+constexpr size_t TYPE_OFFSET = 2;
+constexpr size_t FLAGS_OFFSET = 3;
+constexpr size_t SEQ_OFFSET = 4;
+constexpr size_t ACK_OFFSET = 6;
+constexpr size_t LENGTH_OFFSET = 8;
+
+} // anonymous namespace
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    const std::array<uint32_t, 256>& table = crcTable();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void encodeFrame(std::vector<uint8_t>& out, FrameType type, uint16_t seq, uint16_t ack,
+                 const uint8_t* payload, size_t size) {
+    if (size > MAX_PAYLOAD) {
+        throw EncryptionException("Device frame payload too large", CryptoErrorCode::InternalError);
+    }
+    
+    size_t start = out.size();
+    out.reserve(start + FRAME_HEADER_SIZE + size + FRAME_CRC_SIZE);
+    out.insert(out.end(), FRAME_MAGIC.begin(), FRAME_MAGIC.end());
+    out.push_back(static_cast<uint8_t>(type));
+    out.push_back(0);
+    putU16(out, seq);
+    putU16(out, ack);
+    putU16(out, static_cast<uint16_t>(size));
+    if (size > 0) {
+        out.insert(out.end(), payload, payload + size);
+    }
+    
+    uint32_t crc = crc32(out.data() + start + FRAME_MAGIC.size(), out.size() - start - FRAME_MAGIC.size());
+    for (int shift = 0; shift < 32; shift += 8) {
+        out.push_back(static_cast<uint8_t>(crc >> shift));
+    }
+}
+
+void FrameParser::feed(const uint8_t* data, size_t size, std::vector<Frame>& frames) {
+    buffer_.insert(buffer_.end(), data, data + size);
+    
+    size_t pos = 0;
+    while (pos < buffer_.size()) {
+        // Skip to the next magic; a lone first byte at the end may be one
+        auto magic = std::search(buffer_.begin() + pos, buffer_.end(), FRAME_MAGIC.begin(), FRAME_MAGIC.end());
+        pos = static_cast<size_t>(magic - buffer_.begin());
+        if (magic == buffer_.end()) {
+            if (buffer_.back() == FRAME_MAGIC[0]) {
+                pos = buffer_.size() - 1;
+            }
+            break;
+        }
+        
+        const uint8_t* header = buffer_.data() + pos;
+        size_t available = buffer_.size() - pos;
+        if (available < FRAME_HEADER_SIZE) {
+            break;
+        }
+        size_t length = getU16(header + LENGTH_OFFSET);
+        if (length > MAX_PAYLOAD || header[FLAGS_OFFSET] != 0) {
+            ++corrupt_frames_;
+            ++pos;
+            continue;
+        }
+        size_t total = FRAME_HEADER_SIZE + length + FRAME_CRC_SIZE;
+        if (available < total) {
+            break;
+        }
+        
+        // A false magic inside the data fails here and the search resumes after it
+        size_t covered = total - FRAME_MAGIC.size() - FRAME_CRC_SIZE;
+        if (crc32(header + FRAME_MAGIC.size(), covered) != getU32(header + total - FRAME_CRC_SIZE)) {
+            ++corrupt_frames_;
+            ++pos;
+            continue;
+        }
+        
+        Frame frame;
+        frame.type = static_cast<FrameType>(header[TYPE_OFFSET]);
+        frame.seq = getU16(header + SEQ_OFFSET);
+        frame.ack = getU16(header + ACK_OFFSET);
+        frame.payload.assign(header + FRAME_HEADER_SIZE, header + FRAME_HEADER_SIZE + length);
+        frames.push_back(std::move(frame));
+        pos += total;
+    }
+    buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(pos));
+}
+
+} // namespace device
+} // namespace crusty
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace crusty {
+namespace device {
+
+/**
+ * Binary framing spoken with the embedded device over its serial link; the
+ * firmware side is tools/Zephyr/stm32h573i_dk_app/src/link_proto.c. All
+ * integers are little endian.
+ * 
+ * Frame:
+ *   magic       2 bytes, A5 5A
+ *   type        1 byte, a FrameType
+ *   flags       1 byte, 0
+ *   seq         2 bytes, sequence number of a message frame
+ *   ack         2 bytes, the next seq the sender expects from its peer
+ *   length      2 bytes, payload size, at most MAX_PAYLOAD
+ *   payload     length bytes
+ *   crc         4 bytes, CRC-32 (IEEE) of everything after the magic
+ * 
+ * Message frames carry a request or its reply and are numbered; ACK and
+ * the two RESET frames are not. Each side may have WINDOW message frames
+ * unacknowledged and resends all of them, oldest first, when the oldest
+ * is not acknowledged in time (go-back-N). A receiver only accepts the
+ * frame it expects next and answers anything else with an ACK, so frames
+ * arrive in order and exactly once. Bytes between frames, such as log
+ * output on a shared console, are skipped.
+ * 
+ * Every request gets exactly one reply, in order: INFO for HELLO, RESULT
+ * for ENCRYPT and DECRYPT, OK for the key messages, or ERROR.
+ */
+
+constexpr std::array<uint8_t, 2> FRAME_MAGIC = {0xA5, 0x5A};
+constexpr size_t FRAME_HEADER_SIZE = FRAME_MAGIC.size() + 1 + 1 + 2 + 2 + 2;
+constexpr size_t FRAME_CRC_SIZE = 4;
+
+constexpr uint16_t PROTOCOL_VERSION = 1;
+
+// Largest chunk one ENCRYPT or DECRYPT carries
+constexpr size_t MAX_CHUNK_SIZE = 1024;
+constexpr size_t NONCE_SIZE = 12;
+constexpr size_t TAG_SIZE = 16;
+constexpr size_t MAX_PAYLOAD = NONCE_SIZE + MAX_CHUNK_SIZE + TAG_SIZE;
+constexpr size_t MAX_FRAME_SIZE = FRAME_HEADER_SIZE + MAX_PAYLOAD + FRAME_CRC_SIZE;
+
+// Message frames either side may have unacknowledged
+constexpr size_t WINDOW = 4;
+
+enum class FrameType : uint8_t {
+    // Unnumbered link control
+    Ack = 0x01,
+    Reset = 0x02,       // Host: restart numbering at 0 and forget the key
+    ResetDone = 0x03,   // Device: reset done
+    
+    // Requests, host to device
+    Hello = 0x10,
+    SetKey = 0x11,      // AES key, 16, 24 or 32 bytes
+    ClearKey = 0x12,
+    Encrypt = 0x13,     // nonce | plaintext
+    Decrypt = 0x14,     // nonce | ciphertext | tag
+    
+    // Replies, device to host
+    Info = 0x20,        // version u16 | max chunk u16 | window u8 | capabilities u8
+    Ok = 0x21,
+    Result = 0x22,      // ciphertext | tag, or plaintext
+    Error = 0x23        // ErrorCode u8
+};
+
+// Capability bits of INFO
+constexpr uint8_t CAPABILITY_HW_AES = 1u << 0;
+constexpr uint8_t CAPABILITY_HW_RNG = 1u << 1;
+constexpr uint8_t CAPABILITY_HW_SHA = 1u << 2;
+constexpr uint8_t CAPABILITY_HW_PKA = 1u << 3;
+
+enum class ErrorCode : uint8_t {
+    BadRequest = 1,
+    NoKey = 2,
+    AuthenticationFailed = 3,
+    CryptoFailed = 4
+};
+
+/**
+ * @return True for frames that carry a sequence number
+ */
+inline bool isMessage(FrameType type) {
+    return static_cast<uint8_t>(type) >= static_cast<uint8_t>(FrameType::Hello);
+}
+
+/**
+ * @brief One frame as received
+ */
+struct Frame {
+    FrameType type = FrameType::Ack;
+    uint16_t seq = 0;
+    uint16_t ack = 0;
+    std::vector<uint8_t> payload;
+};
+
+/**
+ * @brief CRC-32 (IEEE 802.3, as zlib) of a buffer
+ */
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+
+/**
+ * @brief Append an encoded frame to a buffer
+ * 
+ * @param out Buffer to append to
+ * @param type Frame type
+ * @param seq Sequence number; ignored by the peer for unnumbered frames
+ * @param ack Next sequence number expected from the peer
+ * @param payload Payload, at most MAX_PAYLOAD bytes
+ * @param size Payload size
+ * @throws EncryptionException with InternalError if the payload is too large
+ */
+void encodeFrame(std::vector<uint8_t>& out, FrameType type, uint16_t seq, uint16_t ack,
+                 const uint8_t* payload = nullptr, size_t size = 0);
+
+/**
+ * @brief Finds frames in a byte stream
+ * 
+ * Bytes are fed as they arrive, in pieces of any size. Anything that is
+ * not a well-formed frame, including a frame whose CRC does not match, is
+ * dropped; the parser then looks for the next magic.
+ */
+class FrameParser {
+public:
+    /**
+     * @brief Consume received bytes
+     * 
+     * @param data Bytes received
+     * @param size Number of bytes
+     * @param frames Receives every frame completed by these bytes
+     */
+    void feed(const uint8_t* data, size_t size, std::vector<Frame>& frames);
+    
+    /**
+     * @brief Forget a partly received frame
+     */
+    void reset() { buffer_.clear(); }
+    
+    /**
+     * @return Frames dropped because of a bad length or CRC
+     */
+    uint64_t corruptFrames() const { return corrupt_frames_; }
+
+private:
+    std::vector<uint8_t> buffer_;
+    uint64_t corrupt_frames_ = 0;
+};
+
+} // namespace device
+} // namespace crusty
@@ -0,0 +1,338 @@
+#include "directory_walker.h"
+#include "audit_log.h"
+#include "encryptor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <cwchar>
+#else
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace crusty {
+
+namespace {
+
+// How long an idle thread sleeps before looking for work to steal again
+constexpr auto IDLE_WAIT = std::chrono::milliseconds(2);
+
+// Shared by the threads of one walk()
+struct WalkState {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::string> directories;
+    };
+    
+    WalkState(size_t threads, const DirectoryWalker::EntryCallback& onFile,
+              const std::shared_ptr<const CancellationToken>& cancellation)
+        : queues(threads), onFile(onFile), cancellation(cancellation) {
+        for (auto& queue : queues) {
+            queue = std::make_unique<Queue>();
+        }
+    }
+    
+    std::vector<std::unique_ptr<Queue>> queues;
+    const DirectoryWalker::EntryCallback& onFile;
+    const std::shared_ptr<const CancellationToken>& cancellation;
+    
+    // Directories queued or being listed; the walk is over when it drops to 0
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> queued{0};
+    std::mutex idle_mutex;
+    std::condition_variable work_available;
+    
+    std::atomic<uint64_t> files{0};
+    std::atomic<uint64_t> directories{0};
+    std::atomic<uint64_t> skipped{0};
+    
+    // First exception from the callback; stops every thread
+    std::atomic<bool> stopping{false};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    
+    bool stopped() const {
+        return stopping.load() || (cancellation && cancellation->cancelled());
+    }
+    
+    void push(size_t thread, std::string directory) {
+        pending.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(queues[thread]->mutex);
+            queues[thread]->directories.push_back(std::move(directory));
+        }
+        queued.fetch_add(1);
+        work_available.notify_one();
+    }
+    
+    // Own queue from the back, others' from the front
+    bool take(size_t thread, std::string& directory) {
+        for (size_t i = 0; i < queues.size(); ++i) {
+            size_t victim = (thread + i) % queues.size();
+            std::lock_guard<std::mutex> lock(queues[victim]->mutex);
+            std::deque<std::string>& directories = queues[victim]->directories;
+            if (directories.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                directory = std::move(directories.back());
+                directories.pop_back();
+            } else {
+                directory = std::move(directories.front());
+                directories.pop_front();
+            }
+            queued.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+    
+    void finished() {
+        if (pending.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            work_available.notify_all();
+        }
+    }
+    
+    void fail(std::exception_ptr exception) {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = exception;
+            }
+        }
+        stopping.store(true);
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        work_available.notify_all();
+    }
+};
+
+std::string joinPath(const std::string& directory, const std::string& name) {
+    if (!directory.empty() && (directory.back() == '/' || directory.back() == '\\')) {
+        return directory + name;
+    }
+#ifdef _WIN32
+    return directory + "\\" + name;
+#else
+    return directory + "/" + name;
+#endif
+}
+
+/**
+ * Lists one directory: files go to the callback, subdirectories to the
+ * thread's queue. Returns false with the reason if it cannot be opened.
+ */
+bool listDirectory(WalkState& state, size_t thread, const std::string& directory, bool recursive,
+                   std::string& reason) {
+#ifdef _WIN32
+    std::wstring pattern = (std::filesystem::path(directory) / L"*").wstring();
+    WIN32_FIND_DATAW data;
+    // Basic info skips the 8.3 names; large fetch asks for bigger batches per call
+    HANDLE find = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch,
+                                   nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE) {
+        reason = "error " + std::to_string(GetLastError());
+        return false;
+    }
+    
+    // Closes the search also when the callback throws
+    struct Closer {
+        HANDLE find;
+        ~Closer() { FindClose(find); }
+    } closer{find};
+    
+    do {
+        if (std::wcscmp(data.cFileName, L".") == 0 || std::wcscmp(data.cFileName, L"..") == 0) {
+            continue;
+        }
+        std::string path = joinPath(directory, std::filesystem::path(data.cFileName).string());
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            // Junctions and directory links are not followed
+            if (recursive && !(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                state.push(thread, std::move(path));
+            }
+            continue;
+        }
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DEVICE) {
+            continue;
+        }
+        
+        uint64_t size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        state.files.fetch_add(1);
+        state.onFile(DirectoryWalker::Entry{std::move(path), size});
+    } while (!state.stopping.load() && FindNextFileW(find, &data));
+    return true;
+#else
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        reason = std::strerror(errno);
+        return false;
+    }
+    DIR* handle = fdopendir(fd);
+    if (!handle) {
+        reason = std::strerror(errno);
+        close(fd);
+        return false;
+    }
+    
+    // The guard closes fd along with the stream, also when the callback throws
+    struct Closer {
+        DIR* handle;
+        ~Closer() { closedir(handle); }
+    } closer{handle};
+    
+    while (!state.stopping.load()) {
+        errno = 0;
+        dirent* entry = readdir(handle);
+        if (!entry) {
+            break;
+        }
+        const char* name = entry->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+            continue;
+        }
+        
+        // Most file systems report the type, so only files need a stat for their size
+        bool isDirectory = entry->d_type == DT_DIR;
+        struct stat info;
+        if (entry->d_type == DT_UNKNOWN) {
+            if (fstatat(fd, name, &info, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            isDirectory = S_ISDIR(info.st_mode);
+        }
+        if (isDirectory) {
+            if (recursive) {
+                state.push(thread, joinPath(directory, name));
+            }
+            continue;
+        }
+        if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) {
+            continue;
+        }
+        
+        // Follows links, so a link to a file counts as that file
+        if (fstatat(fd, name, &info, 0) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+        state.files.fetch_add(1);
+        state.onFile(DirectoryWalker::Entry{joinPath(directory, name), static_cast<uint64_t>(info.st_size)});
+    }
+    return true;
+#endif
+}
+
+// Lists a directory, turning a callback exception into a stop of the walk
+void visit(WalkState& state, size_t thread, const std::string& directory, bool recursive) {
+    try {
+        std::string reason;
+        if (listDirectory(state, thread, directory, recursive, reason)) {
+            state.directories.fetch_add(1);
+        } else {
+            state.skipped.fetch_add(1);
+        }
+    } catch (...) {
+        state.fail(std::current_exception());
+    }
+}
+
+void workerLoop(WalkState& state, size_t thread) {
+    while (!state.stopped()) {
+        std::string directory;
+        if (state.take(thread, directory)) {
+            visit(state, thread, directory, true);
+            state.finished();
+            continue;
+        }
+        if (state.pending.load() == 0) {
+            return;
+        }
+        
+        // Others are still listing and may queue more directories
+        std::unique_lock<std::mutex> lock(state.idle_mutex);
+        state.work_available.wait_for(lock, IDLE_WAIT, [&state]() {
+            return state.queued.load() > 0 || state.pending.load() == 0 || state.stopping.load();
+        });
+    }
+}
+
+} // anonymous namespace
+
+DirectoryWalker::DirectoryWalker(size_t threadCount)
+    : thread_count_(threadCount > 0 ? threadCount : DEFAULT_THREADS) {
+}
+
+DirectoryWalker::Summary DirectoryWalker::walk(const std::string& root, const EntryCallback& onFile, bool recursive) {
+    WalkState state(thread_count_, onFile, cancellation_);
+    if (state.stopped()) {
+        return Summary{};
+    }
+    
+    // The root is listed here, so an unreadable one fails the walk
+    std::string reason;
+    bool listed = false;
+    try {
+        listed = listDirectory(state, 0, root, recursive, reason);
+    } catch (...) {
+        state.fail(std::current_exception());
+    }
+    if (!listed && !state.error) {
+        std::string errorMsg = "Failed to read directory: " + root + " (" + reason + ")";
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
+    }
+    state.directories.fetch_add(1);
+    
+    if (state.pending.load() > 0 && !state.stopped()) {
+        std::vector<std::thread> helpers;
+        helpers.reserve(thread_count_ - 1);
+        try {
+            for (size_t i = 1; i < thread_count_; ++i) {
+                helpers.emplace_back([&state, i]() { workerLoop(state, i); });
+            }
+        } catch (...) {
+            // Fewer threads only make the walk slower
+        }
+        workerLoop(state, 0);
+        for (auto& helper : helpers) {
+            helper.join();
+        }
+    }
+    
+    if (state.error) {
+        std::rethrow_exception(state.error);
+    }
+    
+    Summary summary;
+    summary.files = state.files.load();
+    summary.directories = state.directories.load();
+    summary.skipped = state.skipped.load();
+    if (summary.skipped > 0) {
+        LOG_EVENT(Warning, "Skipped unreadable directories", {"path", root}, {"directories", summary.skipped});
+    }
+    return summary;
+}
+
+void DirectoryWalker::setCancellationToken(std::shared_ptr<const CancellationToken> token) {
+    cancellation_ = std::move(token);
+}
+
+} // namespace crusty
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "cancellation.h"
+
+namespace crusty {
+
+/**
+ * @brief Lists a directory tree on several threads
+ * 
+ * Every thread keeps its own queue of directories still to be listed. It
+ * lists the newest one it found itself, so the tree is walked depth first
+ * and the queues stay short, and takes the oldest one from another thread
+ * when its own queue runs dry; directories near the root hold the largest
+ * subtrees, so one steal keeps a thread busy for a while.
+ * 
+ * Files are handed to the callback as soon as their directory is read, so
+ * a caller can start working on them while the rest of the tree is still
+ * being listed. Directories are read with readdir() and their files sized
+ * with fstatat() relative to the open directory; on Windows,
+ * FindFirstFileEx() returns names and sizes in one pass.
+ * 
+ * Symbolic links to files count as the file they point to; links to
+ * directories are not followed, as with std::filesystem's recursive
+ * iterator. Directories that cannot be read below the root are skipped.
+ */
+class DirectoryWalker {
+public:
+    /**
+     * @brief One regular file found by walk()
+     */
+    struct Entry {
+        std::string path;
+        uint64_t size = 0;
+    };
+    
+    /**
+     * @brief What a walk() found
+     */
+    struct Summary {
+        uint64_t files = 0;
+        uint64_t directories = 0;   // Listed, the root included
+        uint64_t skipped = 0;       // Could not be read
+    };
+    
+    /**
+     * Called from the walking threads, possibly several at once, in no
+     * particular order. An exception stops the walk and is rethrown by
+     * walk().
+     */
+    using EntryCallback = std::function<void(const Entry&)>;
+    
+    /**
+     * @param threadCount Threads listing directories, the caller's included,
+     *        or 0 for DEFAULT_THREADS
+     */
+    explicit DirectoryWalker(size_t threadCount = 0);
+    
+    /**
+     * @brief List a directory and, optionally, everything below it
+     * 
+     * Blocks until the walk is done. The root is listed on the calling
+     * thread before any other thread starts, so a walk without recursion
+     * starts none.
+     * 
+     * @param root Directory to list
+     * @param onFile Receives every regular file
+     * @param recursive True to list subdirectories as well
+     * @return Counts of what was listed; partial if the walk was cancelled
+     * @throws EncryptionException with IoError if the root cannot be read
+     */
+    Summary walk(const std::string& root, const EntryCallback& onFile, bool recursive = true);
+    
+    /**
+     * @brief Stop walks early whenever a token is cancelled
+     * 
+     * Threads check the token before each directory.
+     * 
+     * @param token Token shared with whoever cancels, or null
+     */
+    void setCancellationToken(std::shared_ptr<const CancellationToken> token);
+    
+    /**
+     * @return Threads a walk uses
+     */
+    size_t threadCount() const { return thread_count_; }
+    
+    // Listing is bound by file system latency rather than CPU, but more
+    // than a few threads rarely help on a single disk
+    static constexpr size_t DEFAULT_THREADS = 4;
+    
+    // Prevent copying
+    DirectoryWalker(const DirectoryWalker&) = delete;
+    DirectoryWalker& operator=(const DirectoryWalker&) = delete;
+
+private:
+    size_t thread_count_;
+    std::shared_ptr<const CancellationToken> cancellation_;
+};
+
+} // namespace crusty
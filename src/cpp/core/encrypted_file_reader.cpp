@@ -0,0 +1,152 @@
+#include "encrypted_file_reader.h"
+#include "compression.h"
+#include "encryptor.h"
+#include "secure_buffer_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace crusty {
+
+namespace {
+
+[[noreturn]] void malformed(uint64_t index) {
+    throw EncryptionException("Encrypted chunk " + std::to_string(index) + " is malformed",
+                              CryptoErrorCode::DataCorrupted);
+}
+
+} // anonymous namespace
+
+EncryptedFileReader::EncryptedFileReader(std::unique_ptr<FileReader> source, container::ContainerInfo info,
+                                         const Crypto& crypto, std::shared_ptr<const SecureKey> key,
+                                         std::shared_ptr<secure::SecureBufferPool> pool)
+    : source_(std::move(source)),
+      info_(std::move(info)),
+      crypto_(crypto),
+      key_(std::move(key)),
+      pool_(std::move(pool)),
+      index_offset_(info_.fileSize - container::footerSize(info_.chunkOffsets.size())) {
+}
+
+EncryptedFileReader::~EncryptedFileReader() {
+    pool_->release(std::move(cached_));
+}
+
+size_t EncryptedFileReader::readAt(uint64_t offset, uint8_t* buffer, size_t size) {
+    if (offset >= info_.plaintextSize) {
+        return 0;
+    }
+    size = static_cast<size_t>(std::min<uint64_t>(size, info_.plaintextSize - offset));
+    
+    uint64_t chunkSize = info_.header.chunkSize;
+    size_t copied = 0;
+    while (copied < size) {
+        uint64_t position = offset + copied;
+        uint64_t index = position / chunkSize;
+        if (!has_cached_ || cached_index_ != index) {
+            loadChunk(index);
+        }
+        
+        size_t start = static_cast<size_t>(position - index * chunkSize);
+        size_t count = std::min(cached_.size() - cached_offset_ - start, size - copied);
+        std::memcpy(buffer + copied, cached_.data() + cached_offset_ + start, count);
+        copied += count;
+    }
+    return copied;
+}
+
+std::vector<uint8_t> EncryptedFileReader::readChunk(uint64_t index) {
+    uint64_t chunkCount = info_.chunkOffsets.size();
+    if (index >= chunkCount) {
+        throw EncryptionException("Chunk index out of range", CryptoErrorCode::InternalError);
+    }
+    
+    uint64_t offset = info_.chunkOffsets[index];
+    uint64_t end = index + 1 == chunkCount ? index_offset_ : info_.chunkOffsets[index + 1];
+    size_t length = static_cast<size_t>(end - offset);
+    std::vector<uint8_t> frame = pool_->acquire(length);
+    size_t read = 0;
+    try {
+        read = source_->readAt(offset, frame.data(), length);
+    } catch (const FileOperationException& e) {
+        throw EncryptionException("Failed to read encrypted file: " + std::string(e.what()), CryptoErrorCode::IoError);
+    }
+    if (read != length) {
+        throw EncryptionException("Encrypted file changed while reading", CryptoErrorCode::IoError);
+    }
+    
+    // The index only gave the record's extent; its own header must agree
+    bool isFinal = false;
+    if (container::frameCiphertextLength(frame.data(), isFinal) != length - container::FRAME_HEADER_SIZE ||
+        isFinal != (index + 1 == chunkCount)) {
+        malformed(index);
+    }
+    if (isFinal) {
+        container::clearFinalFlag(frame.data());
+    }
+    return frame;
+}
+
+size_t EncryptedFileReader::openChunk(uint64_t index, std::vector<uint8_t>& frame) const {
+    const container::FileHeader& header = info_.header;
+    bool isFinal = index + 1 == info_.chunkOffsets.size();
+    uint8_t* data = frame.data();
+    size_t plaintextSize = crypto_.decryptChunk(data, frame.size(), *key_,
+                                                container::chunkNonce(info_, index, isFinal),
+                                                data + container::FRAME_HEADER_SIZE,
+                                                frame.size() - container::FRAME_HEADER_SIZE);
+    frame.resize(container::FRAME_HEADER_SIZE + plaintextSize);
+    
+    // The index's plaintext size fixes how much each chunk must hold
+    uint64_t chunkStart = index * header.chunkSize;
+    uint64_t expected = chunkStart < info_.plaintextSize
+        ? std::min<uint64_t>(header.chunkSize, info_.plaintextSize - chunkStart) : 0;
+    size_t offset = container::FRAME_HEADER_SIZE;
+    if (header.compression != Compression::None) {
+        uint8_t encoding = 0;
+        plaintextSize = container::checkChunkPrefix(header, data + offset, plaintextSize, isFinal, encoding);
+        offset += container::CHUNK_PREFIX_SIZE;
+        if (plaintextSize != expected) {
+            malformed(index);
+        }
+        
+        if (encoding == container::CHUNK_COMPRESSED) {
+            std::vector<uint8_t> plaintext = pool_->acquire(plaintextSize);
+            try {
+                compression::decompress(header.compression, data + offset, frame.size() - offset,
+                                        plaintext.data(), plaintextSize);
+            } catch (...) {
+                pool_->release(std::move(plaintext));
+                throw;
+            }
+            frame.swap(plaintext);
+            pool_->release(std::move(plaintext));
+            offset = 0;
+        }
+        return offset;
+    }
+    
+    if (plaintextSize != expected) {
+        malformed(index);
+    }
+    return offset;
+}
+
+void EncryptedFileReader::loadChunk(uint64_t index) {
+    has_cached_ = false;
+    pool_->release(std::move(cached_));
+    
+    std::vector<uint8_t> frame = readChunk(index);
+    try {
+        cached_offset_ = openChunk(index, frame);
+    } catch (...) {
+        pool_->release(std::move(frame));
+        throw;
+    }
+    cached_ = std::move(frame);
+    cached_index_ = index;
+    has_cached_ = true;
+}
+
+} // namespace crusty
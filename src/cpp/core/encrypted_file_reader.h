@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "container_format.h"
+#include "file_operations.h"
+
+namespace crusty {
+
+class Crypto;
+class SecureKey;
+
+namespace secure {
+class SecureBufferPool;
+}
+
+/**
+ * @brief Positional reads of the plaintext of an encrypted file
+ * 
+ * Opened by Encryptor::openEncryptedFile(). Only the chunk index is loaded
+ * up front; readAt() reads and authenticates just the chunks covering the
+ * requested bytes, so a slice costs the same wherever it lies in the file.
+ * Every chunk but the last holds exactly chunkSize bytes, compressed or
+ * not, so an offset maps straight to its chunk.
+ * 
+ * The chunk read last stays decrypted, so small sequential reads cost one
+ * decryption per chunk. It is kept in a pooled buffer that is wiped when
+ * it is replaced or the reader is destroyed.
+ * 
+ * readAt() is not thread-safe; readChunk() and openChunk() let callers
+ * read on one thread and decrypt on several. The Encryptor that opened the
+ * reader must outlive it.
+ */
+class EncryptedFileReader : public FileReader {
+public:
+    /**
+     * @brief Wrap an opened container
+     * 
+     * @param source Reader for the encrypted file
+     * @param info Structure from ContainerReader::readIndex()
+     * @param crypto Cipher implementation
+     * @param key File key derived from the header
+     * @param pool Pool for chunk buffers
+     */
+    EncryptedFileReader(std::unique_ptr<FileReader> source, container::ContainerInfo info, const Crypto& crypto,
+                        std::shared_ptr<const SecureKey> key, std::shared_ptr<secure::SecureBufferPool> pool);
+    
+    /**
+     * @brief Wipe the cached chunk
+     */
+    ~EncryptedFileReader() override;
+    
+    /**
+     * @brief Read plaintext starting at an offset
+     * 
+     * @param offset Position in the plaintext
+     * @param buffer Destination
+     * @param size Bytes wanted
+     * @return Bytes read; less than size only at the end of the plaintext
+     * @throws EncryptionException if a chunk is malformed or fails authentication
+     */
+    size_t readAt(uint64_t offset, uint8_t* buffer, size_t size) override;
+    
+    /**
+     * @return Plaintext size in bytes
+     */
+    uint64_t size() const override { return info_.plaintextSize; }
+    
+    /**
+     * @return Structure of the encrypted file
+     */
+    const container::ContainerInfo& info() const { return info_; }
+    
+    /**
+     * @brief Read one chunk's record from the encrypted file
+     * 
+     * Checks the record's framing; nothing is decrypted yet.
+     * 
+     * @param index Chunk number
+     * @return Record in a pooled buffer, final-chunk flag cleared
+     * @throws EncryptionException if the record is malformed or cannot be read
+     */
+    std::vector<uint8_t> readChunk(uint64_t index);
+    
+    /**
+     * @brief Authenticate and decrypt a record from readChunk()
+     * 
+     * Decrypts in place and, for compressed files, expands the chunk into
+     * a pooled buffer that replaces the record. Thread-safe.
+     * 
+     * @param index Chunk number the record was read for
+     * @param frame Record; holds the plaintext afterwards
+     * @return Offset of the plaintext in frame
+     * @throws EncryptionException if the chunk fails authentication or its
+     *         size does not fit the index
+     */
+    size_t openChunk(uint64_t index, std::vector<uint8_t>& frame) const;
+    
+    // Prevent copying
+    EncryptedFileReader(const EncryptedFileReader&) = delete;
+    EncryptedFileReader& operator=(const EncryptedFileReader&) = delete;
+
+private:
+    void loadChunk(uint64_t index);
+    
+    std::unique_ptr<FileReader> source_;
+    container::ContainerInfo info_;
+    const Crypto& crypto_;
+    std::shared_ptr<const SecureKey> key_;
+    std::shared_ptr<secure::SecureBufferPool> pool_;
+    uint64_t index_offset_ = 0;   // Where the records end and the footer starts
+    
+    // Plaintext of the chunk read last
+    std::vector<uint8_t> cached_;
+    size_t cached_offset_ = 0;
+    uint64_t cached_index_ = 0;
+    bool has_cached_ = false;
+};
+
+} // namespace crusty
@@ -1,14 +1,42 @@
 #include "encryptor.h"
+#include "compression.h"
+#include "container_stream.h"
+#include "encrypted_file_reader.h"
+#include "encryptor_stats.h"
+#include "file_operations.h"
+#include "progress_reporter.h"
 #include "secure_utils.h"
 #include "audit_log.h"
 #include "path_utils.h"
+#include "container_format.h"
+#include "content_chunker.h"
+#include "chunk_pipeline.h"
+#include "thread_pool.h"
+#include "secure_buffer_pool.h"
+#include "mapped_file.h"
+#include "io_queue.h"
+#include "output_file.h"
+#include "key_cache.h"
+#include "memory_budget.h"
+#include "job_queue.h"
+#include "trace.h"
 #include "crypto_interface.h" // Generated by cbindgen from Rust
 
-#include <fstream>
 #include <iostream>
 #include <cstring>
+#include <exception>
 #include <filesystem>
+#include <future>
 #include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace crusty {
 
@@ -28,6 +56,8 @@ CryptoErrorCode mapErrorCode(int32_t rustErrorCode) {
             return CryptoErrorCode::DataCorrupted;
         case -5: // KeyDerivationError
             return CryptoErrorCode::InvalidPassword;
+        case -8: // HardwareNotAvailable
+            return CryptoErrorCode::HardwareNotAvailable;
         default:
             return CryptoErrorCode::InternalError;
     }
@@ -49,108 +79,766 @@ std::string getErrorMessage(int32_t errorCode) {
             return "Buffer too small";
         case -7: // InternalError
             return "Internal error";
+        case -8: // HardwareNotAvailable
+            return "Hardware acceleration not available";
         default:
             return "Unknown error";
     }
 }
 
-void updateProgress(const ProgressCallback& progressCallback, float progress) {
-    if (progressCallback) {
-        progressCallback(progress);
+// The FFI rejects null pointers, which empty vectors may hand out
+const uint8_t* nonNullData(const std::vector<uint8_t>& data) {
+    static const uint8_t empty = 0;
+    return data.empty() ? &empty : data.data();
+}
+
+// Adapts a fraction-only callback to the reporter
+DetailedProgressCallback fractionCallback(ProgressCallback progressCallback) {
+    if (!progressCallback) {
+        return nullptr;
+    }
+    return [progressCallback = std::move(progressCallback)](const ProgressInfo& progress) {
+        progressCallback(progress.fraction);
+    };
+}
+
+// Files compressed with a codec this build lacks can be inspected, not decrypted
+void requireCodec(Compression algorithm) {
+    if (!compression::available(algorithm)) {
+        throw EncryptionException(std::string("File is compressed with ") + compression::name(algorithm) +
+                                  ", which this build cannot decompress", CryptoErrorCode::InternalError);
+    }
+}
+
+// Opens through the backend, reporting failures like the engine's other IO errors
+std::unique_ptr<FileReader> openSourceFile(const FileSystem& fileSystem, const std::string& path,
+                                           FileCaching caching = FileCaching::Normal) {
+    try {
+        return fileSystem.openReader(path, caching);
+    } catch (const FileOperationException& e) {
+        throw EncryptionException("Failed to open source file: " + path + " (" + e.what() + ")",
+                                  CryptoErrorCode::IoError);
+    }
+}
+
+std::unique_ptr<FileWriter> openDestFile(const FileSystem& fileSystem, const std::string& path, uint64_t sizeHint,
+                                         FileCaching caching) {
+    try {
+        return fileSystem.openWriter(path, sizeHint, caching);
+    } catch (const FileOperationException& e) {
+        throw EncryptionException("Failed to open destination file: " + path + " (" + e.what() + ")",
+                                  CryptoErrorCode::IoError);
+    }
+}
+
+/**
+ * Chunk buffers of one queued file, handed between the reader, the I/O
+ * queue and the writer stage. Every buffer goes back to the pool, wiped,
+ * however the file ends, so the queue must be drained first.
+ */
+class QueuedFrames {
+public:
+    QueuedFrames(secure::SecureBufferPool& pool, size_t count, size_t frameSize) : pool_(pool) {
+        free_.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            free_.push_back(pool_.acquire(frameSize));
+            buffers_.push_back({free_.back().data(), free_.back().size()});
+        }
+    }
+    
+    ~QueuedFrames() {
+        for (auto& frame : free_) {
+            pool_.release(std::move(frame));
+        }
+        for (auto& [index, read] : reading_) {
+            pool_.release(std::move(read.frame));
+        }
+        for (auto& [index, frame] : writing_) {
+            pool_.release(std::move(frame));
+        }
+    }
+    
+    // Every buffer, for registration with the queue
+    const std::vector<IoBuffer>& buffers() const { return buffers_; }
+    
+    // Takes a free buffer for reading a chunk, or returns null if none is free
+    uint8_t* startRead(uint64_t index) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.empty()) {
+            return nullptr;
+        }
+        Read& read = reading_[index];
+        read.frame = std::move(free_.back());
+        free_.pop_back();
+        return read.frame.data();
+    }
+    
+    // Called by the queue when a read finished
+    void readDone(uint64_t index, size_t bytes, std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Read& read = reading_[index];
+            read.bytes = bytes;
+            read.error = error;
+            read.done = true;
+        }
+        changed_.notify_all();
+    }
+    
+    // Waits for a chunk's read and takes its buffer
+    std::vector<uint8_t> takeRead(uint64_t index, size_t expected) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&]() { return reading_[index].done; });
+        auto it = reading_.find(index);
+        std::exception_ptr error = it->second.error;
+        size_t bytes = it->second.bytes;
+        std::vector<uint8_t> frame = std::move(it->second.frame);
+        reading_.erase(it);
+        if (error || bytes != expected) {
+            free_.push_back(std::move(frame));
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            throw EncryptionException("File changed while reading", CryptoErrorCode::IoError);
+        }
+        return frame;
+    }
+    
+    // Waits until a buffer is free again
+    void waitForFrame() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this]() { return !free_.empty() || write_error_; });
+        if (write_error_) {
+            std::rethrow_exception(write_error_);
+        }
+    }
+    
+    // Keeps a chunk's buffer while it is being written
+    const uint8_t* startWrite(uint64_t index, std::vector<uint8_t> frame) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (write_error_) {
+            free_.push_back(std::move(frame));
+            std::rethrow_exception(write_error_);
+        }
+        std::vector<uint8_t>& stored = writing_[index];
+        stored = std::move(frame);
+        return stored.data();
+    }
+    
+    // Called by the queue when a write finished
+    void writeDone(uint64_t index, std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = writing_.find(index);
+            free_.push_back(std::move(it->second));
+            writing_.erase(it);
+            if (error && !write_error_) {
+                write_error_ = error;
+            }
+        }
+        changed_.notify_all();
+    }
+    
+    // Rethrows the first failed write
+    void checkWrites() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (write_error_) {
+            std::rethrow_exception(write_error_);
+        }
+    }
+
+private:
+    struct Read {
+        std::vector<uint8_t> frame;
+        size_t bytes = 0;
+        std::exception_ptr error;
+        bool done = false;
+    };
+    
+    secure::SecureBufferPool& pool_;
+    std::vector<IoBuffer> buffers_;
+    std::vector<std::vector<uint8_t>> free_;
+    std::map<uint64_t, Read> reading_;
+    std::map<uint64_t, std::vector<uint8_t>> writing_;
+    std::exception_ptr write_error_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+// Chunks verifyFile() checks, in file order: all of them, or the first, the
+// last and a uniform pick of the others
+std::vector<uint64_t> verifiedChunks(uint64_t chunkCount, uint64_t sampleSize) {
+    std::vector<uint64_t> chunks;
+    if (sampleSize == 0 || sampleSize >= chunkCount) {
+        chunks.resize(static_cast<size_t>(chunkCount));
+        std::iota(chunks.begin(), chunks.end(), uint64_t{0});
+        return chunks;
+    }
+    
+    // The ends catch truncation and appended records; Floyd's algorithm
+    // picks the rest without repeats in one pass
+    std::mt19937_64 generator{std::random_device{}()};
+    std::unordered_set<uint64_t> picked{0, chunkCount - 1};
+    uint64_t interior = chunkCount - 2;
+    uint64_t wanted = std::max<uint64_t>(sampleSize, 2) - 2;
+    for (uint64_t j = interior - wanted; j < interior; ++j) {
+        uint64_t candidate = std::uniform_int_distribution<uint64_t>(0, j)(generator) + 1;
+        if (!picked.insert(candidate).second) {
+            picked.insert(j + 1);
+        }
+    }
+    chunks.assign(picked.begin(), picked.end());
+    std::sort(chunks.begin(), chunks.end());
+    return chunks;
+}
+
+// Reads a chunk manifest and checks its MAC, which also proves the key
+container::ChunkManifest readManifest(const FileSystem& fileSystem, const Crypto& crypto, const std::string& path,
+                                      const SecureKey& key) {
+    std::vector<uint8_t> data = fileSystem.readFile(path);
+    if (data.size() < container::MANIFEST_MAC_SIZE) {
+        throw EncryptionException("Chunk manifest is truncated", CryptoErrorCode::DataCorrupted);
+    }
+    size_t bodySize = data.size() - container::MANIFEST_MAC_SIZE;
+    Fingerprint mac = crypto.fingerprint(container::MANIFEST_MAC_CONTEXT, data.data(), bodySize, key);
+    if (!secure::SecureView(mac.data(), mac.size()).equals(
+            secure::SecureView(data.data() + bodySize, container::MANIFEST_MAC_SIZE))) {
+        throw EncryptionException("Chunk manifest does not match the key", CryptoErrorCode::AuthenticationFailed);
+    }
+    return container::decodeManifest(data.data(), bodySize);
+}
+
+void writeManifest(const FileSystem& fileSystem, const Crypto& crypto, const std::string& path,
+                   const container::ChunkManifest& manifest, const SecureKey& key, bool durable) {
+    std::vector<uint8_t> data = container::encodeManifest(manifest);
+    Fingerprint mac = crypto.fingerprint(container::MANIFEST_MAC_CONTEXT, data.data(), data.size(), key);
+    data.insert(data.end(), mac.begin(), mac.end());
+    
+    AtomicOutput output(fileSystem, path);
+    std::unique_ptr<FileWriter> dest = fileSystem.openWriter(output.tempPath(), data.size());
+    dest->writeAt(0, data.data(), data.size());
+    if (durable) {
+        dest->sync();
+    }
+    dest->close();
+    output.commit(durable);
+}
+
+// Chunk IDs are MAC outputs, so any eight of their bytes hash well
+struct FingerprintHash {
+    size_t operator()(const Fingerprint& id) const {
+        uint64_t value = 0;
+        std::memcpy(&value, id.data(), sizeof(value));
+        return static_cast<size_t>(value);
+    }
+};
+
+// Positional read of archive bytes that must all be there
+void readArchive(FileReader& source, uint64_t offset, uint8_t* data, size_t size) {
+    size_t read = 0;
+    try {
+        read = source.readAt(offset, data, size);
+    } catch (const FileOperationException& e) {
+        throw EncryptionException("Failed to read archive: " + std::string(e.what()), CryptoErrorCode::IoError);
+    }
+    if (read != size) {
+        throw EncryptionException("Archive is truncated", CryptoErrorCode::DataCorrupted);
+    }
+}
+
+// Set while an asynchronous operation runs on this thread; its token then
+// replaces the engine's own in every check the operation makes
+struct ActiveOperation {
+    const Encryptor* engine = nullptr;
+    const CancellationToken* token = nullptr;
+};
+thread_local ActiveOperation activeOperation;
+
+// Shared by an asynchronous operation's job and the handles to it
+struct AsyncState {
+    std::promise<void> promise;
+    CompletionCallback onComplete;
+    
+    void complete(std::exception_ptr error) {
+        if (onComplete) {
+            try {
+                onComplete(error);
+            } catch (const std::exception& e) {
+                // The operation's outcome stands; only the notification is lost
+                LOG_EVENT(Warning, "Completion callback failed", {"error", std::string(e.what())});
+            } catch (...) {
+                LOG_WARNING("Completion callback failed");
+            }
+        }
+        if (error) {
+            promise.set_exception(error);
+        } else {
+            promise.set_value();
+        }
+    }
+};
+
+// Held by the queued job. Completes the operation as cancelled if the job
+// is dropped without running, as queued jobs are when the engine goes
+struct PendingOperation {
+    std::shared_ptr<AsyncState> state;
+    
+    ~PendingOperation() {
+        if (state) {
+            state->complete(std::make_exception_ptr(OperationCancelled()));
+        }
     }
+};
+
+// Records once per process which AES-GCM code path is in use; callers
+// racing a probe in progress wait for it
+void probeBackend() {
+    static std::once_flag probed;
+    std::call_once(probed, []() {
+        uint32_t features = crusty::crypto::get_cpu_features();
+        LOG_EVENT(Info, "Crypto backend selected",
+                  {"aes_gcm", Crypto::aesBackendName(Crypto::aesBackend())},
+                  {"vaes", (features & crusty::crypto::CPU_FEATURE_VAES) != 0},
+                  {"avx512f", (features & crusty::crypto::CPU_FEATURE_AVX512F) != 0});
+    });
 }
 
 }  // anonymous namespace
 
+//
+// SecureKey implementation
+//
+
+SecureKey::~SecureKey() {
+    crusty::crypto::destroy_key_handle(handle_);
+}
+
+SecureKey& SecureKey::operator=(SecureKey&& other) noexcept {
+    if (this != &other) {
+        crusty::crypto::destroy_key_handle(handle_);
+        handle_ = other.handle_;
+        other.handle_ = nullptr;
+    }
+    return *this;
+}
+
+SecureKey SecureKey::fromBytes(const uint8_t* key, size_t size) {
+    crusty::crypto::crusty_key_t* handle = nullptr;
+    int32_t result = crusty::crypto::create_key_handle(key, size, &handle);
+    if (result != 0) {
+        std::string errorMsg = "Failed to import key: " + getErrorMessage(result);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, mapErrorCode(result));
+    }
+    return SecureKey(handle);
+}
+
 //
 // Crypto implementation
 //
 
 std::vector<uint8_t> Crypto::encrypt(
     const std::vector<uint8_t>& plaintext,
-    const std::string& password
+    secure::SecureView password
 ) const {
-    LOG_SECURITY("Encrypting data (" + std::to_string(plaintext.size()) + " bytes)");
-    
-    // Create a secure copy of the password
-    secure::SecureData<std::string> securePassword(password);
+    LOG_EVENT(SecurityEvent, "Encrypting data", {"bytes", plaintext.size()});
     
     // Data size + overhead for nonce and tag
     std::vector<uint8_t> output(plaintext.size() + 32);
     size_t output_len = 0;
     
-    int32_t result = crusty::crypto::encrypt_data(
-        plaintext.data(), plaintext.size(),
-        reinterpret_cast<const uint8_t*>(securePassword.get().c_str()), 
-        securePassword.get().size(),
-        output.data(), output.size(),
-        &output_len
-    );
+    auto callEncrypt = [&]() {
+        return crusty::crypto::encrypt_data(
+            plaintext.data(), plaintext.size(),
+            password.data(), password.size(),
+            output.data(), output.size(),
+            &output_len
+        );
+    };
+    
+    int32_t result = callEncrypt();
+    if (result == -6) { // BufferTooSmall: retry once with the size Rust asked for
+        output.resize(output_len);
+        result = callEncrypt();
+    }
     
     if (result != 0) {
-        if (result == -6) { // BufferTooSmall
-            output.resize(output_len);
-            return encrypt(plaintext, password);
-        }
-        
         std::string errorMsg = "Failed to encrypt data: " + getErrorMessage(result);
         LOG_ERROR(errorMsg);
         throw EncryptionException(errorMsg, mapErrorCode(result));
     }
     
     output.resize(output_len);
-    LOG_SECURITY("Data encrypted successfully (" + std::to_string(output.size()) + " bytes)");
+    LOG_EVENT(SecurityEvent, "Data encrypted successfully", {"bytes", output.size()});
     return output;
 }
 
 std::vector<uint8_t> Crypto::decrypt(
     const std::vector<uint8_t>& ciphertext,
-    const std::string& password
+    secure::SecureView password
 ) const {
-    LOG_SECURITY("Decrypting data (" + std::to_string(ciphertext.size()) + " bytes)");
+    LOG_EVENT(SecurityEvent, "Decrypting data", {"bytes", ciphertext.size()});
     
-    // Create a secure copy of the password
-    secure::SecureData<std::string> securePassword(password);
+    // The frame's length prefix gives the exact plaintext size, so there is
+    // no BufferTooSmall round trip; malformed frames are rejected by Rust
+    size_t plaintextSize = 0;
+    if (ciphertext.size() >= container::recordSize(0)) {
+        uint32_t ciphertextLength = (uint32_t(ciphertext[12]) << 24) | (uint32_t(ciphertext[13]) << 16) |
+                                    (uint32_t(ciphertext[14]) << 8) | uint32_t(ciphertext[15]);
+        plaintextSize = ciphertextLength >= container::TAG_SIZE ? ciphertextLength - container::TAG_SIZE : 0;
+        plaintextSize = std::min(plaintextSize, ciphertext.size() - container::recordSize(0));
+    }
     
-    std::vector<uint8_t> output(ciphertext.size());
+    // Keep at least one byte so an empty message still has a valid buffer
+    std::vector<uint8_t> output(std::max<size_t>(1, plaintextSize));
     size_t output_len = 0;
     
     int32_t result = crusty::crypto::decrypt_data(
-        ciphertext.data(), ciphertext.size(),
-        reinterpret_cast<const uint8_t*>(securePassword.get().c_str()), 
-        securePassword.get().size(),
+        nonNullData(ciphertext), ciphertext.size(),
+        password.data(), password.size(),
         output.data(), output.size(),
         &output_len
     );
     
     if (result != 0) {
-        if (result == -6) { // BufferTooSmall
-            output.resize(output_len);
-            return decrypt(ciphertext, password);
-        }
-        
         std::string errorMsg = "Failed to decrypt data: " + getErrorMessage(result);
         LOG_ERROR(errorMsg);
         throw EncryptionException(errorMsg, mapErrorCode(result));
     }
     
     output.resize(output_len);
-    LOG_SECURITY("Data decrypted successfully (" + std::to_string(output.size()) + " bytes)");
+    LOG_EVENT(SecurityEvent, "Data decrypted successfully", {"bytes", output.size()});
     return output;
 }
 
-std::string Crypto::hashPassword(const std::string& password) const {
-    LOG_SECURITY("Hashing password");
+SecureKey Crypto::deriveKey(
+    secure::SecureView password,
+    const std::vector<uint8_t>& salt,
+    const KdfParams& params
+) const {
+    TRACE_SPAN("ffi.derive_key");
+    LOG_EVENT(SecurityEvent, "Deriving file key",
+              {"kdf", "argon2id"},
+              {"memory_kib", params.memoryKib},
+              {"iterations", params.iterations},
+              {"parallelism", params.parallelism});
+    
+    // The key goes straight into a Rust-owned handle; its bytes never reach this side
+    crusty::crypto::crusty_key_t* handle = nullptr;
+    int32_t result = crusty::crypto::derive_key_handle(
+        password.data(), password.size(),
+        salt.data(), salt.size(),
+        params.memoryKib, params.iterations, params.parallelism,
+        &handle
+    );
+    
+    if (result != 0) {
+        std::string errorMsg = "Failed to derive key: " + getErrorMessage(result);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, mapErrorCode(result));
+    }
+    
+    return SecureKey(handle);
+}
+
+std::vector<uint8_t> Crypto::encryptWithKey(
+    const std::vector<uint8_t>& plaintext,
+    const SecureKey& key
+) const {
+    // Nonce and length prefix plus the authentication tag
+    std::vector<uint8_t> output(container::recordSize(plaintext.size()));
+    output.resize(encryptInto(nonNullData(plaintext), plaintext.size(), key, output.data(), output.size()));
+    return output;
+}
+
+std::vector<uint8_t> Crypto::decryptWithKey(
+    const std::vector<uint8_t>& ciphertext,
+    const SecureKey& key
+) const {
+    if (ciphertext.size() < container::recordSize(0)) {
+        throw EncryptionException("Encrypted chunk is truncated", CryptoErrorCode::DataCorrupted);
+    }
+    
+    // Keep at least one byte so an empty final chunk still has a valid buffer
+    std::vector<uint8_t> output(std::max<size_t>(1, ciphertext.size() - container::recordSize(0)));
+    output.resize(decryptInto(ciphertext.data(), ciphertext.size(), key, output.data(), output.size()));
+    return output;
+}
+
+size_t Crypto::encryptInto(
+    const uint8_t* plaintext,
+    size_t plaintextSize,
+    const SecureKey& key,
+    uint8_t* output,
+    size_t outputSize
+) const {
+    TRACE_SPAN("ffi.encrypt");
+    size_t output_len = 0;
+    int32_t result;
+    
+    if (plaintext == output + container::FRAME_HEADER_SIZE) {
+        // Already laid out as a frame, so nothing needs to move
+        result = crusty::crypto::encrypt_in_place_with_handle(
+            key.handle(),
+            output, outputSize,
+            plaintextSize,
+            &output_len
+        );
+    } else {
+        result = crusty::crypto::encrypt_with_handle(
+            key.handle(),
+            plaintext, plaintextSize,
+            output, outputSize,
+            &output_len
+        );
+    }
+    
+    if (result != 0) {
+        std::string errorMsg = "Failed to encrypt data: " + getErrorMessage(result);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, mapErrorCode(result));
+    }
+    
+    return output_len;
+}
+
+size_t Crypto::decryptInto(
+    const uint8_t* ciphertext,
+    size_t ciphertextSize,
+    const SecureKey& key,
+    uint8_t* output,
+    size_t outputSize
+) const {
+    TRACE_SPAN("ffi.decrypt");
+    size_t output_len = 0;
+    int32_t result;
+    
+    if (output == ciphertext + container::FRAME_HEADER_SIZE) {
+        // Decrypt where the ciphertext is; the tag is checked detached
+        result = crusty::crypto::decrypt_in_place_with_handle(
+            key.handle(),
+            output - container::FRAME_HEADER_SIZE, ciphertextSize,
+            &output_len
+        );
+    } else {
+        result = crusty::crypto::decrypt_with_handle(
+            key.handle(),
+            ciphertext, ciphertextSize,
+            output, outputSize,
+            &output_len
+        );
+    }
+    
+    if (result != 0) {
+        std::string errorMsg = "Failed to decrypt data: " + getErrorMessage(result);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, mapErrorCode(result));
+    }
+    
+    return output_len;
+}
+
+size_t Crypto::encryptChunk(
+    const uint8_t* plaintext,
+    size_t plaintextSize,
+    const SecureKey& key,
+    const ChunkNonce& nonce,
+    uint8_t* output,
+    size_t outputSize
+) const {
+    TRACE_SPAN("ffi.encrypt_chunk");
+    size_t output_len = 0;
+    
+    int32_t result = crusty::crypto::encrypt_with_nonce(
+        key.handle(),
+        plaintext, plaintextSize,
+        nonce.data(),
+        output, outputSize,
+        &output_len
+    );
+    
+    if (result != 0) {
+        std::string errorMsg = "Failed to encrypt chunk: " + getErrorMessage(result);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, mapErrorCode(result));
+    }
+    
+    return output_len;
+}
+
+size_t Crypto::decryptChunk(
+    const uint8_t* ciphertext,
+    size_t ciphertextSize,
+    const SecureKey& key,
+    const ChunkNonce& nonce,
+    uint8_t* output,
+    size_t outputSize
+) const {
+    TRACE_SPAN("ffi.decrypt_chunk");
+    size_t output_len = 0;
+    int32_t result;
+    
+    if (output == ciphertext + container::FRAME_HEADER_SIZE) {
+        // Decrypt where the ciphertext is; the tag is checked detached
+        result = crusty::crypto::decrypt_in_place_with_nonce(
+            key.handle(),
+            output - container::FRAME_HEADER_SIZE, ciphertextSize,
+            nonce.data(),
+            &output_len
+        );
+    } else {
+        result = crusty::crypto::decrypt_with_nonce(
+            key.handle(),
+            ciphertext, ciphertextSize,
+            nonce.data(),
+            output, outputSize,
+            &output_len
+        );
+    }
+    
+    if (result == -4) { // DecryptionError: the nonce does not match
+        std::string errorMsg = "Encrypted chunk is out of place (reordered, truncated or from another file)";
+        LOG_SECURITY(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::DataCorrupted);
+    }
+    if (result != 0) {
+        std::string errorMsg = "Failed to decrypt chunk: " + getErrorMessage(result);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, mapErrorCode(result));
+    }
+    
+    return output_len;
+}
+
+void Crypto::encryptBatch(std::vector<CryptoMessage>& messages, const SecureKey& key) const {
+    runBatch(messages, key, true);
+}
+
+void Crypto::decryptBatch(std::vector<CryptoMessage>& messages, const SecureKey& key) const {
+    runBatch(messages, key, false);
+}
+
+Fingerprint Crypto::fingerprint(uint64_t context, const uint8_t* data, size_t size, const SecureKey& key) const {
+    TRACE_SPAN("ffi.fingerprint");
+    Fingerprint result{};
+    int32_t status = crusty::crypto::fingerprint_with_handle(
+        key.handle(),
+        context,
+        data, size,
+        result.data(), result.size()
+    );
+    
+    if (status != 0) {
+        std::string errorMsg = "Failed to fingerprint data: " + getErrorMessage(status);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, mapErrorCode(status));
+    }
+    return result;
+}
+
+void Crypto::runBatch(std::vector<CryptoMessage>& messages, const SecureKey& key, bool encrypting) {
+    TRACE_SPAN("ffi.batch");
+    static const uint8_t empty = 0;
+    
+    std::vector<crusty::crypto::CryptoBatchItem> items(messages.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+        const CryptoMessage& message = messages[i];
+        items[i].input_ptr = message.input ? message.input : &empty;
+        items[i].input_len = message.inputSize;
+        items[i].output_ptr = message.output;
+        items[i].output_max_len = message.outputSize;
+        items[i].output_len = 0;
+        items[i].status = 0;
+    }
+    
+    int32_t result = encrypting
+        ? crusty::crypto::encrypt_batch_with_handle(key.handle(), items.data(), items.size())
+        : crusty::crypto::decrypt_batch_with_handle(key.handle(), items.data(), items.size());
+    
+    size_t failed = 0;
+    for (size_t i = 0; i < messages.size(); ++i) {
+        messages[i].succeeded = items[i].status == 0;
+        messages[i].written = messages[i].succeeded ? items[i].output_len : 0;
+        if (!messages[i].succeeded) {
+            ++failed;
+        }
+    }
+    
+    if (result != 0) {
+        std::string errorMsg = std::string(encrypting ? "Failed to encrypt " : "Failed to decrypt ") +
+                               std::to_string(failed) + " of " + std::to_string(messages.size()) +
+                               " messages: " + getErrorMessage(result);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, mapErrorCode(result));
+    }
+}
+
+std::vector<uint8_t> Crypto::randomBytes(size_t count) const {
+    std::vector<uint8_t> output(count);
+    
+    int32_t result = crusty::crypto::fill_random_bytes(output.data(), output.size());
+    if (result != 0) {
+        std::string errorMsg = "Failed to generate random bytes: " + getErrorMessage(result);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, mapErrorCode(result));
+    }
+    
+    return output;
+}
+
+KdfParams Crypto::calibrateKdf(
+    std::chrono::milliseconds target,
+    uint32_t memoryKib,
+    uint32_t parallelism
+) const {
+    const KdfParams minimum;
+    KdfParams params;
+    params.memoryKib = std::max(memoryKib, minimum.memoryKib);
+    params.iterations = 1;
+    params.parallelism = std::min(std::max<uint32_t>(1, parallelism), container::MAX_KDF_PARALLELISM);
+    params.memoryKib = std::min(params.memoryKib, container::MAX_KDF_MEMORY_KIB);
+    
+    // Throwaway inputs; only the time matters
+    std::vector<uint8_t> salt = randomBytes(container::SALT_SIZE);
+    auto timePass = [&]() {
+        auto start = std::chrono::steady_clock::now();
+        deriveKey("calibration", salt, params);
+        return std::chrono::steady_clock::now() - start;
+    };
+    
+    std::chrono::steady_clock::duration pass = timePass();
+    while (pass > target && params.memoryKib / 2 >= minimum.memoryKib) {
+        params.memoryKib /= 2;
+        pass = timePass();
+    }
     
-    // Create a secure copy of the password
-    secure::SecureData<std::string> securePassword(password);
+    // A second run is free of first-touch page faults
+    pass = std::min(pass, timePass());
+    
+    uint64_t passes = pass.count() > 0 ? static_cast<uint64_t>(target / pass) : container::MAX_KDF_ITERATIONS;
+    params.iterations = static_cast<uint32_t>(
+        std::min<uint64_t>(std::max<uint64_t>(1, passes), container::MAX_KDF_ITERATIONS));
+    if (params.memoryKib <= minimum.memoryKib) {
+        params.iterations = std::max(params.iterations, minimum.iterations);
+    }
+    
+    LOG_EVENT(Info, "Calibrated key derivation costs",
+              {"target_ms", target.count()},
+              {"pass_us", std::chrono::duration_cast<std::chrono::microseconds>(pass).count()},
+              {"memory_kib", params.memoryKib},
+              {"iterations", params.iterations},
+              {"parallelism", params.parallelism});
+    return params;
+}
+
+std::string Crypto::hashPassword(secure::SecureView password) const {
+    LOG_SECURITY("Hashing password");
     
     constexpr size_t HASH_BUFFER_SIZE = 256;
     std::vector<uint8_t> output(HASH_BUFFER_SIZE);
     
     int32_t result = crusty::crypto::hash_password(
-        reinterpret_cast<const uint8_t*>(securePassword.get().c_str()), 
-        securePassword.get().size(),
+        password.data(), password.size(),
         output.data(), 
         output.size()
     );
@@ -166,7 +854,7 @@ std::string Crypto::hashPassword(const std::string& password) const {
 }
 
 bool Crypto::verifyPassword(
-    const std::string& password, 
+    secure::SecureView password, 
     const std::string& hash
 ) const {
     LOG_SECURITY("Verifying password");
@@ -203,49 +891,130 @@ bool Crypto::verifyPassword(
     return result;
 }
 
+AesBackend Crypto::aesBackend() {
+    switch (static_cast<crusty::crypto::AesBackend>(crusty::crypto::get_aes_backend())) {
+        case crusty::crypto::AesBackend::AesNiClmul:
+            return AesBackend::AesNiClmul;
+        case crusty::crypto::AesBackend::Armv8Crypto:
+            return AesBackend::Armv8Crypto;
+        default:
+            return AesBackend::Software;
+    }
+}
+
+const char* Crypto::aesBackendName(AesBackend backend) {
+    switch (backend) {
+        case AesBackend::AesNiClmul:
+            return "AES-NI + PCLMULQDQ";
+        case AesBackend::Armv8Crypto:
+            return "ARMv8 AES + PMULL";
+        default:
+            return "software";
+    }
+}
+
+void Crypto::warmUp() {
+    // Created first so it outlives the probe, which the future waits for at exit
+    AuditLog::getInstance();
+    
+    static std::future<void> probe = []() {
+        try {
+            return std::async(std::launch::async, probeBackend);
+        } catch (const std::system_error&) {
+            return std::future<void>();   // The first Encryptor probes instead
+        }
+    }();
+    (void)probe;
+}
+
+void Crypto::requireHardwareAcceleration() {
+    int32_t result = crusty::crypto::require_hardware_aes();
+    if (result != 0) {
+        std::string errorMsg = "AES-GCM is not hardware accelerated on this CPU: " + getErrorMessage(result);
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, mapErrorCode(result));
+    }
+}
+
 //
 // Encryptor implementation
 //
 
 Encryptor::Encryptor() 
-    : crypto_(std::make_unique<Crypto>()) {
+    : crypto_(std::make_unique<Crypto>()),
+      buffer_pool_(std::make_shared<secure::SecureBufferPool>()),
+      file_system_(std::make_shared<FileSystem>()),
+      stats_(std::make_shared<EncryptorStats>()) {
+    // Probes here unless Crypto::warmUp() got to it first
+    probeBackend();
 }
 
 Encryptor::Encryptor(std::unique_ptr<Crypto> crypto) 
-    : crypto_(std::move(crypto)) {
+    : crypto_(std::move(crypto)),
+      buffer_pool_(std::make_shared<secure::SecureBufferPool>()),
+      file_system_(std::make_shared<FileSystem>()),
+      stats_(std::make_shared<EncryptorStats>()) {
+}
+
+Encryptor::~Encryptor() {
+    // Queued operations complete as cancelled; running ones stop at their
+    // next check, and are waited for while the engine is still whole
+    async_queue_.reset();
 }
 
 void Encryptor::encryptFile(
     const std::string& sourcePath,
     const std::string& destPath,
-    const std::string& password,
+    secure::SecureView password,
     ProgressCallback progressCallback
+) {
+    encryptFile(sourcePath, destPath, password, fractionCallback(std::move(progressCallback)));
+}
+
+void Encryptor::encryptFile(
+    const std::string& sourcePath,
+    const std::string& destPath,
+    secure::SecureView password,
+    DetailedProgressCallback progressCallback
 ) {
     try {
+        OperationRecorder recorder(stats_.get(), EncryptorStats::Operation::Encrypt);
+        ProgressReporter progress(std::move(progressCallback), progress_settings_);
+        
         // Sanitize paths
-        std::string sanitizedSourcePath = PathUtils::sanitizePath(sourcePath);
-        std::string sanitizedDestPath = PathUtils::sanitizePath(destPath);
+        std::string sanitizedSourcePath = sanitizePath(sourcePath);
+        std::string sanitizedDestPath = sanitizePath(destPath);
         
         LOG_SECURITY("Encrypting file: " + sanitizedSourcePath + " -> " + sanitizedDestPath);
         
         // Check if source file exists
-        if (!std::filesystem::exists(sanitizedSourcePath)) {
+        if (!file_system_->fileExists(sanitizedSourcePath)) {
             std::string errorMsg = "Source file does not exist: " + sanitizedSourcePath;
             LOG_ERROR(errorMsg);
             throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
         }
         
         // Check if destination file already exists
-        if (std::filesystem::exists(sanitizedDestPath)) {
+        if (file_system_->fileExists(sanitizedDestPath)) {
             std::string errorMsg = "Destination file already exists: " + sanitizedDestPath;
             LOG_ERROR(errorMsg);
             throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
         }
         
         // Process the file in chunks to handle large files
-        processFileInChunks(sanitizedSourcePath, sanitizedDestPath, password, true, progressCallback);
+        processFileInChunks(sanitizedSourcePath, sanitizedDestPath, password, true, progress, recorder);
+        progress.finish();
+        recorder.succeed();
         
         LOG_SECURITY("File encrypted successfully");
+    } catch (const OperationCancelled&) {
+        LOG_SECURITY("File encryption cancelled");
+        throw;
+    } catch (const EncryptionException& e) {
+        // Keep the code, so callers can tell a wrong password from a failed write
+        std::string errorMsg = "Failed to encrypt file: " + std::string(e.what());
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, e.getErrorCode());
     } catch (const std::exception& e) {
         std::string errorMsg = "Failed to encrypt file: " + std::string(e.what());
         LOG_ERROR(errorMsg);
@@ -256,34 +1025,55 @@ void Encryptor::encryptFile(
 void Encryptor::decryptFile(
     const std::string& sourcePath,
     const std::string& destPath,
-    const std::string& password,
+    secure::SecureView password,
     ProgressCallback progressCallback
+) {
+    decryptFile(sourcePath, destPath, password, fractionCallback(std::move(progressCallback)));
+}
+
+void Encryptor::decryptFile(
+    const std::string& sourcePath,
+    const std::string& destPath,
+    secure::SecureView password,
+    DetailedProgressCallback progressCallback
 ) {
     try {
+        OperationRecorder recorder(stats_.get(), EncryptorStats::Operation::Decrypt);
+        ProgressReporter progress(std::move(progressCallback), progress_settings_);
+        
         // Sanitize paths
-        std::string sanitizedSourcePath = PathUtils::sanitizePath(sourcePath);
-        std::string sanitizedDestPath = PathUtils::sanitizePath(destPath);
+        std::string sanitizedSourcePath = sanitizePath(sourcePath);
+        std::string sanitizedDestPath = sanitizePath(destPath);
         
         LOG_SECURITY("Decrypting file: " + sanitizedSourcePath + " -> " + sanitizedDestPath);
         
         // Check if source file exists
-        if (!std::filesystem::exists(sanitizedSourcePath)) {
+        if (!file_system_->fileExists(sanitizedSourcePath)) {
             std::string errorMsg = "Source file does not exist: " + sanitizedSourcePath;
             LOG_ERROR(errorMsg);
             throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
         }
         
         // Check if destination file already exists
-        if (std::filesystem::exists(sanitizedDestPath)) {
+        if (file_system_->fileExists(sanitizedDestPath)) {
             std::string errorMsg = "Destination file already exists: " + sanitizedDestPath;
             LOG_ERROR(errorMsg);
             throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
         }
         
         // Process the file in chunks to handle large files
-        processFileInChunks(sanitizedSourcePath, sanitizedDestPath, password, false, progressCallback);
+        processFileInChunks(sanitizedSourcePath, sanitizedDestPath, password, false, progress, recorder);
+        progress.finish();
+        recorder.succeed();
         
         LOG_SECURITY("File decrypted successfully");
+    } catch (const OperationCancelled&) {
+        LOG_SECURITY("File decryption cancelled");
+        throw;
+    } catch (const EncryptionException& e) {
+        std::string errorMsg = "Failed to decrypt file: " + std::string(e.what());
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, e.getErrorCode());
     } catch (const std::exception& e) {
         std::string errorMsg = "Failed to decrypt file: " + std::string(e.what());
         LOG_ERROR(errorMsg);
@@ -291,100 +1081,2342 @@ void Encryptor::decryptFile(
     }
 }
 
-void Encryptor::setChunkSize(size_t bytes) {
-    if (bytes == 0) {
-        LOG_WARNING("Attempted to set chunk size to 0, ignoring");
-        return;
+AsyncOperation Encryptor::encryptFileAsync(
+    const std::string& sourcePath,
+    const std::string& destPath,
+    secure::SecureView password,
+    CompletionCallback onComplete,
+    DetailedProgressCallback progressCallback
+) {
+    return startAsync("Encrypt " + sourcePath, password,
+        [this, sourcePath, destPath, progressCallback = std::move(progressCallback)](secure::SecureView secret) {
+            encryptFile(sourcePath, destPath, secret, progressCallback);
+        },
+        std::move(onComplete));
+}
+
+AsyncOperation Encryptor::decryptFileAsync(
+    const std::string& sourcePath,
+    const std::string& destPath,
+    secure::SecureView password,
+    CompletionCallback onComplete,
+    DetailedProgressCallback progressCallback
+) {
+    return startAsync("Decrypt " + sourcePath, password,
+        [this, sourcePath, destPath, progressCallback = std::move(progressCallback)](secure::SecureView secret) {
+            decryptFile(sourcePath, destPath, secret, progressCallback);
+        },
+        std::move(onComplete));
+}
+
+AsyncOperation Encryptor::startAsync(
+    std::string description,
+    secure::SecureView password,
+    std::function<void(secure::SecureView password)> operation,
+    CompletionCallback onComplete
+) {
+    auto state = std::make_shared<AsyncState>();
+    state->onComplete = std::move(onComplete);
+    std::shared_future<void> future = state->promise.get_future().share();
+    auto pending = std::make_shared<PendingOperation>();
+    pending->state = state;
+    
+    // The caller's password may be gone by the time the job runs
+    auto secret = std::make_shared<const secure::SecureData<std::string>>(
+        std::string(reinterpret_cast<const char*>(password.data()), password.size()));
+    auto token = std::make_shared<CancellationToken>(cancellation_);
+    
+    JobQueue* queue;
+    {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        if (!async_queue_) {
+            async_queue_ = std::make_unique<JobQueue>(
+                async_worker_count_ != 0 ? async_worker_count_ : JobQueue::DEFAULT_WORKERS);
+        }
+        queue = async_queue_.get();
     }
     
-    chunk_size_ = bytes;
-    LOG_INFO("Chunk size set to " + std::to_string(chunk_size_) + " bytes");
+    uint64_t id = queue->submit(std::move(description),
+        [this, pending, secret, operation = std::move(operation)](
+            uint64_t, const std::shared_ptr<const CancellationToken>& jobToken) {
+            std::shared_ptr<AsyncState> state = std::move(pending->state);
+            ActiveOperation outer = activeOperation;
+            activeOperation = {this, jobToken.get()};
+            std::exception_ptr error;
+            try {
+                // Cancelled while queued: end before touching either file
+                jobToken->throwIfCancelled();
+                operation(*secret);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            activeOperation = outer;
+            
+            state->complete(error);
+            if (error) {
+                // Lets the queue log how the job ended
+                std::rethrow_exception(error);
+            }
+        },
+        token);
+    return AsyncOperation(id, std::move(future), std::move(token));
+}
+
+void Encryptor::encryptStream(
+    std::istream& source,
+    std::ostream& dest,
+    secure::SecureView password,
+    ProgressCallback progressCallback,
+    uint64_t sourceSize
+) {
+    encryptStream(source, dest, password, fractionCallback(std::move(progressCallback)), sourceSize);
 }
 
-std::vector<uint8_t> Encryptor::readFileChunk(std::istream& file, size_t size) {
-    std::vector<uint8_t> buffer(size);
-    file.read(reinterpret_cast<char*>(buffer.data()), size);
+void Encryptor::encryptStream(
+    std::istream& source,
+    std::ostream& dest,
+    secure::SecureView password,
+    DetailedProgressCallback progressCallback,
+    uint64_t sourceSize
+) {
+    try {
+        LOG_EVENT(SecurityEvent, "Encrypting stream", {"bytes", sourceSize});
+        
+        OperationRecorder recorder(stats_.get(), EncryptorStats::Operation::Encrypt);
+        ProgressReporter progress(std::move(progressCallback), progress_settings_, sourceSize);
+        processStream(source, dest, password, true, progress, recorder);
+        progress.finish();
+        recorder.succeed();
+        
+        LOG_SECURITY("Stream encrypted successfully");
+    } catch (const OperationCancelled&) {
+        LOG_SECURITY("Stream encryption cancelled");
+        throw;
+    } catch (const EncryptionException& e) {
+        LOG_ERROR("Failed to encrypt stream: " + std::string(e.what()));
+        throw;
+    } catch (const std::exception& e) {
+        std::string errorMsg = "Failed to encrypt stream: " + std::string(e.what());
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
+    }
+}
+
+void Encryptor::decryptStream(
+    std::istream& source,
+    std::ostream& dest,
+    secure::SecureView password,
+    ProgressCallback progressCallback,
+    uint64_t sourceSize
+) {
+    decryptStream(source, dest, password, fractionCallback(std::move(progressCallback)), sourceSize);
+}
+
+void Encryptor::decryptStream(
+    std::istream& source,
+    std::ostream& dest,
+    secure::SecureView password,
+    DetailedProgressCallback progressCallback,
+    uint64_t sourceSize
+) {
+    try {
+        LOG_EVENT(SecurityEvent, "Decrypting stream", {"bytes", sourceSize});
+        
+        OperationRecorder recorder(stats_.get(), EncryptorStats::Operation::Decrypt);
+        ProgressReporter progress(std::move(progressCallback), progress_settings_, sourceSize);
+        processStream(source, dest, password, false, progress, recorder);
+        progress.finish();
+        recorder.succeed();
+        
+        LOG_SECURITY("Stream decrypted successfully");
+    } catch (const OperationCancelled&) {
+        LOG_SECURITY("Stream decryption cancelled");
+        throw;
+    } catch (const EncryptionException& e) {
+        LOG_ERROR("Failed to decrypt stream: " + std::string(e.what()));
+        throw;
+    } catch (const std::exception& e) {
+        std::string errorMsg = "Failed to decrypt stream: " + std::string(e.what());
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
+    }
+}
+
+std::unique_ptr<EncryptStream> Encryptor::openEncryptStream(secure::SecureView password) {
+    LOG_SECURITY("Opening encryption stream");
+    container::FileHeader header = newHeader();
+    std::shared_ptr<const SecureKey> key = newContainerKey(password, header);
+    return std::make_unique<EncryptStream>(*this, header, std::move(key), compression_, buffer_pool_);
+}
+
+std::unique_ptr<DecryptStream> Encryptor::openDecryptStream(secure::SecureView password) {
+    LOG_SECURITY("Opening decryption stream");
+    return std::make_unique<DecryptStream>(*this, password, buffer_pool_);
+}
+
+uint64_t Encryptor::decryptRange(
+    const std::string& sourcePath,
+    uint64_t offset,
+    uint64_t length,
+    std::ostream& dest,
+    secure::SecureView password
+) {
+    using Phase = EncryptorStats::Phase;
     
-    // Resize buffer to actual bytes read
-    size_t bytesRead = file.gcount();
-    buffer.resize(bytesRead);
+    try {
+        OperationRecorder recorder(stats_.get(), EncryptorStats::Operation::Decrypt);
+        std::string sanitizedPath = sanitizePath(sourcePath);
+        
+        LOG_EVENT(SecurityEvent, "Decrypting range",
+                  {"path", sanitizedPath},
+                  {"offset", offset},
+                  {"bytes", length});
+        if (const CancellationToken* token = cancellationToken()) {
+            token->throwIfCancelled();
+        }
+        
+        std::unique_ptr<EncryptedFileReader> reader = openEncrypted(sanitizedPath, password, recorder);
+        uint64_t plaintextSize = reader->size();
+        uint64_t chunkCount = reader->info().chunkOffsets.size();
+        uint64_t chunkSize = reader->info().header.chunkSize;
+        if (offset >= plaintextSize || length == 0) {
+            recorder.succeed();
+            return 0;
+        }
+        uint64_t end = offset + std::min(length, plaintextSize - offset);
+        uint64_t first = offset / chunkSize;
+        uint64_t last = (end - 1) / chunkSize;
+        
+        size_t workers = thread_pool_ ? thread_pool_->size() : 1;
+        size_t maxInFlight = max_in_flight_chunks_ > 0 ? max_in_flight_chunks_ : 2 * workers;
+        
+        // Pipeline indices count from the first covering chunk
+        ChunkPipeline pipeline(thread_pool_.get(), maxInFlight,
+            [&](PipelineChunk& chunk) {
+                chunk.offset = recorder.time(Phase::Crypto, [&] { return reader->openChunk(first + chunk.index, chunk.data); });
+            },
+            [&](PipelineChunk& chunk) {
+                // Only the ends of the range cut into a chunk
+                uint64_t chunkStart = (first + chunk.index) * chunkSize;
+                uint64_t from = std::max(offset, chunkStart) - chunkStart;
+                uint64_t to = std::min(end, chunkStart + chunkSize) - chunkStart;
+                size_t size = static_cast<size_t>(to - from);
+                recorder.time(Phase::Write, [&] {
+                    writeFileChunk(dest, chunk.data.data() + chunk.offset + from, size);
+                });
+                recorder.addChunk(chunk.inputSize, size);
+            },
+            buffer_pool_.get());
+        pipeline.setCancellationToken(cancellationToken());
+        pipeline.setMemoryBudget(memory_budget_.get());
+        
+        for (uint64_t index = first; index <= last; ++index) {
+            std::vector<uint8_t> frame = recorder.time(Phase::Read, [&] { return reader->readChunk(index); });
+            size_t recordLength = frame.size();
+            pipeline.push({index - first, index + 1 == chunkCount, std::move(frame), 0, recordLength});
+        }
+        pipeline.finish();
+        
+        recorder.time(Phase::Write, [&] { dest.flush(); });
+        if (!dest) {
+            throw EncryptionException("Failed to write output", CryptoErrorCode::IoError);
+        }
+        recorder.succeed();
+        
+        LOG_SECURITY("Range decrypted successfully");
+        return end - offset;
+    } catch (const OperationCancelled&) {
+        LOG_SECURITY("Range decryption cancelled");
+        throw;
+    } catch (const EncryptionException& e) {
+        LOG_ERROR("Failed to decrypt range: " + std::string(e.what()));
+        throw;
+    } catch (const std::exception& e) {
+        std::string errorMsg = "Failed to decrypt range: " + std::string(e.what());
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
+    }
+}
+
+std::unique_ptr<EncryptedFileReader> Encryptor::openEncryptedFile(const std::string& path, secure::SecureView password) const {
+    OperationRecorder recorder(nullptr, EncryptorStats::Operation::Decrypt);
+    return openEncrypted(sanitizePath(path), password, recorder);
+}
+
+VerifyResult Encryptor::verifyFile(
+    const std::string& path,
+    secure::SecureView password,
+    ProgressCallback progressCallback,
+    uint64_t sampleChunks
+) {
+    return verifyFile(path, password, fractionCallback(std::move(progressCallback)), sampleChunks);
+}
+
+VerifyResult Encryptor::verifyFile(
+    const std::string& path,
+    secure::SecureView password,
+    DetailedProgressCallback progressCallback,
+    uint64_t sampleChunks
+) {
+    using Phase = EncryptorStats::Phase;
     
-    return buffer;
+    try {
+        OperationRecorder recorder(stats_.get(), EncryptorStats::Operation::Verify);
+        ProgressReporter progress(std::move(progressCallback), progress_settings_);
+        std::string sanitizedPath = sanitizePath(path);
+        
+        LOG_SECURITY("Verifying file: " + sanitizedPath);
+        if (const CancellationToken* token = cancellationToken()) {
+            token->throwIfCancelled();
+        }
+        
+        // The index validates the framing of every record and gives their offsets
+        std::unique_ptr<FileReader> source = openSourceFile(*file_system_, sanitizedPath, file_caching_);
+        container::ContainerInfo info;
+        {
+            FileReaderStreamBuf sourceBuffer(*source);
+            std::istream sourceFile(&sourceBuffer);
+            info = recorder.time(Phase::Read, [&] { return container::ContainerReader(sourceFile).readIndex(); });
+        }
+        uint64_t chunkCount = info.chunkOffsets.size();
+        uint64_t indexOffset = info.fileSize - container::footerSize(chunkCount);
+        auto recordLength = [&](uint64_t index) {
+            uint64_t end = index + 1 == chunkCount ? indexOffset : info.chunkOffsets[index + 1];
+            return static_cast<size_t>(end - info.chunkOffsets[index]);
+        };
+        
+        std::vector<uint64_t> chunks = verifiedChunks(chunkCount, sampleChunks);
+        VerifyResult result;
+        result.chunkCount = chunkCount;
+        result.chunksVerified = chunks.size();
+        result.plaintextSize = info.plaintextSize;
+        for (uint64_t index : chunks) {
+            result.bytesVerified += recordLength(index);
+        }
+        progress.setTotal(result.bytesVerified);
+        
+        std::shared_ptr<const SecureKey> fileKey = recorder.time(Phase::Kdf, [&] { return decryptionKey(password, info.header); });
+        const SecureKey& key = *fileKey;
+        container::checkRecordPrefixes(*crypto_, key, info.header, info.noncePrefixes);
+        recorder.addBytes(info.chunkOffsets.front() + container::footerSize(chunkCount), 0);
+        
+        size_t workers = thread_pool_ ? thread_pool_->size() : 1;
+        size_t maxInFlight = max_in_flight_chunks_ > 0 ? max_in_flight_chunks_ : 2 * workers;
+        bool compressed = info.header.compression != Compression::None;
+        uint64_t plaintextTotal = 0;
+        
+        // Pipeline indices count the checked chunks; the nonce needs each
+        // chunk's place in the file
+        ChunkPipeline pipeline(thread_pool_.get(), maxInFlight,
+            [&](PipelineChunk& chunk) {
+                uint64_t index = chunks[chunk.index];
+                uint8_t* frame = chunk.data.data();
+                if (chunk.isFinal) {
+                    container::clearFinalFlag(frame);
+                }
+                size_t plaintextSize = 0;
+                try {
+                    plaintextSize = recorder.time(Phase::Crypto, [&] {
+                        return crypto_->decryptChunk(frame, chunk.data.size(), key,
+                                                     container::chunkNonce(info, index, chunk.isFinal),
+                                                     frame + container::FRAME_HEADER_SIZE,
+                                                     chunk.data.size() - container::FRAME_HEADER_SIZE);
+                    });
+                } catch (const EncryptionException& e) {
+                    throw EncryptionException("Chunk " + std::to_string(index) + " of " + std::to_string(chunkCount) +
+                                              " failed verification: " + e.what(), e.getErrorCode());
+                }
+                chunk.data.resize(container::FRAME_HEADER_SIZE + plaintextSize);
+                chunk.offset = container::FRAME_HEADER_SIZE;
+            },
+            [&](PipelineChunk& chunk) {
+                if (compressed) {
+                    uint8_t encoding = 0;
+                    plaintextTotal += container::checkChunkPrefix(info.header, chunk.data.data() + chunk.offset,
+                                                                  chunk.data.size() - chunk.offset, chunk.isFinal,
+                                                                  encoding);
+                }
+                recorder.addChunk(chunk.inputSize, 0);
+                progress.add(chunk.inputSize);
+            },
+            buffer_pool_.get());
+        pipeline.setCancellationToken(cancellationToken());
+        pipeline.setMemoryBudget(memory_budget_.get());
+        
+        for (uint64_t i = 0; i < chunks.size(); ++i) {
+            uint64_t index = chunks[i];
+            size_t length = recordLength(index);
+            std::vector<uint8_t> frame = buffer_pool_->acquire(length);
+            size_t read = recorder.time(Phase::Read, [&] { return source->readAt(info.chunkOffsets[index], frame.data(), length); });
+            if (read != length) {
+                throw EncryptionException("Encrypted file changed while reading", CryptoErrorCode::IoError);
+            }
+            pipeline.push({i, index + 1 == chunkCount, std::move(frame), 0, length});
+        }
+        pipeline.finish();
+        
+        // The index holds the plaintext size, but only compressed records
+        // keep theirs inside the ciphertext
+        if (compressed && result.complete() && plaintextTotal != info.plaintextSize) {
+            throw EncryptionException("Plaintext size does not match the chunk index", CryptoErrorCode::DataCorrupted);
+        }
+        progress.finish();
+        recorder.succeed();
+        
+        LOG_EVENT(SecurityEvent, "File verified",
+                  {"path", sanitizedPath},
+                  {"chunks", result.chunksVerified},
+                  {"chunk_count", result.chunkCount});
+        return result;
+    } catch (const OperationCancelled&) {
+        LOG_SECURITY("File verification cancelled");
+        throw;
+    } catch (const EncryptionException& e) {
+        LOG_ERROR("Failed to verify file: " + std::string(e.what()));
+        throw;
+    } catch (const std::exception& e) {
+        std::string errorMsg = "Failed to verify file: " + std::string(e.what());
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
+    }
 }
 
-void Encryptor::writeFileChunk(std::ostream& file, const std::vector<uint8_t>& data) {
-    if (!file.write(reinterpret_cast<const char*>(data.data()), data.size())) {
-        throw EncryptionException("Failed to write to file", CryptoErrorCode::IoError);
+// State of the incremental container an update starts from
+struct Encryptor::PreviousVersion {
+    container::ContainerInfo info;
+    container::ChunkManifest manifest;
+    std::shared_ptr<const SecureKey> key;
+};
+
+std::unique_ptr<Encryptor::PreviousVersion> Encryptor::openPreviousVersion(
+    const std::string& path,
+    secure::SecureView password,
+    OperationRecorder& recorder
+) const {
+    using Phase = EncryptorStats::Phase;
+    
+    if (!file_system_->fileExists(path)) {
+        return nullptr;
+    }
+    
+    // Anything but an intact incremental container is simply replaced
+    std::unique_ptr<FileReader> source = openSourceFile(*file_system_, path, file_caching_);
+    auto previous = std::make_unique<PreviousVersion>();
+    try {
+        FileReaderStreamBuf sourceBuffer(*source);
+        std::istream sourceFile(&sourceBuffer);
+        previous->info = recorder.time(Phase::Read, [&] { return container::ContainerReader(sourceFile).readIndex(); });
+    } catch (const EncryptionException& e) {
+        LOG_EVENT(Warning, "Encrypted file is unreadable, encrypting it again", {"path", path}, {"error", e.what()});
+        return nullptr;
+    }
+    const container::ContainerInfo& info = previous->info;
+    if (!container::isIncremental(info.header)) {
+        LOG_EVENT(Info, "Encrypted file is not incremental, encrypting it again", {"path", path});
+        return nullptr;
+    }
+    try {
+        previous->key = recorder.time(Phase::Kdf, [&] { return decryptionKey(password, info.header); });
+    } catch (const EncryptionException& e) {
+        if (e.getErrorCode() != CryptoErrorCode::InvalidPassword) {
+            throw;
+        }
+        throw EncryptionException("Password does not match the existing encrypted file " + path +
+                                  "; remove it to encrypt under a new password (" + e.what() + ")",
+                                  e.getErrorCode());
+    }
+    
+    // The manifest's MAC proves the password; it must also describe this
+    // version of the file
+    std::string manifestPath = path + container::MANIFEST_SUFFIX;
+    try {
+        previous->manifest = readManifest(*file_system_, *crypto_, manifestPath, *previous->key);
+        const container::ChunkManifest& manifest = previous->manifest;
+        if (manifest.chunkSize == info.header.chunkSize && manifest.salt == info.header.salt &&
+            manifest.plaintextSize == info.plaintextSize && manifest.entries.size() == info.chunkOffsets.size()) {
+            return previous;
+        }
+        LOG_EVENT(Warning, "Chunk manifest is out of date, encrypting the whole file", {"path", manifestPath});
+    } catch (const EncryptionException& e) {
+        LOG_EVENT(Warning, "Chunk manifest unusable, encrypting the whole file", {"path", manifestPath},
+                  {"error", e.what()});
+    } catch (const FileOperationException& e) {
+        LOG_EVENT(Warning, "Chunk manifest unreadable, encrypting the whole file", {"path", manifestPath},
+                  {"error", e.what()});
+    }
+    
+    // Without a manifest, the last record still tells a wrong password from
+    // a lost manifest; it is rewritten by every update, so it authenticates
+    // even after an interrupted one
+    uint64_t last = info.chunkOffsets.size() - 1;
+    EncryptedFileReader reader(std::move(source), info, *crypto_, previous->key, buffer_pool_);
+    std::vector<uint8_t> frame = recorder.time(Phase::Read, [&] { return reader.readChunk(last); });
+    try {
+        recorder.time(Phase::Crypto, [&] { reader.openChunk(last, frame); });
+    } catch (const EncryptionException& e) {
+        buffer_pool_->release(std::move(frame));
+        throw EncryptionException("Password does not match the existing encrypted file " + path +
+                                  "; remove it to encrypt under a new password (" + e.what() + ")",
+                                  e.getErrorCode());
     }
+    buffer_pool_->release(std::move(frame));
+    return nullptr;
 }
 
-void Encryptor::processFileInChunks(
+UpdateResult Encryptor::updateFile(
     const std::string& sourcePath,
     const std::string& destPath,
-    const std::string& password,
-    bool encrypting,
+    secure::SecureView password,
     ProgressCallback progressCallback
 ) {
-    // Create a secure copy of the password
-    secure::SecureData<std::string> securePassword(password);
+    return updateFile(sourcePath, destPath, password, fractionCallback(std::move(progressCallback)));
+}
+
+UpdateResult Encryptor::updateFile(
+    const std::string& sourcePath,
+    const std::string& destPath,
+    secure::SecureView password,
+    DetailedProgressCallback progressCallback
+) {
+    using Phase = EncryptorStats::Phase;
+    
+    try {
+        OperationRecorder recorder(stats_.get(), EncryptorStats::Operation::Encrypt);
+        ProgressReporter progress(std::move(progressCallback), progress_settings_);
+        std::string sanitizedSource = sanitizePath(sourcePath);
+        std::string sanitizedDest = sanitizePath(destPath);
+        
+        LOG_SECURITY("Updating encrypted file: " + sanitizedSource + " -> " + sanitizedDest);
+        if (const CancellationToken* token = cancellationToken()) {
+            token->throwIfCancelled();
+        }
+        if (compression_.algorithm != Compression::None) {
+            LOG_WARNING("Incremental containers are not compressed; ignoring the compression setting");
+        }
+        
+        // An update keeps the salt and chunk size, so the key and every
+        // unchanged record stay valid. Rewritten records get a prefix drawn
+        // for this run, random like the header's, so no nonce repeats
+        std::unique_ptr<PreviousVersion> previous = openPreviousVersion(sanitizedDest, password, recorder);
+        container::FileHeader header;
+        std::shared_ptr<const SecureKey> fileKey;
+        container::NoncePrefix writePrefix{};
+        if (previous) {
+            header = previous->info.header;
+            fileKey = previous->key;
+            std::vector<uint8_t> prefix = crypto_->randomBytes(container::NONCE_PREFIX_SIZE);
+            std::copy(prefix.begin(), prefix.end(), writePrefix.begin());
+        } else {
+            header.chunkSize = static_cast<uint32_t>(chunk_size_);
+            header.flags = container::FLAG_INCREMENTAL;
+            header.headerSize = container::INCREMENTAL_HEADER_SIZE;
+            fileKey = recorder.time(Phase::Kdf, [&] { return newContainerKey(password, header); });
+            writePrefix = header.noncePrefix;
+        }
+        const SecureKey& key = *fileKey;
+        
+        std::unique_ptr<FileReader> source = openSourceFile(*file_system_, sanitizedSource, file_caching_);
+        uint64_t fileSize = source->size();
+        container::ContainerLayout layout = container::layoutFor(fileSize, header.chunkSize,
+                                                                 container::encodedHeaderSize(header));
+        uint64_t chunkCount = layout.chunkCount;
+        progress.setTotal(fileSize);
+        
+        // Only chunks that were whole in both versions can be kept; the
+        // nonce of the last one marks it final
+        uint64_t reusable = 0;
+        if (previous) {
+            reusable = std::min<uint64_t>(previous->info.chunkOffsets.size(), chunkCount) - 1;
+        }
+        
+        // Updates write in place; a new file goes through a temporary one
+        std::unique_ptr<AtomicOutput> output;
+        std::unique_ptr<FileWriter> dest;
+        if (previous) {
+            try {
+                dest = file_system_->openForUpdate(sanitizedDest, file_caching_);
+            } catch (const FileOperationException& e) {
+                throw EncryptionException("Failed to open destination file: " + sanitizedDest + " (" + e.what() + ")",
+                                          CryptoErrorCode::IoError);
+            }
+        } else {
+            output = std::make_unique<AtomicOutput>(*file_system_, sanitizedDest);
+            dest = openDestFile(*file_system_, output->tempPath(), layout.totalSize, file_caching_);
+        }
+        
+        UpdateResult result;
+        result.chunkCount = chunkCount;
+        result.incremental = previous != nullptr;
+        std::vector<container::NoncePrefix> prefixes(static_cast<size_t>(chunkCount));
+        std::vector<Fingerprint> fingerprints(static_cast<size_t>(chunkCount));
+        std::vector<uint8_t> rewritten(static_cast<size_t>(chunkCount), 0);
+        
+        size_t workers = thread_pool_ ? thread_pool_->size() : 1;
+        size_t maxInFlight = max_in_flight_chunks_ > 0 ? max_in_flight_chunks_ : 2 * workers;
+        
+        // A chunk is kept only if its record is the one the manifest saw;
+        // after an interrupted update it may not be
+        ChunkPipeline pipeline(thread_pool_.get(), maxInFlight,
+            [&](PipelineChunk& chunk) {
+                uint64_t index = chunk.index;
+                uint8_t* frame = chunk.data.data();
+                Fingerprint fingerprint = recorder.time(Phase::Crypto, [&] {
+                    return crypto_->fingerprint(index, frame + container::FRAME_HEADER_SIZE, chunk.inputSize, key);
+                });
+                fingerprints[index] = fingerprint;
+                
+                if (index < reusable) {
+                    const container::ManifestEntry& entry = previous->manifest.entries[index];
+                    if (entry.noncePrefix == previous->info.noncePrefixes[index] && entry.fingerprint == fingerprint) {
+                        return;
+                    }
+                }
+                recorder.time(Phase::Crypto, [&] {
+                    crypto_->encryptChunk(frame + container::FRAME_HEADER_SIZE, chunk.inputSize, key,
+                                          container::chunkNonce(writePrefix, index, chunk.isFinal),
+                                          frame, chunk.data.size());
+                });
+                if (chunk.isFinal) {
+                    container::setFinalFlag(frame);
+                }
+                rewritten[index] = 1;
+            },
+            [&](PipelineChunk& chunk) {
+                uint64_t index = chunk.index;
+                size_t written = 0;
+                if (rewritten[index]) {
+                    written = chunk.data.size();
+                    recorder.time(Phase::Write, [&] {
+                        dest->writeAt(layout.chunkOffset(index, header.chunkSize), chunk.data.data(), written);
+                    });
+                    prefixes[index] = writePrefix;
+                    ++result.chunksRewritten;
+                } else {
+                    prefixes[index] = previous->info.noncePrefixes[index];
+                }
+                result.bytesWritten += written;
+                recorder.addChunk(chunk.inputSize, written);
+                progress.add(chunk.inputSize);
+            },
+            buffer_pool_.get());
+        pipeline.setCancellationToken(cancellationToken());
+        pipeline.setMemoryBudget(memory_budget_.get());
+        
+        for (uint64_t index = 0; index < chunkCount; ++index) {
+            size_t plaintextSize = static_cast<size_t>(index + 1 == chunkCount ? layout.lastChunkSize : header.chunkSize);
+            std::vector<uint8_t> frame = buffer_pool_->acquire(container::recordSize(plaintextSize));
+            size_t read = recorder.time(Phase::Read, [&] {
+                return source->readAt(index * header.chunkSize, frame.data() + container::FRAME_HEADER_SIZE, plaintextSize);
+            });
+            if (read != plaintextSize) {
+                throw EncryptionException("Source file changed while reading", CryptoErrorCode::IoError);
+            }
+            pipeline.push({index, index + 1 == chunkCount, std::move(frame), 0, plaintextSize});
+        }
+        pipeline.finish();
+        
+        // The header goes last: until its MAC covers the new records,
+        // readers reject the file rather than mix two versions
+        std::vector<uint64_t> chunkOffsets(static_cast<size_t>(chunkCount));
+        for (uint64_t index = 0; index < chunkCount; ++index) {
+            chunkOffsets[index] = layout.chunkOffset(index, header.chunkSize);
+        }
+        std::vector<uint8_t> footer(container::footerSize(chunkCount));
+        container::encodeFooter(chunkOffsets, fileSize, footer.data());
+        header.recordMac = container::recordMac(*crypto_, key, prefixes);
+        if (container::hasKeyCheck(header)) {
+            header.keyCheck = container::keyCheck(*crypto_, key, header);
+        }
+        std::vector<uint8_t> headerBytes(container::encodedHeaderSize(header));
+        container::encodeHeader(header, headerBytes.data());
+        recorder.time(Phase::Write, [&] {
+            dest->writeAt(layout.footerOffset, footer.data(), footer.size());
+            if (previous && layout.totalSize < previous->info.fileSize) {
+                dest->truncate(layout.totalSize);
+            }
+            dest->writeAt(0, headerBytes.data(), headerBytes.size());
+        });
+        result.bytesWritten += headerBytes.size() + footer.size();
+        recorder.addBytes(0, headerBytes.size() + footer.size());
+        
+        // Not left to a sync group: the manifest must not land before the file
+        bool durable = output_sync_ != OutputSync::None;
+        try {
+            if (durable) {
+                dest->sync();
+            }
+            dest->close();
+            if (output) {
+                output->commit(durable);
+            }
+        } catch (const FileOperationException& e) {
+            throw EncryptionException("Failed to store destination file: " + sanitizedDest + " (" + e.what() + ")",
+                                      CryptoErrorCode::IoError);
+        }
+        
+        // A missing manifest only costs the next update a full pass
+        container::ChunkManifest manifest;
+        manifest.chunkSize = header.chunkSize;
+        manifest.plaintextSize = fileSize;
+        manifest.salt = header.salt;
+        manifest.entries.resize(static_cast<size_t>(chunkCount));
+        for (uint64_t index = 0; index < chunkCount; ++index) {
+            manifest.entries[index] = {prefixes[index], fingerprints[index]};
+        }
+        std::string manifestPath = sanitizedDest + container::MANIFEST_SUFFIX;
+        try {
+            writeManifest(*file_system_, *crypto_, manifestPath, manifest, key, durable);
+        } catch (const FileOperationException& e) {
+            LOG_EVENT(Warning, "Failed to write chunk manifest", {"path", manifestPath}, {"error", e.what()});
+        }
+        progress.finish();
+        recorder.succeed();
+        
+        LOG_EVENT(SecurityEvent, "File updated",
+                  {"source", sanitizedSource},
+                  {"dest", sanitizedDest},
+                  {"chunks_rewritten", result.chunksRewritten},
+                  {"chunk_count", result.chunkCount});
+        return result;
+    } catch (const OperationCancelled&) {
+        LOG_SECURITY("File update cancelled");
+        throw;
+    } catch (const EncryptionException& e) {
+        LOG_ERROR("Failed to update file: " + std::string(e.what()));
+        throw;
+    } catch (const std::exception& e) {
+        std::string errorMsg = "Failed to update file: " + std::string(e.what());
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
+    }
+}
+
+// An opened archive with its catalog decrypted
+struct Encryptor::OpenedArchive {
+    std::unique_ptr<FileReader> source;
+    container::ArchiveHeader header;
+    container::ArchiveCatalog catalog;
+    std::shared_ptr<const SecureKey> key;
+};
+
+std::unique_ptr<Encryptor::OpenedArchive> Encryptor::openArchive(
+    const std::string& path,
+    secure::SecureView password,
+    OperationRecorder& recorder
+) const {
+    using Phase = EncryptorStats::Phase;
     
-    // Open source file
-    std::ifstream sourceFile(sourcePath, std::ios::binary);
-    if (!sourceFile.is_open()) {
-        throw EncryptionException("Failed to open source file: " + sourcePath, CryptoErrorCode::IoError);
+    auto archive = std::make_unique<OpenedArchive>();
+    archive->source = openSourceFile(*file_system_, path, file_caching_);
+    FileReader& source = *archive->source;
+    uint64_t fileSize = source.size();
+    if (fileSize < container::ARCHIVE_HEADER_SIZE + container::ARCHIVE_TRAILER_SIZE) {
+        throw EncryptionException("File is not a deduplicated archive", CryptoErrorCode::DataCorrupted);
     }
     
-    // Get file size for progress reporting
-    sourceFile.seekg(0, std::ios::end);
-    std::streamsize fileSize = sourceFile.tellg();
-    sourceFile.seekg(0, std::ios::beg);
+    // Header and trailer locate the catalog; the key opens it
+    std::array<uint8_t, container::ARCHIVE_HEADER_SIZE> headerBytes;
+    std::array<uint8_t, container::ARCHIVE_TRAILER_SIZE> trailer;
+    recorder.time(Phase::Read, [&] {
+        readArchive(source, 0, headerBytes.data(), headerBytes.size());
+        readArchive(source, fileSize - trailer.size(), trailer.data(), trailer.size());
+    });
+    archive->header = container::decodeArchiveHeader(headerBytes.data(), headerBytes.size());
+    uint64_t catalogOffset = container::decodeArchiveTrailer(trailer.data(), fileSize);
+    uint64_t recordLength = fileSize - trailer.size() - catalogOffset;
+    if (recordLength > container::recordSize(container::MAX_CHUNK_SIZE)) {
+        throw EncryptionException("Archive catalog is too large", CryptoErrorCode::DataCorrupted);
+    }
     
-    // Create parent directories for destination file if needed
-    std::filesystem::path destFilePath(destPath);
-    std::filesystem::create_directories(destFilePath.parent_path());
+    container::FileHeader keyHeader;
+    keyHeader.kdf = archive->header.kdf;
+    keyHeader.salt = archive->header.salt;
+    archive->key = recorder.time(Phase::Kdf, [&] { return decryptionKey(password, keyHeader); });
     
-    // Open destination file
-    std::ofstream destFile(destPath, std::ios::binary);
-    if (!destFile.is_open()) {
-        throw EncryptionException("Failed to open destination file: " + destPath, CryptoErrorCode::IoError);
+    std::vector<uint8_t> record(static_cast<size_t>(recordLength));
+    recorder.time(Phase::Read, [&] { readArchive(source, catalogOffset, record.data(), record.size()); });
+    try {
+        size_t catalogSize = recorder.time(Phase::Crypto, [&] {
+            return crypto_->decryptChunk(record.data(), record.size(), *archive->key,
+                                         container::catalogNonce(archive->header),
+                                         record.data() + container::FRAME_HEADER_SIZE,
+                                         record.size() - container::FRAME_HEADER_SIZE);
+        });
+        archive->catalog = container::decodeCatalog(record.data() + container::FRAME_HEADER_SIZE, catalogSize,
+                                                    catalogOffset);
+    } catch (...) {
+        secure::wipe(record);
+        throw;
     }
+    secure::wipe(record);
+    recorder.addBytes(headerBytes.size() + trailer.size() + recordLength, 0);
+    return archive;
+}
+
+PackResult Encryptor::packFiles(
+    const std::vector<ArchiveItem>& items,
+    const std::string& archivePath,
+    secure::SecureView password,
+    ProgressCallback progressCallback
+) {
+    return packFiles(items, archivePath, password, fractionCallback(std::move(progressCallback)));
+}
+
+PackResult Encryptor::packFiles(
+    const std::vector<ArchiveItem>& items,
+    const std::string& archivePath,
+    secure::SecureView password,
+    DetailedProgressCallback progressCallback
+) {
+    using Phase = EncryptorStats::Phase;
     
-    // Process file in chunks
-    std::streamsize processedBytes = 0;
-    while (sourceFile && !sourceFile.eof()) {
-        // Read a chunk
-        std::vector<uint8_t> chunk = readFileChunk(sourceFile, chunk_size_);
-        if (chunk.empty()) {
-            break;
+    try {
+        OperationRecorder recorder(stats_.get(), EncryptorStats::Operation::Encrypt);
+        ProgressReporter progress(std::move(progressCallback), progress_settings_);
+        std::string sanitizedArchive = sanitizePath(archivePath);
+        
+        LOG_SECURITY("Packing " + std::to_string(items.size()) + " files into archive: " + sanitizedArchive);
+        if (const CancellationToken* token = cancellationToken()) {
+            token->throwIfCancelled();
         }
         
-        // Process the chunk
-        std::vector<uint8_t> processedChunk;
-        if (encrypting) {
-            processedChunk = crypto_->encrypt(chunk, securePassword.get());
-        } else {
-            processedChunk = crypto_->decrypt(chunk, securePassword.get());
+        // Names are checked before anything is written
+        container::ArchiveCatalog catalog;
+        catalog.entries.resize(items.size());
+        std::vector<std::string> sources(items.size());
+        std::unordered_set<std::string> names;
+        uint64_t totalSize = 0;
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (!container::validArchiveName(items[i].name)) {
+                throw EncryptionException("Invalid name in archive: " + items[i].name, CryptoErrorCode::InternalError);
+            }
+            if (!names.insert(items[i].name).second) {
+                throw EncryptionException("Name stored twice in archive: " + items[i].name,
+                                          CryptoErrorCode::InternalError);
+            }
+            catalog.entries[i].name = items[i].name;
+            sources[i] = sanitizePath(items[i].sourcePath);
+            try {
+                totalSize += file_system_->getFileSize(sources[i]);
+            } catch (const FileOperationException& e) {
+                throw EncryptionException("Failed to open source file: " + sources[i] + " (" + e.what() + ")",
+                                          CryptoErrorCode::IoError);
+            }
+        }
+        progress.setTotal(totalSize);
+        
+        // One key for the archive; chunk boundaries are keyed from it too
+        container::FileHeader keyHeader;
+        std::shared_ptr<const SecureKey> fileKey = recorder.time(Phase::Kdf, [&] { return encryptionKey(password, keyHeader); });
+        const SecureKey& key = *fileKey;
+        container::ArchiveHeader header;
+        header.kdf = keyHeader.kdf;
+        header.salt = keyHeader.salt;
+        header.noncePrefix = keyHeader.noncePrefix;
+        header.maxChunkSize = static_cast<uint32_t>(chunk_size_);
+        Fingerprint seedBytes = crypto_->fingerprint(container::CHUNKER_SEED_CONTEXT, header.salt.data(),
+                                                     header.salt.size(), key);
+        uint64_t seed = 0;
+        for (size_t i = 0; i < sizeof(seed); ++i) {
+            seed = (seed << 8) | seedBytes[i];
+        }
+        ContentChunker chunker(seed, chunk_size_);
+        
+        AtomicOutput output(*file_system_, sanitizedArchive);
+        std::unique_ptr<FileWriter> dest = openDestFile(*file_system_, output.tempPath(), 0, file_caching_);
+        std::array<uint8_t, container::ARCHIVE_HEADER_SIZE> headerBytes;
+        container::encodeArchiveHeader(header, headerBytes.data());
+        recorder.time(Phase::Write, [&] { dest->writeAt(0, headerBytes.data(), headerBytes.size()); });
+        uint64_t offset = headerBytes.size();
+        
+        PackResult result;
+        result.files = items.size();
+        result.bytesRead = totalSize;
+        
+        // The workers skip chunks already stored; the writer has the last
+        // word, since an equal chunk may still be in flight
+        std::mutex idMutex;
+        std::unordered_map<Fingerprint, uint64_t, FingerprintHash> storedIds;
+        std::unordered_map<uint64_t, Fingerprint> pendingIds;
+        std::vector<uint64_t> references;
+        
+        size_t workers = thread_pool_ ? thread_pool_->size() : 1;
+        size_t maxInFlight = max_in_flight_chunks_ > 0 ? max_in_flight_chunks_ : 2 * workers;
+        ChunkPipeline pipeline(thread_pool_.get(), maxInFlight,
+            [&](PipelineChunk& chunk) {
+                uint8_t* frame = chunk.data.data();
+                Fingerprint id = recorder.time(Phase::Crypto, [&] {
+                    return crypto_->fingerprint(container::CHUNK_ID_CONTEXT, frame + container::FRAME_HEADER_SIZE,
+                                                chunk.inputSize, key);
+                });
+                bool stored = false;
+                {
+                    std::lock_guard<std::mutex> lock(idMutex);
+                    pendingIds[chunk.index] = id;
+                    stored = storedIds.count(id) != 0;
+                }
+                if (!stored) {
+                    recorder.time(Phase::Crypto, [&] {
+                        crypto_->encryptChunk(frame + container::FRAME_HEADER_SIZE, chunk.inputSize, key,
+                                              container::chunkNonce(id), frame, chunk.data.size());
+                    });
+                }
+            },
+            [&](PipelineChunk& chunk) {
+                Fingerprint id;
+                uint64_t storedIndex = 0;
+                bool isNew = false;
+                {
+                    std::lock_guard<std::mutex> lock(idMutex);
+                    auto pending = pendingIds.find(chunk.index);
+                    id = pending->second;
+                    pendingIds.erase(pending);
+                    auto [stored, inserted] = storedIds.emplace(id, catalog.chunks.size());
+                    storedIndex = stored->second;
+                    isNew = inserted;
+                }
+                references.push_back(storedIndex);
+                
+                size_t written = 0;
+                if (isNew) {
+                    written = chunk.data.size();
+                    recorder.time(Phase::Write, [&] { dest->writeAt(offset, chunk.data.data(), written); });
+                    catalog.chunks.push_back({offset, static_cast<uint32_t>(chunk.inputSize), id});
+                    offset += written;
+                    result.bytesStored += chunk.inputSize;
+                }
+                recorder.addChunk(chunk.inputSize, written);
+                progress.add(chunk.inputSize);
+            },
+            buffer_pool_.get());
+        pipeline.setCancellationToken(cancellationToken());
+        pipeline.setMemoryBudget(memory_budget_.get());
+        
+        // Files are read through a window of two maximum chunks, refilled
+        // once less than one is left, so each byte is moved at most once
+        size_t maxChunk = chunker.maxSize();
+        std::vector<uint8_t> window = buffer_pool_->acquire(2 * maxChunk);
+        std::vector<uint64_t> chunkCounts(items.size(), 0);
+        uint64_t chunkIndex = 0;
+        try {
+            for (size_t i = 0; i < items.size(); ++i) {
+                std::unique_ptr<FileReader> source = openSourceFile(*file_system_, sources[i], file_caching_);
+                uint64_t fileSize = source->size();
+                catalog.entries[i].size = fileSize;
+                uint64_t position = 0;
+                size_t start = 0;
+                size_t filled = 0;
+                while (true) {
+                    if (filled - start < maxChunk && position < fileSize) {
+                        std::memmove(window.data(), window.data() + start, filled - start);
+                        filled -= start;
+                        start = 0;
+                        size_t wanted = static_cast<size_t>(std::min<uint64_t>(window.size() - filled, fileSize - position));
+                        size_t read = recorder.time(Phase::Read, [&] {
+                            return source->readAt(position, window.data() + filled, wanted);
+                        });
+                        if (read != wanted) {
+                            throw EncryptionException("Source file changed while reading: " + sources[i],
+                                                      CryptoErrorCode::IoError);
+                        }
+                        filled += read;
+                        position += read;
+                    }
+                    if (start == filled) {
+                        break;
+                    }
+                    
+                    size_t length = chunker.cut(window.data() + start, filled - start);
+                    std::vector<uint8_t> frame = buffer_pool_->acquire(container::recordSize(length));
+                    std::memcpy(frame.data() + container::FRAME_HEADER_SIZE, window.data() + start, length);
+                    start += length;
+                    ++chunkCounts[i];
+                    pipeline.push({chunkIndex++, false, std::move(frame), 0, length});
+                }
+            }
+            pipeline.finish();
+        } catch (...) {
+            buffer_pool_->release(std::move(window));
+            throw;
         }
+        buffer_pool_->release(std::move(window));
+        result.chunkCount = chunkIndex;
+        result.chunksStored = catalog.chunks.size();
         
-        // Write the processed chunk
-        writeFileChunk(destFile, processedChunk);
+        // References arrive in push order, file after file
+        auto next = references.begin();
+        for (size_t i = 0; i < items.size(); ++i) {
+            catalog.entries[i].chunks.assign(next, next + static_cast<std::ptrdiff_t>(chunkCounts[i]));
+            next += static_cast<std::ptrdiff_t>(chunkCounts[i]);
+        }
         
-        // Update progress
-        processedBytes += chunk.size();
-        float progress = static_cast<float>(processedBytes) / static_cast<float>(fileSize);
-        updateProgress(progressCallback, progress);
+        std::vector<uint8_t> catalogBytes = container::encodeCatalog(catalog);
+        if (catalogBytes.size() > container::MAX_CHUNK_SIZE) {
+            secure::wipe(catalogBytes);
+            throw EncryptionException("Too many files or chunks for one archive; use a larger chunk size",
+                                      CryptoErrorCode::InternalError);
+        }
+        std::vector<uint8_t> record(container::recordSize(catalogBytes.size()));
+        std::memcpy(record.data() + container::FRAME_HEADER_SIZE, catalogBytes.data(), catalogBytes.size());
+        secure::wipe(catalogBytes);
+        recorder.time(Phase::Crypto, [&] {
+            crypto_->encryptChunk(record.data() + container::FRAME_HEADER_SIZE, record.size() - container::recordSize(0),
+                                  key, container::catalogNonce(header), record.data(), record.size());
+        });
+        std::array<uint8_t, container::ARCHIVE_TRAILER_SIZE> trailer;
+        container::encodeArchiveTrailer(offset, trailer.data());
+        recorder.time(Phase::Write, [&] {
+            dest->writeAt(offset, record.data(), record.size());
+            dest->writeAt(offset + record.size(), trailer.data(), trailer.size());
+        });
+        recorder.addBytes(0, headerBytes.size() + record.size() + trailer.size());
+        finishOutput(output, std::move(dest));
+        progress.finish();
+        recorder.succeed();
         
-        // Securely wipe the chunks from memory
-        secure::wipe(chunk);
-        secure::wipe(processedChunk);
+        LOG_EVENT(SecurityEvent, "Archive packed",
+                  {"archive", sanitizedArchive},
+                  {"files", result.files},
+                  {"chunks", result.chunkCount},
+                  {"chunks_stored", result.chunksStored});
+        return result;
+    } catch (const OperationCancelled&) {
+        LOG_SECURITY("Archive packing cancelled");
+        throw;
+    } catch (const EncryptionException& e) {
+        LOG_ERROR("Failed to pack archive: " + std::string(e.what()));
+        throw;
+    } catch (const std::exception& e) {
+        std::string errorMsg = "Failed to pack archive: " + std::string(e.what());
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
     }
+}
+
+void Encryptor::extractEntry(
+    const OpenedArchive& archive,
+    const container::ArchiveEntry& entry,
+    const std::string& destPath,
+    ProgressReporter& progress,
+    OperationRecorder& recorder
+) {
+    using Phase = EncryptorStats::Phase;
+    const container::ArchiveCatalog& catalog = archive.catalog;
+    const SecureKey& key = *archive.key;
     
-    // Ensure all data is written
-    destFile.flush();
+    AtomicOutput output(*file_system_, destPath);
+    std::unique_ptr<FileWriter> dest = openDestFile(*file_system_, output.tempPath(), entry.size, file_caching_);
+    
+    // A chunk shared by several files is decrypted for each of them
+    size_t workers = thread_pool_ ? thread_pool_->size() : 1;
+    size_t maxInFlight = max_in_flight_chunks_ > 0 ? max_in_flight_chunks_ : 2 * workers;
+    uint64_t written = 0;
+    ChunkPipeline pipeline(thread_pool_.get(), maxInFlight,
+        [&](PipelineChunk& chunk) {
+            const container::StoredChunk& stored = catalog.chunks[entry.chunks[chunk.index]];
+            uint8_t* frame = chunk.data.data();
+            size_t plaintextSize = recorder.time(Phase::Crypto, [&] {
+                return crypto_->decryptChunk(frame, chunk.data.size(), key, container::chunkNonce(stored.id),
+                                             frame + container::FRAME_HEADER_SIZE,
+                                             chunk.data.size() - container::FRAME_HEADER_SIZE);
+            });
+            if (plaintextSize != stored.size) {
+                throw EncryptionException("Archive chunk does not match the catalog", CryptoErrorCode::DataCorrupted);
+            }
+            chunk.data.resize(container::FRAME_HEADER_SIZE + plaintextSize);
+            chunk.offset = container::FRAME_HEADER_SIZE;
+        },
+        [&](PipelineChunk& chunk) {
+            size_t plaintextSize = chunk.data.size() - chunk.offset;
+            recorder.time(Phase::Write, [&] {
+                dest->writeAt(written, chunk.data.data() + chunk.offset, plaintextSize);
+            });
+            written += plaintextSize;
+            recorder.addChunk(chunk.inputSize, plaintextSize);
+            progress.add(plaintextSize);
+        },
+        buffer_pool_.get());
+    pipeline.setCancellationToken(cancellationToken());
+    pipeline.setMemoryBudget(memory_budget_.get());
     
-    // Close files
-    sourceFile.close();
-    destFile.close();
+    for (uint64_t i = 0; i < entry.chunks.size(); ++i) {
+        const container::StoredChunk& stored = catalog.chunks[entry.chunks[i]];
+        size_t length = container::recordSize(stored.size);
+        std::vector<uint8_t> frame = buffer_pool_->acquire(length);
+        recorder.time(Phase::Read, [&] { readArchive(*archive.source, stored.offset, frame.data(), length); });
+        pipeline.push({i, i + 1 == entry.chunks.size(), std::move(frame), 0, length});
+    }
+    pipeline.finish();
+    finishOutput(output, std::move(dest));
+}
+
+void Encryptor::unpackArchive(
+    const std::string& archivePath,
+    const std::string& destDirectory,
+    secure::SecureView password,
+    ProgressCallback progressCallback
+) {
+    unpackArchive(archivePath, destDirectory, password, fractionCallback(std::move(progressCallback)));
+}
+
+void Encryptor::unpackArchive(
+    const std::string& archivePath,
+    const std::string& destDirectory,
+    secure::SecureView password,
+    DetailedProgressCallback progressCallback
+) {
+    try {
+        OperationRecorder recorder(stats_.get(), EncryptorStats::Operation::Decrypt);
+        ProgressReporter progress(std::move(progressCallback), progress_settings_);
+        std::string sanitizedArchive = sanitizePath(archivePath);
+        std::string sanitizedDir = sanitizePath(destDirectory);
+        
+        LOG_SECURITY("Unpacking archive: " + sanitizedArchive + " -> " + sanitizedDir);
+        if (const CancellationToken* token = cancellationToken()) {
+            token->throwIfCancelled();
+        }
+        
+        std::unique_ptr<OpenedArchive> archive = openArchive(sanitizedArchive, password, recorder);
+        const container::ArchiveCatalog& catalog = archive->catalog;
+        uint64_t totalSize = 0;
+        for (const container::ArchiveEntry& entry : catalog.entries) {
+            totalSize += entry.size;
+        }
+        progress.setTotal(totalSize);
+        
+        for (const container::ArchiveEntry& entry : catalog.entries) {
+            // Names were validated with the catalog; this also catches links
+            // in the destination that lead elsewhere
+            std::string destPath = PathUtils::sanitizePath(sanitizedDir + "/" + entry.name, sanitizedDir);
+            extractEntry(*archive, entry, destPath, progress, recorder);
+        }
+        progress.finish();
+        recorder.succeed();
+        
+        LOG_EVENT(SecurityEvent, "Archive unpacked",
+                  {"archive", sanitizedArchive},
+                  {"dest", sanitizedDir},
+                  {"files", catalog.entries.size()});
+    } catch (const OperationCancelled&) {
+        LOG_SECURITY("Archive unpacking cancelled");
+        throw;
+    } catch (const EncryptionException& e) {
+        LOG_ERROR("Failed to unpack archive: " + std::string(e.what()));
+        throw;
+    } catch (const std::exception& e) {
+        std::string errorMsg = "Failed to unpack archive: " + std::string(e.what());
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
+    }
+}
+
+void Encryptor::extractFiles(
+    const std::string& archivePath,
+    const std::vector<std::string>& names,
+    const std::string& destDirectory,
+    secure::SecureView password,
+    ProgressCallback progressCallback
+) {
+    extractFiles(archivePath, names, destDirectory, password, fractionCallback(std::move(progressCallback)));
+}
+
+void Encryptor::extractFiles(
+    const std::string& archivePath,
+    const std::vector<std::string>& names,
+    const std::string& destDirectory,
+    secure::SecureView password,
+    DetailedProgressCallback progressCallback
+) {
+    try {
+        OperationRecorder recorder(stats_.get(), EncryptorStats::Operation::Decrypt);
+        ProgressReporter progress(std::move(progressCallback), progress_settings_);
+        std::string sanitizedArchive = sanitizePath(archivePath);
+        std::string sanitizedDir = sanitizePath(destDirectory);
+        
+        LOG_SECURITY("Extracting " + std::to_string(names.size()) + " files from archive: " + sanitizedArchive +
+                     " -> " + sanitizedDir);
+        if (const CancellationToken* token = cancellationToken()) {
+            token->throwIfCancelled();
+        }
+        
+        // Every name is looked up before anything is written
+        std::unique_ptr<OpenedArchive> archive = openArchive(sanitizedArchive, password, recorder);
+        std::unordered_map<std::string_view, const container::ArchiveEntry*> byName;
+        for (const container::ArchiveEntry& entry : archive->catalog.entries) {
+            byName.emplace(entry.name, &entry);
+        }
+        std::vector<const container::ArchiveEntry*> selected;
+        std::unordered_set<const container::ArchiveEntry*> seen;
+        uint64_t totalSize = 0;
+        for (const std::string& name : names) {
+            auto it = byName.find(name);
+            if (it == byName.end()) {
+                throw EncryptionException("No file named " + name + " in archive", CryptoErrorCode::IoError);
+            }
+            if (seen.insert(it->second).second) {
+                selected.push_back(it->second);
+                totalSize += it->second->size;
+            }
+        }
+        progress.setTotal(totalSize);
+        
+        // Only the selected files' chunks are read; the rest of the archive is not touched
+        for (const container::ArchiveEntry* entry : selected) {
+            std::string destPath = PathUtils::sanitizePath(sanitizedDir + "/" + entry->name, sanitizedDir);
+            extractEntry(*archive, *entry, destPath, progress, recorder);
+        }
+        progress.finish();
+        recorder.succeed();
+        
+        LOG_EVENT(SecurityEvent, "Files extracted from archive",
+                  {"archive", sanitizedArchive},
+                  {"dest", sanitizedDir},
+                  {"files", selected.size()},
+                  {"archive_files", archive->catalog.entries.size()});
+    } catch (const OperationCancelled&) {
+        LOG_SECURITY("Archive extraction cancelled");
+        throw;
+    } catch (const EncryptionException& e) {
+        LOG_ERROR("Failed to extract from archive: " + std::string(e.what()));
+        throw;
+    } catch (const std::exception& e) {
+        std::string errorMsg = "Failed to extract from archive: " + std::string(e.what());
+        LOG_ERROR(errorMsg);
+        throw EncryptionException(errorMsg, CryptoErrorCode::IoError);
+    }
+}
+
+container::ArchiveCatalog Encryptor::listArchive(const std::string& archivePath, secure::SecureView password) const {
+    OperationRecorder recorder(nullptr, EncryptorStats::Operation::Decrypt);
+    return openArchive(sanitizePath(archivePath), password, recorder)->catalog;
+}
+
+container::ContainerInfo Encryptor::inspectFile(const std::string& path) const {
+    std::string sanitizedPath = sanitizePath(path);
+    
+    std::unique_ptr<FileReader> source = openSourceFile(*file_system_, sanitizedPath);
+    FileReaderStreamBuf buffer(*source);
+    std::istream file(&buffer);
+    
+    container::ContainerReader reader(file);
+    container::ContainerInfo info = reader.readIndex();
+    LOG_EVENT(Info, "Inspected encrypted file",
+              {"path", sanitizedPath},
+              {"chunks", info.chunkOffsets.size()},
+              {"plaintext_bytes", info.plaintextSize});
+    return info;
+}
+
+container::ContainerSummary Encryptor::summarizeFile(const std::string& path) const {
+    std::string sanitizedPath = sanitizePath(path);
+    
+    std::unique_ptr<FileReader> source = openSourceFile(*file_system_, sanitizedPath);
+    FileReaderStreamBuf buffer(*source);
+    std::istream file(&buffer);
+    
+    container::ContainerReader reader(file);
+    return reader.readSummary();
+}
+
+size_t Encryptor::addKeySlot(const std::string& path, secure::SecureView password, secure::SecureView newPassword) {
+    LOG_SECURITY("Adding key slot: " + sanitizePath(path));
+    return editKeySlots(path, password, [&](container::FileHeader& header, size_t, const std::vector<uint8_t>& dataKey) {
+        for (size_t i = 0; i < container::MAX_KEY_SLOTS; ++i) {
+            if (!header.keySlots[i].used) {
+                sealKeySlot(header.keySlots[i], newPassword, dataKey);
+                return i;
+            }
+        }
+        throw EncryptionException("All " + std::to_string(container::MAX_KEY_SLOTS) + " key slots are in use: " + path,
+                                  CryptoErrorCode::InternalError);
+    });
+}
+
+void Encryptor::removeKeySlot(const std::string& path, secure::SecureView password, size_t slot) {
+    LOG_EVENT(SecurityEvent, "Removing key slot", {"path", sanitizePath(path)}, {"slot", slot});
+    editKeySlots(path, password, [&](container::FileHeader& header, size_t, const std::vector<uint8_t>&) {
+        if (slot >= container::MAX_KEY_SLOTS || !header.keySlots[slot].used) {
+            throw EncryptionException("Key slot " + std::to_string(slot) + " is not in use", CryptoErrorCode::InternalError);
+        }
+        size_t used = std::count_if(header.keySlots.begin(), header.keySlots.end(),
+                                    [](const container::KeySlot& candidate) { return candidate.used; });
+        if (used == 1) {
+            throw EncryptionException("Cannot remove the last key slot of a file", CryptoErrorCode::InternalError);
+        }
+        header.keySlots[slot] = container::KeySlot{};
+        return slot;
+    });
+}
+
+size_t Encryptor::changeKeySlotPassword(const std::string& path, secure::SecureView password,
+                                        secure::SecureView newPassword) {
+    LOG_SECURITY("Changing key slot password: " + sanitizePath(path));
+    return editKeySlots(path, password, [&](container::FileHeader& header, size_t opened, const std::vector<uint8_t>& dataKey) {
+        sealKeySlot(header.keySlots[opened], newPassword, dataKey);
+        return opened;
+    });
+}
+
+void Encryptor::setChunkSize(size_t bytes) {
+    if (bytes == 0) {
+        LOG_WARNING("Attempted to set chunk size to 0, ignoring");
+        return;
+    }
+    
+    if (bytes > container::MAX_CHUNK_SIZE) {
+        LOG_EVENT(Warning, "Attempted to set chunk size above the maximum, ignoring",
+                  {"bytes", bytes}, {"max_bytes", container::MAX_CHUNK_SIZE});
+        return;
+    }
+    
+    chunk_size_ = bytes;
+    LOG_EVENT(Info, "Chunk size set", {"bytes", chunk_size_});
+}
+
+void Encryptor::setWorkerCount(size_t count) {
+    if (count == 0) {
+        count = memory_budget_ ? memory_budget_->plan().workers : MemoryBudget::detectCpuLimit();
+    }
+    
+    if (count == 1) {
+        thread_pool_.reset();
+    } else if (!thread_pool_ || thread_pool_->size() != count) {
+        thread_pool_ = std::make_shared<ThreadPool>(count);
+    }
+    
+    LOG_EVENT(Info, "Worker count set", {"workers", count});
+}
+
+void Encryptor::setMaxInFlightChunks(size_t count) {
+    max_in_flight_chunks_ = count;
+    LOG_EVENT(Info, "Maximum in-flight chunks set", {"chunks", count});
+}
+
+void Encryptor::setAsyncWorkerCount(size_t count) {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    async_worker_count_ = std::max<size_t>(count, 1);
+}
+
+void Encryptor::setIoMode(IoMode mode) {
+    io_mode_ = mode;
+    LOG_EVENT(Info, "I/O mode set", {"mode", mode == IoMode::MemoryMapped ? "memory-mapped" : "stream"});
+}
+
+void Encryptor::setIoEngine(IoEngine engine) {
+    io_engine_ = engine;
+    LOG_EVENT(Info, "I/O engine set", {"engine", ioEngineName(engine)});
+}
+
+void Encryptor::setFileCaching(FileCaching caching) {
+    file_caching_ = caching;
+    LOG_EVENT(Info, "File caching set", {"caching", caching == FileCaching::DropBehind ? "drop-behind" : "normal"});
+}
+
+void Encryptor::setOutputSync(OutputSync sync) {
+    output_sync_ = sync;
+    LOG_EVENT(Info, "Output sync set",
+              {"sync", sync == OutputSync::None ? "none" : sync == OutputSync::PerFile ? "per-file" : "grouped"});
+}
+
+void Encryptor::setSyncGroup(std::shared_ptr<SyncGroup> group) {
+    sync_group_ = std::move(group);
+}
+
+void Encryptor::setIoQueueDepth(size_t depth) {
+    if (depth == 0) {
+        LOG_WARNING("Attempted to set an I/O queue depth of 0, ignoring");
+        return;
+    }
+    io_queue_depth_ = depth;
+}
+
+void Encryptor::setProgressSettings(const ProgressSettings& settings) {
+    if (settings.minInterval.count() <= 0) {
+        LOG_WARNING("Attempted to set a progress interval of 0, ignoring");
+        return;
+    }
+    
+    progress_settings_ = settings;
+    progress_settings_.minDelta = std::clamp(settings.minDelta, 0.0f, 1.0f);
+    LOG_EVENT(Info, "Progress settings set",
+              {"interval_ms", settings.minInterval.count()},
+              {"min_delta", progress_settings_.minDelta});
+}
+
+void Encryptor::setThreadPool(std::shared_ptr<ThreadPool> pool) {
+    thread_pool_ = std::move(pool);
+    LOG_EVENT(Info, "Shared thread pool set", {"workers", thread_pool_ ? thread_pool_->size() : 1});
+}
+
+void Encryptor::setBufferPool(std::shared_ptr<secure::SecureBufferPool> pool) {
+    if (pool) {
+        buffer_pool_ = std::move(pool);
+    }
+}
+
+void Encryptor::setFileSystem(std::shared_ptr<FileSystem> fileSystem) {
+    if (fileSystem) {
+        file_system_ = std::move(fileSystem);
+    }
+}
+
+void Encryptor::setKdfParams(const KdfParams& params) {
+    if (!container::validKdfParams(params)) {
+        LOG_EVENT(Warning, "Attempted to set invalid key derivation costs, ignoring",
+                  {"memory_kib", params.memoryKib},
+                  {"iterations", params.iterations},
+                  {"parallelism", params.parallelism});
+        return;
+    }
+    
+    kdf_params_ = params;
+    LOG_EVENT(Info, "Key derivation costs set",
+              {"memory_kib", params.memoryKib},
+              {"iterations", params.iterations},
+              {"parallelism", params.parallelism});
+}
+
+void Encryptor::setCompression(const CompressionSettings& settings) {
+    if (!compression::available(settings.algorithm)) {
+        LOG_EVENT(Warning, "Attempted to set a compression this build lacks, ignoring",
+                  {"algorithm", compression::name(settings.algorithm)});
+        return;
+    }
+    
+    compression_ = settings;
+    LOG_EVENT(Info, "Compression set",
+              {"algorithm", compression::name(settings.algorithm)},
+              {"level", settings.level},
+              {"skip_incompressible", settings.skipIncompressible});
+}
+
+void Encryptor::setMemoryBudget(std::shared_ptr<MemoryBudget> budget) {
+    memory_budget_ = std::move(budget);
+    if (!memory_budget_) {
+        return;
+    }
+    
+    buffer_pool_->setMaxRetainedBytes(memory_budget_->poolBytes());
+    MemoryPlan plan = memory_budget_->plan(thread_pool_ ? thread_pool_->size() : 1);
+    chunk_size_ = plan.chunkSize;
+    LOG_EVENT(Info, "Memory budget set",
+              {"bytes", memory_budget_->limit()},
+              {"chunk_size", chunk_size_},
+              {"workers", thread_pool_ ? thread_pool_->size() : 1});
+}
+
+void Encryptor::setKeyCache(std::shared_ptr<KeyCache> cache) {
+    key_cache_ = std::move(cache);
+}
+
+void Encryptor::setKeySlots(bool enabled) {
+    key_slots_ = enabled;
+    LOG_EVENT(Info, "Key slots set", {"enabled", enabled});
+}
+
+void Encryptor::setPathResolver(std::shared_ptr<PathResolver> resolver) {
+    path_resolver_ = std::move(resolver);
+}
+
+void Encryptor::setCancellationToken(std::shared_ptr<const CancellationToken> token) {
+    cancellation_ = std::move(token);
+}
+
+const CancellationToken* Encryptor::cancellationToken() const {
+    return activeOperation.engine == this ? activeOperation.token : cancellation_.get();
+}
+
+void Encryptor::setStats(std::shared_ptr<EncryptorStats> stats) {
+    stats_ = std::move(stats);
+}
+
+std::string Encryptor::sanitizePath(const std::string& path) const {
+    return path_resolver_ ? path_resolver_->resolve(path) : PathUtils::sanitizePath(path);
+}
+
+std::shared_ptr<const SecureKey> Encryptor::newPasswordKey(
+    secure::SecureView password,
+    container::KeySlot& slot
+) const {
+    slot.kdf = kdf_params_;
+    
+    std::vector<uint8_t> salt;
+    std::shared_ptr<const SecureKey> key;
+    if (key_cache_) {
+        key = key_cache_->keyForEncryption(*crypto_, password, slot.kdf, salt);
+    } else {
+        salt = crypto_->randomBytes(container::SALT_SIZE);
+        key = std::make_shared<const SecureKey>(crypto_->deriveKey(password, salt, slot.kdf));
+    }
+    std::copy(salt.begin(), salt.end(), slot.salt.begin());
+    return key;
+}
+
+std::shared_ptr<const SecureKey> Encryptor::passwordKey(
+    secure::SecureView password,
+    const container::KeySlot& slot
+) const {
+    std::vector<uint8_t> salt(slot.salt.begin(), slot.salt.end());
+    if (key_cache_) {
+        return key_cache_->keyFor(*crypto_, password, salt, slot.kdf);
+    }
+    return std::make_shared<const SecureKey>(crypto_->deriveKey(password, salt, slot.kdf));
+}
+
+std::shared_ptr<const SecureKey> Encryptor::encryptionKey(
+    secure::SecureView password,
+    container::FileHeader& header
+) const {
+    // The header's salt and costs are derived from like a slot's
+    container::KeySlot derivation;
+    std::shared_ptr<const SecureKey> key = newPasswordKey(password, derivation);
+    header.kdf = derivation.kdf;
+    header.salt = derivation.salt;
+    
+    // Files sharing a cached key still never share nonces
+    std::vector<uint8_t> noncePrefix = crypto_->randomBytes(container::NONCE_PREFIX_SIZE);
+    std::copy(noncePrefix.begin(), noncePrefix.end(), header.noncePrefix.begin());
+    return key;
+}
+
+std::shared_ptr<const SecureKey> Encryptor::newContainerKey(
+    secure::SecureView password,
+    container::FileHeader& header
+) const {
+    // Without slots the header checks the password itself
+    if (!key_slots_) {
+        std::shared_ptr<const SecureKey> key = encryptionKey(password, header);
+        header.flags |= container::FLAG_KEY_CHECK | container::FLAG_HEADER_BOUND;
+        header.headerSize = static_cast<uint32_t>(container::encodedHeaderSize(header));
+        key = container::recordKey(*crypto_, std::move(key), header);
+        header.keyCheck = container::keyCheck(*crypto_, *key, header);
+        return key;
+    }
+    
+    // Only the slot's key is derived. The header still gets costs and a
+    // random salt, so readers that predate key slots fail to authenticate
+    // the file instead of misreading it
+    std::vector<uint8_t> salt = crypto_->randomBytes(container::SALT_SIZE);
+    std::vector<uint8_t> noncePrefix = crypto_->randomBytes(container::NONCE_PREFIX_SIZE);
+    header.kdf = kdf_params_;
+    std::copy(salt.begin(), salt.end(), header.salt.begin());
+    std::copy(noncePrefix.begin(), noncePrefix.end(), header.noncePrefix.begin());
+    header.flags |= container::FLAG_KEY_SLOTS | container::FLAG_HEADER_BOUND;
+    header.headerSize = static_cast<uint32_t>(container::encodedHeaderSize(header));
+    header.keySlots = {};
+    
+    secure::SecureData<std::vector<uint8_t>> dataKey(crypto_->randomBytes(container::DATA_KEY_SIZE));
+    sealKeySlot(header.keySlots[0], password, dataKey.get());
+    auto key = std::make_shared<const SecureKey>(SecureKey::fromBytes(dataKey.get().data(), dataKey.get().size()));
+    return container::recordKey(*crypto_, std::move(key), header);
+}
+
+std::shared_ptr<const SecureKey> Encryptor::decryptionKey(
+    secure::SecureView password,
+    const container::FileHeader& header
+) const {
+    if (container::hasKeySlots(header)) {
+        size_t slot = 0;
+        secure::SecureData<std::vector<uint8_t>> dataKey = openKeySlot(password, header, slot);
+        auto key = std::make_shared<const SecureKey>(SecureKey::fromBytes(dataKey.get().data(), dataKey.get().size()));
+        return container::recordKey(*crypto_, std::move(key), header);
+    }
+    
+    container::KeySlot derivation;
+    derivation.kdf = header.kdf;
+    derivation.salt = header.salt;
+    std::shared_ptr<const SecureKey> key = container::recordKey(*crypto_, passwordKey(password, derivation), header);
+    container::checkKey(*crypto_, *key, header);
+    return key;
+}
+
+std::shared_ptr<const SecureKey> Encryptor::containerKey(
+    secure::SecureView password,
+    const container::FileHeader& header
+) const {
+    requireCodec(header.compression);
+    return decryptionKey(password, header);
+}
+
+secure::SecureData<std::vector<uint8_t>> Encryptor::openKeySlot(
+    secure::SecureView password,
+    const container::FileHeader& header,
+    size_t& slot
+) const {
+    // Nothing says which slot a password belongs to, so each is tried in
+    // turn; a cached key makes the ones tried before cheap
+    secure::SecureData<std::vector<uint8_t>> dataKey(std::vector<uint8_t>(container::DATA_KEY_SIZE));
+    for (size_t i = 0; i < container::MAX_KEY_SLOTS; ++i) {
+        const container::KeySlot& candidate = header.keySlots[i];
+        if (!candidate.used) {
+            continue;
+        }
+        if (const CancellationToken* token = cancellationToken()) {
+            token->throwIfCancelled();
+        }
+        
+        std::shared_ptr<const SecureKey> slotKey = passwordKey(password, candidate);
+        try {
+            size_t size = crypto_->decryptInto(candidate.wrappedKey.data(), candidate.wrappedKey.size(), *slotKey,
+                                               dataKey.get().data(), dataKey.get().size());
+            if (size == container::DATA_KEY_SIZE) {
+                slot = i;
+                return dataKey;
+            }
+        } catch (const EncryptionException&) {
+            // Sealed under another password
+        }
+    }
+    throw EncryptionException("Password does not open any key slot of the file (wrong password)",
+                              CryptoErrorCode::InvalidPassword);
+}
+
+void Encryptor::sealKeySlot(
+    container::KeySlot& slot,
+    secure::SecureView password,
+    const std::vector<uint8_t>& dataKey
+) const {
+    container::KeySlot sealed;
+    std::shared_ptr<const SecureKey> slotKey = newPasswordKey(password, sealed);
+    crypto_->encryptInto(dataKey.data(), dataKey.size(), *slotKey, sealed.wrappedKey.data(), sealed.wrappedKey.size());
+    sealed.used = true;
+    slot = sealed;
+}
+
+size_t Encryptor::editKeySlots(
+    const std::string& path,
+    secure::SecureView password,
+    const std::function<size_t(container::FileHeader& header, size_t opened, const std::vector<uint8_t>& dataKey)>& edit
+) {
+    std::string sanitizedPath = sanitizePath(path);
+    container::FileHeader header;
+    {
+        std::unique_ptr<FileReader> source = openSourceFile(*file_system_, sanitizedPath);
+        FileReaderStreamBuf buffer(*source);
+        std::istream file(&buffer);
+        header = container::readHeader(file);
+    }
+    if (!container::hasKeySlots(header)) {
+        throw EncryptionException("File is not encrypted with key slots: " + path, CryptoErrorCode::InternalError);
+    }
+    
+    // Rewriting in place must not move the first record
+    if (header.headerSize != container::encodedHeaderSize(header)) {
+        throw EncryptionException("File header has fields this version cannot rewrite: " + path,
+                                  CryptoErrorCode::InternalError);
+    }
+    
+    size_t opened = 0;
+    secure::SecureData<std::vector<uint8_t>> dataKey = openKeySlot(password, header, opened);
+    size_t slot = edit(header, opened, dataKey.get());
+    
+    std::vector<uint8_t> headerBytes(container::encodedHeaderSize(header));
+    container::encodeHeader(header, headerBytes.data());
+    try {
+        std::unique_ptr<FileWriter> dest = file_system_->openForUpdate(sanitizedPath, file_caching_);
+        dest->writeAt(0, headerBytes.data(), headerBytes.size());
+        dest->sync();
+        dest->close();
+    } catch (const FileOperationException& e) {
+        throw EncryptionException("Failed to rewrite file header: " + sanitizedPath + " (" + e.what() + ")",
+                                  CryptoErrorCode::IoError);
+    }
+    return slot;
+}
+
+container::FileHeader Encryptor::newHeader() const {
+    container::FileHeader header;
+    header.chunkSize = static_cast<uint32_t>(chunk_size_);
+    if (compression_.algorithm != Compression::None) {
+        header.version = container::COMPRESSED_FORMAT_VERSION;
+        header.compression = compression_.algorithm;
+    }
+    return header;
+}
+
+std::vector<uint8_t> Encryptor::readPlaintextChunk(std::istream& file, size_t prefixSize) {
+    // Read straight into the plaintext slot of a frame so encryption can run
+    // in place; compressed containers leave room for the chunk prefix
+    std::vector<uint8_t> frame = buffer_pool_->acquire(container::recordSize(prefixSize + chunk_size_));
+    file.read(reinterpret_cast<char*>(frame.data() + container::FRAME_HEADER_SIZE + prefixSize), chunk_size_);
+    if (file.bad()) {
+        buffer_pool_->release(std::move(frame));
+        throw EncryptionException("Failed to read input", CryptoErrorCode::IoError);
+    }
+    
+    // Resize buffer to the frame for the bytes actually read
+    size_t bytesRead = file.gcount();
+    frame.resize(container::recordSize(prefixSize + bytesRead));
+    
+    return frame;
+}
+
+void Encryptor::compressChunk(PipelineChunk& chunk, const CompressionSettings& settings, OperationRecorder& recorder) {
+    // Laid out by readPlaintextChunk: frame header | chunk prefix | plaintext | tag
+    const uint8_t* plaintext = chunk.data.data() + container::FRAME_HEADER_SIZE + container::CHUNK_PREFIX_SIZE;
+    size_t plaintextSize = chunk.inputSize;
+    
+    // Only a smaller result is kept, so no record outgrows a stored chunk
+    std::vector<uint8_t> frame = buffer_pool_->acquire(container::recordSize(container::CHUNK_PREFIX_SIZE + plaintextSize));
+    size_t compressedSize = 0;
+    try {
+        compressedSize = recorder.time(EncryptorStats::Phase::Compress, [&]() -> size_t {
+            if (plaintextSize < 2 ||
+                (settings.skipIncompressible && !compression::worthCompressing(settings.algorithm, plaintext, plaintextSize))) {
+                return 0;
+            }
+            return compression::compress(settings.algorithm, settings.level, plaintext, plaintextSize,
+                                         frame.data() + container::FRAME_HEADER_SIZE + container::CHUNK_PREFIX_SIZE,
+                                         plaintextSize - 1);
+        });
+    } catch (...) {
+        buffer_pool_->release(std::move(frame));
+        throw;
+    }
+    
+    if (compressedSize > 0) {
+        frame.resize(container::recordSize(container::CHUNK_PREFIX_SIZE + compressedSize));
+        chunk.data.swap(frame);
+    }
+    buffer_pool_->release(std::move(frame));
+    container::encodeChunkPrefix(chunk.data.data() + container::FRAME_HEADER_SIZE,
+                                 compressedSize > 0 ? container::CHUNK_COMPRESSED : container::CHUNK_STORED,
+                                 static_cast<uint32_t>(plaintextSize));
+}
+
+void Encryptor::decompressChunk(PipelineChunk& chunk, const container::FileHeader& header, OperationRecorder& recorder) {
+    // Decrypted in place: frame header | chunk prefix | stored or compressed plaintext
+    uint8_t encoding = 0;
+    size_t payloadSize = chunk.data.size() - chunk.offset;
+    uint32_t plaintextSize = container::checkChunkPrefix(header, chunk.data.data() + chunk.offset, payloadSize,
+                                                         chunk.isFinal, encoding);
+    size_t bodySize = payloadSize - container::CHUNK_PREFIX_SIZE;
+    chunk.offset += container::CHUNK_PREFIX_SIZE;
+    if (encoding == container::CHUNK_STORED) {
+        return;
+    }
+    
+    std::vector<uint8_t> plaintext = buffer_pool_->acquire(plaintextSize);
+    try {
+        recorder.time(EncryptorStats::Phase::Compress, [&] {
+            compression::decompress(header.compression, chunk.data.data() + chunk.offset, bodySize,
+                                    plaintext.data(), plaintextSize);
+        });
+    } catch (...) {
+        buffer_pool_->release(std::move(plaintext));
+        throw;
+    }
+    chunk.data.swap(plaintext);
+    chunk.offset = 0;
+    buffer_pool_->release(std::move(plaintext));
+}
+
+void Encryptor::sealRecord(
+    PipelineChunk& chunk,
+    const SecureKey& key,
+    const container::FileHeader& header,
+    const CompressionSettings& settings,
+    OperationRecorder& recorder
+) {
+    if (header.compression != Compression::None) {
+        compressChunk(chunk, settings, recorder);
+    }
+    
+    // The ciphertext overwrites the plaintext, so nothing is left to wipe
+    uint8_t* frame = chunk.data.data();
+    recorder.time(EncryptorStats::Phase::Crypto, [&] {
+        crypto_->encryptChunk(frame + container::FRAME_HEADER_SIZE,
+                              chunk.data.size() - container::recordSize(0),
+                              key, container::chunkNonce(header, chunk.index, chunk.isFinal),
+                              frame, chunk.data.size());
+    });
+}
+
+void Encryptor::openRecord(
+    PipelineChunk& chunk,
+    const SecureKey& key,
+    const container::FileHeader& header,
+    OperationRecorder& recorder
+) {
+    // Decrypt inside the frame that was read, so the chunk is neither
+    // copied nor given a second buffer
+    uint8_t* frame = chunk.data.data();
+    ChunkNonce nonce = container::isIncremental(header)
+        ? container::chunkNonce(container::framePrefix(frame), chunk.index, chunk.isFinal)
+        : container::chunkNonce(header, chunk.index, chunk.isFinal);
+    size_t plaintextSize = recorder.time(EncryptorStats::Phase::Crypto, [&] {
+        return crypto_->decryptChunk(frame, chunk.data.size(), key, nonce,
+                                     frame + container::FRAME_HEADER_SIZE,
+                                     chunk.data.size() - container::FRAME_HEADER_SIZE);
+    });
+    chunk.data.resize(container::FRAME_HEADER_SIZE + plaintextSize);
+    chunk.offset = container::FRAME_HEADER_SIZE;
+    
+    if (header.compression != Compression::None) {
+        decompressChunk(chunk, header, recorder);
+    }
+}
+
+std::unique_ptr<EncryptedFileReader> Encryptor::openEncrypted(
+    const std::string& path,
+    secure::SecureView password,
+    OperationRecorder& recorder
+) const {
+    using Phase = EncryptorStats::Phase;
+    
+    // Only the index is read; each record is checked when a read reaches it
+    std::unique_ptr<FileReader> source = openSourceFile(*file_system_, path, file_caching_);
+    container::ContainerInfo info;
+    {
+        FileReaderStreamBuf sourceBuffer(*source);
+        std::istream sourceFile(&sourceBuffer);
+        info = recorder.time(Phase::Read, [&] { return container::ContainerReader(sourceFile).readIndex(false); });
+    }
+    requireCodec(info.header.compression);
+    
+    std::shared_ptr<const SecureKey> key = recorder.time(Phase::Kdf, [&] { return decryptionKey(password, info.header); });
+    container::checkRecordPrefixes(*crypto_, *key, info.header, info.noncePrefixes);
+    recorder.addBytes(info.header.headerSize + container::footerSize(info.chunkOffsets.size()), 0);
+    return std::make_unique<EncryptedFileReader>(std::move(source), std::move(info), *crypto_, std::move(key),
+                                                 buffer_pool_);
+}
+
+bool Encryptor::fixedLayout(FileReader& source, bool encrypting) const {
+    if (encrypting) {
+        return compression_.algorithm == Compression::None;
+    }
+    
+    // A header too short or corrupt to read is reported by the path that
+    // decrypts the file
+    try {
+        FileReaderStreamBuf sourceBuffer(source, container::HEADER_SIZE);
+        std::istream sourceFile(&sourceBuffer);
+        return container::readHeader(sourceFile).compression == Compression::None;
+    } catch (const EncryptionException&) {
+        return true;
+    }
+}
+
+void Encryptor::writeFileChunk(std::ostream& file, const uint8_t* data, size_t size) {
+    if (!file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size))) {
+        throw EncryptionException("Failed to write to file", CryptoErrorCode::IoError);
+    }
+}
+
+void Encryptor::processFileInChunks(
+    const std::string& sourcePath,
+    const std::string& destPath,
+    secure::SecureView password,
+    bool encrypting,
+    ProgressReporter& progress,
+    OperationRecorder& recorder
+) {
+    // Jobs cancelled while queued stop before the key derivation
+    if (const CancellationToken* token = cancellationToken()) {
+        token->throwIfCancelled();
+    }
+    
+    // Written under a temporary name, so a failure never leaves a partial
+    // file, or unauthenticated plaintext, at the destination
+    AtomicOutput output(*file_system_, destPath);
+    
+    // Mapped pages live in the page cache, so dropping them takes the stream path
+    if (io_mode_ == IoMode::MemoryMapped && file_caching_ == FileCaching::Normal &&
+        file_system_->isMappable(sourcePath) &&
+        processMappedFile(sourcePath, output.tempPath(), password, encrypting, progress, recorder)) {
+        finishOutput(output, nullptr);
+        return;
+    }
+    
+    std::unique_ptr<FileReader> source = openSourceFile(*file_system_, sourcePath, file_caching_);
+    uint64_t fileSize = source->size();
+    progress.setTotal(fileSize);
+    
+    // The output size is known before the first byte is written: the exact
+    // container size when encrypting, an upper bound when decrypting unless
+    // the file was compressed. Nothing is reserved for compressed output
+    bool fixed = fixedLayout(*source, encrypting);
+    uint64_t headerSize = container::HEADER_SIZE +
+                          (key_slots_ ? container::KEY_SLOT_TABLE_SIZE : container::KEY_CHECK_SIZE);
+    uint64_t sizeHint = !encrypting ? fileSize
+                      : fixed ? container::layoutFor(fileSize, static_cast<uint32_t>(chunk_size_), headerSize).totalSize : 0;
+    std::unique_ptr<FileWriter> dest = openDestFile(*file_system_, output.tempPath(), sizeHint, file_caching_);
+    
+    // Compressed records have no precomputed offsets, so they are written in order
+    if (io_engine_ != IoEngine::Blocking && source->threadSafe() && dest->threadSafe() && fixed) {
+        processQueuedFile(*source, *dest, password, encrypting, progress, recorder);
+        finishOutput(output, std::move(dest));
+        return;
+    }
+    
+    FileReaderStreamBuf sourceBuffer(*source);
+    FileWriterStreamBuf destBuffer(*dest);
+    std::istream sourceFile(&sourceBuffer);
+    std::ostream destFile(&destBuffer);
+    
+    processStream(sourceFile, destFile, password, encrypting, progress, recorder);
+    
+    destFile.flush();
+    if (!destFile) {
+        throw EncryptionException("Failed to write to file: " + destPath, CryptoErrorCode::IoError);
+    }
+    finishOutput(output, std::move(dest));
+}
+
+void Encryptor::finishOutput(AtomicOutput& output, std::unique_ptr<FileWriter> dest) {
+    try {
+        if (output_sync_ == OutputSync::Grouped && sync_group_) {
+            sync_group_->add(std::move(dest), output);
+            return;
+        }
+        
+        bool durable = output_sync_ != OutputSync::None;
+        if (dest) {
+            if (durable) {
+                dest->sync();
+            }
+            dest->close();
+        }
+        output.commit(durable);
+    } catch (const FileOperationException& e) {
+        throw EncryptionException("Failed to store destination file: " + output.finalPath() + " (" + e.what() + ")",
+                                  CryptoErrorCode::IoError);
+    }
+}
+
+void Encryptor::processStream(
+    std::istream& source,
+    std::ostream& dest,
+    secure::SecureView password,
+    bool encrypting,
+    ProgressReporter& progress,
+    OperationRecorder& recorder
+) {
+    using Phase = EncryptorStats::Phase;
+    
+    // Chunks are independent, so they can be processed on the pool and
+    // written back in order
+    size_t workers = thread_pool_ ? thread_pool_->size() : 1;
+    size_t maxInFlight = max_in_flight_chunks_ > 0 ? max_in_flight_chunks_ : 2 * workers;
+    uint64_t processedBytes = 0;
+    
+    // Process file in chunks
+    if (encrypting) {
+        // Derive the file key once and record how it was derived in the header
+        container::FileHeader header = newHeader();
+        CompressionSettings settings = compression_;
+        size_t prefixSize = header.compression != Compression::None ? container::CHUNK_PREFIX_SIZE : 0;
+        std::shared_ptr<const SecureKey> fileKey = recorder.time(Phase::Kdf, [&] { return newContainerKey(password, header); });
+        const SecureKey& key = *fileKey;
+        container::ContainerWriter writer = recorder.time(Phase::Write, [&] { return container::ContainerWriter(dest, header); });
+        recorder.addBytes(0, header.headerSize);
+        
+        ChunkPipeline pipeline(thread_pool_.get(), maxInFlight,
+            [this, &key, &header, &recorder, settings](PipelineChunk& chunk) {
+                // Compression runs here too, so it scales with the workers
+                sealRecord(chunk, key, header, settings, recorder);
+            },
+            [&](PipelineChunk& chunk) {
+                recorder.time(Phase::Write, [&] { writer.writeChunk(chunk.data, chunk.isFinal); });
+                recorder.addChunk(chunk.inputSize, chunk.data.size());
+                
+                processedBytes += chunk.inputSize;
+                progress.add(chunk.inputSize);
+            },
+            buffer_pool_.get());
+        pipeline.setCancellationToken(cancellationToken());
+        pipeline.setMemoryBudget(memory_budget_.get());
+        
+        // Read one chunk ahead so the last record can be flagged as final
+        uint64_t chunkIndex = 0;
+        auto readChunk = [&] { return recorder.time(Phase::Read, [&] { return readPlaintextChunk(source, prefixSize); }); };
+        std::vector<uint8_t> chunk = readChunk();
+        while (true) {
+            std::vector<uint8_t> nextChunk;
+            bool isFinal = chunk.size() < container::recordSize(prefixSize + chunk_size_);
+            if (!isFinal) {
+                nextChunk = readChunk();
+                isFinal = nextChunk.size() == container::recordSize(prefixSize);
+            }
+            
+            size_t plaintextSize = chunk.size() - container::recordSize(prefixSize);
+            pipeline.push({chunkIndex++, isFinal, std::move(chunk), 0, plaintextSize});
+            
+            if (isFinal) {
+                buffer_pool_->release(std::move(nextChunk));
+                break;
+            }
+            chunk = std::move(nextChunk);
+        }
+        
+        pipeline.finish();
+        recorder.time(Phase::Write, [&] { writer.finish(processedBytes); });
+        recorder.addBytes(0, container::footerSize(chunkIndex));
+    } else {
+        // Re-derive the file key from the stored salt and costs
+        container::ContainerReader reader = recorder.time(Phase::Read, [&] { return container::ContainerReader(source); });
+        std::shared_ptr<const SecureKey> fileKey = recorder.time(Phase::Kdf, [&] { return containerKey(password, reader.header()); });
+        const SecureKey& key = *fileKey;
+        progress.add(reader.header().headerSize);
+        recorder.addBytes(reader.header().headerSize, 0);
+        bool incremental = container::isIncremental(reader.header());
+        
+        ChunkPipeline pipeline(thread_pool_.get(), maxInFlight,
+            [this, &key, &reader, &recorder](PipelineChunk& chunk) {
+                openRecord(chunk, key, reader.header(), recorder);
+            },
+            [&](PipelineChunk& chunk) {
+                size_t plaintextSize = chunk.data.size() - chunk.offset;
+                recorder.time(Phase::Write, [&] { writeFileChunk(dest, chunk.data.data() + chunk.offset, plaintextSize); });
+                recorder.addChunk(chunk.inputSize, plaintextSize);
+                progress.add(chunk.inputSize);
+            },
+            buffer_pool_.get());
+        pipeline.setCancellationToken(cancellationToken());
+        pipeline.setMemoryBudget(memory_budget_.get());
+        
+        // Records are self-delimiting, so only in-flight chunks are held in memory
+        size_t frameSize = container::recordSize(container::maxRecordPlaintext(reader.header()));
+        uint64_t chunkIndex = 0;
+        std::vector<uint8_t> frame = buffer_pool_->acquire(frameSize);
+        std::vector<container::NoncePrefix> prefixes;
+        bool isFinal = false;
+        while (recorder.time(Phase::Read, [&] { return reader.readNextChunk(frame, isFinal); })) {
+            size_t recordLength = frame.size();
+            if (incremental) {
+                prefixes.push_back(container::framePrefix(frame.data()));
+            }
+            pipeline.push({chunkIndex++, isFinal, std::move(frame), 0, recordLength});
+            frame = buffer_pool_->acquire(isFinal ? 0 : frameSize);
+        }
+        buffer_pool_->release(std::move(frame));
+        
+        // A stream can only be checked against the header once it has been
+        // read; callers must discard the output if this throws
+        pipeline.finish();
+        container::checkRecordPrefixes(*crypto_, key, reader.header(), prefixes);
+        recorder.addBytes(container::footerSize(chunkIndex), 0);
+    }
+    
+    // Ensure all data is written
+    recorder.time(Phase::Write, [&] { dest.flush(); });
+    if (!dest) {
+        throw EncryptionException("Failed to write output", CryptoErrorCode::IoError);
+    }
+}
+
+bool Encryptor::processMappedFile(
+    const std::string& sourcePath,
+    const std::string& destPath,
+    secure::SecureView password,
+    bool encrypting,
+    ProgressReporter& progress,
+    OperationRecorder& recorder
+) {
+    using Phase = EncryptorStats::Phase;
+    
+    size_t workers = thread_pool_ ? thread_pool_->size() : 1;
+    size_t maxInFlight = max_in_flight_chunks_ > 0 ? max_in_flight_chunks_ : 2 * workers;
+    if (encrypting) {
+        // Compressed records have no precomputed offsets
+        if (compression_.algorithm != Compression::None) {
+            return false;
+        }
+        
+        MappedFile source = MappedFile::openReadOnly(sourcePath);
+        uint64_t fileSize = source.size();
+        progress.setTotal(fileSize);
+        
+        // Derive the file key once and record how it was derived in the header
+        container::FileHeader header;
+        header.chunkSize = static_cast<uint32_t>(chunk_size_);
+        std::shared_ptr<const SecureKey> fileKey = recorder.time(Phase::Kdf, [&] { return newContainerKey(password, header); });
+        const SecureKey& key = *fileKey;
+        
+        // Every record's position is known up front, so chunks can be written in any order
+        container::ContainerLayout layout = container::layoutFor(fileSize, header.chunkSize, header.headerSize);
+        
+        MappedFile dest = MappedFile::create(destPath, layout.totalSize);
+        container::encodeHeader(header, dest.data());
+        
+        ChunkPipeline pipeline(thread_pool_.get(), maxInFlight,
+            [&](PipelineChunk& chunk) {
+                size_t plaintextSize = chunk.isFinal ? layout.lastChunkSize : header.chunkSize;
+                uint8_t* frame = dest.data() + layout.chunkOffset(chunk.index, header.chunkSize);
+                recorder.time(Phase::Crypto, [&] {
+                    crypto_->encryptChunk(source.data() + chunk.index * header.chunkSize, plaintextSize,
+                                          key, container::chunkNonce(header, chunk.index, chunk.isFinal),
+                                          frame, container::recordSize(plaintextSize));
+                });
+                if (chunk.isFinal) {
+                    container::setFinalFlag(frame);
+                }
+                recorder.addChunk(plaintextSize, container::recordSize(plaintextSize));
+                progress.add(plaintextSize);
+            },
+            [](PipelineChunk&) {});
+        pipeline.setCancellationToken(cancellationToken());
+        pipeline.setMemoryBudget(memory_budget_.get());
+        
+        for (uint64_t i = 0; i < layout.chunkCount; ++i) {
+            pipeline.push({i, i + 1 == layout.chunkCount, {}});
+        }
+        pipeline.finish();
+        
+        std::vector<uint64_t> chunkOffsets(layout.chunkCount);
+        for (uint64_t i = 0; i < layout.chunkCount; ++i) {
+            chunkOffsets[i] = layout.chunkOffset(i, header.chunkSize);
+        }
+        container::encodeFooter(chunkOffsets, fileSize, dest.data() + layout.footerOffset);
+        recorder.addBytes(0, header.headerSize + container::footerSize(layout.chunkCount));
+        if (output_sync_ != OutputSync::None) {
+            dest.flush();
+        }
+        return true;
+    }
+    
+    // The index gives the plaintext size and validates every record's framing
+    container::ContainerInfo info;
+    {
+        std::unique_ptr<FileReader> source = openSourceFile(*file_system_, sourcePath);
+        FileReaderStreamBuf sourceBuffer(*source);
+        std::istream sourceFile(&sourceBuffer);
+        info = recorder.time(Phase::Read, [&] { return container::ContainerReader(sourceFile).readIndex(); });
+    }
+    
+    // An empty destination cannot be mapped, and compressed records must be
+    // decompressed before their plaintext can be placed
+    if (info.plaintextSize == 0 || info.header.compression != Compression::None) {
+        return false;
+    }
+    
+    MappedFile source = MappedFile::openReadOnly(sourcePath);
+    if (source.size() != info.fileSize) {
+        throw EncryptionException("Encrypted file changed while reading", CryptoErrorCode::IoError);
+    }
+    
+    // Re-derive the file key from the stored salt and costs
+    std::shared_ptr<const SecureKey> fileKey = recorder.time(Phase::Kdf, [&] { return decryptionKey(password, info.header); });
+    const SecureKey& key = *fileKey;
+    container::checkRecordPrefixes(*crypto_, key, info.header, info.noncePrefixes);
+    
+    MappedFile dest = MappedFile::create(destPath, info.plaintextSize);
+    uint64_t chunkCount = info.chunkOffsets.size();
+    progress.setTotal(info.fileSize);
+    progress.add(info.chunkOffsets.front());
+    uint64_t indexOffset = info.fileSize - container::footerSize(chunkCount);
+    
+    ChunkPipeline pipeline(thread_pool_.get(), maxInFlight,
+        [&](PipelineChunk& chunk) {
+            uint64_t offset = info.chunkOffsets[chunk.index];
+            uint64_t end = chunk.isFinal ? indexOffset : info.chunkOffsets[chunk.index + 1];
+            size_t recordLength = static_cast<size_t>(end - offset);
+            size_t plaintextSize = recordLength - container::recordSize(0);
+            uint8_t* plaintext = dest.data() + chunk.index * info.header.chunkSize;
+            ChunkNonce nonce = container::chunkNonce(info, chunk.index, chunk.isFinal);
+            
+            if (!chunk.isFinal) {
+                recorder.time(Phase::Crypto, [&] {
+                    crypto_->decryptChunk(source.data() + offset, recordLength, key, nonce, plaintext, plaintextSize);
+                });
+                recorder.addChunk(recordLength, plaintextSize);
+                progress.add(recordLength);
+                return;
+            }
+            
+            // The source map is read-only, so clear the final flag on a copy
+            std::vector<uint8_t> frame = buffer_pool_->acquire(recordLength);
+            std::copy(source.data() + offset, source.data() + end, frame.begin());
+            container::clearFinalFlag(frame.data());
+            try {
+                recorder.time(Phase::Crypto, [&] {
+                    crypto_->decryptChunk(frame.data(), frame.size(), key, nonce, plaintext, plaintextSize);
+                });
+            } catch (...) {
+                buffer_pool_->release(std::move(frame));
+                throw;
+            }
+            buffer_pool_->release(std::move(frame));
+            recorder.addChunk(recordLength, plaintextSize);
+            progress.add(recordLength);
+        },
+        [](PipelineChunk&) {});
+    pipeline.setCancellationToken(cancellationToken());
+    pipeline.setMemoryBudget(memory_budget_.get());
+    
+    for (uint64_t i = 0; i < chunkCount; ++i) {
+        pipeline.push({i, i + 1 == chunkCount, {}});
+    }
+    pipeline.finish();
+    recorder.addBytes(info.chunkOffsets.front() + container::footerSize(chunkCount), 0);
+    if (output_sync_ != OutputSync::None) {
+        dest.flush();
+    }
+    return true;
+}
+
+void Encryptor::processQueuedFile(
+    FileReader& source,
+    FileWriter& dest,
+    secure::SecureView password,
+    bool encrypting,
+    ProgressReporter& progress,
+    OperationRecorder& recorder
+) {
+    using Phase = EncryptorStats::Phase;
+    
+    size_t workers = thread_pool_ ? thread_pool_->size() : 1;
+    size_t maxInFlight = max_in_flight_chunks_ > 0 ? max_in_flight_chunks_ : 2 * workers;
+    
+    // Like the mapped path, place every record by offset: the layout gives
+    // them when encrypting, the index when decrypting
+    container::FileHeader header;
+    container::ContainerLayout layout;
+    container::ContainerInfo info;
+    std::shared_ptr<const SecureKey> fileKey;
+    uint64_t chunkCount = 0;
+    uint64_t indexOffset = 0;
+    if (encrypting) {
+        header.chunkSize = static_cast<uint32_t>(chunk_size_);
+        fileKey = recorder.time(Phase::Kdf, [&] { return newContainerKey(password, header); });
+        layout = container::layoutFor(source.size(), header.chunkSize, header.headerSize);
+        chunkCount = layout.chunkCount;
+        indexOffset = layout.footerOffset;
+        
+        std::vector<uint8_t> headerBytes(header.headerSize);
+        container::encodeHeader(header, headerBytes.data());
+        recorder.time(Phase::Write, [&] { dest.writeAt(0, headerBytes.data(), headerBytes.size()); });
+        recorder.addBytes(0, header.headerSize);
+    } else {
+        FileReaderStreamBuf sourceBuffer(source);
+        std::istream sourceFile(&sourceBuffer);
+        info = recorder.time(Phase::Read, [&] { return container::ContainerReader(sourceFile).readIndex(); });
+        header = info.header;
+        fileKey = recorder.time(Phase::Kdf, [&] { return decryptionKey(password, header); });
+        container::checkRecordPrefixes(*crypto_, *fileKey, header, info.noncePrefixes);
+        chunkCount = info.chunkOffsets.size();
+        indexOffset = info.fileSize - container::footerSize(chunkCount);
+        progress.add(info.chunkOffsets.front());
+        recorder.addBytes(info.chunkOffsets.front() + container::footerSize(chunkCount), 0);
+    }
+    const SecureKey& key = *fileKey;
+    size_t frameSize = container::recordSize(header.chunkSize);
+    
+    auto recordLength = [&](uint64_t index) -> size_t {
+        if (encrypting) {
+            return container::recordSize(index + 1 == chunkCount ? layout.lastChunkSize : header.chunkSize);
+        }
+        uint64_t end = index + 1 == chunkCount ? indexOffset : info.chunkOffsets[index + 1];
+        return static_cast<size_t>(end - info.chunkOffsets[index]);
+    };
+    
+    // Plaintext sits after the frame header in the buffer, so both
+    // directions transform in place
+    auto readOffset = [&](uint64_t index) {
+        return encrypting ? index * header.chunkSize : info.chunkOffsets[index];
+    };
+    auto writeOffset = [&](uint64_t index) {
+        return encrypting ? layout.chunkOffset(index, header.chunkSize) : index * header.chunkSize;
+    };
+    size_t plaintextStart = container::FRAME_HEADER_SIZE;
+    size_t recordOverhead = container::recordSize(0);
+    
+    // Declared in this order so the queue drains before the buffers go
+    QueuedFrames frames(*buffer_pool_,
+                        static_cast<size_t>(std::min<uint64_t>(chunkCount, maxInFlight + 2 * io_queue_depth_)),
+                        frameSize);
+    std::unique_ptr<IoQueue> queue = IoQueue::create(io_engine_, io_queue_depth_);
+    queue->registerBuffers(frames.buffers());
+    
+    ChunkPipeline pipeline(thread_pool_.get(), maxInFlight,
+        [&](PipelineChunk& chunk) {
+            uint8_t* frame = chunk.data.data();
+            size_t length = recordLength(chunk.index);
+            ChunkNonce nonce = encrypting ? container::chunkNonce(header, chunk.index, chunk.isFinal)
+                                          : container::chunkNonce(info, chunk.index, chunk.isFinal);
+            if (encrypting) {
+                recorder.time(Phase::Crypto, [&] {
+                    crypto_->encryptChunk(frame + plaintextStart, length - recordOverhead, key, nonce, frame, length);
+                });
+                if (chunk.isFinal) {
+                    container::setFinalFlag(frame);
+                }
+            } else {
+                if (chunk.isFinal) {
+                    container::clearFinalFlag(frame);
+                }
+                recorder.time(Phase::Crypto, [&] {
+                    crypto_->decryptChunk(frame, length, key, nonce, frame + plaintextStart, length - plaintextStart);
+                });
+            }
+        },
+        [&](PipelineChunk& chunk) {
+            uint64_t index = chunk.index;
+            size_t length = recordLength(index);
+            const uint8_t* frame = frames.startWrite(index, std::move(chunk.data));
+            const uint8_t* data = encrypting ? frame : frame + plaintextStart;
+            size_t size = encrypting ? length : length - recordOverhead;
+            recorder.time(Phase::Write, [&] {
+                queue->write(dest, writeOffset(index), data, size,
+                    [&, index, length](size_t, std::exception_ptr error) {
+                        if (!error) {
+                            size_t plaintextSize = length - recordOverhead;
+                            recorder.addChunk(encrypting ? plaintextSize : length, encrypting ? length : plaintextSize);
+                            progress.add(encrypting ? plaintextSize : length);
+                        }
+                        frames.writeDone(index, error);
+                    });
+            });
+        },
+        buffer_pool_.get());
+    pipeline.setCancellationToken(cancellationToken());
+    pipeline.setMemoryBudget(memory_budget_.get());
+    
+    // Keep up to the queue depth of reads ahead of the cipher
+    uint64_t submitted = 0;
+    uint64_t next = 0;
+    while (next < chunkCount) {
+        while (submitted < chunkCount && submitted < next + queue->depth()) {
+            size_t length = recordLength(submitted);
+            if (length > frameSize || length < recordOverhead) {
+                throw EncryptionException("Invalid chunk size in encrypted file", CryptoErrorCode::DataCorrupted);
+            }
+            uint8_t* frame = frames.startRead(submitted);
+            if (!frame) {
+                break;
+            }
+            uint64_t index = submitted++;
+            queue->read(source, readOffset(index), encrypting ? frame + plaintextStart : frame,
+                        encrypting ? length - recordOverhead : length,
+                        [&frames, index](size_t bytes, std::exception_ptr error) { frames.readDone(index, bytes, error); });
+        }
+        
+        // Every buffer is in the cipher or being written
+        if (submitted == next) {
+            recorder.time(Phase::Write, [&] { frames.waitForFrame(); });
+            continue;
+        }
+        
+        size_t expected = encrypting ? recordLength(next) - recordOverhead : recordLength(next);
+        std::vector<uint8_t> frame = recorder.time(Phase::Read, [&] { return frames.takeRead(next, expected); });
+        pipeline.push({next, next + 1 == chunkCount, std::move(frame)});
+        ++next;
+    }
+    
+    pipeline.finish();
+    recorder.time(Phase::Write, [&] { queue->drain(); });
+    frames.checkWrites();
+    
+    if (encrypting) {
+        std::vector<uint64_t> chunkOffsets(chunkCount);
+        for (uint64_t i = 0; i < chunkCount; ++i) {
+            chunkOffsets[i] = layout.chunkOffset(i, header.chunkSize);
+        }
+        std::vector<uint8_t> footer(container::footerSize(chunkCount));
+        container::encodeFooter(chunkOffsets, source.size(), footer.data());
+        recorder.time(Phase::Write, [&] { dest.writeAt(layout.footerOffset, footer.data(), footer.size()); });
+        recorder.addBytes(0, footer.size());
+    }
 }
 
 } // namespace crusty
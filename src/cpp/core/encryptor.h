@@ -1,16 +1,59 @@
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <functional>
+#include <iosfwd>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
+#include "async_operation.h"
+#include "cancellation.h"
+#include "compression.h"
+#include "file_operations.h"
+#include "io_queue.h"
+#include "output_file.h"
+#include "progress_reporter.h"
+#include "secure_utils.h"
+
 namespace crusty {
 
+namespace container {
+struct ArchiveCatalog;
+struct ArchiveEntry;
+struct ContainerInfo;
+struct ContainerSummary;
+struct FileHeader;
+struct KeySlot;
+}
+
+class DecryptStream;
+class EncryptStream;
+class EncryptedFileReader;
+class EncryptorStats;
+class JobQueue;
+class KeyCache;
+class MemoryBudget;
+class OperationRecorder;
+class PathResolver;
+struct PipelineChunk;
+class ThreadPool;
+
+namespace secure {
+class SecureBufferPool;
+}
+
+namespace crypto {
+struct crusty_key;
+}
+
 /**
  * Progress callback type for encryption/decryption operations
- * Reports progress as a value from 0.0 (started) to 1.0 (completed)
+ * Reports progress as a value from 0.0 (started) to 1.0 (completed); see
+ * DetailedProgressCallback for bytes, rate and remaining time
  */
 using ProgressCallback = std::function<void(float progress)>;
 
@@ -22,7 +65,8 @@ enum class CryptoErrorCode {
     DataCorrupted,
     AuthenticationFailed, 
     IoError,
-    InternalError
+    InternalError,
+    HardwareNotAvailable
 };
 
 /**
@@ -42,6 +86,103 @@ public:
     CryptoErrorCode getErrorCode() const { return error_code_; }
 };
 
+/**
+ * How file data is moved between disk and the cipher
+ */
+enum class IoMode {
+    Stream,       // Buffered stream reads and writes
+    MemoryMapped  // Map source and destination; falls back to Stream if the source can't be mapped
+};
+
+/**
+ * AES-GCM implementation the crypto library selected for this CPU
+ */
+enum class AesBackend {
+    Software,     // Portable constant-time implementation
+    AesNiClmul,   // AES-NI rounds with PCLMULQDQ for GHASH (x86-64)
+    Armv8Crypto   // ARMv8 AES and PMULL instructions (aarch64)
+};
+
+/**
+ * @brief Argon2id cost parameters used to derive a file key
+ * 
+ * The defaults match `Argon2::default()` in the Rust crypto library.
+ */
+struct KdfParams {
+    uint32_t memoryKib = 19456;
+    uint32_t iterations = 2;
+    uint32_t parallelism = 1;
+};
+
+/**
+ * @brief Derived AES-256 key held by the Rust crypto library
+ * 
+ * Owns an opaque handle to the expanded key schedule and a nonce counter
+ * in Rust-owned memory, which is zeroized when the handle is destroyed.
+ * The raw key bytes never reach C++. A key may be used from several
+ * threads at once.
+ */
+class SecureKey {
+public:
+    SecureKey() = default;
+    
+    /**
+     * @brief Take ownership of a handle from the crypto library
+     */
+    explicit SecureKey(crypto::crusty_key* handle) : handle_(handle) {}
+    
+    ~SecureKey();
+    
+    /**
+     * @brief Import raw key bytes, e.g. a key unwrapped from elsewhere
+     * 
+     * @param key Key bytes; the caller remains responsible for wiping them
+     * @param size Must be 32
+     * @throws EncryptionException if the key is invalid
+     */
+    static SecureKey fromBytes(const uint8_t* key, size_t size);
+    
+    /**
+     * @return Handle for the crypto library, or null for an empty key
+     */
+    crypto::crusty_key* handle() const { return handle_; }
+    
+    explicit operator bool() const { return handle_ != nullptr; }
+    
+    // Prevent copying
+    SecureKey(const SecureKey&) = delete;
+    SecureKey& operator=(const SecureKey&) = delete;
+    
+    // Allow moving
+    SecureKey(SecureKey&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+    SecureKey& operator=(SecureKey&& other) noexcept;
+
+private:
+    crypto::crusty_key* handle_ = nullptr;
+};
+
+/**
+ * AES-GCM nonce of one container chunk, from container::chunkNonce
+ */
+using ChunkNonce = std::array<uint8_t, 12>;
+
+/**
+ * Keyed digest of some data, from Crypto::fingerprint
+ */
+using Fingerprint = std::array<uint8_t, 32>;
+
+/**
+ * One message of Crypto::encryptBatch or Crypto::decryptBatch
+ */
+struct CryptoMessage {
+    const uint8_t* input = nullptr;   // Plaintext, or a frame to decrypt
+    size_t inputSize = 0;
+    uint8_t* output = nullptr;        // Sized as for encryptInto/decryptInto
+    size_t outputSize = 0;
+    size_t written = 0;               // Set to the bytes written
+    bool succeeded = false;           // Set by the call
+};
+
 /**
  * @brief Core cryptographic operations
  * 
@@ -62,7 +203,7 @@ public:
      */
     virtual std::vector<uint8_t> encrypt(
         const std::vector<uint8_t>& plaintext,
-        const std::string& password
+        secure::SecureView password
     ) const;
     
     /**
@@ -75,9 +216,223 @@ public:
      */
     virtual std::vector<uint8_t> decrypt(
         const std::vector<uint8_t>& ciphertext,
-        const std::string& password
+        secure::SecureView password
+    ) const;
+    
+    /**
+     * @brief Derive a 32-byte key from a password with Argon2id
+     * 
+     * @param password Password to derive from
+     * @param salt Salt stored alongside the encrypted data
+     * @param params Argon2id cost parameters
+     * @return Derived key
+     * @throws EncryptionException if derivation fails
+     */
+    virtual SecureKey deriveKey(
+        secure::SecureView password,
+        const std::vector<uint8_t>& salt,
+        const KdfParams& params
+    ) const;
+    
+    /**
+     * @brief Encrypt raw data with an already derived key
+     * 
+     * @param plaintext Data to encrypt
+     * @param key Key returned by deriveKey
+     * @return Encrypted data framed as nonce | length | ciphertext
+     * @throws EncryptionException if encryption fails
+     */
+    virtual std::vector<uint8_t> encryptWithKey(
+        const std::vector<uint8_t>& plaintext,
+        const SecureKey& key
     ) const;
     
+    /**
+     * @brief Decrypt data produced by encryptWithKey
+     * 
+     * @param ciphertext Framed data to decrypt
+     * @param key Key returned by deriveKey
+     * @return Decrypted data
+     * @throws EncryptionException if decryption fails
+     */
+    virtual std::vector<uint8_t> decryptWithKey(
+        const std::vector<uint8_t>& ciphertext,
+        const SecureKey& key
+    ) const;
+    
+    /**
+     * @brief Encrypt into a caller-provided buffer with an already derived key
+     * 
+     * Writes the same frame as encryptWithKey without allocating. If the
+     * plaintext already sits at output + container::FRAME_HEADER_SIZE, it
+     * is encrypted in place; otherwise the buffers may still overlap.
+     * 
+     * @param plaintext Data to encrypt
+     * @param plaintextSize Size of the data in bytes
+     * @param key Key returned by deriveKey
+     * @param output Destination for the frame
+     * @param outputSize Size of output; at least container::recordSize(plaintextSize)
+     * @return Bytes written to output
+     * @throws EncryptionException if encryption fails or output is too small
+     */
+    virtual size_t encryptInto(
+        const uint8_t* plaintext,
+        size_t plaintextSize,
+        const SecureKey& key,
+        uint8_t* output,
+        size_t outputSize
+    ) const;
+    
+    /**
+     * @brief Decrypt a frame into a caller-provided buffer
+     * 
+     * If output is ciphertext + container::FRAME_HEADER_SIZE, the frame is
+     * decrypted in place with the tag verified separately, so the data is
+     * neither copied nor allocated; otherwise the buffers must not overlap.
+     * 
+     * @param ciphertext Frame produced by encryptWithKey or encryptInto
+     * @param ciphertextSize Size of the frame in bytes
+     * @param key Key returned by deriveKey
+     * @param output Destination for the plaintext
+     * @param outputSize Size of output in bytes
+     * @return Bytes written to output
+     * @throws EncryptionException if decryption fails or output is too small
+     */
+    virtual size_t decryptInto(
+        const uint8_t* ciphertext,
+        size_t ciphertextSize,
+        const SecureKey& key,
+        uint8_t* output,
+        size_t outputSize
+    ) const;
+    
+    /**
+     * @brief Encrypt a container chunk under its position-derived nonce
+     * 
+     * Same as encryptInto, but the nonce comes from the caller instead of
+     * the key's sequence. Each nonce must be used only once per key.
+     * 
+     * @param plaintext Data to encrypt
+     * @param plaintextSize Size of the data in bytes
+     * @param key Key returned by deriveKey
+     * @param nonce Nonce from container::chunkNonce
+     * @param output Destination for the frame
+     * @param outputSize Size of output; at least container::recordSize(plaintextSize)
+     * @return Bytes written to output
+     * @throws EncryptionException if encryption fails or output is too small
+     */
+    virtual size_t encryptChunk(
+        const uint8_t* plaintext,
+        size_t plaintextSize,
+        const SecureKey& key,
+        const ChunkNonce& nonce,
+        uint8_t* output,
+        size_t outputSize
+    ) const;
+    
+    /**
+     * @brief Decrypt a container chunk, checking it sits where it was written
+     * 
+     * Decrypts in place when output is ciphertext + container::FRAME_HEADER_SIZE,
+     * as decryptInto does.
+     * 
+     * @param ciphertext Frame produced by encryptChunk
+     * @param ciphertextSize Size of the frame in bytes
+     * @param key Key returned by deriveKey
+     * @param nonce Nonce from container::chunkNonce for the expected position
+     * @param output Destination for the plaintext
+     * @param outputSize Size of output in bytes
+     * @return Bytes written to output
+     * @throws EncryptionException with DataCorrupted if the frame carries another
+     *         nonce, or if decryption fails or output is too small
+     */
+    virtual size_t decryptChunk(
+        const uint8_t* ciphertext,
+        size_t ciphertextSize,
+        const SecureKey& key,
+        const ChunkNonce& nonce,
+        uint8_t* output,
+        size_t outputSize
+    ) const;
+    
+    /**
+     * @brief Encrypt many small messages under one key in a single call
+     * 
+     * Produces the same frames as encryptInto, but the cipher is set up once,
+     * which matters when the messages are only a few kilobytes each. Like
+     * encryptInto, each message takes the next nonce of the key's counter,
+     * seeded by one RNG call when its handle was created, so the batch makes
+     * no RNG calls of its own. Every message is attempted; its
+     * written and succeeded fields are set even when the call throws.
+     * 
+     * @param messages Messages to encrypt; outputs must not overlap other messages
+     * @param key Key returned by deriveKey
+     * @throws EncryptionException if any message failed, with the first error
+     */
+    virtual void encryptBatch(std::vector<CryptoMessage>& messages, const SecureKey& key) const;
+    
+    /**
+     * @brief Decrypt many frames under one key in a single call
+     * 
+     * The output of a message that fails authentication is wiped; the
+     * other messages are still decrypted.
+     * 
+     * @param messages Frames to decrypt; outputs must not overlap any input
+     * @param key Key returned by deriveKey
+     * @throws EncryptionException if any message failed, with the first error
+     */
+    virtual void decryptBatch(std::vector<CryptoMessage>& messages, const SecureKey& key) const;
+    
+    /**
+     * @brief Compute a keyed fingerprint of some data
+     * 
+     * HMAC-SHA256 under a subkey of the file key, so fingerprints can be
+     * stored in the clear: they only show whether two inputs with the same
+     * context are equal. Different contexts give unrelated fingerprints
+     * for the same data.
+     * 
+     * @param context Purpose of the fingerprint, such as a chunk index
+     * @param data Data to fingerprint
+     * @param size Bytes in data
+     * @param key Key returned by deriveKey
+     * @return Fingerprint
+     * @throws EncryptionException if the crypto library fails
+     */
+    virtual Fingerprint fingerprint(uint64_t context, const uint8_t* data, size_t size, const SecureKey& key) const;
+    
+    /**
+     * @brief Generate cryptographically secure random bytes
+     * 
+     * @param count Number of bytes to generate
+     * @return Random bytes
+     * @throws EncryptionException if the system RNG fails
+     */
+    virtual std::vector<uint8_t> randomBytes(size_t count) const;
+    
+    /**
+     * @brief Pick Argon2id costs that take about a target time on this host
+     * 
+     * Times single-pass derivations at the given memory cost and scales the
+     * number of passes to the target. If one pass is already too slow, the
+     * memory cost is halved, but never below the KdfParams defaults, which
+     * are also the weakest costs returned. Meant to run once, for example at
+     * install time, with the result passed to Encryptor::setKdfParams.
+     * 
+     * @param target Wanted time per key derivation
+     * @param memoryKib Memory cost to try first, in KiB
+     * @param parallelism Lanes to use
+     * @return Calibrated costs
+     * @throws EncryptionException if key derivation fails
+     */
+    virtual KdfParams calibrateKdf(
+        std::chrono::milliseconds target,
+        uint32_t memoryKib = DEFAULT_CALIBRATION_MEMORY_KIB,
+        uint32_t parallelism = 1
+    ) const;
+    
+    // First memory cost tried by calibrateKdf (64 MiB)
+    static constexpr uint32_t DEFAULT_CALIBRATION_MEMORY_KIB = 64 * 1024;
+    
     /**
      * @brief Hash a password for storage and verification
      * 
@@ -85,7 +440,7 @@ public:
      * @return Hashed password
      * @throws EncryptionException if hashing fails
      */
-    virtual std::string hashPassword(const std::string& password) const;
+    virtual std::string hashPassword(secure::SecureView password) const;
     
     /**
      * @brief Verify a password against a hash
@@ -95,13 +450,99 @@ public:
      * @return True if password matches hash, false otherwise
      */
     virtual bool verifyPassword(
-        const std::string& password, 
+        secure::SecureView password, 
         const std::string& hash
     ) const;
+    
+    /**
+     * @brief AES-GCM implementation used on this CPU
+     * 
+     * CPU features are detected once by the crypto library and cached.
+     * 
+     * @return The selected backend
+     */
+    static AesBackend aesBackend();
+    
+    /**
+     * @brief Human-readable name of a backend, e.g. for logs and --version
+     * 
+     * @param backend Backend to describe
+     * @return Name such as "AES-NI + PCLMULQDQ"
+     */
+    static const char* aesBackendName(AesBackend backend);
+    
+    /**
+     * @brief Start detecting CPU features on a background thread
+     * 
+     * Meant for startup, so the probe overlaps with building the UI or
+     * parsing arguments instead of delaying the first Encryptor. The probe
+     * runs once per process however often this is called; an Encryptor
+     * created while it runs waits for it.
+     */
+    static void warmUp();
+    
+    /**
+     * @brief Fail unless AES-GCM runs on hardware instructions
+     * 
+     * @throws EncryptionException with HardwareNotAvailable if only the
+     *         software implementation is available
+     */
+    static void requireHardwareAcceleration();
+
+private:
+    static void runBatch(std::vector<CryptoMessage>& messages, const SecureKey& key, bool encrypting);
+};
+
+/**
+ * @brief What Encryptor::verifyFile() checked
+ */
+struct VerifyResult {
+    uint64_t chunkCount = 0;       // Chunks in the file
+    uint64_t chunksVerified = 0;   // Chunks whose tag was checked
+    uint64_t bytesVerified = 0;    // Record bytes read and authenticated
+    uint64_t plaintextSize = 0;    // Original size, from the chunk index
+    
+    /**
+     * @return True if every chunk was checked
+     */
+    bool complete() const { return chunksVerified == chunkCount; }
+};
+
+/**
+ * @brief What Encryptor::updateFile() wrote
+ */
+struct UpdateResult {
+    uint64_t chunkCount = 0;        // Chunks in the updated file
+    uint64_t chunksRewritten = 0;   // Chunks encrypted and written by this call
+    uint64_t bytesWritten = 0;      // Bytes written to the encrypted file
+    bool incremental = false;       // False if the whole file was encrypted anew
+};
+
+/**
+ * @brief One file to store in a deduplicated archive
+ */
+struct ArchiveItem {
+    std::string sourcePath;
+    std::string name;   // Path inside the archive, see container::validArchiveName()
+};
+
+/**
+ * @brief What Encryptor::packFiles() stored
+ */
+struct PackResult {
+    uint64_t files = 0;
+    uint64_t bytesRead = 0;      // Plaintext of all files
+    uint64_t chunkCount = 0;     // Chunks the files were cut into
+    uint64_t chunksStored = 0;   // Distinct chunks, each encrypted and written once
+    uint64_t bytesStored = 0;    // Plaintext of the distinct chunks
 };
 
 /**
  * @brief File encryption and decryption operations
+ * 
+ * encryptFile() and decryptFile() may run concurrently on one Encryptor,
+ * as long as its settings are not changed at the same time. Their Async
+ * variants queue the operation on an executor the engine owns instead.
  */
 class Encryptor {
 public:
@@ -117,63 +558,964 @@ public:
      */
     explicit Encryptor(std::unique_ptr<Crypto> crypto);
     
+    /**
+     * @brief Cancel queued and running asynchronous operations and wait for them
+     */
+    ~Encryptor();
+    
     /**
      * @brief Encrypt a file with a password
      * 
      * @param sourcePath Path to the source file
      * @param destPath Path to the destination file
      * @param password Password for encryption
-     * @param progressCallback Optional callback for progress updates
+     * @param progressCallback Optional callback for progress updates, called
+     *                         from a timer thread (see setProgressSettings)
      * @throws EncryptionException if encryption fails
+     * @throws OperationCancelled if the cancellation token is cancelled
      */
     void encryptFile(
         const std::string& sourcePath,
         const std::string& destPath,
-        const std::string& password,
+        secure::SecureView password,
         ProgressCallback progressCallback = nullptr
     );
     
+    /**
+     * @brief Encrypt a file, reporting bytes, rate and remaining time
+     */
+    void encryptFile(
+        const std::string& sourcePath,
+        const std::string& destPath,
+        secure::SecureView password,
+        DetailedProgressCallback progressCallback
+    );
+    
     /**
      * @brief Decrypt a file with a password
      * 
      * @param sourcePath Path to the source file
      * @param destPath Path to the destination file
      * @param password Password for decryption
-     * @param progressCallback Optional callback for progress updates
-     * @throws EncryptionException if decryption fails
+     * @param progressCallback Optional callback for progress updates, called
+     *                         from a timer thread (see setProgressSettings)
+     * @throws EncryptionException if decryption fails; with InvalidPassword
+     *         if the file's header rejects the password, before any of its
+     *         records is read
+     * @throws OperationCancelled if the cancellation token is cancelled
      */
     void decryptFile(
         const std::string& sourcePath,
         const std::string& destPath,
-        const std::string& password,
+        secure::SecureView password,
         ProgressCallback progressCallback = nullptr
     );
     
+    /**
+     * @brief Decrypt a file, reporting bytes, rate and remaining time
+     */
+    void decryptFile(
+        const std::string& sourcePath,
+        const std::string& destPath,
+        secure::SecureView password,
+        DetailedProgressCallback progressCallback
+    );
+    
+    /**
+     * @brief Encrypt a file on the engine's executor
+     * 
+     * Returns at once. The operation waits in submission order for one of
+     * the executor's workers (see setAsyncWorkerCount), so any number can be
+     * in flight without a thread each, and runs like encryptFile() with its
+     * own cancellation token. The token is a child of the engine's, so
+     * cancelling that stops every operation started after it was set.
+     * 
+     * @param sourcePath Path to the source file
+     * @param destPath Path to the destination file
+     * @param password Password for encryption; copied, and the copy is
+     *                 wiped when the operation ends
+     * @param onComplete Optional callback for the end of the operation
+     * @param progressCallback Optional callback for progress updates
+     * @return Handle to wait for, cancel or get the result of the operation
+     */
+    AsyncOperation encryptFileAsync(
+        const std::string& sourcePath,
+        const std::string& destPath,
+        secure::SecureView password,
+        CompletionCallback onComplete = nullptr,
+        DetailedProgressCallback progressCallback = nullptr
+    );
+    
+    /**
+     * @brief Decrypt a file on the engine's executor
+     * 
+     * Runs like decryptFile(); see encryptFileAsync() for how operations
+     * are queued, cancelled and completed.
+     * 
+     * @param sourcePath Path to the source file
+     * @param destPath Path to the destination file
+     * @param password Password for decryption; copied, and the copy is
+     *                 wiped when the operation ends
+     * @param onComplete Optional callback for the end of the operation
+     * @param progressCallback Optional callback for progress updates
+     * @return Handle to wait for, cancel or get the result of the operation
+     */
+    AsyncOperation decryptFileAsync(
+        const std::string& sourcePath,
+        const std::string& destPath,
+        secure::SecureView password,
+        CompletionCallback onComplete = nullptr,
+        DetailedProgressCallback progressCallback = nullptr
+    );
+    
+    /**
+     * @brief Encrypt from one stream to another
+     * 
+     * Neither stream needs to be seekable, so pipes and standard input and
+     * output work. Memory use is bounded by the chunk size and the in-flight
+     * chunk limit.
+     * 
+     * @param source Binary stream to read the plaintext from
+     * @param dest Binary stream to write the container to
+     * @param password Password for encryption
+     * @param progressCallback Optional callback for progress updates
+     * @param sourceSize Plaintext size for progress reporting, or 0 if unknown
+     * @throws EncryptionException if reading, encryption or writing fails
+     * @throws OperationCancelled if the cancellation token is cancelled
+     */
+    void encryptStream(
+        std::istream& source,
+        std::ostream& dest,
+        secure::SecureView password,
+        ProgressCallback progressCallback = nullptr,
+        uint64_t sourceSize = 0
+    );
+    
+    /**
+     * @brief Encrypt a stream, reporting bytes, rate and remaining time
+     */
+    void encryptStream(
+        std::istream& source,
+        std::ostream& dest,
+        secure::SecureView password,
+        DetailedProgressCallback progressCallback,
+        uint64_t sourceSize = 0
+    );
+    
+    /**
+     * @brief Decrypt from one stream to another
+     * 
+     * Chunks are written as soon as they are authenticated, so on failure
+     * dest may already hold a prefix of the plaintext.
+     * 
+     * @param source Binary stream to read the container from
+     * @param dest Binary stream to write the plaintext to
+     * @param password Password for decryption
+     * @param progressCallback Optional callback for progress updates
+     * @param sourceSize Container size for progress reporting, or 0 if unknown
+     * @throws EncryptionException if the data is corrupted, the password is
+     *         wrong or writing fails
+     * @throws OperationCancelled if the cancellation token is cancelled
+     */
+    void decryptStream(
+        std::istream& source,
+        std::ostream& dest,
+        secure::SecureView password,
+        ProgressCallback progressCallback = nullptr,
+        uint64_t sourceSize = 0
+    );
+    
+    /**
+     * @brief Decrypt a stream, reporting bytes, rate and remaining time
+     */
+    void decryptStream(
+        std::istream& source,
+        std::ostream& dest,
+        secure::SecureView password,
+        DetailedProgressCallback progressCallback,
+        uint64_t sourceSize = 0
+    );
+    
+    /**
+     * @brief Start encrypting data pushed in memory
+     * 
+     * For plaintext that is never in a file or std::istream, such as a
+     * network body: see container_stream.h. The key is derived here, and
+     * the chunk size and compression are those set now.
+     * 
+     * @param password Password for encryption
+     * @return Stream to write the plaintext to and read the container
+     *         from; it must not outlive this Encryptor
+     */
+    std::unique_ptr<EncryptStream> openEncryptStream(secure::SecureView password);
+    
+    /**
+     * @brief Start decrypting a container pushed in memory
+     * 
+     * The counterpart of openEncryptStream(); reads any container, however
+     * it was written.
+     * 
+     * @param password Password the container was encrypted with; copied,
+     *                 and the copy is wiped once the key is derived
+     * @return Stream to write the container to and read the plaintext
+     *         from; it must not outlive this Encryptor
+     */
+    std::unique_ptr<DecryptStream> openDecryptStream(secure::SecureView password);
+    
+    /**
+     * @brief Decrypt one byte range of an encrypted file
+     * 
+     * Only the chunks covering the range are read and authenticated, in
+     * parallel on the workers, so a slice near the end of a large file
+     * costs no more than one near the start.
+     * 
+     * @param sourcePath Path to the encrypted file
+     * @param offset First plaintext byte to decrypt
+     * @param length Bytes wanted; the range is cut short at the end of the plaintext
+     * @param dest Binary stream to write the plaintext to
+     * @param password Password the file was encrypted with
+     * @return Bytes written to dest
+     * @throws EncryptionException if the file is malformed, the password is
+     *         wrong, a covering chunk fails authentication or writing fails
+     * @throws OperationCancelled if the cancellation token is cancelled
+     */
+    uint64_t decryptRange(
+        const std::string& sourcePath,
+        uint64_t offset,
+        uint64_t length,
+        std::ostream& dest,
+        secure::SecureView password
+    );
+    
+    /**
+     * @brief Open an encrypted file for positional plaintext reads
+     * 
+     * Loads the chunk index and derives the key; chunks are then decrypted
+     * as they are read (see encrypted_file_reader.h).
+     * 
+     * @param path Path to the encrypted file
+     * @param password Password the file was encrypted with
+     * @return Reader whose offsets and size are those of the plaintext; it
+     *         must not outlive this Encryptor
+     * @throws EncryptionException if the file is malformed or this build
+     *         cannot decompress it
+     */
+    std::unique_ptr<EncryptedFileReader> openEncryptedFile(const std::string& path, secure::SecureView password) const;
+    
+    /**
+     * @brief Authenticate an encrypted file without writing its plaintext
+     * 
+     * Checks the structure like inspectFile(), then derives the key and
+     * verifies chunk tags on the workers. Each chunk is decrypted in a
+     * pooled buffer that is wiped before reuse; nothing is written. With
+     * sampleChunks set, only that many chunks are read: the first, the last
+     * and a random pick of the others, so large archives can be scrubbed
+     * regularly at a fraction of the I/O. Compressed chunks are
+     * authenticated but not decompressed.
+     * 
+     * @param path Path to the encrypted file
+     * @param password Password the file was encrypted with
+     * @param progressCallback Optional callback for progress updates
+     * @param sampleChunks Chunks to check (at least 2), or 0 for all of them
+     * @return What was checked
+     * @throws EncryptionException if the file is malformed, the password is
+     *         wrong or a chunk fails authentication; the message names the
+     *         first chunk that failed
+     * @throws OperationCancelled if the cancellation token is cancelled
+     */
+    VerifyResult verifyFile(
+        const std::string& path,
+        secure::SecureView password,
+        ProgressCallback progressCallback = nullptr,
+        uint64_t sampleChunks = 0
+    );
+    
+    /**
+     * @brief Verify a file, reporting bytes, rate and remaining time
+     */
+    VerifyResult verifyFile(
+        const std::string& path,
+        secure::SecureView password,
+        DetailedProgressCallback progressCallback,
+        uint64_t sampleChunks = 0
+    );
+    
+    /**
+     * @brief Encrypt a file, rewriting only the chunks that changed since the last update
+     * 
+     * Writes an incremental container (FLAG_INCREMENTAL) and a chunk
+     * manifest next to it (destPath + MANIFEST_SUFFIX) with a keyed
+     * fingerprint of every chunk. When destPath already holds an
+     * incremental container with a valid manifest, the password must match
+     * it; the file is then updated in place and only chunks whose
+     * fingerprint differs, plus the last one, are encrypted again, each
+     * under a nonce prefix drawn for this call. Anything else at destPath
+     * is replaced by a fresh encryption. Incremental containers are never
+     * compressed; the compression setting is ignored.
+     * 
+     * An interrupted in-place update leaves a file that fails
+     * authentication until the update is run again, which rewrites every
+     * chunk it may have touched. Any reader of this format can decrypt the
+     * result.
+     * 
+     * @param sourcePath Path to the plaintext
+     * @param destPath Path to the encrypted file to create or update
+     * @param password Password for the file; must match an existing one
+     * @param progressCallback Optional callback for progress updates
+     * @return What was written
+     * @throws EncryptionException if the password does not match the
+     *         existing file or an I/O error occurs
+     * @throws OperationCancelled if the cancellation token is cancelled
+     */
+    UpdateResult updateFile(
+        const std::string& sourcePath,
+        const std::string& destPath,
+        secure::SecureView password,
+        ProgressCallback progressCallback = nullptr
+    );
+    
+    /**
+     * @brief Update a file, reporting bytes, rate and remaining time
+     */
+    UpdateResult updateFile(
+        const std::string& sourcePath,
+        const std::string& destPath,
+        secure::SecureView password,
+        DetailedProgressCallback progressCallback
+    );
+    
+    /**
+     * @brief Encrypt a batch of files into one archive, storing equal chunks once
+     * 
+     * Files are cut at content-defined boundaries (ContentChunker) of at
+     * most the chunk size, averaging a quarter of it, so data shared
+     * between files, or shifted by an insertion, still yields equal
+     * chunks. Each chunk gets a keyed ID; a chunk whose ID was seen before
+     * in the batch is neither encrypted nor written again, only referenced
+     * from its file's entry in the archive catalog. Only chunks within one
+     * archive are shared. The archive is written to a temporary file and
+     * renamed into place. Compression settings do not apply.
+     * 
+     * Equal chunks produce equal records, so anyone with the archive can
+     * see which parts of the batch repeat, though not what they hold.
+     * 
+     * @param items Files and their names in the archive; names must be unique
+     * @param archivePath Path to the archive to create or replace
+     * @param password Password for the archive
+     * @param progressCallback Optional callback for progress updates
+     * @return What was stored
+     * @throws EncryptionException if a name is invalid or repeated, or an
+     *         I/O error occurs
+     * @throws OperationCancelled if the cancellation token is cancelled
+     */
+    PackResult packFiles(
+        const std::vector<ArchiveItem>& items,
+        const std::string& archivePath,
+        secure::SecureView password,
+        ProgressCallback progressCallback = nullptr
+    );
+    
+    /**
+     * @brief Pack files, reporting bytes, rate and remaining time
+     */
+    PackResult packFiles(
+        const std::vector<ArchiveItem>& items,
+        const std::string& archivePath,
+        secure::SecureView password,
+        DetailedProgressCallback progressCallback
+    );
+    
+    /**
+     * @brief Extract every file of a deduplicated archive
+     * 
+     * Each file is written to a temporary file beside its destination and
+     * renamed into place once all of its chunks authenticated; existing
+     * files are replaced. Names are checked so nothing is written outside
+     * destDirectory.
+     * 
+     * @param archivePath Path to the archive
+     * @param destDirectory Directory receiving the files, created if needed
+     * @param password Password the archive was created with
+     * @param progressCallback Optional callback for progress updates
+     * @throws EncryptionException if the archive is malformed, the password
+     *         is wrong, a chunk fails authentication or an I/O error occurs
+     * @throws OperationCancelled if the cancellation token is cancelled
+     */
+    void unpackArchive(
+        const std::string& archivePath,
+        const std::string& destDirectory,
+        secure::SecureView password,
+        ProgressCallback progressCallback = nullptr
+    );
+    
+    /**
+     * @brief Unpack an archive, reporting bytes, rate and remaining time
+     */
+    void unpackArchive(
+        const std::string& archivePath,
+        const std::string& destDirectory,
+        secure::SecureView password,
+        DetailedProgressCallback progressCallback
+    );
+    
+    /**
+     * @brief Extract some files of a deduplicated archive by name
+     * 
+     * Only the catalog and the chunks of the named files are read and
+     * decrypted, so taking one file out of a large archive costs about as
+     * much as decrypting that file alone. Files are written as by
+     * unpackArchive(), under their archive names below destDirectory.
+     * 
+     * @param archivePath Path to the archive
+     * @param names Names of the files to extract, as listed by listArchive()
+     * @param destDirectory Directory receiving the files, created if needed
+     * @param password Password the archive was created with
+     * @param progressCallback Optional callback for progress updates
+     * @throws EncryptionException if a name is not in the archive (before
+     *         anything is written), the archive is malformed, the password
+     *         is wrong, a chunk fails authentication or an I/O error occurs
+     * @throws OperationCancelled if the cancellation token is cancelled
+     */
+    void extractFiles(
+        const std::string& archivePath,
+        const std::vector<std::string>& names,
+        const std::string& destDirectory,
+        secure::SecureView password,
+        ProgressCallback progressCallback = nullptr
+    );
+    
+    /**
+     * @brief Extract files by name, reporting bytes, rate and remaining time
+     */
+    void extractFiles(
+        const std::string& archivePath,
+        const std::vector<std::string>& names,
+        const std::string& destDirectory,
+        secure::SecureView password,
+        DetailedProgressCallback progressCallback
+    );
+    
+    /**
+     * @brief Read the catalog of a deduplicated archive
+     * 
+     * @param archivePath Path to the archive
+     * @param password Password the archive was created with
+     * @return Files and stored chunks (see container_format.h)
+     * @throws EncryptionException if the archive is malformed or the
+     *         password is wrong
+     */
+    container::ArchiveCatalog listArchive(const std::string& archivePath, secure::SecureView password) const;
+    
+    /**
+     * @brief Check the structure of an encrypted file without decrypting it
+     * 
+     * Validates the header, the footer chunk index and every record's
+     * framing. No key is derived, so no password is needed.
+     * 
+     * @param path Path to the encrypted file
+     * @return Container structure (see container_format.h)
+     * @throws EncryptionException if the file is unreadable or malformed
+     */
+    container::ContainerInfo inspectFile(const std::string& path) const;
+    
+    /**
+     * @brief Read the header and trailer of an encrypted file
+     * 
+     * Two small reads, for showing a file's parameters; unlike inspectFile()
+     * the records are not checked.
+     * 
+     * @param path Path to the encrypted file
+     * @return Header and trailer counts (see container_format.h)
+     * @throws EncryptionException if the file is unreadable or not a container
+     */
+    container::ContainerSummary summarizeFile(const std::string& path) const;
+    
+    /**
+     * @brief Let another password open a file encrypted with key slots
+     * 
+     * Seals the file's data key, opened with password, into a free slot
+     * under newPassword and the current Argon2id costs. Only the header is
+     * rewritten, in place, and flushed to disk before returning. The slots
+     * in use are listed by summarizeFile().
+     * 
+     * @param path Path to a container with FLAG_KEY_SLOTS
+     * @param password Password that opens one of its slots
+     * @param newPassword Password for the new slot
+     * @return Index of the new slot
+     * @throws EncryptionException if the file has no key slots or none is
+     *         free, password opens none of them, or the header cannot be
+     *         rewritten
+     */
+    size_t addKeySlot(const std::string& path, secure::SecureView password, secure::SecureView newPassword);
+    
+    /**
+     * @brief Take a password's access to a file encrypted with key slots away
+     * 
+     * The slot is overwritten with zeros in place. Copies of the file made
+     * before still open with its password, and the data key is unchanged;
+     * to revoke a key that may have leaked, encrypt the file again.
+     * 
+     * @param path Path to a container with FLAG_KEY_SLOTS
+     * @param password Password that opens one of its slots
+     * @param slot Index of the slot to clear
+     * @throws EncryptionException if the file has no key slots, the slot
+     *         is unused or the last one in use, password opens none of
+     *         them, or the header cannot be rewritten
+     */
+    void removeKeySlot(const std::string& path, secure::SecureView password, size_t slot);
+    
+    /**
+     * @brief Change the password of the key slot a password opens
+     * 
+     * The slot gets a fresh salt and the current Argon2id costs; the
+     * records are untouched.
+     * 
+     * @param path Path to a container with FLAG_KEY_SLOTS
+     * @param password Current password of the slot
+     * @param newPassword Password to seal the slot under instead
+     * @return Index of the changed slot
+     * @throws EncryptionException if the file has no key slots, password
+     *         opens none of them, or the header cannot be rewritten
+     */
+    size_t changeKeySlotPassword(const std::string& path, secure::SecureView password, secure::SecureView newPassword);
+    
     /**
      * @brief Set the chunk size for processing large files
      * 
-     * Adjusts how much data is processed at once during file operations
+     * Adjusts how much data is processed at once during file operations.
+     * The value is stored in each encrypted file, so files can be decrypted
+     * regardless of the chunk size configured at that time.
      * 
-     * @param bytes Chunk size in bytes
+     * @param bytes Chunk size in bytes (at most container::MAX_CHUNK_SIZE)
      */
     void setChunkSize(size_t bytes);
     
+    /**
+     * @return Chunk size used for newly encrypted files
+     */
+    size_t chunkSize() const { return chunk_size_; }
+    
+    /**
+     * @brief Set the number of threads encrypting or decrypting chunks
+     * 
+     * With more than one worker, chunks are read in order, processed
+     * concurrently and written back in order. A value of 1 keeps the
+     * serial read -> process -> write loop.
+     * 
+     * @param count Number of workers, or 0 for one per CPU the process may
+     *              use (see MemoryBudget::detectCpuLimit), and with a memory
+     *              budget set at most as many as it plans for
+     */
+    void setWorkerCount(size_t count);
+    
+    /**
+     * @brief Limit how many chunks may be in flight in parallel mode
+     * 
+     * Peak memory use is roughly this many chunk buffers, plus one being read.
+     * 
+     * @param count Maximum chunks between the reader and the writer, or 0 for
+     *              twice the worker count
+     */
+    void setMaxInFlightChunks(size_t count);
+    
+    /**
+     * @brief Set how many asynchronous operations run at the same time
+     * 
+     * Each running operation spreads its chunks over the workers set with
+     * setWorkerCount(); the rest wait in the queue. The executor starts
+     * with the first asynchronous operation, so later calls have no effect.
+     * 
+     * @param count Operations run at once (at least 1); JobQueue::DEFAULT_WORKERS by default
+     */
+    void setAsyncWorkerCount(size_t count);
+    
+    /**
+     * @brief Choose how file data is read and written
+     * 
+     * In MemoryMapped mode the source is mapped read-only and every chunk is
+     * encrypted or decrypted straight into a pre-sized mapped destination,
+     * which the container layout makes possible. Empty files, pipes, devices
+     * and network mounts always use streams.
+     * 
+     * @param mode I/O mode (IoMode::Stream by default)
+     */
+    void setIoMode(IoMode mode);
+    
+    /**
+     * @brief Choose how streamed file data is read and written
+     * 
+     * With IoEngine::ThreadPool or IoEngine::IoUring, reads of upcoming
+     * chunks are queued ahead of the cipher and writes behind it, so device
+     * I/O and encryption overlap instead of alternating. Every record's
+     * position is known up front, from the layout when encrypting and from
+     * the index when decrypting, so chunks go straight to their offsets.
+     * Memory-mapped files and backends whose files are not thread-safe are
+     * not affected.
+     * 
+     * @param engine I/O engine (IoEngine::Blocking by default)
+     */
+    void setIoEngine(IoEngine engine);
+    
+    /**
+     * @brief Set how many reads and writes an I/O engine keeps in flight
+     * 
+     * Up to about max in-flight chunks plus twice this many chunk buffers
+     * are held per file. Zero is ignored.
+     * 
+     * @param depth Operations in flight (4 by default)
+     */
+    void setIoQueueDepth(size_t depth);
+    
+    /**
+     * @brief Keep file data out of the page cache
+     * 
+     * For bulk jobs whose data is never read again, such as backups, so
+     * they do not evict the working set of other processes. With
+     * FileCaching::DropBehind, source pages are dropped once read and
+     * destination pages once written back (F_NOCACHE on macOS, sequential
+     * scan and write-through on Windows). Memory mapping is not used in
+     * this mode.
+     * 
+     * @param caching Cache use (FileCaching::Normal by default)
+     */
+    void setFileCaching(FileCaching caching);
+    
+    /**
+     * @brief Choose when finished destination files are made durable
+     * 
+     * Destinations are always written under a temporary name in their
+     * directory and renamed into place once complete, so a failed or
+     * interrupted operation never leaves a partial file behind. With
+     * OutputSync::PerFile the data and the rename reach stable storage
+     * before the operation returns. With OutputSync::Grouped and a group
+     * set, finished files are handed to it instead and only appear at
+     * their destination once the group commits; without a group it
+     * behaves like PerFile.
+     * 
+     * @param sync Durability (OutputSync::None by default)
+     */
+    void setOutputSync(OutputSync sync);
+    
+    /**
+     * @brief Set the group that finishes files under OutputSync::Grouped
+     * 
+     * @param group Group shared with other engines, or null for none
+     */
+    void setSyncGroup(std::shared_ptr<SyncGroup> group);
+    
+    /**
+     * @brief Set how often progress callbacks are invoked
+     * 
+     * Workers only count bytes; a timer thread per operation invokes the
+     * callback at most once per interval, and only when progress moved by
+     * the minimum delta. Completion is always reported, on the calling
+     * thread, before the operation returns. A zero interval is ignored.
+     * 
+     * @param settings Minimum interval and delta between updates
+     */
+    void setProgressSettings(const ProgressSettings& settings);
+    
+    /**
+     * @return Current progress reporting settings
+     */
+    const ProgressSettings& progressSettings() const { return progress_settings_; }
+    
+    /**
+     * @brief Use a thread pool shared with other engines for chunk work
+     * 
+     * Replaces the pool created by setWorkerCount().
+     * 
+     * @param pool Pool to use, or null for serial processing
+     */
+    void setThreadPool(std::shared_ptr<ThreadPool> pool);
+    
+    /**
+     * @brief Use a chunk buffer pool shared with other engines
+     * 
+     * @param pool Pool to use; null is ignored
+     */
+    void setBufferPool(std::shared_ptr<secure::SecureBufferPool> pool);
+    
+    /**
+     * @brief Read and write files through another file system backend
+     * 
+     * All file data goes through the backend's readers and writers; memory
+     * mapping is only used for files the backend reports as mappable.
+     * 
+     * @param fileSystem Backend to use; null is ignored
+     */
+    void setFileSystem(std::shared_ptr<FileSystem> fileSystem);
+    
+    /**
+     * @return File system backend used for file operations
+     */
+    std::shared_ptr<FileSystem> fileSystem() const { return file_system_; }
+    
+    /**
+     * @brief Set the Argon2id costs used for newly encrypted files
+     * 
+     * The costs are stored in each file header, so decryption always uses
+     * the costs the file was written with. Invalid costs are ignored.
+     * 
+     * @param params Costs, for example from Crypto::calibrateKdf
+     */
+    void setKdfParams(const KdfParams& params);
+    
+    /**
+     * @return Argon2id costs used for newly encrypted files
+     */
+    const KdfParams& kdfParams() const { return kdf_params_; }
+    
+    /**
+     * @brief Compress newly encrypted files chunk by chunk
+     * 
+     * Each chunk is compressed on the worker that encrypts it, just before
+     * encryption, and stored as is if that does not make it smaller. The
+     * algorithm is recorded in the header, so decryption needs no setting.
+     * Compressed records vary in size, so these files are written through
+     * the stream path rather than memory mapping or an I/O engine, and are
+     * read back the same way. Settings naming a codec this build lacks are
+     * ignored.
+     * 
+     * @param settings Algorithm, level and probing (no compression by default)
+     */
+    void setCompression(const CompressionSettings& settings);
+    
+    /**
+     * @return Compression used for newly encrypted files
+     */
+    const CompressionSettings& compression() const { return compression_; }
+    
+    /**
+     * @brief Reuse derived keys across files through a shared cache
+     * 
+     * With a cache, files encrypted with the same password and costs while
+     * the cached key lives share a salt, and decrypting files that share a
+     * password and salt derives the key once.
+     * 
+     * @param cache Cache to use, or null to derive a key for every file
+     */
+    void setKeyCache(std::shared_ptr<KeyCache> cache);
+    
+    /**
+     * @brief Encrypt new files under a random data key held in key slots
+     * 
+     * Files get FLAG_KEY_SLOTS, with the data key sealed under the password
+     * in the first slot; more passwords are added with addKeySlot(). Opening
+     * such a file derives one key per slot tried, so with many passwords in
+     * use a key cache saves the derivations of files that share them.
+     * Decryption needs no setting. Archives are not affected.
+     * 
+     * @param enabled True to use key slots (off by default)
+     */
+    void setKeySlots(bool enabled);
+    
+    /**
+     * @return True if new files are encrypted with key slots
+     */
+    bool keySlots() const { return key_slots_; }
+    
+    /**
+     * @brief Sanitize paths through a resolver that caches directories
+     * 
+     * Saves resolving every component of both paths of every file when
+     * many files share a few directories.
+     * 
+     * @param resolver Resolver shared with other engines, or null to
+     *                 resolve every path in full
+     */
+    void setPathResolver(std::shared_ptr<PathResolver> resolver);
+    
+    /**
+     * @brief Let another thread stop file and stream operations early
+     * 
+     * The token is checked before key derivation and before every chunk.
+     * A cancelled operation throws OperationCancelled and leaves nothing at
+     * its destination file; a destination stream keeps what was written.
+     * 
+     * @param token Token shared with whoever cancels, or null to never stop
+     */
+    void setCancellationToken(std::shared_ptr<const CancellationToken> token);
+    
+    /**
+     * @brief Record operation metrics into a registry shared with other engines
+     * 
+     * Each Encryptor starts with a registry of its own.
+     * 
+     * @param stats Registry to use, or null to stop recording
+     */
+    void setStats(std::shared_ptr<EncryptorStats> stats);
+    
+    /**
+     * @brief Keep the chunk buffers of file operations within a budget
+     * 
+     * Every chunk pipeline reserves its chunks' buffers from the budget and
+     * blocks the reader while it is used up, so engines sharing a budget
+     * stay within it together, whatever chunk size the files being
+     * decrypted were written with. Also limits what the buffer pool keeps
+     * to the budget's pool share, and sets the chunk size to the one
+     * MemoryBudget::plan() picks for the current worker count; call this
+     * after setWorkerCount(), or setChunkSize() after this to override.
+     * 
+     * @param budget Budget shared with other engines, or null for none
+     */
+    void setMemoryBudget(std::shared_ptr<MemoryBudget> budget);
+    
+    /**
+     * @return Budget this engine's chunk buffers count against, or null
+     */
+    std::shared_ptr<MemoryBudget> memoryBudget() const { return memory_budget_; }
+    
+    /**
+     * @return Registry this engine records into, or null
+     */
+    std::shared_ptr<EncryptorStats> stats() const { return stats_; }
+
 private:
+    // Seal and open chunks with the engine's helpers
+    friend class EncryptStream;
+    friend class DecryptStream;
+    
     // Implementation detail: the crypto provider
     std::unique_ptr<Crypto> crypto_;
     
     // Default chunk size for processing files (8 MB)
     size_t chunk_size_ = 8 * 1024 * 1024;
     
+    // Wiped, locked chunk buffers reused across chunks and files
+    std::shared_ptr<secure::SecureBufferPool> buffer_pool_;
+    
+    // Where file data is read from and written to; local disk by default
+    std::shared_ptr<FileSystem> file_system_;
+    
+    // Parallel chunk processing; no pool means serial processing
+    std::shared_ptr<ThreadPool> thread_pool_;
+    size_t max_in_flight_chunks_ = 0;
+    
+    IoMode io_mode_ = IoMode::Stream;
+    IoEngine io_engine_ = IoEngine::Blocking;
+    size_t io_queue_depth_ = 4;
+    FileCaching file_caching_ = FileCaching::Normal;
+    OutputSync output_sync_ = OutputSync::None;
+    std::shared_ptr<SyncGroup> sync_group_;
+    
+    KdfParams kdf_params_;
+    CompressionSettings compression_;
+    std::shared_ptr<KeyCache> key_cache_;
+    bool key_slots_ = false;
+    std::shared_ptr<PathResolver> path_resolver_;
+    std::shared_ptr<const CancellationToken> cancellation_;
+    std::shared_ptr<EncryptorStats> stats_;
+    std::shared_ptr<MemoryBudget> memory_budget_;
+    ProgressSettings progress_settings_;
+    
+    // Executor of the Async operations, started by the first of them.
+    // Declared last so it is stopped before anything its jobs use goes
+    std::mutex async_mutex_;
+    size_t async_worker_count_ = 0;   // 0 for JobQueue::DEFAULT_WORKERS
+    std::unique_ptr<JobQueue> async_queue_;
+    
     // Helper methods
-    std::vector<uint8_t> readFileChunk(std::istream& file, size_t size);
-    void writeFileChunk(std::ostream& file, const std::vector<uint8_t>& data);
+    const CancellationToken* cancellationToken() const;
+    AsyncOperation startAsync(
+        std::string description,
+        secure::SecureView password,
+        std::function<void(secure::SecureView password)> operation,
+        CompletionCallback onComplete
+    );
+    std::string sanitizePath(const std::string& path) const;
+    std::shared_ptr<const SecureKey> newPasswordKey(secure::SecureView password, container::KeySlot& slot) const;
+    std::shared_ptr<const SecureKey> passwordKey(secure::SecureView password, const container::KeySlot& slot) const;
+    std::shared_ptr<const SecureKey> encryptionKey(secure::SecureView password, container::FileHeader& header) const;
+    std::shared_ptr<const SecureKey> newContainerKey(secure::SecureView password, container::FileHeader& header) const;
+    std::shared_ptr<const SecureKey> decryptionKey(secure::SecureView password, const container::FileHeader& header) const;
+    std::shared_ptr<const SecureKey> containerKey(secure::SecureView password, const container::FileHeader& header) const;
+    secure::SecureData<std::vector<uint8_t>> openKeySlot(
+        secure::SecureView password,
+        const container::FileHeader& header,
+        size_t& slot
+    ) const;
+    void sealKeySlot(container::KeySlot& slot, secure::SecureView password, const std::vector<uint8_t>& dataKey) const;
+    size_t editKeySlots(
+        const std::string& path,
+        secure::SecureView password,
+        const std::function<size_t(container::FileHeader& header, size_t opened, const std::vector<uint8_t>& dataKey)>& edit
+    );
+    container::FileHeader newHeader() const;
+    std::vector<uint8_t> readPlaintextChunk(std::istream& file, size_t prefixSize);
+    void compressChunk(PipelineChunk& chunk, const CompressionSettings& settings, OperationRecorder& recorder);
+    void decompressChunk(PipelineChunk& chunk, const container::FileHeader& header, OperationRecorder& recorder);
+    void sealRecord(
+        PipelineChunk& chunk,
+        const SecureKey& key,
+        const container::FileHeader& header,
+        const CompressionSettings& settings,
+        OperationRecorder& recorder
+    );
+    void openRecord(
+        PipelineChunk& chunk,
+        const SecureKey& key,
+        const container::FileHeader& header,
+        OperationRecorder& recorder
+    );
+    bool fixedLayout(FileReader& source, bool encrypting) const;
+    std::unique_ptr<EncryptedFileReader> openEncrypted(
+        const std::string& path,
+        secure::SecureView password,
+        OperationRecorder& recorder
+    ) const;
+    void writeFileChunk(std::ostream& file, const uint8_t* data, size_t size);
     void processFileInChunks(
         const std::string& sourcePath,
         const std::string& destPath,
-        const std::string& password,
+        secure::SecureView password,
+        bool encrypting,
+        ProgressReporter& progress,
+        OperationRecorder& recorder
+    );
+    void processStream(
+        std::istream& source,
+        std::ostream& dest,
+        secure::SecureView password,
         bool encrypting,
-        ProgressCallback progressCallback
+        ProgressReporter& progress,
+        OperationRecorder& recorder
+    );
+    bool processMappedFile(
+        const std::string& sourcePath,
+        const std::string& destPath,
+        secure::SecureView password,
+        bool encrypting,
+        ProgressReporter& progress,
+        OperationRecorder& recorder
+    );
+    void processQueuedFile(
+        FileReader& source,
+        FileWriter& dest,
+        secure::SecureView password,
+        bool encrypting,
+        ProgressReporter& progress,
+        OperationRecorder& recorder
+    );
+    void finishOutput(AtomicOutput& output, std::unique_ptr<FileWriter> dest);
+    struct PreviousVersion;
+    std::unique_ptr<PreviousVersion> openPreviousVersion(
+        const std::string& path,
+        secure::SecureView password,
+        OperationRecorder& recorder
+    ) const;
+    struct OpenedArchive;
+    std::unique_ptr<OpenedArchive> openArchive(
+        const std::string& path,
+        secure::SecureView password,
+        OperationRecorder& recorder
+    ) const;
+    void extractEntry(
+        const OpenedArchive& archive,
+        const container::ArchiveEntry& entry,
+        const std::string& destPath,
+        ProgressReporter& progress,
+        OperationRecorder& recorder
     );
 };
 
@@ -0,0 +1,377 @@
+#include "encryptor_stats.h"
+#include "audit_log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+namespace crusty {
+
+namespace {
+
+// Prometheus bucket bounds in seconds, from a fast chunk to a slow Argon2id run
+constexpr double PROMETHEUS_BOUNDS[] = {
+    0.00001, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+    0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0, 300.0
+};
+
+constexpr EncryptorStats::Operation OPERATIONS[] = {
+    EncryptorStats::Operation::Encrypt,
+    EncryptorStats::Operation::Decrypt,
+    EncryptorStats::Operation::Verify
+};
+
+constexpr EncryptorStats::Phase PHASES[] = {
+    EncryptorStats::Phase::Read,
+    EncryptorStats::Phase::Crypto,
+    EncryptorStats::Phase::Write,
+    EncryptorStats::Phase::Kdf,
+    EncryptorStats::Phase::Compress
+};
+
+std::string formatNumber(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+    return buffer;
+}
+
+void writeFamily(std::ostringstream& out, const std::string& name, const char* type, const char* help) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+}
+
+void writeHistogram(std::ostringstream& out, const std::string& name, const std::string& labels,
+                    const LatencyHistogram::Snapshot& histogram) {
+    for (double bound : PROMETHEUS_BOUNDS) {
+        uint64_t nanos = static_cast<uint64_t>(bound * 1e9);
+        out << name << "_bucket{" << labels << ",le=\"" << formatNumber(bound) << "\"} "
+            << histogram.countAtOrBelow(nanos) << "\n";
+    }
+    out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << histogram.count << "\n";
+    out << name << "_sum{" << labels << "} " << formatNumber(histogram.sumNanos / 1e9) << "\n";
+    out << name << "_count{" << labels << "} " << histogram.count << "\n";
+}
+
+std::string operationLabel(EncryptorStats::Operation operation) {
+    return std::string("operation=\"") + EncryptorStats::operationName(operation) + "\"";
+}
+
+} // anonymous namespace
+
+//
+// LatencyHistogram implementation
+//
+
+uint64_t LatencyHistogram::Snapshot::percentile(double quantile) const {
+    if (count == 0) {
+        return 0;
+    }
+    
+    double clamped = std::min(1.0, std::max(0.0, quantile));
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped * count)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return std::min(bucketUpperBound(i), maxNanos);
+        }
+    }
+    return maxNanos;
+}
+
+uint64_t LatencyHistogram::Snapshot::countAtOrBelow(uint64_t nanos) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < buckets.size() && bucketUpperBound(i) <= nanos; ++i) {
+        total += buckets[i];
+    }
+    return total;
+}
+
+double LatencyHistogram::Snapshot::meanNanos() const {
+    return count > 0 ? static_cast<double>(sumNanos) / static_cast<double>(count) : 0.0;
+}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot& other) {
+    if (other.count == 0) {
+        return;
+    }
+    
+    buckets.resize(BUCKET_COUNT);
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sumNanos += other.sumNanos;
+    maxNanos = std::max(maxNanos, other.maxNanos);
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    buckets_[bucketIndex(nanos)].fetch_add(1, std::memory_order_relaxed);
+    sum_nanos_.fetch_add(nanos, std::memory_order_relaxed);
+    
+    uint64_t max = max_nanos_.load(std::memory_order_relaxed);
+    while (nanos > max && !max_nanos_.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot snapshot;
+    snapshot.buckets.resize(BUCKET_COUNT);
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i];
+    }
+    
+    // The count comes from the buckets, so quantiles stay consistent under concurrent updates
+    if (snapshot.count == 0) {
+        snapshot.buckets.clear();
+        return snapshot;
+    }
+    snapshot.sumNanos = sum_nanos_.load(std::memory_order_relaxed);
+    snapshot.maxNanos = max_nanos_.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    sum_nanos_.store(0, std::memory_order_relaxed);
+    max_nanos_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    
+    size_t bits = index / SUB_BUCKETS + SUB_BUCKET_BITS;
+    size_t shift = bits - 1 - SUB_BUCKET_BITS;
+    uint64_t lower = static_cast<uint64_t>(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    return lower + ((uint64_t{1} << shift) - 1);
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t nanos) {
+    if (nanos < SUB_BUCKETS) {
+        return static_cast<size_t>(nanos);
+    }
+    
+    // Position of the highest set bit picks the power of two, the next bits the sub-bucket
+    size_t bits = 0;
+    for (uint64_t value = nanos; value != 0; value >>= 1) {
+        ++bits;
+    }
+    size_t shift = bits - 1 - SUB_BUCKET_BITS;
+    return (bits - SUB_BUCKET_BITS) * SUB_BUCKETS + static_cast<size_t>((nanos >> shift) - SUB_BUCKETS);
+}
+
+//
+// EncryptorStats implementation
+//
+
+double EncryptorStats::OperationStats::bytesPerSecond() const {
+    return duration.sumNanos > 0 ? bytesRead * 1e9 / static_cast<double>(duration.sumNanos) : 0.0;
+}
+
+void EncryptorStats::OperationStats::merge(const OperationStats& other) {
+    operations += other.operations;
+    failures += other.failures;
+    bytesRead += other.bytesRead;
+    bytesWritten += other.bytesWritten;
+    chunks += other.chunks;
+    duration.merge(other.duration);
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        phases[i].merge(other.phases[i]);
+    }
+}
+
+EncryptorStats::OperationStats EncryptorStats::Snapshot::overall() const {
+    OperationStats total;
+    for (const OperationStats& stats : operations) {
+        total.merge(stats);
+    }
+    return total;
+}
+
+std::string EncryptorStats::Snapshot::toPrometheus(const std::string& prefix) const {
+    std::ostringstream out;
+    
+    struct Counter {
+        const char* name;
+        const char* help;
+        uint64_t OperationStats::*field;
+    };
+    const Counter counters[] = {
+        {"_operations_total", "Operations finished, including failed ones", &OperationStats::operations},
+        {"_operation_failures_total", "Operations that failed", &OperationStats::failures},
+        {"_read_bytes_total", "Bytes read from sources", &OperationStats::bytesRead},
+        {"_written_bytes_total", "Bytes written to destinations", &OperationStats::bytesWritten},
+        {"_chunks_total", "Chunks encrypted, decrypted or verified", &OperationStats::chunks},
+    };
+    for (const Counter& counter : counters) {
+        std::string name = prefix + counter.name;
+        writeFamily(out, name, "counter", counter.help);
+        for (Operation operation : OPERATIONS) {
+            out << name << "{" << operationLabel(operation) << "} " << of(operation).*counter.field << "\n";
+        }
+    }
+    
+    std::string durationName = prefix + "_operation_duration_seconds";
+    writeFamily(out, durationName, "histogram", "Wall time of whole operations");
+    for (Operation operation : OPERATIONS) {
+        writeHistogram(out, durationName, operationLabel(operation), of(operation).duration);
+    }
+    
+    std::string phaseName = prefix + "_phase_duration_seconds";
+    writeFamily(out, phaseName, "histogram", "Time per read, crypto, write, key derivation and compression step");
+    for (Operation operation : OPERATIONS) {
+        for (Phase phase : PHASES) {
+            std::string labels = operationLabel(operation) + ",phase=\"" + EncryptorStats::phaseName(phase) + "\"";
+            writeHistogram(out, phaseName, labels, of(operation).phases[static_cast<size_t>(phase)]);
+        }
+    }
+    return out.str();
+}
+
+void EncryptorStats::recordPhase(Operation operation, Phase phase, std::chrono::nanoseconds elapsed) {
+    counters_[static_cast<size_t>(operation)].phases[static_cast<size_t>(phase)]
+        .record(static_cast<uint64_t>(std::max<int64_t>(0, elapsed.count())));
+}
+
+void EncryptorStats::recordOperation(Operation operation, bool succeeded, std::chrono::nanoseconds elapsed,
+                                     uint64_t bytesRead, uint64_t bytesWritten, uint64_t chunks) {
+    Counters& counters = counters_[static_cast<size_t>(operation)];
+    counters.operations.fetch_add(1, std::memory_order_relaxed);
+    if (!succeeded) {
+        counters.failures.fetch_add(1, std::memory_order_relaxed);
+    }
+    counters.bytesRead.fetch_add(bytesRead, std::memory_order_relaxed);
+    counters.bytesWritten.fetch_add(bytesWritten, std::memory_order_relaxed);
+    counters.chunks.fetch_add(chunks, std::memory_order_relaxed);
+    counters.duration.record(static_cast<uint64_t>(std::max<int64_t>(0, elapsed.count())));
+}
+
+EncryptorStats::Snapshot EncryptorStats::snapshot() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < OPERATION_COUNT; ++i) {
+        const Counters& counters = counters_[i];
+        OperationStats& stats = snapshot.operations[i];
+        stats.operations = counters.operations.load(std::memory_order_relaxed);
+        stats.failures = counters.failures.load(std::memory_order_relaxed);
+        stats.bytesRead = counters.bytesRead.load(std::memory_order_relaxed);
+        stats.bytesWritten = counters.bytesWritten.load(std::memory_order_relaxed);
+        stats.chunks = counters.chunks.load(std::memory_order_relaxed);
+        stats.duration = counters.duration.snapshot();
+        for (size_t phase = 0; phase < PHASE_COUNT; ++phase) {
+            stats.phases[phase] = counters.phases[phase].snapshot();
+        }
+    }
+    return snapshot;
+}
+
+void EncryptorStats::reset() {
+    for (Counters& counters : counters_) {
+        counters.operations.store(0, std::memory_order_relaxed);
+        counters.failures.store(0, std::memory_order_relaxed);
+        counters.bytesRead.store(0, std::memory_order_relaxed);
+        counters.bytesWritten.store(0, std::memory_order_relaxed);
+        counters.chunks.store(0, std::memory_order_relaxed);
+        counters.duration.reset();
+        for (LatencyHistogram& phase : counters.phases) {
+            phase.reset();
+        }
+    }
+}
+
+const char* EncryptorStats::operationName(Operation operation) {
+    switch (operation) {
+        case Operation::Encrypt:
+            return "encrypt";
+        case Operation::Decrypt:
+            return "decrypt";
+        case Operation::Verify:
+            return "verify";
+    }
+    return "unknown";
+}
+
+const char* EncryptorStats::phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::Read:
+            return "read";
+        case Phase::Crypto:
+            return "crypto";
+        case Phase::Write:
+            return "write";
+        case Phase::Kdf:
+            return "kdf";
+        case Phase::Compress:
+            return "compress";
+    }
+    return "unknown";
+}
+
+//
+// OperationRecorder implementation
+//
+
+OperationRecorder::OperationRecorder(EncryptorStats* stats, EncryptorStats::Operation operation)
+    : stats_(stats), operation_(operation), start_(Clock::now()) {
+}
+
+OperationRecorder::~OperationRecorder() {
+    Clock::time_point end = Clock::now();
+    trace::span(EncryptorStats::operationName(operation_), start_, end);
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_);
+    uint64_t bytesRead = bytes_read_.load();
+    uint64_t bytesWritten = bytes_written_.load();
+    if (stats_) {
+        stats_->recordOperation(operation_, succeeded_, elapsed, bytesRead, bytesWritten, chunks_.load());
+    }
+    
+    if (!succeeded_) {
+        return;
+    }
+    
+    // Logging must not escape a destructor
+    try {
+        auto milliseconds = [this](EncryptorStats::Phase phase) {
+            return phase_nanos_[static_cast<size_t>(phase)].load() / 1e6;
+        };
+        double seconds = elapsed.count() / 1e9;
+        LOG_EVENT(Info, "Operation metrics",
+                  {"operation", EncryptorStats::operationName(operation_)},
+                  {"bytes_read", bytesRead},
+                  {"bytes_written", bytesWritten},
+                  {"chunks", chunks_.load()},
+                  {"seconds", seconds},
+                  {"mib_per_second", seconds > 0 ? bytesRead / seconds / (1024.0 * 1024.0) : 0.0},
+                  {"read_ms", milliseconds(EncryptorStats::Phase::Read)},
+                  {"crypto_ms", milliseconds(EncryptorStats::Phase::Crypto)},
+                  {"write_ms", milliseconds(EncryptorStats::Phase::Write)},
+                  {"kdf_ms", milliseconds(EncryptorStats::Phase::Kdf)},
+                  {"compress_ms", milliseconds(EncryptorStats::Phase::Compress)});
+    } catch (...) {
+    }
+}
+
+void OperationRecorder::addChunk(uint64_t read, uint64_t written) {
+    addBytes(read, written);
+    chunks_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void OperationRecorder::addBytes(uint64_t read, uint64_t written) {
+    bytes_read_.fetch_add(read, std::memory_order_relaxed);
+    bytes_written_.fetch_add(written, std::memory_order_relaxed);
+}
+
+void OperationRecorder::addPhase(EncryptorStats::Phase phase, Clock::duration elapsed) {
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+    phase_nanos_[static_cast<size_t>(phase)].fetch_add(static_cast<uint64_t>(nanos.count()), std::memory_order_relaxed);
+    if (stats_) {
+        stats_->recordPhase(operation_, phase, nanos);
+    }
+}
+
+} // namespace crusty
@@ -0,0 +1,348 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+namespace crusty {
+
+/**
+ * @brief Lock-free latency histogram with HDR-style log-linear buckets
+ * 
+ * Values below SUB_BUCKETS nanoseconds are counted exactly; above that,
+ * every power of two is split into SUB_BUCKETS equal buckets, so any
+ * recorded value is known to within about 6%. Recording is a few relaxed
+ * atomic additions, cheap enough for every chunk. All methods are
+ * thread-safe.
+ */
+class LatencyHistogram {
+public:
+    /**
+     * @brief Point-in-time copy of a histogram
+     */
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t sumNanos = 0;
+        uint64_t maxNanos = 0;
+        std::vector<uint64_t> buckets;  // Counts by bucket index, or empty if count is 0
+        
+        /**
+         * @brief Estimate a quantile
+         * 
+         * @param quantile Fraction of values at or below the result, 0..1
+         * @return Upper bound of the bucket holding that value, in nanoseconds
+         */
+        uint64_t percentile(double quantile) const;
+        
+        /**
+         * @brief Number of recorded values at or below a bound
+         * 
+         * @param nanos Bound in nanoseconds
+         * @return Values in buckets whose upper bound is at most nanos
+         */
+        uint64_t countAtOrBelow(uint64_t nanos) const;
+        
+        /**
+         * @return Mean value in nanoseconds, or 0 if nothing was recorded
+         */
+        double meanNanos() const;
+        
+        /**
+         * @brief Add the values of another snapshot
+         */
+        void merge(const Snapshot& other);
+    };
+    
+    LatencyHistogram() = default;
+    
+    /**
+     * @brief Record one value
+     * 
+     * @param nanos Duration in nanoseconds
+     */
+    void record(uint64_t nanos);
+    
+    /**
+     * @return Copy of the current counts
+     */
+    Snapshot snapshot() const;
+    
+    /**
+     * @brief Forget all recorded values
+     */
+    void reset();
+    
+    /**
+     * @brief Largest value that falls into a bucket
+     * 
+     * @param index Bucket index, below BUCKET_COUNT
+     * @return Inclusive upper bound in nanoseconds
+     */
+    static uint64_t bucketUpperBound(size_t index);
+    
+    // Buckets per power of two; 16 keeps the relative error near 6%
+    static constexpr size_t SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKETS = size_t{1} << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+    
+    // Prevent copying
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+private:
+    static size_t bucketIndex(uint64_t nanos);
+    
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> sum_nanos_{0};
+    std::atomic<uint64_t> max_nanos_{0};
+};
+
+/**
+ * @brief Counters and latency histograms for the file engine
+ * 
+ * An Encryptor records every operation here: how many ran and failed, the
+ * bytes read and written, the chunks processed, the wall time of each
+ * operation and the time spent per phase. Read and write are the stream
+ * I/O around each chunk, crypto is one chunk's AES-GCM call on a worker,
+ * KDF is getting the file key, cache hits included, and compress is one
+ * chunk's compression or decompression in compressed containers.
+ * Memory-mapped files have no separate read or write phase; page faults
+ * count as crypto.
+ * 
+ * Phases overlap in parallel mode, so their sums can exceed an operation's
+ * wall time; comparing them shows which stage limits throughput. Several
+ * engines may share one instance. All methods are thread-safe.
+ */
+class EncryptorStats {
+public:
+    enum class Operation {
+        Encrypt,
+        Decrypt,
+        Verify      // Decrypted and discarded; nothing is written
+    };
+    
+    enum class Phase {
+        Read,
+        Crypto,
+        Write,
+        Kdf,
+        Compress
+    };
+    
+    static constexpr size_t OPERATION_COUNT = 3;
+    static constexpr size_t PHASE_COUNT = 5;
+    
+    /**
+     * @brief Totals for one kind of operation
+     */
+    struct OperationStats {
+        uint64_t operations = 0;
+        uint64_t failures = 0;
+        uint64_t bytesRead = 0;
+        uint64_t bytesWritten = 0;
+        uint64_t chunks = 0;
+        LatencyHistogram::Snapshot duration;
+        std::array<LatencyHistogram::Snapshot, PHASE_COUNT> phases;
+        
+        /**
+         * @return Bytes read per second of operation wall time, or 0
+         */
+        double bytesPerSecond() const;
+        
+        /**
+         * @brief Add the totals of another operation kind
+         */
+        void merge(const OperationStats& other);
+    };
+    
+    /**
+     * @brief Point-in-time copy of all counters and histograms
+     */
+    struct Snapshot {
+        std::array<OperationStats, OPERATION_COUNT> operations;
+        
+        /**
+         * @return Totals for one operation kind
+         */
+        const OperationStats& of(Operation operation) const {
+            return operations[static_cast<size_t>(operation)];
+        }
+        
+        /**
+         * @return Totals over all operation kinds
+         */
+        OperationStats overall() const;
+        
+        /**
+         * @brief Render in the Prometheus text exposition format
+         * 
+         * Operations and phases become labels; histograms are reduced to
+         * fixed second-based buckets. Overall totals are left to the
+         * query side, where summing over the operation label gives them.
+         * 
+         * @param prefix Metric name prefix
+         * @return Exposition text, one metric family after another
+         */
+        std::string toPrometheus(const std::string& prefix = "crusty") const;
+    };
+    
+    EncryptorStats() = default;
+    
+    /**
+     * @brief Record the time of one phase
+     * 
+     * @param operation Operation the phase belongs to
+     * @param phase Phase that ran
+     * @param elapsed Time it took
+     */
+    void recordPhase(Operation operation, Phase phase, std::chrono::nanoseconds elapsed);
+    
+    /**
+     * @brief Record a finished operation
+     * 
+     * @param operation Kind of operation
+     * @param succeeded Whether it completed
+     * @param elapsed Wall time of the whole operation
+     * @param bytesRead Bytes read from the source
+     * @param bytesWritten Bytes written to the destination
+     * @param chunks Chunks encrypted or decrypted
+     */
+    void recordOperation(Operation operation, bool succeeded, std::chrono::nanoseconds elapsed,
+                         uint64_t bytesRead, uint64_t bytesWritten, uint64_t chunks);
+    
+    /**
+     * @return Copy of the current values
+     */
+    Snapshot snapshot() const;
+    
+    /**
+     * @brief Set every counter and histogram back to zero
+     */
+    void reset();
+    
+    /**
+     * @return Lower-case name of an operation, as used in labels
+     */
+    static const char* operationName(Operation operation);
+    
+    /**
+     * @return Lower-case name of a phase, as used in labels
+     */
+    static const char* phaseName(Phase phase);
+    
+    // Prevent copying
+    EncryptorStats(const EncryptorStats&) = delete;
+    EncryptorStats& operator=(const EncryptorStats&) = delete;
+
+private:
+    struct Counters {
+        std::atomic<uint64_t> operations{0};
+        std::atomic<uint64_t> failures{0};
+        std::atomic<uint64_t> bytesRead{0};
+        std::atomic<uint64_t> bytesWritten{0};
+        std::atomic<uint64_t> chunks{0};
+        LatencyHistogram duration;
+        std::array<LatencyHistogram, PHASE_COUNT> phases;
+    };
+    
+    std::array<Counters, OPERATION_COUNT> counters_;
+};
+
+/**
+ * @brief Collects the measurements of one running operation
+ * 
+ * Created at the start of an operation and passed down to the code that
+ * reads, transforms and writes chunks. The destructor records the
+ * operation in the shared EncryptorStats, as a failure unless succeed()
+ * was called, and logs a per-operation summary on success. Methods other
+ * than succeed() may be called from several threads at once.
+ */
+class OperationRecorder {
+public:
+    /**
+     * @brief Start timing an operation
+     * 
+     * @param stats Registry to record into, or null to only measure
+     * @param operation Kind of operation
+     */
+    OperationRecorder(EncryptorStats* stats, EncryptorStats::Operation operation);
+    
+    /**
+     * @brief Record the operation
+     */
+    ~OperationRecorder();
+    
+    /**
+     * @brief Time a callable as one occurrence of a phase
+     * 
+     * @param phase Phase the callable belongs to
+     * @param function Callable to run
+     * @return Its result
+     */
+    template <typename Function>
+    auto time(EncryptorStats::Phase phase, Function&& function) -> decltype(function()) {
+        PhaseTimer timer(*this, phase);
+        return function();
+    }
+    
+    /**
+     * @brief Count bytes and one finished chunk
+     * 
+     * @param read Bytes of the chunk in the source
+     * @param written Bytes of the chunk in the destination
+     */
+    void addChunk(uint64_t read, uint64_t written);
+    
+    /**
+     * @brief Count bytes outside any chunk, such as headers and footers
+     */
+    void addBytes(uint64_t read, uint64_t written);
+    
+    /**
+     * @brief Mark the operation as completed
+     */
+    void succeed() { succeeded_ = true; }
+    
+    // Prevent copying
+    OperationRecorder(const OperationRecorder&) = delete;
+    OperationRecorder& operator=(const OperationRecorder&) = delete;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    // Records the time between construction and destruction, even when unwinding
+    class PhaseTimer {
+    public:
+        PhaseTimer(OperationRecorder& recorder, EncryptorStats::Phase phase)
+            : recorder_(recorder), phase_(phase), start_(Clock::now()) {}
+        ~PhaseTimer() {
+            Clock::time_point end = Clock::now();
+            trace::span(EncryptorStats::phaseName(phase_), start_, end);
+            recorder_.addPhase(phase_, end - start_);
+        }
+    
+    private:
+        OperationRecorder& recorder_;
+        EncryptorStats::Phase phase_;
+        Clock::time_point start_;
+    };
+    
+    void addPhase(EncryptorStats::Phase phase, Clock::duration elapsed);
+    
+    EncryptorStats* stats_;
+    EncryptorStats::Operation operation_;
+    Clock::time_point start_;
+    bool succeeded_ = false;
+    
+    std::atomic<uint64_t> bytes_read_{0};
+    std::atomic<uint64_t> bytes_written_{0};
+    std::atomic<uint64_t> chunks_{0};
+    std::array<std::atomic<uint64_t>, EncryptorStats::PHASE_COUNT> phase_nanos_{};
+};
+
+} // namespace crusty
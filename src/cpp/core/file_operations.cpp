@@ -1,9 +1,26 @@
 #include "file_operations.h"
 #include "path_utils.h"
 #include "audit_log.h"
+#include "mapped_file.h"
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <mutex>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #ifndef NO_QT_UI
 #include <QtWidgets/QFileDialog>
@@ -64,8 +81,705 @@ std::string getHomeDirectory() {
 #endif
 }
 
+// Throws for the last system error, classified for the caller
+[[noreturn]] void ioError(const std::string& message, const std::string& path) {
+    using ErrorCode = FileOperationException::ErrorCode;
+#ifdef _WIN32
+    DWORD error = GetLastError();
+    std::string reason = "error " + std::to_string(error);
+    ErrorCode code = ErrorCode::IoError;
+    if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) {
+        code = ErrorCode::FileNotFound;
+    } else if (error == ERROR_ACCESS_DENIED || error == ERROR_SHARING_VIOLATION) {
+        code = ErrorCode::AccessDenied;
+    } else if (error == ERROR_DISK_FULL || error == ERROR_HANDLE_DISK_FULL) {
+        code = ErrorCode::DiskFull;
+    }
+#else
+    int error = errno;
+    std::string reason = std::strerror(error);
+    ErrorCode code = ErrorCode::IoError;
+    if (error == ENOENT || error == ENOTDIR) {
+        code = ErrorCode::FileNotFound;
+    } else if (error == EACCES || error == EPERM) {
+        code = ErrorCode::AccessDenied;
+    } else if (error == ENOSPC || error == EDQUOT) {
+        code = ErrorCode::DiskFull;
+    }
+#endif
+    std::string errorMsg = message + ": " + path + " (" + reason + ")";
+    LOG_ERROR(errorMsg);
+    throw FileOperationException(errorMsg, code, path);
+}
+
+#ifdef _WIN32
+
+// Positional I/O through OVERLAPPED offsets on a synchronous handle
+class LocalFileReader : public FileReader {
+public:
+    LocalFileReader(const std::string& path, FileCaching caching) : path_(path) {
+        // Sequential scans make the cache manager unmap pages behind the reader
+        DWORD flags = caching == FileCaching::DropBehind ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+        handle_ = CreateFileW(std::filesystem::path(path).wstring().c_str(), GENERIC_READ,
+                              FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+        if (handle_ == INVALID_HANDLE_VALUE) {
+            ioError("Failed to open file", path);
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(handle_, &size)) {
+            CloseHandle(handle_);
+            ioError("Failed to get file size", path);
+        }
+        size_ = static_cast<uint64_t>(size.QuadPart);
+    }
+    
+    ~LocalFileReader() override {
+        CloseHandle(handle_);
+    }
+    
+    size_t readAt(uint64_t offset, uint8_t* buffer, size_t size) override {
+        size_t total = 0;
+        while (total < size) {
+            OVERLAPPED position = {};
+            position.Offset = static_cast<DWORD>(offset + total);
+            position.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+            DWORD wanted = static_cast<DWORD>(std::min<size_t>(size - total, 1u << 30));
+            DWORD read = 0;
+            if (!ReadFile(handle_, buffer + total, wanted, &read, &position)) {
+                if (GetLastError() == ERROR_HANDLE_EOF) {
+                    break;
+                }
+                ioError("Failed to read file", path_);
+            }
+            if (read == 0) {
+                break;
+            }
+            total += read;
+        }
+        return total;
+    }
+    
+    uint64_t size() const override { return size_; }
+    bool threadSafe() const override { return true; }
+
+private:
+    std::string path_;
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+    uint64_t size_ = 0;
+};
+
+class LocalFileWriter : public FileWriter {
+public:
+    LocalFileWriter(const std::string& path, FileCaching caching, bool update) : path_(path) {
+        // Write-through keeps dirty pages from piling up in the cache
+        DWORD flags = caching == FileCaching::DropBehind ? FILE_FLAG_WRITE_THROUGH : FILE_ATTRIBUTE_NORMAL;
+        handle_ = CreateFileW(std::filesystem::path(path).wstring().c_str(), GENERIC_WRITE,
+                              0, nullptr, update ? OPEN_EXISTING : CREATE_ALWAYS, flags, nullptr);
+        if (handle_ == INVALID_HANDLE_VALUE) {
+            ioError(update ? "Failed to open file" : "Failed to create file", path);
+        }
+        
+        // Existing contents count as written, so close() keeps them
+        LARGE_INTEGER size = {};
+        if (update && GetFileSizeEx(handle_, &size)) {
+            end_ = static_cast<uint64_t>(size.QuadPart);
+        }
+    }
+    
+    ~LocalFileWriter() override {
+        if (handle_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle_);
+        }
+    }
+    
+    void writeAt(uint64_t offset, const uint8_t* data, size_t size) override {
+        size_t total = 0;
+        while (total < size) {
+            OVERLAPPED position = {};
+            position.Offset = static_cast<DWORD>(offset + total);
+            position.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+            DWORD wanted = static_cast<DWORD>(std::min<size_t>(size - total, 1u << 30));
+            DWORD written = 0;
+            if (!WriteFile(handle_, data + total, wanted, &written, &position)) {
+                ioError("Failed to write file", path_);
+            }
+            total += written;
+        }
+        noteWritten(offset, size);
+    }
+    
+    bool threadSafe() const override { return true; }
+    
+    void noteWritten(uint64_t offset, size_t size) override {
+        uint64_t end = offset + size;
+        uint64_t current = end_.load();
+        while (current < end && !end_.compare_exchange_weak(current, end)) {
+        }
+    }
+    
+    void preallocate(uint64_t size) override {
+        // Reserves clusters without moving the end of file
+        FILE_ALLOCATION_INFO info = {};
+        info.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+        preallocated_ = SetFileInformationByHandle(handle_, FileAllocationInfo, &info, sizeof(info)) != 0;
+    }
+    
+    void truncate(uint64_t size) override {
+        FILE_END_OF_FILE_INFO info = {};
+        info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFileInformationByHandle(handle_, FileEndOfFileInfo, &info, sizeof(info))) {
+            ioError("Failed to set file size", path_);
+        }
+        end_ = size;
+    }
+    
+    void sync() override {
+        releaseReserved();
+        if (!FlushFileBuffers(handle_)) {
+            ioError("Failed to sync file", path_);
+        }
+    }
+    
+    void close() override {
+        releaseReserved();
+        HANDLE handle = handle_;
+        handle_ = INVALID_HANDLE_VALUE;
+        if (!CloseHandle(handle)) {
+            ioError("Failed to close file", path_);
+        }
+    }
+
+private:
+    // Give back reserved space that was not written
+    void releaseReserved() {
+        if (!preallocated_) {
+            return;
+        }
+        FILE_END_OF_FILE_INFO info = {};
+        info.EndOfFile.QuadPart = static_cast<LONGLONG>(end_.load());
+        if (!SetFileInformationByHandle(handle_, FileEndOfFileInfo, &info, sizeof(info))) {
+            ioError("Failed to set file size", path_);
+        }
+        preallocated_ = false;
+    }
+    
+    std::string path_;
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+    std::atomic<uint64_t> end_{0};
+    bool preallocated_ = false;
+};
+
+#else
+
+// Cache hints are best effort; failures only cost cache space
+
+void avoidCache(int fd, bool reading) {
+#if defined(F_NOCACHE)
+    // macOS has no per-range eviction, but can bypass the cache for a file
+    (void)reading;
+    fcntl(fd, F_NOCACHE, 1);
+#elif defined(POSIX_FADV_SEQUENTIAL)
+    if (reading) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#else
+    (void)fd;
+    (void)reading;
+#endif
+}
+
+void dropCachedRange(int fd, uint64_t offset, size_t size) {
+#if defined(POSIX_FADV_DONTNEED) && !defined(F_NOCACHE)
+    // Widened to whole pages; the kernel only drops pages fully inside
+    static const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t start = offset / pageSize * pageSize;
+    uint64_t end = (offset + size + pageSize - 1) / pageSize * pageSize;
+    posix_fadvise(fd, static_cast<off_t>(start), static_cast<off_t>(end - start), POSIX_FADV_DONTNEED);
+#else
+    (void)fd;
+    (void)offset;
+    (void)size;
+#endif
+}
+
+void startWriteback(int fd, uint64_t offset, size_t size) {
+#if defined(__linux__)
+    sync_file_range(fd, static_cast<off64_t>(offset), static_cast<off64_t>(size), SYNC_FILE_RANGE_WRITE);
+#else
+    (void)fd;
+    (void)offset;
+    (void)size;
+#endif
+}
+
+// Data and the metadata needed to read it back, such as the size
+int syncData(int fd) {
+#if defined(F_FULLFSYNC)
+    // fsync on macOS stops at the drive's volatile cache
+    if (fcntl(fd, F_FULLFSYNC) == 0) {
+        return 0;
+    }
+    return fsync(fd);
+#elif defined(__linux__)
+    return fdatasync(fd);
+#else
+    return fsync(fd);
+#endif
+}
+
+void dropWrittenRange(int fd, uint64_t offset, size_t size) {
+#if defined(__linux__)
+    sync_file_range(fd, static_cast<off64_t>(offset), static_cast<off64_t>(size),
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+    dropCachedRange(fd, offset, size);
+}
+
+class LocalFileReader : public FileReader {
+public:
+    LocalFileReader(const std::string& path, FileCaching caching)
+        : path_(path), drop_behind_(caching == FileCaching::DropBehind) {
+        fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) {
+            ioError("Failed to open file", path);
+        }
+        struct stat info;
+        if (fstat(fd_, &info) != 0) {
+            ::close(fd_);
+            ioError("Failed to get file size", path);
+        }
+        size_ = static_cast<uint64_t>(info.st_size);
+        if (drop_behind_) {
+            avoidCache(fd_, true);
+        }
+    }
+    
+    ~LocalFileReader() override {
+        ::close(fd_);
+    }
+    
+    size_t readAt(uint64_t offset, uint8_t* buffer, size_t size) override {
+        size_t total = 0;
+        while (total < size) {
+            ssize_t read = ::pread(fd_, buffer + total, size - total, static_cast<off_t>(offset + total));
+            if (read < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ioError("Failed to read file", path_);
+            }
+            if (read == 0) {
+                break;
+            }
+            total += static_cast<size_t>(read);
+        }
+        noteRead(offset, total);
+        return total;
+    }
+    
+    uint64_t size() const override { return size_; }
+    bool threadSafe() const override { return true; }
+    int descriptor() const override { return fd_; }
+    
+    void noteRead(uint64_t offset, size_t size) override {
+        // Pages that were read are clean, so they can go right away
+        if (drop_behind_) {
+            dropCachedRange(fd_, offset, size);
+        }
+    }
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    bool drop_behind_ = false;
+};
+
+class LocalFileWriter : public FileWriter {
+public:
+    LocalFileWriter(const std::string& path, FileCaching caching, bool update)
+        : path_(path), drop_behind_(caching == FileCaching::DropBehind) {
+        int flags = update ? O_WRONLY | O_CLOEXEC : O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        fd_ = ::open(path.c_str(), flags, 0666);
+        if (fd_ < 0) {
+            ioError(update ? "Failed to open file" : "Failed to create file", path);
+        }
+        if (drop_behind_) {
+            avoidCache(fd_, false);
+        }
+        
+        // Existing contents count as written, so close() keeps them
+        struct stat info {};
+        if (update && fstat(fd_, &info) == 0) {
+            end_ = static_cast<uint64_t>(info.st_size);
+        }
+    }
+    
+    ~LocalFileWriter() override {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+    
+    void writeAt(uint64_t offset, const uint8_t* data, size_t size) override {
+        size_t total = 0;
+        while (total < size) {
+            ssize_t written = ::pwrite(fd_, data + total, size - total, static_cast<off_t>(offset + total));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ioError("Failed to write file", path_);
+            }
+            total += static_cast<size_t>(written);
+        }
+        noteWritten(offset, size);
+    }
+    
+    bool threadSafe() const override { return true; }
+    int descriptor() const override { return fd_; }
+    
+    void noteWritten(uint64_t offset, size_t size) override {
+        uint64_t end = offset + size;
+        uint64_t current = end_.load();
+        while (current < end && !end_.compare_exchange_weak(current, end)) {
+        }
+        if (drop_behind_) {
+            writeBehind(offset, size);
+        }
+    }
+    
+    void preallocate(uint64_t size) override {
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+        // Reserves blocks, so a full disk fails early, without moving the end of file
+        preallocated_ = fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0;
+#else
+        (void)size;
+#endif
+    }
+    
+    void truncate(uint64_t size) override {
+        if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+            ioError("Failed to set file size", path_);
+        }
+        end_ = size;
+    }
+    
+    void startSync() override {
+        // A zero length runs to the end of the file
+        startWriteback(fd_, 0, 0);
+    }
+    
+    void sync() override {
+        releaseReserved();
+        int result;
+        do {
+            result = syncData(fd_);
+        } while (result != 0 && errno == EINTR);
+        if (result != 0) {
+            ioError("Failed to sync file", path_);
+        }
+    }
+    
+    void close() override {
+        if (drop_behind_) {
+            std::lock_guard<std::mutex> lock(writeback_mutex_);
+            for (const auto& [offset, size] : writeback_) {
+                dropWrittenRange(fd_, offset, size);
+            }
+            writeback_.clear();
+        }
+        
+        releaseReserved();
+        int fd = fd_;
+        fd_ = -1;
+        if (::close(fd) != 0) {
+            ioError("Failed to close file", path_);
+        }
+    }
+
+private:
+    // Truncating to the current size gives back reserved blocks past it
+    void releaseReserved() {
+        if (!preallocated_) {
+            return;
+        }
+        if (ftruncate(fd_, static_cast<off_t>(end_.load())) != 0) {
+            ioError("Failed to set file size", path_);
+        }
+        preallocated_ = false;
+    }
+    
+    // Dirty pages cannot be dropped, so start their writeback now and drop
+    // them a few writes later, when the disk has most likely caught up
+    void writeBehind(uint64_t offset, size_t size) {
+        startWriteback(fd_, offset, size);
+        
+        std::pair<uint64_t, size_t> oldest;
+        {
+            std::lock_guard<std::mutex> lock(writeback_mutex_);
+            writeback_.emplace_back(offset, size);
+            if (writeback_.size() <= WRITEBACK_WINDOW) {
+                return;
+            }
+            oldest = writeback_.front();
+            writeback_.pop_front();
+        }
+        dropWrittenRange(fd_, oldest.first, oldest.second);
+    }
+    
+    // Ranges whose writeback was started but that are still cached
+    static constexpr size_t WRITEBACK_WINDOW = 4;
+    
+    std::string path_;
+    int fd_ = -1;
+    std::atomic<uint64_t> end_{0};
+    bool preallocated_ = false;
+    bool drop_behind_ = false;
+    std::mutex writeback_mutex_;
+    std::deque<std::pair<uint64_t, size_t>> writeback_;
+};
+
+#endif
+
 } // anonymous namespace
 
+void FileWriter::truncate(uint64_t size) {
+    (void)size;
+    throw FileOperationException("This file system cannot shorten files", FileOperationException::ErrorCode::IoError,
+                                 std::string());
+}
+
+//
+// Stream adapters
+//
+
+FileReaderStreamBuf::FileReaderStreamBuf(FileReader& reader, size_t bufferSize)
+    : reader_(reader), buffer_(std::max<size_t>(1, bufferSize)) {
+    setg(buffer_.data(), buffer_.data(), buffer_.data());
+}
+
+uint64_t FileReaderStreamBuf::position() const {
+    return buffer_offset_ + static_cast<uint64_t>(gptr() - eback());
+}
+
+FileReaderStreamBuf::int_type FileReaderStreamBuf::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    
+    buffer_offset_ = position();
+    size_t read = reader_.readAt(buffer_offset_, reinterpret_cast<uint8_t*>(buffer_.data()), buffer_.size());
+    setg(buffer_.data(), buffer_.data(), buffer_.data() + read);
+    return read == 0 ? traits_type::eof() : traits_type::to_int_type(*gptr());
+}
+
+std::streamsize FileReaderStreamBuf::xsgetn(char* buffer, std::streamsize count) {
+    // Whatever is already buffered first
+    std::streamsize buffered = std::min<std::streamsize>(count, egptr() - gptr());
+    std::copy(gptr(), gptr() + buffered, buffer);
+    gbump(static_cast<int>(buffered));
+    
+    std::streamsize remaining = count - buffered;
+    if (remaining == 0) {
+        return count;
+    }
+    if (static_cast<size_t>(remaining) < buffer_.size()) {
+        return buffered + std::streambuf::xsgetn(buffer + buffered, remaining);
+    }
+    
+    // Large reads go straight into the caller's memory
+    uint64_t offset = position();
+    size_t read = reader_.readAt(offset, reinterpret_cast<uint8_t*>(buffer + buffered), static_cast<size_t>(remaining));
+    buffer_offset_ = offset + read;
+    setg(buffer_.data(), buffer_.data(), buffer_.data());
+    return buffered + static_cast<std::streamsize>(read);
+}
+
+FileReaderStreamBuf::pos_type FileReaderStreamBuf::seekoff(
+    off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which
+) {
+    if (!(which & std::ios_base::in)) {
+        return pos_type(off_type(-1));
+    }
+    
+    off_type base = direction == std::ios_base::beg ? 0
+        : direction == std::ios_base::cur ? static_cast<off_type>(position())
+        : static_cast<off_type>(reader_.size());
+    off_type target = base + offset;
+    if (target < 0) {
+        return pos_type(off_type(-1));
+    }
+    
+    // Stay in the buffer when the target is inside it
+    uint64_t position = static_cast<uint64_t>(target);
+    if (position >= buffer_offset_ && position <= buffer_offset_ + static_cast<uint64_t>(egptr() - eback())) {
+        setg(eback(), eback() + (position - buffer_offset_), egptr());
+    } else {
+        buffer_offset_ = position;
+        setg(buffer_.data(), buffer_.data(), buffer_.data());
+    }
+    return pos_type(target);
+}
+
+FileReaderStreamBuf::pos_type FileReaderStreamBuf::seekpos(pos_type position, std::ios_base::openmode which) {
+    return seekoff(off_type(position), std::ios_base::beg, which);
+}
+
+FileWriterStreamBuf::FileWriterStreamBuf(FileWriter& writer, size_t bufferSize)
+    : writer_(writer), buffer_(std::max<size_t>(1, bufferSize)) {
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+void FileWriterStreamBuf::flushBuffer() {
+    size_t pending = static_cast<size_t>(pptr() - pbase());
+    if (pending > 0) {
+        writer_.writeAt(buffer_offset_, reinterpret_cast<const uint8_t*>(pbase()), pending);
+        buffer_offset_ += pending;
+    }
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+FileWriterStreamBuf::int_type FileWriterStreamBuf::overflow(int_type c) {
+    flushBuffer();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize FileWriterStreamBuf::xsputn(const char* data, std::streamsize count) {
+    if (static_cast<size_t>(count) < buffer_.size()) {
+        return std::streambuf::xsputn(data, count);
+    }
+    
+    // Large writes go straight to the file
+    flushBuffer();
+    writer_.writeAt(buffer_offset_, reinterpret_cast<const uint8_t*>(data), static_cast<size_t>(count));
+    buffer_offset_ += static_cast<uint64_t>(count);
+    return count;
+}
+
+int FileWriterStreamBuf::sync() {
+    flushBuffer();
+    return 0;
+}
+
+//
+// Local file system
+//
+
+bool FileSystem::fileExists(std::string_view path) const {
+    std::error_code ec;
+    return std::filesystem::is_regular_file(std::filesystem::path(path), ec);
+}
+
+std::uintmax_t FileSystem::getFileSize(std::string_view path) const {
+    std::error_code ec;
+    std::uintmax_t size = std::filesystem::file_size(std::filesystem::path(path), ec);
+    if (ec) {
+        std::string errorMsg = "Failed to get file size: " + std::string(path) + " (" + ec.message() + ")";
+        throw FileOperationException(errorMsg,
+                                     ec == std::errc::no_such_file_or_directory
+                                         ? FileOperationException::ErrorCode::FileNotFound
+                                         : FileOperationException::ErrorCode::IoError,
+                                     std::string(path));
+    }
+    return size;
+}
+
+void FileSystem::createDirectories(std::string_view path) const {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path), ec);
+    if (ec) {
+        std::string errorMsg = "Failed to create directory: " + std::string(path) + " (" + ec.message() + ")";
+        LOG_ERROR(errorMsg);
+        throw FileOperationException(errorMsg, FileOperationException::ErrorCode::DirectoryCreationFailed,
+                                     std::string(path));
+    }
+}
+
+std::vector<uint8_t> FileSystem::readFile(std::string_view path) const {
+    std::unique_ptr<FileReader> reader = openReader(path);
+    std::vector<uint8_t> data(static_cast<size_t>(reader->size()));
+    data.resize(reader->readAt(0, data.data(), data.size()));
+    return data;
+}
+
+void FileSystem::writeFile(std::string_view path, const std::vector<uint8_t>& data) const {
+    std::unique_ptr<FileWriter> writer = openWriter(path, data.size());
+    writer->writeAt(0, data.data(), data.size());
+    writer->close();
+}
+
+bool FileSystem::removeFile(std::string_view path) const {
+    std::error_code ec;
+    bool removed = std::filesystem::remove(std::filesystem::path(path), ec);
+    if (ec) {
+        std::string errorMsg = "Failed to remove file: " + std::string(path) + " (" + ec.message() + ")";
+        LOG_ERROR(errorMsg);
+        throw FileOperationException(errorMsg, FileOperationException::ErrorCode::IoError, std::string(path));
+    }
+    return removed;
+}
+
+void FileSystem::renameFile(std::string_view from, std::string_view to) const {
+    std::error_code ec;
+    std::filesystem::rename(std::filesystem::path(from), std::filesystem::path(to), ec);
+    if (ec) {
+        std::string errorMsg = "Failed to rename file: " + std::string(from) + " -> " + std::string(to) +
+                               " (" + ec.message() + ")";
+        LOG_ERROR(errorMsg);
+        throw FileOperationException(errorMsg, FileOperationException::ErrorCode::IoError, std::string(from));
+    }
+}
+
+void FileSystem::syncDirectory(std::string_view path) const {
+#ifdef _WIN32
+    (void)path;
+#else
+    std::string directory = path.empty() ? std::string(".") : std::string(path);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        ioError("Failed to open directory", directory);
+    }
+    int result;
+    do {
+        result = fsync(fd);
+    } while (result != 0 && errno == EINTR);
+    
+    // Some file systems cannot sync directories and keep entries durable anyway
+    if (result != 0 && errno != EINVAL && errno != ENOTSUP) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        ioError("Failed to sync directory", directory);
+    }
+    ::close(fd);
+#endif
+}
+
+std::unique_ptr<FileReader> FileSystem::openReader(std::string_view path, FileCaching caching) const {
+    return std::make_unique<LocalFileReader>(std::string(path), caching);
+}
+
+std::unique_ptr<FileWriter> FileSystem::openWriter(std::string_view path, uint64_t sizeHint, FileCaching caching) const {
+    auto writer = std::make_unique<LocalFileWriter>(std::string(path), caching, false);
+    if (sizeHint > 0) {
+        writer->preallocate(sizeHint);
+    }
+    return writer;
+}
+
+std::unique_ptr<FileWriter> FileSystem::openForUpdate(std::string_view path, FileCaching caching) const {
+    return std::make_unique<LocalFileWriter>(std::string(path), caching, true);
+}
+
+bool FileSystem::isMappable(std::string_view path) const {
+    return MappedFile::isMappable(std::string(path));
+}
+
 std::string FileOperations::selectFile(
     const std::string& title,
     const std::string& filter,
@@ -101,7 +815,7 @@ std::string FileOperations::selectFile(
     }
     LOG_WARNING("File dialog not available in CLI mode. Using default path: " + result);
 #endif
-    
+
     if (!result.empty()) {
         try {
             // Sanitize the path to prevent directory traversal attacks
@@ -121,7 +835,7 @@ std::vector<std::string> FileOperations::selectMultipleFiles(
     const std::string& filter
 ) const {
     std::vector<std::string> result;
-    
+
 #ifndef NO_QT_UI
     QStringList selectedFiles = QFileDialog::getOpenFileNames(
         nullptr,
@@ -137,21 +851,22 @@ std::vector<std::string> FileOperations::selectMultipleFiles(
     result.push_back(defaultPath);
     LOG_WARNING("Multiple file dialog not available in CLI mode. Using default path: " + defaultPath);
 #endif
-    
-    // Sanitize all paths
+
+    // Sanitize all paths; a selection usually comes from one directory
+    PathResolver resolver;
     std::vector<std::string> sanitizedPaths;
     sanitizedPaths.reserve(result.size());
     
     for (const auto& path : result) {
         try {
-            sanitizedPaths.push_back(PathUtils::sanitizePath(path));
+            sanitizedPaths.push_back(resolver.resolve(path));
         } catch (const std::exception& e) {
             LOG_WARNING("Invalid file path skipped: " + path + " - " + e.what());
         }
     }
     
     if (!sanitizedPaths.empty()) {
-        LOG_INFO("Multiple files selected: " + std::to_string(sanitizedPaths.size()) + " files");
+        LOG_EVENT(Info, "Multiple files selected", {"files", sanitizedPaths.size()});
     }
     
     return sanitizedPaths;
@@ -172,7 +887,7 @@ std::string FileOperations::selectDirectory(const std::string& title) const {
     std::string result = getHomeDirectory();
     LOG_WARNING("Directory dialog not available in CLI mode. Using home directory: " + result);
 #endif
-    
+
     if (!result.empty()) {
         try {
             // Sanitize the path to prevent directory traversal attacks
@@ -187,6 +902,10 @@ std::string FileOperations::selectDirectory(const std::string& title) const {
     return result;
 }
 
+std::string PathUtil::ensureUniqueFilePath(std::string_view basePath) {
+    return PathUtils::ensureUniqueFilePath(basePath);
+}
+
 std::string FileOperations::prepareOutputFile(
     const std::string& sourcePath,
     const std::string& outputPath,
@@ -308,7 +1027,7 @@ std::uintmax_t FileOperations::getFileSize(const std::string& path) {
         }
         
         std::uintmax_t size = std::filesystem::file_size(sanitizedPath);
-        LOG_INFO("File size for " + sanitizedPath + ": " + std::to_string(size) + " bytes");
+        LOG_EVENT(Info, "File size", {"path", sanitizedPath}, {"bytes", size});
         return size;
     } catch (const std::filesystem::filesystem_error& e) {
         std::string errorMsg = "Failed to get file size: " + path + " (" + e.what() + ")";
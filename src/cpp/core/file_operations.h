@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <memory>
 #include <stdexcept>
+#include <streambuf>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -90,10 +93,210 @@ public:
     static std::string ensureUniqueFilePath(std::string_view basePath);
 };
 
+/**
+ * How opened files use the operating system's page cache
+ */
+enum class FileCaching {
+    Normal,      // Cached as usual
+    DropBehind   // Used once: evicted as soon as it was read or written back
+};
+
+/**
+ * @brief Open file for positional reads
+ * 
+ * Reads at explicit offsets need no shared file position, so one reader
+ * may serve several threads if the implementation allows it; the local
+ * one does.
+ */
+class FileReader {
+public:
+    virtual ~FileReader() = default;
+    
+    /**
+     * @brief Read bytes starting at an offset
+     * 
+     * @param offset Position in the file
+     * @param buffer Destination
+     * @param size Bytes wanted
+     * @return Bytes read; less than size only at the end of the file
+     * @throws FileOperationException on IO errors
+     */
+    virtual size_t readAt(uint64_t offset, uint8_t* buffer, size_t size) = 0;
+    
+    /**
+     * @return File size in bytes when it was opened
+     */
+    virtual uint64_t size() const = 0;
+    
+    /**
+     * @return True if readAt() may be called from several threads at once
+     */
+    virtual bool threadSafe() const { return false; }
+    
+    /**
+     * @return POSIX file descriptor for kernel I/O queues, or -1 if there is none
+     */
+    virtual int descriptor() const { return -1; }
+    
+    /**
+     * @brief Record that bytes were read behind readAt()'s back
+     * 
+     * Called by I/O queues that read from descriptor() directly, so cache
+     * hints still apply.
+     * 
+     * @param offset Position in the file
+     * @param size Number of bytes
+     */
+    virtual void noteRead(uint64_t offset, size_t size) { (void)offset; (void)size; }
+};
+
+/**
+ * @brief Open file for positional writes
+ * 
+ * Data is stored once close() returned and durable only after sync(); a
+ * writer destroyed without close() is closed silently.
+ */
+class FileWriter {
+public:
+    virtual ~FileWriter() = default;
+    
+    /**
+     * @brief Write bytes starting at an offset, extending the file if needed
+     * 
+     * @param offset Position in the file
+     * @param data Bytes to write
+     * @param size Number of bytes
+     * @throws FileOperationException on IO errors, such as a full disk
+     */
+    virtual void writeAt(uint64_t offset, const uint8_t* data, size_t size) = 0;
+    
+    /**
+     * @brief Reserve space for the expected size without changing the file size
+     * 
+     * Only a hint; implementations that cannot reserve space ignore it.
+     * Space past the last written byte is released by close().
+     * 
+     * @param size Expected final size in bytes
+     */
+    virtual void preallocate(uint64_t size) { (void)size; }
+    
+    /**
+     * @brief Cut the file at a size, dropping everything past it
+     * 
+     * For writers from FileSystem::openForUpdate() whose new contents are
+     * shorter than the old ones. Backends that cannot do it throw.
+     * 
+     * @param size New file size in bytes, at most the current size
+     * @throws FileOperationException if the size cannot be changed
+     */
+    virtual void truncate(uint64_t size);
+    
+    /**
+     * @brief Start writing the data back to the device without waiting
+     * 
+     * Leaves a later sync() little to do. Only a hint.
+     */
+    virtual void startSync() {}
+    
+    /**
+     * @brief Wait until the data written so far is on stable storage
+     * 
+     * Releases space reserved past the last written byte first, so the
+     * stored size is final. Call before close(); backends without
+     * durability guarantees ignore it.
+     * 
+     * @throws FileOperationException if the data could not be stored
+     */
+    virtual void sync() {}
+    
+    /**
+     * @brief Flush and close the file
+     * 
+     * @throws FileOperationException if the data could not be stored
+     */
+    virtual void close() = 0;
+    
+    /**
+     * @return True if writeAt() may be called from several threads at once
+     *         for ranges that do not overlap
+     */
+    virtual bool threadSafe() const { return false; }
+    
+    /**
+     * @return POSIX file descriptor for kernel I/O queues, or -1 if there is none
+     */
+    virtual int descriptor() const { return -1; }
+    
+    /**
+     * @brief Record that bytes were written behind writeAt()'s back
+     * 
+     * Called by I/O queues that write to descriptor() directly, so close()
+     * still knows the final size and cache hints still apply.
+     * 
+     * @param offset Position in the file
+     * @param size Number of bytes
+     */
+    virtual void noteWritten(uint64_t offset, size_t size) { (void)offset; (void)size; }
+};
+
+/**
+ * @brief Sequential, seekable std::istream adapter over a FileReader
+ * 
+ * Lets stream-based code such as container::ContainerReader read from any
+ * FileSystem. Large reads bypass the internal buffer and go straight into
+ * the caller's memory. Read errors set badbit on the stream.
+ */
+class FileReaderStreamBuf : public std::streambuf {
+public:
+    explicit FileReaderStreamBuf(FileReader& reader, size_t bufferSize = DEFAULT_BUFFER_SIZE);
+    
+    static constexpr size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+protected:
+    int_type underflow() override;
+    std::streamsize xsgetn(char* buffer, std::streamsize count) override;
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+
+private:
+    uint64_t position() const;
+    
+    FileReader& reader_;
+    std::vector<char> buffer_;
+    uint64_t buffer_offset_ = 0;  // File offset of buffer_[0]
+};
+
+/**
+ * @brief Sequential std::ostream adapter over a FileWriter
+ * 
+ * Writes go to increasing offsets from 0. Large writes bypass the internal
+ * buffer. Write errors set badbit on the stream; flush the stream before
+ * closing the writer.
+ */
+class FileWriterStreamBuf : public std::streambuf {
+public:
+    explicit FileWriterStreamBuf(FileWriter& writer, size_t bufferSize = FileReaderStreamBuf::DEFAULT_BUFFER_SIZE);
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* data, std::streamsize count) override;
+    int sync() override;
+
+private:
+    void flushBuffer();
+    
+    FileWriter& writer_;
+    std::vector<char> buffer_;
+    uint64_t buffer_offset_ = 0;  // File offset of buffer_[0]
+};
+
 /**
  * @brief File system operations
  * 
- * Handles direct file and directory operations
+ * Handles direct file and directory operations. The default implementation
+ * works on local disk; subclasses can provide other backends (in-memory
+ * for tests, remote storage) by overriding the virtual methods, including
+ * openReader() and openWriter(), which the file engine uses for all data.
  */
 class FileSystem {
 public:
@@ -154,6 +357,84 @@ public:
      * @throws FileOperationException if file exists but couldn't be removed
      */
     virtual bool removeFile(std::string_view path) const;
+    
+    /**
+     * @brief Rename a file, replacing the destination if it exists
+     * 
+     * Atomic on local file systems when both paths are in one directory:
+     * the destination is always either the old or the new file.
+     * 
+     * @param from Current path
+     * @param to New path
+     * @throws FileOperationException if the file could not be renamed
+     */
+    virtual void renameFile(std::string_view from, std::string_view to) const;
+    
+    /**
+     * @brief Make files created, renamed or removed in a directory durable
+     * 
+     * Without it a synced file can still vanish, or come back under its
+     * old name, after a crash. Nothing to do on Windows, whose file
+     * systems log such changes themselves.
+     * 
+     * @param path Directory path
+     * @throws FileOperationException if the directory could not be synced
+     */
+    virtual void syncDirectory(std::string_view path) const;
+    
+    /**
+     * @brief Open a file for positional reads
+     * 
+     * @param path File path
+     * @param caching Page cache use; backends without a cache ignore it
+     * @return Reader for the file
+     * @throws FileOperationException if the file cannot be opened
+     */
+    virtual std::unique_ptr<FileReader> openReader(
+        std::string_view path,
+        FileCaching caching = FileCaching::Normal
+    ) const;
+    
+    /**
+     * @brief Create or truncate a file for positional writes
+     * 
+     * @param path File path
+     * @param sizeHint Expected final size to preallocate, or 0 if unknown
+     * @param caching Page cache use; backends without a cache ignore it
+     * @return Writer for the file
+     * @throws FileOperationException if the file cannot be created
+     */
+    virtual std::unique_ptr<FileWriter> openWriter(
+        std::string_view path,
+        uint64_t sizeHint = 0,
+        FileCaching caching = FileCaching::Normal
+    ) const;
+    
+    /**
+     * @brief Open an existing file for positional writes, keeping its contents
+     * 
+     * Writes replace bytes in place; FileWriter::truncate() shortens the file.
+     * 
+     * @param path File path
+     * @param caching Page cache use; backends without a cache ignore it
+     * @return Writer for the file
+     * @throws FileOperationException if the file does not exist or cannot be opened
+     */
+    virtual std::unique_ptr<FileWriter> openForUpdate(
+        std::string_view path,
+        FileCaching caching = FileCaching::Normal
+    ) const;
+    
+    /**
+     * @brief Check whether a file may be memory-mapped directly
+     * 
+     * Backends that are not local disk must return false, so that the
+     * engine goes through openReader() and openWriter() instead.
+     * 
+     * @param path File path
+     * @return True for non-empty regular files on local file systems
+     */
+    virtual bool isMappable(std::string_view path) const;
 };
 
 /**
@@ -323,7 +604,7 @@ public:
      * @return Directory path
      */
     std::string getDirectoryPath(const std::string& path);
-    
+
 private:
     std::unique_ptr<FileSystem> file_system_;
     std::unique_ptr<FileDialogInterface> file_dialog_;
@@ -0,0 +1,524 @@
+#include "io_queue.h"
+#include "file_operations.h"
+#include "thread_pool.h"
+#include "audit_log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CRUSTY_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace crusty {
+
+namespace {
+
+// More threads than this only add contention on one device
+constexpr size_t MAX_IO_THREADS = 8;
+
+// Completion callbacks run on I/O threads, where nobody could catch
+void runCompletion(const IoQueue::Completion& done, size_t bytes, std::exception_ptr error) {
+    try {
+        done(bytes, error);
+    } catch (const std::exception& e) {
+        LOG_EVENT(Warning, "I/O completion callback failed", {"error", std::string(e.what())});
+    } catch (...) {
+        LOG_WARNING("I/O completion callback failed");
+    }
+}
+
+/**
+ * Runs every operation inside the submitting call
+ */
+class BlockingIoQueue : public IoQueue {
+public:
+    void read(FileReader& file, uint64_t offset, uint8_t* buffer, size_t size, Completion done) override {
+        size_t bytes = 0;
+        std::exception_ptr error;
+        try {
+            bytes = file.readAt(offset, buffer, size);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        runCompletion(done, bytes, error);
+    }
+    
+    void write(FileWriter& file, uint64_t offset, const uint8_t* data, size_t size, Completion done) override {
+        std::exception_ptr error;
+        try {
+            file.writeAt(offset, data, size);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        runCompletion(done, error ? 0 : size, error);
+    }
+    
+    void drain() override {}
+    IoEngine engine() const override { return IoEngine::Blocking; }
+    size_t depth() const override { return 1; }
+};
+
+/**
+ * Blocking positional I/O on a few dedicated threads
+ */
+class ThreadIoQueue : public IoQueue {
+public:
+    explicit ThreadIoQueue(size_t depth)
+        : depth_(depth), threads_(std::min(depth, MAX_IO_THREADS)) {
+    }
+    
+    ~ThreadIoQueue() override {
+        drain();
+    }
+    
+    void read(FileReader& file, uint64_t offset, uint8_t* buffer, size_t size, Completion done) override {
+        submit([&file, offset, buffer, size]() { return file.readAt(offset, buffer, size); }, std::move(done));
+    }
+    
+    void write(FileWriter& file, uint64_t offset, const uint8_t* data, size_t size, Completion done) override {
+        submit([&file, offset, data, size]() {
+            file.writeAt(offset, data, size);
+            return size;
+        }, std::move(done));
+    }
+    
+    void drain() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this]() { return in_flight_ == 0; });
+    }
+    
+    IoEngine engine() const override { return IoEngine::ThreadPool; }
+    size_t depth() const override { return depth_; }
+
+private:
+    template<typename Operation>
+    void submit(Operation operation, Completion done) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this]() { return in_flight_ < depth_; });
+            ++in_flight_;
+        }
+        
+        threads_.submit([this, operation, done = std::move(done)]() {
+            size_t bytes = 0;
+            std::exception_ptr error;
+            try {
+                bytes = operation();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            runCompletion(done, bytes, error);
+            
+            // Only now, so drain() returns after the last callback
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                --in_flight_;
+            }
+            changed_.notify_all();
+        });
+    }
+    
+    size_t depth_;
+    size_t in_flight_ = 0;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    
+    // Last, so the workers stop before the state they use is destroyed
+    ThreadPool threads_;
+};
+
+#ifdef CRUSTY_HAVE_IO_URING
+
+std::exception_ptr ioFailure(int error, bool writing) {
+    using ErrorCode = FileOperationException::ErrorCode;
+    ErrorCode code = ErrorCode::IoError;
+    if (error == ENOSPC || error == EDQUOT) {
+        code = ErrorCode::DiskFull;
+    } else if (error == EACCES || error == EPERM) {
+        code = ErrorCode::AccessDenied;
+    }
+    std::string message = std::string(writing ? "Failed to write file" : "Failed to read file") +
+                          " (" + std::strerror(error) + ")";
+    return std::make_exception_ptr(FileOperationException(message, code, ""));
+}
+
+/**
+ * Linux io_uring through the raw system calls
+ * 
+ * One submission ring shared by all submitting threads under a mutex, and
+ * one completion thread that blocks in io_uring_enter and runs callbacks.
+ * Short transfers are resubmitted for the remainder, so callers see the
+ * same semantics as FileReader::readAt and FileWriter::writeAt.
+ */
+class UringIoQueue : public IoQueue {
+public:
+    /**
+     * @return Queue, or null if the kernel refuses to set up a ring
+     */
+    static std::unique_ptr<UringIoQueue> create(size_t depth, int& error) {
+        std::unique_ptr<UringIoQueue> queue(new UringIoQueue(depth));
+        error = queue->setUp();
+        if (error != 0) {
+            return nullptr;
+        }
+        queue->completer_ = std::thread([queue = queue.get()]() { queue->completionLoop(); });
+        return queue;
+    }
+    
+    ~UringIoQueue() override {
+        if (completer_.joinable()) {
+            drain();
+            
+            // Wake the completion thread with an operation only it understands
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                io_uring_sqe& sqe = nextEntry();
+                sqe.opcode = IORING_OP_NOP;
+                sqe.user_data = WAKE;
+                submitEntry();
+            }
+            completer_.join();
+        }
+        
+        if (sqes_ != MAP_FAILED) {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != MAP_FAILED) {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+        if (ring_fd_ >= 0) {
+            close(ring_fd_);
+        }
+    }
+    
+    void registerBuffers(const std::vector<IoBuffer>& buffers) override {
+        std::vector<iovec> vectors;
+        vectors.reserve(buffers.size());
+        for (const IoBuffer& buffer : buffers) {
+            vectors.push_back({buffer.data, buffer.size});
+        }
+        if (vectors.empty()) {
+            return;
+        }
+        
+        // Pinned pages count against RLIMIT_MEMLOCK, which may be too low
+        if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+                    vectors.data(), static_cast<unsigned>(vectors.size())) != 0) {
+            static std::once_flag logged;
+            int error = errno;
+            std::call_once(logged, [error]() {
+                LOG_EVENT(Info, "io_uring buffer registration failed, using unregistered buffers",
+                          {"error", std::string(std::strerror(error))});
+            });
+            return;
+        }
+        registered_ = buffers;
+    }
+    
+    void read(FileReader& file, uint64_t offset, uint8_t* buffer, size_t size, Completion done) override {
+        if (file.descriptor() < 0) {
+            blocking_.read(file, offset, buffer, size, std::move(done));
+            return;
+        }
+        submit({false, file.descriptor(), &file, nullptr, offset, buffer, size, 0, std::move(done)});
+    }
+    
+    void write(FileWriter& file, uint64_t offset, const uint8_t* data, size_t size, Completion done) override {
+        if (file.descriptor() < 0) {
+            blocking_.write(file, offset, data, size, std::move(done));
+            return;
+        }
+        submit({true, file.descriptor(), nullptr, &file, offset, const_cast<uint8_t*>(data), size, 0, std::move(done)});
+    }
+    
+    void drain() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this]() { return free_.size() == operations_.size(); });
+    }
+    
+    IoEngine engine() const override { return IoEngine::IoUring; }
+    size_t depth() const override { return operations_.size(); }
+
+private:
+    struct Operation {
+        bool writing = false;
+        int fd = -1;
+        FileReader* reader = nullptr;
+        FileWriter* writer = nullptr;
+        uint64_t offset = 0;
+        uint8_t* data = nullptr;
+        size_t size = 0;
+        size_t done = 0;
+        Completion callback;
+    };
+    
+    static constexpr uint64_t WAKE = ~uint64_t(0);
+    
+    // Largest transfer per entry; the kernel caps single I/Os near 2 GiB anyway
+    static constexpr size_t MAX_TRANSFER = size_t(1) << 30;
+    
+    explicit UringIoQueue(size_t depth) : operations_(depth) {
+        free_.reserve(depth);
+        for (size_t i = depth; i > 0; --i) {
+            free_.push_back(i - 1);
+        }
+    }
+    
+    int setUp() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        
+        // One spare entry for the wake-up at shutdown
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(operations_.size() + 1), &params));
+        if (ring_fd_ < 0) {
+            return errno;
+        }
+        
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            return errno;
+        }
+        cq_ring_ = singleMap ? sq_ring_
+                             : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                    ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            return errno;
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) {
+            return errno;
+        }
+        
+        uint8_t* sq = static_cast<uint8_t*>(sq_ring_);
+        uint8_t* cq = static_cast<uint8_t*>(cq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return 0;
+    }
+    
+    void submit(Operation operation) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this]() { return !free_.empty(); });
+        size_t slot = free_.back();
+        free_.pop_back();
+        operations_[slot] = std::move(operation);
+        queue(slot);
+    }
+    
+    // Caller holds mutex_
+    io_uring_sqe& nextEntry() {
+        unsigned index = *sq_tail_ & sq_mask_;
+        io_uring_sqe& sqe = static_cast<io_uring_sqe*>(sqes_)[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sq_array_[index] = index;
+        return sqe;
+    }
+    
+    // Caller holds mutex_
+    void submitEntry() {
+        __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+        while (syscall(__NR_io_uring_enter, ring_fd_, 1u, 0u, 0u, nullptr, 0) < 0) {
+            // The entry stays in the ring, so retrying submits it
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                LOG_EVENT(Error, "io_uring submission failed", {"error", std::string(std::strerror(errno))});
+                std::terminate();
+            }
+        }
+    }
+    
+    // Caller holds mutex_
+    void queue(size_t slot) {
+        Operation& operation = operations_[slot];
+        uint8_t* data = operation.data + operation.done;
+        size_t length = std::min(operation.size - operation.done, MAX_TRANSFER);
+        
+        io_uring_sqe& sqe = nextEntry();
+        sqe.opcode = operation.writing ? IORING_OP_WRITE : IORING_OP_READ;
+        for (size_t i = 0; i < registered_.size(); ++i) {
+            if (data >= registered_[i].data && data + length <= registered_[i].data + registered_[i].size) {
+                sqe.opcode = operation.writing ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+                sqe.buf_index = static_cast<uint16_t>(i);
+                break;
+            }
+        }
+        sqe.fd = operation.fd;
+        sqe.off = operation.offset + operation.done;
+        sqe.addr = reinterpret_cast<uint64_t>(data);
+        sqe.len = static_cast<uint32_t>(length);
+        sqe.user_data = slot;
+        submitEntry();
+    }
+    
+    void completionLoop() {
+        while (true) {
+            if (syscall(__NR_io_uring_enter, ring_fd_, 0u, 1u, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                errno != EINTR) {
+                LOG_EVENT(Error, "io_uring wait failed", {"error", std::string(std::strerror(errno))});
+                std::terminate();
+            }
+            
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            bool stopping = false;
+            for (; head != tail; ++head) {
+                io_uring_cqe entry = cqes_[head & cq_mask_];
+                __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                if (entry.user_data == WAKE) {
+                    stopping = true;
+                } else {
+                    complete(static_cast<size_t>(entry.user_data), entry.res);
+                }
+            }
+            if (stopping) {
+                return;
+            }
+        }
+    }
+    
+    void complete(size_t slot, int result) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Operation& operation = operations_[slot];
+        
+        std::exception_ptr error;
+        if (result == -EINTR || result == -EAGAIN) {
+            queue(slot);
+            return;
+        }
+        if (result < 0) {
+            error = ioFailure(-result, operation.writing);
+        } else {
+            operation.done += static_cast<size_t>(result);
+            bool more = operation.done < operation.size;
+            if (more && result > 0) {
+                queue(slot);
+                return;
+            }
+            if (more && operation.writing) {
+                error = ioFailure(EIO, true);
+            }
+        }
+        
+        Operation finished = std::move(operation);
+        lock.unlock();
+        
+        // Outside the lock; cache hints may wait for writeback
+        if (!error && finished.writer) {
+            finished.writer->noteWritten(finished.offset, finished.size);
+        } else if (!error && finished.reader) {
+            finished.reader->noteRead(finished.offset, finished.done);
+        }
+        
+        // The slot is freed after the callback, so drain() returns only
+        // once every callback has run
+        runCompletion(finished.callback, error ? 0 : finished.done, error);
+        
+        lock.lock();
+        free_.push_back(slot);
+        lock.unlock();
+        changed_.notify_all();
+    }
+    
+    std::vector<Operation> operations_;
+    std::vector<size_t> free_;
+    std::vector<IoBuffer> registered_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    BlockingIoQueue blocking_;
+    
+    int ring_fd_ = -1;
+    void* sq_ring_ = MAP_FAILED;
+    void* cq_ring_ = MAP_FAILED;
+    void* sqes_ = MAP_FAILED;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    
+    std::thread completer_;
+};
+
+#endif
+
+} // anonymous namespace
+
+std::unique_ptr<IoQueue> IoQueue::create(IoEngine engine, size_t depth) {
+    depth = std::max<size_t>(depth, 1);
+    
+    switch (engine) {
+        case IoEngine::Blocking:
+            return std::make_unique<BlockingIoQueue>();
+        case IoEngine::IoUring: {
+#ifdef CRUSTY_HAVE_IO_URING
+            int error = 0;
+            std::unique_ptr<UringIoQueue> queue = UringIoQueue::create(depth, error);
+            if (queue) {
+                return queue;
+            }
+            std::string reason = std::strerror(error);
+#else
+            std::string reason = "not supported on this platform";
+#endif
+            // Containers often block the system calls; say so once, not per file
+            static std::once_flag logged;
+            std::call_once(logged, [&reason]() {
+                LOG_EVENT(Warning, "io_uring not available, using I/O threads", {"reason", reason});
+            });
+            return std::make_unique<ThreadIoQueue>(depth);
+        }
+        case IoEngine::ThreadPool:
+        default:
+            return std::make_unique<ThreadIoQueue>(depth);
+    }
+}
+
+const char* ioEngineName(IoEngine engine) {
+    switch (engine) {
+        case IoEngine::Blocking:
+            return "blocking";
+        case IoEngine::ThreadPool:
+            return "threads";
+        case IoEngine::IoUring:
+            return "io_uring";
+        default:
+            return "unknown";
+    }
+}
+
+} // namespace crusty
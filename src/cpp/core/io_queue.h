@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace crusty {
+
+class FileReader;
+class FileWriter;
+
+/**
+ * How the file engine issues reads and writes
+ */
+enum class IoEngine {
+    Blocking,    // One read or write at a time on the engine's own threads
+    ThreadPool,  // Reads ahead and writes behind on dedicated I/O threads
+    IoUring      // Linux io_uring; falls back to ThreadPool where it is not available
+};
+
+/**
+ * @brief Memory registered with an I/O queue for repeated transfers
+ */
+struct IoBuffer {
+    uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * @brief Queue of asynchronous positional reads and writes
+ * 
+ * Operations are submitted from any thread and complete in any order. Each
+ * completion callback runs on an I/O thread with the bytes transferred (a
+ * read is short only at the end of the file, a write is never short) or
+ * the error that ended the operation. Callbacks must be quick and must not
+ * submit to or drain the same queue.
+ * 
+ * At most depth() operations are in flight; submitting more blocks until
+ * one completes. The destructor waits for every operation, so buffers and
+ * files may be released once the queue is gone.
+ */
+class IoQueue {
+public:
+    /**
+     * Completion callback; error is null on success
+     */
+    using Completion = std::function<void(size_t bytes, std::exception_ptr error)>;
+    
+    /**
+     * @brief Create a queue for an engine
+     * 
+     * IoEngine::IoUring falls back to IoEngine::ThreadPool if the kernel
+     * or platform does not support it; engine() tells which one is used.
+     * 
+     * @param engine Requested engine; Blocking runs operations inside submit
+     * @param depth Maximum operations in flight (at least 1)
+     * @return The queue
+     */
+    static std::unique_ptr<IoQueue> create(IoEngine engine, size_t depth);
+    
+    virtual ~IoQueue() = default;
+    
+    /**
+     * @brief Register buffers that later transfers will use
+     * 
+     * Lets io_uring pin the pages once instead of on every operation.
+     * Transfers may still use other memory. Must be called before the first
+     * submission; failures only lose the optimization.
+     * 
+     * @param buffers Buffers, which must outlive the queue
+     */
+    virtual void registerBuffers(const std::vector<IoBuffer>& buffers) { (void)buffers; }
+    
+    /**
+     * @brief Read bytes at an offset
+     * 
+     * @param file File to read; must stay open until the callback ran
+     * @param offset Position in the file
+     * @param buffer Destination
+     * @param size Bytes wanted
+     * @param done Completion callback
+     */
+    virtual void read(FileReader& file, uint64_t offset, uint8_t* buffer, size_t size, Completion done) = 0;
+    
+    /**
+     * @brief Write bytes at an offset
+     * 
+     * @param file File to write; must stay open until the callback ran
+     * @param offset Position in the file
+     * @param data Bytes to write; must stay valid until the callback ran
+     * @param size Number of bytes
+     * @param done Completion callback
+     */
+    virtual void write(FileWriter& file, uint64_t offset, const uint8_t* data, size_t size, Completion done) = 0;
+    
+    /**
+     * @brief Wait until every submitted operation has completed
+     */
+    virtual void drain() = 0;
+    
+    /**
+     * @return Engine actually used
+     */
+    virtual IoEngine engine() const = 0;
+    
+    /**
+     * @return Maximum operations in flight
+     */
+    virtual size_t depth() const = 0;
+};
+
+/**
+ * @return Short engine name for logs and the command line
+ */
+const char* ioEngineName(IoEngine engine);
+
+} // namespace crusty
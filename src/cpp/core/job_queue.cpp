@@ -0,0 +1,205 @@
+#include "job_queue.h"
+#include "audit_log.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace crusty {
+
+namespace {
+
+const char* stateName(JobQueue::State state) {
+    switch (state) {
+        case JobQueue::State::Queued:
+            return "queued";
+        case JobQueue::State::Running:
+            return "running";
+        case JobQueue::State::Succeeded:
+            return "succeeded";
+        case JobQueue::State::Failed:
+            return "failed";
+        default:
+            return "cancelled";
+    }
+}
+
+} // anonymous namespace
+
+JobQueue::JobQueue(size_t workerCount, Listener listener) : listener_(std::move(listener)) {
+    workerCount = std::max<size_t>(1, workerCount);
+    workers_.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers_.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+JobQueue::~JobQueue() {
+    std::vector<JobInfo> withdrawn;
+    std::vector<Job> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (uint64_t id : queued_) {
+            auto it = jobs_.find(id);
+            it->second.info.state = State::Cancelled;
+            withdrawn.push_back(it->second.info);
+            dropped.push_back(std::move(it->second.job));
+            jobs_.erase(it);
+        }
+        queued_.clear();
+        for (auto& [id, entry] : jobs_) {
+            entry.token->cancel();
+        }
+    }
+    available_.notify_all();
+    
+    // Released outside the lock, as what they captured may call back in
+    dropped.clear();
+    for (const JobInfo& job : withdrawn) {
+        notify(job);
+    }
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+uint64_t JobQueue::submit(std::string description, Job job, std::shared_ptr<CancellationToken> token) {
+    JobInfo info;
+    info.description = std::move(description);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        info.id = next_id_++;
+    }
+    
+    // Reported before a worker can see it, so listeners get states in order
+    LOG_EVENT(Info, "Job queued", {"job", info.id}, {"description", info.description});
+    notify(info);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!token) {
+            token = std::make_shared<CancellationToken>();
+        }
+        jobs_.emplace(info.id, Entry{info, std::move(job), std::move(token)});
+        queued_.push_back(info.id);
+    }
+    available_.notify_one();
+    return info.id;
+}
+
+bool JobQueue::cancel(uint64_t id) {
+    JobInfo withdrawn;
+    Job dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) {
+            return false;
+        }
+        
+        // Running jobs stop at their next check and report themselves
+        if (it->second.info.state == State::Running) {
+            it->second.token->cancel();
+            LOG_EVENT(Info, "Job cancellation requested", {"job", id});
+            return true;
+        }
+        
+        queued_.erase(std::find(queued_.begin(), queued_.end(), id));
+        it->second.info.state = State::Cancelled;
+        withdrawn = std::move(it->second.info);
+        dropped = std::move(it->second.job);
+        jobs_.erase(it);
+    }
+    dropped = nullptr;
+    
+    LOG_EVENT(Info, "Job cancelled", {"job", id}, {"description", withdrawn.description});
+    notify(withdrawn);
+    return true;
+}
+
+void JobQueue::cancelAll() {
+    std::vector<uint64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [id, entry] : jobs_) {
+            ids.push_back(id);
+        }
+    }
+    for (uint64_t id : ids) {
+        cancel(id);
+    }
+}
+
+std::vector<JobQueue::JobInfo> JobQueue::jobs() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<JobInfo> jobs;
+    jobs.reserve(jobs_.size());
+    for (const auto& [id, entry] : jobs_) {
+        jobs.push_back(entry.info);
+    }
+    return jobs;
+}
+
+void JobQueue::workerLoop() {
+    while (true) {
+        JobInfo info;
+        Job job;
+        std::shared_ptr<CancellationToken> token;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            available_.wait(lock, [this]() { return stopping_ || !queued_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            
+            Entry& entry = jobs_.at(queued_.front());
+            queued_.pop_front();
+            entry.info.state = State::Running;
+            info = entry.info;
+            job = std::move(entry.job);
+            token = entry.token;
+        }
+        notify(info);
+        
+        try {
+            job(info.id, token);
+            info.state = State::Succeeded;
+        } catch (const OperationCancelled&) {
+            info.state = State::Cancelled;
+        } catch (const std::exception& e) {
+            info.state = State::Failed;
+            info.error = e.what();
+        } catch (...) {
+            info.state = State::Failed;
+            info.error = "Unknown error";
+        }
+        
+        // Whatever the job captured goes before anyone hears it is done
+        job = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.erase(info.id);
+        }
+        
+        LOG_EVENT(Info, "Job finished", {"job", info.id}, {"state", stateName(info.state)});
+        notify(info);
+    }
+}
+
+void JobQueue::notify(const JobInfo& job) {
+    if (!listener_) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(listener_mutex_);
+    try {
+        listener_(job);
+    } catch (const std::exception& e) {
+        // The job itself is unaffected; only this update is lost
+        LOG_EVENT(Warning, "Job listener failed", {"job", job.id}, {"error", std::string(e.what())});
+    } catch (...) {
+        LOG_WARNING("Job listener failed");
+    }
+}
+
+} // namespace crusty
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "cancellation.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace crusty {
+
+/**
+ * @brief Long-lived queue of cancellable background jobs
+ * 
+ * Made for front ends that start whole operations (a file, a batch) and
+ * must stay responsive: jobs wait in submission order for one of a fixed
+ * number of worker threads, and any of them can be cancelled, queued or
+ * running. A running job is handed a CancellationToken to pass down to its
+ * Encryptor or BatchEncryptor, so it stops at the next chunk.
+ * 
+ * Unlike a ThreadPool, queued jobs can be withdrawn and the destructor
+ * does not run them: it cancels everything and waits only for the jobs
+ * already running, so no job outlives the queue.
+ */
+class JobQueue {
+public:
+    enum class State {
+        Queued,
+        Running,
+        Succeeded,
+        Failed,
+        Cancelled
+    };
+    
+    /**
+     * @brief Snapshot of one job
+     */
+    struct JobInfo {
+        uint64_t id = 0;
+        std::string description;
+        State state = State::Queued;
+        std::string error;   // Reason, for State::Failed
+    };
+    
+    /**
+     * Work of a job, run on a worker thread. Returning marks the job
+     * succeeded; throwing OperationCancelled marks it cancelled, and any
+     * other exception failed.
+     */
+    using Job = std::function<void(uint64_t id, const std::shared_ptr<const CancellationToken>& token)>;
+    
+    /**
+     * Called on every state change, from worker threads or from cancel()
+     * for queued jobs, one call at a time. Must not call back into the
+     * queue's destructor.
+     */
+    using Listener = std::function<void(const JobInfo& job)>;
+    
+    /**
+     * @brief Start the worker threads
+     * 
+     * @param workerCount Jobs run at the same time (at least 1)
+     * @param listener Optional callback for state changes
+     */
+    explicit JobQueue(size_t workerCount = DEFAULT_WORKERS, Listener listener = nullptr);
+    
+    /**
+     * @brief Cancel every job and wait for the running ones to stop
+     */
+    ~JobQueue();
+    
+    /**
+     * @brief Queue a job
+     * 
+     * @param description Shown to the user and in the log
+     * @param job Work to run
+     * @param token Token to hand the job, e.g. one with a parent or one the
+     *        caller also keeps to cancel it; null for a new one
+     * @return Id of the job, never 0
+     */
+    uint64_t submit(std::string description, Job job, std::shared_ptr<CancellationToken> token = nullptr);
+    
+    /**
+     * @brief Cancel a job
+     * 
+     * A queued job is removed and reported cancelled at once; a running one
+     * is asked to stop and reported when it does.
+     * 
+     * @param id Job to cancel
+     * @return False if the job has already finished or never existed
+     */
+    bool cancel(uint64_t id);
+    
+    /**
+     * @brief Cancel every queued and running job
+     */
+    void cancelAll();
+    
+    /**
+     * @return Queued and running jobs, oldest first
+     */
+    std::vector<JobInfo> jobs() const;
+    
+    /**
+     * @return Number of worker threads
+     */
+    size_t workerCount() const { return workers_.size(); }
+    
+    // Two jobs keep the disk busy while one is deriving its key; each job
+    // spreads its own chunks over more threads
+    static constexpr size_t DEFAULT_WORKERS = 2;
+    
+    // Prevent copying
+    JobQueue(const JobQueue&) = delete;
+    JobQueue& operator=(const JobQueue&) = delete;
+
+private:
+    struct Entry {
+        JobInfo info;
+        Job job;
+        std::shared_ptr<CancellationToken> token;
+    };
+    
+    void workerLoop();
+    void notify(const JobInfo& job);
+    
+    Listener listener_;
+    std::mutex listener_mutex_;
+    
+    mutable std::mutex mutex_;
+    std::condition_variable available_;
+    std::map<uint64_t, Entry> jobs_;   // Queued and running
+    std::deque<uint64_t> queued_;
+    uint64_t next_id_ = 1;
+    bool stopping_ = false;
+    
+    std::vector<std::thread> workers_;
+};
+
+} // namespace crusty
@@ -0,0 +1,180 @@
+#include "key_cache.h"
+#include "audit_log.h"
+#include "container_format.h"
+#include "crypto_interface.h"
+
+#include <algorithm>
+
+namespace crusty {
+
+namespace {
+
+// Argon2id floor: cheap enough for every lookup, still a keyed one-way hash
+constexpr uint32_t ID_MEMORY_KIB = 8;
+constexpr uint32_t ID_ITERATIONS = 1;
+constexpr uint32_t ID_PARALLELISM = 1;
+
+bool sameParams(const KdfParams& a, const KdfParams& b) {
+    return a.memoryKib == b.memoryKib && a.iterations == b.iterations && a.parallelism == b.parallelism;
+}
+
+} // anonymous namespace
+
+KeyCache::KeyCache(size_t capacity, std::chrono::seconds lifetime)
+    : capacity_(std::max<size_t>(1, capacity)), lifetime_(lifetime) {
+    if (crusty::crypto::fill_random_bytes(id_salt_.data(), id_salt_.size()) != 0) {
+        throw EncryptionException("Failed to generate key cache salt", CryptoErrorCode::InternalError);
+    }
+}
+
+KeyCache::~KeyCache() {
+    clear();
+    secure::wipeMemory(id_salt_.data(), id_salt_.size());
+}
+
+std::shared_ptr<const SecureKey> KeyCache::keyFor(
+    const Crypto& crypto,
+    secure::SecureView password,
+    const std::vector<uint8_t>& salt,
+    const KdfParams& params
+) {
+    std::vector<uint8_t> usedSalt;
+    return lookup(crypto, password, &salt, params, usedSalt);
+}
+
+std::shared_ptr<const SecureKey> KeyCache::keyForEncryption(
+    const Crypto& crypto,
+    secure::SecureView password,
+    const KdfParams& params,
+    std::vector<uint8_t>& salt
+) {
+    return lookup(crypto, password, nullptr, params, salt);
+}
+
+void KeyCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (!entries_.empty()) {
+        erase(entries_.begin());
+    }
+}
+
+size_t KeyCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+uint64_t KeyCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t KeyCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+KeyCache::PasswordId KeyCache::passwordId(secure::SecureView password) const {
+    PasswordId id{};
+    int32_t result = crusty::crypto::derive_key_with_params(
+        password.data(), password.size(),
+        id_salt_.data(), id_salt_.size(),
+        ID_MEMORY_KIB, ID_ITERATIONS, ID_PARALLELISM,
+        id.data(), id.size()
+    );
+    
+    if (result != 0) {
+        throw EncryptionException("Failed to hash password for the key cache", CryptoErrorCode::InvalidPassword);
+    }
+    return id;
+}
+
+std::shared_ptr<const SecureKey> KeyCache::lookup(
+    const Crypto& crypto,
+    secure::SecureView password,
+    const std::vector<uint8_t>* salt,
+    const KdfParams& params,
+    std::vector<uint8_t>& usedSalt
+) {
+    secure::SecureData<PasswordId> id(passwordId(password));
+    std::shared_future<std::shared_ptr<const SecureKey>> key;
+    std::promise<std::shared_ptr<const SecureKey>> derived;
+    uint64_t serial = 0;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Clock::time_point now = Clock::now();
+        dropExpired(now);
+        
+        auto found = std::find_if(entries_.begin(), entries_.end(), [&](const Entry& entry) {
+            return entry.passwordId == id.get() && sameParams(entry.params, params) &&
+                   (salt ? entry.salt == *salt : entry.encryptions < MAX_FILES_PER_KEY);
+        });
+        
+        if (found != entries_.end()) {
+            entries_.splice(entries_.begin(), entries_, found);
+            if (!salt) {
+                ++found->encryptions;
+            }
+            usedSalt = found->salt;
+            ++hits_;
+            key = found->key;
+        } else {
+            std::vector<uint8_t> entrySalt = salt ? *salt : crypto.randomBytes(container::SALT_SIZE);
+            
+            // Built in place, so the id is never copied out of the arena
+            entries_.emplace_front();
+            Entry& entry = entries_.front();
+            entry.passwordId = id.get();
+            entry.salt = std::move(entrySalt);
+            entry.params = params;
+            entry.expires = now + lifetime_;
+            entry.encryptions = salt ? 0 : 1;
+            entry.serial = serial = ++next_serial_;
+            entry.key = derived.get_future().share();
+            usedSalt = entry.salt;
+            key = entry.key;
+            
+            if (entries_.size() > capacity_) {
+                erase(std::prev(entries_.end()));
+            }
+            ++misses_;
+        }
+    }
+    
+    // Derive outside the lock; other requests for this key wait on the future
+    if (serial != 0) {
+        try {
+            derived.set_value(std::make_shared<const SecureKey>(crypto.deriveKey(password, usedSalt, params)));
+        } catch (...) {
+            derived.set_exception(std::current_exception());
+            
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto failed = std::find_if(entries_.begin(), entries_.end(),
+                                       [serial](const Entry& entry) { return entry.serial == serial; });
+            if (failed != entries_.end()) {
+                erase(failed);
+            }
+        }
+        LOG_EVENT(Info, "Key cache miss", {"cached_keys", size()});
+    }
+    
+    return key.get();
+}
+
+void KeyCache::dropExpired(Clock::time_point now) {
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        auto next = std::next(it);
+        if (it->expires <= now) {
+            erase(it);
+        }
+        it = next;
+    }
+}
+
+void KeyCache::erase(std::list<Entry, secure::SecureAllocator<Entry>>::iterator entry) {
+    secure::wipeMemory(entry->passwordId.data(), entry->passwordId.size());
+    secure::wipe(entry->salt);
+    entries_.erase(entry);
+}
+
+} // namespace crusty
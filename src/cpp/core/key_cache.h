@@ -0,0 +1,159 @@
+#pragma once
+
+#include "encryptor.h"
+#include "secure_arena.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace crusty {
+
+/**
+ * @brief Bounded, time-limited cache of derived file keys
+ * 
+ * Entries are keyed by a password id, the salt and the Argon2id costs, so
+ * a batch of files sharing a password and salt runs the KDF once. The
+ * password id is a cheap Argon2id hash of the password under a random
+ * per-cache salt; neither passwords nor raw keys are stored, and the keys
+ * themselves stay in Rust-owned memory that is zeroized when the last
+ * user releases them.
+ * 
+ * Concurrent requests for the same key wait for one derivation instead of
+ * each running the KDF. All methods are thread-safe.
+ */
+class KeyCache {
+public:
+    /**
+     * @brief Create an empty cache
+     * 
+     * @param capacity Most keys kept; the least recently used is dropped first
+     * @param lifetime How long a key may be reused after it was derived
+     */
+    explicit KeyCache(size_t capacity = DEFAULT_CAPACITY,
+                      std::chrono::seconds lifetime = DEFAULT_LIFETIME);
+    
+    /**
+     * @brief Wipe all cached keys
+     */
+    ~KeyCache();
+    
+    /**
+     * @brief Key for decrypting a file, derived on the first request
+     * 
+     * @param crypto Crypto provider that derives missing keys
+     * @param password Password to derive from
+     * @param salt Salt stored in the file header
+     * @param params Costs stored in the file header
+     * @return Shared key; stays valid after it is evicted
+     * @throws EncryptionException if key derivation fails
+     */
+    std::shared_ptr<const SecureKey> keyFor(
+        const Crypto& crypto,
+        secure::SecureView password,
+        const std::vector<uint8_t>& salt,
+        const KdfParams& params
+    );
+    
+    /**
+     * @brief Key and salt for encrypting a new file
+     * 
+     * Reuses a cached key for the same password and costs, so files
+     * encrypted in one batch share a salt. Each file still gets its own
+     * random nonce prefix; a key is handed out for at most
+     * MAX_FILES_PER_KEY files before a fresh salt is drawn.
+     * 
+     * @param crypto Crypto provider that derives missing keys and salts
+     * @param password Password to derive from
+     * @param params Costs to derive with
+     * @param salt Receives the salt to store in the header
+     * @return Shared key
+     * @throws EncryptionException if key derivation fails
+     */
+    std::shared_ptr<const SecureKey> keyForEncryption(
+        const Crypto& crypto,
+        secure::SecureView password,
+        const KdfParams& params,
+        std::vector<uint8_t>& salt
+    );
+    
+    /**
+     * @brief Drop every cached key
+     */
+    void clear();
+    
+    /**
+     * @return Number of cached keys, including expired ones not yet dropped
+     */
+    size_t size() const;
+    
+    /**
+     * @return Requests answered without running the KDF
+     */
+    uint64_t hits() const;
+    
+    /**
+     * @return Requests that ran the KDF
+     */
+    uint64_t misses() const;
+    
+    // Default limits: a few passwords at once, for the length of a batch
+    static constexpr size_t DEFAULT_CAPACITY = 16;
+    static constexpr std::chrono::seconds DEFAULT_LIFETIME{300};
+    
+    // Files sharing a key tell their nonces apart only by their random
+    // 56-bit prefixes, and two equal prefixes would repeat every chunk's
+    // nonce. At 2^12 files the chance of any two colliding is below 2^-32
+    static constexpr uint64_t MAX_FILES_PER_KEY = 1u << 12;
+    
+    // Prevent copying
+    KeyCache(const KeyCache&) = delete;
+    KeyCache& operator=(const KeyCache&) = delete;
+
+private:
+    using PasswordId = std::array<uint8_t, 32>;
+    using Clock = std::chrono::steady_clock;
+    
+    struct Entry {
+        PasswordId passwordId{};
+        std::vector<uint8_t> salt;
+        KdfParams params;
+        Clock::time_point expires;
+        uint64_t encryptions = 0;
+        uint64_t serial = 0;
+        std::shared_future<std::shared_ptr<const SecureKey>> key;
+    };
+    
+    PasswordId passwordId(secure::SecureView password) const;
+    std::shared_ptr<const SecureKey> lookup(
+        const Crypto& crypto,
+        secure::SecureView password,
+        const std::vector<uint8_t>* salt,
+        const KdfParams& params,
+        std::vector<uint8_t>& usedSalt
+    );
+    
+    // Called with mutex_ held
+    void dropExpired(Clock::time_point now);
+    void erase(std::list<Entry, secure::SecureAllocator<Entry>>::iterator entry);
+    
+    size_t capacity_;
+    std::chrono::seconds lifetime_;
+    std::array<uint8_t, 16> id_salt_{};
+    
+    // Most recently used first; password ids stay in locked memory
+    std::list<Entry, secure::SecureAllocator<Entry>> entries_;
+    uint64_t next_serial_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    
+    mutable std::mutex mutex_;
+};
+
+} // namespace crusty
@@ -0,0 +1,261 @@
+#include "mapped_file.h"
+#include "encryptor.h"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/vfs.h>
+#elif defined(__APPLE__)
+#include <sys/mount.h>
+#endif
+#endif
+
+namespace crusty {
+
+namespace {
+
+[[noreturn]] void ioError(const std::string& message, const std::string& path) {
+#ifdef _WIN32
+    std::string reason = "error " + std::to_string(GetLastError());
+#else
+    std::string reason = std::strerror(errno);
+#endif
+    throw EncryptionException(message + ": " + path + " (" + reason + ")", CryptoErrorCode::IoError);
+}
+
+#if defined(__linux__)
+// File systems where mapping is slow or unsafe (remote, or userspace-backed)
+bool isRemoteFileSystem(long type) {
+    switch (static_cast<unsigned long>(type)) {
+        case 0x6969:      // NFS
+        case 0x517B:      // SMB
+        case 0xFF534D42:  // CIFS
+        case 0xFE534D42:  // SMB2
+        case 0x65735546:  // FUSE
+        case 0x01021997:  // 9P
+        case 0x00C36400:  // Ceph
+        case 0x47504653:  // GPFS
+        case 0x0BD00BD0:  // Lustre
+        case 0x6B414653:  // AFS
+            return true;
+        default:
+            return false;
+    }
+}
+#endif
+
+} // anonymous namespace
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+#ifdef _WIN32
+        std::swap(file_handle_, other.file_handle_);
+        std::swap(mapping_handle_, other.mapping_handle_);
+#else
+        std::swap(fd_, other.fd_);
+#endif
+    }
+    return *this;
+}
+
+bool MappedFile::isMappable(const std::string& path) {
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec) || std::filesystem::file_size(path, ec) == 0 || ec) {
+        return false;
+    }
+
+#ifdef _WIN32
+    std::filesystem::path root = std::filesystem::absolute(path, ec).root_path();
+    return !ec && GetDriveTypeW(root.wstring().c_str()) != DRIVE_REMOTE;
+#elif defined(__linux__)
+    struct statfs info;
+    return statfs(path.c_str(), &info) == 0 && !isRemoteFileSystem(info.f_type);
+#elif defined(__APPLE__)
+    struct statfs info;
+    return statfs(path.c_str(), &info) == 0 && (info.f_flags & MNT_LOCAL) != 0;
+#else
+    return true;
+#endif
+}
+
+#ifdef _WIN32
+
+MappedFile MappedFile::openReadOnly(const std::string& path) {
+    MappedFile file;
+    HANDLE handle = CreateFileW(std::filesystem::path(path).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        ioError("Failed to open file for mapping", path);
+    }
+    file.file_handle_ = handle;
+    
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+        ioError("Failed to map empty or unreadable file", path);
+    }
+    file.size_ = static_cast<uint64_t>(size.QuadPart);
+    
+    file.mapping_handle_ = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (file.mapping_handle_ == nullptr) {
+        ioError("Failed to map file", path);
+    }
+    
+    file.data_ = static_cast<uint8_t*>(MapViewOfFile(file.mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+    if (file.data_ == nullptr) {
+        ioError("Failed to map file", path);
+    }
+    return file;
+}
+
+MappedFile MappedFile::create(const std::string& path, uint64_t size) {
+    MappedFile file;
+    HANDLE handle = CreateFileW(std::filesystem::path(path).wstring().c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                                nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        ioError("Failed to create file for mapping", path);
+    }
+    file.file_handle_ = handle;
+    file.size_ = size;
+    
+    // Mapping a larger size than the file extends it, allocating the space
+    file.mapping_handle_ = CreateFileMappingW(handle, nullptr, PAGE_READWRITE,
+                                              static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+    if (file.mapping_handle_ == nullptr) {
+        ioError("Failed to map file", path);
+    }
+    
+    file.data_ = static_cast<uint8_t*>(MapViewOfFile(file.mapping_handle_, FILE_MAP_WRITE, 0, 0, 0));
+    if (file.data_ == nullptr) {
+        ioError("Failed to map file", path);
+    }
+    return file;
+}
+
+void MappedFile::flush() {
+    if (data_ != nullptr && (!FlushViewOfFile(data_, 0) || !FlushFileBuffers(file_handle_))) {
+        ioError("Failed to flush", "mapped file");
+    }
+}
+
+void MappedFile::close() {
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+        data_ = nullptr;
+    }
+    if (mapping_handle_ != nullptr) {
+        CloseHandle(mapping_handle_);
+        mapping_handle_ = nullptr;
+    }
+    if (file_handle_ != nullptr) {
+        CloseHandle(file_handle_);
+        file_handle_ = nullptr;
+    }
+    size_ = 0;
+}
+
+#else
+
+MappedFile MappedFile::openReadOnly(const std::string& path) {
+    MappedFile file;
+    file.fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file.fd_ < 0) {
+        ioError("Failed to open file for mapping", path);
+    }
+    
+    struct stat info;
+    if (fstat(file.fd_, &info) != 0 || info.st_size == 0) {
+        ioError("Failed to map empty or unreadable file", path);
+    }
+    file.size_ = static_cast<uint64_t>(info.st_size);
+    
+    void* data = mmap(nullptr, file.size_, PROT_READ, MAP_SHARED, file.fd_, 0);
+    if (data == MAP_FAILED) {
+        ioError("Failed to map file", path);
+    }
+    file.data_ = static_cast<uint8_t*>(data);
+    
+    // Chunks are consumed front to back
+    madvise(data, file.size_, MADV_SEQUENTIAL);
+    return file;
+}
+
+MappedFile MappedFile::create(const std::string& path, uint64_t size) {
+    MappedFile file;
+    file.fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (file.fd_ < 0) {
+        ioError("Failed to create file for mapping", path);
+    }
+    file.size_ = size;
+    
+    // Reserve the blocks now: running out of space while storing through a
+    // map raises SIGBUS instead of returning an error
+#if defined(__linux__)
+    int result = posix_fallocate(file.fd_, 0, static_cast<off_t>(size));
+    if (result != 0) {
+        if (result != EOPNOTSUPP && result != EINVAL) {
+            errno = result;
+            ioError("Failed to allocate space for file", path);
+        }
+        if (ftruncate(file.fd_, static_cast<off_t>(size)) != 0) {
+            ioError("Failed to size file", path);
+        }
+    }
+#else
+    if (ftruncate(file.fd_, static_cast<off_t>(size)) != 0) {
+        ioError("Failed to size file", path);
+    }
+#endif
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd_, 0);
+    if (data == MAP_FAILED) {
+        ioError("Failed to map file", path);
+    }
+    file.data_ = static_cast<uint8_t*>(data);
+    return file;
+}
+
+void MappedFile::flush() {
+    if (data_ != nullptr && (msync(data_, size_, MS_SYNC) != 0 || fsync(fd_) != 0)) {
+        ioError("Failed to flush", "mapped file");
+    }
+}
+
+void MappedFile::close() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+}
+
+#endif
+
+} // namespace crusty
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace crusty {
+
+/**
+ * @brief Memory-mapped view of a whole file
+ * 
+ * Read-only maps are used for sources, read-write maps for destinations
+ * whose final size is known up front. Move-only; the mapping is released
+ * when the object is destroyed.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    
+    /**
+     * @brief Map an existing file read-only
+     * 
+     * @param path File to map
+     * @return Mapped file
+     * @throws EncryptionException if the file cannot be opened or mapped
+     */
+    static MappedFile openReadOnly(const std::string& path);
+    
+    /**
+     * @brief Create a file of the given size and map it read-write
+     * 
+     * Disk space is reserved up front where the platform supports it, so
+     * running out of space fails here instead of while writing the map.
+     * 
+     * @param path File to create (truncated if it exists)
+     * @param size Final size in bytes (must be non-zero)
+     * @return Mapped file
+     * @throws EncryptionException if the file cannot be created or mapped
+     */
+    static MappedFile create(const std::string& path, uint64_t size);
+    
+    /**
+     * @brief Check whether a file is a good candidate for mapping
+     * 
+     * True for non-empty regular files on local file systems. Pipes,
+     * devices and network mounts should go through streams instead.
+     * 
+     * @param path File to check
+     * @return True if the file can be mapped
+     */
+    static bool isMappable(const std::string& path);
+    
+    /**
+     * @brief Wait until the mapped data is on stable storage
+     * 
+     * @throws EncryptionException if the data could not be written
+     */
+    void flush();
+    
+    /**
+     * @brief Unmap and close the file
+     */
+    void close();
+    
+    const uint8_t* data() const { return data_; }
+    uint8_t* data() { return data_; }
+    uint64_t size() const { return size_; }
+    
+    // Move only
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+    uint8_t* data_ = nullptr;
+    uint64_t size_ = 0;
+
+#ifdef _WIN32
+    void* file_handle_ = nullptr;
+    void* mapping_handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+} // namespace crusty
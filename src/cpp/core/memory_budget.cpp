@@ -0,0 +1,205 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace crusty {
+
+namespace {
+
+#ifdef __linux__
+const char* const CGROUP_ROOT = "/sys/fs/cgroup";
+
+// First line of a cgroup control file, or empty if it cannot be read
+std::string readControl(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// Value of a cgroup control file; false for "max", -1 and unreadable files
+bool readLimit(const std::string& path, uint64_t& value) {
+    std::string text = readControl(path);
+    if (text.empty() || text[0] < '0' || text[0] > '9') {
+        return false;
+    }
+    try {
+        value = std::stoull(text);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// The process's cgroup v2 directory and its ancestors, innermost first; a
+// limit set on any of them applies
+std::vector<std::string> cgroupV2Dirs() {
+    std::ifstream file("/proc/self/cgroup");
+    std::string line;
+    std::string path;
+    while (std::getline(file, line)) {
+        if (line.rfind("0::", 0) == 0) {
+            path = line.substr(3);
+            break;
+        }
+    }
+    
+    std::vector<std::string> dirs;
+    while (!path.empty() && path != "/") {
+        dirs.push_back(CGROUP_ROOT + path);
+        path.erase(path.find_last_of('/'));
+    }
+    // In a container's own cgroup namespace the root is the container
+    dirs.push_back(CGROUP_ROOT);
+    return dirs;
+}
+
+uint64_t cgroupMemoryLimit() {
+    uint64_t limit = std::numeric_limits<uint64_t>::max();
+    for (const std::string& dir : cgroupV2Dirs()) {
+        uint64_t value = 0;
+        if (readLimit(dir + "/memory.max", value)) {
+            limit = std::min(limit, value);
+        }
+    }
+    uint64_t value = 0;
+    if (readLimit(std::string(CGROUP_ROOT) + "/memory/memory.limit_in_bytes", value)) {
+        limit = std::min(limit, value);
+    }
+    return limit;
+}
+
+// CPU quota as quota / period, or 0 without one
+double cgroupCpuLimit() {
+    double limit = 0;
+    auto lower = [&limit](double cpus) {
+        if (cpus > 0 && (limit == 0 || cpus < limit)) {
+            limit = cpus;
+        }
+    };
+    
+    for (const std::string& dir : cgroupV2Dirs()) {
+        // "<quota> <period>", or "max <period>" without a quota
+        std::string text = readControl(dir + "/cpu.max");
+        size_t space = text.find(' ');
+        if (space == std::string::npos || text.compare(0, space, "max") == 0) {
+            continue;
+        }
+        try {
+            lower(std::stod(text.substr(0, space)) / std::stod(text.substr(space + 1)));
+        } catch (const std::exception&) {
+        }
+    }
+    
+    uint64_t quota = 0;
+    uint64_t period = 0;
+    if (readLimit(std::string(CGROUP_ROOT) + "/cpu/cpu.cfs_quota_us", quota) &&
+        readLimit(std::string(CGROUP_ROOT) + "/cpu/cpu.cfs_period_us", period) && period > 0) {
+        lower(static_cast<double>(quota) / static_cast<double>(period));
+    }
+    return limit;
+}
+#endif
+
+uint64_t physicalMemory() {
+#ifdef _WIN32
+    MEMORYSTATUSEX status{};
+    status.dwLength = sizeof(status);
+    return GlobalMemoryStatusEx(&status) ? status.ullTotalPhys : 0;
+#else
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return pages > 0 && pageSize > 0 ? static_cast<uint64_t>(pages) * static_cast<uint64_t>(pageSize) : 0;
+#endif
+}
+
+} // anonymous namespace
+
+MemoryBudget::MemoryBudget(size_t bytes)
+    : limit_(std::max(bytes, MIN_BYTES)) {
+}
+
+size_t MemoryBudget::detectMemoryLimit() {
+    uint64_t limit = physicalMemory();
+#ifdef __linux__
+    uint64_t cgroup = cgroupMemoryLimit();
+    if (limit == 0 || cgroup < limit) {
+        limit = cgroup == std::numeric_limits<uint64_t>::max() ? 0 : cgroup;
+    }
+#endif
+    return static_cast<size_t>(std::min<uint64_t>(limit, std::numeric_limits<size_t>::max()));
+}
+
+size_t MemoryBudget::detectCpuLimit() {
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+#ifdef __linux__
+    double quota = cgroupCpuLimit();
+    if (quota > 0) {
+        // A quota of 1.5 CPUs still keeps two threads busy part of the time
+        cpus = std::min(cpus, std::max<size_t>(1, static_cast<size_t>(quota + 0.999)));
+    }
+#endif
+    return cpus;
+}
+
+MemoryPlan MemoryBudget::plan(size_t workers) const {
+    MemoryPlan plan;
+    plan.workers = workers > 0 ? workers : detectCpuLimit();
+    
+    // Two chunks in flight per worker, plus the one read and the one written
+    auto frames = [](size_t count) { return 2 * count + 2; };
+    size_t perFrame = chunkBytes() / frames(plan.workers);
+    if (perFrame < MIN_PLANNED_CHUNK_SIZE) {
+        plan.chunkSize = MIN_PLANNED_CHUNK_SIZE;
+        size_t fitting = chunkBytes() / MIN_PLANNED_CHUNK_SIZE;
+        plan.workers = std::max<size_t>(1, fitting > 2 ? (fitting - 2) / 2 : 1);
+        return plan;
+    }
+    
+    plan.chunkSize = MIN_PLANNED_CHUNK_SIZE;
+    while (plan.chunkSize < MAX_PLANNED_CHUNK_SIZE && plan.chunkSize * 2 <= perFrame) {
+        plan.chunkSize *= 2;
+    }
+    return plan;
+}
+
+bool MemoryBudget::tryReserve(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (reserved_ > 0 && bytes > chunkBytes() - std::min(reserved_, chunkBytes())) {
+        return false;
+    }
+    reserved_ += bytes;
+    peak_ = std::max(peak_, reserved_);
+    return true;
+}
+
+void MemoryBudget::release(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reserved_ -= std::min(bytes, reserved_);
+}
+
+size_t MemoryBudget::reservedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reserved_;
+}
+
+size_t MemoryBudget::peakReservedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_;
+}
+
+} // namespace crusty
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace crusty {
+
+/**
+ * @brief Chunk size and worker count that fit a memory budget
+ */
+struct MemoryPlan {
+    size_t chunkSize = 0;
+    size_t workers = 1;
+};
+
+/**
+ * @brief Upper bound on the chunk memory of one or more engines
+ * 
+ * A quarter of the budget is for the buffer pools to keep for reuse; the
+ * rest is shared by the chunks in flight of every pipeline using the
+ * budget. A pipeline reserves each chunk's buffer before queueing it and
+ * releases it once the chunk's buffer is recycled, so a producer that
+ * would go over the budget blocks until other chunks are written instead
+ * of allocating more. Argon2id's working memory (KdfParams::memoryKib per
+ * key derivation) and the buffers of the stream classes come on top.
+ * 
+ * All methods are thread-safe.
+ */
+class MemoryBudget {
+public:
+    /**
+     * @brief Create a budget
+     * 
+     * @param bytes Limit in bytes; at least MIN_BYTES
+     */
+    explicit MemoryBudget(size_t bytes);
+    
+    /**
+     * @brief Memory available to this process
+     * 
+     * The smallest of the cgroup memory limit (v2 memory.max or v1
+     * memory.limit_in_bytes) and physical memory.
+     * 
+     * @return Bytes, or 0 if neither could be determined
+     */
+    static size_t detectMemoryLimit();
+    
+    /**
+     * @brief CPUs this process may use
+     * 
+     * The hardware thread count, lowered to the cgroup CPU quota (v2
+     * cpu.max or v1 cpu.cfs_quota_us), rounded up.
+     * 
+     * @return At least 1
+     */
+    static size_t detectCpuLimit();
+    
+    /**
+     * @return Limit in bytes
+     */
+    size_t limit() const { return limit_; }
+    
+    /**
+     * @return Bytes buffer pools may keep for reuse
+     */
+    size_t poolBytes() const { return limit_ / 4; }
+    
+    /**
+     * @return Bytes shared by chunks in flight
+     */
+    size_t chunkBytes() const { return limit_ - poolBytes(); }
+    
+    /**
+     * @brief Chunk size and worker count whose chunks in flight fit
+     * 
+     * Each worker is given two chunks in flight, the pipelines' default,
+     * plus two for the chunks being read and written. The chunk size is
+     * the largest power of two up to MAX_PLANNED_CHUNK_SIZE that fits;
+     * below MIN_PLANNED_CHUNK_SIZE, workers are dropped instead.
+     * 
+     * @param workers Workers wanted, or 0 for detectCpuLimit()
+     * @return Plan for one engine using the whole budget
+     */
+    MemoryPlan plan(size_t workers = 0) const;
+    
+    /**
+     * @brief Reserve bytes for a chunk without waiting
+     * 
+     * Succeeds whenever nothing is reserved, so a chunk larger than the
+     * budget can still go through on its own.
+     * 
+     * @param bytes Bytes to reserve
+     * @return True if the bytes were reserved
+     */
+    bool tryReserve(size_t bytes);
+    
+    /**
+     * @brief Return bytes taken with tryReserve()
+     * 
+     * @param bytes Bytes to return
+     */
+    void release(size_t bytes);
+    
+    /**
+     * @return Bytes currently reserved
+     */
+    size_t reservedBytes() const;
+    
+    /**
+     * @return Most bytes reserved at any one time
+     */
+    size_t peakReservedBytes() const;
+    
+    // Smallest budget accepted (4 MB)
+    static constexpr size_t MIN_BYTES = 4 * 1024 * 1024;
+    
+    // Chunk sizes plan() picks from; the upper end is the engine default
+    static constexpr size_t MIN_PLANNED_CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t MAX_PLANNED_CHUNK_SIZE = 8 * 1024 * 1024;
+    
+    // Prevent copying
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+private:
+    size_t limit_;
+    size_t reserved_ = 0;
+    size_t peak_ = 0;
+    mutable std::mutex mutex_;
+};
+
+} // namespace crusty
@@ -0,0 +1,317 @@
+#include "output_file.h"
+#include "file_operations.h"
+#include "audit_log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <random>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace crusty {
+
+namespace {
+
+// Hex digits of a temporary file's random suffix
+constexpr size_t TEMPORARY_SUFFIX_DIGITS = 16;
+constexpr const char* TEMPORARY_EXTENSION = ".tmp";
+
+// Hidden, in the destination's directory so the rename stays on one file system
+std::string temporaryPathFor(const std::string& finalPath) {
+    static thread_local std::mt19937_64 generator{std::random_device{}()};
+    char suffix[TEMPORARY_SUFFIX_DIGITS + 1];
+    std::snprintf(suffix, sizeof(suffix), "%016llx", static_cast<unsigned long long>(generator()));
+    
+    std::filesystem::path path(finalPath);
+    std::string name = "." + path.filename().string() + "." + suffix + TEMPORARY_EXTENSION;
+    return (path.parent_path() / name).string();
+}
+
+std::string parentDirectory(const std::string& path) {
+    return std::filesystem::path(path).parent_path().string();
+}
+
+// Cleanup after a failure must not hide the failure itself
+void discard(const FileSystem& fileSystem, const std::string& path) {
+    try {
+        fileSystem.removeFile(path);
+    } catch (...) {
+    }
+}
+
+// Largest suffix worth parsing; longer digit runs are not ours
+constexpr size_t MAX_SUFFIX_DIGITS = 18;
+
+std::string familyKey(const std::string& stem, const std::string& extension) {
+    // '/' cannot appear in a file name
+    return stem + '/' + extension;
+}
+
+// Creates an empty file unless something already has the name
+bool createExclusive(const std::string& path) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(std::filesystem::path(path).wstring().c_str(), GENERIC_WRITE, 0, nullptr,
+                                CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+        return true;
+    }
+    DWORD error = GetLastError();
+    if (error == ERROR_FILE_EXISTS || error == ERROR_ALREADY_EXISTS) {
+        return false;
+    }
+    std::string reason = "error " + std::to_string(error);
+    bool denied = error == ERROR_ACCESS_DENIED;
+#else
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd >= 0) {
+        ::close(fd);
+        return true;
+    }
+    if (errno == EEXIST) {
+        return false;
+    }
+    std::string reason = std::strerror(errno);
+    bool denied = errno == EACCES || errno == EPERM;
+#endif
+    std::string errorMsg = "Failed to create file: " + path + " (" + reason + ")";
+    LOG_ERROR(errorMsg);
+    throw FileOperationException(errorMsg,
+                                 denied ? FileOperationException::ErrorCode::AccessDenied
+                                        : FileOperationException::ErrorCode::IoError,
+                                 path);
+}
+
+} // anonymous namespace
+
+AtomicOutput::AtomicOutput(const FileSystem& fileSystem, std::string finalPath)
+    : file_system_(fileSystem),
+      final_path_(std::move(finalPath)),
+      temp_path_(temporaryPathFor(final_path_)) {
+    std::string parent = parentDirectory(final_path_);
+    if (!parent.empty()) {
+        file_system_.createDirectories(parent);
+    }
+}
+
+AtomicOutput::~AtomicOutput() {
+    if (!done_) {
+        discard(file_system_, temp_path_);
+    }
+}
+
+bool AtomicOutput::isTemporaryPath(const std::string& path) {
+    std::string name = std::filesystem::path(path).filename().string();
+    size_t extensionLength = std::char_traits<char>::length(TEMPORARY_EXTENSION);
+    // "." + at least one character + "." + suffix + extension
+    if (name.size() < 3 + TEMPORARY_SUFFIX_DIGITS + extensionLength || name[0] != '.' ||
+        name.compare(name.size() - extensionLength, extensionLength, TEMPORARY_EXTENSION) != 0) {
+        return false;
+    }
+    size_t suffixStart = name.size() - extensionLength - TEMPORARY_SUFFIX_DIGITS;
+    if (name[suffixStart - 1] != '.') {
+        return false;
+    }
+    return std::all_of(name.begin() + suffixStart, name.end() - extensionLength,
+                       [](char c) { return std::isxdigit(static_cast<unsigned char>(c)) != 0; });
+}
+
+void AtomicOutput::commit(bool syncDirectory) {
+    file_system_.renameFile(temp_path_, final_path_);
+    done_ = true;
+    if (syncDirectory) {
+        file_system_.syncDirectory(parentDirectory(final_path_));
+    }
+}
+
+SyncGroup::SyncGroup(std::shared_ptr<FileSystem> fileSystem, size_t maxPending)
+    : file_system_(std::move(fileSystem)),
+      max_pending_(std::max<size_t>(1, maxPending)) {
+}
+
+SyncGroup::~SyncGroup() {
+    for (Entry& entry : pending_) {
+        entry.writer.reset();
+        discard(*file_system_, entry.tempPath);
+    }
+    if (!pending_.empty()) {
+        LOG_EVENT(Warning, "Discarded uncommitted output files", {"files", pending_.size()});
+    }
+}
+
+void SyncGroup::add(std::unique_ptr<FileWriter> writer, AtomicOutput& output) {
+    if (writer) {
+        writer->startSync();
+    }
+    
+    std::vector<Entry> full;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back(Entry{std::move(writer), output.tempPath(), output.finalPath()});
+        output.release();
+        if (pending_.size() >= max_pending_) {
+            full.swap(pending_);
+        }
+    }
+    
+    if (!full.empty()) {
+        commitEntries(std::move(full));
+    }
+}
+
+std::vector<SyncGroup::Failure> SyncGroup::commit() {
+    std::vector<Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries.swap(pending_);
+    }
+    commitEntries(std::move(entries));
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Failure> failures;
+    failures.swap(failures_);
+    return failures;
+}
+
+size_t SyncGroup::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+void SyncGroup::commitEntries(std::vector<Entry> entries) {
+    if (entries.empty()) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> commitLock(commit_mutex_);
+    std::vector<Failure> failures;
+    
+    // Write-back of every file was started when it was added, so these
+    // mostly wait for the last few blocks and one journal commit
+    std::map<std::string, std::vector<std::string>> directories;
+    for (Entry& entry : entries) {
+        try {
+            if (entry.writer) {
+                entry.writer->sync();
+                entry.writer->close();
+                entry.writer.reset();
+            }
+            file_system_->renameFile(entry.tempPath, entry.finalPath);
+            directories[parentDirectory(entry.finalPath)].push_back(entry.finalPath);
+        } catch (const std::exception& e) {
+            failures.push_back(Failure{entry.finalPath, e.what()});
+            entry.writer.reset();
+            discard(*file_system_, entry.tempPath);
+        }
+    }
+    
+    for (const auto& [directory, paths] : directories) {
+        try {
+            file_system_->syncDirectory(directory);
+        } catch (const std::exception& e) {
+            // The files are in place but might not survive a crash
+            for (const std::string& path : paths) {
+                failures.push_back(Failure{path, e.what()});
+            }
+        }
+    }
+    
+    LOG_EVENT(Info, "Output files committed",
+              {"files", entries.size() - failures.size()},
+              {"directories", directories.size()},
+              {"failed", failures.size()});
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    failures_.insert(failures_.end(), failures.begin(), failures.end());
+}
+
+UniqueNameAllocator::UniqueNameAllocator(std::string directory) : directory_(std::move(directory)) {
+    std::error_code ec;
+    std::filesystem::path listed = directory_.empty() ? std::filesystem::path(".") : std::filesystem::path(directory_);
+    std::filesystem::directory_iterator it(listed, ec);
+    if (ec == std::errc::no_such_file_or_directory) {
+        return;
+    }
+    
+    for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        addExisting(it->path().filename().string());
+    }
+    if (ec) {
+        std::string errorMsg = "Failed to read directory: " + directory_ + " (" + ec.message() + ")";
+        LOG_ERROR(errorMsg);
+        throw FileOperationException(errorMsg, FileOperationException::ErrorCode::IoError, directory_);
+    }
+}
+
+std::string UniqueNameAllocator::reserve(std::string_view fileName) {
+    while (true) {
+        std::string path = nextPath(fileName);
+        if (createExclusive(path)) {
+            return path;
+        }
+        // Taken by someone else since the listing; nextPath() now skips it
+    }
+}
+
+std::string UniqueNameAllocator::claim(std::string_view fileName) {
+    return nextPath(fileName);
+}
+
+void UniqueNameAllocator::addExisting(const std::string& fileName) {
+    std::filesystem::path name(fileName);
+    std::string stem = name.stem().string();
+    std::string extension = name.extension().string();
+    families_[familyKey(stem, extension)].taken.insert(0);
+    
+    // "stem_N" also takes suffix N of "stem"; "stem_01" is never generated
+    size_t separator = stem.rfind('_');
+    if (separator == std::string::npos || separator == 0) {
+        return;
+    }
+    std::string digits = stem.substr(separator + 1);
+    if (digits.empty() || digits.size() > MAX_SUFFIX_DIGITS || digits[0] == '0' ||
+        !std::all_of(digits.begin(), digits.end(), [](unsigned char c) { return c >= '0' && c <= '9'; })) {
+        return;
+    }
+    families_[familyKey(stem.substr(0, separator), extension)].taken.insert(std::stoull(digits));
+}
+
+std::string UniqueNameAllocator::nextPath(std::string_view fileName) {
+    std::filesystem::path name(fileName);
+    std::string stem = name.stem().string();
+    std::string extension = name.extension().string();
+    
+    uint64_t suffix;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Family& family = families_[familyKey(stem, extension)];
+        while (family.taken.count(family.next) != 0) {
+            ++family.next;
+        }
+        suffix = family.next;
+        family.taken.insert(suffix);
+        
+        // "stem_N" is also the plain name of its own family
+        if (suffix != 0) {
+            families_[familyKey(stem + "_" + std::to_string(suffix), extension)].taken.insert(0);
+        }
+    }
+    
+    std::string chosen = suffix == 0 ? std::string(fileName) : stem + "_" + std::to_string(suffix) + extension;
+    return directory_.empty() ? chosen : (std::filesystem::path(directory_) / chosen).string();
+}
+
+} // namespace crusty
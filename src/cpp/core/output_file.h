@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace crusty {
+
+class FileSystem;
+class FileWriter;
+
+/**
+ * When finished output files are made durable
+ */
+enum class OutputSync {
+    None,     // Renamed into place; the kernel writes them back in its own time
+    PerFile,  // Synced, renamed and the directory synced before each operation returns
+    Grouped   // Handed to a SyncGroup, which syncs and renames many files together
+};
+
+/**
+ * @brief Destination written under a temporary name in its own directory
+ * 
+ * The temporary file is renamed over the final path by commit(), which is
+ * atomic on local file systems, so readers and a crash see either no file
+ * or the complete one, never a partial one. A file that is not committed
+ * or handed to a SyncGroup is removed when the object is destroyed.
+ */
+class AtomicOutput {
+public:
+    /**
+     * @brief Pick a temporary name next to the destination
+     * 
+     * Creates the destination's parent directories; the temporary file
+     * itself is created by whoever writes it.
+     * 
+     * @param fileSystem Backend of the destination
+     * @param finalPath Destination path
+     * @throws FileOperationException if the directories cannot be created
+     */
+    AtomicOutput(const FileSystem& fileSystem, std::string finalPath);
+    ~AtomicOutput();
+    
+    /**
+     * @return Path to write the data to
+     */
+    const std::string& tempPath() const { return temp_path_; }
+    
+    /**
+     * @return Path the file is renamed to
+     */
+    const std::string& finalPath() const { return final_path_; }
+    
+    /**
+     * @brief Rename the written file into place
+     * 
+     * @param syncDirectory True to also make the rename durable
+     * @throws FileOperationException if the rename fails
+     */
+    void commit(bool syncDirectory);
+    
+    /**
+     * @brief Give up ownership of the temporary file, for a SyncGroup
+     */
+    void release() { done_ = true; }
+    
+    /**
+     * @brief Whether a path has the form of an AtomicOutput temporary file
+     * 
+     * For directory scans that run while outputs are being written, and
+     * that must not pick up half-written files.
+     * 
+     * @param path Path to check
+     * @return True for hidden names ending in a 16-digit suffix and ".tmp"
+     */
+    static bool isTemporaryPath(const std::string& path);
+    
+    // Prevent copying
+    AtomicOutput(const AtomicOutput&) = delete;
+    AtomicOutput& operator=(const AtomicOutput&) = delete;
+
+private:
+    const FileSystem& file_system_;
+    std::string final_path_;
+    std::string temp_path_;
+    bool done_ = false;
+};
+
+/**
+ * @brief Output files made durable and renamed into place together
+ * 
+ * A batch that syncs every file as it finishes waits for the disk once per
+ * file, plus once per rename for the directory. A group instead keeps the
+ * finished files open under their temporary names while the kernel writes
+ * them back in the background; commit() then syncs them, by which time
+ * little is left to write, renames them and syncs each directory once.
+ * Files are only renamed after their data is durable, so a crash never
+ * leaves a truncated file under a final name.
+ * 
+ * Every pending file holds a descriptor, so the group commits by itself
+ * once maxPending files are waiting. Safe to use from several threads.
+ */
+class SyncGroup {
+public:
+    /**
+     * @brief A file that could not be stored
+     */
+    struct Failure {
+        std::string path;   // Final path
+        std::string error;
+    };
+    
+    /**
+     * @param fileSystem Backend of every file added
+     * @param maxPending Files held open before committing early (at least 1)
+     */
+    explicit SyncGroup(std::shared_ptr<FileSystem> fileSystem, size_t maxPending = DEFAULT_MAX_PENDING);
+    
+    /**
+     * Discards files that were never committed
+     */
+    ~SyncGroup();
+    
+    /**
+     * @brief Hand over a finished file
+     * 
+     * @param writer Open writer of the temporary file, or null if its data
+     *               is already durable
+     * @param output Names of the file, released from its AtomicOutput
+     */
+    void add(std::unique_ptr<FileWriter> writer, AtomicOutput& output);
+    
+    /**
+     * @brief Sync and rename every pending file
+     * 
+     * A file that fails is removed and reported; the others are still
+     * committed.
+     * 
+     * @return Files that failed since the last call, including those of
+     *         early commits
+     */
+    std::vector<Failure> commit();
+    
+    /**
+     * @return Files waiting for commit()
+     */
+    size_t pending() const;
+    
+    // Enough to cover the disk's write-back latency without nearing descriptor limits
+    static constexpr size_t DEFAULT_MAX_PENDING = 64;
+    
+    // Prevent copying
+    SyncGroup(const SyncGroup&) = delete;
+    SyncGroup& operator=(const SyncGroup&) = delete;
+
+private:
+    struct Entry {
+        std::unique_ptr<FileWriter> writer;
+        std::string tempPath;
+        std::string finalPath;
+    };
+    
+    void commitEntries(std::vector<Entry> entries);
+    
+    std::shared_ptr<FileSystem> file_system_;
+    size_t max_pending_;
+    
+    mutable std::mutex mutex_;
+    std::vector<Entry> pending_;
+    std::vector<Failure> failures_;
+    
+    // Serializes commits, so an early one and commit() do not interleave
+    std::mutex commit_mutex_;
+};
+
+/**
+ * @brief Hands out unused file names in one directory
+ * 
+ * Probing "name_1", "name_2", ... costs one stat per name already taken,
+ * so giving n outputs the same name costs O(n^2) calls. An allocator lists
+ * the directory once and keeps, for every stem and extension, the numbered
+ * suffixes in use and the lowest one that may be free, so each name after
+ * that costs one exclusive create at most.
+ * 
+ * Names follow PathUtils::ensureUniqueFilePath(): "report.pdf", then
+ * "report_1.pdf", "report_2.pdf" and so on. Safe to use from several
+ * threads; a name is never handed out twice.
+ */
+class UniqueNameAllocator {
+public:
+    /**
+     * @brief List the directory's current entries
+     * 
+     * @param directory Directory the names are for; a missing one counts as empty
+     * @throws FileOperationException if the directory cannot be read
+     */
+    explicit UniqueNameAllocator(std::string directory);
+    
+    /**
+     * @brief Take a free name by creating an empty file under it
+     * 
+     * The file is created exclusively (O_EXCL, CREATE_NEW), so names taken
+     * by other processes since the listing are skipped, never overwritten.
+     * 
+     * @param fileName Preferred file name, without a directory
+     * @return Path of the created file
+     * @throws FileOperationException if the file cannot be created
+     */
+    std::string reserve(std::string_view fileName);
+    
+    /**
+     * @brief Take a name that was free when the directory was listed
+     * 
+     * Creates nothing, for callers whose own create refuses existing files.
+     * 
+     * @param fileName Preferred file name, without a directory
+     * @return Path for the file
+     */
+    std::string claim(std::string_view fileName);
+    
+    /**
+     * @return Directory the names are in
+     */
+    const std::string& directory() const { return directory_; }
+
+private:
+    // Suffixes in use for one stem and extension; 0 is the plain name
+    struct Family {
+        std::unordered_set<uint64_t> taken;
+        uint64_t next = 0;
+    };
+    
+    void addExisting(const std::string& fileName);
+    std::string nextPath(std::string_view fileName);
+    
+    std::string directory_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Family> families_;
+};
+
+} // namespace crusty
@@ -6,6 +6,11 @@
 #include <stdexcept>
 #include <vector>
 #include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+#include "output_file.h"
+#include "trace.h"
 
 namespace crusty {
 
@@ -26,6 +31,7 @@ public:
      * @throws std::runtime_error if path is invalid or escapes from base directory
      */
     static std::string sanitizePath(std::string_view path, std::string_view baseDir = "") {
+        TRACE_SPAN("path.sanitize");
         try {
             // Convert to canonical form (resolves "..", ".", and symlinks)
             std::filesystem::path canonicalPath = std::filesystem::weakly_canonical(path);
@@ -35,12 +41,7 @@ public:
                 std::filesystem::path canonicalBaseDir = std::filesystem::weakly_canonical(baseDir);
                 
                 // Check if the path is within the base directory
-                auto baseDirStr = canonicalBaseDir.string();
-                auto pathStr = canonicalPath.string();
-                
-                // Path must start with the base directory
-                if (pathStr.length() < baseDirStr.length() || 
-                    pathStr.substr(0, baseDirStr.length()) != baseDirStr) {
+                if (!isWithin(canonicalPath, canonicalBaseDir)) {
                     throw std::runtime_error("Path escapes from the allowed directory");
                 }
             }
@@ -51,6 +52,22 @@ public:
         }
     }
     
+    /**
+     * @brief Check whether a resolved path lies inside a resolved directory
+     * 
+     * Compares whole components, so "/data/base2" is not inside "/data/base".
+     * 
+     * @param path Canonical path to check
+     * @param baseDir Canonical base directory
+     * @return True if path is baseDir or below it
+     */
+    static bool isWithin(const std::filesystem::path& path, const std::filesystem::path& baseDir) {
+        auto [baseIt, pathIt] = std::mismatch(baseDir.begin(), baseDir.end(), path.begin(), path.end());
+        
+        // A trailing separator leaves an empty last component
+        return baseIt == baseDir.end() || (baseIt->empty() && std::next(baseIt) == baseDir.end());
+    }
+    
     /**
      * @brief Check if a file path has a safe extension
      * 
@@ -80,6 +97,10 @@ public:
     /**
      * @brief Create a unique file path if the original already exists
      * 
+     * Lists the directory once instead of probing every numbered name.
+     * Nothing is created, so another writer may still take the name; to
+     * name many files in one directory, keep a UniqueNameAllocator.
+     * 
      * @param basePath Base path to check
      * @return Unique path with numbered suffix if needed
      */
@@ -90,20 +111,7 @@ public:
             return std::string(basePath);
         }
         
-        std::filesystem::path parentPath = path.parent_path();
-        std::filesystem::path stem = path.stem();
-        std::filesystem::path extension = path.extension();
-        
-        int counter = 1;
-        std::filesystem::path newPath;
-        
-        do {
-            std::string newName = stem.string() + "_" + std::to_string(counter) + extension.string();
-            newPath = parentPath / newName;
-            counter++;
-        } while (std::filesystem::exists(newPath));
-        
-        return newPath.string();
+        return UniqueNameAllocator(path.parent_path().string()).claim(path.filename().string());
     }
     
     /**
@@ -134,4 +142,120 @@ public:
     }
 };
 
+/**
+ * @brief Path sanitizer that remembers the directories it resolved
+ * 
+ * PathUtils::sanitizePath() resolves every component of every path, one
+ * stat or readlink each. A resolver canonicalizes its base directory once
+ * and each distinct parent directory once, then appends file names to the
+ * cached parent lexically. Only names that could change the result, "."
+ * and ".." anywhere in the path or a symbolic link as the last component,
+ * take the full resolution, so results and escape detection match
+ * sanitizePath(), except that results are always absolute.
+ * 
+ * The cache assumes directories are not replaced while it is in use, so
+ * keep a resolver for one batch or one selection, not for the whole
+ * process. Thread-safe.
+ */
+class PathResolver {
+public:
+    /**
+     * @param baseDir Optional base directory that every path must be within
+     * @throws std::runtime_error if the base directory is invalid
+     */
+    explicit PathResolver(std::string_view baseDir = "") {
+        if (!baseDir.empty()) {
+            try {
+                base_dir_ = std::filesystem::weakly_canonical(baseDir);
+            } catch (const std::filesystem::filesystem_error& e) {
+                throw std::runtime_error(std::string("Invalid path: ") + e.what());
+            }
+        }
+    }
+    
+    /**
+     * @brief Sanitize a path like PathUtils::sanitizePath()
+     * 
+     * @param path Path to sanitize
+     * @return Sanitized absolute path
+     * @throws std::runtime_error if path is invalid or escapes from the base directory
+     */
+    std::string resolve(std::string_view path) {
+        try {
+            std::filesystem::path input = std::filesystem::absolute(path);
+            std::filesystem::path name = input.filename();
+            
+            bool lexical = !name.empty() &&
+                std::none_of(input.begin(), input.end(), [](const std::filesystem::path& part) {
+                    return part == "." || part == "..";
+                });
+            
+            std::filesystem::path resolved;
+            if (lexical) {
+                resolved = canonicalDirectory(input.parent_path()) / name;
+                
+                // A link may point anywhere, so follow it like sanitizePath does
+                std::error_code ec;
+                if (std::filesystem::is_symlink(std::filesystem::symlink_status(resolved, ec))) {
+                    resolved = std::filesystem::weakly_canonical(resolved);
+                }
+            } else {
+                resolved = std::filesystem::weakly_canonical(input);
+            }
+            
+            if (!base_dir_.empty() && !PathUtils::isWithin(resolved, base_dir_)) {
+                throw std::runtime_error("Path escapes from the allowed directory");
+            }
+            return resolved.string();
+        } catch (const std::filesystem::filesystem_error& e) {
+            throw std::runtime_error(std::string("Invalid path: ") + e.what());
+        }
+    }
+    
+    /**
+     * @brief Forget every resolved directory
+     */
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        directories_.clear();
+    }
+    
+    /**
+     * @return Directories currently cached
+     */
+    size_t cachedDirectories() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return directories_.size();
+    }
+    
+    // Enough for a deep tree; the cache starts over when it is full
+    static constexpr size_t MAX_CACHED_DIRECTORIES = 4096;
+
+private:
+    std::filesystem::path canonicalDirectory(const std::filesystem::path& directory) {
+        std::string key = directory.string();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = directories_.find(key);
+            if (it != directories_.end()) {
+                return it->second;
+            }
+        }
+        
+        // Resolved outside the lock; two threads may race to store the same result
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(directory);
+        
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (directories_.size() >= MAX_CACHED_DIRECTORIES) {
+            directories_.clear();
+        }
+        directories_.emplace(std::move(key), canonical);
+        return canonical;
+    }
+    
+    std::filesystem::path base_dir_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::filesystem::path> directories_;
+};
+
 } // namespace crusty
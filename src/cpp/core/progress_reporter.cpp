@@ -0,0 +1,121 @@
+#include "progress_reporter.h"
+#include "audit_log.h"
+
+#include <algorithm>
+#include <exception>
+#include <string>
+
+namespace crusty {
+
+namespace {
+
+// Weight of the newest interval in the smoothed rate
+constexpr double RATE_SMOOTHING = 0.3;
+
+} // anonymous namespace
+
+ProgressReporter::ProgressReporter(DetailedProgressCallback callback, const ProgressSettings& settings,
+                                   uint64_t totalBytes)
+    : callback_(std::move(callback)),
+      settings_(settings),
+      start_(Clock::now()),
+      total_bytes_(totalBytes),
+      last_sample_(start_) {
+    if (callback_) {
+        timer_ = std::thread([this]() { timerLoop(); });
+    }
+}
+
+ProgressReporter::~ProgressReporter() {
+    stop();
+}
+
+void ProgressReporter::finish() {
+    stop();
+    if (callback_) {
+        sample(true);
+    }
+}
+
+void ProgressReporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    
+    if (timer_.joinable()) {
+        timer_.join();
+    }
+}
+
+void ProgressReporter::timerLoop() {
+    auto interval = std::max(settings_.minInterval, std::chrono::milliseconds(1));
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!condition_.wait_for(lock, interval, [this]() { return stopping_; })) {
+        lock.unlock();
+        try {
+            sample(false);
+        } catch (const std::exception& e) {
+            // Nobody can catch it on this thread; the operation itself goes on
+            LOG_EVENT(Warning, "Progress callback failed, no further updates", {"error", std::string(e.what())});
+            return;
+        } catch (...) {
+            LOG_WARNING("Progress callback failed, no further updates");
+            return;
+        }
+        lock.lock();
+    }
+}
+
+void ProgressReporter::sample(bool finished) {
+    Clock::time_point now = Clock::now();
+    uint64_t done = bytes_done_.load(std::memory_order_relaxed);
+    uint64_t total = total_bytes_.load(std::memory_order_relaxed);
+    
+    // Smooth the rate so one slow chunk does not make the ETA jump
+    double seconds = std::chrono::duration<double>(now - last_sample_).count();
+    if (seconds > 0.0) {
+        double rate = static_cast<double>(done - last_sample_bytes_) / seconds;
+        last_.bytesPerSecond = last_.bytesPerSecond > 0.0
+            ? RATE_SMOOTHING * rate + (1.0 - RATE_SMOOTHING) * last_.bytesPerSecond
+            : rate;
+    }
+    last_sample_ = now;
+    last_sample_bytes_ = done;
+    
+    ProgressInfo info = last_;
+    info.bytesDone = done;
+    info.totalBytes = total;
+    info.finished = finished;
+    if (finished) {
+        info.fraction = 1.0f;
+        info.eta = std::chrono::milliseconds(0);
+        double elapsed = std::chrono::duration<double>(now - start_).count();
+        if (elapsed > 0.0) {
+            info.bytesPerSecond = static_cast<double>(done) / elapsed;
+        }
+    } else {
+        if (total > 0) {
+            info.fraction = std::min(1.0f, static_cast<float>(static_cast<double>(done) / static_cast<double>(total)));
+        }
+        
+        // Nothing moved, or not enough to be worth an update
+        if (done == last_.bytesDone ||
+            (total > 0 && delivered_ && info.fraction - last_.fraction < settings_.minDelta)) {
+            return;
+        }
+        
+        info.eta = std::chrono::milliseconds(-1);
+        if (total > done && info.bytesPerSecond > 0.0) {
+            info.eta = std::chrono::milliseconds(static_cast<int64_t>(
+                static_cast<double>(total - done) / info.bytesPerSecond * 1000.0));
+        }
+    }
+    
+    last_ = info;
+    delivered_ = true;
+    callback_(info);
+}
+
+} // namespace crusty
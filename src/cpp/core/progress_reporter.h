@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace crusty {
+
+/**
+ * @brief Progress of one running operation
+ */
+struct ProgressInfo {
+    uint64_t bytesDone = 0;
+    uint64_t totalBytes = 0;        // 0 if the size is not known
+    float fraction = 0.0f;          // 0.0 (started) to 1.0 (completed)
+    double bytesPerSecond = 0.0;    // Smoothed over recent updates
+    std::chrono::milliseconds eta{-1};  // Negative if not known yet
+    bool finished = false;
+    
+    /**
+     * @return True if eta holds an estimate
+     */
+    bool hasEta() const { return eta.count() >= 0; }
+};
+
+/**
+ * Progress callback type receiving bytes, rate and remaining time
+ */
+using DetailedProgressCallback = std::function<void(const ProgressInfo& progress)>;
+
+/**
+ * @brief How often progress is reported
+ */
+struct ProgressSettings {
+    // Shortest time between two updates
+    std::chrono::milliseconds minInterval{100};
+    
+    // Smallest change of fraction worth an update; 0 reports every change
+    float minDelta = 0.01f;
+};
+
+/**
+ * @brief Coalesces the progress of one operation into timed updates
+ * 
+ * Workers only add bytes with a relaxed atomic addition, so any number of
+ * them can report without locks and without calling back into the UI. A
+ * single timer thread samples the total every minInterval and invokes the
+ * callback when the fraction moved by at least minDelta, so a small chunk
+ * size cannot flood an event queue. finish() stops the timer and delivers
+ * the final update on the calling thread; no callback runs after finish()
+ * or the destructor returns.
+ * 
+ * Without a callback no thread is started and add() is a single atomic
+ * addition.
+ */
+class ProgressReporter {
+public:
+    /**
+     * @brief Start the timer if there is a callback
+     * 
+     * @param callback Receives the updates, or null to report nothing
+     * @param settings Minimum interval and delta between updates
+     * @param totalBytes Expected bytes, or 0 if not known yet
+     */
+    ProgressReporter(DetailedProgressCallback callback, const ProgressSettings& settings,
+                     uint64_t totalBytes = 0);
+    
+    /**
+     * @brief Stop the timer without a final update
+     */
+    ~ProgressReporter();
+    
+    /**
+     * @brief Count processed bytes; safe to call from any thread
+     */
+    void add(uint64_t bytes) { bytes_done_.fetch_add(bytes, std::memory_order_relaxed); }
+    
+    /**
+     * @brief Set the expected bytes once they are known
+     */
+    void setTotal(uint64_t bytes) { total_bytes_.store(bytes, std::memory_order_relaxed); }
+    
+    /**
+     * @brief Stop the timer and report completion
+     */
+    void finish();
+    
+    // Prevent copying
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    void timerLoop();
+    void stop();
+    void sample(bool finished);
+    
+    DetailedProgressCallback callback_;
+    ProgressSettings settings_;
+    Clock::time_point start_;
+    
+    std::atomic<uint64_t> bytes_done_{0};
+    std::atomic<uint64_t> total_bytes_{0};
+    
+    // Only touched by whichever thread is delivering
+    ProgressInfo last_;
+    Clock::time_point last_sample_;
+    uint64_t last_sample_bytes_ = 0;
+    bool delivered_ = false;
+    
+    std::thread timer_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopping_ = false;
+};
+
+} // namespace crusty
@@ -0,0 +1,173 @@
+#include "secure_arena.h"
+#include "secure_buffer_pool.h"
+#include "secure_utils.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace crusty {
+namespace secure {
+
+SecureArena& SecureArena::instance() {
+    // Leaked on purpose: secrets in static objects may be freed after any
+    // function-local static would have been destroyed
+    static SecureArena* arena = new SecureArena();
+    return *arena;
+}
+
+SecureArena::~SecureArena() {
+    for (const Region& region : regions_) {
+        wipeMemory(region.data, region.size);
+        unmapGuarded(region.data, region.size);
+    }
+}
+
+void* SecureArena::allocate(size_t size) {
+    if (size > MAX_BLOCK_SIZE) {
+        bool locked = false;
+        size_t mapped = (size + pageSize() - 1) / pageSize() * pageSize();
+        uint8_t* data = mapGuarded(mapped, locked);
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.largeBytes += mapped;
+        return data;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocateBlock(classIndex(size));
+}
+
+void SecureArena::deallocate(void* data, size_t size) noexcept {
+    if (data == nullptr) {
+        return;
+    }
+    
+    if (size > MAX_BLOCK_SIZE) {
+        size_t mapped = (size + pageSize() - 1) / pageSize() * pageSize();
+        wipeMemory(data, mapped);
+        unmapGuarded(static_cast<uint8_t*>(data), mapped);
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.largeBytes -= mapped;
+        return;
+    }
+    
+    size_t index = classIndex(size);
+    size_t blockSize = MIN_BLOCK_SIZE << index;
+    wipeMemory(data, blockSize);
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    FreeBlock* block = static_cast<FreeBlock*>(data);
+    block->next = free_[index];
+    free_[index] = block;
+    stats_.blockBytes -= blockSize;
+}
+
+SecureArena::Stats SecureArena::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+size_t SecureArena::classIndex(size_t size) {
+    size_t index = 0;
+    while ((MIN_BLOCK_SIZE << index) < size) {
+        ++index;
+    }
+    return index;
+}
+
+size_t SecureArena::pageSize() {
+    static const size_t size = []() {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return static_cast<size_t>(info.dwPageSize);
+#else
+        long page = sysconf(_SC_PAGESIZE);
+        return page > 0 ? static_cast<size_t>(page) : size_t(4096);
+#endif
+    }();
+    return size;
+}
+
+uint8_t* SecureArena::mapGuarded(size_t size, bool& locked) {
+    size_t page = pageSize();
+    size_t total = size + 2 * page;
+    
+#ifdef _WIN32
+    void* base = VirtualAlloc(nullptr, total, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (base == nullptr) {
+        throw std::bad_alloc();
+    }
+    DWORD previous = 0;
+    VirtualProtect(base, page, PAGE_NOACCESS, &previous);
+    VirtualProtect(static_cast<uint8_t*>(base) + page + size, page, PAGE_NOACCESS, &previous);
+#else
+    void* base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    mprotect(base, page, PROT_NONE);
+    mprotect(static_cast<uint8_t*>(base) + page + size, page, PROT_NONE);
+#ifdef MADV_DONTDUMP
+    madvise(static_cast<uint8_t*>(base) + page, size, MADV_DONTDUMP);
+#endif
+#endif
+    
+    uint8_t* data = static_cast<uint8_t*>(base) + page;
+    locked = lockMemory(data, size);
+    return data;
+}
+
+void SecureArena::unmapGuarded(uint8_t* data, size_t size) {
+    // Unmapping also drops the lock
+    uint8_t* base = data - pageSize();
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    munmap(base, size + 2 * pageSize());
+#endif
+}
+
+void* SecureArena::allocateBlock(size_t index) {
+    size_t blockSize = MIN_BLOCK_SIZE << index;
+    stats_.blockBytes += blockSize;
+    
+    if (FreeBlock* block = free_[index]) {
+        free_[index] = block->next;
+        block->next = nullptr;   // The rest was wiped on deallocate
+        return block;
+    }
+    
+    // Blocks are powers of two from a page-aligned start, so the offset is
+    // always aligned to the block size
+    region_used_ = (region_used_ + blockSize - 1) / blockSize * blockSize;
+    if (regions_.empty() || region_used_ + blockSize > regions_.back().size) {
+        Region region{nullptr, REGION_SIZE, false};
+        try {
+            region.data = mapGuarded(REGION_SIZE, region.locked);
+        } catch (...) {
+            stats_.blockBytes -= blockSize;
+            throw;
+        }
+        regions_.push_back(region);
+        region_used_ = 0;
+        ++stats_.regions;
+        if (region.locked) {
+            ++stats_.lockedRegions;
+        }
+    }
+    
+    void* block = regions_.back().data + region_used_;
+    region_used_ += blockSize;
+    return block;
+}
+
+} // namespace secure
+} // namespace crusty
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace crusty {
+namespace secure {
+
+/**
+ * @brief Allocator for secrets, backed by a few memory-locked regions
+ * 
+ * Small blocks (up to MAX_BLOCK_SIZE) are carved from regions of
+ * REGION_SIZE bytes, each mapped with an inaccessible guard page on both
+ * sides and locked into RAM once, so a password or key id costs no system
+ * call and never lands on the general heap or in swap. Blocks come in
+ * power-of-two sizes and freed blocks are kept on a list per size. Larger
+ * requests get a guarded, locked mapping of their own.
+ * 
+ * Every block is wiped before it is reused or unmapped, and handed out
+ * zeroed. Locking is best effort: past RLIMIT_MEMLOCK regions are still
+ * used, just not locked. Where supported, regions are also left out of
+ * core dumps.
+ * 
+ * All methods are thread-safe.
+ */
+class SecureArena {
+public:
+    /**
+     * @brief Usage counters
+     */
+    struct Stats {
+        size_t regions = 0;          // Small-block regions mapped
+        size_t lockedRegions = 0;    // Of those, locked into RAM
+        size_t blockBytes = 0;       // Small blocks handed out
+        size_t largeBytes = 0;       // Bytes in dedicated mappings
+    };
+    
+    /**
+     * @brief The arena used by SecureAllocator
+     * 
+     * Never destroyed, so allocations made during static destruction stay valid.
+     */
+    static SecureArena& instance();
+    
+    SecureArena() = default;
+    
+    /**
+     * @brief Unmap every region; blocks still allocated become invalid
+     */
+    ~SecureArena();
+    
+    /**
+     * @brief Allocate zeroed memory aligned to ALIGNMENT
+     * 
+     * @param size Bytes requested
+     * @return Start of the block
+     * @throws std::bad_alloc if no memory could be mapped
+     */
+    void* allocate(size_t size);
+    
+    /**
+     * @brief Wipe a block and take it back
+     * 
+     * @param data Block from allocate(), or null
+     * @param size Size passed to allocate()
+     */
+    void deallocate(void* data, size_t size) noexcept;
+    
+    /**
+     * @return Current usage
+     */
+    Stats stats() const;
+    
+    // Sizes served from the shared regions, in powers of two
+    static constexpr size_t MIN_BLOCK_SIZE = 16;
+    static constexpr size_t MAX_BLOCK_SIZE = 4096;
+    
+    // Alignment of every block
+    static constexpr size_t ALIGNMENT = MIN_BLOCK_SIZE;
+    
+    // Regions are locked whole; this keeps several of them under the
+    // common 8 MB RLIMIT_MEMLOCK
+    static constexpr size_t REGION_SIZE = 256 * 1024;
+    
+    // Prevent copying
+    SecureArena(const SecureArena&) = delete;
+    SecureArena& operator=(const SecureArena&) = delete;
+
+private:
+    static constexpr size_t CLASS_COUNT = 9;   // 16 .. 4096
+    
+    struct Region {
+        uint8_t* data;   // First usable byte, after the leading guard page
+        size_t size;
+        bool locked;
+    };
+    
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    
+    static size_t classIndex(size_t size);
+    static size_t pageSize();
+    static uint8_t* mapGuarded(size_t size, bool& locked);
+    static void unmapGuarded(uint8_t* data, size_t size);
+    
+    // Called with mutex_ held
+    void* allocateBlock(size_t index);
+    
+    std::vector<Region> regions_;
+    size_t region_used_ = 0;   // Bump offset into regions_.back()
+    std::array<FreeBlock*, CLASS_COUNT> free_{};
+    Stats stats_;
+    
+    mutable std::mutex mutex_;
+};
+
+/**
+ * @brief Standard allocator drawing from SecureArena::instance()
+ * 
+ * For containers holding secrets: the memory is locked and is wiped when
+ * the container frees or grows it, not only when it is destroyed.
+ */
+template<typename T>
+class SecureAllocator {
+public:
+    using value_type = T;
+    
+    static_assert(alignof(T) <= SecureArena::ALIGNMENT, "SecureArena does not align beyond 16 bytes");
+    
+    SecureAllocator() noexcept = default;
+    
+    template<typename U>
+    SecureAllocator(const SecureAllocator<U>&) noexcept {}
+    
+    T* allocate(size_t count) {
+        if (count > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(SecureArena::instance().allocate(count * sizeof(T)));
+    }
+    
+    void deallocate(T* data, size_t count) noexcept {
+        SecureArena::instance().deallocate(data, count * sizeof(T));
+    }
+    
+    template<typename U>
+    bool operator==(const SecureAllocator<U>&) const noexcept { return true; }
+    
+    template<typename U>
+    bool operator!=(const SecureAllocator<U>&) const noexcept { return false; }
+};
+
+/**
+ * String whose characters live in the secure arena
+ * 
+ * Short strings are stored inside the object itself; reserve past the
+ * small-string capacity (e.g. sizeof(SecureString)) to keep them in the
+ * arena too.
+ */
+using SecureString = std::basic_string<char, std::char_traits<char>, SecureAllocator<char>>;
+
+/**
+ * Byte buffer in the secure arena
+ */
+using SecureBytes = std::vector<uint8_t, SecureAllocator<uint8_t>>;
+
+} // namespace secure
+} // namespace crusty
@@ -0,0 +1,162 @@
+#include "secure_buffer_pool.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace crusty {
+namespace secure {
+
+bool lockMemory(const void* data, size_t size) {
+    if (data == nullptr || size == 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return VirtualLock(const_cast<void*>(data), size) != 0;
+#else
+    return mlock(data, size) == 0;
+#endif
+}
+
+void unlockMemory(const void* data, size_t size) {
+    if (data == nullptr || size == 0) {
+        return;
+    }
+#ifdef _WIN32
+    VirtualUnlock(const_cast<void*>(data), size);
+#else
+    munlock(data, size);
+#endif
+}
+
+//
+// SecureBufferPool implementation
+//
+
+SecureBufferPool::SecureBufferPool(size_t maxRetainedBytes)
+    : max_retained_bytes_(maxRetainedBytes) {
+}
+
+SecureBufferPool::~SecureBufferPool() {
+    trim();
+}
+
+std::vector<uint8_t> SecureBufferPool::acquire(size_t size) {
+    std::vector<uint8_t> buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Newest buffers first; unless they were wiped with streaming stores,
+        // they are the most likely to still be cached
+        for (size_t i = free_.size(); i-- > 0;) {
+            if (free_[i].capacity() >= size) {
+                buffer = std::move(free_[i]);
+                retained_bytes_ -= buffer.capacity();
+                free_[i] = std::move(free_.back());
+                free_.pop_back();
+                break;
+            }
+        }
+    }
+    
+    if (buffer.capacity() == 0) {
+        if (size == 0) {
+            return buffer;
+        }
+        buffer.resize(size);
+        std::lock_guard<std::mutex> lock(mutex_);
+        track(buffer);
+        return buffer;
+    }
+    
+    // Pooled buffers are already zero, so this only writes when growing
+    buffer.resize(size);
+    return buffer;
+}
+
+void SecureBufferPool::release(std::vector<uint8_t>&& buffer) {
+    if (buffer.capacity() == 0) {
+        return;
+    }
+    
+    // Only the bytes in use can hold data; the rest were wiped last time
+    wipeMemory(buffer.data(), buffer.size());
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    track(buffer);
+    if (retained_bytes_ + buffer.capacity() > max_retained_bytes_) {
+        untrack(buffer);
+        std::vector<uint8_t>().swap(buffer);
+        return;
+    }
+    
+    retained_bytes_ += buffer.capacity();
+    free_.emplace_back(std::move(buffer));
+    buffer.clear();
+}
+
+void SecureBufferPool::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : free_) {
+        untrack(entry);
+    }
+    free_.clear();
+    retained_bytes_ = 0;
+}
+
+void SecureBufferPool::setMaxRetainedBytes(size_t maxRetainedBytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_retained_bytes_ = maxRetainedBytes;
+    // The oldest buffers are the least likely to still be cached
+    size_t kept = 0;
+    while (retained_bytes_ > max_retained_bytes_ && kept < free_.size()) {
+        std::vector<uint8_t>& oldest = free_[kept];
+        retained_bytes_ -= oldest.capacity();
+        untrack(oldest);
+        std::vector<uint8_t>().swap(oldest);
+        ++kept;
+    }
+    free_.erase(free_.begin(), free_.begin() + static_cast<std::ptrdiff_t>(kept));
+}
+
+size_t SecureBufferPool::retainedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retained_bytes_;
+}
+
+void SecureBufferPool::track(const std::vector<uint8_t>& buffer) {
+    auto it = regions_.find(buffer.data());
+    if (it != regions_.end()) {
+        if (it->second.size == buffer.capacity()) {
+            return;
+        }
+        
+        // The address was reused by a different allocation
+        if (it->second.locked) {
+            unlockMemory(buffer.data(), it->second.size);
+        }
+        regions_.erase(it);
+    }
+    
+    bool locked = lockMemory(buffer.data(), buffer.capacity());
+    regions_[buffer.data()] = Region{buffer.capacity(), locked};
+}
+
+void SecureBufferPool::untrack(const std::vector<uint8_t>& buffer) {
+    auto it = regions_.find(buffer.data());
+    if (it == regions_.end()) {
+        return;
+    }
+    
+    if (it->second.locked) {
+        unlockMemory(buffer.data(), it->second.size);
+    }
+    regions_.erase(it);
+}
+
+} // namespace secure
+} // namespace crusty
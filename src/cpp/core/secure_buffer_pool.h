@@ -0,0 +1,117 @@
+#pragma once
+
+#include "secure_utils.h"
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace crusty {
+namespace secure {
+
+/**
+ * @brief Lock a memory region into RAM so it is never written to swap
+ * 
+ * @param data Start of the region
+ * @param size Size of the region in bytes
+ * @return True if the region was locked
+ */
+bool lockMemory(const void* data, size_t size);
+
+/**
+ * @brief Undo lockMemory
+ * 
+ * @param data Start of the region
+ * @param size Size of the region in bytes
+ */
+void unlockMemory(const void* data, size_t size);
+
+/**
+ * @brief Reusable pool of wiped, memory-locked buffers for chunk data
+ * 
+ * Buffers are wiped when they are returned, but only over the bytes that
+ * were in use, and keep their size so reacquiring one of the same size
+ * writes nothing. Locking is best effort; buffers that cannot be locked
+ * (for example past RLIMIT_MEMLOCK) are still pooled.
+ * 
+ * All methods are thread-safe.
+ */
+class SecureBufferPool {
+public:
+    /**
+     * @brief Create a pool
+     * 
+     * @param maxRetainedBytes Upper bound on the capacity kept for reuse
+     */
+    explicit SecureBufferPool(size_t maxRetainedBytes = DEFAULT_MAX_RETAINED_BYTES);
+    
+    /**
+     * @brief Unlock and wipe all pooled buffers
+     */
+    ~SecureBufferPool();
+    
+    /**
+     * @brief Take a buffer of the given size
+     * 
+     * @param size Required size in bytes
+     * @return Buffer with size() == size; contents are zero
+     */
+    std::vector<uint8_t> acquire(size_t size);
+    
+    /**
+     * @brief Wipe a buffer and keep it for reuse
+     * 
+     * Buffers that did not come from acquire() are accepted too.
+     * 
+     * @param buffer Buffer to return; left empty
+     */
+    void release(std::vector<uint8_t>&& buffer);
+    
+    /**
+     * @brief Free all pooled buffers
+     */
+    void trim();
+    
+    /**
+     * @brief Change the upper bound on the capacity kept for reuse
+     * 
+     * Frees pooled buffers, oldest first, until the pool is within it.
+     * 
+     * @param maxRetainedBytes New bound in bytes
+     */
+    void setMaxRetainedBytes(size_t maxRetainedBytes);
+    
+    /**
+     * @return Capacity currently held for reuse, in bytes
+     */
+    size_t retainedBytes() const;
+    
+    // Default retention limit (128 MB, sixteen 8 MB chunks)
+    static constexpr size_t DEFAULT_MAX_RETAINED_BYTES = 128 * 1024 * 1024;
+    
+    // Prevent copying
+    SecureBufferPool(const SecureBufferPool&) = delete;
+    SecureBufferPool& operator=(const SecureBufferPool&) = delete;
+
+private:
+    // Called with mutex_ held
+    void track(const std::vector<uint8_t>& buffer);
+    void untrack(const std::vector<uint8_t>& buffer);
+    
+    size_t max_retained_bytes_;
+    size_t retained_bytes_ = 0;
+    std::vector<std::vector<uint8_t>> free_;   // Already wiped; freeing them again would only add traffic
+    
+    // Buffers seen by the pool, by start address, and whether locking worked
+    struct Region {
+        size_t size;
+        bool locked;
+    };
+    std::unordered_map<const uint8_t*, Region> regions_;
+    
+    mutable std::mutex mutex_;
+};
+
+} // namespace secure
+} // namespace crusty
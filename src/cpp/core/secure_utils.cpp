@@ -0,0 +1,92 @@
+#include "secure_utils.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CRUSTY_WIPE_STREAMING 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace crusty {
+namespace secure {
+
+namespace {
+
+// The compiler must assume the zeroed memory is read afterwards
+inline void keepStores(void* data) {
+#if defined(__GNUC__) || defined(__clang__)
+    __asm__ __volatile__("" : : "r"(data) : "memory");
+#elif defined(_MSC_VER)
+    (void)data;
+    _ReadWriteBarrier();
+#else
+    (void)data;
+#endif
+}
+
+void wipeCached(void* data, size_t size) {
+#if defined(_WIN32)
+    SecureZeroMemory(data, size);
+#elif (defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))) || \
+      defined(__OpenBSD__) || defined(__FreeBSD__)
+    explicit_bzero(data, size);
+#elif defined(__GNUC__) || defined(__clang__)
+    std::memset(data, 0, size);
+    keepStores(data);
+#else
+    // Volatile stores are kept on every compiler
+    volatile unsigned char* ptr = static_cast<volatile unsigned char*>(data);
+    while (size--) {
+        *ptr++ = 0;
+    }
+#endif
+}
+
+#ifdef CRUSTY_WIPE_STREAMING
+// Whole 64-byte lines with non-temporal stores, which go to memory without
+// first reading the lines into the cache
+void wipeStreaming(void* data, size_t size) {
+    uint8_t* start = static_cast<uint8_t*>(data);
+    uint8_t* end = start + size;
+    uint8_t* first = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(start) + 63) & ~uintptr_t{63});
+    uint8_t* last = reinterpret_cast<uint8_t*>(reinterpret_cast<uintptr_t>(end) & ~uintptr_t{63});
+    
+    wipeCached(start, static_cast<size_t>(first - start));
+    const __m128i zero = _mm_setzero_si128();
+    for (uint8_t* line = first; line < last; line += 64) {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(line), zero);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(line + 16), zero);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(line + 32), zero);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(line + 48), zero);
+    }
+    // Order the streaming stores before the memory is handed to anyone else
+    _mm_sfence();
+    keepStores(first);
+    wipeCached(last, static_cast<size_t>(end - last));
+}
+#endif
+
+} // anonymous namespace
+
+void wipeMemory(void* data, size_t size) {
+    if (size == 0) return;
+#ifdef CRUSTY_WIPE_STREAMING
+    if (size >= STREAMING_WIPE_THRESHOLD) {
+        wipeStreaming(data, size);
+        return;
+    }
+#endif
+    wipeCached(data, size);
+}
+
+} // namespace secure
+} // namespace crusty
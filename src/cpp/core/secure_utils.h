@@ -1,13 +1,31 @@
 #pragma once
 
+#include <cstdint>
 #include <cstring>
 #include <type_traits>
+#include <utility>
 #include <vector>
 #include <string>
 
 namespace crusty {
 namespace secure {
 
+/**
+ * Securely wipes a raw memory region
+ * 
+ * Unlike a plain memset, the stores cannot be dropped by the optimizer,
+ * even when the memory is freed right after. Regions of at least
+ * STREAMING_WIPE_THRESHOLD bytes are wiped with non-temporal stores on
+ * x86, so wiping a chunk does not evict the data the next one works on.
+ * 
+ * @param data Start of the region
+ * @param size Number of bytes to wipe
+ */
+void wipeMemory(void* data, size_t size);
+
+// About a core's L2 cache; smaller regions are faster to wipe in the cache
+constexpr size_t STREAMING_WIPE_THRESHOLD = 1024 * 1024;
+
 /**
  * Securely wipes memory containing sensitive data
  * 
@@ -16,33 +34,39 @@ namespace secure {
  */
 template<typename T>
 inline void wipe(T& data) {
-    volatile T* ptr = &data;
-    std::memset(const_cast<T*>(ptr), 0, sizeof(T));
+    static_assert(std::is_trivially_copyable<T>::value, "wipe() would corrupt a non-trivial object");
+    wipeMemory(&data, sizeof(T));
 }
 
 /**
  * Specialization for std::vector to wipe its contents
  */
-template<typename T>
-inline void wipe(std::vector<T>& data) {
+template<typename T, typename Allocator>
+inline void wipe(std::vector<T, Allocator>& data) {
     if (data.empty()) return;
-    volatile T* ptr = data.data();
-    std::memset(const_cast<T*>(ptr), 0, data.size() * sizeof(T));
+    wipeMemory(data.data(), data.size() * sizeof(T));
     data.clear();
 }
 
 /**
  * Specialization for std::string to wipe its contents
+ * 
+ * The whole capacity is wiped, so bytes left behind by a shorter value or
+ * by moving a short string out of its inline buffer go too.
  */
-inline void wipe(std::string& data) {
-    if (data.empty()) return;
-    volatile char* ptr = data.data();
-    std::memset(const_cast<char*>(ptr), 0, data.size());
+template<typename CharT, typename Traits, typename Allocator>
+inline void wipe(std::basic_string<CharT, Traits, Allocator>& data) {
+    data.resize(data.capacity());
+    wipeMemory(&data[0], data.size() * sizeof(CharT));
     data.clear();
 }
 
 /**
  * RAII wrapper for secure data that's automatically wiped when it goes out of scope
+ * 
+ * Takes ownership by move only, so wrapping a secret never copies it;
+ * whatever the move leaves behind in the source is wiped. Callees that
+ * only read a password take a SecureView of it instead.
  */
 template<typename T>
 class SecureData {
@@ -51,7 +75,9 @@ private:
 
 public:
     SecureData() = default;
-    explicit SecureData(const T& data) : data_(data) {}
+    explicit SecureData(T&& data) : data_(std::move(data)) {
+        wipe(data);
+    }
     
     ~SecureData() {
         wipe(data_);
@@ -66,15 +92,64 @@ public:
     SecureData& operator=(const SecureData&) = delete;
     
     // Allow moving
-    SecureData(SecureData&& other) noexcept : data_(std::move(other.data_)) {}
+    SecureData(SecureData&& other) noexcept : data_(std::move(other.data_)) {
+        wipe(other.data_);
+    }
     SecureData& operator=(SecureData&& other) noexcept {
         if (this != &other) {
             wipe(data_);
             data_ = std::move(other.data_);
+            wipe(other.data_);
         }
         return *this;
     }
 };
 
+/**
+ * Non-owning, read-only view of a secret held elsewhere
+ * 
+ * Passed by value down to the crypto library, which gets its pointer and
+ * length directly, so a password is never copied on the way. Like
+ * std::string_view, a view must not outlive the data it refers to.
+ */
+class SecureView {
+public:
+    SecureView() noexcept = default;
+    SecureView(const uint8_t* data, size_t size) noexcept : data_(data), size_(size) {}
+    
+    // Implicit, so plain and secure strings can be passed where a view is expected
+    SecureView(const char* data) noexcept
+        : SecureView(reinterpret_cast<const uint8_t*>(data), std::strlen(data)) {}
+    
+    template<typename Traits, typename Allocator>
+    SecureView(const std::basic_string<char, Traits, Allocator>& data) noexcept
+        : SecureView(reinterpret_cast<const uint8_t*>(data.data()), data.size()) {}
+    
+    template<typename T>
+    SecureView(const SecureData<T>& data) noexcept : SecureView(data.get()) {}
+    
+    const uint8_t* data() const noexcept { return data_; }
+    size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    
+    /**
+     * Compare two secrets in time that depends only on their lengths
+     */
+    bool equals(SecureView other) const noexcept {
+        if (size_ != other.size_) {
+            return false;
+        }
+        uint8_t difference = 0;
+        for (size_t i = 0; i < size_; ++i) {
+            difference |= data_[i] ^ other.data_[i];
+        }
+        return difference == 0;
+    }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
 } // namespace secure
 } // namespace crusty
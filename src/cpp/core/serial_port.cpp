@@ -0,0 +1,262 @@
+#include "serial_port.h"
+#include "encryptor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace crusty {
+
+namespace {
+
+[[noreturn]] void ioError(const std::string& message, const std::string& name) {
+#ifdef _WIN32
+    std::string reason = "error " + std::to_string(GetLastError());
+#else
+    std::string reason = std::strerror(errno);
+#endif
+    throw EncryptionException(message + ": " + name + " (" + reason + ")", CryptoErrorCode::IoError);
+}
+
+[[noreturn]] void unsupportedRate(const std::string& name, uint32_t baudRate) {
+    throw EncryptionException("Serial port " + name + " does not support " + std::to_string(baudRate) + " baud",
+                              CryptoErrorCode::IoError);
+}
+
+#ifndef _WIN32
+speed_t speedFor(uint32_t baudRate) {
+    switch (baudRate) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+#ifdef B460800
+        case 460800: return B460800;
+#endif
+#ifdef B921600
+        case 921600: return B921600;
+#endif
+        default: return 0;
+    }
+}
+
+bool isBoardPort(const std::string& name) {
+    // ST-LINK's virtual COM port is a CDC ACM device; USB-UART bridges show up as ttyUSB
+    static const char* const prefixes[] = {"ttyACM", "ttyUSB", "cu.usbmodem", "cu.usbserial"};
+    return std::any_of(std::begin(prefixes), std::end(prefixes),
+                       [&name](const char* prefix) { return name.rfind(prefix, 0) == 0; });
+}
+#endif
+
+} // anonymous namespace
+
+#ifdef _WIN32
+
+std::unique_ptr<SerialPort> SerialPort::open(const std::string& name, uint32_t baudRate) {
+    // The device namespace prefix is needed for COM10 and above
+    std::string path = name.rfind("\\\\.\\", 0) == 0 ? name : "\\\\.\\" + name;
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        ioError("Failed to open serial port", name);
+    }
+    std::unique_ptr<SerialPort> port(new SerialPort(name));
+    port->handle_ = handle;
+    
+    DCB dcb{};
+    dcb.DCBlength = sizeof(dcb);
+    if (!GetCommState(handle, &dcb)) {
+        ioError("Failed to read serial port settings", name);
+    }
+    dcb.BaudRate = baudRate;
+    dcb.ByteSize = 8;
+    dcb.Parity = NOPARITY;
+    dcb.StopBits = ONESTOPBIT;
+    dcb.fBinary = TRUE;
+    dcb.fParity = FALSE;
+    dcb.fOutxCtsFlow = FALSE;
+    dcb.fOutxDsrFlow = FALSE;
+    dcb.fDtrControl = DTR_CONTROL_ENABLE;
+    dcb.fRtsControl = RTS_CONTROL_ENABLE;
+    dcb.fDsrSensitivity = FALSE;
+    dcb.fOutX = FALSE;
+    dcb.fInX = FALSE;
+    dcb.fNull = FALSE;
+    dcb.fAbortOnError = FALSE;
+    if (!SetCommState(handle, &dcb)) {
+        unsupportedRate(name, baudRate);
+    }
+    PurgeComm(handle, PURGE_RXCLEAR | PURGE_TXCLEAR);
+    return port;
+}
+
+std::vector<std::string> SerialPort::availablePorts() {
+    std::vector<std::string> ports;
+    char target[256];
+    for (int i = 1; i <= 255; ++i) {
+        std::string name = "COM" + std::to_string(i);
+        if (QueryDosDeviceA(name.c_str(), target, sizeof(target)) != 0) {
+            ports.push_back(name);
+        }
+    }
+    return ports;
+}
+
+SerialPort::~SerialPort() {
+    if (handle_) {
+        CloseHandle(handle_);
+    }
+}
+
+void SerialPort::write(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1u << 20));
+        DWORD written = 0;
+        if (!WriteFile(handle_, data, chunk, &written, nullptr)) {
+            ioError("Failed to write to serial port", name_);
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+size_t SerialPort::read(uint8_t* buffer, size_t size, std::chrono::milliseconds timeout) {
+    // MAXDWORD interval and multiplier: return what is there, or wait up to
+    // the constant for the first byte
+    long long wait = std::clamp<long long>(timeout.count(), 1, MAXDWORD - 1);
+    if (wait != read_timeout_) {
+        COMMTIMEOUTS timeouts{};
+        timeouts.ReadIntervalTimeout = MAXDWORD;
+        timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+        timeouts.ReadTotalTimeoutConstant = static_cast<DWORD>(wait);
+        if (!SetCommTimeouts(handle_, &timeouts)) {
+            ioError("Failed to set serial port timeouts", name_);
+        }
+        read_timeout_ = wait;
+    }
+    
+    DWORD read = 0;
+    if (!ReadFile(handle_, buffer, static_cast<DWORD>(std::min<size_t>(size, MAXDWORD)), &read, nullptr)) {
+        ioError("Failed to read from serial port", name_);
+    }
+    return read;
+}
+
+#else
+
+std::unique_ptr<SerialPort> SerialPort::open(const std::string& name, uint32_t baudRate) {
+    speed_t speed = speedFor(baudRate);
+    if (speed == 0) {
+        unsupportedRate(name, baudRate);
+    }
+    
+    // Non-blocking so the open does not wait for carrier detect
+    int fd = ::open(name.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        ioError("Failed to open serial port", name);
+    }
+    std::unique_ptr<SerialPort> port(new SerialPort(name));
+    port->fd_ = fd;
+    
+    termios settings{};
+    if (tcgetattr(fd, &settings) != 0) {
+        ioError("Failed to read serial port settings", name);
+    }
+    cfmakeraw(&settings);
+    settings.c_cflag |= CLOCAL | CREAD;
+    settings.c_cflag &= ~(CSTOPB | CRTSCTS);
+    settings.c_cc[VMIN] = 0;
+    settings.c_cc[VTIME] = 0;
+    if (cfsetispeed(&settings, speed) != 0 || cfsetospeed(&settings, speed) != 0 ||
+        tcsetattr(fd, TCSANOW, &settings) != 0) {
+        unsupportedRate(name, baudRate);
+    }
+    tcflush(fd, TCIOFLUSH);
+    
+    // Reads wait in poll(), writes block until the driver takes the data
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) != 0) {
+        ioError("Failed to configure serial port", name);
+    }
+    return port;
+}
+
+std::vector<std::string> SerialPort::availablePorts() {
+    std::vector<std::string> ports;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it("/dev", ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (isBoardPort(name)) {
+            ports.push_back(it->path().string());
+        }
+    }
+    std::sort(ports.begin(), ports.end());
+    return ports;
+}
+
+SerialPort::~SerialPort() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void SerialPort::write(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd_, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ioError("Failed to write to serial port", name_);
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+size_t SerialPort::read(uint8_t* buffer, size_t size, std::chrono::milliseconds timeout) {
+    pollfd request{fd_, POLLIN, 0};
+    int ready = poll(&request, 1, static_cast<int>(std::min<long long>(timeout.count(), 1 << 30)));
+    if (ready < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        ioError("Failed to wait for serial port", name_);
+    }
+    if (ready == 0) {
+        return 0;
+    }
+    if (request.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+        // A USB adapter that was unplugged
+        errno = EIO;
+        ioError("Serial port disconnected", name_);
+    }
+    
+    ssize_t count = ::read(fd_, buffer, size);
+    if (count < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+            return 0;
+        }
+        ioError("Failed to read from serial port", name_);
+    }
+    return static_cast<size_t>(count);
+}
+
+#endif
+
+} // namespace crusty
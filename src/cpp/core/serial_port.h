@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "device_link.h"
+
+namespace crusty {
+
+/**
+ * @brief Serial port as a DeviceTransport
+ * 
+ * Opened raw at 8N1 without flow control, as the firmware configures its
+ * UART. On Windows, names are COM ports ("COM3"); elsewhere, device paths
+ * ("/dev/ttyACM0").
+ */
+class SerialPort : public DeviceTransport {
+public:
+    /**
+     * @brief Open a port
+     * 
+     * @param name Port name or device path
+     * @param baudRate Line rate, e.g. 115200
+     * @return Open port
+     * @throws EncryptionException with IoError if the port cannot be opened
+     *         or does not support the rate
+     */
+    static std::unique_ptr<SerialPort> open(const std::string& name, uint32_t baudRate = DEFAULT_BAUD_RATE);
+    
+    /**
+     * @brief Ports that look like they could lead to a board
+     * 
+     * USB serial and ST-LINK virtual COM ports on Linux and macOS; every
+     * present COM port on Windows.
+     * 
+     * @return Port names, sorted
+     */
+    static std::vector<std::string> availablePorts();
+    
+    ~SerialPort() override;
+    
+    void write(const uint8_t* data, size_t size) override;
+    size_t read(uint8_t* buffer, size_t size, std::chrono::milliseconds timeout) override;
+    
+    const std::string& name() const { return name_; }
+    
+    static constexpr uint32_t DEFAULT_BAUD_RATE = 115200;
+    
+    // Prevent copying
+    SerialPort(const SerialPort&) = delete;
+    SerialPort& operator=(const SerialPort&) = delete;
+
+private:
+    explicit SerialPort(std::string name) : name_(std::move(name)) {}
+    
+    std::string name_;
+#ifdef _WIN32
+    void* handle_ = nullptr;
+    long long read_timeout_ = -1;   // Set on the handle, to skip redundant SetCommTimeouts
+#else
+    int fd_ = -1;
+#endif
+};
+
+} // namespace crusty
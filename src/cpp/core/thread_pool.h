@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace crusty {
+
+/**
+ * @brief Fixed-size pool of worker threads shared by the file engine
+ * 
+ * Tasks are run in submission order. Threads that block waiting for pool
+ * work (for example a batch job waiting on its own chunks) should call
+ * runPendingTask() while they wait so nested use cannot deadlock.
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief Start the worker threads
+     * 
+     * @param threadCount Number of workers, or 0 for one per hardware thread
+     */
+    explicit ThreadPool(size_t threadCount = 0);
+    
+    /**
+     * @brief Finish all queued tasks and join the workers
+     */
+    ~ThreadPool();
+    
+    /**
+     * @brief Queue a task
+     * 
+     * @param task Callable taking no arguments
+     * @return Future for the task's result; exceptions are stored in it
+     */
+    template<typename F>
+    auto submit(F&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> future = packaged->get_future();
+        enqueue([packaged]() { (*packaged)(); });
+        return future;
+    }
+    
+    /**
+     * @brief Run one queued task on the calling thread, if there is one
+     * 
+     * @return True if a task was run
+     */
+    bool runPendingTask();
+    
+    /**
+     * @return Number of worker threads
+     */
+    size_t size() const { return workers_.size(); }
+    
+    // Prevent copying
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+private:
+    void enqueue(std::function<void()> task);
+    void workerLoop();
+    
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopping_ = false;
+};
+
+} // namespace crusty
@@ -0,0 +1,232 @@
+#include "trace.h"
+#include "crypto_interface.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace crusty {
+namespace trace {
+
+namespace detail {
+std::atomic<bool> capturing{false};
+}
+
+namespace {
+
+// Fields are relaxed atomics so a writer overwriting the slot being read
+// is not a data race; the reader drops slots the writer may have reached
+struct Event {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> begin{0};   // Nanoseconds since the capture started
+    std::atomic<int64_t> duration{0};
+};
+
+// Written only by its thread, read by writeChromeTrace()
+struct ThreadBuffer {
+    ThreadBuffer(size_t capacity, uint32_t threadId)
+        : events(new Event[capacity]), mask(capacity - 1), tid(threadId) {}
+    
+    std::unique_ptr<Event[]> events;
+    size_t mask;
+    uint32_t tid;
+    std::atomic<uint64_t> written{0};
+};
+
+// Buffers of the current capture; kept after their threads exit so
+// short-lived threads still show up
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    size_t capacity = DEFAULT_EVENTS_PER_THREAD;
+    uint64_t generation = 0;
+    Clock::time_point epoch = Clock::now();
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry();   // Outlives threads still recording at exit
+    return *instance;
+}
+
+std::atomic<uint64_t> current_generation{0};
+std::atomic<int64_t> epoch_nanos{0};
+
+struct ThreadState {
+    std::shared_ptr<ThreadBuffer> buffer;
+    uint64_t generation = 0;
+};
+
+thread_local ThreadState thread_state;
+
+// Registers the calling thread's buffer on its first span of a capture
+ThreadBuffer* threadBuffer() {
+    uint64_t generation = current_generation.load(std::memory_order_acquire);
+    if (thread_state.buffer && thread_state.generation == generation) {
+        return thread_state.buffer.get();
+    }
+    
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (reg.generation != generation) {
+        return nullptr;   // A new capture is being set up
+    }
+    auto buffer = std::make_shared<ThreadBuffer>(reg.capacity, static_cast<uint32_t>(reg.buffers.size() + 1));
+    reg.buffers.push_back(buffer);
+    thread_state.buffer = std::move(buffer);
+    thread_state.generation = generation;
+    return thread_state.buffer.get();
+}
+
+int64_t sinceEpoch(Clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count() -
+           epoch_nanos.load(std::memory_order_relaxed);
+}
+
+#ifdef CRUSTY_TRACING
+// Phases of the Rust crate, in the order of crypto::CryptoProfile
+const char* const RUST_PHASES[] = {"rust.kdf", "rust.cipher_init", "rust.aead", "rust.copy_out"};
+constexpr size_t RUST_PHASE_COUNT = sizeof(RUST_PHASES) / sizeof(RUST_PHASES[0]);
+
+thread_local Clock::time_point rust_begin[RUST_PHASE_COUNT];
+
+// Called by Rust at both ends of a phase; the clock is read here so its
+// spans line up with the C++ ones
+void onRustPhase(uint32_t phase, uint8_t begin) {
+    if (phase >= RUST_PHASE_COUNT) {
+        return;
+    }
+    if (begin) {
+        rust_begin[phase] = Clock::now();
+    } else {
+        span(RUST_PHASES[phase], rust_begin[phase], Clock::now());
+    }
+}
+#endif
+
+// Span names are literals from our own code, but keep the JSON valid anyway
+void writeName(std::ostream& out, const char* name) {
+    out << '"';
+    for (const char* c = name; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\' << *c;
+        } else if (static_cast<unsigned char>(*c) >= 0x20) {
+            out << *c;
+        }
+    }
+    out << '"';
+}
+
+} // anonymous namespace
+
+namespace detail {
+
+void record(const char* name, Clock::time_point begin, Clock::time_point end) noexcept {
+    ThreadBuffer* buffer = nullptr;
+    try {
+        buffer = threadBuffer();
+    } catch (...) {
+        return;
+    }
+    if (!buffer) {
+        return;
+    }
+    
+    uint64_t index = buffer->written.load(std::memory_order_relaxed);
+    Event& event = buffer->events[index & buffer->mask];
+    event.name.store(name, std::memory_order_relaxed);
+    event.begin.store(sinceEpoch(begin), std::memory_order_relaxed);
+    event.duration.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count(),
+                         std::memory_order_relaxed);
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+} // namespace detail
+
+void start(size_t eventsPerThread) {
+    if (!compiledIn()) {
+        return;
+    }
+    
+    size_t capacity = 1;
+    while (capacity < std::max<size_t>(eventsPerThread, 2)) {
+        capacity <<= 1;
+    }
+    
+    Registry& reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        detail::capturing.store(false, std::memory_order_relaxed);
+        reg.buffers.clear();
+        reg.capacity = capacity;
+        reg.epoch = Clock::now();
+        epoch_nanos.store(std::chrono::duration_cast<std::chrono::nanoseconds>(reg.epoch.time_since_epoch()).count(),
+                          std::memory_order_relaxed);
+        current_generation.store(++reg.generation, std::memory_order_release);
+        detail::capturing.store(true, std::memory_order_relaxed);
+    }
+#ifdef CRUSTY_TRACING
+    crypto::set_trace_callback(&onRustPhase);
+#endif
+}
+
+void stop() {
+    if (!compiledIn()) {
+        return;
+    }
+#ifdef CRUSTY_TRACING
+    crypto::set_trace_callback(nullptr);
+#endif
+    detail::capturing.store(false, std::memory_order_relaxed);
+}
+
+void writeChromeTrace(std::ostream& out) {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        buffers = reg.buffers;
+    }
+    
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto& buffer : buffers) {
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t capacity = buffer->mask + 1;
+        uint64_t oldest = written > capacity ? written - capacity : 0;
+        
+        std::vector<const char*> names;
+        std::vector<int64_t> begins;
+        std::vector<int64_t> durations;
+        for (uint64_t i = oldest; i < written; ++i) {
+            const Event& event = buffer->events[i & buffer->mask];
+            names.push_back(event.name.load(std::memory_order_relaxed));
+            begins.push_back(event.begin.load(std::memory_order_relaxed));
+            durations.push_back(event.duration.load(std::memory_order_relaxed));
+        }
+        
+        // Slots the thread wrapped around to while they were copied are dropped
+        uint64_t after = buffer->written.load(std::memory_order_acquire);
+        uint64_t valid = after > capacity ? after - capacity : 0;
+        
+        out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+            << ",\"args\":{\"name\":\"thread " << buffer->tid << "\"}}";
+        first = false;
+        for (uint64_t i = std::max(oldest, valid); i < written; ++i) {
+            size_t slot = static_cast<size_t>(i - oldest);
+            if (!names[slot]) {
+                continue;
+            }
+            out << ",\n{\"name\":";
+            writeName(out, names[slot]);
+            out << ",\"cat\":\"crusty\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << begins[slot] / 1000 << '.' << (begins[slot] % 1000) / 100
+                << ",\"dur\":" << durations[slot] / 1000 << '.' << (durations[slot] % 1000) / 100 << '}';
+        }
+    }
+    out << "\n]}\n";
+}
+
+} // namespace trace
+} // namespace crusty
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace crusty {
+
+/**
+ * @brief Span tracing for profiling where an operation's time goes
+ * 
+ * Spans are compiled in only with CRUSTY_TRACING (the CMake option of the
+ * same name, which also builds the Rust crate with its `tracing` feature);
+ * otherwise TRACE_SPAN expands to nothing and the hooks in the engine
+ * compile away. Even when compiled in, nothing is recorded until start()
+ * is called, and a span then costs two clock reads and a store into the
+ * calling thread's ring buffer; only a thread's first span of a capture
+ * takes a lock, to register its buffer.
+ * 
+ * Each thread records into a ring buffer of its own that keeps the newest
+ * events, so a long capture keeps its last part. writeChromeTrace()
+ * writes the Chrome trace event format, which chrome://tracing and
+ * ui.perfetto.dev open. Span names must be string literals or otherwise
+ * outlive the capture.
+ */
+namespace trace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Events each thread keeps unless start() is given another count
+ */
+constexpr size_t DEFAULT_EVENTS_PER_THREAD = 1u << 16;
+
+/**
+ * @return True if this build records spans (CRUSTY_TRACING)
+ */
+constexpr bool compiledIn() {
+#ifdef CRUSTY_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+namespace detail {
+extern std::atomic<bool> capturing;
+void record(const char* name, Clock::time_point begin, Clock::time_point end) noexcept;
+}
+
+/**
+ * @return True while a capture is running
+ */
+inline bool enabled() noexcept {
+    return detail::capturing.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Start a capture, dropping the events of the previous one
+ * 
+ * Also hands the Rust crate a callback for its KDF, cipher and AEAD
+ * phases, if it was built with them. Does nothing in builds without
+ * CRUSTY_TRACING.
+ * 
+ * @param eventsPerThread Events kept per thread, rounded up to a power of two
+ */
+void start(size_t eventsPerThread = DEFAULT_EVENTS_PER_THREAD);
+
+/**
+ * @brief Stop recording; the events stay until the next start()
+ */
+void stop();
+
+/**
+ * @brief Write the events captured so far as a Chrome trace
+ * 
+ * Best called after stop(): events recorded while it runs may be left out.
+ * 
+ * @param out Stream to write the JSON to
+ */
+void writeChromeTrace(std::ostream& out);
+
+/**
+ * @brief Record an interval whose ends were measured already
+ * 
+ * For code that reads the clock anyway, such as the phase timers of
+ * OperationRecorder.
+ * 
+ * @param name Span name; must outlive the capture
+ * @param begin Start of the interval
+ * @param end End of the interval
+ */
+inline void span(const char* name, Clock::time_point begin, Clock::time_point end) noexcept {
+#ifdef CRUSTY_TRACING
+    if (enabled()) {
+        detail::record(name, begin, end);
+    }
+#else
+    (void)name;
+    (void)begin;
+    (void)end;
+#endif
+}
+
+/**
+ * @brief Records the time between construction and destruction as one span
+ */
+class Span {
+public:
+    explicit Span(const char* name) noexcept : name_(enabled() ? name : nullptr) {
+        if (name_) {
+            begin_ = Clock::now();
+        }
+    }
+    
+    ~Span() {
+        if (name_) {
+            span(name_, begin_, Clock::now());
+        }
+    }
+    
+    // Prevent copying
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* name_;
+    Clock::time_point begin_;
+};
+
+} // namespace trace
+} // namespace crusty
+
+#ifdef CRUSTY_TRACING
+#define CRUSTY_TRACE_JOIN2(a, b) a##b
+#define CRUSTY_TRACE_JOIN(a, b) CRUSTY_TRACE_JOIN2(a, b)
+#define TRACE_SPAN(name) ::crusty::trace::Span CRUSTY_TRACE_JOIN(trace_span_, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) ((void)0)
+#endif
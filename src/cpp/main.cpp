@@ -7,8 +7,10 @@
 #else
 #include <iostream>
 #include <string>
+#include "cli/cli.h"
 #endif
 
+#include "core/audit_log.h"
 #include "core/encryptor.h"
 
 #ifndef NO_QT_UI
@@ -29,7 +31,11 @@ namespace {
 int main(int argc, char *argv[]) {
     try {
 #ifndef NO_QT_UI
-        // Qt GUI version
+        // Qt GUI version; the log file is opened and the CPU probed off
+        // the GUI thread while the window is built
+        crusty::AuditLog::getInstance().enableAsync();
+        crusty::Crypto::warmUp();
+        
         QApplication app(argc, argv);
         configureApplication(app);
         
@@ -39,14 +45,7 @@ int main(int argc, char *argv[]) {
         return app.exec();
 #else
         // CLI version
-        std::cout << "CRUSTy-CLI v1.0.0" << std::endl;
-        std::cout << "This is a command-line version built without Qt UI." << std::endl;
-        
-        // Basic functionality demo
-        std::cout << "Initializing encryption engine..." << std::endl;
-        // Add CLI functionality here
-        
-        return 0;
+        return crusty::cli::run(argc, argv);
 #endif
     } catch (const std::exception& e) {
 #ifndef NO_QT_UI
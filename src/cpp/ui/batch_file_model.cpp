@@ -0,0 +1,328 @@
+#include "batch_file_model.h"
+#include "file_list_model.h"
+
+#include <QFileInfo>
+
+#include <algorithm>
+
+namespace crusty {
+
+namespace {
+
+using Status = BatchEncryptor::Status;
+
+QString statusText(Status status)
+{
+    switch (status) {
+        case Status::Running:
+            return "Running";
+        case Status::Succeeded:
+            return "Done";
+        case Status::Failed:
+            return "Failed";
+        case Status::Cancelled:
+            return "Cancelled";
+        default:
+            return "Pending";
+    }
+}
+
+} // anonymous namespace
+
+BatchFileModel::BatchFileModel(QObject* parent)
+    : QAbstractTableModel(parent),
+      m_errors(1)
+{
+    m_clock.start();
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(UPDATE_INTERVAL_MS);
+    connect(&m_flushTimer, &QTimer::timeout, this, &BatchFileModel::flush);
+}
+
+void BatchFileModel::addFiles(const QStringList& sources, BatchEncryptor::Operation operation)
+{
+    if (sources.isEmpty()) {
+        return;
+    }
+    
+    int first = rowCount();
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(sources.size()) - 1);
+    for (const QString& source : sources) {
+        QString output = QString::fromStdString(BatchEncryptor::defaultDestPath(source.toStdString(), operation));
+        m_source.push_back(addPath(source));
+        m_output.push_back(addPath(output));
+        m_size.push_back(QFileInfo(source).size());
+        m_state.push_back(static_cast<uint8_t>(Status::Pending));
+        m_progress.push_back(0.0f);
+        m_throughput.push_back(0.0f);
+        m_started.push_back(0);
+        m_error.push_back(0);
+    }
+    endInsertRows();
+}
+
+void BatchFileModel::clear()
+{
+    beginResetModel();
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.clear();
+        m_pendingErrors.clear();
+    }
+    m_paths.clear();
+    m_source.clear();
+    m_output.clear();
+    m_size.clear();
+    m_state.clear();
+    m_progress.clear();
+    m_throughput.clear();
+    m_started.clear();
+    m_error.clear();
+    m_errors.resize(1);
+    endResetModel();
+}
+
+std::vector<BatchEncryptor::Item> BatchFileModel::items() const
+{
+    std::vector<BatchEncryptor::Item> items;
+    items.reserve(m_source.size());
+    for (size_t row = 0; row < m_source.size(); ++row) {
+        items.push_back({m_paths[m_source[row]].toStdString(), m_paths[m_output[row]].toStdString()});
+    }
+    return items;
+}
+
+void BatchFileModel::resetProgress()
+{
+    // Reports still waiting belong to the previous run
+    flush();
+    
+    std::fill(m_state.begin(), m_state.end(), static_cast<uint8_t>(Status::Pending));
+    std::fill(m_progress.begin(), m_progress.end(), 0.0f);
+    std::fill(m_throughput.begin(), m_throughput.end(), 0.0f);
+    std::fill(m_error.begin(), m_error.end(), 0);
+    m_errors.resize(1);
+    
+    if (rowCount() > 0) {
+        emit dataChanged(index(0, StatusColumn), index(rowCount() - 1, ProgressColumn));
+    }
+}
+
+void BatchFileModel::post(const BatchEncryptor::Progress& progress)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.push_back({static_cast<uint32_t>(progress.itemIndex), progress.itemStatus, progress.itemProgress});
+    }
+    scheduleFlush();
+}
+
+void BatchFileModel::postError(int row, const QString& error)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pendingErrors.push_back({row, error});
+    }
+    scheduleFlush();
+}
+
+int BatchFileModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : static_cast<int>(m_source.size());
+}
+
+int BatchFileModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant BatchFileModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    
+    size_t row = static_cast<size_t>(index.row());
+    Status status = static_cast<Status>(m_state[row]);
+    switch (role) {
+        case Qt::DisplayRole:
+            switch (index.column()) {
+                case SourceColumn:
+                    return m_paths[m_source[row]];
+                case OutputColumn:
+                    return m_paths[m_output[row]];
+                case SizeColumn:
+                    return FileListModel::formatSize(m_size[row]);
+                case StatusColumn:
+                    return statusText(status);
+                case ProgressColumn:
+                    if (status == Status::Running) {
+                        QString text = QString("%1%").arg(static_cast<int>(m_progress[row] * 100));
+                        if (m_throughput[row] > 0.0f) {
+                            text += QString(" - %1 MB/s").arg(m_throughput[row], 0, 'f', 1);
+                        }
+                        return text;
+                    }
+                    if (status == Status::Succeeded && m_throughput[row] > 0.0f) {
+                        return QString("%1 MB/s").arg(m_throughput[row], 0, 'f', 1);
+                    }
+                    return QString();
+            }
+            break;
+        
+        case Qt::ToolTipRole:
+            if (index.column() == StatusColumn && m_error[row] != 0) {
+                return m_errors[m_error[row]];
+            }
+            if (index.column() == SourceColumn || index.column() == OutputColumn) {
+                return data(index, Qt::DisplayRole);
+            }
+            break;
+        
+        case Qt::TextAlignmentRole:
+            if (index.column() == SizeColumn) {
+                return int(Qt::AlignRight | Qt::AlignVCenter);
+            }
+            break;
+    }
+    return QVariant();
+}
+
+QVariant BatchFileModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    
+    switch (section) {
+        case SourceColumn:
+            return QString("File");
+        case OutputColumn:
+            return QString("Output");
+        case SizeColumn:
+            return QString("Size");
+        case StatusColumn:
+            return QString("Status");
+        case ProgressColumn:
+            return QString("Progress");
+    }
+    return QVariant();
+}
+
+bool BatchFileModel::removeRows(int row, int count, const QModelIndex& parent)
+{
+    if (parent.isValid() || row < 0 || count <= 0 || row + count > rowCount()) {
+        return false;
+    }
+    
+    // Waiting reports refer to rows as they are now
+    flush();
+    
+    if (count == rowCount()) {
+        clear();
+        return true;
+    }
+    
+    beginRemoveRows(QModelIndex(), row, row + count - 1);
+    auto eraseRows = [row, count](auto& column) {
+        column.erase(column.begin() + row, column.begin() + row + count);
+    };
+    eraseRows(m_source);
+    eraseRows(m_output);
+    eraseRows(m_size);
+    eraseRows(m_state);
+    eraseRows(m_progress);
+    eraseRows(m_throughput);
+    eraseRows(m_started);
+    eraseRows(m_error);
+    endRemoveRows();
+    return true;
+}
+
+void BatchFileModel::scheduleFlush()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        if (m_flushScheduled) {
+            return;
+        }
+        m_flushScheduled = true;
+    }
+    
+    // One queued call per interval, however many reports arrive meanwhile
+    QMetaObject::invokeMethod(this, [this]() {
+        if (!m_flushTimer.isActive()) {
+            m_flushTimer.start();
+        }
+    }, Qt::QueuedConnection);
+}
+
+void BatchFileModel::flush()
+{
+    std::vector<Update> pending;
+    std::vector<ErrorUpdate> pendingErrors;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        pending.swap(m_pending);
+        pendingErrors.swap(m_pendingErrors);
+        m_flushScheduled = false;
+    }
+    
+    const size_t rows = m_source.size();
+    size_t first = rows;
+    size_t last = 0;
+    qint64 now = m_clock.elapsed();
+    
+    for (const Update& update : pending) {
+        size_t row = update.row;
+        if (row >= rows) {
+            continue;
+        }
+        
+        Status previous = static_cast<Status>(m_state[row]);
+        if (update.status == Status::Running && previous != Status::Running) {
+            m_started[row] = now;
+            m_throughput[row] = 0.0f;
+        }
+        
+        m_state[row] = static_cast<uint8_t>(update.status);
+        m_progress[row] = update.status == Status::Succeeded ? 1.0f : update.progress;
+        
+        // Measured from the first report seen, so at most one interval late
+        qint64 elapsed = now - m_started[row];
+        if ((update.status == Status::Running || update.status == Status::Succeeded) &&
+            previous == Status::Running && elapsed > 0) {
+            double megabytes = m_progress[row] * m_size[row] / (1024.0 * 1024.0);
+            m_throughput[row] = static_cast<float>(megabytes * 1000.0 / elapsed);
+        }
+        
+        first = std::min(first, row);
+        last = std::max(last, row);
+    }
+    
+    for (const ErrorUpdate& update : pendingErrors) {
+        size_t row = static_cast<size_t>(update.row);
+        if (update.row < 0 || row >= rows) {
+            continue;
+        }
+        
+        m_errors.push_back(update.error);
+        m_error[row] = static_cast<uint32_t>(m_errors.size() - 1);
+        first = std::min(first, row);
+        last = std::max(last, row);
+    }
+    
+    // One range for everything, instead of a signal per report
+    if (first <= last && first < rows) {
+        emit dataChanged(index(static_cast<int>(first), StatusColumn),
+                         index(static_cast<int>(last), ProgressColumn));
+    }
+}
+
+BatchFileModel::PathId BatchFileModel::addPath(const QString& path)
+{
+    m_paths.push_back(path);
+    return static_cast<PathId>(m_paths.size() - 1);
+}
+
+} // namespace crusty
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <QAbstractTableModel>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "../core/batch_encryptor.h"
+
+namespace crusty {
+
+/**
+ * @brief Files of the batch tab and their progress while a batch runs
+ * 
+ * Rows are kept as parallel arrays (path ids, sizes, states, progress,
+ * throughput) rather than as an item per cell, so a batch of 50k files
+ * costs a few dozen bytes per row beyond its paths.
+ * 
+ * Progress is reported with post(), from any thread and as often as the
+ * engine likes. Reports are collected and applied on the GUI thread at
+ * most every UPDATE_INTERVAL_MS, each time as one dataChanged() over the
+ * rows that changed, so the view repaints once per interval however many
+ * files are in flight.
+ */
+class BatchFileModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    enum Column {
+        SourceColumn,
+        OutputColumn,
+        SizeColumn,
+        StatusColumn,
+        ProgressColumn,
+        ColumnCount
+    };
+    
+    /**
+     * @brief Constructor
+     * 
+     * @param parent Parent object
+     */
+    explicit BatchFileModel(QObject* parent = nullptr);
+    
+    /**
+     * @brief Add files at the end, all pending
+     * 
+     * @param sources Files to process
+     * @param operation Operation that picks their default outputs
+     */
+    void addFiles(const QStringList& sources, BatchEncryptor::Operation operation);
+    
+    /**
+     * @brief Remove every file
+     */
+    void clear();
+    
+    /**
+     * @return Files in row order, for BatchEncryptor::run()
+     */
+    std::vector<BatchEncryptor::Item> items() const;
+    
+    /**
+     * @brief Mark every file pending again and forget earlier errors
+     */
+    void resetProgress();
+    
+    /**
+     * @brief Report the progress of one file
+     * 
+     * Thread-safe; applied on the GUI thread with the next update.
+     * 
+     * @param progress Progress as passed to the batch callback; its item
+     *                 index is the row
+     */
+    void post(const BatchEncryptor::Progress& progress);
+    
+    /**
+     * @brief Attach the reason a file failed, shown as the status tooltip
+     * 
+     * Thread-safe; applied on the GUI thread with the next update.
+     * 
+     * @param row Row of the file
+     * @param error Reason
+     */
+    void postError(int row, const QString& error);
+    
+    // QAbstractTableModel
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool removeRows(int row, int count, const QModelIndex& parent = QModelIndex()) override;
+    
+    // Reports are applied this often at most; fast enough to look live
+    static constexpr int UPDATE_INTERVAL_MS = 100;
+
+private:
+    using PathId = uint32_t;
+    
+    struct Update {
+        uint32_t row;
+        BatchEncryptor::Status status;
+        float progress;
+    };
+    
+    struct ErrorUpdate {
+        int row;
+        QString error;
+    };
+    
+    void scheduleFlush();
+    void flush();
+    PathId addPath(const QString& path);
+    
+    // Paths by id; rows refer to them instead of holding strings. Paths of
+    // removed rows stay until the model is emptied
+    std::vector<QString> m_paths;
+    
+    // One entry per row
+    std::vector<PathId> m_source;
+    std::vector<PathId> m_output;
+    std::vector<qint64> m_size;
+    std::vector<uint8_t> m_state;        // BatchEncryptor::Status
+    std::vector<float> m_progress;       // 0..1
+    std::vector<float> m_throughput;     // MB/s while running, average once done
+    std::vector<qint64> m_started;       // ms on m_clock, for the throughput
+    std::vector<uint32_t> m_error;       // Index into m_errors, 0 for none
+    
+    std::vector<QString> m_errors;       // Failure reasons; the first is empty
+    QElapsedTimer m_clock;
+    
+    // Reports waiting for the GUI thread
+    std::mutex m_pendingMutex;
+    std::vector<Update> m_pending;
+    std::vector<ErrorUpdate> m_pendingErrors;
+    bool m_flushScheduled = false;
+    
+    QTimer m_flushTimer;
+};
+
+} // namespace crusty
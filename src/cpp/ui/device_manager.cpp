@@ -0,0 +1,60 @@
+#include "device_manager.h"
+#include "../core/audit_log.h"
+#include "../core/serial_port.h"
+
+namespace crusty {
+
+DeviceManager::DeviceManager(QObject* parent)
+    : QObject(parent),
+      m_worker(std::make_unique<JobQueue>(1))
+{
+}
+
+DeviceManager::~DeviceManager()
+{
+    // Jobs post to the manager and use the link
+    m_worker.reset();
+}
+
+void DeviceManager::refresh()
+{
+    m_worker->submit("List serial ports",
+        [this](uint64_t, const std::shared_ptr<const CancellationToken>&) {
+            QStringList ports;
+            for (const std::string& port : SerialPort::availablePorts()) {
+                ports.append(QString::fromStdString(port));
+            }
+            QMetaObject::invokeMethod(this, [this, ports]() {
+                emit portsListed(ports);
+            }, Qt::QueuedConnection);
+        });
+}
+
+void DeviceManager::connectTo(const QString& port)
+{
+    m_worker->submit("Connect to " + port.toStdString(),
+        [this, port](uint64_t, const std::shared_ptr<const CancellationToken>&) {
+            // Close the previous port first; the new one may be the same
+            m_link.reset();
+            try {
+                auto link = std::make_unique<DeviceLink>(SerialPort::open(port.toStdString()));
+                link->connect();
+                DeviceLink::DeviceInfo info = link->info();
+                m_link = std::move(link);
+                LOG_EVENT(Info, "Device connected", {"port", port.toStdString()},
+                          {"protocol_version", std::to_string(info.protocolVersion)});
+                QMetaObject::invokeMethod(this, [this, port, info]() {
+                    emit connected(port, info);
+                }, Qt::QueuedConnection);
+            } catch (const EncryptionException& e) {
+                QString error = QString::fromUtf8(e.what());
+                LOG_EVENT(Warning, "Device connection failed", {"port", port.toStdString()},
+                          {"error", std::string(e.what())});
+                QMetaObject::invokeMethod(this, [this, port, error]() {
+                    emit connectionFailed(port, error);
+                }, Qt::QueuedConnection);
+            }
+        });
+}
+
+} // namespace crusty
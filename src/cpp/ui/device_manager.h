@@ -0,0 +1,84 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+#include <memory>
+
+#include "../core/device_link.h"
+#include "../core/job_queue.h"
+
+namespace crusty {
+
+/**
+ * @brief Finds boards on serial ports and keeps the link to one of them
+ * 
+ * Port listing and the connection handshake run on a worker, so a board
+ * that does not answer never stalls the window; results arrive through
+ * signals on the GUI thread. The link itself lives and is used only on
+ * the worker.
+ */
+class DeviceManager : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * 
+     * @param parent Parent object
+     */
+    explicit DeviceManager(QObject* parent = nullptr);
+    
+    /**
+     * @brief Destructor; waits for the operation in progress and closes the link
+     */
+    ~DeviceManager() override;
+    
+    /**
+     * @brief List the serial ports a board could be on
+     */
+    void refresh();
+    
+    /**
+     * @brief Open a port and run the link handshake, replacing any current link
+     * 
+     * The board must have been switched to the binary link with its LINK
+     * command.
+     * 
+     * @param port Port name from portsListed()
+     */
+    void connectTo(const QString& port);
+
+signals:
+    /**
+     * @brief Ports found by refresh()
+     * 
+     * @param ports Port names
+     */
+    void portsListed(const QStringList& ports);
+    
+    /**
+     * @brief The board on a port answered the handshake
+     * 
+     * @param port Port name
+     * @param info What the board reported
+     */
+    void connected(const QString& port, const DeviceLink::DeviceInfo& info);
+    
+    /**
+     * @brief A port could not be opened or the board did not answer
+     * 
+     * @param port Port name
+     * @param error Why
+     */
+    void connectionFailed(const QString& port, const QString& error);
+
+private:
+    // Only used on the worker
+    std::unique_ptr<DeviceLink> m_link;
+    
+    std::unique_ptr<JobQueue> m_worker;
+};
+
+} // namespace crusty
@@ -0,0 +1,185 @@
+#include "file_details_panel.h"
+
+#include <QFileInfo>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QStyle>
+#include <QVBoxLayout>
+
+namespace crusty {
+
+namespace {
+
+const char* DATE_FORMAT = "yyyy-MM-dd hh:mm:ss";
+const char* PENDING_TEXT = "...";
+
+QString detailedSize(qint64 size)
+{
+    if (size < 1024) {
+        return QString("%1 bytes").arg(size);
+    } else if (size < 1024 * 1024) {
+        return QString("%1 KB (%2 bytes)").arg(size / 1024.0, 0, 'f', 2).arg(size);
+    } else if (size < 1024 * 1024 * 1024) {
+        return QString("%1 MB (%2 bytes)").arg(size / (1024.0 * 1024.0), 0, 'f', 2).arg(size);
+    }
+    return QString("%1 GB (%2 bytes)").arg(size / (1024.0 * 1024.0 * 1024.0), 0, 'f', 2).arg(size);
+}
+
+} // anonymous namespace
+
+FileDetailsPanel::FileDetailsPanel(QWidget* parent)
+    : QWidget(parent)
+{
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    QLabel* header = new QLabel("File Details", this);
+    header->setProperty("class", "section-header");
+    layout->addWidget(header);
+    
+    m_content = new QWidget(this);
+    QVBoxLayout* contentLayout = new QVBoxLayout(m_content);
+    contentLayout->setContentsMargins(0, 0, 0, 0);
+    
+    // File details
+    QFormLayout* formLayout = new QFormLayout();
+    m_name = new QLabel(m_content);
+    m_type = new QLabel(m_content);
+    m_sizeLabel = new QLabel("Size:", m_content);
+    m_size = new QLabel(m_content);
+    m_created = new QLabel(m_content);
+    m_modified = new QLabel(m_content);
+    m_location = new QLabel(m_content);
+    m_location->setWordWrap(true);
+    formLayout->addRow("Name:", m_name);
+    formLayout->addRow("Type:", m_type);
+    formLayout->addRow(m_sizeLabel, m_size);
+    formLayout->addRow("Created:", m_created);
+    formLayout->addRow("Modified:", m_modified);
+    formLayout->addRow("Path:", m_location);
+    
+    // Encrypted container details, read from its header and trailer
+    m_container = new QGroupBox("Encrypted Container", m_content);
+    QFormLayout* containerLayout = new QFormLayout(m_container);
+    m_format = new QLabel(m_container);
+    m_chunks = new QLabel(m_container);
+    m_plaintext = new QLabel(m_container);
+    m_kdf = new QLabel(m_container);
+    m_kdf->setWordWrap(true);
+    m_integrity = new QLabel(m_container);
+    m_integrity->setWordWrap(true);
+    containerLayout->addRow("Format:", m_format);
+    containerLayout->addRow("Chunks:", m_chunks);
+    containerLayout->addRow("Original size:", m_plaintext);
+    containerLayout->addRow("Key derivation:", m_kdf);
+    containerLayout->addRow("Structure:", m_integrity);
+    m_container->hide();
+    
+    // Actions section
+    QLabel* actionsLabel = new QLabel("Actions", m_content);
+    actionsLabel->setProperty("class", "section-header");
+    
+    QHBoxLayout* actionsLayout = new QHBoxLayout();
+    m_encryptButton = new QPushButton("Encrypt", m_content);
+    m_encryptButton->setIcon(style()->standardIcon(QStyle::SP_DialogSaveButton));
+    m_decryptButton = new QPushButton("Decrypt", m_content);
+    m_decryptButton->setIcon(style()->standardIcon(QStyle::SP_FileIcon));
+    actionsLayout->addWidget(m_encryptButton);
+    actionsLayout->addWidget(m_decryptButton);
+    
+    contentLayout->addLayout(formLayout);
+    contentLayout->addWidget(m_container);
+    contentLayout->addSpacing(20);
+    contentLayout->addWidget(actionsLabel);
+    contentLayout->addLayout(actionsLayout);
+    
+    layout->addWidget(m_content);
+    layout->addStretch();
+    m_content->hide();
+    
+    connect(m_encryptButton, &QPushButton::clicked, this, [this]() {
+        emit encryptRequested(m_path);
+    });
+    connect(m_decryptButton, &QPushButton::clicked, this, [this]() {
+        emit decryptRequested(m_path);
+    });
+}
+
+void FileDetailsPanel::showPending(const QString& path)
+{
+    // Both only take the path apart; nothing here touches the disk
+    QFileInfo info(path);
+    m_path = path;
+    m_name->setText(info.fileName());
+    m_location->setText(info.absolutePath());
+    m_type->setText(PENDING_TEXT);
+    m_size->setText(PENDING_TEXT);
+    m_created->setText(PENDING_TEXT);
+    m_modified->setText(PENDING_TEXT);
+    setSizeVisible(true);
+    m_container->hide();
+    m_content->show();
+}
+
+void FileDetailsPanel::showDetails(const FileDetails& details)
+{
+    if (details.path != m_path) {
+        return;
+    }
+    
+    if (!details.exists) {
+        m_type->setText("Not found");
+        m_created->clear();
+        m_modified->clear();
+        setSizeVisible(false);
+        m_container->hide();
+        return;
+    }
+    
+    m_type->setText(details.type);
+    m_size->setText(detailedSize(details.size));
+    setSizeVisible(!details.isDir);
+    m_created->setText(details.created.toString(DATE_FORMAT));
+    m_modified->setText(details.modified.toString(DATE_FORMAT));
+    
+    if (!details.isContainer) {
+        m_container->hide();
+        return;
+    }
+    
+    if (!details.containerError.isEmpty()) {
+        m_format->setText("Unreadable");
+        m_chunks->clear();
+        m_plaintext->clear();
+        m_kdf->clear();
+        m_integrity->setText("Damaged: " + details.containerError);
+    } else {
+        const container::ContainerSummary& summary = details.container;
+        QString format = QString("Version %1, %2 KB chunks")
+            .arg(summary.header.version)
+            .arg(summary.header.chunkSize / 1024);
+        if (summary.header.compression != Compression::None) {
+            format += QString(", %1 compressed").arg(compression::name(summary.header.compression));
+        }
+        if (container::isIncremental(summary.header)) {
+            format += ", incremental";
+        }
+        m_format->setText(format);
+        m_chunks->setText(QString::number(summary.chunkCount));
+        m_plaintext->setText(detailedSize(static_cast<qint64>(summary.plaintextSize)));
+        m_kdf->setText(QString("Argon2id, %1 MB memory, %2 iterations, %3 lanes")
+            .arg(summary.header.kdf.memoryKib / 1024.0, 0, 'f', 1)
+            .arg(summary.header.kdf.iterations)
+            .arg(summary.header.kdf.parallelism));
+        m_integrity->setText(summary.layoutMatches
+            ? QString("Header and chunk index consistent")
+            : QString("File size does not match the chunk index"));
+    }
+    m_container->show();
+}
+
+void FileDetailsPanel::setSizeVisible(bool visible)
+{
+    m_sizeLabel->setVisible(visible);
+    m_size->setVisible(visible);
+}
+
+} // namespace crusty
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <QGroupBox>
+#include <QLabel>
+#include <QPushButton>
+#include <QString>
+#include <QWidget>
+
+#include "file_inspector.h"
+
+namespace crusty {
+
+/**
+ * @brief Right-hand panel describing the selected file
+ * 
+ * Its widgets are created once; selecting another file only changes their
+ * text. The encrypted-container section is shown for containers only.
+ */
+class FileDetailsPanel : public QWidget {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * 
+     * @param parent Parent widget
+     */
+    explicit FileDetailsPanel(QWidget* parent = nullptr);
+    
+    /**
+     * @brief Show a file whose details are still being read
+     * 
+     * @param path Absolute path of the file
+     */
+    void showPending(const QString& path);
+    
+    /**
+     * @brief Show details read by a FileInspector
+     * 
+     * Ignored unless they are for the file last passed to showPending().
+     * 
+     * @param details Details of the file
+     */
+    void showDetails(const FileDetails& details);
+    
+    /**
+     * @return File being shown, or an empty string
+     */
+    QString path() const { return m_path; }
+
+signals:
+    /**
+     * @brief The user asked to encrypt the file shown
+     */
+    void encryptRequested(const QString& path);
+    
+    /**
+     * @brief The user asked to decrypt the file shown
+     */
+    void decryptRequested(const QString& path);
+
+private:
+    void setSizeVisible(bool visible);
+    
+    QString m_path;
+    QWidget* m_content;   // Hidden until a file is selected
+    
+    QLabel* m_name;
+    QLabel* m_type;
+    QLabel* m_size;
+    QLabel* m_sizeLabel;
+    QLabel* m_created;
+    QLabel* m_modified;
+    QLabel* m_location;
+    
+    QGroupBox* m_container;
+    QLabel* m_format;
+    QLabel* m_chunks;
+    QLabel* m_plaintext;
+    QLabel* m_kdf;
+    QLabel* m_integrity;
+    
+    QPushButton* m_encryptButton;
+    QPushButton* m_decryptButton;
+};
+
+} // namespace crusty
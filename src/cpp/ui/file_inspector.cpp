@@ -0,0 +1,107 @@
+#include "file_inspector.h"
+#include "../core/audit_log.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+
+namespace crusty {
+
+FileInspector::FileInspector(QObject* parent)
+    : QObject(parent),
+      m_cache(CACHE_SIZE),
+      m_worker(std::make_unique<JobQueue>(1))
+{
+}
+
+FileInspector::~FileInspector()
+{
+    // The job posts to the inspector and uses its members
+    m_worker.reset();
+}
+
+void FileInspector::inspect(const QString& path)
+{
+    if (m_job != 0) {
+        m_worker->cancel(m_job);
+    }
+    uint64_t generation = ++m_generation;
+    
+    m_job = m_worker->submit("Inspect " + path.toStdString(),
+        [this, generation, path](uint64_t, const std::shared_ptr<const CancellationToken>& token) {
+            FileDetails details = read(path, *token);
+            QMetaObject::invokeMethod(this, [this, generation, details]() {
+                // Dropped if another file was selected meanwhile
+                if (generation != m_generation) {
+                    return;
+                }
+                m_job = 0;
+                emit inspected(details);
+            }, Qt::QueuedConnection);
+        });
+}
+
+FileDetails FileInspector::read(const QString& path, const CancellationToken& token)
+{
+    QFileInfo info(path);
+    FileDetails details;
+    details.path = path;
+    details.name = info.fileName();
+    details.exists = info.exists();
+    if (!details.exists) {
+        return details;
+    }
+    
+    details.isDir = info.isDir();
+    details.type = details.isDir ? "Directory" : info.suffix().isEmpty() ? "File" : info.suffix().toUpper() + " File";
+    details.size = details.isDir ? 0 : info.size();
+    details.created = info.birthTime();
+    details.modified = info.lastModified();
+    
+    QString key = cacheKey(info);
+    {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        if (const FileDetails* cached = m_cache.object(key)) {
+            FileDetails copy = *cached;
+            copy.path = path;
+            return copy;
+        }
+    }
+    token.throwIfCancelled();
+    
+    // Anything without the magic is an ordinary file; no need to parse it
+    if (!details.isDir && details.size >= static_cast<qint64>(container::HEADER_SIZE)) {
+        QFile file(path);
+        char magic[container::MAGIC.size()];
+        if (file.open(QIODevice::ReadOnly) &&
+            file.read(magic, sizeof(magic)) == static_cast<qint64>(sizeof(magic)) &&
+            std::equal(container::MAGIC.begin(), container::MAGIC.end(), reinterpret_cast<const uint8_t*>(magic))) {
+            details.isContainer = true;
+        }
+    }
+    
+    if (details.isContainer) {
+        try {
+            details.container = m_encryptor.summarizeFile(path.toStdString());
+        } catch (const EncryptionException& e) {
+            details.containerError = QString::fromUtf8(e.what());
+            LOG_EVENT(Info, "Container header unreadable", {"path", path.toStdString()}, {"error", std::string(e.what())});
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(m_cacheMutex);
+    m_cache.insert(key, new FileDetails(details));
+    return details;
+}
+
+QString FileInspector::cacheKey(const QFileInfo& info)
+{
+    // A file rewritten in place gets a new modification time or size
+    return QString("%1|%2|%3")
+        .arg(info.absoluteFilePath())
+        .arg(info.lastModified().toMSecsSinceEpoch())
+        .arg(info.size());
+}
+
+} // namespace crusty
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QCache>
+#include <QDateTime>
+#include <QObject>
+#include <QString>
+
+#include <memory>
+#include <mutex>
+
+#include "../core/container_format.h"
+#include "../core/encryptor.h"
+#include "../core/job_queue.h"
+
+class QFileInfo;
+
+namespace crusty {
+
+/**
+ * @brief What the details panel shows about one file
+ */
+struct FileDetails {
+    QString path;
+    QString name;
+    QString type;
+    bool exists = false;
+    bool isDir = false;
+    qint64 size = 0;
+    QDateTime created;
+    QDateTime modified;
+    
+    // Set for files starting with the container magic
+    bool isContainer = false;
+    container::ContainerSummary container;
+    QString containerError;   // Why the summary could not be read
+};
+
+/**
+ * @brief Looks at selected files on a worker thread
+ * 
+ * inspect() returns at once; the file is stat'ed and, if it is an
+ * encrypted container, its header and trailer are read on a worker, and
+ * inspected() follows on the GUI thread. Only the latest request is
+ * answered: a new one withdraws the previous one.
+ * 
+ * Results are cached by path, modification time and size, so clicking
+ * back to a file costs a stat and no reads.
+ */
+class FileInspector : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * 
+     * @param parent Parent object
+     */
+    explicit FileInspector(QObject* parent = nullptr);
+    
+    /**
+     * @brief Destructor; waits for the inspection in progress
+     */
+    ~FileInspector() override;
+    
+    /**
+     * @brief Inspect a file, replacing any earlier request
+     * 
+     * @param path Absolute path of a file or directory
+     */
+    void inspect(const QString& path);
+    
+    // Files remembered; details are small, so this is a few hundred KB
+    static constexpr int CACHE_SIZE = 512;
+
+signals:
+    /**
+     * @brief Details for the latest request are ready
+     * 
+     * @param details Details of the file
+     */
+    void inspected(const FileDetails& details);
+
+private:
+    FileDetails read(const QString& path, const CancellationToken& token);
+    
+    static QString cacheKey(const QFileInfo& info);
+    
+    uint64_t m_generation = 0;
+    uint64_t m_job = 0;
+    
+    std::mutex m_cacheMutex;
+    QCache<QString, FileDetails> m_cache;
+    
+    // Only used on the worker
+    Encryptor m_encryptor;
+    
+    std::unique_ptr<JobQueue> m_worker;
+};
+
+} // namespace crusty
@@ -0,0 +1,392 @@
+#include "file_list_model.h"
+#include "main_window_constants.h"
+#include "../core/audit_log.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileIconProvider>
+#include <QFileInfo>
+#include <QHash>
+
+#include <algorithm>
+
+// Use the constants namespace
+using namespace crusty::constants;
+
+namespace crusty {
+
+namespace {
+
+constexpr int COLUMN_COUNT = 4;
+
+// Same filter the browser always used; hidden files stay hidden
+constexpr QDir::Filters LIST_FILTER = QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot;
+
+} // anonymous namespace
+
+FileListModel::FileListModel(QObject* parent)
+    : QAbstractTableModel(parent),
+      m_scanner(std::make_unique<JobQueue>(1))
+{
+    m_refreshTimer.setSingleShot(true);
+    m_refreshTimer.setInterval(REFRESH_DELAY_MS);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &FileListModel::startRefresh);
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, [this]() {
+        m_refreshTimer.start();
+    });
+}
+
+FileListModel::~FileListModel()
+{
+    // The scan posts to the model, so it stops before any member goes
+    m_scanner.reset();
+}
+
+void FileListModel::setDirectory(const QString& directory)
+{
+    if (m_scanJob != 0) {
+        m_scanner->cancel(m_scanJob);
+    }
+    ++m_generation;
+    
+    beginResetModel();
+    m_entries.clear();
+    m_visible = 0;
+    m_wanted = FETCH_BATCH;
+    m_directory = directory;
+    endResetModel();
+    
+    // Watch only the directory on show
+    if (!m_watcher.directories().isEmpty()) {
+        m_watcher.removePaths(m_watcher.directories());
+    }
+    m_watcher.addPath(directory);
+    m_refreshTimer.stop();
+    m_refreshQueued = false;
+    
+    startScan();
+}
+
+int FileListModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_visible;
+}
+
+int FileListModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : COLUMN_COUNT;
+}
+
+QVariant FileListModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_visible) {
+        return QVariant();
+    }
+    
+    const Entry& entry = m_entries[index.row()];
+    switch (role) {
+        case Qt::DisplayRole:
+            switch (index.column()) {
+                case FILE_NAME_COLUMN:
+                    return entry.name;
+                case FILE_SIZE_COLUMN:
+                    return entry.isDir ? QString("<DIR>") : formatSize(entry.size);
+                case FILE_DATE_COLUMN:
+                    return entry.modified.toString("yyyy-MM-dd hh:mm:ss");
+                case FILE_PATH_COLUMN:
+                    return pathOf(entry);
+            }
+            break;
+        
+        case FILE_SORT_ROLE:
+            // Sizes and dates sort by value rather than by their text
+            switch (index.column()) {
+                case FILE_NAME_COLUMN:
+                    return entry.name;
+                case FILE_SIZE_COLUMN:
+                    return entry.isDir ? qint64(-1) : entry.size;
+                case FILE_DATE_COLUMN:
+                    return entry.modified;
+                case FILE_PATH_COLUMN:
+                    return pathOf(entry);
+            }
+            break;
+        
+        case Qt::DecorationRole:
+            if (index.column() == FILE_NAME_COLUMN) {
+                return iconFor(entry, pathOf(entry));
+            }
+            break;
+    }
+    return QVariant();
+}
+
+QVariant FileListModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    
+    switch (section) {
+        case FILE_NAME_COLUMN:
+            return QString("Name");
+        case FILE_SIZE_COLUMN:
+            return QString("Size");
+        case FILE_DATE_COLUMN:
+            return QString("Date");
+        case FILE_PATH_COLUMN:
+            return QString("Path");
+    }
+    return QVariant();
+}
+
+bool FileListModel::canFetchMore(const QModelIndex& parent) const
+{
+    // While scanning, a view at the bottom keeps asking, so the next
+    // batch shows up without another scroll
+    return !parent.isValid() && (m_visible < static_cast<int>(m_entries.size()) || m_scanning);
+}
+
+void FileListModel::fetchMore(const QModelIndex& parent)
+{
+    if (parent.isValid()) {
+        return;
+    }
+    
+    m_wanted = m_visible + FETCH_BATCH;
+    revealPending();
+}
+
+void FileListModel::startScan()
+{
+    m_scanning = true;
+    uint64_t generation = m_generation;
+    QString directory = m_directory;
+    
+    m_scanJob = m_scanner->submit("Scan " + directory.toStdString(),
+        [this, generation, directory](uint64_t, const std::shared_ptr<const CancellationToken>& token) {
+            QFileInfo info(directory);
+            if (!info.isDir() || !info.isReadable()) {
+                QString error = "Cannot read directory: " + directory;
+                QMetaObject::invokeMethod(this, [this, generation, error]() {
+                    finishScan(generation, error);
+                }, Qt::QueuedConnection);
+                return;
+            }
+            
+            // The iterator reads the directory as it goes, unlike entryInfoList
+            QDirIterator it(directory, LIST_FILTER);
+            std::vector<Entry> batch;
+            batch.reserve(SCAN_BATCH);
+            while (it.hasNext()) {
+                token->throwIfCancelled();
+                it.next();
+                batch.push_back(entryFor(it.fileInfo()));
+                
+                if (batch.size() == static_cast<size_t>(SCAN_BATCH)) {
+                    QMetaObject::invokeMethod(this, [this, generation, entries = std::move(batch)]() mutable {
+                        addEntries(generation, std::move(entries));
+                    }, Qt::QueuedConnection);
+                    batch = std::vector<Entry>();
+                    batch.reserve(SCAN_BATCH);
+                }
+            }
+            
+            QMetaObject::invokeMethod(this, [this, generation, entries = std::move(batch)]() mutable {
+                addEntries(generation, std::move(entries));
+                finishScan(generation, QString());
+            }, Qt::QueuedConnection);
+        });
+}
+
+void FileListModel::startRefresh()
+{
+    // Compared against a listing that is still arriving, a rescan would
+    // report its missing part as new
+    if (m_scanning) {
+        m_refreshQueued = true;
+        return;
+    }
+    
+    m_scanning = true;
+    uint64_t generation = m_generation;
+    QString directory = m_directory;
+    
+    // Entries are implicitly shared, so the copy is cheap; indices into it
+    // stay valid because nothing else changes the entries meanwhile
+    m_scanJob = m_scanner->submit("Rescan " + directory.toStdString(),
+        [this, generation, directory, previous = m_entries](uint64_t, const std::shared_ptr<const CancellationToken>& token) {
+            QHash<QString, int> indexOf;
+            indexOf.reserve(static_cast<int>(previous.size()));
+            for (size_t i = 0; i < previous.size(); ++i) {
+                indexOf.insert(previous[i].name, static_cast<int>(i));
+            }
+            
+            Delta delta;
+            std::vector<bool> seen(previous.size(), false);
+            QDirIterator it(directory, LIST_FILTER);
+            while (it.hasNext()) {
+                token->throwIfCancelled();
+                it.next();
+                Entry entry = entryFor(it.fileInfo());
+                
+                auto found = indexOf.constFind(entry.name);
+                if (found == indexOf.constEnd()) {
+                    delta.added.push_back(std::move(entry));
+                    continue;
+                }
+                
+                const Entry& old = previous[found.value()];
+                seen[found.value()] = true;
+                if (old.size != entry.size || old.modified != entry.modified || old.isDir != entry.isDir) {
+                    delta.changed.emplace_back(found.value(), std::move(entry));
+                }
+            }
+            for (size_t i = 0; i < seen.size(); ++i) {
+                if (!seen[i]) {
+                    delta.removed.push_back(static_cast<int>(i));
+                }
+            }
+            
+            QMetaObject::invokeMethod(this, [this, generation, delta = std::move(delta)]() mutable {
+                applyDelta(generation, std::move(delta));
+            }, Qt::QueuedConnection);
+        });
+}
+
+void FileListModel::addEntries(uint64_t generation, std::vector<Entry> entries)
+{
+    if (generation != m_generation || entries.empty()) {
+        return;
+    }
+    
+    m_entries.insert(m_entries.end(),
+                     std::make_move_iterator(entries.begin()),
+                     std::make_move_iterator(entries.end()));
+    revealPending();
+}
+
+void FileListModel::finishScan(uint64_t generation, const QString& error)
+{
+    if (generation != m_generation) {
+        return;
+    }
+    
+    m_scanning = false;
+    m_scanJob = 0;
+    if (!error.isEmpty()) {
+        LOG_EVENT(Warning, "Directory scan failed", {"path", m_directory.toStdString()});
+        emit scanFailed(error);
+    } else {
+        LOG_EVENT(Info, "Directory scanned", {"path", m_directory.toStdString()}, {"entries", m_entries.size()});
+        emit scanFinished(static_cast<int>(m_entries.size()));
+    }
+    
+    if (m_refreshQueued) {
+        m_refreshQueued = false;
+        startRefresh();
+    }
+}
+
+void FileListModel::applyDelta(uint64_t generation, Delta delta)
+{
+    if (generation != m_generation) {
+        return;
+    }
+    
+    // Indices refer to the entries as they were when the rescan started
+    for (auto& [row, entry] : delta.changed) {
+        m_entries[row] = std::move(entry);
+        if (row < m_visible) {
+            emit dataChanged(index(row, 0), index(row, COLUMN_COUNT - 1));
+        }
+    }
+    
+    // Remove from the back, one contiguous run at a time
+    for (auto it = delta.removed.rbegin(); it != delta.removed.rend();) {
+        int last = *it;
+        int first = last;
+        for (++it; it != delta.removed.rend() && *it == first - 1; ++it) {
+            first = *it;
+        }
+        
+        // Only the part of the run that is already a row concerns the view
+        int lastRow = std::min(last, m_visible - 1);
+        if (first <= lastRow) {
+            beginRemoveRows(QModelIndex(), first, lastRow);
+        }
+        m_entries.erase(m_entries.begin() + first, m_entries.begin() + last + 1);
+        if (first <= lastRow) {
+            m_visible -= lastRow - first + 1;
+            endRemoveRows();
+        }
+    }
+    
+    m_scanning = false;
+    m_scanJob = 0;
+    addEntries(generation, std::move(delta.added));
+    
+    if (m_refreshQueued) {
+        m_refreshQueued = false;
+        startRefresh();
+    }
+}
+
+void FileListModel::revealPending()
+{
+    int target = std::min(static_cast<int>(m_entries.size()), m_wanted);
+    if (target <= m_visible) {
+        return;
+    }
+    
+    beginInsertRows(QModelIndex(), m_visible, target - 1);
+    m_visible = target;
+    endInsertRows();
+}
+
+QString FileListModel::formatSize(qint64 size)
+{
+    if (size < 1024) {
+        return QString("%1 B").arg(size);
+    } else if (size < 1024 * 1024) {
+        return QString("%1 KB").arg(size / 1024.0, 0, 'f', 2);
+    } else if (size < 1024 * 1024 * 1024) {
+        return QString("%1 MB").arg(size / (1024.0 * 1024.0), 0, 'f', 2);
+    }
+    return QString("%1 GB").arg(size / (1024.0 * 1024.0 * 1024.0), 0, 'f', 2);
+}
+
+QString FileListModel::pathOf(const Entry& entry) const
+{
+    return QDir(m_directory).filePath(entry.name);
+}
+
+FileListModel::Entry FileListModel::entryFor(const QFileInfo& info)
+{
+    Entry entry;
+    entry.name = info.fileName();
+    entry.isDir = info.isDir();
+    entry.size = entry.isDir ? 0 : info.size();
+    entry.modified = info.lastModified();
+    return entry;
+}
+
+QIcon FileListModel::iconFor(const Entry& entry, const QString& path)
+{
+    // Only ever used on the GUI thread, like the icon provider itself
+    static QFileIconProvider provider;
+    static QHash<QString, QIcon> icons;
+    
+    // '/' cannot be part of a suffix, so it stands for directories
+    QString key = entry.isDir ? QString("/") : QFileInfo(entry.name).suffix().toLower();
+    auto it = icons.constFind(key);
+    if (it != icons.constEnd()) {
+        return it.value();
+    }
+    
+    QIcon icon = entry.isDir ? provider.icon(QFileIconProvider::Folder) : provider.icon(QFileInfo(path));
+    icons.insert(key, icon);
+    return icon;
+}
+
+} // namespace crusty
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <QAbstractTableModel>
+#include <QDateTime>
+#include <QFileSystemWatcher>
+#include <QIcon>
+#include <QString>
+#include <QTimer>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "../core/job_queue.h"
+
+class QFileInfo;
+
+namespace crusty {
+
+/**
+ * @brief File browser model filled by a background directory scan
+ * 
+ * setDirectory() returns at once; a scan on a worker thread streams the
+ * entries back in batches. Rows are handed to the view only as it asks for
+ * them (canFetchMore/fetchMore), so a directory of 200k files costs the GUI
+ * thread the rows scrolled into view, not the whole listing. Icons are
+ * looked up once per extension and shared by every model.
+ * 
+ * The directory is watched afterwards. Changes are rescanned off the GUI
+ * thread and applied as row insertions, removals and updates, so the view
+ * keeps its selection and scroll position.
+ */
+class FileListModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor
+     * 
+     * @param parent Parent object
+     */
+    explicit FileListModel(QObject* parent = nullptr);
+    
+    /**
+     * @brief Destructor; stops the scan in progress
+     */
+    ~FileListModel() override;
+    
+    /**
+     * @brief Show another directory
+     * 
+     * Clears the rows and starts scanning; scanFinished() or scanFailed()
+     * follows. Calling it again for the same directory rescans it.
+     * 
+     * @param directory Absolute path of an existing directory
+     */
+    void setDirectory(const QString& directory);
+    
+    /**
+     * @return Directory being shown
+     */
+    QString directory() const { return m_directory; }
+    
+    // QAbstractTableModel
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+    
+    /**
+     * @return Size as shown in file lists, e.g. "1.50 MB"
+     */
+    static QString formatSize(qint64 size);
+    
+    // Rows added per fetchMore(); about a few screens full
+    static constexpr int FETCH_BATCH = 1000;
+    
+    // Entries the scanner collects before posting them to the GUI thread
+    static constexpr int SCAN_BATCH = 512;
+    
+    // Changes are collected this long before rescanning, so a directory
+    // being written to is not rescanned for every file
+    static constexpr int REFRESH_DELAY_MS = 500;
+
+signals:
+    /**
+     * @brief The first scan of the directory has finished
+     * 
+     * @param entries Number of entries found
+     */
+    void scanFinished(int entries);
+    
+    /**
+     * @brief The directory could not be read
+     * 
+     * @param error Description of the problem
+     */
+    void scanFailed(const QString& error);
+
+private:
+    struct Entry {
+        QString name;
+        qint64 size = 0;
+        QDateTime modified;
+        bool isDir = false;
+    };
+    
+    // Differences between a rescan and the entries it was given
+    struct Delta {
+        std::vector<std::pair<int, Entry>> changed;
+        std::vector<int> removed;   // Ascending
+        std::vector<Entry> added;
+    };
+    
+    void startScan();
+    void startRefresh();
+    void addEntries(uint64_t generation, std::vector<Entry> entries);
+    void finishScan(uint64_t generation, const QString& error);
+    void applyDelta(uint64_t generation, Delta delta);
+    void revealPending();
+    QString pathOf(const Entry& entry) const;
+    
+    static Entry entryFor(const QFileInfo& info);
+    static QIcon iconFor(const Entry& entry, const QString& path);
+    
+    QString m_directory;
+    std::vector<Entry> m_entries;   // Every entry found; the first m_visible are rows
+    int m_visible = 0;
+    int m_wanted = FETCH_BATCH;     // Rows the view has asked for
+    
+    // Bumped for every directory, so results of an earlier one are dropped
+    uint64_t m_generation = 0;
+    uint64_t m_scanJob = 0;
+    bool m_scanning = false;
+    bool m_refreshQueued = false;
+    
+    QFileSystemWatcher m_watcher;
+    QTimer m_refreshTimer;
+    
+    // One worker, so a rescan never runs beside the scan it compares with
+    std::unique_ptr<JobQueue> m_scanner;
+};
+
+} // namespace crusty
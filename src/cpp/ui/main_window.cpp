@@ -1,5 +1,10 @@
 #include "main_window.h"
 #include "main_window_constants.h"
+#include "file_list_model.h"
+#include "batch_file_model.h"
+#include "file_details_panel.h"
+#include "file_inspector.h"
+#include "device_manager.h"
 #include "../core/audit_log.h"
 #include "../core/path_utils.h"
 
@@ -123,8 +128,6 @@ MainWindow::MainWindow(QWidget *parent)
     
     // Set up status bar
     statusBar()->addWidget(m_statusLabel = new QLabel(this));
-    statusBar()->addPermanentWidget(m_progressBar = new QProgressBar(this));
-    m_progressBar->setVisible(false);
     
     // Set up status message timer
     m_statusTimer.setSingleShot(true);
@@ -132,9 +135,21 @@ MainWindow::MainWindow(QWidget *parent)
         m_statusLabel->clear();
     });
     
+    // Jobs outlive the calls that queue them, so they run on workers of the window
+    m_jobQueue = std::make_unique<JobQueue>(JobQueue::DEFAULT_WORKERS, [this](const JobQueue::JobInfo& job) {
+        // Called from worker threads; the job list belongs to the GUI thread
+        QMetaObject::invokeMethod(this, [this, job]() { updateJob(job); }, Qt::QueuedConnection);
+    });
+    
     updateUiState();
 }
 
+MainWindow::~MainWindow()
+{
+    // Running jobs post to the window, so they stop before any member goes
+    m_jobQueue.reset();
+}
+
 void MainWindow::applyStyleSheet()
 {
     // Load style sheet from resources
@@ -160,11 +175,13 @@ void MainWindow::setupUi()
     // Create operation tab widget
     m_operationTabWidget = new QTabWidget(this);
     
-    // Add tabs
+    // Add tabs; the decrypt tab is filled in by file selection, so only
+    // the batch and device tabs wait until they are first shown
     m_operationTabWidget->addTab(createEncryptTab(), "Encrypt");
     m_operationTabWidget->addTab(createDecryptTab(), "Decrypt");
-    m_operationTabWidget->addTab(createBatchTab(), "Batch Processing");
-    m_operationTabWidget->addTab(createDeviceTab(), "Embedded Devices");
+    addLazyTab(&MainWindow::createBatchTab, "Batch Processing");
+    addLazyTab(&MainWindow::createDeviceTab, "Embedded Devices");
+    connect(m_operationTabWidget, &QTabWidget::currentChanged, this, &MainWindow::buildTab);
     
     // Create main splitter (below the tabs)
     m_mainSplitter = new QSplitter(Qt::Horizontal, this);
@@ -173,23 +190,20 @@ void MainWindow::setupUi()
     QWidget* fileBrowserPanel = createFileBrowserPanel();
     m_mainSplitter->addWidget(fileBrowserPanel);
     
-    // Create details panel (placeholder for now)
-    QWidget* detailsPanel = new QWidget(this);
-    QVBoxLayout* detailsLayout = new QVBoxLayout(detailsPanel);
-    QLabel* detailsLabel = new QLabel("File Details", detailsPanel);
-    detailsLabel->setProperty("class", "section-header");
-    detailsLayout->addWidget(detailsLabel);
-    detailsLayout->addStretch();
-    m_mainSplitter->addWidget(detailsPanel);
+    // Create details panel, filled in as files are selected
+    m_detailsPanel = new FileDetailsPanel(this);
+    m_inspector = new FileInspector(this);
+    m_mainSplitter->addWidget(m_detailsPanel);
     
     // Set splitter sizes
     QList<int> sizes;
     sizes << 700 << 300; // Reversed ratio from before to make file list the main component
     m_mainSplitter->setSizes(sizes);
     
-    // Add tab widget and splitter to main layout
+    // Add tab widget, splitter and job list to main layout
     mainLayout->addWidget(m_operationTabWidget);
     mainLayout->addWidget(m_mainSplitter, 1); // Give the splitter a stretch factor of 1
+    mainLayout->addWidget(createJobPanel());
     
     // Connect signals
     connect(m_encrypt.fileEdit, &QLineEdit::textChanged, this, &MainWindow::updateUiState);
@@ -201,6 +215,27 @@ void MainWindow::setupUi()
     connect(m_decrypt.passwordEdit, &QLineEdit::textChanged, this, &MainWindow::updateUiState);
     connect(m_fileTreeView, &QTreeView::clicked, this, &MainWindow::onFileSelected);
     connect(m_fileTreeView, &QTreeView::doubleClicked, this, &MainWindow::onFileDoubleClicked);
+    connect(m_inspector, &FileInspector::inspected, m_detailsPanel, &FileDetailsPanel::showDetails);
+    connect(m_detailsPanel, &FileDetailsPanel::encryptRequested, this, [this](const QString& filePath) {
+        m_operationTabWidget->setCurrentIndex(0); // Switch to encrypt tab
+        m_encrypt.fileEdit->setText(filePath);
+        if (m_encrypt.outputEdit->text().isEmpty()) {
+            m_encrypt.outputEdit->setText(filePath + ENCRYPTED_EXTENSION);
+        }
+    });
+    connect(m_detailsPanel, &FileDetailsPanel::decryptRequested, this, [this](const QString& filePath) {
+        m_operationTabWidget->setCurrentIndex(1); // Switch to decrypt tab
+        m_decrypt.fileEdit->setText(filePath);
+        if (m_decrypt.outputEdit->text().isEmpty()) {
+            QString outputPath = filePath;
+            if (outputPath.endsWith(ENCRYPTED_EXTENSION)) {
+                outputPath.chop(strlen(ENCRYPTED_EXTENSION));
+            } else {
+                outputPath += DECRYPTED_EXTENSION;
+            }
+            m_decrypt.outputEdit->setText(outputPath);
+        }
+    });
 }
 
 void MainWindow::setupToolBar()
@@ -308,14 +343,20 @@ QWidget* MainWindow::createFileBrowserPanel()
     QVBoxLayout* layout = new QVBoxLayout(panel);
     layout->setContentsMargins(0, 0, 0, 0);
     
-    // Create file model
-    m_fileModel = new QStandardItemModel(this);
-    m_fileModel->setHorizontalHeaderLabels({"Name", "Size", "Date", "Path"});
+    // Create file model; directories are scanned in the background
+    m_fileModel = new FileListModel(this);
+    connect(m_fileModel, &FileListModel::scanFinished, this, [this](int entries) {
+        showStatusMessage(QString("Loaded %1 items").arg(entries), false);
+    });
+    connect(m_fileModel, &FileListModel::scanFailed, this, [this](const QString& error) {
+        showStatusMessage(error, true);
+    });
     
     // Create sort proxy model
     m_fileSortModel = new QSortFilterProxyModel(this);
     m_fileSortModel->setSourceModel(m_fileModel);
     m_fileSortModel->setSortCaseSensitivity(Qt::CaseInsensitive);
+    m_fileSortModel->setSortRole(FILE_SORT_ROLE);
     
     // Create tree view
     m_fileTreeView = new QTreeView(this);
@@ -362,8 +403,8 @@ QWidget* MainWindow::createFileBrowserPanel()
     // Connect signals
     connect(upButton, &QPushButton::clicked, this, &MainWindow::navigateUp);
     
-    // Initial file list
-    refreshFileList();
+    // List the initial directory once the window is up
+    QTimer::singleShot(0, this, [this]() { refreshFileList(); });
     
     return panel;
 }
@@ -401,6 +442,10 @@ QWidget* MainWindow::createEncryptTab()
     m_encrypt.strengthMeter = new PasswordStrengthMeter(encryptTab);
     encryptForm->addRow("Password strength:", m_encrypt.strengthMeter);
     
+    // Key slots let passwords be added to the file later
+    m_encrypt.keySlotsCheck = new QCheckBox("Allow more passwords (key slots)", encryptTab);
+    encryptForm->addRow("", m_encrypt.keySlotsCheck);
+    
     // Add encrypt button
     m_encrypt.button = new QPushButton("Encrypt", encryptTab);
     m_encrypt.button->setEnabled(false);
@@ -471,18 +516,24 @@ QWidget* MainWindow::createBatchTab()
     QGroupBox* fileListGroup = new QGroupBox("Files to Process", batchTab);
     QVBoxLayout* fileListLayout = new QVBoxLayout(fileListGroup);
     
-    m_batch.fileModel = new QStandardItemModel(this);
-    m_batch.fileModel->setHorizontalHeaderLabels({"File", "Output", "Status"});
+    m_batch.fileModel = new BatchFileModel(this);
     
     m_batch.fileTable = new QTableView(batchTab);
     m_batch.fileTable->setModel(m_batch.fileModel);
     m_batch.fileTable->setSelectionBehavior(QAbstractItemView::SelectRows);
     m_batch.fileTable->setSelectionMode(QAbstractItemView::SingleSelection);
     m_batch.fileTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
-    m_batch.fileTable->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
-    m_batch.fileTable->horizontalHeader()->setSectionResizeMode(1, QHeaderView::Stretch);
-    m_batch.fileTable->horizontalHeader()->setSectionResizeMode(2, QHeaderView::Fixed);
-    m_batch.fileTable->setColumnWidth(2, 100);
+    m_batch.fileTable->horizontalHeader()->setSectionResizeMode(BatchFileModel::SourceColumn, QHeaderView::Stretch);
+    m_batch.fileTable->horizontalHeader()->setSectionResizeMode(BatchFileModel::OutputColumn, QHeaderView::Stretch);
+    m_batch.fileTable->horizontalHeader()->setSectionResizeMode(BatchFileModel::SizeColumn, QHeaderView::Fixed);
+    m_batch.fileTable->horizontalHeader()->setSectionResizeMode(BatchFileModel::StatusColumn, QHeaderView::Fixed);
+    m_batch.fileTable->horizontalHeader()->setSectionResizeMode(BatchFileModel::ProgressColumn, QHeaderView::Fixed);
+    m_batch.fileTable->setColumnWidth(BatchFileModel::SizeColumn, 90);
+    m_batch.fileTable->setColumnWidth(BatchFileModel::StatusColumn, 100);
+    m_batch.fileTable->setColumnWidth(BatchFileModel::ProgressColumn, 140);
+    
+    // Rows all have the same height, so the view need not measure them
+    m_batch.fileTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
     
     QHBoxLayout* fileButtonLayout = new QHBoxLayout();
     m_batch.addButton = new QPushButton("Add Files...", batchTab);
@@ -520,6 +571,25 @@ QWidget* MainWindow::createBatchTab()
     
     // Connect signals
     connect(m_batch.button, &QPushButton::clicked, this, &MainWindow::processBatch);
+    connect(m_batch.passwordEdit, &QLineEdit::textChanged, this, &MainWindow::updateUiState);
+    connect(m_batch.addButton, &QPushButton::clicked, [this]() {
+        QStringList files = QFileDialog::getOpenFileNames(
+            this, "Add Files", m_currentDirectory.isEmpty() ? QDir::homePath() : m_currentDirectory, ALL_FILES_FILTER
+        );
+        
+        auto operation = m_batch.operationCombo->currentIndex() == 0
+            ? BatchEncryptor::Operation::Encrypt
+            : BatchEncryptor::Operation::Decrypt;
+        m_batch.fileModel->addFiles(files, operation);
+        updateUiState();
+    });
+    connect(m_batch.removeButton, &QPushButton::clicked, [this]() {
+        QModelIndexList selected = m_batch.fileTable->selectionModel()->selectedRows();
+        if (!selected.isEmpty()) {
+            m_batch.fileModel->removeRow(selected.first().row());
+            updateUiState();
+        }
+    });
     
     return batchTab;
 }
@@ -576,25 +646,140 @@ QWidget* MainWindow::createDeviceTab()
     deviceLayout->addWidget(deviceListGroup);
     deviceLayout->addWidget(operationsGroup);
     
-    // Add sample devices for demonstration
-    QStandardItem* item1 = new QStandardItem("STM32H573I-DK #1");
-    QStandardItem* type1 = new QStandardItem("STM32H5 Series");
-    QStandardItem* status1 = new QStandardItem("Disconnected");
-    QStandardItem* id1 = new QStandardItem("STM32H573I-001");
-    m_device.deviceModel->appendRow({item1, type1, status1, id1});
+    // Ports are listed and boards connected on the manager's worker
+    m_deviceManager = new DeviceManager(this);
+    
+    auto setDeviceStatus = [this](const QString& port, const QString& status) {
+        for (int row = 0; row < m_device.deviceModel->rowCount(); ++row) {
+            QStandardItem* item = m_device.deviceModel->item(row, DEVICE_STATUS_COLUMN);
+            bool match = m_device.deviceModel->item(row, DEVICE_ID_COLUMN)->text() == port;
+            if (match || item->text() == "Connected") {
+                item->setText(match ? status : "Disconnected");
+            }
+        }
+    };
+    
+    auto setStatusLabel = [this](const QString& text, bool isConnected) {
+        m_device.statusLabel->setText(text);
+        m_device.statusLabel->setProperty("class", isConnected ? "device-connected" : "device-disconnected");
+        // Restyle for the new class
+        m_device.statusLabel->style()->unpolish(m_device.statusLabel);
+        m_device.statusLabel->style()->polish(m_device.statusLabel);
+    };
+    
+    connect(m_deviceManager, &DeviceManager::portsListed, this, [this](const QStringList& ports) {
+        m_device.deviceModel->removeRows(0, m_device.deviceModel->rowCount());
+        for (const QString& port : ports) {
+            m_device.deviceModel->appendRow({
+                new QStandardItem(port),
+                new QStandardItem("Serial port"),
+                new QStandardItem(port == m_connectedPort ? "Connected" : "Disconnected"),
+                new QStandardItem(port)
+            });
+        }
+        showStatusMessage(ports.isEmpty() ? "No serial ports found" : QString("Found %1 serial port(s)").arg(ports.size()));
+    });
+    
+    connect(m_deviceManager, &DeviceManager::connected, this,
+            [this, setDeviceStatus, setStatusLabel](const QString& port, const DeviceLink::DeviceInfo& info) {
+        m_connectedPort = port;
+        setDeviceStatus(port, "Connected");
+        setStatusLabel(QString("Connected to %1: protocol %2, %3-byte chunks, %4")
+                           .arg(port)
+                           .arg(info.protocolVersion)
+                           .arg(info.maxChunkSize)
+                           .arg(info.hardwareAes ? "hardware AES" : "software AES"),
+                       true);
+        showStatusMessage("Connected to " + port);
+    });
     
-    QStandardItem* item2 = new QStandardItem("STM32H573I-DK #2");
-    QStandardItem* type2 = new QStandardItem("STM32H5 Series");
-    QStandardItem* status2 = new QStandardItem("Connected");
-    QStandardItem* id2 = new QStandardItem("STM32H573I-002");
-    m_device.deviceModel->appendRow({item2, type2, status2, id2});
+    connect(m_deviceManager, &DeviceManager::connectionFailed, this,
+            [this, setDeviceStatus, setStatusLabel](const QString& port, const QString& error) {
+        m_connectedPort.clear();
+        setDeviceStatus(port, "Failed");
+        setStatusLabel("No device connected", false);
+        showStatusMessage("Failed to connect to " + port + ": " + error, true);
+    });
     
     // Connect signals
     connect(m_device.refreshButton, &QPushButton::clicked, this, &MainWindow::showDeviceManagement);
+    connect(m_device.connectButton, &QPushButton::clicked, this, [this, setDeviceStatus]() {
+        QModelIndexList selected = m_device.deviceTable->selectionModel()->selectedRows(DEVICE_ID_COLUMN);
+        if (selected.isEmpty()) {
+            showStatusMessage("Select a serial port to connect to", true);
+            return;
+        }
+        QString port = selected.first().data().toString();
+        setDeviceStatus(port, "Connecting");
+        m_deviceManager->connectTo(port);
+    });
     
     return deviceTab;
 }
 
+void MainWindow::addLazyTab(TabFactory create, const QString& label)
+{
+    QWidget* placeholder = new QWidget();
+    QVBoxLayout* layout = new QVBoxLayout(placeholder);
+    layout->setContentsMargins(0, 0, 0, 0);
+    
+    m_operationTabWidget->addTab(placeholder, label);
+    m_pendingTabs.insert(placeholder, create);
+}
+
+void MainWindow::buildTab(int index)
+{
+    QWidget* placeholder = m_operationTabWidget->widget(index);
+    auto pending = m_pendingTabs.find(placeholder);
+    if (pending == m_pendingTabs.end()) {
+        return;
+    }
+    
+    TabFactory create = pending.value();
+    m_pendingTabs.erase(pending);
+    placeholder->layout()->addWidget((this->*create)());
+    updateUiState();
+}
+
+QWidget* MainWindow::createJobPanel()
+{
+    QGroupBox* jobGroup = new QGroupBox("Jobs", this);
+    QVBoxLayout* jobLayout = new QVBoxLayout(jobGroup);
+    
+    m_jobs.model = new QStandardItemModel(this);
+    m_jobs.model->setHorizontalHeaderLabels({"Job", "Status", "Progress"});
+    
+    m_jobs.table = new QTableView(jobGroup);
+    m_jobs.table->setModel(m_jobs.model);
+    m_jobs.table->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_jobs.table->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    m_jobs.table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_jobs.table->horizontalHeader()->setSectionResizeMode(JOB_NAME_COLUMN, QHeaderView::Stretch);
+    m_jobs.table->horizontalHeader()->setSectionResizeMode(JOB_STATUS_COLUMN, QHeaderView::Fixed);
+    m_jobs.table->horizontalHeader()->setSectionResizeMode(JOB_PROGRESS_COLUMN, QHeaderView::Fixed);
+    m_jobs.table->setColumnWidth(JOB_STATUS_COLUMN, 100);
+    m_jobs.table->setColumnWidth(JOB_PROGRESS_COLUMN, 250);
+    m_jobs.table->setMaximumHeight(JOB_LIST_HEIGHT);
+    
+    QHBoxLayout* jobButtonLayout = new QHBoxLayout();
+    m_jobs.cancelButton = new QPushButton("Cancel", jobGroup);
+    m_jobs.clearButton = new QPushButton("Clear Finished", jobGroup);
+    m_jobs.cancelButton->setEnabled(false);
+    jobButtonLayout->addStretch();
+    jobButtonLayout->addWidget(m_jobs.cancelButton);
+    jobButtonLayout->addWidget(m_jobs.clearButton);
+    
+    jobLayout->addWidget(m_jobs.table);
+    jobLayout->addLayout(jobButtonLayout);
+    
+    // Connect signals
+    connect(m_jobs.cancelButton, &QPushButton::clicked, this, &MainWindow::cancelSelectedJobs);
+    connect(m_jobs.clearButton, &QPushButton::clicked, this, &MainWindow::clearFinishedJobs);
+    connect(m_jobs.table->selectionModel(), &QItemSelectionModel::selectionChanged, this, &MainWindow::updateUiState);
+    
+    return jobGroup;
+}
+
 void MainWindow::setupFileSelectors()
 {
     // Find encrypt tab browse buttons
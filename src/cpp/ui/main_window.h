@@ -22,15 +22,21 @@
 #include <QStandardItemModel>
 #include <QSortFilterProxyModel>
 #include <QStandardItemModel>
+#include <QHash>
 
 #include "../core/encryptor.h"
+#include "../core/batch_encryptor.h"
 #include "../core/file_operations.h"
+#include "../core/job_queue.h"
 
 namespace crusty {
 
 // Forward declarations
 class FilePathSelector;
 class FileListModel;
+class BatchFileModel;
+class FileDetailsPanel;
+class FileInspector;
 class PasswordStrengthMeter;
 class DeviceManager;
 
@@ -39,7 +45,7 @@ class DeviceManager;
  */
 class MainWindow : public QMainWindow {
     Q_OBJECT
-    
+
 public:
     /**
      * @brief Constructor
@@ -50,9 +56,12 @@ public:
     
     /**
      * @brief Destructor
+     * 
+     * Cancels every job and waits for the running ones to stop, so none
+     * of them outlives the window.
      */
-    ~MainWindow() override = default;
-    
+    ~MainWindow() override;
+
 private slots:
     /**
      * @brief Encrypt the selected file
@@ -69,6 +78,16 @@ private slots:
      */
     void processBatch();
     
+    /**
+     * @brief Cancel the jobs selected in the job list
+     */
+    void cancelSelectedJobs();
+    
+    /**
+     * @brief Remove finished jobs from the job list
+     */
+    void clearFinishedJobs();
+    
     /**
      * @brief Open a file or directory
      */
@@ -107,6 +126,9 @@ private slots:
     
     /**
      * @brief Show the key management dialog
+     * 
+     * Adds, removes or changes the passwords of a file encrypted with key
+     * slots. Only the file's header is rewritten, on the job queue.
      */
     void showKeyManagement();
     
@@ -119,7 +141,7 @@ private slots:
      * @brief Show about dialog
      */
     void showAbout();
-    
+
 private:
     /**
      * @brief Set up the user interface
@@ -176,6 +198,30 @@ private:
      */
     QWidget* createDeviceTab();
     
+    // One of the create*Tab() methods
+    using TabFactory = QWidget* (MainWindow::*)();
+    
+    /**
+     * @brief Add a tab whose contents are created the first time it is shown
+     * 
+     * @param create Method creating the tab's contents
+     * @param label Tab label
+     */
+    void addLazyTab(TabFactory create, const QString& label);
+    
+    /**
+     * @brief Create the contents of a tab added with addLazyTab(), if not done yet
+     * 
+     * @param index Index of the tab
+     */
+    void buildTab(int index);
+    
+    /**
+     * @brief Create the list of queued and running jobs
+     * @return The job panel widget
+     */
+    QWidget* createJobPanel();
+    
     /**
      * @brief Set up file selection dialogs with their callbacks
      */
@@ -190,27 +236,56 @@ private:
     void showStatusMessage(const QString& message, bool isError = false);
     
     /**
-     * @brief Process a cryptographic operation in a background thread
+     * @brief Queue a cryptographic operation on the job queue
+     * 
+     * The operation runs on an Encryptor of its own, cancelled through the
+     * job list, while the window stays usable.
      * 
      * @param operation The operation to perform (encrypt/decrypt)
+     * @param description Name of the job in the job list
      * @param sourcePath Source file path
      * @param destPath Destination file path
      * @param password Password for encryption/decryption
      */
     void processCryptoOperation(
         const std::function<void(
+            Encryptor&,
             const std::string&, 
             const std::string&, 
+            secure::SecureView, 
             const std::string&, 
-            const std::string&, 
-            const std::function<void(float)>&
+            const DetailedProgressCallback&
         )>& operation,
+        const QString& description,
         const QString& sourcePath,
         const QString& destPath,
         const QString& password,
         const QString& successMessage = "Operation completed successfully"
     );
     
+    /**
+     * @brief Show a job's new state in the job list
+     * 
+     * @param job Job that changed
+     */
+    void updateJob(const JobQueue::JobInfo& job);
+    
+    /**
+     * @brief Show a running job's progress in the job list
+     * 
+     * @param id Job id
+     * @param text Progress text
+     */
+    void setJobProgress(uint64_t id, const QString& text);
+    
+    /**
+     * @brief Find a job's row in the job list
+     * 
+     * @param id Job id
+     * @return Row, or -1 if the job is not listed
+     */
+    int jobRow(uint64_t id) const;
+    
     /**
      * @brief Check if the file exists and confirm overwrite if needed
      * 
@@ -223,8 +298,13 @@ private:
     QSplitter* m_mainSplitter;
     QTreeView* m_fileTreeView;
     QTabWidget* m_operationTabWidget;
-    QStandardItemModel* m_fileModel;
+    QHash<QWidget*, TabFactory> m_pendingTabs;  // Placeholders of tabs not built yet
+    FileListModel* m_fileModel;
     QSortFilterProxyModel* m_fileSortModel;
+    FileDetailsPanel* m_detailsPanel;
+    FileInspector* m_inspector;  // Reads the selected file for the details panel
+    DeviceManager* m_deviceManager = nullptr;  // Created with the device tab
+    QString m_connectedPort;         // Port of the connected board, if any
     QString m_currentDirectory;  // Current directory being displayed
     QLineEdit* m_pathEdit;       // Address bar path edit
     
@@ -244,6 +324,7 @@ private:
         QLineEdit* outputEdit;
         QLineEdit* passwordEdit;
         PasswordStrengthMeter* strengthMeter;
+        QCheckBox* keySlotsCheck;
         QPushButton* button;
     } m_encrypt;
     
@@ -258,13 +339,21 @@ private:
     // UI elements - Batch tab
     struct {
         QTableView* fileTable;
-        QStandardItemModel* fileModel;
+        BatchFileModel* fileModel;
         QPushButton* addButton;
         QPushButton* removeButton;
         QComboBox* operationCombo;
         QLineEdit* passwordEdit;
         QPushButton* button;
-    } m_batch;
+    } m_batch{};  // Null until the tab is first shown
+    
+    // UI elements - Job list
+    struct {
+        QTableView* table;
+        QStandardItemModel* model;
+        QPushButton* cancelButton;
+        QPushButton* clearButton;
+    } m_jobs;
     
     // UI elements - Device tab
     struct {
@@ -274,15 +363,15 @@ private:
         QPushButton* connectButton;
         QPushButton* installButton;
         QLabel* statusLabel;
-    } m_device;
+    } m_device{};  // Null until the tab is first shown
     
-    // Status and progress
-    QProgressBar* m_progressBar;
+    // Status
     QLabel* m_statusLabel;
     QTimer m_statusTimer;
     
-    // Core components
-    Encryptor m_encryptor;
+    // Core components; every job uses an engine of its own
+    std::unique_ptr<JobQueue> m_jobQueue;
+    uint64_t m_batchJob = 0;  // Job working on the batch table, or 0
 };
 
 /**
@@ -290,7 +379,7 @@ private:
  */
 class PasswordStrengthMeter : public QProgressBar {
     Q_OBJECT
-    
+
 public:
     /**
      * @brief Constructor
@@ -298,7 +387,7 @@ public:
      * @param parent Parent widget
      */
     explicit PasswordStrengthMeter(QWidget* parent = nullptr);
-    
+
 public slots:
     /**
      * @brief Update the strength meter based on password
@@ -306,7 +395,7 @@ public slots:
      * @param password The password to evaluate
      */
     void updateStrength(const QString& password);
-    
+
 private:
     /**
      * @brief Calculate password strength
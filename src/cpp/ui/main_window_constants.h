@@ -28,11 +28,22 @@ namespace constants {
     constexpr int FILE_SIZE_COLUMN = 1;
     constexpr int FILE_DATE_COLUMN = 2;
     constexpr int FILE_PATH_COLUMN = 3;
+    constexpr int FILE_SORT_ROLE = Qt::UserRole + 3;
     
     // Column Indices for Device Model
     constexpr int DEVICE_NAME_COLUMN = 0;
     constexpr int DEVICE_TYPE_COLUMN = 1;
     constexpr int DEVICE_STATUS_COLUMN = 2;
     constexpr int DEVICE_ID_COLUMN = 3;
+    
+    // Column Indices for Job Model
+    constexpr int JOB_NAME_COLUMN = 0;
+    constexpr int JOB_STATUS_COLUMN = 1;
+    constexpr int JOB_PROGRESS_COLUMN = 2;
+    
+    // Job list
+    constexpr int JOB_LIST_HEIGHT = 160;
+    constexpr int JOB_ID_ROLE = Qt::UserRole + 1;
+    constexpr int JOB_STATE_ROLE = Qt::UserRole + 2;
 } // namespace constants
 } // namespace crusty
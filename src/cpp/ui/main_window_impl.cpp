@@ -1,5 +1,7 @@
 #include "main_window.h"
 #include "main_window_constants.h"
+#include "file_list_model.h"
+#include "batch_file_model.h"
 #include "../core/audit_log.h"
 #include "../core/path_utils.h"
 
@@ -22,6 +24,7 @@
 #include <QIcon>
 #include <QFont>
 #include <QFileIconProvider>
+#include <QInputDialog>
 
 // Use the constants namespace
 using namespace crusty::constants;
@@ -32,6 +35,34 @@ using namespace crusty::constants;
 
 namespace crusty {
 
+namespace {
+
+// Job list text with the transfer rate and remaining time, once known
+QString progressText(const ProgressInfo& progress)
+{
+    QString text = QString("%1%").arg(static_cast<int>(progress.fraction * 100));
+    if (progress.finished || progress.bytesPerSecond <= 0.0) {
+        return text;
+    }
+    
+    text += QString(" - %1 MB/s").arg(progress.bytesPerSecond / (1024.0 * 1024.0), 0, 'f', 1);
+    if (progress.hasEta()) {
+        text += QString(", %1 s left").arg((progress.eta.count() + 999) / 1000);
+    }
+    return text;
+}
+
+// True once the job shown in a row has stopped, whatever the outcome
+bool isFinished(const QStandardItem* status)
+{
+    auto state = static_cast<JobQueue::State>(status->data(JOB_STATE_ROLE).toInt());
+    return state == JobQueue::State::Succeeded ||
+           state == JobQueue::State::Failed ||
+           state == JobQueue::State::Cancelled;
+}
+
+} // anonymous namespace
+
 // Additional implementation methods for MainWindow class
 
 void MainWindow::updateUiState()
@@ -50,11 +81,24 @@ void MainWindow::updateUiState()
         !m_decrypt.passwordEdit->text().isEmpty()
     );
     
-    // Enable batch button if password is filled
-    m_batch.button->setEnabled(
-        !m_batch.passwordEdit->text().isEmpty() &&
-        m_batch.fileModel->rowCount() > 0
-    );
+    // Enable batch button if password is filled and no batch is queued
+    if (m_batch.button != nullptr) {
+        bool batchIdle = m_batchJob == 0;
+        m_batch.button->setEnabled(
+            batchIdle &&
+            !m_batch.passwordEdit->text().isEmpty() &&
+            m_batch.fileModel->rowCount() > 0
+        );
+        m_batch.addButton->setEnabled(batchIdle);
+        m_batch.removeButton->setEnabled(batchIdle);
+    }
+    
+    // Enable cancel button if a selected job has not finished
+    bool cancellable = false;
+    for (const QModelIndex& index : m_jobs.table->selectionModel()->selectedRows()) {
+        cancellable = cancellable || !isFinished(m_jobs.model->item(index.row(), JOB_STATUS_COLUMN));
+    }
+    m_jobs.cancelButton->setEnabled(cancellable);
     
     // Update UI state based on input fields
 }
@@ -104,12 +148,14 @@ bool MainWindow::confirmFileOverwrite(const QString& filePath)
 
 void MainWindow::processCryptoOperation(
     const std::function<void(
+        Encryptor&,
         const std::string&, 
         const std::string&, 
+        secure::SecureView, 
         const std::string&, 
-        const std::string&, 
-        const std::function<void(float)>&
+        const DetailedProgressCallback&
     )>& operation,
+    const QString& description,
     const QString& sourcePath,
     const QString& destPath,
     const QString& password,
@@ -127,54 +173,50 @@ void MainWindow::processCryptoOperation(
         return;
     }
     
-    // Disable UI during operation
-    setEnabled(false);
-    m_progressBar->setVisible(true);
-    m_progressBar->setValue(0);
-    
-    // Process operation in a separate thread
-    std::thread([=]() {
-        try {
-            // Execute the operation
+    // Queue the operation; the window stays usable while it waits and runs.
+    // The job owns the only std::string copy of the password and wipes it
+    // when it is done
+    auto pwd = std::make_shared<const secure::SecureData<std::string>>(password.toStdString());
+    m_jobQueue->submit(description.toStdString(),
+        [this, operation, source = sourcePath.toStdString(), dest = destPath.toStdString(),
+         pwd, successMessage](uint64_t id, const std::shared_ptr<const CancellationToken>& token) {
+            // Jobs run side by side, so each has an engine of its own
+            Encryptor encryptor;
+            encryptor.setCancellationToken(token);
+            
             operation(
-                sourcePath.toStdString(),
-                destPath.toStdString(),
-                password.toStdString(),
+                encryptor,
+                source,
+                dest,
+                *pwd,
                 "", // No second factor
-                [this](float progress) {
-                    // Update progress bar
-                    QMetaObject::invokeMethod(m_progressBar, "setValue", Qt::QueuedConnection,
-                        Q_ARG(int, static_cast<int>(progress * 100)));
+                [this, id](const ProgressInfo& progress) {
+                    // Called from the engine's progress timer, at most every 100 ms
+                    QString text = progressText(progress);
+                    QMetaObject::invokeMethod(this, [this, id, text]() {
+                        setJobProgress(id, text);
+                    }, Qt::QueuedConnection);
                 }
             );
             
-            // Show success message
-            QMetaObject::invokeMethod(this, "showStatusMessage", Qt::QueuedConnection,
-                Q_ARG(QString, successMessage),
-                Q_ARG(bool, false));
-        } catch (const std::exception& e) {
-            // Show error message
-            QMetaObject::invokeMethod(this, "showStatusMessage", Qt::QueuedConnection,
-                Q_ARG(QString, QString("Operation failed: %1").arg(e.what())),
-                Q_ARG(bool, true));
-        }
-        
-        // Re-enable UI
-        QMetaObject::invokeMethod(this, "setEnabled", Qt::QueuedConnection,
-            Q_ARG(bool, true));
-        QMetaObject::invokeMethod(m_progressBar, "setVisible", Qt::QueuedConnection,
-            Q_ARG(bool, false));
-    }).detach();
+            // Failures and cancellation are reported through the job list
+            QMetaObject::invokeMethod(this, [this, successMessage]() {
+                showStatusMessage(successMessage);
+            }, Qt::QueuedConnection);
+        });
 }
 
 void MainWindow::encryptFile()
 {
+    bool keySlots = m_encrypt.keySlotsCheck->isChecked();
     processCryptoOperation(
-        [this](const std::string& src, const std::string& dst, 
-               const std::string& pwd, const std::string& secondFactor, 
-               const std::function<void(float)>& progress) {
-            m_encryptor.encryptFile(src, dst, pwd, progress);
+        [keySlots](Encryptor& encryptor, const std::string& src, const std::string& dst, 
+           secure::SecureView pwd, const std::string& secondFactor, 
+           const DetailedProgressCallback& progress) {
+            encryptor.setKeySlots(keySlots);
+            encryptor.encryptFile(src, dst, pwd, progress);
         },
+        "Encrypt " + QFileInfo(m_encrypt.fileEdit->text()).fileName(),
         m_encrypt.fileEdit->text(),
         m_encrypt.outputEdit->text(),
         m_encrypt.passwordEdit->text(),
@@ -185,12 +227,13 @@ void MainWindow::encryptFile()
 void MainWindow::decryptFile()
 {
     processCryptoOperation(
-        [this](const std::string& src, const std::string& dst, 
-               const std::string& pwd, const std::string& secondFactor, 
-               const std::function<void(float)>& progress) {
+        [](Encryptor& encryptor, const std::string& src, const std::string& dst, 
+           secure::SecureView pwd, const std::string& secondFactor, 
+           const DetailedProgressCallback& progress) {
             // Note: secondFactor is ignored as the current implementation doesn't support it
-            m_encryptor.decryptFile(src, dst, pwd, progress);
+            encryptor.decryptFile(src, dst, pwd, progress);
         },
+        "Decrypt " + QFileInfo(m_decrypt.fileEdit->text()).fileName(),
         m_decrypt.fileEdit->text(),
         m_decrypt.outputEdit->text(),
         m_decrypt.passwordEdit->text(),
@@ -200,8 +243,172 @@ void MainWindow::decryptFile()
 
 void MainWindow::processBatch()
 {
-    // Not yet implemented
-    showStatusMessage("Batch processing not yet implemented", true);
+    // Rows are matched to items by position, so one batch at a time
+    if (m_batchJob != 0) {
+        showStatusMessage("A batch is already queued", true);
+        return;
+    }
+    
+    // Collect the files listed in the batch table
+    std::vector<BatchEncryptor::Item> items = m_batch.fileModel->items();
+    if (items.empty()) {
+        showStatusMessage("No files to process", true);
+        return;
+    }
+    m_batch.fileModel->resetProgress();
+    
+    auto operation = m_batch.operationCombo->currentIndex() == 0
+        ? BatchEncryptor::Operation::Encrypt
+        : BatchEncryptor::Operation::Decrypt;
+    auto password = std::make_shared<const secure::SecureData<std::string>>(m_batch.passwordEdit->text().toStdString());
+    QString description = QString("%1 %2 files")
+        .arg(operation == BatchEncryptor::Operation::Encrypt ? "Encrypt" : "Decrypt")
+        .arg(items.size());
+    
+    // Queue the batch; the table can't change until its job has finished
+    BatchFileModel* model = m_batch.fileModel;
+    m_batchJob = m_jobQueue->submit(description.toStdString(),
+        [this, model, items = std::move(items), operation, password](uint64_t id, const std::shared_ptr<const CancellationToken>& token) {
+            BatchEncryptor batch;
+            batch.setCancellationToken(token);
+            
+            // The model batches row updates itself; the job list only
+            // hears about whole-percent steps
+            int lastPercent = -1;
+            auto results = batch.run(items, operation, *password,
+                [this, id, model, &lastPercent](const BatchEncryptor::Progress& progress) {
+                    model->post(progress);
+                    
+                    int percent = static_cast<int>(progress.overallProgress * 100);
+                    if (percent != lastPercent) {
+                        lastPercent = percent;
+                        QString text = QString("%1% - %2 of %3 files")
+                            .arg(percent)
+                            .arg(progress.completedItems)
+                            .arg(progress.totalItems);
+                        QMetaObject::invokeMethod(this, [this, id, text]() {
+                            setJobProgress(id, text);
+                        }, Qt::QueuedConnection);
+                    }
+                }
+            );
+            
+            // Attach failure reasons to their rows
+            size_t failed = 0;
+            size_t cancelled = 0;
+            for (size_t i = 0; i < results.size(); ++i) {
+                if (results[i].status == BatchEncryptor::Status::Cancelled) {
+                    ++cancelled;
+                }
+                if (results[i].status != BatchEncryptor::Status::Failed) {
+                    continue;
+                }
+                ++failed;
+                model->postError(static_cast<int>(i), QString::fromStdString(results[i].error));
+            }
+            
+            QString summary = QString("Batch finished: %1 of %2 files processed")
+                .arg(results.size() - failed - cancelled)
+                .arg(results.size());
+            if (failed > 0) {
+                summary += QString(", %1 failed").arg(failed);
+            }
+            if (cancelled > 0) {
+                summary += QString(", %1 cancelled").arg(cancelled);
+            }
+            QMetaObject::invokeMethod(this, [this, summary, failed]() {
+                showStatusMessage(summary, failed > 0);
+            }, Qt::QueuedConnection);
+            
+            // Shows the job as cancelled rather than done
+            token->throwIfCancelled();
+        });
+    updateUiState();
+}
+
+void MainWindow::cancelSelectedJobs()
+{
+    for (const QModelIndex& index : m_jobs.table->selectionModel()->selectedRows()) {
+        QStandardItem* item = m_jobs.model->item(index.row(), JOB_NAME_COLUMN);
+        m_jobQueue->cancel(item->data(JOB_ID_ROLE).toULongLong());
+    }
+}
+
+void MainWindow::clearFinishedJobs()
+{
+    for (int row = m_jobs.model->rowCount() - 1; row >= 0; --row) {
+        if (isFinished(m_jobs.model->item(row, JOB_STATUS_COLUMN))) {
+            m_jobs.model->removeRow(row);
+        }
+    }
+    updateUiState();
+}
+
+void MainWindow::updateJob(const JobQueue::JobInfo& job)
+{
+    QString description = QString::fromStdString(job.description);
+    int row = jobRow(job.id);
+    if (row < 0) {
+        // Every job is reported queued first; anything else was cleared
+        if (job.state != JobQueue::State::Queued) {
+            return;
+        }
+        QStandardItem* name = new QStandardItem(description);
+        name->setData(QVariant::fromValue<qulonglong>(job.id), JOB_ID_ROLE);
+        m_jobs.model->appendRow({name, new QStandardItem(), new QStandardItem()});
+        row = m_jobs.model->rowCount() - 1;
+    }
+    
+    QStandardItem* status = m_jobs.model->item(row, JOB_STATUS_COLUMN);
+    QStandardItem* progress = m_jobs.model->item(row, JOB_PROGRESS_COLUMN);
+    status->setData(static_cast<int>(job.state), JOB_STATE_ROLE);
+    switch (job.state) {
+        case JobQueue::State::Queued:
+            status->setText("Queued");
+            break;
+        case JobQueue::State::Running:
+            status->setText("Running");
+            progress->setText("0%");
+            break;
+        case JobQueue::State::Succeeded:
+            status->setText("Done");
+            progress->setText("100%");
+            break;
+        case JobQueue::State::Failed:
+            status->setText("Failed");
+            status->setToolTip(QString::fromStdString(job.error));
+            showStatusMessage(QString("%1 failed: %2").arg(description, QString::fromStdString(job.error)), true);
+            break;
+        case JobQueue::State::Cancelled:
+            status->setText("Cancelled");
+            showStatusMessage(description + " cancelled");
+            break;
+    }
+    
+    if (job.id == m_batchJob && isFinished(status)) {
+        m_batchJob = 0;
+    }
+    updateUiState();
+}
+
+void MainWindow::setJobProgress(uint64_t id, const QString& text)
+{
+    int row = jobRow(id);
+    if (row < 0 || isFinished(m_jobs.model->item(row, JOB_STATUS_COLUMN))) {
+        return;
+    }
+    
+    m_jobs.model->item(row, JOB_PROGRESS_COLUMN)->setText(text);
+}
+
+int MainWindow::jobRow(uint64_t id) const
+{
+    for (int row = 0; row < m_jobs.model->rowCount(); ++row) {
+        if (m_jobs.model->item(row, JOB_NAME_COLUMN)->data(JOB_ID_ROLE).toULongLong() == id) {
+            return row;
+        }
+    }
+    return -1;
 }
 
 void MainWindow::openFile()
@@ -235,10 +442,6 @@ void MainWindow::openFile()
 
 void MainWindow::refreshFileList(const QString& directory)
 {
-    // Clear current model
-    m_fileModel->clear();
-    m_fileModel->setHorizontalHeaderLabels({"Name", "Size", "Date", "Path"});
-    
     // If directory is provided, update current directory
     if (!directory.isEmpty()) {
         QFileInfo dirInfo(directory);
@@ -258,56 +461,13 @@ void MainWindow::refreshFileList(const QString& directory)
         m_pathEdit->setText(m_currentDirectory);
     }
     
-    // Add files to model
-    QDir dir(m_currentDirectory);
-    QFileInfoList fileInfoList = dir.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
-    
-    for (const QFileInfo& fileInfo : fileInfoList) {
-        QList<QStandardItem*> row;
-        
-        // Name
-        QStandardItem* nameItem = new QStandardItem(fileInfo.fileName());
-        if (fileInfo.isDir()) {
-            nameItem->setIcon(style()->standardIcon(QStyle::SP_DirIcon));
-        } else {
-            // Use different icons based on file type
-            QFileIconProvider iconProvider;
-            nameItem->setIcon(iconProvider.icon(fileInfo));
-        }
-        row.append(nameItem);
-        
-        // Size
-        QString sizeStr;
-        if (fileInfo.isDir()) {
-            sizeStr = "<DIR>";
-        } else {
-            qint64 size = fileInfo.size();
-            if (size < 1024) {
-                sizeStr = QString("%1 B").arg(size);
-            } else if (size < 1024 * 1024) {
-                sizeStr = QString("%1 KB").arg(size / 1024.0, 0, 'f', 2);
-            } else if (size < 1024 * 1024 * 1024) {
-                sizeStr = QString("%1 MB").arg(size / (1024.0 * 1024.0), 0, 'f', 2);
-            } else {
-                sizeStr = QString("%1 GB").arg(size / (1024.0 * 1024.0 * 1024.0), 0, 'f', 2);
-            }
-        }
-        row.append(new QStandardItem(sizeStr));
-        
-        // Date
-        row.append(new QStandardItem(fileInfo.lastModified().toString("yyyy-MM-dd hh:mm:ss")));
-        
-        // Path
-        row.append(new QStandardItem(fileInfo.absoluteFilePath()));
-        
-        m_fileModel->appendRow(row);
-    }
+    // Rows arrive as the scan finds them; the window stays usable meanwhile
+    m_fileModel->setDirectory(m_currentDirectory);
     
     // Sort by name by default
     m_fileTreeView->sortByColumn(FILE_NAME_COLUMN, Qt::AscendingOrder);
     
-    // Update status bar
-    showStatusMessage(QString("Loaded %1 items").arg(fileInfoList.size()), false);
+    showStatusMessage("Loading " + m_currentDirectory, false);
 }
 
 void MainWindow::onFileSelected(const QModelIndex& index)
@@ -317,9 +477,6 @@ void MainWindow::onFileSelected(const QModelIndex& index)
     QModelIndex pathIndex = m_fileModel->index(sourceIndex.row(), FILE_PATH_COLUMN);
     QString filePath = m_fileModel->data(pathIndex).toString();
     
-    // Get file info
-    QFileInfo fileInfo(filePath);
-    
     // Set file path in the appropriate tab based on current tab
     int currentTab = m_operationTabWidget->currentIndex();
     if (currentTab == 0) { // Encrypt tab
@@ -340,93 +497,9 @@ void MainWindow::onFileSelected(const QModelIndex& index)
         }
     }
     
-    // Update file details panel
-    QWidget* detailsPanel = m_mainSplitter->widget(1);
-    if (detailsPanel) {
-        // Find or create details layout
-        QVBoxLayout* detailsLayout = nullptr;
-        if (detailsPanel->layout()) {
-            detailsLayout = qobject_cast<QVBoxLayout*>(detailsPanel->layout());
-        } else {
-            detailsLayout = new QVBoxLayout(detailsPanel);
-        }
-        
-        // Clear existing widgets except the header
-        while (detailsLayout->count() > 1) {
-            QLayoutItem* item = detailsLayout->takeAt(1);
-            if (item->widget()) {
-                item->widget()->deleteLater();
-            }
-            delete item;
-        }
-        
-        // Add file details
-        QFormLayout* formLayout = new QFormLayout();
-        formLayout->addRow("Name:", new QLabel(fileInfo.fileName()));
-        formLayout->addRow("Type:", new QLabel(fileInfo.isDir() ? "Directory" : fileInfo.suffix().isEmpty() ? "File" : fileInfo.suffix().toUpper() + " File"));
-        
-        if (!fileInfo.isDir()) {
-            // Format size
-            qint64 size = fileInfo.size();
-            QString sizeStr;
-            if (size < 1024) {
-                sizeStr = QString("%1 bytes").arg(size);
-            } else if (size < 1024 * 1024) {
-                sizeStr = QString("%1 KB (%2 bytes)").arg(size / 1024.0, 0, 'f', 2).arg(size);
-            } else if (size < 1024 * 1024 * 1024) {
-                sizeStr = QString("%1 MB (%2 bytes)").arg(size / (1024.0 * 1024.0), 0, 'f', 2).arg(size);
-            } else {
-                sizeStr = QString("%1 GB (%2 bytes)").arg(size / (1024.0 * 1024.0 * 1024.0), 0, 'f', 2).arg(size);
-            }
-            formLayout->addRow("Size:", new QLabel(sizeStr));
-        }
-        
-        formLayout->addRow("Created:", new QLabel(fileInfo.birthTime().toString("yyyy-MM-dd hh:mm:ss")));
-        formLayout->addRow("Modified:", new QLabel(fileInfo.lastModified().toString("yyyy-MM-dd hh:mm:ss")));
-        formLayout->addRow("Path:", new QLabel(fileInfo.absolutePath()));
-        
-        // Add actions section
-        QLabel* actionsLabel = new QLabel("Actions");
-        actionsLabel->setProperty("class", "section-header");
-        
-        QHBoxLayout* actionsLayout = new QHBoxLayout();
-        
-        QPushButton* encryptButton = new QPushButton("Encrypt");
-        encryptButton->setIcon(style()->standardIcon(QStyle::SP_DialogSaveButton));
-        connect(encryptButton, &QPushButton::clicked, this, [this, filePath]() {
-            m_operationTabWidget->setCurrentIndex(0); // Switch to encrypt tab
-            m_encrypt.fileEdit->setText(filePath);
-            if (m_encrypt.outputEdit->text().isEmpty()) {
-                m_encrypt.outputEdit->setText(filePath + ENCRYPTED_EXTENSION);
-            }
-        });
-        
-        QPushButton* decryptButton = new QPushButton("Decrypt");
-        decryptButton->setIcon(style()->standardIcon(QStyle::SP_FileIcon));
-        connect(decryptButton, &QPushButton::clicked, this, [this, filePath]() {
-            m_operationTabWidget->setCurrentIndex(1); // Switch to decrypt tab
-            m_decrypt.fileEdit->setText(filePath);
-            if (m_decrypt.outputEdit->text().isEmpty()) {
-                QString outputPath = filePath;
-                if (outputPath.endsWith(ENCRYPTED_EXTENSION)) {
-                    outputPath.chop(strlen(ENCRYPTED_EXTENSION));
-                } else {
-                    outputPath += DECRYPTED_EXTENSION;
-                }
-                m_decrypt.outputEdit->setText(outputPath);
-            }
-        });
-        
-        actionsLayout->addWidget(encryptButton);
-        actionsLayout->addWidget(decryptButton);
-        
-        // Add to details layout
-        detailsLayout->addLayout(formLayout);
-        detailsLayout->addSpacing(20);
-        detailsLayout->addWidget(actionsLabel);
-        detailsLayout->addLayout(actionsLayout);
-        detailsLayout->addStretch();
-    }
+    // Update file details panel; the file is read in the background
+    m_detailsPanel->showPending(filePath);
+    m_inspector->inspect(filePath);
 }
 
 void MainWindow::showSettings()
@@ -437,17 +510,90 @@ void MainWindow::showSettings()
 
 void MainWindow::showKeyManagement()
 {
-    // Not yet implemented
-    showStatusMessage("Key management not yet implemented", true);
+    QString filePath = QFileDialog::getOpenFileName(
+        this,
+        "Select File to Manage Keys",
+        m_decrypt.fileEdit->text().isEmpty() ? m_currentDirectory : m_decrypt.fileEdit->text(),
+        ENCRYPTED_FILES_FILTER
+    );
+    if (filePath.isEmpty()) {
+        return;
+    }
+    
+    const QStringList actions = {"Add a password", "Change a password", "Remove a key slot"};
+    bool ok = false;
+    QString action = QInputDialog::getItem(this, "Key Management", "Action:", actions, 0, false, &ok);
+    if (!ok) {
+        return;
+    }
+    int actionIndex = actions.indexOf(action);
+    
+    QString password = QInputDialog::getText(this, "Key Management", "Current password:",
+                                             QLineEdit::Password, QString(), &ok);
+    if (!ok || password.isEmpty()) {
+        return;
+    }
+    
+    // Removing names a slot, the other actions a new password
+    QString newPassword;
+    int slot = 0;
+    if (actionIndex == 2) {
+        slot = QInputDialog::getInt(this, "Key Management", "Slot to remove:", 0, 0,
+                                    static_cast<int>(container::MAX_KEY_SLOTS) - 1, 1, &ok);
+        if (!ok) {
+            return;
+        }
+    } else {
+        newPassword = QInputDialog::getText(this, "Key Management", "New password:",
+                                            QLineEdit::Password, QString(), &ok);
+        if (!ok || newPassword.isEmpty()) {
+            return;
+        }
+        QString confirmation = QInputDialog::getText(this, "Key Management", "Repeat the new password:",
+                                                     QLineEdit::Password, QString(), &ok);
+        if (!ok) {
+            return;
+        }
+        if (confirmation != newPassword) {
+            showStatusMessage("The new passwords do not match", true);
+            return;
+        }
+    }
+    
+    // Each slot tried costs a key derivation, so the edit runs as a job
+    auto pwd = std::make_shared<const secure::SecureData<std::string>>(password.toStdString());
+    auto newPwd = std::make_shared<const secure::SecureData<std::string>>(newPassword.toStdString());
+    m_jobQueue->submit((action + " of " + QFileInfo(filePath).fileName()).toStdString(),
+        [this, actionIndex, path = filePath.toStdString(), pwd, newPwd, slot](
+            uint64_t, const std::shared_ptr<const CancellationToken>& token) {
+            Encryptor encryptor;
+            encryptor.setCancellationToken(token);
+            
+            QString message;
+            if (actionIndex == 0) {
+                size_t added = encryptor.addKeySlot(path, *pwd, *newPwd);
+                message = QString("Password added in key slot %1").arg(added);
+            } else if (actionIndex == 1) {
+                size_t changed = encryptor.changeKeySlotPassword(path, *pwd, *newPwd);
+                message = QString("Password of key slot %1 changed").arg(changed);
+            } else {
+                encryptor.removeKeySlot(path, *pwd, static_cast<size_t>(slot));
+                message = QString("Key slot %1 removed").arg(slot);
+            }
+            
+            QMetaObject::invokeMethod(this, [this, message]() {
+                showStatusMessage(message);
+            }, Qt::QueuedConnection);
+        });
 }
 
 void MainWindow::showDeviceManagement()
 {
-    // Switch to device tab
+    // Switch to device tab, creating it on first use
     m_operationTabWidget->setCurrentIndex(3);
+    buildTab(3);
     
-    // Not yet implemented
-    showStatusMessage("Device management not yet implemented", true);
+    m_deviceManager->refresh();
 }
 
 // 2FA functions are not implemented in this version
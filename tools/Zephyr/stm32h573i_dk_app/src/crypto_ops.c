@@ -1,60 +1,298 @@
 /*
  * Copyright (c) 2025 CRUSTy-Core
- *
+ * 
  * SPDX-License-Identifier: Apache-2.0
  */
 
 #include <zephyr/kernel.h>
 #include <zephyr/sys/util.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/random/random.h>
 #include <zephyr/logging/log.h>
 #include <string.h>
 #include <stdlib.h>
 #include "crypto_ops.h"
 
+/* Software implementations via mbedTLS, used wherever the hardware cannot help */
+#include <mbedtls/gcm.h>
+#include <mbedtls/sha256.h>
+
 /* Additional includes for hardware crypto */
 #ifndef CONFIG_BOARD_QEMU_CORTEX_M3
-#include <zephyr/crypto/crypto.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/entropy.h>
 #endif
 
+/*
+ * Zephyr's STM32 crypto driver has no GCM mode, so AES-GCM drives the AES
+ * peripheral through the STM32Cube HAL directly. Large payloads are fed by
+ * GPDMA2, which Zephyr leaves alone; GPDMA1 belongs to the UART.
+ */
+#if !defined(CONFIG_BOARD_QEMU_CORTEX_M3) && defined(CONFIG_USE_STM32_HAL_CRYP)
+#define CRYPTO_OPS_HW_AES 1
+#include <soc.h>
+#include <stm32h5xx_hal.h>
+#if defined(CONFIG_USE_STM32_HAL_DMA)
+#define CRYPTO_OPS_HW_AES_DMA 1
+#endif
+#endif
+
+/*
+ * The benchmark counts core cycles with the DWT where there is one. QEMU
+ * does not model it, so there the system timer stands in.
+ */
+#if !defined(CONFIG_BOARD_QEMU_CORTEX_M3) && defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+#define CRYPTO_OPS_BENCH_DWT 1
+#include <soc.h>
+#endif
+
 /* Log module declaration */
 LOG_MODULE_REGISTER(crypto_ops, CONFIG_LOG_DEFAULT_LEVEL);
 
-/* Return codes */
-#define CRYPTO_OPS_SUCCESS           0
-#define CRYPTO_OPS_ERR_NOT_INIT     -1
-#define CRYPTO_OPS_ERR_PARAM        -2
-#define CRYPTO_OPS_ERR_KEY          -3
-#define CRYPTO_OPS_ERR_BUFFER       -4
-#define CRYPTO_OPS_ERR_AUTH         -5
-#define CRYPTO_OPS_ERR_HARDWARE     -6
+/* Defines */
+#define HW_AES_TIMEOUT_MS       100
+#define HW_AES_IRQ_PRIORITY     2
 
 /* State variables */
 static bool crypto_initialized = false;
 
 #ifndef CONFIG_BOARD_QEMU_CORTEX_M3
 /* STM32H573I-DK specific variables */
-static const struct device *crypto_dev = NULL;
 static const struct device *entropy_dev = NULL;
 static bool has_hw_aes_impl = false;
 static bool has_hw_rng_impl = false;
+#endif
 
-/* Software implementations via mbedTLS for missing hardware features */
-#include <mbedtls/sha256.h>
+#ifdef CRYPTO_OPS_HW_AES
+/* The peripheral is shared by the shell and the host link */
+static K_MUTEX_DEFINE(hw_aes_mutex);
+static CRYP_HandleTypeDef hw_aes;
+
+#ifdef CRYPTO_OPS_HW_AES_DMA
+static DMA_HandleTypeDef hw_aes_dma_in;
+static DMA_HandleTypeDef hw_aes_dma_out;
+static K_SEM_DEFINE(hw_aes_dma_done, 0, 1);
+static volatile bool hw_aes_dma_failed;
+
+/* Called by the HAL from the DMA interrupt once the last output word is read */
+void HAL_CRYP_OutCpltCallback(CRYP_HandleTypeDef *hcryp)
+{
+    ARG_UNUSED(hcryp);
+    k_sem_give(&hw_aes_dma_done);
+}
+
+void HAL_CRYP_ErrorCallback(CRYP_HandleTypeDef *hcryp)
+{
+    ARG_UNUSED(hcryp);
+    hw_aes_dma_failed = true;
+    k_sem_give(&hw_aes_dma_done);
+}
+
+static void hw_aes_dma_in_isr(const void *arg)
+{
+    ARG_UNUSED(arg);
+    HAL_DMA_IRQHandler(&hw_aes_dma_in);
+}
+
+static void hw_aes_dma_out_isr(const void *arg)
+{
+    ARG_UNUSED(arg);
+    HAL_DMA_IRQHandler(&hw_aes_dma_out);
+}
+
+static int hw_aes_dma_setup(DMA_HandleTypeDef *hdma, DMA_Channel_TypeDef *channel,
+                            uint32_t request, bool to_peripheral)
+{
+    hdma->Instance = channel;
+    hdma->Init.Request = request;
+    hdma->Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+    hdma->Init.Direction = to_peripheral ? DMA_MEMORY_TO_PERIPH : DMA_PERIPH_TO_MEMORY;
+    hdma->Init.SrcInc = to_peripheral ? DMA_SINC_INCREMENTED : DMA_SINC_FIXED;
+    hdma->Init.DestInc = to_peripheral ? DMA_DINC_FIXED : DMA_DINC_INCREMENTED;
+    hdma->Init.SrcDataWidth = DMA_SRC_DATAWIDTH_WORD;
+    hdma->Init.DestDataWidth = DMA_DEST_DATAWIDTH_WORD;
+    hdma->Init.Priority = DMA_HIGH_PRIORITY;
+    hdma->Init.SrcBurstLength = 1;
+    hdma->Init.DestBurstLength = 1;
+    hdma->Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT0;
+    hdma->Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+    hdma->Init.Mode = DMA_NORMAL;
+    return HAL_DMA_Init(hdma) == HAL_OK ? 0 : -EIO;
+}
+#endif /* CRYPTO_OPS_HW_AES_DMA */
+
+static int hw_aes_init(void)
+{
+    __HAL_RCC_AES_CLK_ENABLE();
+    
+    /* Key, IV and AAD are set per operation */
+    hw_aes.Instance = AES;
+    hw_aes.Init.DataType = CRYP_BYTE_SWAP;
+    hw_aes.Init.KeySize = CRYP_KEYSIZE_256B;
+    hw_aes.Init.Algorithm = CRYP_AES_GCM_GMAC;
+    hw_aes.Init.DataWidthUnit = CRYP_DATAWIDTHUNIT_BYTE;
+    hw_aes.Init.HeaderWidthUnit = CRYP_HEADERWIDTHUNIT_BYTE;
+    hw_aes.Init.KeyIVConfigSkip = CRYP_KEYIVCONFIG_ALWAYS;
+    if (HAL_CRYP_Init(&hw_aes) != HAL_OK) {
+        return -EIO;
+    }
+
+#ifdef CRYPTO_OPS_HW_AES_DMA
+    __HAL_RCC_GPDMA2_CLK_ENABLE();
+    if (hw_aes_dma_setup(&hw_aes_dma_in, GPDMA2_Channel0, GPDMA2_REQUEST_AES_IN, true) != 0 ||
+        hw_aes_dma_setup(&hw_aes_dma_out, GPDMA2_Channel1, GPDMA2_REQUEST_AES_OUT, false) != 0) {
+        return -EIO;
+    }
+    __HAL_LINKDMA(&hw_aes, hdmain, hw_aes_dma_in);
+    __HAL_LINKDMA(&hw_aes, hdmaout, hw_aes_dma_out);
+    
+    IRQ_CONNECT(GPDMA2_Channel0_IRQn, HW_AES_IRQ_PRIORITY, hw_aes_dma_in_isr, NULL, 0);
+    IRQ_CONNECT(GPDMA2_Channel1_IRQn, HW_AES_IRQ_PRIORITY, hw_aes_dma_out_isr, NULL, 0);
+    irq_enable(GPDMA2_Channel0_IRQn);
+    irq_enable(GPDMA2_Channel1_IRQn);
 #endif
 
-/* Simple pseudo-random number generator for QEMU demo */
-#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
-static uint32_t random_seed = 0x12345678;
+    return 0;
+}
 
-static uint32_t simple_rand(void)
+/* Whether the peripheral can take an operation; anything else goes to mbedTLS */
+static bool hw_aes_supports(size_t key_len, size_t nonce_len, size_t aad_len, size_t data_len)
 {
-    /* Very simple LCG random number generator */
-    random_seed = (random_seed * 1103515245 + 12345) & 0x7FFFFFFF;
-    return random_seed;
+    /* No 192-bit keys, and the HAL counts sizes in 16 bits */
+    return has_hw_aes_impl && (key_len == 16 || key_len == 32) && nonce_len == 12 &&
+           data_len > 0 && data_len <= UINT16_MAX && aad_len <= UINT16_MAX;
 }
+
+/**
+ * @brief Run AES-GCM on the peripheral
+ * 
+ * Only for operations hw_aes_supports() accepts. Always produces the full
+ * 16-byte tag; decryption leaves checking it to the caller.
+ * 
+ * @return 0 on success, -EIO if the peripheral failed
+ */
+static int hw_aes_gcm(bool encrypt, const uint8_t *key, size_t key_len, const uint8_t *nonce,
+                      const uint8_t *aad, size_t aad_len, const uint8_t *input, size_t len,
+                      uint8_t *output, uint8_t tag[16])
+{
+    uint32_t key_words[8];
+    uint32_t iv_words[4];
+    uint32_t tag_words[4];
+    CRYP_ConfigTypeDef config;
+    HAL_StatusTypeDef status;
+    int ret = 0;
+    
+    /* The HAL takes key and IV as big-endian words, most significant first */
+    for (size_t i = 0; i < key_len / 4; i++) {
+        key_words[i] = sys_get_be32(key + 4 * i);
+    }
+    for (size_t i = 0; i < 3; i++) {
+        iv_words[i] = sys_get_be32(nonce + 4 * i);
+    }
+    /* Counter of the first payload block; J0 (counter 1) only masks the tag */
+    iv_words[3] = 2;
+    
+    k_mutex_lock(&hw_aes_mutex, K_FOREVER);
+    
+    HAL_CRYP_GetConfig(&hw_aes, &config);
+    config.KeySize = (key_len == 32) ? CRYP_KEYSIZE_256B : CRYP_KEYSIZE_128B;
+    config.pKey = key_words;
+    config.pInitVect = iv_words;
+    config.Header = (uint32_t *)aad;
+    config.HeaderSize = aad_len;
+    status = HAL_CRYP_SetConfig(&hw_aes, &config);
+
+#ifdef CRYPTO_OPS_HW_AES_DMA
+    /* DMA moves whole words, so both buffers must be word aligned */
+    bool use_dma = len >= CRYPTO_OPS_HW_DMA_THRESHOLD &&
+                   IS_ALIGNED(input, 4) && IS_ALIGNED(output, 4);
+    
+    if (status == HAL_OK && use_dma) {
+        hw_aes_dma_failed = false;
+        k_sem_reset(&hw_aes_dma_done);
+        status = encrypt ?
+            HAL_CRYP_Encrypt_DMA(&hw_aes, (uint32_t *)input, (uint16_t)len, (uint32_t *)output) :
+            HAL_CRYP_Decrypt_DMA(&hw_aes, (uint32_t *)input, (uint16_t)len, (uint32_t *)output);
+        if (status == HAL_OK &&
+            (k_sem_take(&hw_aes_dma_done, K_MSEC(HW_AES_TIMEOUT_MS)) != 0 || hw_aes_dma_failed)) {
+            status = HAL_ERROR;
+        }
+    } else
 #endif
+    if (status == HAL_OK) {
+        status = encrypt ?
+            HAL_CRYP_Encrypt(&hw_aes, (uint32_t *)input, (uint16_t)len, (uint32_t *)output,
+                             HW_AES_TIMEOUT_MS) :
+            HAL_CRYP_Decrypt(&hw_aes, (uint32_t *)input, (uint16_t)len, (uint32_t *)output,
+                             HW_AES_TIMEOUT_MS);
+    }
+    
+    if (status == HAL_OK) {
+        status = HAL_CRYPEx_AESGCM_GenerateAuthTAG(&hw_aes, tag_words, HW_AES_TIMEOUT_MS);
+    }
+    
+    if (status == HAL_OK) {
+        memcpy(tag, tag_words, sizeof(tag_words));
+    } else {
+        LOG_ERR("AES peripheral failed: status %d, error 0x%x", status,
+                (unsigned int)hw_aes.ErrorCode);
+        /* Start from a clean peripheral next time */
+        HAL_CRYP_DeInit(&hw_aes);
+        HAL_CRYP_Init(&hw_aes);
+        ret = -EIO;
+    }
+    
+    k_mutex_unlock(&hw_aes_mutex);
+    
+    memset(key_words, 0, sizeof(key_words));
+    return ret;
+}
+#endif /* CRYPTO_OPS_HW_AES */
+
+/**
+ * @brief Run AES-GCM with mbedTLS
+ * 
+ * @return CRYPTO_OPS_SUCCESS, CRYPTO_OPS_ERR_AUTH if decryption found a bad tag,
+ *         or CRYPTO_OPS_ERR_KEY if mbedTLS rejected the key
+ */
+static int sw_aes_gcm(bool encrypt, const uint8_t *key, size_t key_len,
+                      const uint8_t *nonce, size_t nonce_len, const uint8_t *aad, size_t aad_len,
+                      const uint8_t *input, size_t len, uint8_t *output, uint8_t *tag, size_t tag_len)
+{
+    mbedtls_gcm_context ctx;
+    int ret;
+    
+    mbedtls_gcm_init(&ctx);
+    ret = mbedtls_gcm_setkey(&ctx, MBEDTLS_CIPHER_ID_AES, key, key_len * 8);
+    if (ret != 0) {
+        LOG_ERR("mbedTLS rejected the key: %d", ret);
+        mbedtls_gcm_free(&ctx);
+        return CRYPTO_OPS_ERR_KEY;
+    }
+    
+    if (encrypt) {
+        ret = mbedtls_gcm_crypt_and_tag(&ctx, MBEDTLS_GCM_ENCRYPT, len, nonce, nonce_len,
+                                        aad, aad_len, input, output, tag_len, tag);
+    } else {
+        /* Wipes the output itself if the tag does not match */
+        ret = mbedtls_gcm_auth_decrypt(&ctx, len, nonce, nonce_len, aad, aad_len,
+                                       tag, tag_len, input, output);
+    }
+    mbedtls_gcm_free(&ctx);
+    
+    return (ret == 0) ? CRYPTO_OPS_SUCCESS : CRYPTO_OPS_ERR_AUTH;
+}
+
+static bool tags_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    /* No early exit, so timing says nothing about where a forged tag differs */
+    uint8_t diff = 0;
+    
+    for (size_t i = 0; i < len; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
 
 int crypto_ops_init(void)
 {
@@ -69,9 +307,8 @@ int crypto_ops_init(void)
     LOG_INF("Initializing crypto operations (STM32H573I-DK hardware)");
     
     /* Initialize AES hardware if available */
-    #ifdef CONFIG_CRYPTO_STM32_AES
-    crypto_dev = DEVICE_DT_GET(DT_NODELABEL(aes));
-    if (crypto_dev != NULL && device_is_ready(crypto_dev)) {
+    #ifdef CRYPTO_OPS_HW_AES
+    if (hw_aes_init() == 0) {
         LOG_INF("AES hardware accelerator found");
         has_hw_aes_impl = true;
     } else {
@@ -82,7 +319,7 @@ int crypto_ops_init(void)
     LOG_WRN("AES hardware support not enabled in config, using software fallback");
     has_hw_aes_impl = false;
     #endif
-    
+
     /* Initialize RNG hardware if available */
     #ifdef CONFIG_ENTROPY_STM32_RNG
     entropy_dev = DEVICE_DT_GET(DT_NODELABEL(rng));
@@ -97,11 +334,11 @@ int crypto_ops_init(void)
     LOG_WRN("RNG hardware support not enabled in config, using software fallback");
     has_hw_rng_impl = false;
     #endif
-    
+
     crypto_initialized = true;
     LOG_INF("Crypto operations initialized successfully");
 #endif
-    
+
     return CRYPTO_OPS_SUCCESS;
 }
 
@@ -139,12 +376,10 @@ int crypto_ops_random_bytes(uint8_t *buffer, size_t len)
         LOG_WRN("Zero length requested in random_bytes");
         return CRYPTO_OPS_SUCCESS;
     }
-    
+
 #ifdef CONFIG_BOARD_QEMU_CORTEX_M3
-    /* Use simple PRNG for QEMU demo purposes */
-    for (size_t i = 0; i < len; i++) {
-        buffer[i] = (uint8_t)(simple_rand() & 0xFF);
-    }
+    /* QEMU has no entropy source; this is Zephyr's test generator */
+    sys_rand_get(buffer, len);
     
     LOG_DBG("Generated %u random bytes (QEMU simulation)", (unsigned int)len);
 #else
@@ -163,7 +398,7 @@ int crypto_ops_random_bytes(uint8_t *buffer, size_t len)
         LOG_DBG("Generated %u random bytes (software fallback)", (unsigned int)len);
     }
 #endif
-    
+
     return CRYPTO_OPS_SUCCESS;
 }
 
@@ -174,12 +409,14 @@ int crypto_ops_aes_gcm_encrypt(const uint8_t *key, size_t key_len,
                               uint8_t *ciphertext, size_t *ciphertext_len,
                               uint8_t *tag, size_t tag_len)
 {
+    int ret;
+
 #ifdef CONFIG_BOARD_QEMU_CORTEX_M3
-    LOG_INF("AES-GCM encryption (QEMU simulation)");
+    LOG_DBG("AES-GCM encryption (QEMU simulation)");
 #else
-    LOG_INF("AES-GCM encryption (STM32H573I-DK)");
+    LOG_DBG("AES-GCM encryption (STM32H573I-DK)");
 #endif
-    
+
     if (!crypto_initialized) {
         LOG_ERR("Crypto operations not initialized");
         return CRYPTO_OPS_ERR_NOT_INIT;
@@ -212,89 +449,35 @@ int crypto_ops_aes_gcm_encrypt(const uint8_t *key, size_t key_len,
         return CRYPTO_OPS_ERR_BUFFER;
     }
 
-#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
-    /* In QEMU simulation, we just copy plaintext to ciphertext 
-     * and generate a random tag for demonstration purposes
-     */
-    memcpy(ciphertext, plaintext, plaintext_len);
-    *ciphertext_len = plaintext_len;
-    
-    /* Generate a random tag */
-    for (size_t i = 0; i < tag_len; i++) {
-        tag[i] = (uint8_t)(simple_rand() & 0xFF);
-    }
-    
-    LOG_DBG("Simulated encryption of %u bytes", (unsigned int)plaintext_len);
-#else
-    /* On STM32H573I-DK, use hardware AES if available */
-    if (has_hw_aes_impl && crypto_dev != NULL) {
-        struct cipher_ctx ctx = {0};
-        struct cipher_pkt encrypt = {0};
-        struct cipher_aead_pkt aead_op = {0};
-        uint8_t iv_tmp[12];
-        int ret;
+#ifdef CRYPTO_OPS_HW_AES
+    /* On STM32H573I-DK, use hardware AES if it can take the operation */
+    if (hw_aes_supports(key_len, nonce_len, aad_len, plaintext_len)) {
+        uint8_t full_tag[16];
         
-        /* Copy nonce to IV */
-        memcpy(iv_tmp, nonce, MIN(nonce_len, sizeof(iv_tmp)));
-        
-        /* Setup context for AES-GCM */
-        ctx.keylen = key_len;
-        ctx.key.bit_stream = key;
-        
-        /* Begin session */
-        ret = cipher_begin_session(crypto_dev, &ctx, CRYPTO_CIPHER_ALGO_AES,
-                                  CRYPTO_CIPHER_MODE_GCM, CRYPTO_CIPHER_OP_ENCRYPT);
-        if (ret != 0) {
-            LOG_ERR("Failed to setup AES session: %d", ret);
-            goto use_software_aes;
+        if (hw_aes_gcm(true, key, key_len, nonce, aad, aad_len,
+                       plaintext, plaintext_len, ciphertext, full_tag) == 0) {
+            memcpy(tag, full_tag, tag_len);
+            *ciphertext_len = plaintext_len;
+            LOG_DBG("Hardware AES-GCM encryption of %u bytes", (unsigned int)plaintext_len);
+            return CRYPTO_OPS_SUCCESS;
         }
         
-        /* Prepare encryption packet */
-        encrypt.in_buf = plaintext;
-        encrypt.in_len = plaintext_len;
-        encrypt.out_buf = ciphertext;
-        encrypt.out_len = *ciphertext_len;
-        
-        /* Prepare AEAD operation */
-        aead_op.ad = aad;
-        aead_op.ad_len = aad_len;
-        aead_op.tag = tag;
-        aead_op.tag_len = tag_len;
-        
-        /* Perform AEAD encrypt */
-        ctx.mode_params.gcm_info.iv.iv = iv_tmp;
-        ctx.mode_params.gcm_info.iv.ivlen = MIN(nonce_len, sizeof(iv_tmp));
-        
-        ret = cipher_gcm_op(&ctx, &aead_op, &encrypt);
-        if (ret != 0) {
-            LOG_ERR("AES-GCM hardware encryption failed: %d", ret);
-            cipher_free_session(crypto_dev, &ctx);
-            goto use_software_aes;
+        /* In place, the plaintext may already be overwritten */
+        if (plaintext == ciphertext) {
+            return CRYPTO_OPS_ERR_HARDWARE;
         }
-        
-        /* Set output length */
-        *ciphertext_len = plaintext_len;
-        
-        /* Cleanup */
-        cipher_free_session(crypto_dev, &ctx);
-        
-        LOG_DBG("Hardware AES-GCM encryption of %u bytes", (unsigned int)plaintext_len);
-    } else {
-    use_software_aes:
-        LOG_WRN("Hardware AES not available, using software fallback");
-        
-        /* For software fallback, we use mbedTLS, but for simplicity in this 
-         * example we'll just simulate encryption like in QEMU mode */
-        memcpy(ciphertext, plaintext, plaintext_len);
-        *ciphertext_len = plaintext_len;
-        
-        /* Generate a random tag */
-        crypto_ops_random_bytes(tag, tag_len);
-        
-        LOG_DBG("Software AES-GCM encryption of %u bytes", (unsigned int)plaintext_len);
+        LOG_WRN("Hardware AES failed, using software fallback");
     }
 #endif
+
+    ret = sw_aes_gcm(true, key, key_len, nonce, nonce_len, aad, aad_len,
+                     plaintext, plaintext_len, ciphertext, tag, tag_len);
+    if (ret != CRYPTO_OPS_SUCCESS) {
+        return ret;
+    }
+    *ciphertext_len = plaintext_len;
     
+    LOG_DBG("Software AES-GCM encryption of %u bytes", (unsigned int)plaintext_len);
     return CRYPTO_OPS_SUCCESS;
 }
 
@@ -305,12 +488,14 @@ int crypto_ops_aes_gcm_decrypt(const uint8_t *key, size_t key_len,
                               const uint8_t *tag, size_t tag_len,
                               uint8_t *plaintext, size_t *plaintext_len)
 {
+    int ret;
+
 #ifdef CONFIG_BOARD_QEMU_CORTEX_M3
-    LOG_INF("AES-GCM decryption (QEMU simulation)");
+    LOG_DBG("AES-GCM decryption (QEMU simulation)");
 #else
-    LOG_INF("AES-GCM decryption (STM32H573I-DK)");
+    LOG_DBG("AES-GCM decryption (STM32H573I-DK)");
 #endif
-    
+
     if (!crypto_initialized) {
         LOG_ERR("Crypto operations not initialized");
         return CRYPTO_OPS_ERR_NOT_INIT;
@@ -342,125 +527,252 @@ int crypto_ops_aes_gcm_decrypt(const uint8_t *key, size_t key_len,
         LOG_ERR("Plaintext buffer too small");
         return CRYPTO_OPS_ERR_BUFFER;
     }
-    
-#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
-    /* In QEMU simulation, we just copy ciphertext to plaintext 
-     * for demonstration purposes
-     */
-    memcpy(plaintext, ciphertext, ciphertext_len);
-    *plaintext_len = ciphertext_len;
-    
-    LOG_DBG("Simulated decryption of %u bytes", (unsigned int)ciphertext_len);
-#else
-    /* On STM32H573I-DK, use hardware AES if available */
-    if (has_hw_aes_impl && crypto_dev != NULL) {
-        struct cipher_ctx ctx = {0};
-        struct cipher_pkt decrypt = {0};
-        struct cipher_aead_pkt aead_op = {0};
-        uint8_t iv_tmp[12];
-        int ret;
-        
-        /* Copy nonce to IV */
-        memcpy(iv_tmp, nonce, MIN(nonce_len, sizeof(iv_tmp)));
-        
-        /* Setup context for AES-GCM */
-        ctx.keylen = key_len;
-        ctx.key.bit_stream = key;
-        
-        /* Begin session */
-        ret = cipher_begin_session(crypto_dev, &ctx, CRYPTO_CIPHER_ALGO_AES,
-                                  CRYPTO_CIPHER_MODE_GCM, CRYPTO_CIPHER_OP_DECRYPT);
-        if (ret != 0) {
-            LOG_ERR("Failed to setup AES session: %d", ret);
-            goto use_software_aes_dec;
-        }
-        
-        /* Prepare decryption packet */
-        decrypt.in_buf = ciphertext;
-        decrypt.in_len = ciphertext_len;
-        decrypt.out_buf = plaintext;
-        decrypt.out_len = *plaintext_len;
-        
-        /* Prepare AEAD operation */
-        aead_op.ad = aad;
-        aead_op.ad_len = aad_len;
-        aead_op.tag = (uint8_t *)tag;  /* Cast away const as API requires */
-        aead_op.tag_len = tag_len;
-        
-        /* Perform AEAD decrypt */
-        ctx.mode_params.gcm_info.iv.iv = iv_tmp;
-        ctx.mode_params.gcm_info.iv.ivlen = MIN(nonce_len, sizeof(iv_tmp));
+
+#ifdef CRYPTO_OPS_HW_AES
+    /* On STM32H573I-DK, use hardware AES if it can take the operation */
+    if (hw_aes_supports(key_len, nonce_len, aad_len, ciphertext_len)) {
+        uint8_t expected_tag[16];
         
-        ret = cipher_gcm_op(&ctx, &aead_op, &decrypt);
-        if (ret != 0) {
-            LOG_ERR("AES-GCM hardware decryption failed: %d", ret);
-            cipher_free_session(crypto_dev, &ctx);
-            
-            if (ret == -22) {  /* -EINVAL, likely tag mismatch */
+        if (hw_aes_gcm(false, key, key_len, nonce, aad, aad_len,
+                       ciphertext, ciphertext_len, plaintext, expected_tag) == 0) {
+            if (!tags_equal(expected_tag, tag, tag_len)) {
+                /* Never hand out unauthenticated plaintext */
+                memset(plaintext, 0, ciphertext_len);
+                LOG_WRN("AES-GCM authentication failed");
                 return CRYPTO_OPS_ERR_AUTH;
             }
-            
-            goto use_software_aes_dec;
+            *plaintext_len = ciphertext_len;
+            LOG_DBG("Hardware AES-GCM decryption of %u bytes", (unsigned int)ciphertext_len);
+            return CRYPTO_OPS_SUCCESS;
         }
         
-        /* Set output length */
-        *plaintext_len = ciphertext_len;
-        
-        /* Cleanup */
-        cipher_free_session(crypto_dev, &ctx);
-        
-        LOG_DBG("Hardware AES-GCM decryption of %u bytes", (unsigned int)ciphertext_len);
-    } else {
-    use_software_aes_dec:
-        LOG_WRN("Hardware AES not available, using software fallback");
-        
-        /* For software fallback, we use mbedTLS, but for simplicity in this 
-         * example we'll just simulate decryption like in QEMU mode */
-        memcpy(plaintext, ciphertext, ciphertext_len);
-        *plaintext_len = ciphertext_len;
-        
-        LOG_DBG("Software AES-GCM decryption of %u bytes", (unsigned int)ciphertext_len);
+        /* In place, the ciphertext may already be overwritten */
+        if (plaintext == ciphertext) {
+            return CRYPTO_OPS_ERR_HARDWARE;
+        }
+        LOG_WRN("Hardware AES failed, using software fallback");
     }
 #endif
+
+    ret = sw_aes_gcm(false, key, key_len, nonce, nonce_len, aad, aad_len,
+                     ciphertext, ciphertext_len, plaintext, (uint8_t *)tag, tag_len);
+    if (ret == CRYPTO_OPS_ERR_AUTH) {
+        LOG_WRN("AES-GCM authentication failed");
+    }
+    if (ret != CRYPTO_OPS_SUCCESS) {
+        return ret;
+    }
+    *plaintext_len = ciphertext_len;
     
-    /* Pretend the tag is valid */
+    LOG_DBG("Software AES-GCM decryption of %u bytes", (unsigned int)ciphertext_len);
     return CRYPTO_OPS_SUCCESS;
 }
 
-int crypto_ops_sha256(const uint8_t *data, size_t data_len, uint8_t *hash)
+/* Life cycle of a struct crypto_ops_aes_gcm_ctx */
+#define GCM_CTX_RELEASED        0
+#define GCM_CTX_AAD             1   /* Started, still taking AAD */
+#define GCM_CTX_DATA            2   /* Payload under way */
+
+static void gcm_ctx_release(struct crypto_ops_aes_gcm_ctx *ctx)
 {
-#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
-    LOG_INF("SHA-256 hash (QEMU simulation)");
-#else
-    LOG_INF("SHA-256 hash (STM32H573I-DK)");
-#endif
+    /* Wipes the key schedule and GHASH state */
+    mbedtls_gcm_free(&ctx->gcm);
+    ctx->state = GCM_CTX_RELEASED;
+}
+
+int crypto_ops_aes_gcm_start(struct crypto_ops_aes_gcm_ctx *ctx, bool encrypt,
+                             const uint8_t *key, size_t key_len,
+                             const uint8_t *nonce, size_t nonce_len)
+{
+    int ret;
     
     if (!crypto_initialized) {
         LOG_ERR("Crypto operations not initialized");
         return CRYPTO_OPS_ERR_NOT_INIT;
     }
     
-    /* Parameter validation */
-    if (data == NULL || hash == NULL) {
+    if (ctx == NULL || key == NULL || nonce == NULL) {
         LOG_ERR("Invalid parameter (NULL pointer)");
         return CRYPTO_OPS_ERR_PARAM;
     }
     
-#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
-    /* In QEMU simulation, we just generate a random hash
-     * for demonstration purposes
-     */
-    for (size_t i = 0; i < 32; i++) {  /* SHA-256 produces a 32-byte hash */
-        hash[i] = (uint8_t)(simple_rand() & 0xFF);
+    if (key_len != 16 && key_len != 24 && key_len != 32) {
+        LOG_ERR("Invalid key length: %u", (unsigned int)key_len);
+        return CRYPTO_OPS_ERR_KEY;
     }
     
-    LOG_DBG("Simulated SHA-256 hash of %u bytes", (unsigned int)data_len);
-#else
-    /* On STM32H573I-DK, SHA hardware is not available in Zephyr,
-     * so we use mbedTLS software implementation */
-    mbedtls_sha256_context ctx;
+    if (nonce_len < 8) {
+        LOG_ERR("Nonce too short: %u", (unsigned int)nonce_len);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    mbedtls_gcm_init(&ctx->gcm);
+    ctx->state = GCM_CTX_AAD;
+    ctx->decrypt = !encrypt;
     
-    LOG_INF("Using mbedTLS for SHA-256 (hardware SHA not available)");
+    ret = mbedtls_gcm_setkey(&ctx->gcm, MBEDTLS_CIPHER_ID_AES, key, key_len * 8);
+    if (ret != 0) {
+        LOG_ERR("mbedTLS rejected the key: %d", ret);
+        gcm_ctx_release(ctx);
+        return CRYPTO_OPS_ERR_KEY;
+    }
+    
+    ret = mbedtls_gcm_starts(&ctx->gcm, encrypt ? MBEDTLS_GCM_ENCRYPT : MBEDTLS_GCM_DECRYPT,
+                             nonce, nonce_len);
+    if (ret != 0) {
+        LOG_ERR("Failed to start AES-GCM: %d", ret);
+        gcm_ctx_release(ctx);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    LOG_DBG("Started streaming AES-GCM %s", encrypt ? "encryption" : "decryption");
+    return CRYPTO_OPS_SUCCESS;
+}
+
+int crypto_ops_aes_gcm_update_aad(struct crypto_ops_aes_gcm_ctx *ctx,
+                                  const uint8_t *aad, size_t aad_len)
+{
+    if (ctx == NULL) {
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    if (ctx->state != GCM_CTX_AAD || (aad == NULL && aad_len > 0)) {
+        LOG_ERR("AAD passed after the payload or without a buffer");
+        gcm_ctx_release(ctx);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    if (aad_len > 0 && mbedtls_gcm_update_ad(&ctx->gcm, aad, aad_len) != 0) {
+        LOG_ERR("AAD too long");
+        gcm_ctx_release(ctx);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    return CRYPTO_OPS_SUCCESS;
+}
+
+int crypto_ops_aes_gcm_update(struct crypto_ops_aes_gcm_ctx *ctx,
+                              const uint8_t *input, size_t len, uint8_t *output)
+{
+    size_t output_len;
+    
+    if (ctx == NULL) {
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    if (ctx->state == GCM_CTX_RELEASED || ((input == NULL || output == NULL) && len > 0)) {
+        LOG_ERR("Invalid parameter (NULL pointer or released context)");
+        gcm_ctx_release(ctx);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    ctx->state = GCM_CTX_DATA;
+    if (len == 0) {
+        return CRYPTO_OPS_SUCCESS;
+    }
+    
+    /* GCM is a stream cipher; mbedTLS carries partial blocks over itself */
+    if (mbedtls_gcm_update(&ctx->gcm, input, len, output, len, &output_len) != 0 ||
+        output_len != len) {
+        LOG_ERR("Message exceeds the AES-GCM limit");
+        gcm_ctx_release(ctx);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    return CRYPTO_OPS_SUCCESS;
+}
+
+/* Finish the operation into tag and release the context */
+static int gcm_ctx_final(struct crypto_ops_aes_gcm_ctx *ctx, bool decrypt,
+                         uint8_t *tag, size_t tag_len)
+{
+    size_t output_len;
+    int ret;
+    
+    if (ctx == NULL) {
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    if (ctx->state == GCM_CTX_RELEASED || ctx->decrypt != decrypt) {
+        LOG_ERR("Context not started for %s", decrypt ? "decryption" : "encryption");
+        gcm_ctx_release(ctx);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    if (tag_len < 4 || tag_len > 16) {
+        LOG_ERR("Invalid tag length: %u", (unsigned int)tag_len);
+        gcm_ctx_release(ctx);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    ret = mbedtls_gcm_finish(&ctx->gcm, NULL, 0, &output_len, tag, tag_len);
+    gcm_ctx_release(ctx);
+    if (ret != 0) {
+        LOG_ERR("Failed to finish AES-GCM: %d", ret);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    return CRYPTO_OPS_SUCCESS;
+}
+
+int crypto_ops_aes_gcm_finish(struct crypto_ops_aes_gcm_ctx *ctx,
+                              uint8_t *tag, size_t tag_len)
+{
+    if (tag == NULL) {
+        crypto_ops_aes_gcm_abort(ctx);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    return gcm_ctx_final(ctx, false, tag, tag_len);
+}
+
+int crypto_ops_aes_gcm_verify(struct crypto_ops_aes_gcm_ctx *ctx,
+                              const uint8_t *tag, size_t tag_len)
+{
+    uint8_t expected[16];
+    int ret;
+    
+    if (tag == NULL) {
+        crypto_ops_aes_gcm_abort(ctx);
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    ret = gcm_ctx_final(ctx, true, expected, tag_len);
+    if (ret != CRYPTO_OPS_SUCCESS) {
+        return ret;
+    }
+    
+    if (!tags_equal(expected, tag, tag_len)) {
+        LOG_WRN("AES-GCM authentication failed");
+        return CRYPTO_OPS_ERR_AUTH;
+    }
+    
+    return CRYPTO_OPS_SUCCESS;
+}
+
+void crypto_ops_aes_gcm_abort(struct crypto_ops_aes_gcm_ctx *ctx)
+{
+    if (ctx != NULL && ctx->state != GCM_CTX_RELEASED) {
+        gcm_ctx_release(ctx);
+    }
+}
+
+int crypto_ops_sha256(const uint8_t *data, size_t data_len, uint8_t *hash)
+{
+    if (!crypto_initialized) {
+        LOG_ERR("Crypto operations not initialized");
+        return CRYPTO_OPS_ERR_NOT_INIT;
+    }
+    
+    /* Parameter validation */
+    if (data == NULL || hash == NULL) {
+        LOG_ERR("Invalid parameter (NULL pointer)");
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    /* SHA hardware is not available in Zephyr, so both platforms use
+     * the mbedTLS software implementation */
+    mbedtls_sha256_context ctx;
     
     mbedtls_sha256_init(&ctx);
     mbedtls_sha256_starts(&ctx, 0); /* 0 for SHA-256 */
@@ -469,20 +781,28 @@ int crypto_ops_sha256(const uint8_t *data, size_t data_len, uint8_t *hash)
     mbedtls_sha256_free(&ctx);
     
     LOG_DBG("Software SHA-256 hash of %u bytes", (unsigned int)data_len);
-#endif
     
     return CRYPTO_OPS_SUCCESS;
 }
 
 int crypto_ops_self_test(void)
 {
+    /* AES-256-GCM test case 14 of the GCM specification: zero key, IV and plaintext */
+    static const uint8_t kat_ciphertext[16] = {
+        0xce, 0xa7, 0x40, 0x3d, 0x4d, 0x60, 0x6b, 0x6e,
+        0x07, 0x4e, 0xc5, 0xd3, 0xba, 0xf3, 0x9d, 0x18
+    };
+    static const uint8_t kat_tag[16] = {
+        0xd0, 0xd1, 0xc8, 0xa7, 0x99, 0x99, 0x6b, 0xf0,
+        0x26, 0x5b, 0x98, 0xb5, 0xd4, 0x8a, 0xb9, 0x19
+    };
     uint8_t buffer[32];
     size_t buffer_len = sizeof(buffer);
-    uint8_t key[16] = {0};
+    uint8_t key[32] = {0};
     uint8_t nonce[12] = {0};
     uint8_t tag[16] = {0};
     int ret;
-    
+
 #ifdef CONFIG_BOARD_QEMU_CORTEX_M3
     LOG_INF("Running crypto self-test (QEMU simulation)");
 #else
@@ -496,7 +816,7 @@ int crypto_ops_self_test(void)
             has_hw_aes ? "Yes" : "No", 
             has_hw_rng ? "Yes" : "No");
 #endif
-    
+
     /* Test random number generation */
     ret = crypto_ops_random_bytes(buffer, sizeof(buffer));
     if (ret != CRYPTO_OPS_SUCCESS) {
@@ -504,13 +824,67 @@ int crypto_ops_self_test(void)
         return ret;
     }
     
-    /* Test AES-GCM encryption */
+    /* Test AES-GCM encryption against the known answer, in place */
+    memset(buffer, 0, 16);
     ret = crypto_ops_aes_gcm_encrypt(key, sizeof(key), nonce, sizeof(nonce),
                                    NULL, 0, buffer, 16, buffer, &buffer_len, tag, sizeof(tag));
     if (ret != CRYPTO_OPS_SUCCESS) {
         LOG_ERR("AES-GCM encryption test failed: %d", ret);
         return ret;
     }
+    if (memcmp(buffer, kat_ciphertext, 16) != 0 || memcmp(tag, kat_tag, 16) != 0) {
+        LOG_ERR("AES-GCM encryption test gave the wrong result");
+        return CRYPTO_OPS_ERR_HARDWARE;
+    }
+    
+    /* Test AES-GCM decryption, and that a damaged tag is refused */
+    buffer_len = sizeof(buffer);
+    ret = crypto_ops_aes_gcm_decrypt(key, sizeof(key), nonce, sizeof(nonce), NULL, 0,
+                                   kat_ciphertext, 16, kat_tag, 16, buffer, &buffer_len);
+    if (ret != CRYPTO_OPS_SUCCESS || buffer_len != 16 || buffer[0] != 0 || buffer[15] != 0) {
+        LOG_ERR("AES-GCM decryption test failed: %d", ret);
+        return (ret != CRYPTO_OPS_SUCCESS) ? ret : CRYPTO_OPS_ERR_HARDWARE;
+    }
+    tag[0] ^= 1;
+    buffer_len = sizeof(buffer);
+    ret = crypto_ops_aes_gcm_decrypt(key, sizeof(key), nonce, sizeof(nonce), NULL, 0,
+                                   kat_ciphertext, 16, tag, 16, buffer, &buffer_len);
+    if (ret != CRYPTO_OPS_ERR_AUTH) {
+        LOG_ERR("AES-GCM accepted a damaged tag: %d", ret);
+        return CRYPTO_OPS_ERR_HARDWARE;
+    }
+    
+    /* Test the streaming API on the same answer, in uneven pieces */
+    struct crypto_ops_aes_gcm_ctx stream;
+    
+    memset(buffer, 0, 16);
+    ret = crypto_ops_aes_gcm_start(&stream, true, key, sizeof(key), nonce, sizeof(nonce));
+    if (ret == CRYPTO_OPS_SUCCESS) {
+        ret = crypto_ops_aes_gcm_update(&stream, buffer, 5, buffer);
+    }
+    if (ret == CRYPTO_OPS_SUCCESS) {
+        ret = crypto_ops_aes_gcm_update(&stream, buffer + 5, 11, buffer + 5);
+    }
+    if (ret == CRYPTO_OPS_SUCCESS) {
+        ret = crypto_ops_aes_gcm_finish(&stream, tag, sizeof(tag));
+    }
+    if (ret != CRYPTO_OPS_SUCCESS || memcmp(buffer, kat_ciphertext, 16) != 0 ||
+        memcmp(tag, kat_tag, 16) != 0) {
+        LOG_ERR("Streaming AES-GCM encryption test failed: %d", ret);
+        return (ret != CRYPTO_OPS_SUCCESS) ? ret : CRYPTO_OPS_ERR_HARDWARE;
+    }
+    
+    ret = crypto_ops_aes_gcm_start(&stream, false, key, sizeof(key), nonce, sizeof(nonce));
+    if (ret == CRYPTO_OPS_SUCCESS) {
+        ret = crypto_ops_aes_gcm_update(&stream, buffer, 16, buffer);
+    }
+    if (ret == CRYPTO_OPS_SUCCESS) {
+        ret = crypto_ops_aes_gcm_verify(&stream, kat_tag, sizeof(kat_tag));
+    }
+    if (ret != CRYPTO_OPS_SUCCESS || buffer[0] != 0 || buffer[15] != 0) {
+        LOG_ERR("Streaming AES-GCM decryption test failed: %d", ret);
+        return (ret != CRYPTO_OPS_SUCCESS) ? ret : CRYPTO_OPS_ERR_HARDWARE;
+    }
     
     /* Test SHA-256 hash */
     ret = crypto_ops_sha256(buffer, sizeof(buffer), buffer);
@@ -522,3 +896,200 @@ int crypto_ops_self_test(void)
     LOG_INF("Crypto self-test completed successfully");
     return CRYPTO_OPS_SUCCESS;
 }
+
+#ifdef CRYPTO_OPS_BENCH_DWT
+/* Start the DWT cycle counter; false if this core has none */
+static bool bench_dwt_enable(void)
+{
+    if (DWT->CTRL & DWT_CTRL_NOCYCCNT_Msk) {
+        return false;
+    }
+#if defined(CONFIG_ARMV8_M_MAINLINE)
+    DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+#else
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#endif
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    return true;
+}
+#endif
+
+/* Counter the benchmark reads: core cycles from the DWT, or the system timer */
+static bool bench_use_dwt;
+
+static inline uint32_t bench_cycles(void)
+{
+#ifdef CRYPTO_OPS_BENCH_DWT
+    if (bench_use_dwt) {
+        return DWT->CYCCNT;
+    }
+#endif
+    return k_cycle_get_32();
+}
+
+enum bench_op {
+    BENCH_SW_ENCRYPT,
+    BENCH_SW_DECRYPT,
+    BENCH_HW_ENCRYPT,
+    BENCH_HW_DECRYPT,
+    BENCH_SHA256,
+    BENCH_RNG,
+};
+
+struct bench_buffers {
+    const uint8_t *key;
+    const uint8_t *nonce;
+    const uint8_t *input;
+    size_t len;
+    uint8_t *output;
+    uint8_t *tag;
+};
+
+static int bench_run(enum bench_op op, const struct bench_buffers *b)
+{
+    uint8_t hash[32];
+    
+    switch (op) {
+    case BENCH_SW_ENCRYPT:
+    case BENCH_SW_DECRYPT:
+        return sw_aes_gcm(op == BENCH_SW_ENCRYPT, b->key, 32, b->nonce, 12, NULL, 0,
+                          b->input, b->len, b->output, b->tag, 16);
+#ifdef CRYPTO_OPS_HW_AES
+    case BENCH_HW_ENCRYPT:
+    case BENCH_HW_DECRYPT:
+        if (hw_aes_gcm(op == BENCH_HW_ENCRYPT, b->key, 32, b->nonce, NULL, 0,
+                       b->input, b->len, b->output, b->tag) != 0) {
+            return CRYPTO_OPS_ERR_HARDWARE;
+        }
+        return CRYPTO_OPS_SUCCESS;
+#endif
+    case BENCH_SHA256:
+        return crypto_ops_sha256(b->input, b->len, hash);
+    case BENCH_RNG:
+        return crypto_ops_random_bytes(b->output, b->len);
+    default:
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+}
+
+/* Time each run separately, so the minimum and maximum show the latency spread */
+static int bench_measure(enum bench_op op, const struct bench_buffers *b, unsigned int iterations,
+                         struct crypto_ops_bench_timing *timing)
+{
+    uint64_t total = 0;
+    
+    timing->min_cycles = UINT32_MAX;
+    timing->max_cycles = 0;
+    
+    for (unsigned int i = 0; i < iterations; i++) {
+        uint32_t start = bench_cycles();
+        int ret = bench_run(op, b);
+        uint32_t cycles = bench_cycles() - start;
+        
+        if (ret != CRYPTO_OPS_SUCCESS) {
+            return ret;
+        }
+        total += cycles;
+        timing->min_cycles = MIN(timing->min_cycles, cycles);
+        timing->max_cycles = MAX(timing->max_cycles, cycles);
+    }
+    timing->avg_cycles = (uint32_t)(total / iterations);
+    return CRYPTO_OPS_SUCCESS;
+}
+
+int crypto_ops_benchmark(size_t len, unsigned int iterations,
+                         struct crypto_ops_bench_result *result)
+{
+    uint8_t key[32];
+    uint8_t nonce[12];
+    uint8_t sw_tag[16];
+    uint8_t *plaintext, *sw_out, *check;
+    struct bench_buffers b;
+    int ret;
+    
+    if (!crypto_initialized) {
+        LOG_ERR("Crypto operations not initialized");
+        return CRYPTO_OPS_ERR_NOT_INIT;
+    }
+    
+    if (result == NULL || len == 0 || len > CRYPTO_OPS_BENCH_MAX_LEN || iterations == 0) {
+        LOG_ERR("Invalid benchmark parameters");
+        return CRYPTO_OPS_ERR_PARAM;
+    }
+    
+    memset(result, 0, sizeof(*result));
+
+#ifdef CRYPTO_OPS_BENCH_DWT
+    bench_use_dwt = bench_dwt_enable();
+    result->cycles_per_sec = bench_use_dwt ? SystemCoreClock : sys_clock_hw_cycles_per_sec();
+#else
+    result->cycles_per_sec = sys_clock_hw_cycles_per_sec();
+#endif
+    result->dwt = bench_use_dwt;
+    
+    /* Heap buffers are word aligned, so large runs take the DMA path */
+    plaintext = k_malloc(len);
+    sw_out = k_malloc(len);
+    check = k_malloc(len);
+    if (plaintext == NULL || sw_out == NULL || check == NULL) {
+        LOG_ERR("Not enough heap for a %u byte benchmark", (unsigned int)len);
+        ret = CRYPTO_OPS_ERR_BUFFER;
+        goto out;
+    }
+    
+    crypto_ops_random_bytes(key, sizeof(key));
+    crypto_ops_random_bytes(nonce, sizeof(nonce));
+    crypto_ops_random_bytes(plaintext, len);
+    
+    b = (struct bench_buffers){ key, nonce, plaintext, len, sw_out, sw_tag };
+    ret = bench_measure(BENCH_SW_ENCRYPT, &b, iterations, &result->sw_encrypt);
+    if (ret == CRYPTO_OPS_SUCCESS) {
+        b = (struct bench_buffers){ key, nonce, sw_out, len, check, sw_tag };
+        ret = bench_measure(BENCH_SW_DECRYPT, &b, iterations, &result->sw_decrypt);
+    }
+    if (ret != CRYPTO_OPS_SUCCESS || memcmp(check, plaintext, len) != 0) {
+        LOG_ERR("Software AES-GCM benchmark failed: %d", ret);
+        ret = (ret != CRYPTO_OPS_SUCCESS) ? ret : CRYPTO_OPS_ERR_AUTH;
+        goto out;
+    }
+
+#ifdef CRYPTO_OPS_HW_AES
+    if (hw_aes_supports(sizeof(key), sizeof(nonce), 0, len)) {
+        uint8_t hw_tag[16];
+        
+        result->hw_available = true;
+        result->hw_dma = IS_ENABLED(CRYPTO_OPS_HW_AES_DMA) && len >= CRYPTO_OPS_HW_DMA_THRESHOLD;
+        
+        b = (struct bench_buffers){ key, nonce, plaintext, len, check, hw_tag };
+        ret = bench_measure(BENCH_HW_ENCRYPT, &b, iterations, &result->hw_encrypt);
+        if (ret != CRYPTO_OPS_SUCCESS) {
+            goto out;
+        }
+        /* Both implementations must produce the same ciphertext and tag */
+        result->outputs_match = memcmp(check, sw_out, len) == 0 &&
+                                memcmp(hw_tag, sw_tag, sizeof(hw_tag)) == 0;
+        
+        b = (struct bench_buffers){ key, nonce, sw_out, len, check, hw_tag };
+        ret = bench_measure(BENCH_HW_DECRYPT, &b, iterations, &result->hw_decrypt);
+        if (ret != CRYPTO_OPS_SUCCESS) {
+            goto out;
+        }
+        result->outputs_match = result->outputs_match && memcmp(check, plaintext, len) == 0 &&
+                                memcmp(hw_tag, sw_tag, sizeof(hw_tag)) == 0;
+    }
+#endif
+
+    b = (struct bench_buffers){ NULL, NULL, plaintext, len, check, NULL };
+    ret = bench_measure(BENCH_SHA256, &b, iterations, &result->sha256);
+    if (ret == CRYPTO_OPS_SUCCESS) {
+        ret = bench_measure(BENCH_RNG, &b, iterations, &result->rng);
+    }
+
+out:
+    k_free(plaintext);
+    k_free(sw_out);
+    k_free(check);
+    memset(key, 0, sizeof(key));
+    return ret;
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2025 CRUSTy-Core
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+
+#include "link_proto.h"
+#include "uart_comm.h"
+#include "crypto_ops.h"
+
+LOG_MODULE_REGISTER(link_proto, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Defines */
+#define LINK_THREAD_STACK_SIZE 4096
+#define LINK_THREAD_PRIORITY   7
+#define LINK_RETRANSMIT_MS     1000
+#define LINK_MAX_RETRANSMITS   5
+#define LINK_SEND_TIMEOUT_MS   500
+
+/*
+ * Frames start two bytes into word-aligned storage, so payloads (offset 10)
+ * and the text after a nonce (offset 22) are word aligned, which the AES
+ * peripheral needs to move them by DMA.
+ */
+#define LINK_FRAME_PAD         2
+
+/* A sent message frame, kept until the host acknowledges it */
+struct link_tx_slot {
+    uint8_t pad[LINK_FRAME_PAD];
+    uint8_t frame[LINK_MAX_FRAME];
+    size_t len;
+} __aligned(4);
+
+static K_THREAD_STACK_DEFINE(link_stack, LINK_THREAD_STACK_SIZE);
+static struct k_thread link_thread;
+static bool link_active;
+
+/* Receive state */
+static uint8_t rx_buffer[LINK_FRAME_PAD + LINK_MAX_FRAME] __aligned(4);
+static uint8_t *const rx_frame = rx_buffer + LINK_FRAME_PAD;
+static size_t rx_len;
+static uint16_t rx_expected;    /* Seq of the next request we accept */
+
+/* Send state; slot seq % LINK_WINDOW holds frame seq */
+static struct link_tx_slot tx_slots[LINK_WINDOW];
+static uint16_t tx_base;        /* Oldest unacknowledged seq */
+static uint16_t tx_next;        /* Seq of our next reply */
+static int64_t tx_deadline;
+static int tx_timeouts;
+static uint8_t tx_control[LINK_HEADER_SIZE + LINK_CRC_SIZE];
+
+/* Key loaded by SET_KEY */
+static uint8_t link_key[32];
+static size_t link_key_len;
+
+static void put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void put_u32(uint8_t *p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void link_clear_key(void)
+{
+    memset(link_key, 0, sizeof(link_key));
+    link_key_len = 0;
+}
+
+/**
+ * @brief Write the header and CRC around a payload already in place
+ *
+ * The ack field always carries the current rx_expected, so a resent frame
+ * acknowledges everything received since it was first sent.
+ *
+ * @return Length of the whole frame
+ */
+static size_t link_seal(uint8_t *frame, uint8_t type, uint16_t seq, size_t payload_len)
+{
+    frame[0] = LINK_MAGIC0;
+    frame[1] = LINK_MAGIC1;
+    frame[2] = type;
+    frame[3] = 0;
+    put_u16(frame + 4, seq);
+    put_u16(frame + 6, rx_expected);
+    put_u16(frame + 8, (uint16_t)payload_len);
+    put_u32(frame + LINK_HEADER_SIZE + payload_len,
+            crc32_ieee(frame + 2, LINK_HEADER_SIZE - 2 + payload_len));
+    return LINK_HEADER_SIZE + payload_len + LINK_CRC_SIZE;
+}
+
+static void link_write(const uint8_t *frame, size_t len)
+{
+    /* A frame that cannot be queued is as good as lost; it is resent on timeout */
+    if (uart_comm_send(frame, len, K_MSEC(LINK_SEND_TIMEOUT_MS)) != UART_COMM_SUCCESS) {
+        LOG_WRN("Link frame not sent");
+    }
+}
+
+static void link_send_control(uint8_t type)
+{
+    link_write(tx_control, link_seal(tx_control, type, 0, 0));
+}
+
+/* Where the next reply's payload goes; replies are built in their send slot */
+static uint8_t *link_reply_payload(void)
+{
+    return tx_slots[tx_next % LINK_WINDOW].frame + LINK_HEADER_SIZE;
+}
+
+static void link_send_reply(uint8_t type, size_t payload_len)
+{
+    struct link_tx_slot *slot = &tx_slots[tx_next % LINK_WINDOW];
+
+    slot->len = link_seal(slot->frame, type, tx_next, payload_len);
+    if (tx_base == tx_next) {
+        tx_deadline = k_uptime_get() + LINK_RETRANSMIT_MS;
+        tx_timeouts = 0;
+    }
+    tx_next++;
+    link_write(slot->frame, slot->len);
+}
+
+static void link_send_error(uint8_t code)
+{
+    link_reply_payload()[0] = code;
+    link_send_reply(LINK_FRAME_ERROR, 1);
+}
+
+static void link_reset(void)
+{
+    rx_expected = 0;
+    tx_base = 0;
+    tx_next = 0;
+    tx_timeouts = 0;
+    link_clear_key();
+}
+
+static void link_acknowledge(uint16_t ack)
+{
+    uint16_t outstanding = tx_next - tx_base;
+    uint16_t acked = ack - tx_base;
+
+    /* Anything outside the window is stale */
+    if (acked == 0 || acked > outstanding) {
+        return;
+    }
+    tx_base = ack;
+    tx_deadline = k_uptime_get() + LINK_RETRANSMIT_MS;
+    tx_timeouts = 0;
+}
+
+static void link_check_retransmit(void)
+{
+    if (tx_base == tx_next || k_uptime_get() < tx_deadline) {
+        return;
+    }
+
+    if (++tx_timeouts > LINK_MAX_RETRANSMITS) {
+        /* The host went away; it resets the link when it comes back */
+        LOG_WRN("Link host not responding, dropping %u replies", (unsigned int)(uint16_t)(tx_next - tx_base));
+        tx_base = tx_next;
+        return;
+    }
+
+    /* Go-back-N: resend everything from the oldest unacknowledged frame */
+    for (uint16_t seq = tx_base; seq != tx_next; seq++) {
+        struct link_tx_slot *slot = &tx_slots[seq % LINK_WINDOW];
+        slot->len = link_seal(slot->frame, slot->frame[2], seq,
+                              slot->len - LINK_HEADER_SIZE - LINK_CRC_SIZE);
+        link_write(slot->frame, slot->len);
+    }
+    tx_deadline = k_uptime_get() + LINK_RETRANSMIT_MS;
+}
+
+static void link_send_info(void)
+{
+    uint8_t *reply = link_reply_payload();
+    bool has_aes, has_rng, has_sha, has_pka;
+
+    crypto_ops_get_capabilities(&has_aes, &has_rng, &has_sha, &has_pka);
+    put_u16(reply, LINK_PROTOCOL_VERSION);
+    put_u16(reply + 2, LINK_MAX_CHUNK);
+    reply[4] = LINK_WINDOW;
+    reply[5] = (has_aes ? LINK_CAP_HW_AES : 0) | (has_rng ? LINK_CAP_HW_RNG : 0) |
+               (has_sha ? LINK_CAP_HW_SHA : 0) | (has_pka ? LINK_CAP_HW_PKA : 0);
+    link_send_reply(LINK_FRAME_INFO, 6);
+}
+
+/* ENCRYPT: nonce | plaintext, answered with ciphertext | tag */
+static void link_encrypt(const uint8_t *payload, size_t len)
+{
+    if (len < LINK_NONCE_SIZE || len - LINK_NONCE_SIZE > LINK_MAX_CHUNK) {
+        link_send_error(LINK_ERR_BAD_REQUEST);
+        return;
+    }
+    if (link_key_len == 0) {
+        link_send_error(LINK_ERR_NO_KEY);
+        return;
+    }
+
+    size_t text_len = len - LINK_NONCE_SIZE;
+    size_t out_len = text_len;
+    uint8_t *reply = link_reply_payload();
+    int ret = crypto_ops_aes_gcm_encrypt(link_key, link_key_len, payload, LINK_NONCE_SIZE, NULL, 0,
+                                         payload + LINK_NONCE_SIZE, text_len, reply, &out_len,
+                                         reply + text_len, LINK_TAG_SIZE);
+    if (ret != CRYPTO_OPS_SUCCESS || out_len != text_len) {
+        LOG_ERR("Link encryption failed: %d", ret);
+        link_send_error(LINK_ERR_CRYPTO_FAILED);
+        return;
+    }
+    link_send_reply(LINK_FRAME_RESULT, text_len + LINK_TAG_SIZE);
+}
+
+/* DECRYPT: nonce | ciphertext | tag, answered with plaintext */
+static void link_decrypt(const uint8_t *payload, size_t len)
+{
+    if (len < LINK_NONCE_SIZE + LINK_TAG_SIZE ||
+        len - LINK_NONCE_SIZE - LINK_TAG_SIZE > LINK_MAX_CHUNK) {
+        link_send_error(LINK_ERR_BAD_REQUEST);
+        return;
+    }
+    if (link_key_len == 0) {
+        link_send_error(LINK_ERR_NO_KEY);
+        return;
+    }
+
+    size_t text_len = len - LINK_NONCE_SIZE - LINK_TAG_SIZE;
+    size_t out_len = LINK_MAX_CHUNK;
+    uint8_t *reply = link_reply_payload();
+    int ret = crypto_ops_aes_gcm_decrypt(link_key, link_key_len, payload, LINK_NONCE_SIZE, NULL, 0,
+                                         payload + LINK_NONCE_SIZE, text_len,
+                                         payload + LINK_NONCE_SIZE + text_len, LINK_TAG_SIZE,
+                                         reply, &out_len);
+    if (ret == CRYPTO_OPS_ERR_AUTH) {
+        memset(reply, 0, text_len);
+        link_send_error(LINK_ERR_AUTH_FAILED);
+        return;
+    }
+    if (ret != CRYPTO_OPS_SUCCESS || out_len != text_len) {
+        LOG_ERR("Link decryption failed: %d", ret);
+        link_send_error(LINK_ERR_CRYPTO_FAILED);
+        return;
+    }
+    link_send_reply(LINK_FRAME_RESULT, text_len);
+}
+
+static void link_handle_request(uint8_t type, const uint8_t *payload, size_t len)
+{
+    switch (type) {
+    case LINK_FRAME_HELLO:
+        link_send_info();
+        break;
+
+    case LINK_FRAME_SET_KEY:
+        if (len != 16 && len != 24 && len != 32) {
+            link_send_error(LINK_ERR_BAD_REQUEST);
+            break;
+        }
+        memcpy(link_key, payload, len);
+        link_key_len = len;
+        link_send_reply(LINK_FRAME_OK, 0);
+        break;
+
+    case LINK_FRAME_CLEAR_KEY:
+        link_clear_key();
+        link_send_reply(LINK_FRAME_OK, 0);
+        break;
+
+    case LINK_FRAME_ENCRYPT:
+        link_encrypt(payload, len);
+        break;
+
+    case LINK_FRAME_DECRYPT:
+        link_decrypt(payload, len);
+        break;
+
+    default:
+        link_send_error(LINK_ERR_BAD_REQUEST);
+        break;
+    }
+}
+
+static void link_handle_frame(const uint8_t *frame, size_t payload_len)
+{
+    uint8_t type = frame[2];
+    uint16_t seq = get_u16(frame + 4);
+
+    if (type == LINK_FRAME_RESET) {
+        link_reset();
+        link_send_control(LINK_FRAME_RESET_DONE);
+        return;
+    }
+
+    link_acknowledge(get_u16(frame + 6));
+    if (type < LINK_FRAME_HELLO) {
+        return;
+    }
+
+    /* A repeat, a gap, or no slot left for the reply: the host resends */
+    if (seq != rx_expected || (uint16_t)(tx_next - tx_base) >= LINK_WINDOW) {
+        link_send_control(LINK_FRAME_ACK);
+        return;
+    }
+    rx_expected++;
+    link_handle_request(type, frame + LINK_HEADER_SIZE, payload_len);
+}
+
+static void link_rx_byte(uint8_t c)
+{
+    /* Hunt for the magic; anything else between frames is skipped */
+    if (rx_len == 0 && c != LINK_MAGIC0) {
+        return;
+    }
+    if (rx_len == 1 && c != LINK_MAGIC1) {
+        rx_len = (c == LINK_MAGIC0) ? 1 : 0;
+        return;
+    }
+    rx_frame[rx_len++] = c;
+    if (rx_len < LINK_HEADER_SIZE) {
+        return;
+    }
+
+    size_t payload_len = get_u16(rx_frame + 8);
+    if (payload_len > LINK_MAX_PAYLOAD || rx_frame[3] != 0) {
+        rx_len = 0;
+        return;
+    }
+    if (rx_len < LINK_HEADER_SIZE + payload_len + LINK_CRC_SIZE) {
+        return;
+    }
+    rx_len = 0;
+
+    uint32_t crc = crc32_ieee(rx_frame + 2, LINK_HEADER_SIZE - 2 + payload_len);
+    if (crc != get_u32(rx_frame + LINK_HEADER_SIZE + payload_len)) {
+        /* Dropped; the host resends it */
+        return;
+    }
+    link_handle_frame(rx_frame, payload_len);
+}
+
+static void link_thread_fn(void *p1, void *p2, void *p3)
+{
+    uint8_t buf[64];
+
+    while (true) {
+        /* Sleep until data arrives, or until a reply is due for resending */
+        k_timeout_t wait = K_FOREVER;
+        if (tx_base != tx_next) {
+            int64_t left = tx_deadline - k_uptime_get();
+            wait = K_MSEC(MAX(left, 0));
+        }
+
+        int count = uart_comm_read(buf, sizeof(buf), wait);
+        for (int i = 0; i < count; i++) {
+            link_rx_byte(buf[i]);
+        }
+        link_check_retransmit();
+    }
+}
+
+int link_proto_start(void)
+{
+    if (link_active) {
+        return LINK_PROTO_SUCCESS;
+    }
+
+    if (!uart_comm_is_ready()) {
+        LOG_ERR("UART not initialized");
+        return LINK_PROTO_ERR_STATE;
+    }
+
+    /* Received bytes now stay buffered for the link thread */
+    uart_comm_set_rx_callback(NULL);
+    link_reset();
+    rx_len = 0;
+    link_active = true;
+
+    k_thread_create(&link_thread, link_stack, K_THREAD_STACK_SIZEOF(link_stack),
+                    link_thread_fn, NULL, NULL, NULL, LINK_THREAD_PRIORITY, 0, K_NO_WAIT);
+    LOG_INF("Binary host link started");
+    return LINK_PROTO_SUCCESS;
+}
+
+bool link_proto_is_active(void)
+{
+    return link_active;
+}
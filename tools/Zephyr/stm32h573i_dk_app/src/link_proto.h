@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2025 CRUSTy-Core
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LINK_PROTO_H_
+#define LINK_PROTO_H_
+
+#include <stdbool.h>
+
+/*
+ * Binary host link for offloaded encryption. The frame layout and message
+ * types must match src/cpp/core/device_protocol.h on the host, which
+ * describes the protocol in full:
+ *
+ *   magic A5 5A | type | flags | seq u16 | ack u16 | length u16 | payload | CRC-32
+ *
+ * Integers are little endian; the CRC covers everything after the magic.
+ */
+#define LINK_MAGIC0            0xA5
+#define LINK_MAGIC1            0x5A
+#define LINK_HEADER_SIZE       10
+#define LINK_CRC_SIZE          4
+
+#define LINK_PROTOCOL_VERSION  1
+#define LINK_MAX_CHUNK         1024
+#define LINK_NONCE_SIZE        12
+#define LINK_TAG_SIZE          16
+#define LINK_MAX_PAYLOAD       (LINK_NONCE_SIZE + LINK_MAX_CHUNK + LINK_TAG_SIZE)
+#define LINK_MAX_FRAME         (LINK_HEADER_SIZE + LINK_MAX_PAYLOAD + LINK_CRC_SIZE)
+
+/* Message frames either side may have unacknowledged; must divide 65536 */
+#define LINK_WINDOW            4
+
+/* Unnumbered frame types */
+#define LINK_FRAME_ACK         0x01
+#define LINK_FRAME_RESET       0x02
+#define LINK_FRAME_RESET_DONE  0x03
+
+/* Requests */
+#define LINK_FRAME_HELLO       0x10
+#define LINK_FRAME_SET_KEY     0x11
+#define LINK_FRAME_CLEAR_KEY   0x12
+#define LINK_FRAME_ENCRYPT     0x13
+#define LINK_FRAME_DECRYPT     0x14
+
+/* Replies */
+#define LINK_FRAME_INFO        0x20
+#define LINK_FRAME_OK          0x21
+#define LINK_FRAME_RESULT      0x22
+#define LINK_FRAME_ERROR       0x23
+
+/* Capability bits of INFO */
+#define LINK_CAP_HW_AES        (1 << 0)
+#define LINK_CAP_HW_RNG        (1 << 1)
+#define LINK_CAP_HW_SHA        (1 << 2)
+#define LINK_CAP_HW_PKA        (1 << 3)
+
+/* Codes carried by ERROR */
+#define LINK_ERR_BAD_REQUEST   1
+#define LINK_ERR_NO_KEY        2
+#define LINK_ERR_AUTH_FAILED   3
+#define LINK_ERR_CRYPTO_FAILED 4
+
+/* Return codes */
+#define LINK_PROTO_SUCCESS     0
+#define LINK_PROTO_ERR_STATE  -1
+
+/**
+ * @brief Hand the UART over to the binary host link
+ *
+ * Stops delivering received lines to the UART callback and starts the link
+ * thread, which reads frames from uart_comm and answers them. The text
+ * commands stay unavailable until the board is reset. Calling it again
+ * while the link runs does nothing.
+ *
+ * @return LINK_PROTO_SUCCESS on success, LINK_PROTO_ERR_STATE if the UART is not initialized
+ */
+int link_proto_start(void);
+
+/**
+ * @brief Check if the binary host link is running
+ *
+ * @return true once link_proto_start() has succeeded
+ */
+bool link_proto_is_active(void);
+
+#endif /* LINK_PROTO_H_ */
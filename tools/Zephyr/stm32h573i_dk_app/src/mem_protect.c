@@ -9,6 +9,7 @@
 #include <zephyr/logging/log.h>
 #include <string.h>
 #include "mem_protect.h"
+#include "secure_heap.h"
 
 /* Log module declaration */
 LOG_MODULE_REGISTER(mem_protect, CONFIG_LOG_DEFAULT_LEVEL);
@@ -21,11 +22,6 @@ LOG_MODULE_REGISTER(mem_protect, CONFIG_LOG_DEFAULT_LEVEL);
 /* MPU region configuration */
 static const struct arm_mpu_region mpu_regions_hw[MEM_REGION_COUNT];
 #else
-/* For QEMU we'll use a static buffer to simulate secure memory */
-#define SECURE_MEM_SIZE (16 * 1024)
-static uint8_t secure_mem_buffer[SECURE_MEM_SIZE];
-#define SECURE_MEM_ADDR ((uintptr_t)secure_mem_buffer)
-
 /* Simple memory region simulation structure */
 static struct {
     uintptr_t base_addr;
@@ -35,18 +31,17 @@ static struct {
 } mpu_regions[MEM_REGION_COUNT];
 #endif
 
-/* Simple allocation tracking for secure memory */
-#define MAX_ALLOCATIONS 16
-static struct {
-    void *ptr;
-    size_t size;
-    bool used;
-} secure_allocations[MAX_ALLOCATIONS];
+/*
+ * Secure memory: secure data in the lower half, crypto buffers in the
+ * upper, each half its own MPU region; secure_heap hands it out. Aligned
+ * to the half so both regions start on their size.
+ */
+#define SECURE_MEM_SIZE (16 * 1024)
+static uint8_t secure_mem_buffer[SECURE_MEM_SIZE] __aligned(SECURE_MEM_SIZE / 2);
+#define SECURE_MEM_ADDR ((uintptr_t)secure_mem_buffer)
 
 /* State variables */
 static bool mem_protection_active = false;
-static size_t secure_mem_used = 0;
-static size_t secure_mem_next_offset = 0;
 
 #ifdef CONFIG_BOARD_QEMU_CORTEX_M3
 /**
@@ -163,20 +158,16 @@ int mem_protect_init(void)
 #ifdef CONFIG_BOARD_QEMU_CORTEX_M3
     LOG_INF("Initializing memory protection simulation (QEMU)...");
 
-    /* Initialize allocation tracking */
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        secure_allocations[i].ptr = NULL;
-        secure_allocations[i].size = 0;
-        secure_allocations[i].used = false;
-    }
-
     /* Initialize region configuration */
     for (int i = 0; i < MEM_REGION_COUNT; i++) {
         mpu_regions[i].configured = false;
     }
 
-    /* Clear secure memory buffer */
-    memset(secure_mem_buffer, 0, SECURE_MEM_SIZE);
+    /* Clear secure memory and set up its allocator */
+    if (secure_heap_init(secure_mem_buffer, SECURE_MEM_SIZE) != SECURE_HEAP_SUCCESS) {
+        LOG_ERR("Failed to set up the secure heap");
+        return MEM_PROTECT_ERROR_INIT;
+    }
 
     /* Define secure data region */
     ret = configure_memory_region(MEM_REGION_SECURE_DATA, 
@@ -204,11 +195,10 @@ int mem_protect_init(void)
 #else
     LOG_INF("Initializing hardware memory protection (STM32H573I-DK)...");
     
-    /* Initialize allocation tracking */
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        secure_allocations[i].ptr = NULL;
-        secure_allocations[i].size = 0;
-        secure_allocations[i].used = false;
+    /* Clear secure memory and set up its allocator */
+    if (secure_heap_init(secure_mem_buffer, SECURE_MEM_SIZE) != SECURE_HEAP_SUCCESS) {
+        LOG_ERR("Failed to set up the secure heap");
+        return MEM_PROTECT_ERROR_INIT;
     }
     
     /* Check if MPU is available */
@@ -218,11 +208,9 @@ int mem_protect_init(void)
         /* Disable MPU during configuration */
         arm_core_mpu_disable();
         
-        /* Define secure data region - use SRAM section for secure data */
-        /* Note: actual addresses would be derived from linker script symbols */
-        /* Using placeholder addresses for now */
-        uintptr_t secure_data_base = 0x20000000;
-        size_t secure_data_size = 0x4000; /* 16KB */
+        /* Define secure data region over the lower half of secure memory */
+        uintptr_t secure_data_base = SECURE_MEM_ADDR;
+        size_t secure_data_size = SECURE_MEM_SIZE / 2;
         
         ret = configure_hw_memory_region(MEM_REGION_SECURE_DATA,
                                        secure_data_base,
@@ -233,9 +221,9 @@ int mem_protect_init(void)
             return ret;
         }
         
-        /* Define crypto buffer region */
+        /* Define crypto buffer region over the upper half */
         uintptr_t crypto_buf_base = secure_data_base + secure_data_size;
-        size_t crypto_buf_size = 0x4000; /* 16KB */
+        size_t crypto_buf_size = SECURE_MEM_SIZE / 2;
         
         ret = configure_hw_memory_region(MEM_REGION_CRYPTO_BUFFER,
                                       crypto_buf_base,
@@ -285,14 +273,7 @@ int mem_protect_init(void)
         LOG_INF("Hardware MPU initialized successfully");
     #else
         LOG_WRN("Hardware MPU not available, using software-only protection");
-        /* Initialize software protection similar to QEMU */
-        
-        /* Calculate SRAM secure memory region */
-        uintptr_t secure_mem_base = 0x20000000;  /* Start of SRAM */
-        size_t secure_mem_size = 0x8000;         /* 32KB for secure memory */
-        
-        secure_mem_used = 0;
-        secure_mem_next_offset = 0;
+        /* Secure memory is allocated as with the MPU, just not fenced off */
         
         /* Memory protection is limited but active */
         mem_protection_active = true;
@@ -340,12 +321,12 @@ int mem_protect_configure_region(mem_region_type_t region_type, mem_access_perm_
         /* Simplified region info - in actual implementation, track these */
         switch (region_type) {
             case MEM_REGION_SECURE_DATA:
-                base = 0x20000000;
-                size = 0x4000;
+                base = SECURE_MEM_ADDR;
+                size = SECURE_MEM_SIZE / 2;
                 break;
             case MEM_REGION_CRYPTO_BUFFER:
-                base = 0x20004000;
-                size = 0x4000;
+                base = SECURE_MEM_ADDR + SECURE_MEM_SIZE / 2;
+                size = SECURE_MEM_SIZE / 2;
                 break;
             case MEM_REGION_CODE:
                 base = 0x08000000;
@@ -386,8 +367,7 @@ int mem_protect_configure_region(mem_region_type_t region_type, mem_access_perm_
 
 void *mem_protect_alloc_secure(size_t size, size_t align)
 {
-    void *ptr = NULL;
-    int idx = -1;
+    void *ptr;
     
     if (!mem_protection_active) {
         LOG_ERR("Memory protection not initialized");
@@ -405,85 +385,23 @@ void *mem_protect_alloc_secure(size_t size, size_t align)
         return NULL;
     }
     
-    /* Find a free allocation slot */
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (!secure_allocations[i].used) {
-            idx = i;
-            break;
-        }
-    }
-    
-    if (idx == -1) {
-        LOG_ERR("No free allocation slots");
-        return NULL;
-    }
-
-#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
-    /* Check if there's enough memory in simulated buffer */
-    if (secure_mem_used + size > SECURE_MEM_SIZE) {
-        LOG_ERR("Not enough secure memory");
+    /* Constant time whatever the occupancy: a fixed-block pool or the TLSF heap */
+    ptr = secure_heap_alloc(size, align);
+    if (ptr == NULL) {
+        LOG_ERR("Not enough secure memory for %u bytes", (unsigned int)size);
         return NULL;
     }
     
-    /* Align the offset */
-    size_t aligned_offset = (secure_mem_next_offset + align - 1) & ~(align - 1);
-    
-    /* Allocate memory from simulation buffer */
-    ptr = &secure_mem_buffer[aligned_offset];
-    secure_allocations[idx].ptr = ptr;
-    secure_allocations[idx].size = size;
-    secure_allocations[idx].used = true;
-    
-    /* Update next offset and used memory */
-    secure_mem_next_offset = aligned_offset + size;
-    secure_mem_used += size;
-#else
-    /* On real hardware, use k_malloc_align for secure memory allocations */
-    /* In a real secure application, we would use a dedicated secure heap */
-    
-    #if defined(CONFIG_ARM_MPU)
-        /* For demonstration, allocate with k_malloc_align */
-        ptr = k_malloc_align(size, align);
-        if (ptr == NULL) {
-            LOG_ERR("Failed to allocate secure memory");
-            return NULL;
-        }
-        
-        secure_allocations[idx].ptr = ptr;
-        secure_allocations[idx].size = size;
-        secure_allocations[idx].used = true;
-        
-        secure_mem_used += size;
-    #else
-        /* Simplified allocation for no-MPU case */
-        /* Similar to QEMU simulation but from system heap */
-        ptr = k_malloc_align(size, align);
-        if (ptr == NULL) {
-            LOG_ERR("Failed to allocate secure memory");
-            return NULL;
-        }
-        
-        secure_allocations[idx].ptr = ptr;
-        secure_allocations[idx].size = size;
-        secure_allocations[idx].used = true;
-        
-        secure_mem_used += size;
-    #endif
-#endif
-    
     /* Clear the allocated memory for security */
     memset(ptr, 0, size);
     
-    LOG_DBG("Allocated %u bytes of secure memory at %p (total used: %u)",
-            (unsigned int)size, ptr, (unsigned int)secure_mem_used);
+    LOG_DBG("Allocated %u bytes of secure memory at %p", (unsigned int)size, ptr);
     
     return ptr;
 }
 
 void mem_protect_free_secure(void *ptr)
 {
-    int idx = -1;
-    
     if (!mem_protection_active) {
         LOG_ERR("Memory protection not initialized");
         return;
@@ -494,37 +412,13 @@ void mem_protect_free_secure(void *ptr)
         return;
     }
     
-    /* Find the allocation slot */
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (secure_allocations[i].used && secure_allocations[i].ptr == ptr) {
-            idx = i;
-            break;
-        }
-    }
-    
-    if (idx == -1) {
+    /* Wipes the block before it can be handed out again */
+    if (secure_heap_free(ptr) != SECURE_HEAP_SUCCESS) {
         LOG_ERR("Attempt to free untracked memory: %p", ptr);
         return;
     }
     
-    /* Clear the memory before freeing */
-    memset(ptr, 0, secure_allocations[idx].size);
-    
-    /* Update memory usage */
-    secure_mem_used -= secure_allocations[idx].size;
-    
-#ifndef CONFIG_BOARD_QEMU_CORTEX_M3
-    /* Only free memory on real hardware, not needed for simulation buffer */
-    k_free(ptr);
-#endif
-    
-    /* Mark slot as unused */
-    secure_allocations[idx].used = false;
-    secure_allocations[idx].ptr = NULL;
-    secure_allocations[idx].size = 0;
-    
-    LOG_DBG("Freed secure memory at %p (total used: %u)",
-            ptr, (unsigned int)secure_mem_used);
+    LOG_DBG("Freed secure memory at %p", ptr);
 }
 
 void mem_protect_sanitize(void *ptr, size_t size)
@@ -564,36 +458,6 @@ bool mem_protect_is_secure_region(void *ptr, size_t size)
         return false;
     }
     
-    uintptr_t addr = (uintptr_t)ptr;
-    uintptr_t end = addr + size;
-    
-#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
-    /* Check if address range is within secure memory simulation buffer */
-    return (addr >= SECURE_MEM_ADDR && end <= (SECURE_MEM_ADDR + SECURE_MEM_SIZE));
-#else
-    /* Check if memory is in a tracked secure allocation */
-    for (int i = 0; i < MAX_ALLOCATIONS; i++) {
-        if (secure_allocations[i].used) {
-            uintptr_t alloc_start = (uintptr_t)secure_allocations[i].ptr;
-            uintptr_t alloc_end = alloc_start + secure_allocations[i].size;
-            
-            if (addr >= alloc_start && end <= alloc_end) {
-                return true;
-            }
-        }
-    }
-    
-    #if defined(CONFIG_ARM_MPU)
-        /* For hardware MPU, we would check if the memory is in a secure region */
-        /* This would require additional tracking of MPU regions */
-        /* Simplified implementation - check if in SRAM secure region */
-        uintptr_t secure_start = 0x20000000;  /* Start of secure SRAM (example) */
-        uintptr_t secure_end = 0x20008000;    /* End of secure SRAM (example) */
-        
-        return (addr >= secure_start && end <= secure_end);
-    #else
-        /* For software-only protection, limited verification */
-        return false;
-    #endif
-#endif
+    /* Everything handed out lives in the MPU-protected secure memory */
+    return secure_heap_contains(ptr, size);
 }
@@ -57,6 +57,8 @@ int mem_protect_configure_region(mem_region_type_t region_type, mem_access_perm_
  *
  * This function allocates memory from the secure region with specific 
  * alignment requirements. The allocated memory is protected from unauthorized access.
+ * Sizes common in crypto jobs come from fixed-block pools, the rest from a TLSF
+ * heap that coalesces freed blocks; either way it takes constant time.
  *
  * @param size Size of memory to allocate in bytes
  * @param align Alignment requirement (must be power of 2)
@@ -67,6 +69,8 @@ void *mem_protect_alloc_secure(size_t size, size_t align);
 /**
  * @brief Free memory allocated from the secure memory region
  *
+ * The memory is wiped before it can be handed out again.
+ *
  * @param ptr Pointer to memory previously allocated with mem_protect_alloc_secure
  */
 void mem_protect_free_secure(void *ptr);
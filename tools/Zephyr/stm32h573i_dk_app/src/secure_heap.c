@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2025 CRUSTy-Core
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "secure_heap.h"
+#include "crypto_ops.h"
+
+/* Log module declaration */
+LOG_MODULE_REGISTER(secure_heap, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*
+ * TLSF layout: a block size maps to a first-level class (its highest set
+ * bit) and one of HEAP_SL_COUNT equal second-level ranges inside it. Each
+ * (class, range) has a free list, and two bitmaps say which lists hold
+ * blocks, so finding a block that fits takes two find-first-set steps.
+ * Sizes below HEAP_SMALL_BLOCK share class 0 in HEAP_ALIGN steps.
+ */
+#define HEAP_ALIGN          (2 * sizeof(void *))
+#define HEAP_ALIGN_LOG2     (sizeof(void *) == 8 ? 4 : 3)
+#define HEAP_SL_LOG2        3
+#define HEAP_SL_COUNT       (1U << HEAP_SL_LOG2)
+#define HEAP_FL_SHIFT       (HEAP_SL_LOG2 + HEAP_ALIGN_LOG2)
+#define HEAP_SMALL_BLOCK    ((size_t)1 << HEAP_FL_SHIFT)
+#define HEAP_FL_COUNT       SECURE_HEAP_CLASS_COUNT
+
+BUILD_ASSERT(HEAP_FL_COUNT == SECURE_HEAP_MAX_LOG2 - HEAP_FL_SHIFT + 2, "class count mismatch");
+
+/*
+ * Every block starts with this header; the free list links live in the
+ * payload while the block is free. Blocks are kept in address order
+ * through prev_phys and their sizes, ending in a zero-size used sentinel,
+ * and no two free blocks are ever adjacent.
+ */
+struct heap_block {
+    struct heap_block *prev_phys;   /* Block just below, NULL for the first */
+    size_t size;                    /* Payload bytes, HEAP_BLOCK_FREE set while free */
+    struct heap_block *next_free;
+    struct heap_block *prev_free;
+};
+
+#define HEAP_BLOCK_FREE     ((size_t)1)
+#define HEAP_HEADER_SIZE    offsetof(struct heap_block, next_free)
+#define HEAP_MIN_BLOCK      sizeof(struct heap_block)   /* Header plus the free links */
+
+BUILD_ASSERT(HEAP_HEADER_SIZE == HEAP_ALIGN, "header must keep payloads aligned");
+
+/* Pool blocks are multiples of this, so every block keeps the alignment */
+#define POOL_ALIGN          16
+
+static const struct {
+    size_t block_size;
+    uint32_t blocks;
+} pool_config[SECURE_HEAP_POOL_COUNT] = {
+    { 32, 8 },                                                          /* AES keys, nonces and tags */
+    { ROUND_UP(sizeof(struct crypto_ops_aes_gcm_ctx), POOL_ALIGN), 2 }, /* Streaming AES-GCM contexts */
+    { ROUND_UP(1024 + 16, POOL_ALIGN), 2 },                             /* A link chunk with its tag */
+};
+
+static struct k_spinlock heap_lock;
+
+/* Region */
+static uint8_t *region_start;
+static size_t region_size;
+
+/* Pools; bit n of pool_used is block n */
+static uint8_t *pool_base[SECURE_HEAP_POOL_COUNT];
+static uint32_t pool_used[SECURE_HEAP_POOL_COUNT];
+
+/* Heap */
+static uint8_t *heap_start;
+static uint8_t *heap_end;           /* Just past the sentinel */
+static struct heap_block *free_lists[HEAP_FL_COUNT][HEAP_SL_COUNT];
+static uint32_t fl_bitmap;
+static uint32_t sl_bitmap[HEAP_FL_COUNT];
+
+static struct secure_heap_stats heap_stats;
+
+static inline size_t block_size(const struct heap_block *block)
+{
+    return block->size & ~HEAP_BLOCK_FREE;
+}
+
+static inline uint8_t *block_payload(struct heap_block *block)
+{
+    return (uint8_t *)block + HEAP_HEADER_SIZE;
+}
+
+static inline struct heap_block *block_next(struct heap_block *block)
+{
+    return (struct heap_block *)(block_payload(block) + block_size(block));
+}
+
+static void heap_mapping(size_t size, unsigned int *fl, unsigned int *sl)
+{
+    if (size < HEAP_SMALL_BLOCK) {
+        *fl = 0;
+        *sl = size >> HEAP_ALIGN_LOG2;
+    } else {
+        unsigned int top = find_msb_set((uint32_t)size) - 1;
+        
+        *fl = top - HEAP_FL_SHIFT + 1;
+        *sl = (size >> (top - HEAP_SL_LOG2)) & (HEAP_SL_COUNT - 1);
+    }
+}
+
+static void class_count_alloc(struct secure_heap_class_stats *stats)
+{
+    stats->in_use++;
+    stats->peak = MAX(stats->peak, stats->in_use);
+}
+
+static void heap_insert(struct heap_block *block)
+{
+    unsigned int fl, sl;
+    
+    heap_mapping(block_size(block), &fl, &sl);
+    block->size |= HEAP_BLOCK_FREE;
+    block->prev_free = NULL;
+    block->next_free = free_lists[fl][sl];
+    if (block->next_free != NULL) {
+        block->next_free->prev_free = block;
+    }
+    free_lists[fl][sl] = block;
+    fl_bitmap |= BIT(fl);
+    sl_bitmap[fl] |= BIT(sl);
+    heap_stats.classes[fl].free_blocks++;
+}
+
+static void heap_remove(struct heap_block *block)
+{
+    unsigned int fl, sl;
+    
+    heap_mapping(block_size(block), &fl, &sl);
+    if (block->prev_free != NULL) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        free_lists[fl][sl] = block->next_free;
+        if (block->next_free == NULL) {
+            sl_bitmap[fl] &= ~BIT(sl);
+            if (sl_bitmap[fl] == 0) {
+                fl_bitmap &= ~BIT(fl);
+            }
+        }
+    }
+    if (block->next_free != NULL) {
+        block->next_free->prev_free = block->prev_free;
+    }
+    block->size &= ~HEAP_BLOCK_FREE;
+    heap_stats.classes[fl].free_blocks--;
+}
+
+/* Unlink a free block of at least size bytes, or return NULL */
+static struct heap_block *heap_take(size_t size)
+{
+    unsigned int fl, sl;
+    uint32_t sl_map;
+    
+    /* Round up to the next range, so every block on the list found fits */
+    if (size >= HEAP_SMALL_BLOCK) {
+        size += ((size_t)1 << (find_msb_set((uint32_t)size) - 1 - HEAP_SL_LOG2)) - 1;
+    }
+    heap_mapping(size, &fl, &sl);
+    if (fl >= HEAP_FL_COUNT) {
+        return NULL;
+    }
+    
+    sl_map = sl_bitmap[fl] & (~0U << sl);
+    if (sl_map == 0) {
+        uint32_t fl_map = fl_bitmap & (~0U << (fl + 1));
+        
+        if (fl_map == 0) {
+            return NULL;
+        }
+        fl = find_lsb_set(fl_map) - 1;
+        sl_map = sl_bitmap[fl];
+    }
+    sl = find_lsb_set(sl_map) - 1;
+    
+    struct heap_block *block = free_lists[fl][sl];
+    
+    heap_remove(block);
+    return block;
+}
+
+/* Split a used block at offset bytes into its payload; the new upper block is returned */
+static struct heap_block *heap_split(struct heap_block *block, size_t offset)
+{
+    struct heap_block *upper = (struct heap_block *)(block_payload(block) + offset);
+    
+    upper->prev_phys = block;
+    upper->size = block_size(block) - offset - HEAP_HEADER_SIZE;
+    block_next(upper)->prev_phys = upper;
+    block->size = offset;
+    return upper;
+}
+
+/* Return a block to the free lists, merged with free neighbours */
+static void heap_release(struct heap_block *block)
+{
+    struct heap_block *next = block_next(block);
+    struct heap_block *prev = block->prev_phys;
+    
+    if (next->size & HEAP_BLOCK_FREE) {
+        heap_remove(next);
+        block->size += HEAP_HEADER_SIZE + next->size;
+        block_next(block)->prev_phys = block;
+    }
+    if (prev != NULL && (prev->size & HEAP_BLOCK_FREE)) {
+        heap_remove(prev);
+        prev->size += HEAP_HEADER_SIZE + block->size;
+        block_next(prev)->prev_phys = prev;
+        block = prev;
+    }
+    heap_insert(block);
+}
+
+/* The used heap block whose payload is ptr, or NULL */
+static struct heap_block *heap_block_of(void *ptr)
+{
+    uint8_t *p = ptr;
+    
+    if (p < heap_start + HEAP_HEADER_SIZE || p >= heap_end || ((uintptr_t)p & (HEAP_ALIGN - 1))) {
+        return NULL;
+    }
+    
+    struct heap_block *block = (struct heap_block *)(p - HEAP_HEADER_SIZE);
+    
+    if ((block->size & HEAP_BLOCK_FREE) || block->size > (size_t)(heap_end - p) - HEAP_HEADER_SIZE) {
+        return NULL;
+    }
+    return (block_next(block)->prev_phys == block) ? block : NULL;
+}
+
+/* Index of the pool holding ptr at a block boundary, or -1 */
+static int pool_of(void *ptr, uint32_t *block)
+{
+    uint8_t *p = ptr;
+    
+    for (int i = 0; i < SECURE_HEAP_POOL_COUNT; i++) {
+        size_t offset = (size_t)(p - pool_base[i]);
+        
+        if (p >= pool_base[i] && offset < pool_config[i].block_size * pool_config[i].blocks) {
+            if (offset % pool_config[i].block_size != 0) {
+                return -1;
+            }
+            *block = offset / pool_config[i].block_size;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* The smallest pool for size, if it would be at least half used; or -1 */
+static int pool_for(size_t size, size_t align)
+{
+    if (align > POOL_ALIGN) {
+        return -1;
+    }
+    for (int i = 0; i < SECURE_HEAP_POOL_COUNT; i++) {
+        if (size <= pool_config[i].block_size) {
+            return (i == 0 || size > pool_config[i].block_size / 2) ? i : -1;
+        }
+    }
+    return -1;
+}
+
+int secure_heap_init(void *mem, size_t size)
+{
+    uint8_t *start = (uint8_t *)ROUND_UP((uintptr_t)mem, POOL_ALIGN);
+    uint8_t *end = (uint8_t *)mem + size;
+    uint8_t *cursor = start;
+    size_t pools_size = 0;
+    
+    if (mem == NULL || size > BIT(SECURE_HEAP_MAX_LOG2)) {
+        LOG_ERR("Invalid secure heap region: %u bytes", (unsigned int)size);
+        return SECURE_HEAP_ERR_PARAM;
+    }
+    
+    for (int i = 0; i < SECURE_HEAP_POOL_COUNT; i++) {
+        pools_size += pool_config[i].block_size * pool_config[i].blocks;
+    }
+    if (size < (size_t)(start - (uint8_t *)mem) + pools_size + 2 * HEAP_HEADER_SIZE + HEAP_MIN_BLOCK) {
+        LOG_ERR("Secure heap region too small: %u bytes", (unsigned int)size);
+        return SECURE_HEAP_ERR_PARAM;
+    }
+    
+    k_spinlock_key_t key = k_spin_lock(&heap_lock);
+    
+    memset(mem, 0, size);
+    memset(&heap_stats, 0, sizeof(heap_stats));
+    memset(free_lists, 0, sizeof(free_lists));
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    fl_bitmap = 0;
+    region_start = mem;
+    region_size = size;
+    heap_stats.total_bytes = size;
+    
+    for (int i = 0; i < SECURE_HEAP_POOL_COUNT; i++) {
+        pool_base[i] = cursor;
+        pool_used[i] = 0;
+        cursor += pool_config[i].block_size * pool_config[i].blocks;
+        heap_stats.pools[i].min_size = pool_config[i].block_size;
+        heap_stats.pools[i].free_blocks = pool_config[i].blocks;
+    }
+    
+    for (int i = 0; i < HEAP_FL_COUNT; i++) {
+        heap_stats.classes[i].min_size = (i == 0) ? 0 : (size_t)1 << (i + HEAP_FL_SHIFT - 1);
+    }
+    
+    /* One free block spanning the heap, then the sentinel */
+    heap_start = cursor;
+    heap_end = (uint8_t *)ROUND_DOWN((uintptr_t)end, HEAP_ALIGN);
+    
+    struct heap_block *first = (struct heap_block *)heap_start;
+    
+    first->prev_phys = NULL;
+    first->size = (size_t)(heap_end - heap_start) - 2 * HEAP_HEADER_SIZE;
+    
+    struct heap_block *sentinel = block_next(first);
+    
+    sentinel->prev_phys = first;
+    sentinel->size = 0;
+    heap_insert(first);
+    
+    k_spin_unlock(&heap_lock, key);
+    
+    LOG_INF("Secure heap: %u bytes in pools, %u bytes of heap",
+            (unsigned int)pools_size, (unsigned int)(heap_end - heap_start));
+    return SECURE_HEAP_SUCCESS;
+}
+
+void *secure_heap_alloc(size_t size, size_t align)
+{
+    if (size == 0 || (align & (align - 1)) != 0 || region_start == NULL) {
+        return NULL;
+    }
+    align = MAX(align, HEAP_ALIGN);
+    
+    k_spinlock_key_t key = k_spin_lock(&heap_lock);
+    int pool = pool_for(size, align);
+    
+    if (pool >= 0) {
+        uint32_t all = (pool_config[pool].blocks == 32) ? ~0U : BIT(pool_config[pool].blocks) - 1;
+        uint32_t free_mask = ~pool_used[pool] & all;
+        
+        if (free_mask != 0) {
+            uint32_t n = find_lsb_set(free_mask) - 1;
+            
+            pool_used[pool] |= BIT(n);
+            class_count_alloc(&heap_stats.pools[pool]);
+            heap_stats.pools[pool].free_blocks--;
+            heap_stats.used_bytes += pool_config[pool].block_size;
+            heap_stats.peak_used_bytes = MAX(heap_stats.peak_used_bytes, heap_stats.used_bytes);
+            k_spin_unlock(&heap_lock, key);
+            return pool_base[pool] + n * pool_config[pool].block_size;
+        }
+        /* Pool exhausted; the heap may still have room */
+        heap_stats.pools[pool].failures++;
+    }
+    
+    struct heap_block *block = NULL;
+    unsigned int fl, sl;
+    
+    if (size <= (size_t)(heap_end - heap_start) && align <= (size_t)(heap_end - heap_start)) {
+        size = ROUND_UP(size, HEAP_ALIGN);
+        /* Room to move the payload up to the alignment with a free block below it */
+        block = heap_take((align > HEAP_ALIGN) ? size + align + HEAP_MIN_BLOCK : size);
+    }
+    if (block == NULL) {
+        heap_mapping(MIN(size, (size_t)(heap_end - heap_start)), &fl, &sl);
+        heap_stats.classes[MIN(fl, HEAP_FL_COUNT - 1)].failures++;
+        k_spin_unlock(&heap_lock, key);
+        return NULL;
+    }
+    
+    if (align > HEAP_ALIGN) {
+        uintptr_t payload = (uintptr_t)block_payload(block);
+        uintptr_t aligned = ROUND_UP(payload, align);
+        
+        if (aligned != payload && aligned - payload < HEAP_MIN_BLOCK) {
+            aligned = ROUND_UP(payload + HEAP_MIN_BLOCK, align);
+        }
+        if (aligned != payload) {
+            struct heap_block *below = block;
+            
+            block = heap_split(below, aligned - payload - HEAP_HEADER_SIZE);
+            heap_insert(below);
+        }
+    }
+    
+    /* Give back the tail if it can hold a block of its own */
+    if (block_size(block) >= size + HEAP_MIN_BLOCK) {
+        heap_insert(heap_split(block, size));
+    }
+    
+    heap_mapping(block_size(block), &fl, &sl);
+    class_count_alloc(&heap_stats.classes[fl]);
+    heap_stats.used_bytes += HEAP_HEADER_SIZE + block_size(block);
+    heap_stats.peak_used_bytes = MAX(heap_stats.peak_used_bytes, heap_stats.used_bytes);
+    k_spin_unlock(&heap_lock, key);
+    
+    return block_payload(block);
+}
+
+size_t secure_heap_block_size(void *ptr)
+{
+    k_spinlock_key_t key = k_spin_lock(&heap_lock);
+    struct heap_block *block;
+    uint32_t n;
+    int pool = pool_of(ptr, &n);
+    size_t size = 0;
+    
+    if (pool >= 0) {
+        if (pool_used[pool] & BIT(n)) {
+            size = pool_config[pool].block_size;
+        }
+    } else if ((block = heap_block_of(ptr)) != NULL) {
+        size = block_size(block);
+    }
+    
+    k_spin_unlock(&heap_lock, key);
+    return size;
+}
+
+int secure_heap_free(void *ptr)
+{
+    size_t size = secure_heap_block_size(ptr);
+    
+    if (size == 0) {
+        LOG_ERR("Free of a pointer that is not a secure block: %p", ptr);
+        return SECURE_HEAP_ERR_PTR;
+    }
+    
+    /* Outside the lock; the block stays ours until it is released below */
+    memset(ptr, 0, size);
+    
+    k_spinlock_key_t key = k_spin_lock(&heap_lock);
+    struct heap_block *block;
+    uint32_t n;
+    int pool = pool_of(ptr, &n);
+    int ret = SECURE_HEAP_SUCCESS;
+    
+    if (pool >= 0 && (pool_used[pool] & BIT(n))) {
+        pool_used[pool] &= ~BIT(n);
+        heap_stats.pools[pool].in_use--;
+        heap_stats.pools[pool].free_blocks++;
+        heap_stats.used_bytes -= pool_config[pool].block_size;
+    } else if (pool < 0 && (block = heap_block_of(ptr)) != NULL) {
+        unsigned int fl, sl;
+        
+        heap_mapping(block_size(block), &fl, &sl);
+        heap_stats.classes[fl].in_use--;
+        heap_stats.used_bytes -= HEAP_HEADER_SIZE + block_size(block);
+        heap_release(block);
+    } else {
+        /* Freed by someone else meanwhile */
+        ret = SECURE_HEAP_ERR_PTR;
+    }
+    
+    k_spin_unlock(&heap_lock, key);
+    return ret;
+}
+
+bool secure_heap_contains(const void *ptr, size_t size)
+{
+    const uint8_t *p = ptr;
+    
+    return region_start != NULL && p >= region_start && size <= region_size &&
+           (size_t)(p - region_start) <= region_size - size;
+}
+
+void secure_heap_get_stats(struct secure_heap_stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&heap_lock);
+    
+    *stats = heap_stats;
+    stats->largest_free = 0;
+    if (fl_bitmap != 0) {
+        unsigned int fl = find_msb_set(fl_bitmap) - 1;
+        unsigned int sl = find_msb_set(sl_bitmap[fl]) - 1;
+        
+        if (fl == 0) {
+            stats->largest_free = (size_t)sl << HEAP_ALIGN_LOG2;
+        } else {
+            size_t base = (size_t)1 << (fl + HEAP_FL_SHIFT - 1);
+            
+            stats->largest_free = base + sl * (base >> HEAP_SL_LOG2);
+        }
+    }
+    
+    k_spin_unlock(&heap_lock, key);
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2025 CRUSTy-Core
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SECURE_HEAP_H
+#define SECURE_HEAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Allocator for the MPU-protected secure memory region.
+ *
+ * Requests that fit one of the fixed-block pools are served from it;
+ * everything else comes from a two-level segregated fit (TLSF) heap that
+ * splits and coalesces blocks. Both allocate and free in constant time,
+ * independent of how full or fragmented the region is. Blocks are wiped
+ * when they are freed.
+ */
+
+/** Return codes */
+#define SECURE_HEAP_SUCCESS         0
+#define SECURE_HEAP_ERR_PARAM      -1
+#define SECURE_HEAP_ERR_PTR        -2
+
+/** Largest region the heap manages, as a power of two */
+#define SECURE_HEAP_MAX_LOG2        16
+
+/** Heap size classes; each covers a power-of-two range of block sizes */
+#define SECURE_HEAP_CLASS_COUNT     (SECURE_HEAP_MAX_LOG2 - (sizeof(void *) == 8 ? 7 : 6) + 2)
+
+/** Fixed-block pools: AES keys and tags, AES-GCM contexts, link-sized buffers */
+#define SECURE_HEAP_POOL_COUNT      3
+
+/**
+ * @brief Usage of one pool or heap size class
+ */
+struct secure_heap_class_stats {
+    size_t min_size;            /**< Smallest block of the class (pools: block size) */
+    uint32_t in_use;            /**< Live allocations */
+    uint32_t peak;              /**< Most live allocations at once */
+    uint32_t failures;          /**< Requests it could not serve; pools pass those to the heap */
+    uint32_t free_blocks;       /**< Blocks available (pools: free slots) */
+};
+
+/**
+ * @brief Usage of the whole secure region
+ */
+struct secure_heap_stats {
+    size_t total_bytes;         /**< Region size */
+    size_t used_bytes;          /**< Handed out, including pool slack and headers */
+    size_t peak_used_bytes;
+    size_t largest_free;        /**< Lower bound of the largest heap block available */
+    struct secure_heap_class_stats pools[SECURE_HEAP_POOL_COUNT];
+    struct secure_heap_class_stats classes[SECURE_HEAP_CLASS_COUNT];
+};
+
+/**
+ * @brief Take over a memory region
+ *
+ * Carves the pools from the start of the region and gives the rest to the
+ * heap. Anything allocated before is lost.
+ *
+ * @param mem Start of the region
+ * @param size Size of the region in bytes, at most 2^SECURE_HEAP_MAX_LOG2
+ * @return SECURE_HEAP_SUCCESS, or SECURE_HEAP_ERR_PARAM if the region is too small or too large
+ */
+int secure_heap_init(void *mem, size_t size);
+
+/**
+ * @brief Allocate a block
+ *
+ * @param size Bytes needed
+ * @param align Alignment, a power of two; 0 for the default of 2 pointers
+ * @return Pointer to the block, or NULL if nothing fits
+ */
+void *secure_heap_alloc(size_t size, size_t align);
+
+/**
+ * @brief Wipe and free a block
+ *
+ * @param ptr Block returned by secure_heap_alloc()
+ * @return SECURE_HEAP_SUCCESS, or SECURE_HEAP_ERR_PTR if ptr is not a live block
+ */
+int secure_heap_free(void *ptr);
+
+/**
+ * @brief Usable size of a block
+ *
+ * @param ptr Block returned by secure_heap_alloc()
+ * @return Bytes the block can hold, at least the size requested; 0 if ptr is not a live block
+ */
+size_t secure_heap_block_size(void *ptr);
+
+/**
+ * @brief Check whether memory lies in the region
+ *
+ * @param ptr Start of the memory
+ * @param size Size of the memory in bytes
+ * @return true if all of it is inside the region
+ */
+bool secure_heap_contains(const void *ptr, size_t size);
+
+/**
+ * @brief Read usage statistics
+ *
+ * @param stats Filled in
+ */
+void secure_heap_get_stats(struct secure_heap_stats *stats);
+
+#endif /* SECURE_HEAP_H */
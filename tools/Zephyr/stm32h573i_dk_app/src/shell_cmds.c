@@ -15,6 +15,7 @@
 
 #include "shell_cmds.h"
 #include "crypto_ops.h"
+#include "secure_heap.h"
 
 LOG_MODULE_REGISTER(shell_cmds, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -271,6 +272,169 @@ static int cmd_crypto_decrypt_aes_gcm(const struct shell *sh, size_t argc, char
     return 0;
 }
 
+/* Payload sizes `crypto bench` sweeps unless given one */
+static const size_t bench_sizes[] = { 16, 64, 256, 1024, CRYPTO_OPS_BENCH_MAX_LEN };
+
+struct bench_row {
+    const char *op;
+    const char *impl;
+    const struct crypto_ops_bench_timing *timing;
+};
+
+/* Rows of one result that have something to show */
+static size_t bench_rows(const struct crypto_ops_bench_result *r, bool hw_rng,
+                         struct bench_row rows[6])
+{
+    size_t n = 0;
+    
+    rows[n++] = (struct bench_row){ "aes-gcm-encrypt", "mbedtls", &r->sw_encrypt };
+    rows[n++] = (struct bench_row){ "aes-gcm-decrypt", "mbedtls", &r->sw_decrypt };
+    if (r->hw_available) {
+        const char *impl = r->hw_dma ? "aes-dma" : "aes";
+        
+        rows[n++] = (struct bench_row){ "aes-gcm-encrypt", impl, &r->hw_encrypt };
+        rows[n++] = (struct bench_row){ "aes-gcm-decrypt", impl, &r->hw_decrypt };
+    }
+    rows[n++] = (struct bench_row){ "sha256", "mbedtls", &r->sha256 };
+    rows[n++] = (struct bench_row){ "rng", hw_rng ? "rng" : "software", &r->rng };
+    return n;
+}
+
+static void bench_print(const struct shell *sh, bool machine, size_t len, unsigned int iterations,
+                        const struct crypto_ops_bench_result *r, bool hw_rng)
+{
+    struct bench_row rows[6];
+    size_t count = bench_rows(r, hw_rng, rows);
+    
+    for (size_t i = 0; i < count; i++) {
+        const struct crypto_ops_bench_timing *t = rows[i].timing;
+        
+        if (machine) {
+            shell_print(sh, "%s,%s,%u,%u,%u,%u,%u", rows[i].op, rows[i].impl, (unsigned int)len,
+                        iterations, t->avg_cycles, t->min_cycles, t->max_cycles);
+            continue;
+        }
+        
+        /* Cycles per byte in hundredths, throughput from the average */
+        uint32_t cpb = (uint32_t)(((uint64_t)t->avg_cycles * 100U) / len);
+        uint32_t kb_s = (uint32_t)(((uint64_t)len * r->cycles_per_sec) / MAX(t->avg_cycles, 1U) / 1024U);
+        
+        shell_print(sh, "  %-15s %-8s %5u %9u %9u %9u %6u.%02u %8u", rows[i].op, rows[i].impl,
+                    (unsigned int)len, t->avg_cycles, t->min_cycles, t->max_cycles,
+                    cpb / 100U, cpb % 100U, kb_s);
+    }
+}
+
+static int cmd_crypto_bench(const struct shell *sh, size_t argc, char **argv)
+{
+    bool machine = false;
+    size_t single_len = 0;
+    unsigned int iterations = 100;
+    bool has_hw_aes, has_hw_rng, has_hw_sha, has_hw_pka;
+    bool mismatch = false;
+    size_t arg = 1;
+    
+    /* -m: comma-separated rows for host tooling */
+    if (arg < argc && strcmp(argv[arg], "-m") == 0) {
+        machine = true;
+        arg++;
+    }
+    
+    if (arg < argc) {
+        single_len = atoi(argv[arg++]);
+        if (single_len == 0 || single_len > CRYPTO_OPS_BENCH_MAX_LEN) {
+            shell_error(sh, "Invalid length. Must be between 1 and %u", CRYPTO_OPS_BENCH_MAX_LEN);
+            return -1;
+        }
+    }
+    
+    if (arg < argc) {
+        iterations = atoi(argv[arg++]);
+        if (iterations == 0) {
+            shell_error(sh, "Invalid iteration count");
+            return -1;
+        }
+    }
+    
+    crypto_ops_get_capabilities(&has_hw_aes, &has_hw_rng, &has_hw_sha, &has_hw_pka);
+    
+    for (size_t i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+        size_t len = single_len ? single_len : bench_sizes[i];
+        struct crypto_ops_bench_result result;
+        int ret = crypto_ops_benchmark(len, iterations, &result);
+        
+        if (ret != 0) {
+            shell_error(sh, "Benchmark of %u bytes failed: %d", (unsigned int)len, ret);
+            return -1;
+        }
+        
+        if (i == 0) {
+            if (machine) {
+                shell_print(sh, "# crypto-bench v1 board=%s counter=%s hz=%u", CONFIG_BOARD,
+                            result.dwt ? "dwt" : "timer", result.cycles_per_sec);
+                shell_print(sh, "op,impl,bytes,runs,avg_cycles,min_cycles,max_cycles");
+            } else {
+                shell_print(sh, "Crypto benchmark on %s, %u runs each, %s cycles at %u Hz:",
+                            CONFIG_BOARD, iterations, result.dwt ? "DWT core" : "system timer",
+                            result.cycles_per_sec);
+                shell_print(sh, "  %-15s %-8s %5s %9s %9s %9s %9s %8s", "Operation", "Impl",
+                            "Bytes", "Cycles", "Min", "Max", "Cyc/B", "KB/s");
+            }
+        }
+        
+        bench_print(sh, machine, len, iterations, &result, has_hw_rng);
+        mismatch = mismatch || (result.hw_available && !result.outputs_match);
+        
+        if (single_len) {
+            break;
+        }
+    }
+    
+    if (mismatch) {
+        shell_error(sh, "Hardware and software AES-GCM results differ");
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int cmd_secmem_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+    
+    struct secure_heap_stats stats;
+    
+    secure_heap_get_stats(&stats);
+    if (stats.total_bytes == 0) {
+        shell_error(sh, "Secure memory not initialized");
+        return -1;
+    }
+    
+    shell_print(sh, "Secure memory: %u of %u bytes used, peak %u, largest free block %u+",
+                (unsigned int)stats.used_bytes, (unsigned int)stats.total_bytes,
+                (unsigned int)stats.peak_used_bytes, (unsigned int)stats.largest_free);
+    shell_print(sh, "  %-12s %6s %6s %6s %6s", "Class", "Used", "Peak", "Free", "Failed");
+    for (int i = 0; i < SECURE_HEAP_POOL_COUNT; i++) {
+        const struct secure_heap_class_stats *c = &stats.pools[i];
+        
+        shell_print(sh, "  pool %-7u %6u %6u %6u %6u", (unsigned int)c->min_size,
+                    c->in_use, c->peak, c->free_blocks, c->failures);
+    }
+    for (int i = 0; i < SECURE_HEAP_CLASS_COUNT; i++) {
+        const struct secure_heap_class_stats *c = &stats.classes[i];
+        
+        /* Classes that never saw a request are noise */
+        if (c->peak == 0 && c->failures == 0 && c->free_blocks == 0) {
+            continue;
+        }
+        shell_print(sh, "  heap %-6u+ %6u %6u %6u %6u", (unsigned int)c->min_size,
+                    c->in_use, c->peak, c->free_blocks, c->failures);
+    }
+    
+    return 0;
+}
+
 /* Create subcommand sets */
 SHELL_STATIC_SUBCMD_SET_CREATE(sub_crypto_hash,
     SHELL_CMD_ARG(sha256, NULL, "Compute SHA-256 hash", cmd_crypto_hash_sha256, 2, 0),
@@ -291,6 +455,7 @@ SHELL_STATIC_SUBCMD_SET_CREATE(sub_crypto,
     SHELL_CMD_ARG(status, NULL, "Show crypto hardware status", cmd_crypto_status, 1, 0),
     SHELL_CMD_ARG(selftest, NULL, "Run crypto self-test", cmd_crypto_selftest, 1, 0),
     SHELL_CMD_ARG(random, NULL, "Generate random bytes: random [length]", cmd_crypto_random, 1, 1),
+    SHELL_CMD_ARG(bench, NULL, "Time AES-GCM, SHA-256 and RNG: bench [-m] [length] [runs]", cmd_crypto_bench, 1, 3),
     SHELL_CMD(hash, &sub_crypto_hash, "Hash functions", NULL),
     SHELL_CMD(encrypt, &sub_crypto_encrypt, "Encryption functions", NULL),
     SHELL_CMD(decrypt, &sub_crypto_decrypt, "Decryption functions", NULL),
@@ -300,6 +465,13 @@ SHELL_STATIC_SUBCMD_SET_CREATE(sub_crypto,
 /* Register the main "crypto" command */
 SHELL_CMD_REGISTER(crypto, &sub_crypto, "Cryptographic operations", NULL);
 
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_secmem,
+    SHELL_CMD_ARG(stats, NULL, "Show secure memory usage per pool and size class", cmd_secmem_stats, 1, 0),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(secmem, &sub_secmem, "Secure memory allocator", NULL);
+
 int shell_cmds_init(void)
 {
     LOG_INF("Shell commands initialized");
@@ -13,6 +13,7 @@
 /* Hardware-specific includes */
 #include <zephyr/device.h>
 #include <zephyr/drivers/uart.h>
+#include <zephyr/sys/ring_buffer.h>
 #endif
 
 LOG_MODULE_REGISTER(uart_comm, CONFIG_LOG_DEFAULT_LEVEL);
@@ -28,54 +29,168 @@ static bool uart_initialized = false;
 static K_MUTEX_DEFINE(uart_mutex);
 
 #ifndef CONFIG_BOARD_QEMU_CORTEX_M3
+#ifndef CONFIG_UART_ASYNC_API
+#error "uart_comm needs CONFIG_UART_ASYNC_API and DMA channels on the UART"
+#endif
+
 /* Hardware-specific variables */
 static const struct device *uart_dev;
 
-/* UART interrupt callback to handle received data */
-static void uart_cb(const struct device *dev, void *user_data)
+/*
+ * TX: senders copy into tx_ring and return; the driver sends the ring's
+ * contiguous data straight from the ring by DMA, one uart_tx() at a time,
+ * and the next transfer starts from the completion event.
+ */
+static uint8_t tx_ring_storage[UART_COMM_TX_RING_SIZE];
+static struct ring_buf tx_ring;
+static struct k_spinlock tx_lock;
+static size_t tx_in_flight;     /* Bytes claimed by the running uart_tx(), 0 when idle */
+static K_SEM_DEFINE(tx_space_sem, 0, 1);
+static K_SEM_DEFINE(tx_idle_sem, 0, 1);
+
+/*
+ * RX: DMA fills the two rx_dma_bufs in turn; the event handler moves what
+ * arrived into rx_ring, and rx_work splits it into lines for the callback
+ * in thread context.
+ */
+static uint8_t rx_dma_bufs[2][UART_COMM_RX_DMA_BUFFER_SIZE];
+static uint8_t rx_dma_next;
+static int32_t rx_idle_timeout_us;
+static uint8_t rx_ring_storage[UART_COMM_RX_RING_SIZE];
+static struct ring_buf rx_ring;
+static struct k_spinlock rx_lock;
+static uint32_t rx_dropped;
+static K_SEM_DEFINE(rx_data_sem, 0, 1);
+static struct k_work rx_work;
+
+/* Start the next DMA transfer if data is queued; call with tx_lock held */
+static void uart_tx_start_locked(void)
 {
-    uint8_t c;
+    uint8_t *chunk;
+    uint32_t len = ring_buf_get_claim(&tx_ring, &chunk, UART_COMM_TX_RING_SIZE);
 
-    if (!uart_irq_update(dev)) {
+    if (len == 0) {
+        tx_in_flight = 0;
+        k_sem_give(&tx_idle_sem);
         return;
     }
 
-    if (uart_irq_rx_ready(dev)) {
-        /* Read all available data */
-        while (uart_fifo_read(dev, &c, 1) == 1) {
-            if (rx_buf_pos < UART_COMM_RX_BUFFER_SIZE - 1) {
-                rx_buf[rx_buf_pos++] = c;
-                
-                /* Check for line ending or buffer full */
-                if (c == '\n' || rx_buf_pos >= UART_COMM_RX_BUFFER_SIZE - 1) {
-                    /* Null terminate the string */
-                    rx_buf[rx_buf_pos] = '\0';
-                    
-                    /* Process the received data */
-                    if (user_rx_callback != NULL) {
-                        /* Copy data to secondary buffer for callback processing */
-                        k_mutex_lock(&uart_mutex, K_FOREVER);
-                        memcpy(rx_secondary_buf, rx_buf, rx_buf_pos + 1);
-                        size_t len = rx_buf_pos;
-                        rx_buf_pos = 0;
-                        k_mutex_unlock(&uart_mutex);
-                        
-                        /* Call user callback with received data */
-                        user_rx_callback(rx_secondary_buf, len);
-                    } else {
-                        rx_buf_pos = 0;
-                    }
-                }
-            } else {
-                /* Buffer overflow - reset position */
-                rx_buf_pos = 0;
-                LOG_WRN("UART RX buffer overflow");
-            }
+    int ret = uart_tx(uart_dev, chunk, len, SYS_FOREVER_US);
+    if (ret != 0) {
+        /* Nothing will complete, so drop the queue rather than stall senders */
+        LOG_ERR("UART TX failed to start: %d", ret);
+        ring_buf_get_finish(&tx_ring, 0);
+        ring_buf_reset(&tx_ring);
+        tx_in_flight = 0;
+        k_sem_give(&tx_space_sem);
+        k_sem_give(&tx_idle_sem);
+        return;
+    }
+    tx_in_flight = len;
+}
+
+static int uart_rx_start(void)
+{
+    rx_dma_next = 1;
+    return uart_rx_enable(uart_dev, rx_dma_bufs[0], sizeof(rx_dma_bufs[0]), rx_idle_timeout_us);
+}
+
+/* UART async event handler, called from the DMA and UART interrupts */
+static void uart_async_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+    k_spinlock_key_t key;
+
+    switch (evt->type) {
+    case UART_TX_DONE:
+    case UART_TX_ABORTED:
+        /* After an abort, the unsent rest is still claimed and goes out again */
+        key = k_spin_lock(&tx_lock);
+        ring_buf_get_finish(&tx_ring, evt->data.tx.len);
+        uart_tx_start_locked();
+        k_spin_unlock(&tx_lock, key);
+        k_sem_give(&tx_space_sem);
+        break;
+
+    case UART_RX_RDY: {
+        key = k_spin_lock(&rx_lock);
+        uint32_t stored = ring_buf_put(&rx_ring, evt->data.rx.buf + evt->data.rx.offset,
+                                       evt->data.rx.len);
+        rx_dropped += evt->data.rx.len - stored;
+        k_spin_unlock(&rx_lock, key);
+
+        k_sem_give(&rx_data_sem);
+        if (user_rx_callback != NULL) {
+            k_work_submit(&rx_work);
         }
+        break;
     }
 
-    if (uart_irq_tx_ready(dev)) {
-        /* TX handling if needed */
+    case UART_RX_BUF_REQUEST:
+        /* The driver released the other buffer before asking for this one */
+        uart_rx_buf_rsp(dev, rx_dma_bufs[rx_dma_next], sizeof(rx_dma_bufs[0]));
+        rx_dma_next ^= 1;
+        break;
+
+    case UART_RX_DISABLED:
+        /* Reception stops after a line error; keep listening */
+        uart_rx_start();
+        break;
+
+    case UART_RX_STOPPED:
+        LOG_WRN("UART RX stopped: reason %d", evt->data.rx_stop.reason);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Hand the received lines to the user callback, outside interrupt context */
+static void uart_rx_work_handler(struct k_work *work)
+{
+    uint8_t chunk[32];
+    uint32_t count;
+    uint32_t dropped = 0;
+
+    do {
+        k_spinlock_key_t key = k_spin_lock(&rx_lock);
+        count = ring_buf_get(&rx_ring, chunk, sizeof(chunk));
+        dropped += rx_dropped;
+        rx_dropped = 0;
+        k_spin_unlock(&rx_lock, key);
+
+        k_mutex_lock(&uart_mutex, K_FOREVER);
+        for (uint32_t i = 0; i < count; i++) {
+            rx_buf[rx_buf_pos++] = chunk[i];
+
+            /* Check for line ending or buffer full */
+            if (chunk[i] != '\n' && rx_buf_pos < UART_COMM_RX_BUFFER_SIZE - 1) {
+                continue;
+            }
+
+            /* Null terminate and copy to secondary buffer for callback processing */
+            rx_buf[rx_buf_pos] = '\0';
+            memcpy(rx_secondary_buf, rx_buf, rx_buf_pos + 1);
+            size_t len = rx_buf_pos;
+            rx_buf_pos = 0;
+            k_mutex_unlock(&uart_mutex);
+
+            /* Call user callback with received data */
+            if (user_rx_callback != NULL) {
+                user_rx_callback(rx_secondary_buf, len);
+            }
+
+            /* The callback may have handed the stream to uart_comm_read() */
+            if (user_rx_callback == NULL) {
+                return;
+            }
+            k_mutex_lock(&uart_mutex, K_FOREVER);
+        }
+        k_mutex_unlock(&uart_mutex);
+    } while (count > 0);
+
+    if (dropped > 0) {
+        LOG_WRN("UART RX buffer overflow, %u bytes dropped", dropped);
     }
 }
 #else
@@ -186,13 +301,27 @@ int uart_comm_init(const char *device_name, uint32_t baud_rate, uart_rx_callback
         return UART_COMM_ERR_INIT;
     }
 
-    /* Initialize the receive buffer */
+    /* Initialize the receive and transmit buffers */
     rx_buf_pos = 0;
+    ring_buf_init(&rx_ring, sizeof(rx_ring_storage), rx_ring_storage);
+    ring_buf_init(&tx_ring, sizeof(tx_ring_storage), tx_ring_storage);
+    tx_in_flight = 0;
+    k_work_init(&rx_work, uart_rx_work_handler);
 
-    /* Set up the interrupt callback if a user callback was provided */
-    if (rx_callback != NULL) {
-        uart_irq_callback_set(uart_dev, uart_cb);
-        uart_irq_rx_enable(uart_dev);
+    ret = uart_callback_set(uart_dev, uart_async_cb, NULL);
+    if (ret != 0) {
+        LOG_ERR("UART %s has no async (DMA) support: %d", device_name, ret);
+        return UART_COMM_ERR_INIT;
+    }
+
+    /* Report a partly filled DMA buffer once the line has been idle for about 4 characters */
+    rx_idle_timeout_us = MAX(40000000 / baud_rate, 100);
+
+    /* Reception runs all the time; without a callback, uart_comm_receive() reads the buffered data */
+    ret = uart_rx_start();
+    if (ret != 0) {
+        LOG_ERR("Failed to enable UART reception: %d", ret);
+        return UART_COMM_ERR_INIT;
     }
 
     uart_initialized = true;
@@ -237,31 +366,32 @@ int uart_comm_send(const uint8_t *data, size_t len, k_timeout_t timeout)
     k_mutex_unlock(&uart_mutex);
     return UART_COMM_SUCCESS;
 #else
-    /* Send data using Zephyr's UART API */
-    for (size_t i = 0; i < len; i++) {
-        /* Poll until UART TX buffer is not full or timeout */
-        int64_t start_time = k_uptime_get();
-        bool tx_timeout = false;
+    /*
+     * Queue the data for DMA and return; the mutex only keeps concurrent
+     * senders' data from interleaving. Data that fits the ring is queued
+     * whole or not at all, larger data a ring's worth at a time.
+     */
+    k_timepoint_t end = sys_timepoint_calc(timeout);
+    size_t queued = 0;
+    
+    while (queued < len) {
+        size_t piece = MIN(len - queued, UART_COMM_TX_RING_SIZE);
+        k_spinlock_key_t key = k_spin_lock(&tx_lock);
         
-        while (uart_fifo_fill(uart_dev, &data[i], 1) != 1) {
-            /* Check for timeout if not waiting forever */
-            if (timeout.ticks != K_FOREVER.ticks && timeout.ticks != K_NO_WAIT.ticks) {
-                if (k_uptime_get() - start_time > timeout.ticks) {
-                    tx_timeout = true;
-                    break;
-                }
-            }
-            
-            /* For non-blocking mode, return immediately */
-            if (timeout.ticks == K_NO_WAIT.ticks) {
-                tx_timeout = true;
-                break;
+        if (ring_buf_space_get(&tx_ring) >= piece) {
+            ring_buf_put(&tx_ring, &data[queued], piece);
+            queued += piece;
+            if (tx_in_flight == 0) {
+                k_sem_reset(&tx_idle_sem);
+                uart_tx_start_locked();
             }
-            
-            k_yield();
+            k_spin_unlock(&tx_lock, key);
+            continue;
         }
+        k_spin_unlock(&tx_lock, key);
         
-        if (tx_timeout) {
+        /* Wait for a transfer to complete and free some room */
+        if (k_sem_take(&tx_space_sem, sys_timepoint_timeout(end)) != 0) {
             k_mutex_unlock(&uart_mutex);
             LOG_ERR("UART TX timeout");
             return UART_COMM_ERR_TIMEOUT;
@@ -290,9 +420,9 @@ int uart_comm_receive(uint8_t *data, size_t max_len, k_timeout_t timeout)
         LOG_WRN("UART is in interrupt mode, polling receive may interfere with callback");
     }
 
+#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
     k_mutex_lock(&uart_mutex, K_FOREVER);
     
-#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
     /* For QEMU simulation, we'll create simulated data if requested */
     static int qemu_read_counter = 0;
     size_t recv_count = 0;
@@ -325,14 +455,17 @@ int uart_comm_receive(uint8_t *data, size_t max_len, k_timeout_t timeout)
     k_mutex_unlock(&uart_mutex);
     return (recv_count > 0) ? recv_count : UART_COMM_ERR_TIMEOUT;
 #else
+    /* Read from the DMA-filled ring buffer, sleeping until more data arrives */
     size_t recv_count = 0;
-    int64_t start_time = k_uptime_get();
+    k_timepoint_t end = sys_timepoint_calc(timeout);
     
     while (recv_count < max_len) {
         uint8_t c;
-        int ret = uart_poll_in(uart_dev, &c);
+        k_spinlock_key_t key = k_spin_lock(&rx_lock);
+        uint32_t got = ring_buf_get(&rx_ring, &c, 1);
+        k_spin_unlock(&rx_lock, key);
         
-        if (ret == 0) {
+        if (got == 1) {
             /* Data received */
             data[recv_count++] = c;
             
@@ -340,27 +473,58 @@ int uart_comm_receive(uint8_t *data, size_t max_len, k_timeout_t timeout)
             if (c == '\n' || recv_count >= max_len) {
                 break;
             }
-        } else {
-            /* No data available, check timeout */
-            if (timeout.ticks != K_FOREVER.ticks) {
-                if (timeout.ticks == K_NO_WAIT.ticks || 
-                    (k_uptime_get() - start_time > timeout.ticks)) {
-                    break;
-                }
-            }
-            
-            /* Yield to other threads */
-            k_yield();
+        } else if (k_sem_take(&rx_data_sem, sys_timepoint_timeout(end)) != 0) {
+            break;
         }
     }
     
-    k_mutex_unlock(&uart_mutex);
-    
     /* Return number of bytes received or error code */
     return (recv_count > 0) ? recv_count : UART_COMM_ERR_TIMEOUT;
 #endif
 }
 
+int uart_comm_read(uint8_t *data, size_t max_len, k_timeout_t timeout)
+{
+    if (!uart_initialized) {
+        LOG_ERR("UART not initialized");
+        return UART_COMM_ERR_STATE;
+    }
+
+    if (data == NULL || max_len == 0) {
+        LOG_ERR("Invalid UART read parameters");
+        return UART_COMM_ERR_PARAM;
+    }
+
+#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
+    /* Nothing arrives in the simulation */
+    k_sleep(timeout);
+    return UART_COMM_ERR_TIMEOUT;
+#else
+    k_timepoint_t end = sys_timepoint_calc(timeout);
+    
+    while (true) {
+        k_spinlock_key_t key = k_spin_lock(&rx_lock);
+        uint32_t count = ring_buf_get(&rx_ring, data, max_len);
+        k_spin_unlock(&rx_lock, key);
+        
+        if (count > 0) {
+            return count;
+        }
+        if (k_sem_take(&rx_data_sem, sys_timepoint_timeout(end)) != 0) {
+            return UART_COMM_ERR_TIMEOUT;
+        }
+    }
+#endif
+}
+
+void uart_comm_set_rx_callback(uart_rx_callback_t rx_callback)
+{
+    k_mutex_lock(&uart_mutex, K_FOREVER);
+    user_rx_callback = rx_callback;
+    rx_buf_pos = 0;
+    k_mutex_unlock(&uart_mutex);
+}
+
 int uart_comm_flush_rx(void)
 {
     if (!uart_initialized) {
@@ -377,17 +541,46 @@ int uart_comm_flush_rx(void)
     /* Clear simulated data */
     LOG_DBG("QEMU: Flushing RX buffer");
 #else
-    /* Flush any pending data from the UART FIFO */
-    uint8_t dummy;
-    while (uart_poll_in(uart_dev, &dummy) == 0) {
-        /* Discard received character */
-    }
+    /* Discard whatever the DMA has delivered but nobody has read yet */
+    k_spinlock_key_t key = k_spin_lock(&rx_lock);
+    ring_buf_reset(&rx_ring);
+    k_spin_unlock(&rx_lock, key);
+    k_sem_reset(&rx_data_sem);
 #endif
     
     k_mutex_unlock(&uart_mutex);
     return UART_COMM_SUCCESS;
 }
 
+int uart_comm_flush_tx(k_timeout_t timeout)
+{
+    if (!uart_initialized) {
+        LOG_ERR("UART not initialized");
+        return UART_COMM_ERR_STATE;
+    }
+
+#ifdef CONFIG_BOARD_QEMU_CORTEX_M3
+    /* Simulated transmission completes immediately */
+    return UART_COMM_SUCCESS;
+#else
+    k_timepoint_t end = sys_timepoint_calc(timeout);
+    
+    while (true) {
+        k_spinlock_key_t key = k_spin_lock(&tx_lock);
+        bool idle = tx_in_flight == 0 && ring_buf_is_empty(&tx_ring);
+        k_spin_unlock(&tx_lock, key);
+        
+        if (idle) {
+            return UART_COMM_SUCCESS;
+        }
+        if (k_sem_take(&tx_idle_sem, sys_timepoint_timeout(end)) != 0) {
+            LOG_ERR("UART TX flush timeout");
+            return UART_COMM_ERR_TIMEOUT;
+        }
+    }
+#endif
+}
+
 bool uart_comm_is_ready(void)
 {
 #ifdef CONFIG_BOARD_QEMU_CORTEX_M3
@@ -23,6 +23,11 @@
 #define UART_COMM_RX_BUFFER_SIZE 256
 #define UART_COMM_TX_BUFFER_SIZE 256
 
+/* Hardware transport buffers: data queued for or received by DMA */
+#define UART_COMM_TX_RING_SIZE       2048
+#define UART_COMM_RX_RING_SIZE       2048
+#define UART_COMM_RX_DMA_BUFFER_SIZE 128
+
 /* UART callback types */
 typedef void (*uart_rx_callback_t)(const uint8_t *data, size_t len);
 
@@ -42,12 +47,15 @@ int uart_comm_init(const char *device_name, uint32_t baud_rate, uart_rx_callback
 /**
  * @brief Send data over UART
  *
- * This function sends data over the initialized UART device.
+ * This function queues data for transmission by DMA and returns as soon as it
+ * is queued, so the caller can keep working while it is sent. Data of up to
+ * UART_COMM_TX_RING_SIZE bytes is queued whole or not at all; use
+ * uart_comm_flush_tx() to wait until it has left the UART.
  *
  * @param data Pointer to the data to send
  * @param len Length of the data in bytes
- * @param timeout_ms Maximum time to wait for transmission to complete in milliseconds
- *        (0 for non-blocking, K_FOREVER for blocking until complete)
+ * @param timeout Maximum time to wait for room in the transmit queue
+ *        (K_NO_WAIT for non-blocking, K_FOREVER for blocking until queued)
  *
  * @return UART_COMM_SUCCESS on success, error code on failure
  */
@@ -57,7 +65,10 @@ int uart_comm_send(const uint8_t *data, size_t len, k_timeout_t timeout);
  * @brief Receive data from UART
  *
  * This function receives data from the UART device into the provided buffer.
- * Note: This is for polling mode. For interrupt-driven reception, use the callback.
+ * Reception runs by DMA in the background, so data that arrived since the
+ * last call is already buffered.
+ * Note: This is for use without a callback. With a callback, received lines
+ * are delivered to it from the system work queue instead.
  *
  * @param data Pointer to the buffer to store received data
  * @param max_len Maximum length of data to receive
@@ -68,6 +79,31 @@ int uart_comm_send(const uint8_t *data, size_t len, k_timeout_t timeout);
  */
 int uart_comm_receive(uint8_t *data, size_t max_len, k_timeout_t timeout);
 
+/**
+ * @brief Read raw received bytes
+ *
+ * Unlike uart_comm_receive(), this returns as soon as any data is
+ * available and does not stop at line endings, for binary protocols.
+ * Only useful without a callback.
+ *
+ * @param data Pointer to the buffer to store received data
+ * @param max_len Maximum length of data to read
+ * @param timeout Maximum time to wait for the first byte
+ *
+ * @return Number of bytes read on success, UART_COMM_ERR_TIMEOUT if none arrived
+ */
+int uart_comm_read(uint8_t *data, size_t max_len, k_timeout_t timeout);
+
+/**
+ * @brief Replace the receive callback
+ *
+ * With NULL, received data stays buffered for uart_comm_receive() and
+ * uart_comm_read(). Safe to call from the callback itself.
+ *
+ * @param rx_callback Callback function for received lines (can be NULL)
+ */
+void uart_comm_set_rx_callback(uart_rx_callback_t rx_callback);
+
 /**
  * @brief Clear UART receive buffer
  *
@@ -77,6 +113,15 @@ int uart_comm_receive(uint8_t *data, size_t max_len, k_timeout_t timeout);
  */
 int uart_comm_flush_rx(void);
 
+/**
+ * @brief Wait until all queued data has been transmitted
+ *
+ * @param timeout Maximum time to wait
+ *
+ * @return UART_COMM_SUCCESS on success, UART_COMM_ERR_TIMEOUT if data is still queued
+ */
+int uart_comm_flush_tx(k_timeout_t timeout);
+
 /**
  * @brief Check if UART device is ready
  *
@@ -12,6 +12,7 @@
 #include "gpio_control.h"
 #include "uart_demo.h"
 #include "gpio_test.h"
+#include "link_proto.h"
 
 LOG_MODULE_REGISTER(uart_demo, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -78,12 +79,19 @@ static void process_basic_commands(const uint8_t *data, size_t len)
         uart_comm_send((uint8_t *)"Echo: ", 6, K_FOREVER);
         uart_comm_send(data + 5, len - 5, K_FOREVER);
         uart_comm_send((uint8_t *)"\r\n", 2, K_FOREVER);
+    } else if (strncmp((char *)data, "LINK", 4) == 0) {
+        /* Switch the UART to the binary host link; the host resets it from here */
+        uart_comm_send((uint8_t *)"LINK READY\r\n", 12, K_FOREVER);
+        if (link_proto_start() != LINK_PROTO_SUCCESS) {
+            uart_comm_send((uint8_t *)"LINK FAILED\r\n", 13, K_FOREVER);
+        }
     } else if (strncmp((char *)data, "HELP", 4) == 0) {
         /* Send help information */
         const char *help_text = 
             "=== Basic Commands ===\r\n"
             "LED <led_num> <0|1> - Control LED (0=off, 1=on)\r\n"
             "ECHO <text> - Echo back the text\r\n"
+            "LINK - Switch to the binary host link until reset\r\n"
             "HELP - Show this help text\r\n"
             "\r\n"
             "=== GPIO Test Commands ===\r\n"